@@ -0,0 +1,970 @@
+#include<chrono>
+#include<thread>
+#include<atomic>
+#include<vector>
+#include<memory>
+#include<algorithm>
+#include<functional>
+#include<cstring>
+#include<fstream>
+#include<json.h>
+#include<sodium.h>
+
+#include "caster.hpp"
+#include "reactor.hpp"
+#include "messageDatabaseDefinition.hpp"
+#include "NMEAGGASentence.hpp"
+#include "SOMScopeGuard.hpp"
+#include "SOMException.hpp"
+#include "keyGraph.hpp"
+
+using namespace pylongps;
+
+const int DEFAULT_NUMBER_OF_BENCHMARK_SAMPLES = 15;
+const double DEFAULT_MINIMUM_SAMPLE_TIME = .05; //Seconds
+const double DEFAULT_REGRESSION_THRESHOLD = .10; //Fractional increase in median time per operation that counts as a regression
+const int COMPARE_EXIT_STATUS_NO_REGRESSIONS = 0; //Exit statuses of -compare (the number of regressions is printed, since exit statuses are truncated to 8 bits)
+const int COMPARE_EXIT_STATUS_REGRESSIONS = 1;
+const int COMPARE_EXIT_STATUS_ERROR = 2;
+const uint64_t MAXIMUM_ITERATIONS_PER_SAMPLE = 100000000;
+const uint64_t QUERY_BENCHMARK_NUMBER_OF_BASESTATIONS = 1000; //Size of the basestation table the query/retrieve benchmarks run against
+const int BENCHMARK_CASTER_BASE_PORT = 13000; //The in-process caster used for the query/credential benchmarks binds ports 13000-13005
+const uint64_t KEY_CASCADE_BENCHMARK_NUMBER_OF_CONNECTIONS = 10000; //Connections backed by the signing key removed in each cascade
+const std::string GGA_BENCHMARK_SENTENCE = "$GPGGA,123519.00,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47";
+
+/**
+This class holds the settings shared by all of the benchmarks in a run.
+*/
+class benchmarkSettings
+{
+public:
+int numberOfSamples = DEFAULT_NUMBER_OF_BENCHMARK_SAMPLES;
+double minimumSampleTime = DEFAULT_MINIMUM_SAMPLE_TIME;
+std::string filter; //Only benchmarks with names containing this are run
+};
+
+/**
+This class holds the timing of a benchmark (one entry per sample).
+*/
+class benchmarkResult
+{
+public:
+std::string name;
+uint64_t iterationsPerSample = 0;
+std::vector<double> nanosecondsPerOperation;
+};
+
+namespace pylongps
+{
+
+/**
+This class gives the benchmarks access to the private caster functions on the query and registration hot paths.
+*/
+class casterBenchmarkAccess
+{
+public:
+/**
+This function calls the caster's query SQL string generation.
+@param inputCaster: The caster to use
+@param inputRequest: The request to generate the string for
+@param inputParameterCountBuffer: This is set to the total number of bound variables
+@return: The query string
+
+@throws: This function can throw exceptions
+*/
+static std::string generateClientQueryRequestSQLString(caster &inputCaster, const client_query_request &inputRequest, int &inputParameterCountBuffer)
+{
+return inputCaster.generateClientQueryRequestSQLString(inputRequest, inputParameterCountBuffer);
+}
+
+/**
+This function performs the database part of answering a client query the way caster::processClientQueryRequest does (generate, prepare, bind, step and retrieve the matching basestations).
+@param inputCaster: The caster to use
+@param inputRequest: The request to answer
+@return: The matching basestations
+
+@throws: This function can throw exceptions
+*/
+static std::vector<base_station_stream_information> executeClientQueryRequest(caster &inputCaster, const client_query_request &inputRequest)
+{
+int boundParameterCount = 0;
+std::string sqlQueryString;
+SOM_TRY
+sqlQueryString = inputCaster.generateClientQueryRequestSQLString(inputRequest, boundParameterCount);
+SOM_CATCH("Error generating request sql string\n")
+
+std::unique_ptr<sqlite3_stmt, decltype(&sqlite3_finalize)> clientQueryStatement(nullptr, &sqlite3_finalize);
+
+SOM_TRY
+prepareStatement(clientQueryStatement, sqlQueryString, *inputCaster.databaseConnection);
+SOM_CATCH("Error preparing query statement\n")
+
+if(inputCaster.bindClientQueryRequestFields(clientQueryStatement, inputRequest) != boundParameterCount)
+{
+throw SOMException("Bound parameter count mismatch\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+}
+
+std::vector<int64_t> resultPrimaryKeys;
+while(true)
+{
+int stepReturnValue = sqlite3_step(clientQueryStatement.get());
+if(stepReturnValue == SQLITE_DONE)
+{
+break;
+}
+
+if(stepReturnValue != SQLITE_ROW)
+{
+throw SOMException("Error executing query\n", SQLITE3_ERROR, __FILE__, __LINE__);
+}
+
+resultPrimaryKeys.push_back((int64_t) sqlite3_column_int64(clientQueryStatement.get(), 0));
+}
+
+std::vector<base_station_stream_information> results(resultPrimaryKeys.size());
+for(uint64_t i=0; i<resultPrimaryKeys.size(); i++)
+{
+SOM_TRY
+inputCaster.basestationToSQLInterface->retrieve(resultPrimaryKeys[i], results[i]);
+SOM_CATCH("Error retrieving object associated with a query primary key\n")
+}
+
+return results;
+}
+
+/**
+This function calls the caster's credential check.
+@param inputCaster: The caster to use
+@param inputCredentials: The credentials giving the permissions/signing keys
+@param inputAuthorizedPermissionsBuffer: The object to return the authorized_permissions with
+@return: A tuple of <messageIsValid, isSignedByOfficialEntityKey, isSignedByRegisteredCommunityKey>
+*/
+static std::tuple<bool, bool, bool> checkCredentials(caster &inputCaster, credentials &inputCredentials, authorized_permissions &inputAuthorizedPermissionsBuffer)
+{
+return inputCaster.checkCredentials(inputCredentials, inputAuthorizedPermissionsBuffer);
+}
+
+/**
+This function calls the caster's credential check without its cache (so the signatures are always verified).
+@param inputCaster: The caster to use
+@param inputCredentials: The credentials giving the permissions/signing keys
+@param inputAuthorizedPermissionsBuffer: The object to return the authorized_permissions with
+@return: A tuple of <messageIsValid, isSignedByOfficialEntityKey, isSignedByRegisteredCommunityKey>
+*/
+static std::tuple<bool, bool, bool> verifyCredentials(caster &inputCaster, credentials &inputCredentials, authorized_permissions &inputAuthorizedPermissionsBuffer)
+{
+return inputCaster.verifyCredentials(inputCredentials, inputAuthorizedPermissionsBuffer);
+}
+
+/**
+This function stores a basestation in the caster's database (so the query benchmarks have something to search).
+@param inputCaster: The caster to use
+@param inputBasestation: The basestation to store
+
+@throws: This function can throw exceptions
+*/
+static void storeBasestation(caster &inputCaster, const base_station_stream_information &inputBasestation)
+{
+SOM_TRY
+inputCaster.basestationToSQLInterface->store(inputBasestation);
+SOM_CATCH("Error storing basestation\n")
+}
+};
+
+}
+
+/**
+This class lets the reactor dispatch overhead be measured by counting the messages the reactor hands to it.
+*/
+class reactorDispatchBenchmark
+{
+public:
+/**
+This function starts a reactor with a single inproc PAIR interface for the benchmark to send messages to.
+@param inputContext: The ZMQ context to use
+
+@throws: This function can throw exceptions
+*/
+reactorDispatchBenchmark(zmq::context_t &inputContext) : numberOfHandledMessages(0)
+{
+std::string connectionString = "inproc://reactorDispatchBenchmark";
+
+std::unique_ptr<zmq::socket_t> receiverSocket;
+SOM_TRY
+receiverSocket.reset(new zmq::socket_t(inputContext, ZMQ_PAIR));
+receiverSocket->bind(connectionString.c_str());
+SOM_CATCH("Error making receiver socket\n")
+
+SOM_TRY
+senderSocket.reset(new zmq::socket_t(inputContext, ZMQ_PAIR));
+senderSocket->connect(connectionString.c_str());
+SOM_CATCH("Error making sender socket\n")
+
+SOM_TRY
+benchmarkReactor.reset(new reactor<reactorDispatchBenchmark>(&inputContext, this));
+SOM_CATCH("Error making reactor\n")
+
+SOM_TRY
+benchmarkReactor->addInterface(receiverSocket, &reactorDispatchBenchmark::processMessage, "receiverSocket");
+SOM_CATCH("Error adding interface\n")
+
+SOM_TRY
+benchmarkReactor->start();
+SOM_CATCH("Error starting reactor\n")
+}
+
+/**
+This function sends the given number of messages to the reactor and waits until they have all been handled.
+@param inputNumberOfMessages: How many messages to send
+
+@throws: This function can throw exceptions
+*/
+void run(uint64_t inputNumberOfMessages)
+{
+uint64_t targetNumberOfHandledMessages = numberOfHandledMessages + inputNumberOfMessages;
+char message[8] = {0};
+for(uint64_t i=0; i<inputNumberOfMessages; i++)
+{
+SOM_TRY
+senderSocket->send(message, sizeof(message));
+SOM_CATCH("Error sending message\n")
+}
+
+while(numberOfHandledMessages < targetNumberOfHandledMessages)
+{
+std::this_thread::yield();
+}
+}
+
+/**
+This function receives a message waiting on the benchmark interface and counts it.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+@return: true if the polling cycle should restart before processing any more messages
+
+@throws: This function can throw exceptions
+*/
+bool processMessage(reactor<reactorDispatchBenchmark> &/*inputReactor*/, zmq::socket_t &inputSocket)
+{
+zmq::message_t messageBuffer;
+SOM_TRY
+if(inputSocket.recv(&messageBuffer, ZMQ_DONTWAIT))
+{
+numberOfHandledMessages++;
+}
+SOM_CATCH("Error receiving message\n")
+
+return false;
+}
+
+std::atomic<uint64_t> numberOfHandledMessages;
+std::unique_ptr<zmq::socket_t> senderSocket;
+std::unique_ptr<reactor<reactorDispatchBenchmark> > benchmarkReactor; //Declared last so it is shut down before the rest is destroyed
+};
+
+/**
+This function times an operation.  The number of iterations per sample is increased until a sample takes at least inputSettings.minimumSampleTime, then inputSettings.numberOfSamples samples are taken.
+@param inputName: The name of the benchmark
+@param inputOperation: The function to time, which should perform the operation the given number of times
+@param inputSettings: The settings to use
+@param inputSetup: An optional function to call (untimed) before each sample with the number of iterations the sample will run
+@return: The measurements
+
+@throws: This function can throw exceptions
+*/
+benchmarkResult runBenchmark(const std::string &inputName, const std::function<void(uint64_t)> &inputOperation, const benchmarkSettings &inputSettings, const std::function<void(uint64_t)> &inputSetup = nullptr)
+{
+benchmarkResult result;
+result.name = inputName;
+
+auto timeSample = [&](uint64_t inputNumberOfIterations)
+{
+if(inputSetup)
+{
+inputSetup(inputNumberOfIterations);
+}
+
+std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+inputOperation(inputNumberOfIterations);
+return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+};
+
+//Calibrate (this also warms up caches/allocators)
+uint64_t numberOfIterations = 1;
+while(true)
+{
+double sampleTime = 0.0;
+SOM_TRY
+sampleTime = timeSample(numberOfIterations);
+SOM_CATCH("Error running benchmark " + inputName + "\n")
+
+if(sampleTime >= inputSettings.minimumSampleTime || numberOfIterations >= MAXIMUM_ITERATIONS_PER_SAMPLE)
+{
+break;
+}
+
+double scale = sampleTime > 0.0 ? 1.2*inputSettings.minimumSampleTime/sampleTime : 10.0;
+numberOfIterations = std::min<uint64_t>(MAXIMUM_ITERATIONS_PER_SAMPLE, numberOfIterations*std::max(2.0, std::min(10.0, scale)));
+}
+result.iterationsPerSample = numberOfIterations;
+
+for(int i=0; i<inputSettings.numberOfSamples; i++)
+{
+double sampleTime = 0.0;
+SOM_TRY
+sampleTime = timeSample(numberOfIterations);
+SOM_CATCH("Error running benchmark " + inputName + "\n")
+
+result.nanosecondsPerOperation.push_back(sampleTime*1e9/numberOfIterations);
+}
+
+return result;
+}
+
+/**
+This function converts a benchmark result to the JSON form that is written out and compared.
+@param inputResult: The result to convert
+@return: The JSON object
+*/
+Json::Value benchmarkResultToJson(const benchmarkResult &inputResult)
+{
+std::vector<double> sortedTimes = inputResult.nanosecondsPerOperation;
+std::sort(sortedTimes.begin(), sortedTimes.end());
+
+Json::Value result;
+result["name"] = inputResult.name;
+result["iterations_per_sample"] = (Json::UInt64) inputResult.iterationsPerSample;
+result["samples"] = (Json::UInt64) sortedTimes.size();
+if(sortedTimes.size() == 0)
+{
+return result;
+}
+
+double total = 0.0;
+for(double time : sortedTimes)
+{
+total += time;
+}
+
+result["median_ns_per_operation"] = sortedTimes[sortedTimes.size()/2];
+result["mean_ns_per_operation"] = total/sortedTimes.size();
+result["min_ns_per_operation"] = sortedTimes.front();
+result["max_ns_per_operation"] = sortedTimes.back();
+return result;
+}
+
+/**
+This function reads a JSON file.
+@param inputPath: The file to read
+@param inputValueBuffer: The object to store the parsed JSON in
+@return: false if the file couldn't be read or parsed
+*/
+bool readJSONFile(const std::string &inputPath, Json::Value &inputValueBuffer)
+{
+std::ifstream inputFile(inputPath);
+if(!inputFile)
+{
+return false;
+}
+
+Json::Reader reader;
+return reader.parse(inputFile, inputValueBuffer);
+}
+
+/**
+This function compares the median times of the benchmarks two runs have in common and prints a table of the changes followed by the number of regressions.
+@param inputBaselinePath: The JSON output of the earlier run
+@param inputCurrentPath: The JSON output of the run to check
+@param inputRegressionThreshold: The fractional slowdown that is reported as a regression
+@return: The number of regressions found (-1 if the files couldn't be read)
+*/
+int compareBenchmarkResults(const std::string &inputBaselinePath, const std::string &inputCurrentPath, double inputRegressionThreshold)
+{
+Json::Value baseline;
+Json::Value current;
+if(!readJSONFile(inputBaselinePath, baseline) || !readJSONFile(inputCurrentPath, current))
+{
+fprintf(stderr, "Unable to read benchmark results\n");
+return -1;
+}
+
+std::map<std::string, double> baselineNameToMedian;
+for(const Json::Value &benchmark : baseline["benchmarks"])
+{
+baselineNameToMedian[benchmark["name"].asString()] = benchmark["median_ns_per_operation"].asDouble();
+}
+
+int numberOfRegressions = 0;
+printf("%-50s %15s %15s %9s\n", "benchmark", "baseline ns/op", "current ns/op", "change");
+for(const Json::Value &benchmark : current["benchmarks"])
+{
+std::string name = benchmark["name"].asString();
+double currentMedian = benchmark["median_ns_per_operation"].asDouble();
+if(baselineNameToMedian.count(name) == 0)
+{
+printf("%-50s %15s %15.1lf %9s\n", name.c_str(), "-", currentMedian, "new");
+continue;
+}
+
+double baselineMedian = baselineNameToMedian.at(name);
+double change = baselineMedian > 0.0 ? (currentMedian - baselineMedian)/baselineMedian : 0.0;
+bool isRegression = change > inputRegressionThreshold;
+numberOfRegressions += isRegression;
+printf("%-50s %15.1lf %15.1lf %+8.1lf%%%s\n", name.c_str(), baselineMedian, currentMedian, change*100.0, isRegression ? " REGRESSION" : "");
+}
+printf("%d regression(s)\n", numberOfRegressions);
+
+return numberOfRegressions;
+}
+
+/**
+This function makes a signed credentials message giving the given key permission to register basestations.
+@param inputOfficialSecretKey: The signing key that vouches for the permissions
+@param inputOfficialPublicKey: The public key that goes with inputOfficialSecretKey
+@param inputPermittedPublicKey: The key to give permissions to
+@return: The credentials
+*/
+credentials makeBenchmarkCredentials(const std::string &inputOfficialSecretKey, const std::string &inputOfficialPublicKey, const std::string &inputPermittedPublicKey)
+{
+authorized_permissions permissions;
+permissions.set_public_key(inputPermittedPublicKey);
+permissions.set_valid_until(Poco::Timestamp().epochMicroseconds() + 3600.0*1000000.0);
+permissions.set_number_of_permitted_base_stations(10);
+
+std::string serializedPermissions;
+permissions.SerializeToString(&serializedPermissions);
+
+unsigned char permissionsSignatureArray[crypto_sign_BYTES];
+crypto_sign_detached(permissionsSignatureArray, nullptr, (const unsigned char *) serializedPermissions.c_str(), serializedPermissions.size(), (const unsigned char *) inputOfficialSecretKey.c_str());
+
+credentials result;
+result.set_permissions(serializedPermissions);
+signature *permissionsSignature = result.add_signatures();
+permissionsSignature->set_public_key(inputOfficialPublicKey);
+permissionsSignature->set_cryptographic_signature(std::string((const char *) permissionsSignatureArray, crypto_sign_BYTES));
+
+return result;
+}
+
+/**
+This function makes a basestation entry like the ones the caster stores on registration.
+@param inputBasestationID: The ID to give the basestation
+@return: The basestation
+*/
+base_station_stream_information makeBenchmarkBasestation(int64_t inputBasestationID)
+{
+base_station_stream_information basestation;
+basestation.set_base_station_id(inputBasestationID);
+basestation.set_latitude(((inputBasestationID*7919) % 180000)/1000.0 - 90.0);
+basestation.set_longitude(((inputBasestationID*104729) % 360000)/1000.0 - 180.0);
+basestation.set_expected_update_rate(1.0 + (inputBasestationID % 10));
+basestation.set_message_format((inputBasestationID % 2) == 0 ? RTCM_V3_1 : RTCM_V2_3);
+basestation.set_informal_name("benchmark" + std::to_string(inputBasestationID));
+basestation.set_station_class((base_station_class) (1 + (inputBasestationID % 3)));
+basestation.set_real_update_rate(1.0);
+basestation.set_start_time(Poco::Timestamp().epochMicroseconds());
+return basestation;
+}
+
+/**
+This function makes a distinct key (or connection ID) the size of the ones the caster uses.
+@param inputPrefix: A character to distinguish the different kinds of keys
+@param inputIndex: The number of the key
+@return: The key
+*/
+std::string makeBenchmarkKey(char inputPrefix, uint64_t inputIndex)
+{
+std::string key(crypto_sign_PUBLICKEYBYTES, inputPrefix);
+memcpy(&key[1], &inputIndex, sizeof(inputIndex));
+return key;
+}
+
+/**
+This function removes a signing key from a key graph by the same walk caster::removeSigningKey makes (without the database requests and notifications for the removed connections): connection keys only it signed are removed along with their connections.
+@param inputGraph: The graph to remove from
+@param inputSigningKeyNodeID: The node of the signing key
+@return: The number of connections removed
+*/
+uint64_t cascadeSigningKeyRemoval(keyGraph &inputGraph, uint32_t inputSigningKeyNodeID)
+{
+uint64_t numberOfRemovedConnections = 0;
+while(inputGraph.getNumberOfNeighbors(inputSigningKeyNodeID) > 0)
+{
+uint32_t connectionKeyNodeID = inputGraph.getNeighbor(inputSigningKeyNodeID, inputGraph.getNumberOfNeighbors(inputSigningKeyNodeID) - 1);
+if(inputGraph.getNumberOfNeighbors(connectionKeyNodeID, SIGNING_KEY_NODE) >= 2)
+{
+inputGraph.removeEdge(inputSigningKeyNodeID, connectionKeyNodeID);
+continue;
+}
+
+for(uint32_t i = inputGraph.getNumberOfNeighbors(connectionKeyNodeID); i > 0; i--)
+{
+uint32_t neighborNodeID = inputGraph.getNeighbor(connectionKeyNodeID, i-1);
+if(inputGraph.getType(neighborNodeID) == AUTHENTICATED_CONNECTION_NODE)
+{
+inputGraph.removeNode(neighborNodeID);
+numberOfRemovedConnections++;
+}
+}
+inputGraph.removeNode(connectionKeyNodeID);
+}
+
+inputGraph.removeNode(inputSigningKeyNodeID);
+return numberOfRemovedConnections;
+}
+
+/**
+This function adds a double condition to a repeated field of a subquery.
+@param inputConditions: The repeated field to add to
+@param inputRelation: The relation to the value
+@param inputValue: The value
+*/
+void addDoubleCondition(google::protobuf::RepeatedPtrField<sql_double_condition> &inputConditions, sql_relational_operator inputRelation, double inputValue)
+{
+sql_double_condition *condition = inputConditions.Add();
+condition->set_relation(inputRelation);
+condition->set_value(inputValue);
+}
+
+/**
+This function returns the query shapes the clients typically send, by name.
+@return: The named queries
+*/
+std::vector<std::pair<std::string, client_query_request> > makeBenchmarkQueries()
+{
+std::vector<std::pair<std::string, client_query_request> > queries;
+
+queries.emplace_back("all", client_query_request());
+
+client_query_request classAndFormatQuery;
+client_subquery *subquery = classAndFormatQuery.add_subqueries();
+subquery->add_acceptable_classes(OFFICIAL);
+subquery->add_acceptable_classes(COMMUNITY);
+subquery->add_acceptable_formats(RTCM_V3_1);
+queries.emplace_back("class_and_format", classAndFormatQuery);
+
+client_query_request boundingBoxQuery;
+boundingBoxQuery.set_max_number_of_results(100);
+subquery = boundingBoxQuery.add_subqueries();
+addDoubleCondition(*subquery->mutable_latitude_condition(), GREATER_THAN_EQUAL_TO, 30.0);
+addDoubleCondition(*subquery->mutable_latitude_condition(), LESS_THAN_EQUAL_TO, 50.0);
+addDoubleCondition(*subquery->mutable_longitude_condition(), GREATER_THAN_EQUAL_TO, -120.0);
+addDoubleCondition(*subquery->mutable_longitude_condition(), LESS_THAN_EQUAL_TO, -70.0);
+addDoubleCondition(*subquery->mutable_expected_update_rate_condition(), GREATER_THAN_EQUAL_TO, 2.0);
+queries.emplace_back("bounding_box", boundingBoxQuery);
+
+client_query_request radiusQuery;
+radiusQuery.set_max_number_of_results(10);
+subquery = radiusQuery.add_subqueries();
+subquery->mutable_circular_search_region()->set_latitude(40.0);
+subquery->mutable_circular_search_region()->set_longitude(-100.0);
+subquery->mutable_circular_search_region()->set_radius(2000000.0);
+queries.emplace_back("radius", radiusQuery);
+
+client_query_request multipleSubqueryQuery;
+for(int i=0; i<4; i++)
+{
+subquery = multipleSubqueryQuery.add_subqueries();
+subquery->add_acceptable_classes((base_station_class) (1 + (i % 3)));
+addDoubleCondition(*subquery->mutable_latitude_condition(), GREATER_THAN, -90.0 + 45.0*i);
+addDoubleCondition(*subquery->mutable_latitude_condition(), LESS_THAN, -45.0 + 45.0*i);
+}
+queries.emplace_back("multiple_subqueries", multipleSubqueryQuery);
+
+return queries;
+}
+
+int main(int argc, char** argv)
+{
+//Defined options
+// -filter substringOfBenchmarkNamesToRun
+// -samples numberOfSamples
+// -min_sample_time seconds
+// -output pathToJSONFile
+// -baseline pathToEarlierJSONOutput (with -compare)
+// -compare pathToJSONOutputToCompareWithTheBaseline
+// -threshold fractionalSlowdownToReport
+// -list
+// -help list of possible options
+
+std::map<std::string, std::string> processedArguments = parseStringArguments(argv+1, argc-1); //Skip program name
+
+if(processedArguments.count("help") > 0)
+{ //Print options and exit
+printf("Runs microbenchmarks of the library's hot paths and prints the results as JSON, or compares the results of two runs.\n");
+printf("Possible options: \n");
+printf("-filter substringOfBenchmarkNamesToRun\n");
+printf("-samples numberOfSamplesPerBenchmark (default %d)\n", DEFAULT_NUMBER_OF_BENCHMARK_SAMPLES);
+printf("-min_sample_time minimumSecondsPerSample (default %.2lf)\n", DEFAULT_MINIMUM_SAMPLE_TIME);
+printf("-output pathToWriteJSONTo (default stdout)\n");
+printf("-baseline earlierResults.json -compare currentResults.json: print the change in median time per benchmark and the number of regressions, exiting with %d if there are none, %d if there are any and %d on error\n", COMPARE_EXIT_STATUS_NO_REGRESSIONS, COMPARE_EXIT_STATUS_REGRESSIONS, COMPARE_EXIT_STATUS_ERROR);
+printf("-threshold fractionalSlowdownCountedAsARegression (default %.2lf)\n", DEFAULT_REGRESSION_THRESHOLD);
+printf("-list print the benchmark names and exit\n");
+printf("-help get list of possible options\n");
+return 0;
+}
+
+if(processedArguments.count("compare") > 0)
+{
+if(processedArguments.count("baseline") == 0)
+{
+fprintf(stderr, "-compare requires -baseline\n");
+return COMPARE_EXIT_STATUS_ERROR;
+}
+
+double regressionThreshold = DEFAULT_REGRESSION_THRESHOLD;
+if(processedArguments.count("threshold") > 0)
+{
+if(convertStringToDouble(processedArguments["threshold"], regressionThreshold) == false)
+{
+fprintf(stderr, "Unable to read threshold: %s\n", processedArguments["threshold"].c_str());
+return COMPARE_EXIT_STATUS_ERROR;
+}
+}
+
+int numberOfRegressions = compareBenchmarkResults(processedArguments["baseline"], processedArguments["compare"], regressionThreshold);
+if(numberOfRegressions < 0)
+{
+return COMPARE_EXIT_STATUS_ERROR;
+}
+
+return numberOfRegressions > 0 ? COMPARE_EXIT_STATUS_REGRESSIONS : COMPARE_EXIT_STATUS_NO_REGRESSIONS;
+}
+
+benchmarkSettings settings;
+if(processedArguments.count("filter") > 0)
+{
+settings.filter = processedArguments["filter"];
+}
+
+if(processedArguments.count("samples") > 0)
+{
+int64_t numberOfSamples = 0;
+if(convertStringToInteger(processedArguments["samples"], numberOfSamples) == false || numberOfSamples <= 0)
+{
+fprintf(stderr, "Unable to read samples: %s\n", processedArguments["samples"].c_str());
+return 1;
+}
+settings.numberOfSamples = numberOfSamples;
+}
+
+if(processedArguments.count("min_sample_time") > 0)
+{
+if(convertStringToDouble(processedArguments["min_sample_time"], settings.minimumSampleTime) == false || settings.minimumSampleTime <= 0.0)
+{
+fprintf(stderr, "Unable to read min_sample_time: %s\n", processedArguments["min_sample_time"].c_str());
+return 1;
+}
+}
+
+if(sodium_init() == -1)
+{
+fprintf(stderr, "Unable to initialize libsodium\n");
+return 1;
+}
+
+std::unique_ptr<zmq::context_t> context;
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Shared fixtures
+std::string casterPublicKey;
+std::string casterSecretKey;
+std::tie(casterPublicKey, casterSecretKey) = generateSigningKeys();
+
+std::string keyManagerPublicKey;
+std::string keyManagerSecretKey;
+std::tie(keyManagerPublicKey, keyManagerSecretKey) = generateSigningKeys();
+
+std::string officialPublicKey;
+std::string officialSecretKey;
+std::tie(officialPublicKey, officialSecretKey) = generateSigningKeys();
+
+std::string connectionPublicKey;
+std::string connectionSecretKey;
+std::tie(connectionPublicKey, connectionSecretKey) = generateSigningKeys();
+
+std::unique_ptr<caster> benchmarkCaster;
+SOM_TRY
+benchmarkCaster.reset(new caster(context.get(), 1, BENCHMARK_CASTER_BASE_PORT, BENCHMARK_CASTER_BASE_PORT + 1, BENCHMARK_CASTER_BASE_PORT + 2, BENCHMARK_CASTER_BASE_PORT + 3, BENCHMARK_CASTER_BASE_PORT + 4, BENCHMARK_CASTER_BASE_PORT + 5, casterPublicKey, casterSecretKey, keyManagerPublicKey, std::vector<std::string>{officialPublicKey}, std::vector<std::string>(0), std::vector<std::string>(0)));
+SOM_CATCH("Error, unable to start caster\n")
+
+for(uint64_t i=1; i<=QUERY_BENCHMARK_NUMBER_OF_BASESTATIONS; i++)
+{
+SOM_TRY
+casterBenchmarkAccess::storeBasestation(*benchmarkCaster, makeBenchmarkBasestation(i));
+SOM_CATCH("Error populating caster database\n")
+}
+
+sqlite3 *databaseConnection = nullptr;
+if(sqlite3_open_v2(":memory:", &databaseConnection, SQLITE_OPEN_CREATE | SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK)
+{
+fprintf(stderr, "Unable to open database\n");
+return 1;
+}
+SOMScopeGuard databaseConnectionGuard([&]() {sqlite3_close_v2(databaseConnection);} );
+
+std::unique_ptr<messageDatabaseDefinition> basestationDatabase;
+SOM_TRY
+basestationDatabase.reset(new messageDatabaseDefinition(*databaseConnection, *base_station_stream_information::descriptor()));
+SOM_CATCH("Error, unable to initialize messageDatabaseDefinition\n")
+
+base_station_stream_information signedBasestation = makeBenchmarkBasestation(0);
+signedBasestation.set_source_public_key(connectionPublicKey);
+signedBasestation.add_signing_keys(officialPublicKey);
+uint64_t nextBasestationID = 1;
+
+std::unique_ptr<zmq::socket_t> protobufSenderSocket;
+std::unique_ptr<zmq::socket_t> protobufReceiverSocket;
+SOM_TRY
+protobufReceiverSocket.reset(new zmq::socket_t(*context, ZMQ_PAIR));
+protobufReceiverSocket->bind("inproc://protobufBenchmark");
+protobufSenderSocket.reset(new zmq::socket_t(*context, ZMQ_PAIR));
+protobufSenderSocket->connect("inproc://protobufBenchmark");
+SOM_CATCH("Error making protobuf benchmark sockets\n")
+
+std::unique_ptr<reactorDispatchBenchmark> dispatchBenchmark;
+SOM_TRY
+dispatchBenchmark.reset(new reactorDispatchBenchmark(*context));
+SOM_CATCH("Error making reactor benchmark\n")
+
+NMEAGGASentence parsedSentence;
+if(!parsedSentence.parse(GGA_BENCHMARK_SENTENCE))
+{
+fprintf(stderr, "Unable to parse GGA benchmark sentence\n");
+return 1;
+}
+
+//Each benchmark is a name, the operation to time and an optional untimed setup
+std::vector<std::tuple<std::string, std::function<void(uint64_t)>, std::function<void(uint64_t)> > > benchmarks;
+
+benchmarks.emplace_back("messageDatabaseDefinition/store", [&](uint64_t inputNumberOfIterations)
+{
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+signedBasestation.set_base_station_id(nextBasestationID++);
+basestationDatabase->store(signedBasestation);
+}
+}, nullptr);
+
+benchmarks.emplace_back("messageDatabaseDefinition/retrieve", [&](uint64_t inputNumberOfIterations)
+{
+base_station_stream_information retrievedBasestation;
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+basestationDatabase->retrieve(1 + (i % (nextBasestationID - 1)), retrievedBasestation);
+}
+}, [&](uint64_t /*inputNumberOfIterations*/)
+{
+while(nextBasestationID <= QUERY_BENCHMARK_NUMBER_OF_BASESTATIONS)
+{
+signedBasestation.set_base_station_id(nextBasestationID++);
+basestationDatabase->store(signedBasestation);
+}
+});
+
+uint64_t firstBasestationIDToDelete = 0;
+benchmarks.emplace_back("messageDatabaseDefinition/deleteMessage", [&](uint64_t inputNumberOfIterations)
+{
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+basestationDatabase->deleteMessage(firstBasestationIDToDelete + i);
+}
+}, [&](uint64_t inputNumberOfIterations)
+{
+firstBasestationIDToDelete = nextBasestationID;
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+signedBasestation.set_base_station_id(nextBasestationID++);
+basestationDatabase->store(signedBasestation);
+}
+});
+
+for(const std::pair<std::string, client_query_request> &query : makeBenchmarkQueries())
+{
+const client_query_request &request = query.second;
+benchmarks.emplace_back("caster/generateClientQueryRequestSQLString/" + query.first, [&, request](uint64_t inputNumberOfIterations)
+{
+int boundParameterCount = 0;
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+casterBenchmarkAccess::generateClientQueryRequestSQLString(*benchmarkCaster, request, boundParameterCount);
+}
+}, nullptr);
+
+benchmarks.emplace_back("caster/executeClientQuery/" + query.first, [&, request](uint64_t inputNumberOfIterations)
+{
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+casterBenchmarkAccess::executeClientQueryRequest(*benchmarkCaster, request);
+}
+}, nullptr);
+}
+
+credentials connectionCredentials = makeBenchmarkCredentials(officialSecretKey, officialPublicKey, connectionPublicKey);
+benchmarks.emplace_back("caster/checkCredentials", [&](uint64_t inputNumberOfIterations)
+{ //Repeated credentials, so after the first check this is the cached path
+authorized_permissions permissions;
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+if(!std::get<0>(casterBenchmarkAccess::checkCredentials(*benchmarkCaster, connectionCredentials, permissions)))
+{
+throw SOMException("Benchmark credentials rejected\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+}
+}
+}, nullptr);
+
+benchmarks.emplace_back("caster/verifyCredentials", [&](uint64_t inputNumberOfIterations)
+{
+authorized_permissions permissions;
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+if(!std::get<0>(casterBenchmarkAccess::verifyCredentials(*benchmarkCaster, connectionCredentials, permissions)))
+{
+throw SOMException("Benchmark credentials rejected\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+}
+}
+}, nullptr);
+
+for(uint64_t messageSize : std::vector<uint64_t>{100, 1000})
+{
+std::string message(messageSize, 'x');
+std::string signedMessage = calculateAndPreappendSignature(message, connectionSecretKey);
+
+benchmarks.emplace_back("sodium/crypto_sign_verify_detached/" + std::to_string(messageSize), [&, signedMessage](uint64_t inputNumberOfIterations)
+{ //Same check the caster makes on each authenticated message it forwards
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+if(crypto_sign_verify_detached((const unsigned char *) signedMessage.c_str(), (const unsigned char *) signedMessage.c_str() + crypto_sign_BYTES, signedMessage.size() - crypto_sign_BYTES, (const unsigned char *) connectionPublicKey.c_str()) != 0)
+{
+throw SOMException("Benchmark signature rejected\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+}
+}
+}, nullptr);
+
+benchmarks.emplace_back("calculateAndPreappendSignature/" + std::to_string(messageSize), [&, message](uint64_t inputNumberOfIterations)
+{
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+calculateAndPreappendSignature(message, connectionSecretKey);
+}
+}, nullptr);
+}
+
+std::unique_ptr<keyGraph> cascadeGraph;
+std::vector<uint32_t> cascadeSigningKeyNodeIDs;
+benchmarks.emplace_back("keyGraph/signingKeyCascade/" + std::to_string(KEY_CASCADE_BENCHMARK_NUMBER_OF_CONNECTIONS), [&](uint64_t inputNumberOfIterations)
+{ //Each iteration removes a signing key backing KEY_CASCADE_BENCHMARK_NUMBER_OF_CONNECTIONS connection keys with one connection each
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+if(cascadeSigningKeyRemoval(*cascadeGraph, cascadeSigningKeyNodeIDs[i]) != KEY_CASCADE_BENCHMARK_NUMBER_OF_CONNECTIONS)
+{
+throw SOMException("Benchmark cascade removed the wrong number of connections\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+}
+}
+}, [&](uint64_t inputNumberOfIterations)
+{
+cascadeGraph.reset(new keyGraph);
+cascadeSigningKeyNodeIDs.clear();
+uint64_t nextKeyIndex = 0;
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+cascadeSigningKeyNodeIDs.push_back(cascadeGraph->addNode(SIGNING_KEY_NODE, makeBenchmarkKey('s', i)));
+for(uint64_t a=0; a<KEY_CASCADE_BENCHMARK_NUMBER_OF_CONNECTIONS; a++)
+{
+uint32_t connectionKeyNodeID = cascadeGraph->addNode(CONNECTION_KEY_NODE, makeBenchmarkKey('k', nextKeyIndex));
+cascadeGraph->addEdge(cascadeSigningKeyNodeIDs.back(), connectionKeyNodeID);
+cascadeGraph->addEdge(connectionKeyNodeID, cascadeGraph->addNode(AUTHENTICATED_CONNECTION_NODE, makeBenchmarkKey('c', nextKeyIndex).substr(0, 5))); //ZMQ routing IDs are 5 bytes
+nextKeyIndex++;
+}
+}
+});
+
+benchmarks.emplace_back("sendProtobufMessage+receiveProtobufMessage", [&](uint64_t inputNumberOfIterations)
+{
+base_station_stream_information receivedBasestation;
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+sendProtobufMessage(*protobufSenderSocket, signedBasestation);
+bool messageReceived = false;
+bool messageDeserialized = false;
+std::tie(messageReceived, messageDeserialized) = receiveProtobufMessage(*protobufReceiverSocket, receivedBasestation);
+if(!messageReceived || !messageDeserialized)
+{
+throw SOMException("Benchmark message not received\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+}
+}
+}, nullptr);
+
+benchmarks.emplace_back("NMEAGGASentence/parse", [&](uint64_t inputNumberOfIterations)
+{
+NMEAGGASentence sentence;
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+sentence.parse(GGA_BENCHMARK_SENTENCE);
+}
+}, nullptr);
+
+benchmarks.emplace_back("NMEAGGASentence/serialize", [&](uint64_t inputNumberOfIterations)
+{
+for(uint64_t i=0; i<inputNumberOfIterations; i++)
+{
+parsedSentence.serialize();
+}
+}, nullptr);
+
+benchmarks.emplace_back("reactor/dispatch", [&](uint64_t inputNumberOfIterations)
+{
+dispatchBenchmark->run(inputNumberOfIterations);
+}, nullptr);
+
+if(processedArguments.count("list") > 0)
+{
+for(const auto &benchmark : benchmarks)
+{
+printf("%s\n", std::get<0>(benchmark).c_str());
+}
+return 0;
+}
+
+Json::Value results;
+results["settings"]["samples"] = settings.numberOfSamples;
+results["settings"]["min_sample_time"] = settings.minimumSampleTime;
+results["settings"]["filter"] = settings.filter;
+results["benchmarks"] = Json::Value(Json::arrayValue);
+for(const auto &benchmark : benchmarks)
+{
+if(std::get<0>(benchmark).find(settings.filter) == std::string::npos)
+{
+continue;
+}
+
+benchmarkResult result;
+SOM_TRY
+result = runBenchmark(std::get<0>(benchmark), std::get<1>(benchmark), settings, std::get<2>(benchmark));
+SOM_CATCH("Error running benchmark\n")
+
+results["benchmarks"].append(benchmarkResultToJson(result));
+fprintf(stderr, "%s: %.1lf ns/op\n", result.name.c_str(), results["benchmarks"][results["benchmarks"].size()-1]["median_ns_per_operation"].asDouble());
+}
+
+Json::StyledWriter writer;
+std::string serializedResults = writer.write(results);
+if(processedArguments.count("output") > 0)
+{
+std::ofstream outputFile(processedArguments["output"]);
+if(!outputFile)
+{
+fprintf(stderr, "Unable to open %s\n", processedArguments["output"].c_str());
+return 1;
+}
+outputFile << serializedResults;
+}
+else
+{
+printf("%s", serializedResults.c_str());
+}
+
+return 0;
+}
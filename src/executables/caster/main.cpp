@@ -20,6 +20,18 @@ int main(int argc, char** argv)
 // -caster_public_key_path pathToPublicKeyFileForCaster
 // -caster_secret_key_path pathToSecretKeyFileForCaster
 // -caster_key_management_public_key_path pathToPublicKeyAllowedToSendKeyManagementRequests
+// -state_handoff_address addressForReplacementCastersToRetrieveStateFrom
+// -take_over_from stateHandoffAddressOfCasterToReplace
+// -ingest_burst_size numberOfMessages
+// -global_ingest_rate_limit messagesPerSecond
+// -official_publishing_hwm numberOfMessages
+// -registered_community_publishing_hwm numberOfMessages
+// -community_publishing_hwm numberOfMessages
+// -add_stream_frame_headers 1or0
+// -trace_sampling_interval numberOfMessages
+// -metrics_port metricsPortNumber
+// -registration_admission_rate registrationsPerSecond
+// -trace_dump_directory directoryToWriteTraceDumpsToOnSIGUSR1
 // -help list of possible options
 
 std::map<std::string, std::string> processedArguments = parseStringArguments(argv+1, argc-1); //Skip program name
@@ -42,6 +54,18 @@ printf("-key_management_port keyManagementPortNumber\n");
 printf("-caster_public_key_path pathToPublicKeyFileForCaster\n");
 printf("-caster_secret_key_path pathToSecretKeyFileForCaster\n");
 printf("-caster_key_management_public_key_path pathToPublicKeyAllowedToSendKeyManagementRequests\n");
+printf("-state_handoff_address addressForReplacementCastersToRetrieveStateFrom (example: ipc:///tmp/pylonGPSCasterHandoff)\n");
+printf("-take_over_from stateHandoffAddressOfCasterToReplace\n");
+printf("-ingest_burst_size numberOfMessagesATransmitterCanSendInABurst\n");
+printf("-global_ingest_rate_limit maximumMessagesPerSecondFromAllNonOfficialTransmitters (0 for no limit)\n");
+printf("-official_publishing_hwm numberOfOfficialStreamMessagesThatCanWaitToBePublished\n");
+printf("-registered_community_publishing_hwm numberOfRegisteredCommunityStreamMessagesThatCanWaitToBePublished\n");
+printf("-community_publishing_hwm numberOfCommunityStreamMessagesThatCanWaitToBePublished\n");
+printf("-add_stream_frame_headers 1 to add sequence numbers/ingest times to forwarded messages (receivers must support them)\n");
+printf("-trace_sampling_interval traceOneOfEveryThisManyMessages (requires -add_stream_frame_headers 1, 0 to only trace messages traced by their transmitters)\n");
+printf("-metrics_port portNumberToServePrometheusMetricsOverHTTPOn (0 to not serve metrics)\n");
+printf("-registration_admission_rate maximumTransmitterRegistrationsAcceptedPerSecond (0 for no limit)\n");
+printf("-trace_dump_directory directoryToWriteTraceDumpsToOnSIGUSR1 (default is the current directory, read the dumps with traceDecoder)\n");
 printf("-help get list of possible options\n");
 return 0;
 }
@@ -159,6 +183,111 @@ fprintf(stderr, "Unable to read caster_key_management_public_key_path: %s\n", pr
 currentConfiguration.set_signing_keys_management_key(stringBuffer);
 }
 
+// -state_handoff_address addressForReplacementCastersToRetrieveStateFrom
+if(processedArguments.count("state_handoff_address") > 0)
+{
+currentConfiguration.set_state_handoff_connection_string(processedArguments["state_handoff_address"]);
+}
+
+// -take_over_from stateHandoffAddressOfCasterToReplace
+if(processedArguments.count("take_over_from") > 0)
+{
+currentConfiguration.set_previous_caster_state_handoff_connection_string(processedArguments["take_over_from"]);
+}
+
+// -ingest_burst_size numberOfMessages
+if(processedArguments.count("ingest_burst_size") > 0)
+{
+double doubleBuffer = 0.0;
+if(convertStringToDouble(processedArguments["ingest_burst_size"], doubleBuffer) == false)
+{
+fprintf(stderr, "Unable to read ingest_burst_size: %s\n", processedArguments["ingest_burst_size"].c_str());
+}
+currentConfiguration.set_ingest_burst_size(doubleBuffer);
+}
+
+// -global_ingest_rate_limit messagesPerSecond
+if(processedArguments.count("global_ingest_rate_limit") > 0)
+{
+double doubleBuffer = 0.0;
+if(convertStringToDouble(processedArguments["global_ingest_rate_limit"], doubleBuffer) == false)
+{
+fprintf(stderr, "Unable to read global_ingest_rate_limit: %s\n", processedArguments["global_ingest_rate_limit"].c_str());
+}
+currentConfiguration.set_global_ingest_rate_limit(doubleBuffer);
+}
+
+// -official_publishing_hwm numberOfMessages
+if(processedArguments.count("official_publishing_hwm") > 0)
+{
+if(convertStringToInteger(processedArguments["official_publishing_hwm"], buffer) == false)
+{
+fprintf(stderr, "Unable to read official_publishing_hwm: %s\n", processedArguments["official_publishing_hwm"].c_str());
+}
+currentConfiguration.set_official_publishing_high_water_mark(buffer);
+}
+
+// -registered_community_publishing_hwm numberOfMessages
+if(processedArguments.count("registered_community_publishing_hwm") > 0)
+{
+if(convertStringToInteger(processedArguments["registered_community_publishing_hwm"], buffer) == false)
+{
+fprintf(stderr, "Unable to read registered_community_publishing_hwm: %s\n", processedArguments["registered_community_publishing_hwm"].c_str());
+}
+currentConfiguration.set_registered_community_publishing_high_water_mark(buffer);
+}
+
+// -community_publishing_hwm numberOfMessages
+if(processedArguments.count("community_publishing_hwm") > 0)
+{
+if(convertStringToInteger(processedArguments["community_publishing_hwm"], buffer) == false)
+{
+fprintf(stderr, "Unable to read community_publishing_hwm: %s\n", processedArguments["community_publishing_hwm"].c_str());
+}
+currentConfiguration.set_community_publishing_high_water_mark(buffer);
+}
+
+// -add_stream_frame_headers 1or0
+if(processedArguments.count("add_stream_frame_headers") > 0)
+{
+if(convertStringToInteger(processedArguments["add_stream_frame_headers"], buffer) == false)
+{
+fprintf(stderr, "Unable to read add_stream_frame_headers: %s\n", processedArguments["add_stream_frame_headers"].c_str());
+}
+currentConfiguration.set_add_stream_frame_headers(buffer != 0);
+}
+
+// -trace_sampling_interval numberOfMessages
+if(processedArguments.count("trace_sampling_interval") > 0)
+{
+if(convertStringToInteger(processedArguments["trace_sampling_interval"], buffer) == false)
+{
+fprintf(stderr, "Unable to read trace_sampling_interval: %s\n", processedArguments["trace_sampling_interval"].c_str());
+}
+currentConfiguration.set_trace_sampling_interval(buffer);
+}
+
+// -metrics_port metricsPortNumber
+if(processedArguments.count("metrics_port") > 0)
+{
+if(convertStringToInteger(processedArguments["metrics_port"], buffer) == false)
+{
+fprintf(stderr, "Unable to read metrics_port: %s\n", processedArguments["metrics_port"].c_str());
+}
+currentConfiguration.set_metrics_port_number(buffer);
+}
+
+// -registration_admission_rate registrationsPerSecond
+if(processedArguments.count("registration_admission_rate") > 0)
+{
+double doubleBuffer = 0.0;
+if(convertStringToDouble(processedArguments["registration_admission_rate"], doubleBuffer) == false)
+{
+fprintf(stderr, "Unable to read registration_admission_rate: %s\n", processedArguments["registration_admission_rate"].c_str());
+}
+currentConfiguration.set_registration_admission_rate(doubleBuffer);
+}
+
 //If keys have not been provided, generate them
 if(currentConfiguration.caster_public_key().size() == 0 || currentConfiguration.caster_secret_key().size() == 0)
 {
@@ -180,6 +309,17 @@ currentConfiguration.set_signing_keys_management_key(publicKey);
 
 //Config file should have the options, all modifications completed
 
+// -trace_dump_directory directoryToWriteTraceDumpsToOnSIGUSR1
+std::string traceDumpDirectory = ".";
+if(processedArguments.count("trace_dump_directory") > 0)
+{
+traceDumpDirectory = processedArguments["trace_dump_directory"];
+}
+
+SOM_TRY //Must happen before the caster starts its threads
+startTraceRingDumpOnSignal(traceDumpDirectory);
+SOM_CATCH("Error setting up trace dumps\n")
+
 //Create ZMQ context
 std::unique_ptr<zmq::context_t> context;
 
@@ -190,12 +330,15 @@ SOM_CATCH("Error initializing ZMQ context\n")
 //Create caster
 caster mycaster(context.get(), currentConfiguration);
 
-//Sleep forever while caster operates
-while(true)
+//Sleep while caster operates
+while(!mycaster.hasHandedOffState())
 {
 std::this_thread::sleep_for(std::chrono::milliseconds(1000));
 }
 
+//A replacement caster gets the new connections now, so serve the existing ones for a while before shutting down (their peers then reconnect to the replacement)
+std::this_thread::sleep_for(std::chrono::milliseconds((int64_t) (STATE_HANDOFF_DRAIN_TIME*1000)));
+
 return 0;
 }
 
@@ -0,0 +1,784 @@
+#include "Poco/ByteOrder.h"
+#include "Poco/Timestamp.h"
+#include<chrono>
+#include<thread>
+#include<atomic>
+#include<vector>
+#include<memory>
+#include<future>
+#include<algorithm>
+#include<fstream>
+#include<json.h>
+#include<sodium.h>
+
+#include "caster.hpp"
+#include "transceiver.hpp"
+#include "streamFrameHeader.hpp"
+#include "SOMException.hpp"
+
+using namespace pylongps;
+
+//The ports used by caster i are basePort + CASTER_PORT_SPACING*i + the offsets below
+const int CASTER_PORT_SPACING = 10;
+const int REGISTRATION_PORT_OFFSET = 0;
+const int CLIENT_REQUEST_PORT_OFFSET = 1;
+const int CLIENT_PUBLISHING_PORT_OFFSET = 2;
+const int PROXY_PUBLISHING_PORT_OFFSET = 3;
+const int STREAM_STATUS_NOTIFICATION_PORT_OFFSET = 4;
+const int KEY_MANAGEMENT_PORT_OFFSET = 5;
+
+const int64_t ORIGIN_CASTER_ID = 1; //Proxies get ORIGIN_CASTER_ID + 1, + 2, ...
+const uint32_t MINIMUM_LOAD_MESSAGE_SIZE = 16; //Send time + basestation index
+const double KEEPALIVE_INTERVAL = 1.0; //Seconds between messages sent to registered basestations while the others are still registering (so the caster doesn't time them out)
+const double STREAM_DISCOVERY_TIMEOUT = 30.0; //Seconds to wait for every caster to list all of the registered basestations
+const double DRAIN_TIME = 1.0; //Seconds to wait for messages in flight after the senders stop
+const int CLIENT_POLL_TIMEOUT = 100; //Milliseconds
+
+/**
+This class holds what a thread which registers and then drives a slice of the fake basestations needs and what it measured.
+*/
+class basestationDriverState
+{
+public:
+uint64_t firstBasestationIndex = 0;
+uint64_t numberOfBasestations = 0;
+std::vector<std::unique_ptr<zmq::socket_t> > sockets; //One DEALER socket per successfully registered basestation
+std::vector<bool> socketIsAuthenticated;
+std::vector<uint64_t> socketBasestationIndex;
+std::vector<int64_t> registrationLatencies; //Microseconds
+uint64_t numberOfFailedRegistrations = 0;
+uint64_t numberOfSentMessages = 0;
+};
+
+/**
+This class holds the sockets of the clients a thread polls and the latencies it measured.
+*/
+class clientReceiverState
+{
+public:
+std::vector<std::unique_ptr<zmq::socket_t> > sockets;
+std::vector<int64_t> latencies; //Microseconds
+uint64_t numberOfReceivedMessages = 0;
+};
+
+/**
+This function makes a load message with the send time (monotonic clock) and basestation index at the start, padded to the given size.
+@param inputBasestationIndex: The index of the basestation sending the message
+@param inputSendTime: The time to embed (0 for keepalive messages, which aren't counted)
+@param inputMessageSize: The size the message should be
+@return: The message
+*/
+std::string makeLoadMessage(uint64_t inputBasestationIndex, int64_t inputSendTime, uint32_t inputMessageSize)
+{
+std::string message(std::max(inputMessageSize, MINIMUM_LOAD_MESSAGE_SIZE), 'x');
+Poco::Int64 networkOrderSendTime = Poco::ByteOrder::toNetwork(Poco::Int64(inputSendTime));
+Poco::UInt64 networkOrderIndex = Poco::ByteOrder::toNetwork(Poco::UInt64(inputBasestationIndex));
+memcpy(&message[0], &networkOrderSendTime, sizeof(networkOrderSendTime));
+memcpy(&message[sizeof(networkOrderSendTime)], &networkOrderIndex, sizeof(networkOrderIndex));
+return message;
+}
+
+/**
+This function sends a load message from the given basestation, signing it if the basestation is authenticated.
+@param inputSocket: The basestation's connection to the caster
+@param inputMessage: The message to send
+@param inputIsAuthenticated: True if the message needs to be signed
+@param inputSecretKey: The key to sign with
+
+@throws: This function can throw exceptions
+*/
+void sendLoadMessage(zmq::socket_t &inputSocket, const std::string &inputMessage, bool inputIsAuthenticated, const std::string &inputSecretKey)
+{
+if(inputIsAuthenticated)
+{
+std::string signedMessage = calculateAndPreappendSignature(inputMessage, inputSecretKey);
+SOM_TRY
+inputSocket.send(signedMessage.c_str(), signedMessage.size());
+SOM_CATCH("Error sending message\n")
+}
+else
+{
+SOM_TRY
+inputSocket.send(inputMessage.c_str(), inputMessage.size());
+SOM_CATCH("Error sending message\n")
+}
+}
+
+/**
+This function registers the driver's slice of basestations with the caster (timing each registration), keeps them alive until inputStartSending is set and then sends messages from them at the given rate until inputStopSending is set.  Basestations with an index below inputNumberOfAuthenticatedBasestations register with the given credentials.
+@param inputState: The slice to register/drive and where to put the results
+@param inputContext: The ZMQ context to use
+@param inputRegistrationConnectionString: The caster's transmitter registration/streaming address
+@param inputNumberOfAuthenticatedBasestations: How many of all the basestations are authenticated
+@param inputCredentials: The credentials for the authenticated basestations
+@param inputSecretKey: The signing key that goes with the credentials
+@param inputMessageRate: Messages per second per basestation
+@param inputMessageSize: Bytes per message
+@param inputRegistrationFinished: Incremented when the slice has been registered
+@param inputStartSending: Set when the driver should start sending
+@param inputStopSending: Set when the driver should stop
+*/
+void registerAndDriveBasestations(basestationDriverState &inputState, zmq::context_t &inputContext, const std::string &inputRegistrationConnectionString, uint64_t inputNumberOfAuthenticatedBasestations, const credentials &inputCredentials, const std::string &inputSecretKey, double inputMessageRate, uint32_t inputMessageSize, std::atomic<uint64_t> &inputRegistrationFinished, const std::atomic<bool> &inputStartSending, const std::atomic<bool> &inputStopSending)
+{
+std::chrono::steady_clock::time_point lastKeepaliveTime = std::chrono::steady_clock::now();
+
+auto sendKeepalives = [&]()
+{
+for(uint64_t i=0; i<inputState.sockets.size(); i++)
+{
+try
+{
+sendLoadMessage(*inputState.sockets[i], makeLoadMessage(inputState.socketBasestationIndex[i], 0, inputMessageSize), inputState.socketIsAuthenticated[i], inputSecretKey);
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "%s", inputException.what());
+}
+}
+lastKeepaliveTime = std::chrono::steady_clock::now();
+};
+
+for(uint64_t basestationIndex = inputState.firstBasestationIndex; basestationIndex < (inputState.firstBasestationIndex + inputState.numberOfBasestations); basestationIndex++)
+{
+bool isAuthenticated = basestationIndex < inputNumberOfAuthenticatedBasestations;
+
+try
+{
+std::unique_ptr<zmq::socket_t> socket;
+SOM_TRY
+socket.reset(new zmq::socket_t(inputContext, ZMQ_DEALER));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+socket->setsockopt(ZMQ_RCVTIMEO, (void *) &CASTER_DATA_SENDER_MAX_WAIT_TIME, sizeof(CASTER_DATA_SENDER_MAX_WAIT_TIME));
+SOM_CATCH("Error setting socket timeout\n")
+
+//Same identity scheme as casterDataSender
+std::string connectionIdentity(CASTER_DATA_SENDER_IDENTITY_SIZE, '\0');
+randombytes_buf((void *) &connectionIdentity[0], connectionIdentity.size());
+connectionIdentity[0] = 'P';
+
+SOM_TRY
+socket->setsockopt(ZMQ_IDENTITY, (const void *) connectionIdentity.c_str(), connectionIdentity.size());
+SOM_CATCH("Error setting socket identity\n")
+
+SOM_TRY
+socket->connect(inputRegistrationConnectionString.c_str());
+SOM_CATCH("Error connecting to caster\n")
+
+transmitter_registration_request registrationRequest;
+auto basestationInfo = registrationRequest.mutable_stream_info();
+basestationInfo->set_latitude(((basestationIndex*7919) % 180000)/1000.0 - 90.0);
+basestationInfo->set_longitude(((basestationIndex*104729) % 360000)/1000.0 - 180.0);
+basestationInfo->set_expected_update_rate(inputMessageRate);
+basestationInfo->set_message_format(RTCM_V3_1);
+basestationInfo->set_informal_name("loadGenerator" + std::to_string(basestationIndex));
+
+if(isAuthenticated)
+{
+(*registrationRequest.mutable_transmitter_credentials()) = inputCredentials;
+}
+
+transmitter_registration_reply registrationReply;
+bool replyReceived = false;
+bool replyDeserialized = false;
+
+std::chrono::steady_clock::time_point registrationStartTime = std::chrono::steady_clock::now();
+SOM_TRY
+std::tie(replyReceived, replyDeserialized) = remoteProcedureCall(*socket, registrationRequest, registrationReply);
+SOM_CATCH("Error, unable to complete RPC\n")
+
+if(!replyReceived || !replyDeserialized || !registrationReply.request_succeeded())
+{
+inputState.numberOfFailedRegistrations++;
+continue;
+}
+
+inputState.registrationLatencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - registrationStartTime).count());
+inputState.sockets.emplace_back(socket.release());
+inputState.socketIsAuthenticated.push_back(isAuthenticated);
+inputState.socketBasestationIndex.push_back(basestationIndex);
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "%s", inputException.what());
+inputState.numberOfFailedRegistrations++;
+}
+
+if(std::chrono::duration<double>(std::chrono::steady_clock::now() - lastKeepaliveTime).count() > KEEPALIVE_INTERVAL)
+{
+sendKeepalives();
+}
+}
+
+inputRegistrationFinished++;
+
+while(!inputStartSending)
+{ //Wait for the other drivers and the clients
+if(std::chrono::duration<double>(std::chrono::steady_clock::now() - lastKeepaliveTime).count() > KEEPALIVE_INTERVAL)
+{
+sendKeepalives();
+}
+std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+
+if(inputState.sockets.size() == 0 || inputMessageRate <= 0.0)
+{
+return;
+}
+
+//Send round robin from the slice's basestations, spacing the messages evenly
+double secondsBetweenMessages = 1.0/(inputMessageRate*inputState.sockets.size());
+std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+for(uint64_t messageNumber = 0; !inputStopSending; messageNumber++)
+{
+std::this_thread::sleep_until(startTime + std::chrono::microseconds((int64_t) (messageNumber*secondsBetweenMessages*1000000.0)));
+
+uint64_t socketIndex = messageNumber % inputState.sockets.size();
+try
+{
+sendLoadMessage(*inputState.sockets[socketIndex], makeLoadMessage(inputState.socketBasestationIndex[socketIndex], getMonotonicTime(), inputMessageSize), inputState.socketIsAuthenticated[socketIndex], inputSecretKey);
+inputState.numberOfSentMessages++;
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "%s", inputException.what());
+}
+}
+}
+
+/**
+This function polls the sockets of a group of clients and records the latency of each load message they receive until inputStopReceiving is set.
+@param inputState: The clients to poll and where to put the results
+@param inputCountMessages: Messages are only counted while this is set (so keepalives and messages in flight before the run don't count)
+@param inputStopReceiving: Set when the thread should stop
+*/
+void receiveClientMessages(clientReceiverState &inputState, const std::atomic<bool> &inputCountMessages, const std::atomic<bool> &inputStopReceiving)
+{
+std::vector<zmq::pollitem_t> pollItems;
+for(const std::unique_ptr<zmq::socket_t> &socket : inputState.sockets)
+{
+pollItems.push_back({(void *) (*socket), 0, ZMQ_POLLIN, 0});
+}
+
+zmq::message_t messageBuffer;
+while(!inputStopReceiving)
+{
+try
+{
+if(zmq::poll(pollItems.data(), pollItems.size(), CLIENT_POLL_TIMEOUT) == 0)
+{
+continue;
+}
+
+for(uint64_t i=0; i<pollItems.size(); i++)
+{
+while((pollItems[i].revents & ZMQ_POLLIN) && inputState.sockets[i]->recv(&messageBuffer, ZMQ_DONTWAIT))
+{
+int64_t receptionTime = getMonotonicTime();
+if(messageBuffer.size() < (sizeof(Poco::Int64)*2 + MINIMUM_LOAD_MESSAGE_SIZE))
+{
+continue;
+}
+
+Poco::Int64 networkOrderSendTime = 0;
+memcpy(&networkOrderSendTime, ((const char *) messageBuffer.data()) + sizeof(Poco::Int64)*2, sizeof(networkOrderSendTime));
+int64_t sendTime = Poco::ByteOrder::fromNetwork(networkOrderSendTime);
+
+if(sendTime == 0 || !inputCountMessages)
+{ //Keepalive or outside of the measurement
+continue;
+}
+
+inputState.numberOfReceivedMessages++;
+inputState.latencies.push_back((receptionTime - sendTime)/1000);
+}
+}
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "%s", inputException.what());
+}
+}
+}
+
+/**
+This function summarizes a set of latencies as count, mean, max and percentiles.
+@param inputLatencies: The latencies (microseconds), which are sorted by this function
+@return: The summary
+*/
+Json::Value summarizeLatencies(std::vector<int64_t> &inputLatencies)
+{
+Json::Value summary;
+summary["count"] = (Json::UInt64) inputLatencies.size();
+if(inputLatencies.size() == 0)
+{
+return summary;
+}
+
+std::sort(inputLatencies.begin(), inputLatencies.end());
+
+double total = 0.0;
+for(int64_t latency : inputLatencies)
+{
+total += latency;
+}
+
+auto percentile = [&](double inputFraction)
+{
+return (Json::Int64) inputLatencies[std::min<uint64_t>(inputLatencies.size() - 1, inputFraction*inputLatencies.size())];
+};
+
+summary["mean_us"] = total/inputLatencies.size();
+summary["p50_us"] = percentile(.5);
+summary["p90_us"] = percentile(.9);
+summary["p99_us"] = percentile(.99);
+summary["p999_us"] = percentile(.999);
+summary["max_us"] = (Json::Int64) inputLatencies.back();
+return summary;
+}
+
+/**
+This function reads the current and peak resident memory of this process from /proc/self/status.
+@return: An object with rss_kb and peak_rss_kb (empty if they couldn't be read)
+*/
+Json::Value readMemoryUsage()
+{
+Json::Value memory;
+std::ifstream statusFile("/proc/self/status");
+std::string line;
+while(std::getline(statusFile, line))
+{
+if(line.find("VmRSS:") == 0)
+{
+memory["rss_kb"] = (Json::Int64) std::stoll(line.substr(6));
+}
+else if(line.find("VmHWM:") == 0)
+{
+memory["peak_rss_kb"] = (Json::Int64) std::stoll(line.substr(6));
+}
+}
+
+return memory;
+}
+
+/**
+This function returns the connection string of a caster port.
+@param inputIPAddress: The IP address of the caster
+@param inputBasePort: The first port number used by the load generator
+@param inputCasterIndex: 0 for the origin caster, 1+ for the proxies
+@param inputPortOffset: Which of the caster's ports
+@return: The connection string
+*/
+std::string casterConnectionString(const std::string &inputIPAddress, int inputBasePort, int inputCasterIndex, int inputPortOffset)
+{
+return "tcp://" + inputIPAddress + ":" + std::to_string(inputBasePort + inputCasterIndex*CASTER_PORT_SPACING + inputPortOffset);
+}
+
+int main(int argc, char** argv)
+{
+//Defined options
+// -unauthenticated_basestations numberOfBasestations
+// -authenticated_basestations numberOfBasestations
+// -proxies numberOfProxyCasters
+// -clients numberOfSubscribingClients
+// -streams_per_client numberOfStreams
+// -client_threads numberOfThreads
+// -driver_threads numberOfThreads
+// -message_rate messagesPerSecondPerBasestation
+// -message_size bytes
+// -duration seconds
+// -base_port portNumber
+// -external_caster IPAddress
+// -output pathToJSONFile
+// -help list of possible options
+
+std::map<std::string, std::string> processedArguments = parseStringArguments(argv+1, argc-1); //Skip program name
+
+if(processedArguments.count("help") > 0)
+{ //Print options and exit
+printf("Starts an in-process caster (and optionally proxies of it), registers fake basestations, drives messages through them to subscribing clients and prints measurements as JSON.\n");
+printf("Possible options: \n");
+printf("-unauthenticated_basestations numberOfBasestations (default 1000)\n");
+printf("-authenticated_basestations numberOfBasestations (default 0)\n");
+printf("-proxies numberOfInProcessCastersProxyingTheFirst (default 0)\n");
+printf("-clients numberOfSubscribingClients, spread over the casters (default 10)\n");
+printf("-streams_per_client numberOfStreamsEachClientSubscribesTo (default 1)\n");
+printf("-client_threads numberOfThreadsPollingTheClients (default 2)\n");
+printf("-driver_threads numberOfThreadsRegisteringAndDrivingBasestations (default 8)\n");
+printf("-message_rate messagesPerSecondPerBasestation (default 1.0, must be at least 0.2 to keep the streams from timing out)\n");
+printf("-message_size bytesPerMessage (default 100, minimum 16)\n");
+printf("-duration secondsToSendFor (default 10)\n");
+printf("-base_port firstPortToUse (default 12000, caster i uses the ports starting at base_port + 10*i)\n");
+printf("-external_caster IPAddressOfAnAlreadyRunningCaster which uses the default port layout starting at base_port (no in-process casters or proxies are started and caster side statistics are not available)\n");
+printf("-output pathToWriteJSONTo (default stdout)\n");
+printf("-help get list of possible options\n");
+printf("Each basestation and client uses a socket, so the open file limit (ulimit -n) may need to be raised for large runs.\n");
+return 0;
+}
+
+int64_t numberOfUnauthenticatedBasestations = 1000;
+int64_t numberOfAuthenticatedBasestations = 0;
+int64_t numberOfProxies = 0;
+int64_t numberOfClients = 10;
+int64_t streamsPerClient = 1;
+int64_t numberOfClientThreads = 2;
+int64_t numberOfDriverThreads = 8;
+double messageRate = 1.0;
+int64_t messageSize = 100;
+double duration = 10.0;
+int64_t basePort = 12000;
+std::string externalCasterIPAddress;
+std::string outputPath;
+
+std::vector<std::pair<std::string, int64_t *> > integerOptions = {{"unauthenticated_basestations", &numberOfUnauthenticatedBasestations}, {"authenticated_basestations", &numberOfAuthenticatedBasestations}, {"proxies", &numberOfProxies}, {"clients", &numberOfClients}, {"streams_per_client", &streamsPerClient}, {"client_threads", &numberOfClientThreads}, {"driver_threads", &numberOfDriverThreads}, {"message_size", &messageSize}, {"base_port", &basePort}};
+for(const auto &option : integerOptions)
+{
+if(processedArguments.count(option.first) > 0)
+{
+if(convertStringToInteger(processedArguments[option.first], *option.second) == false || (*option.second) < 0)
+{
+fprintf(stderr, "Unable to read %s: %s\n", option.first.c_str(), processedArguments[option.first].c_str());
+return 1;
+}
+}
+}
+
+std::vector<std::pair<std::string, double *> > doubleOptions = {{"message_rate", &messageRate}, {"duration", &duration}};
+for(const auto &option : doubleOptions)
+{
+if(processedArguments.count(option.first) > 0)
+{
+if(convertStringToDouble(processedArguments[option.first], *option.second) == false || (*option.second) < 0.0)
+{
+fprintf(stderr, "Unable to read %s: %s\n", option.first.c_str(), processedArguments[option.first].c_str());
+return 1;
+}
+}
+}
+
+if(processedArguments.count("external_caster") > 0)
+{
+externalCasterIPAddress = processedArguments["external_caster"];
+if(numberOfAuthenticatedBasestations > 0 || numberOfProxies > 0)
+{
+fprintf(stderr, "Authenticated basestations and proxies require in-process casters\n");
+return 1;
+}
+}
+
+if(processedArguments.count("output") > 0)
+{
+outputPath = processedArguments["output"];
+}
+
+numberOfClientThreads = std::max<int64_t>(numberOfClientThreads, 1);
+numberOfDriverThreads = std::max<int64_t>(numberOfDriverThreads, 1);
+int64_t numberOfBasestations = numberOfUnauthenticatedBasestations + numberOfAuthenticatedBasestations;
+int64_t numberOfCasters = numberOfProxies + 1;
+std::string casterIPAddress = externalCasterIPAddress.size() > 0 ? externalCasterIPAddress : "127.0.0.1";
+
+if(sodium_init() == -1)
+{
+fprintf(stderr, "Unable to initialize libsodium\n");
+return 1;
+}
+
+//Every basestation and client has its own socket, so raise the ZMQ limit accordingly
+std::unique_ptr<zmq::context_t> context;
+SOM_TRY
+context.reset(new zmq::context_t(std::max<int64_t>(1, numberOfDriverThreads/2), numberOfBasestations + numberOfClients + 1024));
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate the keys the casters use and the official signing key that vouches for the authenticated basestations
+std::string casterPublicKey;
+std::string casterSecretKey;
+std::tie(casterPublicKey, casterSecretKey) = generateSigningKeys();
+
+std::string keyManagerPublicKey;
+std::string keyManagerSecretKey;
+std::tie(keyManagerPublicKey, keyManagerSecretKey) = generateSigningKeys();
+
+std::string officialSigningPublicKey;
+std::string officialSigningSecretKey;
+std::tie(officialSigningPublicKey, officialSigningSecretKey) = generateSigningKeys();
+
+std::string connectionSigningPublicKey;
+std::string connectionSigningSecretKey;
+std::tie(connectionSigningPublicKey, connectionSigningSecretKey) = generateSigningKeys();
+
+credentials connectionKeyCredentials;
+{
+authorized_permissions permissions;
+permissions.set_public_key(connectionSigningPublicKey);
+permissions.set_valid_until(Poco::Timestamp().epochMicroseconds() + (duration + 3600.0)*1000000.0);
+permissions.set_number_of_permitted_base_stations(numberOfAuthenticatedBasestations);
+
+std::string serializedPermissions;
+permissions.SerializeToString(&serializedPermissions);
+
+unsigned char permissionsSignatureArray[crypto_sign_BYTES];
+crypto_sign_detached(permissionsSignatureArray, nullptr, (const unsigned char *) serializedPermissions.c_str(), serializedPermissions.size(), (const unsigned char *) officialSigningSecretKey.c_str());
+
+signature officialSigningSignature;
+officialSigningSignature.set_public_key(officialSigningPublicKey);
+officialSigningSignature.set_cryptographic_signature(std::string((const char *) permissionsSignatureArray, crypto_sign_BYTES));
+
+connectionKeyCredentials.set_permissions(serializedPermissions);
+(*connectionKeyCredentials.add_signatures()) = officialSigningSignature;
+}
+
+//Start the casters
+std::vector<std::unique_ptr<caster> > casters;
+if(externalCasterIPAddress.size() == 0)
+{
+std::vector<std::future<void> > proxyAdditions; //Made in parallel
+for(int64_t casterIndex = 0; casterIndex < numberOfCasters; casterIndex++)
+{
+int casterBasePort = basePort + casterIndex*CASTER_PORT_SPACING;
+
+SOM_TRY
+casters.emplace_back(new caster(context.get(), ORIGIN_CASTER_ID + casterIndex, casterBasePort + REGISTRATION_PORT_OFFSET, casterBasePort + CLIENT_REQUEST_PORT_OFFSET, casterBasePort + CLIENT_PUBLISHING_PORT_OFFSET, casterBasePort + PROXY_PUBLISHING_PORT_OFFSET, casterBasePort + STREAM_STATUS_NOTIFICATION_PORT_OFFSET, casterBasePort + KEY_MANAGEMENT_PORT_OFFSET, casterPublicKey, casterSecretKey, keyManagerPublicKey, std::vector<std::string>{officialSigningPublicKey}, std::vector<std::string>(0), std::vector<std::string>(0)));
+SOM_CATCH("Error, unable to start caster\n")
+
+if(casterIndex > 0)
+{ //Proxy the origin caster through its client interfaces
+SOM_TRY
+proxyAdditions.push_back(casters.back()->addProxyAsync(casterConnectionString(casterIPAddress, basePort, 0, CLIENT_REQUEST_PORT_OFFSET), casterConnectionString(casterIPAddress, basePort, 0, CLIENT_PUBLISHING_PORT_OFFSET), casterConnectionString(casterIPAddress, basePort, 0, STREAM_STATUS_NOTIFICATION_PORT_OFFSET)));
+SOM_CATCH("Error, unable to add proxy\n")
+}
+}
+
+for(std::future<void> &proxyAddition : proxyAdditions)
+{
+SOM_TRY
+proxyAddition.get();
+SOM_CATCH("Error, unable to add proxy\n")
+}
+}
+
+//Register the basestations from the driver threads (authenticated ones first)
+std::atomic<uint64_t> numberOfFinishedRegistrationDrivers(0);
+std::atomic<bool> startSending(false);
+std::atomic<bool> stopSending(false);
+
+std::vector<basestationDriverState> driverStates(numberOfDriverThreads);
+std::vector<std::thread> driverThreads;
+std::string registrationConnectionString = casterConnectionString(casterIPAddress, basePort, 0, REGISTRATION_PORT_OFFSET);
+
+std::chrono::steady_clock::time_point registrationStartTime = std::chrono::steady_clock::now();
+for(int64_t i=0; i<numberOfDriverThreads; i++)
+{
+driverStates[i].firstBasestationIndex = (numberOfBasestations*i)/numberOfDriverThreads;
+driverStates[i].numberOfBasestations = (numberOfBasestations*(i+1))/numberOfDriverThreads - driverStates[i].firstBasestationIndex;
+driverThreads.emplace_back(registerAndDriveBasestations, std::ref(driverStates[i]), std::ref(*context), registrationConnectionString, numberOfAuthenticatedBasestations, std::cref(connectionKeyCredentials), std::cref(connectionSigningSecretKey), messageRate, messageSize, std::ref(numberOfFinishedRegistrationDrivers), std::cref(startSending), std::cref(stopSending));
+}
+
+while(numberOfFinishedRegistrationDrivers < driverThreads.size())
+{
+std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+double registrationDuration = std::chrono::duration<double>(std::chrono::steady_clock::now() - registrationStartTime).count();
+
+uint64_t numberOfRegisteredBasestations = 0;
+for(const basestationDriverState &state : driverStates)
+{
+numberOfRegisteredBasestations += state.sockets.size();
+}
+
+//Wait for every caster to list the basestations, so the clients know the stream IDs
+std::vector<std::vector<int64_t> > casterIndexToStreamIDs(numberOfCasters);
+std::vector<int64_t> casterIndexToCasterID(numberOfCasters, 0);
+std::chrono::steady_clock::time_point discoveryStartTime = std::chrono::steady_clock::now();
+for(int64_t casterIndex = 0; casterIndex < numberOfCasters; casterIndex++)
+{
+while(true)
+{
+client_query_request queryRequest; //Empty request returns all
+client_query_reply queryReply;
+
+try
+{
+queryReply = transceiver::queryPylonGPSV2Caster(queryRequest, casterIPAddress + ":" + std::to_string(basePort + casterIndex*CASTER_PORT_SPACING + CLIENT_REQUEST_PORT_OFFSET), 5000, *context);
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "%s", inputException.what());
+}
+
+casterIndexToCasterID[casterIndex] = queryReply.caster_id();
+casterIndexToStreamIDs[casterIndex].clear();
+for(int i=0; i<queryReply.base_stations_size(); i++)
+{
+if(queryReply.base_stations(i).informal_name().find("loadGenerator") == 0)
+{
+casterIndexToStreamIDs[casterIndex].push_back(queryReply.base_stations(i).base_station_id());
+}
+}
+
+if(casterIndexToStreamIDs[casterIndex].size() >= numberOfRegisteredBasestations || std::chrono::duration<double>(std::chrono::steady_clock::now() - discoveryStartTime).count() > STREAM_DISCOVERY_TIMEOUT)
+{
+break;
+}
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+}
+
+//Make the clients, spreading them over the casters and their streams
+std::atomic<bool> countMessages(false);
+std::atomic<bool> stopReceiving(false);
+std::vector<clientReceiverState> clientStates(numberOfClientThreads);
+uint64_t numberOfSubscriptions = 0;
+for(int64_t clientIndex = 0; clientIndex < numberOfClients; clientIndex++)
+{
+int64_t casterIndex = clientIndex % numberOfCasters;
+const std::vector<int64_t> &streamIDs = casterIndexToStreamIDs[casterIndex];
+
+std::unique_ptr<zmq::socket_t> socket;
+SOM_TRY
+socket.reset(new zmq::socket_t(*context, ZMQ_SUB));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+socket->connect(casterConnectionString(casterIPAddress, basePort, casterIndex, CLIENT_PUBLISHING_PORT_OFFSET).c_str());
+SOM_CATCH("Error connecting to caster\n")
+
+for(int64_t streamNumber = 0; streamNumber < streamsPerClient && streamIDs.size() > 0; streamNumber++)
+{
+int64_t streamID = streamIDs[((clientIndex/numberOfCasters)*streamsPerClient + streamNumber) % streamIDs.size()];
+std::string subscriptionPrefix = generateStreamSubscriptionPrefix(casterIndexToCasterID[casterIndex], streamID);
+
+SOM_TRY
+socket->setsockopt(ZMQ_SUBSCRIBE, subscriptionPrefix.c_str(), subscriptionPrefix.size());
+SOM_CATCH("Error setting subscription\n")
+numberOfSubscriptions++;
+}
+
+clientStates[clientIndex % numberOfClientThreads].sockets.emplace_back(socket.release());
+}
+
+std::vector<std::thread> clientThreads;
+for(clientReceiverState &state : clientStates)
+{
+clientThreads.emplace_back(receiveClientMessages, std::ref(state), std::cref(countMessages), std::cref(stopReceiving));
+}
+
+//Give the subscriptions time to propagate, then run
+std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+countMessages = true;
+std::chrono::steady_clock::time_point sendingStartTime = std::chrono::steady_clock::now();
+startSending = true;
+std::this_thread::sleep_for(std::chrono::microseconds((int64_t) (duration*1000000.0)));
+stopSending = true;
+
+for(std::thread &driverThread : driverThreads)
+{
+driverThread.join();
+}
+double sendingDuration = std::chrono::duration<double>(std::chrono::steady_clock::now() - sendingStartTime).count();
+
+std::this_thread::sleep_for(std::chrono::microseconds((int64_t) (DRAIN_TIME*1000000.0)));
+stopReceiving = true;
+for(std::thread &clientThread : clientThreads)
+{
+clientThread.join();
+}
+
+//Assemble the report
+Json::Value report;
+Json::Value &configuration = report["configuration"];
+configuration["unauthenticated_basestations"] = (Json::Int64) numberOfUnauthenticatedBasestations;
+configuration["authenticated_basestations"] = (Json::Int64) numberOfAuthenticatedBasestations;
+configuration["proxies"] = (Json::Int64) numberOfProxies;
+configuration["clients"] = (Json::Int64) numberOfClients;
+configuration["streams_per_client"] = (Json::Int64) streamsPerClient;
+configuration["message_rate"] = messageRate;
+configuration["message_size"] = (Json::Int64) std::max<int64_t>(messageSize, MINIMUM_LOAD_MESSAGE_SIZE);
+configuration["duration"] = duration;
+configuration["external_caster"] = externalCasterIPAddress;
+
+std::vector<int64_t> registrationLatencies;
+uint64_t numberOfFailedRegistrations = 0;
+uint64_t numberOfSentMessages = 0;
+for(const basestationDriverState &state : driverStates)
+{
+registrationLatencies.insert(registrationLatencies.end(), state.registrationLatencies.begin(), state.registrationLatencies.end());
+numberOfFailedRegistrations += state.numberOfFailedRegistrations;
+numberOfSentMessages += state.numberOfSentMessages;
+}
+
+Json::Value &registration = report["registration"];
+registration = summarizeLatencies(registrationLatencies);
+registration["failures"] = (Json::UInt64) numberOfFailedRegistrations;
+registration["duration_s"] = registrationDuration;
+registration["registrations_per_second"] = registrationDuration > 0.0 ? numberOfRegisteredBasestations/registrationDuration : 0.0;
+for(int64_t casterIndex = 0; casterIndex < numberOfCasters; casterIndex++)
+{
+registration["streams_listed_by_caster"].append((Json::UInt64) casterIndexToStreamIDs[casterIndex].size());
+}
+
+Json::Value &ingest = report["ingest"];
+ingest["sent_messages"] = (Json::UInt64) numberOfSentMessages;
+ingest["messages_per_second"] = sendingDuration > 0.0 ? numberOfSentMessages/sendingDuration : 0.0;
+ingest["bytes_per_second"] = sendingDuration > 0.0 ? (numberOfSentMessages*std::max<int64_t>(messageSize, MINIMUM_LOAD_MESSAGE_SIZE))/sendingDuration : 0.0;
+
+Json::Value &publish = report["publish"];
+for(const std::unique_ptr<caster> &casterInstance : casters)
+{
+Json::Value casterStatistics;
+uint64_t numberOfIngestDrops = 0;
+for(const auto &streamIDAndDropCount : casterInstance->getStreamIngestDropCounts())
+{
+numberOfIngestDrops += streamIDAndDropCount.second;
+}
+
+uint64_t numberOfPublishedMessages = 0;
+uint64_t numberOfPublishingDrops = 0;
+for(const auto &stationClassStatistics : casterInstance->getStationClassPublishingStatistics())
+{
+numberOfPublishedMessages += stationClassStatistics.second.numberOfPublishedMessages;
+numberOfPublishingDrops += stationClassStatistics.second.numberOfDroppedMessages;
+}
+
+casterStatistics["ingest_dropped_messages"] = (Json::UInt64) numberOfIngestDrops;
+casterStatistics["published_messages"] = (Json::UInt64) numberOfPublishedMessages;
+casterStatistics["publishing_dropped_messages"] = (Json::UInt64) numberOfPublishingDrops;
+publish["casters"].append(casterStatistics);
+}
+
+std::vector<int64_t> deliveryLatencies;
+uint64_t numberOfReceivedMessages = 0;
+for(clientReceiverState &state : clientStates)
+{
+deliveryLatencies.insert(deliveryLatencies.end(), state.latencies.begin(), state.latencies.end());
+numberOfReceivedMessages += state.numberOfReceivedMessages;
+}
+
+Json::Value &delivery = report["delivery"];
+delivery["subscriptions"] = (Json::UInt64) numberOfSubscriptions;
+delivery["received_messages"] = (Json::UInt64) numberOfReceivedMessages;
+delivery["messages_per_second"] = sendingDuration > 0.0 ? numberOfReceivedMessages/sendingDuration : 0.0;
+delivery["latency"] = summarizeLatencies(deliveryLatencies);
+
+report["memory"] = readMemoryUsage();
+
+Json::StyledWriter writer;
+std::string serializedReport = writer.write(report);
+if(outputPath.size() > 0)
+{
+std::ofstream outputFile(outputPath);
+if(!outputFile)
+{
+fprintf(stderr, "Unable to open %s\n", outputPath.c_str());
+return 1;
+}
+outputFile << serializedReport;
+}
+else
+{
+printf("%s", serializedReport.c_str());
+}
+
+return 0;
+}
@@ -0,0 +1,106 @@
+#include<cstdio>
+#include<string>
+#include<vector>
+#include<algorithm>
+
+#include "utilityFunctions.hpp"
+#include "trace_ring_dump.pb.h"
+
+using namespace pylongps;
+
+/**
+This class holds one record of the merged timeline along with the thread it came from.
+*/
+class timelineEntry
+{
+public:
+const trace_ring_record *record;
+const trace_ring_thread *thread;
+};
+
+int main(int argc, char** argv)
+{
+//Defined options
+// -i traceDumpFile
+// -thread threadNameSubstring
+// -last numberOfRecords
+// -help list of possible options
+
+std::map<std::string, std::string> processedArguments = parseStringArguments(argv+1, argc-1); //Skip program name
+
+// -help list of possible options
+if(processedArguments.count("help") > 0 || processedArguments.count("i") == 0)
+{ //Print options and exit
+printf("Prints the records of a caster trace dump (made by sending SIGUSR1 to the caster or from GET /trace on its metrics port) as a single timeline, oldest first.\n");
+printf("Possible options: \n");
+printf("-i traceDumpFile\n");
+printf("-thread onlyShowThreadsWithNamesContainingThis\n");
+printf("-last onlyShowThisManyOfTheMostRecentRecords\n");
+printf("-help get list of possible options\n");
+return processedArguments.count("help") > 0 ? 0 : 1;
+}
+
+trace_ring_dump dump;
+if(loadProtobufObjectFromFile(processedArguments["i"], dump) == false)
+{
+fprintf(stderr, "Unable to load trace dump from file: %s\n", processedArguments["i"].c_str());
+return 1;
+}
+
+std::string threadFilter;
+if(processedArguments.count("thread") > 0)
+{
+threadFilter = processedArguments["thread"];
+}
+
+int64_t numberOfRecordsToShow = -1;
+if(processedArguments.count("last") > 0)
+{
+if(convertStringToInteger(processedArguments["last"], numberOfRecordsToShow) == false)
+{
+fprintf(stderr, "Unable to read last: %s\n", processedArguments["last"].c_str());
+return 1;
+}
+}
+
+//Summarize the threads and merge their records
+printf("Process %ld, dumped at %.6f\n", (long) dump.process_id(), dump.dump_epoch_time()/1e6);
+
+std::vector<timelineEntry> timeline;
+for(int i=0; i<dump.threads_size(); i++)
+{
+const trace_ring_thread &thread = dump.threads(i);
+if(thread.thread_name().find(threadFilter) == std::string::npos)
+{
+continue;
+}
+
+printf("Thread %s (ID %ld%s): %d records, %lu older records overwritten\n", thread.thread_name().c_str(), (long) thread.thread_id(), thread.thread_has_exited() ? ", exited" : "", thread.records_size(), (unsigned long) thread.number_of_overwritten_records());
+
+for(int a=0; a<thread.records_size(); a++)
+{
+timeline.push_back(timelineEntry{&thread.records(a), &thread});
+}
+}
+
+std::stable_sort(timeline.begin(), timeline.end(), [](const timelineEntry &inputFirst, const timelineEntry &inputSecond) { return inputFirst.record->time() < inputSecond.record->time(); });
+
+uint64_t firstEntryToShow = 0;
+if(numberOfRecordsToShow >= 0 && ((uint64_t) numberOfRecordsToShow) < timeline.size())
+{
+firstEntryToShow = timeline.size() - numberOfRecordsToShow;
+}
+
+//Record times are from the monotonic clock, so convert them to wall clock times using the time the dump was made
+printf("\n%-18s %-14s %-40s %-32s %s\n", "time", "before dump", "thread", "event", "IDs");
+for(uint64_t i = firstEntryToShow; i < timeline.size(); i++)
+{
+const trace_ring_record &record = *timeline[i].record;
+int64_t nanosecondsBeforeDump = dump.dump_monotonic_time() - record.time();
+double epochTime = dump.dump_epoch_time()/1e6 - nanosecondsBeforeDump/1e9;
+
+printf("%-18.6f %-14.6f %-40s %-32s %ld %ld\n", epochTime, nanosecondsBeforeDump/1e9, timeline[i].thread->thread_name().c_str(), trace_ring_event_type_Name(record.type()).c_str(), (long) record.first_id(), (long) record.second_id());
+}
+
+return 0;
+}
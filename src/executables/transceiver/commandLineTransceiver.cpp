@@ -416,7 +416,7 @@ std::string clientPortConnectionString = std::get<0>(inputCasterConnectionInfo)
 
 try
 {
-dataReceiverConnectionString = dataTransceiver.createPylonGPSV2DataReceiver(clientPortConnectionString, reply.caster_id(), reply.base_stations(0).base_station_id());
+dataReceiverConnectionString = dataTransceiver.createPylonGPSV2DataReceiver(clientPortConnectionString, reply.caster_id(), reply.base_stations(0).base_station_id(), reply.base_stations(0).has_stream_frame_headers());
 }
 catch(const std::exception &inputException)
 {
@@ -483,7 +483,7 @@ try
 std::pair<int64_t, int64_t> basestationID(inputCasterID, inputStreamID);
 
 SOM_TRY
-dataReceiverConnectionString = receiverSender->createPylonGPSV2DataReceiver(casterIPString + ":10003", inputCasterID, inputStreamID);
+dataReceiverConnectionString = receiverSender->createPylonGPSV2DataReceiver(casterIPString + ":10003", inputCasterID, inputStreamID, inputBasestationInfo.has_stream_frame_headers());
 SOM_CATCH("Error, unable to create data receiver\n")
 selectedBasestationIDToAssociatedZMQDataReceiver.emplace(basestationID, dataReceiverConnectionString);
 
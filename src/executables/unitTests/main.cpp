@@ -13,6 +13,7 @@
 #include "utilityFunctions.hpp"
 #include "reactor.hpp"
 #include<unistd.h>
+#include<sys/resource.h>
 #include "fileDataReceiver.hpp"
 #include<Poco/Net/StreamSocket.h>
 #include "tcpDataReceiver.hpp"
@@ -20,10 +21,52 @@
 //#include "ntripV1DataReceiver.hpp"
 #include<json.h>
 #include "commandLineArgumentParser.hpp"
+#include "lastMessageCache.hpp"
+#include "tokenBucket.hpp"
+#include "stationClassPublishingQueue.hpp"
+#include "streamFrameHeader.hpp"
+#include "streamDeliveryTracker.hpp"
+#include "zmqDataReceiver.hpp"
+#include "fileDataSender.hpp"
+#include "batchedFileWriter.hpp"
+#include "streamRecording.hpp"
+#include "recordingDataSender.hpp"
+#include "recordingDataReceiver.hpp"
+#include "latencyTracer.hpp"
+#include "traceRing.hpp"
+#include "proxyStreamTable.hpp"
+#include "verifiedCredentialsCache.hpp"
+#include "keyGraph.hpp"
 
 using namespace pylongps; //Use pylongps classes without alteration for now
 using namespace pylongps_protobuf_sql_converter; //Use protobuf/sql converter test message
 
+/**
+This function makes the configuration for a test caster with no signing keys other than the key manager's, so that tests can set the options which are only available through caster_configuration.
+@param inputCasterID: The ID of the caster
+@param inputPorts: The transmitter registration/streaming, client request, client stream publishing, proxy stream publishing, stream status notification and key registration/removal ports, in that order
+@param inputCasterPublicKey: The public key of the caster
+@param inputCasterSecretKey: The secret key of the caster
+@param inputSigningKeysManagementKey: The key manager's public signing key
+@return: The configuration
+*/
+caster_configuration makeTestCasterConfiguration(int64_t inputCasterID, const std::vector<int> &inputPorts, const std::string &inputCasterPublicKey, const std::string &inputCasterSecretKey, const std::string &inputSigningKeysManagementKey)
+{
+caster_configuration configuration;
+configuration.set_caster_id(inputCasterID);
+configuration.set_transmitter_registration_and_streaming_port_number(inputPorts.at(0));
+configuration.set_client_request_port_number(inputPorts.at(1));
+configuration.set_client_stream_publishing_port_number(inputPorts.at(2));
+configuration.set_proxy_stream_publishing_port_number(inputPorts.at(3));
+configuration.set_stream_status_notification_port_number(inputPorts.at(4));
+configuration.set_key_registration_and_removal_port_number(inputPorts.at(5));
+configuration.set_caster_public_key(inputCasterPublicKey);
+configuration.set_caster_secret_key(inputCasterSecretKey);
+configuration.set_signing_keys_management_key(inputSigningKeysManagementKey);
+
+return configuration;
+}
+
 TEST_CASE("CommandLineArgumentParser", "[CommandLineArgumentParser]")
 {
 SECTION("Zero arguments", "[CommandLineArgumentParser]")
@@ -1702,8 +1745,8 @@ SOM_TRY //Set filter to allow any published messages to be received
 subscriberSocket->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
 SOM_CATCH("Error setting subscription for socket\n")
 
-//Sleep for a few milliseconds to allow connection to stabilize so no messages are missed
-std::this_thread::sleep_for(std::chrono::milliseconds(10));
+//Sleep to allow connection to stabilize and the subscription to propagate to the proxied caster so no messages are missed
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
 //Send a message via each of the basestations
 std::string firstSocketUpdateString = "Hello world\n";
@@ -1874,3 +1917,2981 @@ remove(tempFilePath.c_str());
 }
 
 
+
+TEST_CASE( "Test caster state handoff", "[test]")
+{
+SECTION( "Hand off a registered stream to a replacement caster")
+{
+//Make ZMQ context
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate keys to use
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+//Generate key manager signing key
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+Poco::Int64 casterID = 991;
+int registrationPort = 9110;
+int clientRequestPort = 9113;
+int clientPublishingPort = 9114;
+int proxyPublishingPort = 9115;
+int streamStatusNotificationPort = 9116;
+int keyManagementPort = 9117;
+std::string stateHandoffAddress = "inproc://casterStateHandoffTest";
+
+std::unique_ptr<caster> originalCaster;
+
+caster_configuration originalConfiguration = makeTestCasterConfiguration(casterID, {registrationPort, clientRequestPort, clientPublishingPort, proxyPublishingPort, streamStatusNotificationPort, keyManagementPort}, casterPublicKey, casterPrivateKey, keyManagerPublicKey);
+originalConfiguration.set_state_handoff_connection_string(stateHandoffAddress);
+
+SOM_TRY
+originalCaster.reset(new caster(context.get(), originalConfiguration));
+SOM_CATCH("Error constructing caster\n")
+
+std::unique_ptr<zmq::socket_t> testMessagePublisher;
+
+SOM_TRY //Init socket
+testMessagePublisher.reset(new zmq::socket_t(*context, ZMQ_PUB));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+testMessagePublisher->bind("tcp://*:10011");
+SOM_CATCH("Error binding socket\n")
+
+std::unique_ptr<transceiver> com;
+
+SOM_TRY
+com.reset(new transceiver(*context));
+SOM_CATCH("Error initializing transceiver\n")
+
+std::string pubDataReceiverAddress;
+
+SOM_TRY
+pubDataReceiverAddress = com->createZMQPubDataReceiver("127.0.0.1:10011");
+SOM_CATCH("Error, unable to create data receiver\n")
+
+SOM_TRY 
+com->createPylonGPSV2DataSender(pubDataReceiverAddress, "127.0.0.1:" +std::to_string(registrationPort), 1.0, 2.0, RTCM_V3_1, "handoffBasestation", 3.0);
+SOM_CATCH("Error making caster sender\n")
+
+std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+client_query_request queryRequest; //Empty request should return all
+client_query_reply queryReply;
+
+SOM_TRY
+queryReply = transceiver::queryPylonGPSV2Caster(queryRequest, "127.0.0.1:" + std::to_string(clientRequestPort), 5000, *context);
+SOM_CATCH("Error querying caster\n")
+
+REQUIRE(queryReply.base_stations_size() == 1);
+auto baseStationID = queryReply.base_stations(0).base_station_id();
+
+//Start the replacement caster, which should take over the ports and the registered stream
+std::unique_ptr<caster> replacementCaster;
+
+caster_configuration replacementConfiguration = makeTestCasterConfiguration(casterID, {registrationPort, clientRequestPort, clientPublishingPort, proxyPublishingPort, streamStatusNotificationPort, keyManagementPort}, casterPublicKey, casterPrivateKey, keyManagerPublicKey);
+replacementConfiguration.set_previous_caster_state_handoff_connection_string(stateHandoffAddress);
+
+SOM_TRY
+replacementCaster.reset(new caster(context.get(), replacementConfiguration));
+SOM_CATCH("Error constructing replacement caster\n")
+
+REQUIRE(originalCaster->hasHandedOffState() == true);
+
+SOM_TRY
+queryReply = transceiver::queryPylonGPSV2Caster(queryRequest, "127.0.0.1:" + std::to_string(clientRequestPort), 5000, *context);
+SOM_CATCH("Error querying replacement caster\n")
+
+REQUIRE(queryReply.has_caster_id() == true);
+REQUIRE(queryReply.caster_id() == casterID);
+REQUIRE(queryReply.base_stations_size() == 1);
+REQUIRE(queryReply.base_stations(0).base_station_id() == baseStationID);
+REQUIRE(queryReply.base_stations(0).informal_name() == "handoffBasestation");
+}
+
+SECTION( "Handed off ports are shared without closing the existing connections")
+{
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+Poco::Int64 casterID = 992;
+std::vector<int> ports = {9260, 9261, 9262, 9263, 9264, 9265, 9266}; //The last is the metrics port
+std::string stateHandoffAddress = "inproc://casterPortReleaseTest";
+
+std::unique_ptr<caster> originalCaster;
+
+caster_configuration configuration = makeTestCasterConfiguration(casterID, {ports[0], ports[1], ports[2], ports[3], ports[4], ports[5]}, casterPublicKey, casterPrivateKey, keyManagerPublicKey);
+configuration.set_state_handoff_connection_string(stateHandoffAddress);
+configuration.set_metrics_port_number(ports[6]);
+
+SOM_TRY
+originalCaster.reset(new caster(context.get(), configuration));
+SOM_CATCH("Error constructing caster\n")
+
+//Connect a client before the handoff, which should keep being served by the original caster afterwards
+zmq::socket_t clientRequestSocket(*context, ZMQ_REQ);
+int timeoutWaitTime = 5000;
+clientRequestSocket.setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+clientRequestSocket.connect(("tcp://127.0.0.1:" + std::to_string(ports[1])).c_str());
+
+client_query_request queryRequest; //Empty request should return all
+client_query_reply queryReply;
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+std::tie(messageReceived, messageDeserializedCorrectly) = remoteProcedureCall(clientRequestSocket, queryRequest, queryReply);
+REQUIRE(messageReceived);
+REQUIRE(messageDeserializedCorrectly);
+
+//Ask for the state the way a replacement caster would
+zmq::socket_t handoffSocket(*context, ZMQ_REQ);
+handoffSocket.setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+handoffSocket.connect(stateHandoffAddress.c_str());
+
+caster_state_handoff_request request;
+request.set_caster_id(casterID);
+sendProtobufMessage(handoffSocket, request);
+
+caster_state_handoff_reply reply;
+std::tie(messageReceived, messageDeserializedCorrectly) = receiveProtobufMessage(handoffSocket, reply);
+REQUIRE(messageReceived);
+REQUIRE(messageDeserializedCorrectly);
+REQUIRE(reply.has_failure_reason() == false);
+REQUIRE(originalCaster->hasHandedOffState());
+
+//Every port can be bound by a replacement right away while the original caster is still running
+std::vector<std::unique_ptr<zmq::socket_t>> replacementSockets;
+for(int port : ports)
+{
+replacementSockets.emplace_back(new zmq::socket_t(*context, ZMQ_ROUTER));
+REQUIRE_NOTHROW(bindZMQSocketToSharedTCPPort(*replacementSockets.back(), port, true, 0));
+}
+
+//The client's connection is still open, so the original caster answers it (the replacement sockets never reply)
+std::tie(messageReceived, messageDeserializedCorrectly) = remoteProcedureCall(clientRequestSocket, queryRequest, queryReply);
+REQUIRE(messageReceived);
+REQUIRE(messageDeserializedCorrectly);
+REQUIRE(queryReply.caster_id() == casterID);
+}
+}
+
+TEST_CASE( "Test client stream subscription counting", "[test]")
+{
+SECTION( "Subscribe and unsubscribe to caster streams")
+{
+//Make ZMQ context
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate keys to use
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+//Generate key manager signing key
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+Poco::Int64 casterID = 992;
+int clientPublishingPort = 9124;
+
+caster myCaster(context.get(), casterID, 9120, 9123, clientPublishingPort, 9125, 9126, 9127, casterPublicKey, casterPrivateKey, keyManagerPublicKey, std::vector<std::string>(0), std::vector<std::string>(0), std::vector<std::string>(0));
+
+REQUIRE(myCaster.getClientStreamSubscriberCounts().size() == 0);
+REQUIRE(myCaster.getAllClientStreamsSubscriberCount() == 0);
+
+std::unique_ptr<zmq::socket_t> subscriberSocket;
+
+SOM_TRY //Init socket
+subscriberSocket.reset(new zmq::socket_t(*context, ZMQ_SUB));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+std::string connectionString = "tcp://127.0.0.1:" + std::to_string(clientPublishingPort);
+subscriberSocket->connect(connectionString.c_str());
+SOM_CATCH("Error connecting socket\n")
+
+Poco::Int64 streamFilter[2];
+streamFilter[0] = Poco::ByteOrder::toNetwork(casterID);
+streamFilter[1] = Poco::ByteOrder::toNetwork(Poco::Int64(7));
+
+Poco::Int64 otherCasterFilter = Poco::ByteOrder::toNetwork(Poco::Int64(casterID+1));
+
+SOM_TRY
+subscriberSocket->setsockopt(ZMQ_SUBSCRIBE, (void *) streamFilter, sizeof(streamFilter));
+subscriberSocket->setsockopt(ZMQ_SUBSCRIBE, (void *) &otherCasterFilter, sizeof(otherCasterFilter));
+SOM_CATCH("Error setting subscriptions\n")
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+auto subscriberCounts = myCaster.getClientStreamSubscriberCounts();
+REQUIRE(subscriberCounts.size() == 1);
+REQUIRE(subscriberCounts.count(7) == 1);
+REQUIRE(subscriberCounts.at(7) == 1);
+REQUIRE(myCaster.getAllClientStreamsSubscriberCount() == 0);
+
+SOM_TRY
+subscriberSocket->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
+subscriberSocket->setsockopt(ZMQ_UNSUBSCRIBE, (void *) streamFilter, sizeof(streamFilter));
+SOM_CATCH("Error changing subscriptions\n")
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+REQUIRE(myCaster.getClientStreamSubscriberCounts().size() == 0);
+REQUIRE(myCaster.getAllClientStreamsSubscriberCount() == 1);
+}
+}
+
+TEST_CASE( "Test demand driven proxy subscriptions", "[test]")
+{
+SECTION( "Only proxy the streams local clients are subscribed to")
+{
+//Make ZMQ context
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate keys to use
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+//Generate key manager signing key
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+Poco::Int64 firstCasterID = 993;
+int firstRegistrationPort = 9130;
+int firstClientRequestPort = 9133;
+int firstClientPublishingPort = 9134;
+int firstStreamStatusNotificationPort = 9136;
+
+caster firstCaster(context.get(), firstCasterID, firstRegistrationPort, firstClientRequestPort, firstClientPublishingPort, 9135, firstStreamStatusNotificationPort, 9137, casterPublicKey, casterPrivateKey, keyManagerPublicKey, std::vector<std::string>(0), std::vector<std::string>(0), std::vector<std::string>(0));
+
+Poco::Int64 secondCasterID = 994;
+int secondClientRequestPort = 9143;
+int secondClientPublishingPort = 9144;
+int secondProxyPublishingPort = 9145;
+
+caster secondCaster(context.get(), secondCasterID, 9140, secondClientRequestPort, secondClientPublishingPort, secondProxyPublishingPort, 9146, 9147, casterPublicKey, casterPrivateKey, keyManagerPublicKey, std::vector<std::string>(0), std::vector<std::string>(0), std::vector<std::string>(0));
+
+//Proxy the first caster through its client publishing interface (its proxy publishing interface passes subscriptions on as well, see below)
+SOM_TRY
+secondCaster.addProxy("tcp://127.0.0.1:" + std::to_string(firstClientRequestPort), "tcp://127.0.0.1:" + std::to_string(firstClientPublishingPort), "tcp://127.0.0.1:" + std::to_string(firstStreamStatusNotificationPort));
+SOM_CATCH("Error, unable to add proxy\n")
+
+//Register two basestations with the first caster
+std::vector<std::unique_ptr<zmq::socket_t> > registrationSockets;
+for(int i=0; i<2; i++)
+{
+registrationSockets.emplace_back(new zmq::socket_t(*context, ZMQ_DEALER));
+
+int timeoutWaitTime = 5000; //Max 5 seconds
+registrationSockets.back()->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+
+std::string connectionString = "tcp://127.0.0.1:" +std::to_string(firstRegistrationPort);
+registrationSockets.back()->connect(connectionString.c_str());
+
+transmitter_registration_request registrationRequest;
+auto basestationInfo = registrationRequest.mutable_stream_info();
+basestationInfo->set_latitude(1.0);
+basestationInfo->set_longitude(2.0);
+basestationInfo->set_expected_update_rate(3.0);
+basestationInfo->set_message_format(RTCM_V3_1);
+basestationInfo->set_informal_name("demandBasestation" + std::to_string(i));
+
+transmitter_registration_reply registrationReply;
+
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+SOM_TRY
+std::tie(messageReceived, messageDeserializedCorrectly) = remoteProcedureCall(*registrationSockets.back(), registrationRequest, registrationReply);
+SOM_CATCH("Error, stream registration failed\n")
+
+REQUIRE(registrationReply.request_succeeded() == true);
+}
+
+//Give a little time for the notifications to propagate
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+client_query_request queryRequest; //Empty request should return all
+client_query_reply queryReply;
+
+SOM_TRY
+queryReply = transceiver::queryPylonGPSV2Caster(queryRequest, "127.0.0.1:" + std::to_string(secondClientRequestPort), 5000, *context);
+SOM_CATCH("Error querying caster\n")
+
+REQUIRE(queryReply.base_stations_size() == 2);
+
+int64_t subscribedStreamID = 0;
+for(int i=0; i<queryReply.base_stations_size(); i++)
+{
+if(queryReply.base_stations(i).informal_name() == "demandBasestation0")
+{
+subscribedStreamID = queryReply.base_stations(i).base_station_id();
+}
+}
+
+//Subscribe to the first stream on the second caster and listen to everything the second caster receives from the first
+std::unique_ptr<zmq::socket_t> clientSubscriberSocket(new zmq::socket_t(*context, ZMQ_SUB));
+std::unique_ptr<zmq::socket_t> proxySubscriberSocket(new zmq::socket_t(*context, ZMQ_SUB));
+
+int timeoutWaitTime = 1000; //Max 1 second
+clientSubscriberSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+proxySubscriberSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+
+std::string clientConnectionString = "tcp://127.0.0.1:" + std::to_string(secondClientPublishingPort);
+clientSubscriberSocket->connect(clientConnectionString.c_str());
+std::string proxyConnectionString = "tcp://127.0.0.1:" + std::to_string(secondProxyPublishingPort);
+proxySubscriberSocket->connect(proxyConnectionString.c_str());
+
+std::string streamPrefix = generateStreamSubscriptionPrefix(secondCasterID, subscribedStreamID);
+clientSubscriberSocket->setsockopt(ZMQ_SUBSCRIBE, (void *) streamPrefix.c_str(), streamPrefix.size());
+
+//Subscribing to just the caster ID receives everything without counting as demand (how the caster's statistics are gathered)
+std::string casterIDPrefix = streamPrefix.substr(0, sizeof(Poco::Int64));
+proxySubscriberSocket->setsockopt(ZMQ_SUBSCRIBE, (void *) casterIDPrefix.c_str(), casterIDPrefix.size());
+
+//Allow the subscription to propagate to the first caster
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+std::string unsubscribedUpdate = "Nobody wants this\n";
+std::string subscribedUpdate = "Hello world\n";
+
+registrationSockets[1]->send(unsubscribedUpdate.c_str(), unsubscribedUpdate.size());
+registrationSockets[0]->send(subscribedUpdate.c_str(), subscribedUpdate.size());
+
+zmq::message_t messageBuffer;
+
+//Only the subscribed stream should have been forwarded by the second caster
+REQUIRE(proxySubscriberSocket->recv(&messageBuffer) == true);
+REQUIRE(std::string(((const char *) messageBuffer.data()) + sizeof(Poco::Int64)*2, messageBuffer.size() - sizeof(Poco::Int64)*2) == subscribedUpdate);
+REQUIRE(proxySubscriberSocket->recv(&messageBuffer, ZMQ_DONTWAIT) == false);
+
+REQUIRE(clientSubscriberSocket->recv(&messageBuffer) == true);
+REQUIRE(std::string(((const char *) messageBuffer.data()), sizeof(Poco::Int64)*2) == streamPrefix);
+REQUIRE(std::string(((const char *) messageBuffer.data()) + sizeof(Poco::Int64)*2, messageBuffer.size() - sizeof(Poco::Int64)*2) == subscribedUpdate);
+
+//Chain a third caster to the second one's proxy publishing interface, so a client of the third caster has to pull the other stream through both proxies
+Poco::Int64 thirdCasterID = 995;
+int thirdClientRequestPort = 9271;
+int thirdClientPublishingPort = 9272;
+
+caster thirdCaster(context.get(), thirdCasterID, 9270, thirdClientRequestPort, thirdClientPublishingPort, 9273, 9274, 9275, casterPublicKey, casterPrivateKey, keyManagerPublicKey, std::vector<std::string>(0), std::vector<std::string>(0), std::vector<std::string>(0));
+
+SOM_TRY
+thirdCaster.addProxy("tcp://127.0.0.1:" + std::to_string(secondClientRequestPort), "tcp://127.0.0.1:" + std::to_string(secondProxyPublishingPort), "tcp://127.0.0.1:9146");
+SOM_CATCH("Error, unable to add proxy\n")
+
+SOM_TRY
+queryReply = transceiver::queryPylonGPSV2Caster(queryRequest, "127.0.0.1:" + std::to_string(thirdClientRequestPort), 5000, *context);
+SOM_CATCH("Error querying caster\n")
+
+REQUIRE(queryReply.base_stations_size() == 2);
+
+int64_t chainedStreamID = 0;
+for(int i=0; i<queryReply.base_stations_size(); i++)
+{
+if(queryReply.base_stations(i).informal_name() == "demandBasestation1")
+{
+chainedStreamID = queryReply.base_stations(i).base_station_id();
+}
+}
+
+std::unique_ptr<zmq::socket_t> chainedSubscriberSocket(new zmq::socket_t(*context, ZMQ_SUB));
+chainedSubscriberSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+
+std::string chainedConnectionString = "tcp://127.0.0.1:" + std::to_string(thirdClientPublishingPort);
+chainedSubscriberSocket->connect(chainedConnectionString.c_str());
+
+std::string chainedStreamPrefix = generateStreamSubscriptionPrefix(thirdCasterID, chainedStreamID);
+chainedSubscriberSocket->setsockopt(ZMQ_SUBSCRIBE, (void *) chainedStreamPrefix.c_str(), chainedStreamPrefix.size());
+
+//Allow the subscription to propagate through the second caster to the first
+std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+std::string chainedUpdate = "Wanted at the end of the chain\n";
+registrationSockets[1]->send(chainedUpdate.c_str(), chainedUpdate.size());
+
+REQUIRE(chainedSubscriberSocket->recv(&messageBuffer) == true);
+REQUIRE(std::string(((const char *) messageBuffer.data()), sizeof(Poco::Int64)*2) == chainedStreamPrefix);
+REQUIRE(std::string(((const char *) messageBuffer.data()) + sizeof(Poco::Int64)*2, messageBuffer.size() - sizeof(Poco::Int64)*2) == chainedUpdate);
+}
+}
+
+TEST_CASE( "Test last message cache", "[test]")
+{
+SECTION( "Keep the latest of each RTCM type and drop untyped messages")
+{
+//Make an RTCM 3 frame of the given type with the 2 byte header used in this test preappended
+auto makeFrame = [](uint32_t inputType, char inputFill)
+{
+std::string payload(6, inputFill);
+payload[0] = (char) (inputType >> 4);
+payload[1] = (char) (((inputType & 0x0F) << 4) | (payload[1] & 0x0F));
+
+std::string frame = "HH";
+frame.push_back((char) RTCM_V3_PREAMBLE);
+frame.push_back((char) 0);
+frame.push_back((char) payload.size());
+frame += payload + "CRC";
+return frame;
+};
+
+REQUIRE((getRTCMV3MessageType(makeFrame(1005, 'a').c_str() + 2, makeFrame(1005, 'a').size() - 2) == std::pair<bool, uint32_t>(true, 1005)));
+REQUIRE(getRTCMV3MessageType("hello", 5).first == false);
+
+lastMessageCache cache;
+
+cache.addMessage(makeFrame(1005, 'a').c_str(), makeFrame(1005, 'a').size(), 2);
+cache.addMessage(makeFrame(1077, 'b').c_str(), makeFrame(1077, 'b').size(), 2);
+cache.addMessage("HHuntyped0", 10, 2);
+cache.addMessage("HHuntyped1", 10, 2);
+cache.addMessage(makeFrame(1077, 'c').c_str(), makeFrame(1077, 'c').size(), 2);
+cache.addMessage("HHuntyped2", 10, 2);
+
+std::vector<const std::string *> messages = cache.getMessages();
+
+REQUIRE(messages.size() == 2);
+REQUIRE(*messages[0] == makeFrame(1005, 'a'));
+REQUIRE(*messages[1] == makeFrame(1077, 'c'));
+
+lastMessageCache stationDescriptionCache(true);
+
+stationDescriptionCache.addMessage(makeFrame(1077, 'a').c_str(), makeFrame(1077, 'a').size(), 2);
+stationDescriptionCache.addMessage(makeFrame(1005, 'b').c_str(), makeFrame(1005, 'b').size(), 2);
+stationDescriptionCache.addMessage("HHuntyped0", 10, 2);
+stationDescriptionCache.addMessage(makeFrame(1033, 'c').c_str(), makeFrame(1033, 'c').size(), 2);
+
+messages = stationDescriptionCache.getMessages();
+
+REQUIRE(messages.size() == 2);
+REQUIRE(*messages[0] == makeFrame(1005, 'b'));
+REQUIRE(*messages[1] == makeFrame(1033, 'c'));
+}
+}
+
+TEST_CASE( "Test caster replays cached messages to new subscribers", "[test]")
+{
+SECTION( "Subscribe after a message has been published")
+{
+//Make ZMQ context
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate keys to use
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+//Generate key manager signing key
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+Poco::Int64 casterID = 995;
+int registrationPort = 9150;
+int clientPublishingPort = 9154;
+
+caster myCaster(context.get(), casterID, registrationPort, 9153, clientPublishingPort, 9155, 9156, 9157, casterPublicKey, casterPrivateKey, keyManagerPublicKey, std::vector<std::string>(0), std::vector<std::string>(0), std::vector<std::string>(0));
+
+std::unique_ptr<zmq::socket_t> registrationSocket;
+
+SOM_TRY //Init socket
+registrationSocket.reset(new zmq::socket_t(*context, ZMQ_DEALER));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+int timeoutWaitTime = 5000; //Max 5 seconds
+registrationSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+SOM_CATCH("Error setting socket timeout\n")
+
+SOM_TRY //Connect to caster
+std::string connectionString = "tcp://127.0.0.1:" +std::to_string(registrationPort);
+registrationSocket->connect(connectionString.c_str());
+SOM_CATCH("Error connecting socket for registration with caster\n")
+
+transmitter_registration_request registrationRequest;
+auto basestationInfo = registrationRequest.mutable_stream_info();
+basestationInfo->set_latitude(1.0);
+basestationInfo->set_longitude(2.0);
+basestationInfo->set_expected_update_rate(3.0);
+basestationInfo->set_message_format(RTCM_V3_1);
+basestationInfo->set_informal_name("cacheBasestation");
+
+transmitter_registration_reply registrationReply;
+
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+SOM_TRY
+std::tie(messageReceived, messageDeserializedCorrectly) = remoteProcedureCall(*registrationSocket, registrationRequest, registrationReply);
+SOM_CATCH("Error, stream registration failed\n")
+
+REQUIRE(registrationReply.request_succeeded() == true);
+
+client_query_request queryRequest; //Empty request should return all
+client_query_reply queryReply;
+
+SOM_TRY
+queryReply = transceiver::queryPylonGPSV2Caster(queryRequest, "127.0.0.1:9153", 5000, *context);
+SOM_CATCH("Error querying caster\n")
+
+REQUIRE(queryReply.base_stations_size() == 1);
+
+//Send station coordinates (1005) and an observation (1077, which would be stale by the time it is replayed) before anyone is subscribed
+std::string update("\xD3\x00\x13\x3E\xD7\xD3\x02\x02\x98\x0E\xDE\xEF\x34\xB4\xBD\x62\xAC\x09\x41\x98\x6F\x33\x36\x0B\x98", 25);
+std::string observation("\xD3\x00\x06\x43\x50\x00\x00\x00\x00\x00\x00\x00", 12);
+
+for(const std::string &message : {update, observation})
+{
+SOM_TRY
+registrationSocket->send(message.c_str(), message.size());
+SOM_CATCH("Error sending update\n")
+}
+
+std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+std::unique_ptr<zmq::socket_t> subscriberSocket;
+
+SOM_TRY //Init socket
+subscriberSocket.reset(new zmq::socket_t(*context, ZMQ_SUB));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+int timeoutWaitTime = 5000; //Max 5 seconds
+subscriberSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+SOM_CATCH("Error setting socket timeout\n")
+
+SOM_TRY
+std::string connectionString = "tcp://127.0.0.1:" + std::to_string(clientPublishingPort);
+subscriberSocket->connect(connectionString.c_str());
+SOM_CATCH("Error connecting socket\n")
+
+std::string streamPrefix = generateStreamSubscriptionPrefix(casterID, queryReply.base_stations(0).base_station_id());
+
+SOM_TRY
+subscriberSocket->setsockopt(ZMQ_SUBSCRIBE, (void *) streamPrefix.c_str(), streamPrefix.size());
+SOM_CATCH("Error setting subscription\n")
+
+zmq::message_t messageBuffer;
+
+SOM_TRY
+REQUIRE(subscriberSocket->recv(&messageBuffer) == true);
+SOM_CATCH("Error receiving replayed message\n")
+
+REQUIRE(std::string((const char *) messageBuffer.data(), messageBuffer.size()) == streamPrefix + update);
+
+//The observation isn't replayed, so the next message is a new one
+std::string liveUpdate = "Live update\n";
+
+SOM_TRY
+registrationSocket->send(liveUpdate.c_str(), liveUpdate.size());
+SOM_CATCH("Error sending update\n")
+
+SOM_TRY
+REQUIRE(subscriberSocket->recv(&messageBuffer) == true);
+SOM_CATCH("Error receiving message\n")
+
+REQUIRE(std::string((const char *) messageBuffer.data(), messageBuffer.size()) == streamPrefix + liveUpdate);
+}
+}
+
+TEST_CASE( "Test token bucket", "[test]")
+{
+SECTION( "Allow a burst and then the sustained rate")
+{
+tokenBucket bucket(2.0, 3.0, 0); //2 per second, burst of 3
+
+for(int i=0; i<3; i++)
+{
+REQUIRE(bucket.takeToken(0) == true);
+}
+REQUIRE(bucket.takeToken(0) == false);
+
+//Half a second gives one more token
+REQUIRE(bucket.takeToken(500000) == true);
+REQUIRE(bucket.takeToken(500000) == false);
+
+//Tokens don't accumulate beyond the burst size
+REQUIRE(bucket.takeToken(100000000) == true);
+REQUIRE(bucket.takeToken(100000000) == true);
+REQUIRE(bucket.takeToken(100000000) == true);
+REQUIRE(bucket.takeToken(100000000) == false);
+
+//A returned token can be taken again, but not beyond the burst size
+bucket.returnToken();
+REQUIRE(bucket.takeToken(100000000) == true);
+REQUIRE(bucket.takeToken(100000000) == false);
+for(int i=0; i<5; i++)
+{
+bucket.returnToken();
+}
+for(int i=0; i<3; i++)
+{
+REQUIRE(bucket.takeToken(100000000) == true);
+}
+REQUIRE(bucket.takeToken(100000000) == false);
+
+tokenBucket unlimitedBucket;
+for(int i=0; i<100; i++)
+{
+REQUIRE(unlimitedBucket.takeToken(0) == true);
+}
+}
+}
+
+TEST_CASE( "Test caster ingest rate limiting", "[test]")
+{
+SECTION( "Drop messages from a transmitter sending faster than it declared")
+{
+//Make ZMQ context
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate keys to use
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+//Generate key manager signing key
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+Poco::Int64 casterID = 996;
+int registrationPort = 9160;
+double burstSize = 2.0;
+
+caster_configuration configuration = makeTestCasterConfiguration(casterID, {registrationPort, 9163, 9164, 9165, 9166, 9167}, casterPublicKey, casterPrivateKey, keyManagerPublicKey);
+configuration.set_ingest_burst_size(burstSize);
+caster myCaster(context.get(), configuration);
+
+std::unique_ptr<zmq::socket_t> registrationSocket;
+
+SOM_TRY //Init socket
+registrationSocket.reset(new zmq::socket_t(*context, ZMQ_DEALER));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+int timeoutWaitTime = 5000; //Max 5 seconds
+registrationSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+SOM_CATCH("Error setting socket timeout\n")
+
+SOM_TRY //Connect to caster
+std::string connectionString = "tcp://127.0.0.1:" +std::to_string(registrationPort);
+registrationSocket->connect(connectionString.c_str());
+SOM_CATCH("Error connecting socket for registration with caster\n")
+
+transmitter_registration_request registrationRequest;
+auto basestationInfo = registrationRequest.mutable_stream_info();
+basestationInfo->set_latitude(1.0);
+basestationInfo->set_longitude(2.0);
+basestationInfo->set_expected_update_rate(1.0);
+basestationInfo->set_message_format(RTCM_V3_1);
+basestationInfo->set_informal_name("floodingBasestation");
+
+transmitter_registration_reply registrationReply;
+
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+SOM_TRY
+std::tie(messageReceived, messageDeserializedCorrectly) = remoteProcedureCall(*registrationSocket, registrationRequest, registrationReply);
+SOM_CATCH("Error, stream registration failed\n")
+
+REQUIRE(registrationReply.request_succeeded() == true);
+
+//Send far more than the burst allows
+int numberOfMessagesToSend = 20;
+std::string update = "Flood\n";
+for(int i=0; i<numberOfMessagesToSend; i++)
+{
+SOM_TRY
+registrationSocket->send(update.c_str(), update.size());
+SOM_CATCH("Error sending update\n")
+}
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+auto dropCounts = myCaster.getStreamIngestDropCounts();
+REQUIRE(dropCounts.size() == 1);
+
+//Burst of 2 plus what trickled in at 4 messages/second while sending
+REQUIRE(dropCounts.begin()->second >= numberOfMessagesToSend - burstSize - 2);
+REQUIRE(dropCounts.begin()->second <= numberOfMessagesToSend - burstSize);
+}
+}
+
+TEST_CASE( "Test station class publishing queue", "[test]")
+{
+SECTION( "Drop messages beyond the high water mark and measure publishing delay")
+{
+stationClassPublishingQueue queue(2, 3); //Weight 2, high water mark of 3
+std::string message = "0123456789abcdefData";
+
+for(int i=0; i<3; i++)
+{
+REQUIRE(queue.addMessage(message.c_str(), message.size(), 7, 1000*i) == true);
+}
+REQUIRE(queue.addMessage(message.c_str(), message.size(), 7, 5000) == false);
+
+REQUIRE(queue.messages.size() == 3);
+REQUIRE(queue.getStatistics().numberOfDroppedMessages == 1);
+REQUIRE(queue.getStatistics().numberOfQueuedMessages == 3);
+REQUIRE(std::string((const char *) queue.messages.front().message.data(), queue.messages.front().message.size()) == message);
+REQUIRE(queue.messages.front().streamID == 7);
+
+queue.removePublishedMessage(10000); //Waited 10 ms
+queue.removePublishedMessage(10000); //Waited 9 ms
+
+REQUIRE(queue.messages.size() == 1);
+REQUIRE(queue.getStatistics().numberOfPublishedMessages == 2);
+REQUIRE(queue.getStatistics().numberOfQueuedMessages == 1);
+REQUIRE(queue.getStatistics().totalPublishingDelay == 19000);
+REQUIRE(queue.getStatistics().maximumPublishingDelay == 10000);
+}
+}
+
+TEST_CASE( "Test caster station class publishing statistics", "[test]")
+{
+SECTION( "Messages from an anonymous transmitter are published as COMMUNITY")
+{
+//Make ZMQ context
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate keys to use
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+//Generate key manager signing key
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+Poco::Int64 casterID = 995;
+int registrationPort = 9170;
+
+caster myCaster(context.get(), casterID, registrationPort, 9173, 9174, 9175, 9176, 9177, casterPublicKey, casterPrivateKey, keyManagerPublicKey, std::vector<std::string>(0), std::vector<std::string>(0), std::vector<std::string>(0));
+
+std::unique_ptr<zmq::socket_t> registrationSocket;
+
+SOM_TRY //Init socket
+registrationSocket.reset(new zmq::socket_t(*context, ZMQ_DEALER));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+int timeoutWaitTime = 5000; //Max 5 seconds
+registrationSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+SOM_CATCH("Error setting socket timeout\n")
+
+SOM_TRY //Connect to caster
+std::string connectionString = "tcp://127.0.0.1:" +std::to_string(registrationPort);
+registrationSocket->connect(connectionString.c_str());
+SOM_CATCH("Error connecting socket for registration with caster\n")
+
+transmitter_registration_request registrationRequest;
+auto basestationInfo = registrationRequest.mutable_stream_info();
+basestationInfo->set_latitude(1.0);
+basestationInfo->set_longitude(2.0);
+basestationInfo->set_expected_update_rate(1.0);
+basestationInfo->set_message_format(RTCM_V3_1);
+basestationInfo->set_informal_name("communityBasestation");
+
+transmitter_registration_reply registrationReply;
+
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+SOM_TRY
+std::tie(messageReceived, messageDeserializedCorrectly) = remoteProcedureCall(*registrationSocket, registrationRequest, registrationReply);
+SOM_CATCH("Error, stream registration failed\n")
+
+REQUIRE(registrationReply.request_succeeded() == true);
+
+int numberOfMessagesToSend = 3;
+std::string update = "Update\n";
+for(int i=0; i<numberOfMessagesToSend; i++)
+{
+SOM_TRY
+registrationSocket->send(update.c_str(), update.size());
+SOM_CATCH("Error sending update\n")
+}
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+auto statistics = myCaster.getStationClassPublishingStatistics();
+REQUIRE(statistics.size() == 3);
+REQUIRE(statistics.at(COMMUNITY).numberOfPublishedMessages == numberOfMessagesToSend);
+REQUIRE(statistics.at(COMMUNITY).numberOfDroppedMessages == 0);
+REQUIRE(statistics.at(COMMUNITY).numberOfQueuedMessages == 0);
+REQUIRE(statistics.at(OFFICIAL).numberOfPublishedMessages == 0);
+REQUIRE(statistics.at(REGISTERED_COMMUNITY).numberOfPublishedMessages == 0);
+}
+}
+
+TEST_CASE( "Test stream frame headers and loss accounting", "[test]")
+{
+SECTION( "Write/read stream frame headers")
+{
+char frameHeader[STREAM_FRAME_HEADER_SIZE];
+writeStreamFrameHeader(frameHeader, 12345, 67890);
+
+uint64_t sequenceNumber = 0;
+int64_t ingestTime = 0;
+uint32_t headerSize = 0;
+REQUIRE(readStreamFrameHeader(frameHeader, STREAM_FRAME_HEADER_SIZE, sequenceNumber, ingestTime, headerSize) == true);
+REQUIRE(sequenceNumber == 12345);
+REQUIRE(ingestTime == 67890);
+REQUIRE(headerSize == STREAM_FRAME_HEADER_SIZE);
+
+//Too short or not a header
+REQUIRE(readStreamFrameHeader(frameHeader, STREAM_FRAME_HEADER_SIZE-1, sequenceNumber, ingestTime, headerSize) == false);
+std::string rtcmMessage = "\xD3\x00\x13 not a frame header";
+REQUIRE(readStreamFrameHeader(rtcmMessage.c_str(), rtcmMessage.size(), sequenceNumber, ingestTime, headerSize) == false);
+}
+
+SECTION( "Track gaps and latency")
+{
+streamDeliveryTracker tracker(1, 2);
+
+REQUIRE(tracker.addMessage(0, 1000, 1500) == false);
+REQUIRE(tracker.addMessage(1, 2000, 2100) == false);
+REQUIRE(tracker.addMessage(4, 3000, 3300) == true); //Missed 2 and 3
+REQUIRE(tracker.addMessage(2, 1500, 4000) == false); //Late message
+
+REQUIRE(tracker.statistics.number_of_received_messages() == 4);
+REQUIRE(tracker.statistics.number_of_missed_messages() == 2);
+REQUIRE(tracker.statistics.number_of_gaps() == 1);
+REQUIRE(tracker.statistics.number_of_out_of_order_messages() == 1);
+REQUIRE(tracker.statistics.last_latency() == 2500);
+REQUIRE(tracker.statistics.maximum_latency() == 2500);
+REQUIRE(tracker.statistics.average_latency() == (500+100+300+2500)/4);
+
+//Stream restarted (such as by a caster state handoff)
+REQUIRE(tracker.addMessage(0, 5000, 5000) == false);
+REQUIRE(tracker.addMessage(1, 5000, 5000) == false);
+REQUIRE(tracker.statistics.number_of_gaps() == 1);
+}
+
+SECTION( "zmqDataReceiver strips frame headers and reports missed messages")
+{
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+Poco::Int64 casterID = 994;
+Poco::Int64 streamID = 3;
+
+std::unique_ptr<zmq::socket_t> casterPublishingSocket;
+
+SOM_TRY
+casterPublishingSocket.reset(new zmq::socket_t(*context, ZMQ_PUB));
+casterPublishingSocket->bind("tcp://*:9180");
+SOM_CATCH("Error making socket\n")
+
+zmqDataReceiver receiver("127.0.0.1:9180", casterID, streamID, *context, true, true);
+
+std::unique_ptr<zmq::socket_t> dataSocket;
+std::unique_ptr<zmq::socket_t> notificationSocket;
+
+SOM_TRY
+dataSocket.reset(new zmq::socket_t(*context, ZMQ_SUB));
+dataSocket->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
+int timeoutWaitTime = 5000; //Max 5 seconds
+dataSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+dataSocket->connect(receiver.address().c_str());
+
+notificationSocket.reset(new zmq::socket_t(*context, ZMQ_SUB));
+notificationSocket->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
+notificationSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+notificationSocket->connect(receiver.notificationAddress().c_str());
+SOM_CATCH("Error making socket\n")
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100)); //Let the subscriptions go through
+
+//Send sequence numbers 0 and 3 (1 and 2 are missing)
+std::vector<uint64_t> sequenceNumbers = {0, 3};
+std::string payload = "payload";
+for(uint64_t sequenceNumber : sequenceNumbers)
+{
+Poco::Int64 header[2];
+header[0] = Poco::ByteOrder::toNetwork(casterID);
+header[1] = Poco::ByteOrder::toNetwork(streamID);
+char frameHeader[STREAM_FRAME_HEADER_SIZE];
+writeStreamFrameHeader(frameHeader, sequenceNumber, Poco::Timestamp().epochMicroseconds());
+
+std::string message = std::string((const char *) header, sizeof(header)) + std::string(frameHeader, STREAM_FRAME_HEADER_SIZE) + payload;
+
+SOM_TRY
+casterPublishingSocket->send(message.c_str(), message.size());
+SOM_CATCH("Error sending message\n")
+}
+
+for(int i=0; i<2; i++)
+{
+zmq::message_t messageBuffer;
+REQUIRE(dataSocket->recv(&messageBuffer) == true);
+REQUIRE(std::string((const char *) messageBuffer.data(), messageBuffer.size()) == payload);
+}
+
+//The first message is reported because no statistics have been sent yet, the second because of the gap
+data_receiver_status_notification notification;
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+for(int i=0; i<2; i++)
+{
+SOM_TRY
+std::tie(messageReceived, messageDeserializedCorrectly) = receiveProtobufMessage(*notificationSocket, notification);
+SOM_CATCH("Error receiving notification\n")
+
+REQUIRE(messageReceived == true);
+REQUIRE(messageDeserializedCorrectly == true);
+}
+
+REQUIRE(notification.has_delivery_statistics() == true);
+REQUIRE(notification.delivery_statistics().caster_id() == casterID);
+REQUIRE(notification.delivery_statistics().stream_id() == streamID);
+REQUIRE(notification.delivery_statistics().number_of_received_messages() == 2);
+REQUIRE(notification.delivery_statistics().number_of_missed_messages() == 2);
+REQUIRE(notification.delivery_statistics().number_of_gaps() == 1);
+}
+
+SECTION( "Receivers leave messages intact when the caster doesn't add frame headers")
+{
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+Poco::Int64 casterID = 994;
+Poco::Int64 streamID = 3;
+
+std::unique_ptr<zmq::socket_t> casterPublishingSocket;
+
+SOM_TRY
+casterPublishingSocket.reset(new zmq::socket_t(*context, ZMQ_PUB));
+casterPublishingSocket->bind("tcp://*:9255");
+SOM_CATCH("Error making socket\n")
+
+zmqDataReceiver receiver("127.0.0.1:9255", casterID, streamID, *context);
+std::shared_ptr<zmqCasterSubscriber> casterSubscriber(new zmqCasterSubscriber("127.0.0.1:9255", *context));
+zmqDataReceiver sharingReceiver(casterSubscriber, casterID, streamID, *context);
+
+std::vector<std::unique_ptr<zmq::socket_t> > dataSockets;
+for(const std::string &address : std::vector<std::string>{receiver.address(), sharingReceiver.address()})
+{
+SOM_TRY
+dataSockets.emplace_back(new zmq::socket_t(*context, ZMQ_SUB));
+dataSockets.back()->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
+int timeoutWaitTime = 5000; //Max 5 seconds
+dataSockets.back()->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+dataSockets.back()->connect(address.c_str());
+SOM_CATCH("Error making socket\n")
+}
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100)); //Let the subscriptions go through
+
+//A payload which happens to look like a stream frame header is part of the message
+Poco::Int64 header[2];
+header[0] = Poco::ByteOrder::toNetwork(casterID);
+header[1] = Poco::ByteOrder::toNetwork(streamID);
+char frameHeader[STREAM_FRAME_HEADER_SIZE];
+writeStreamFrameHeader(frameHeader, 0, Poco::Timestamp().epochMicroseconds());
+std::string payload = std::string(frameHeader, STREAM_FRAME_HEADER_SIZE) + "payload";
+std::string message = std::string((const char *) header, sizeof(header)) + payload;
+
+SOM_TRY
+casterPublishingSocket->send(message.c_str(), message.size());
+SOM_CATCH("Error sending message\n")
+
+for(std::unique_ptr<zmq::socket_t> &dataSocket : dataSockets)
+{
+zmq::message_t messageBuffer;
+REQUIRE(dataSocket->recv(&messageBuffer) == true);
+REQUIRE(std::string((const char *) messageBuffer.data(), messageBuffer.size()) == payload);
+}
+}
+}
+
+TEST_CASE( "Test shared caster subscriber", "[test]")
+{
+SECTION( "zmqDataReceivers sharing a caster subscriber get only their own streams")
+{
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+Poco::Int64 casterID = 994;
+std::vector<Poco::Int64> streamIDs = {3, 4};
+
+std::unique_ptr<zmq::socket_t> casterPublishingSocket;
+
+SOM_TRY
+casterPublishingSocket.reset(new zmq::socket_t(*context, ZMQ_PUB));
+casterPublishingSocket->bind("tcp://*:9250");
+SOM_CATCH("Error making socket\n")
+
+std::shared_ptr<zmqCasterSubscriber> casterSubscriber(new zmqCasterSubscriber("127.0.0.1:9250", *context, true));
+
+std::vector<std::unique_ptr<zmqDataReceiver> > receivers;
+std::vector<std::unique_ptr<zmq::socket_t> > dataSockets;
+for(Poco::Int64 streamID : streamIDs)
+{
+receivers.emplace_back(new zmqDataReceiver(casterSubscriber, casterID, streamID, *context));
+
+SOM_TRY
+dataSockets.emplace_back(new zmq::socket_t(*context, ZMQ_SUB));
+dataSockets.back()->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
+int timeoutWaitTime = 5000; //Max 5 seconds
+dataSockets.back()->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+dataSockets.back()->connect(receivers.back()->address().c_str());
+SOM_CATCH("Error making socket\n")
+}
+REQUIRE(receivers[0]->address() != receivers[1]->address());
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100)); //Let the subscriptions go through
+
+//Publish a message for an unsubscribed stream followed by one for each receiver's stream
+std::vector<Poco::Int64> publishedStreamIDs = {5, 4, 3};
+for(Poco::Int64 streamID : publishedStreamIDs)
+{
+Poco::Int64 header[2];
+header[0] = Poco::ByteOrder::toNetwork(casterID);
+header[1] = Poco::ByteOrder::toNetwork(streamID);
+char frameHeader[STREAM_FRAME_HEADER_SIZE];
+writeStreamFrameHeader(frameHeader, 0, Poco::Timestamp().epochMicroseconds());
+
+std::string message = std::string((const char *) header, sizeof(header)) + std::string(frameHeader, STREAM_FRAME_HEADER_SIZE) + "payload" + std::to_string(streamID);
+
+SOM_TRY
+casterPublishingSocket->send(message.c_str(), message.size());
+SOM_CATCH("Error sending message\n")
+}
+
+for(int i=0; i<streamIDs.size(); i++)
+{
+zmq::message_t messageBuffer;
+REQUIRE(dataSockets[i]->recv(&messageBuffer) == true);
+REQUIRE(std::string((const char *) messageBuffer.data(), messageBuffer.size()) == "payload" + std::to_string(streamIDs[i]));
+
+//Nothing else should arrive
+REQUIRE(dataSockets[i]->recv(&messageBuffer, ZMQ_DONTWAIT) == false);
+}
+
+//Removing one receiver leaves the other's stream flowing
+receivers[0].reset();
+
+std::string message;
+{
+Poco::Int64 header[2];
+header[0] = Poco::ByteOrder::toNetwork(casterID);
+header[1] = Poco::ByteOrder::toNetwork(streamIDs[1]);
+char frameHeader[STREAM_FRAME_HEADER_SIZE];
+writeStreamFrameHeader(frameHeader, 1, Poco::Timestamp().epochMicroseconds());
+message = std::string((const char *) header, sizeof(header)) + std::string(frameHeader, STREAM_FRAME_HEADER_SIZE) + "payload";
+}
+
+SOM_TRY
+casterPublishingSocket->send(message.c_str(), message.size());
+SOM_CATCH("Error sending message\n")
+
+zmq::message_t messageBuffer;
+REQUIRE(dataSockets[1]->recv(&messageBuffer) == true);
+REQUIRE(std::string((const char *) messageBuffer.data(), messageBuffer.size()) == "payload");
+}
+
+SECTION( "A caster subscriber keeps working after a control request times out")
+{
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+Poco::Int64 casterID = 994;
+Poco::Int64 streamID = 3;
+
+std::unique_ptr<zmq::socket_t> casterPublishingSocket;
+
+SOM_TRY
+casterPublishingSocket.reset(new zmq::socket_t(*context, ZMQ_PUB));
+casterPublishingSocket->bind("tcp://*:9256");
+SOM_CATCH("Error making socket\n")
+
+//Holds up the subscriber's thread until it is released
+class blockingSink : public directDataSink
+{
+public:
+void handleDirectData(const char *inputData, uint64_t inputDataSize)
+{
+while(!released)
+{
+std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+}
+
+std::atomic<bool> released{false};
+};
+
+blockingSink sink;
+directDataSinkList sinks;
+sinks.add(&sink);
+
+zmqCasterSubscriber casterSubscriber("127.0.0.1:9256", *context);
+std::string publisherConnectionString;
+std::tie(publisherConnectionString, std::ignore) = casterSubscriber.addStream(casterID, streamID, &sinks);
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100)); //Let the subscription go through
+
+Poco::Int64 header[2];
+header[0] = Poco::ByteOrder::toNetwork(casterID);
+header[1] = Poco::ByteOrder::toNetwork(streamID);
+std::string message = std::string((const char *) header, sizeof(header)) + "payload";
+
+SOM_TRY
+casterPublishingSocket->send(message.c_str(), message.size());
+SOM_CATCH("Error sending message\n")
+
+REQUIRE_THROWS(casterSubscriber.removeStream(publisherConnectionString));
+
+//The late reply to the remove request is discarded rather than taken as the reply to the next request
+sink.released = true;
+std::string secondPublisherConnectionString;
+std::tie(secondPublisherConnectionString, std::ignore) = casterSubscriber.addStream(casterID, streamID + 1);
+REQUIRE(secondPublisherConnectionString.size() > 0);
+REQUIRE(secondPublisherConnectionString != publisherConnectionString);
+
+casterSubscriber.removeStream(secondPublisherConnectionString);
+sinks.remove(&sink);
+}
+}
+
+TEST_CASE( "Test latency tracing", "[test]")
+{
+SECTION( "Write/read traced stream frame headers")
+{
+std::vector<traceHop> traceHops = {traceHop(TRANSMITTER_SEND, 1000), traceHop(CASTER_INGEST, -5)};
+std::string frameHeader = createStreamFrameHeader(7, 8, traceHops);
+REQUIRE(frameHeader.size() == (STREAM_FRAME_HEADER_SIZE + 1 + 2*STREAM_FRAME_HEADER_TRACE_HOP_SIZE));
+
+uint64_t sequenceNumber = 0;
+int64_t ingestTime = 0;
+uint32_t headerSize = 0;
+REQUIRE(readStreamFrameHeader(frameHeader.c_str(), frameHeader.size(), sequenceNumber, ingestTime, headerSize) == true);
+REQUIRE(sequenceNumber == 7);
+REQUIRE(ingestTime == 8);
+REQUIRE(headerSize == frameHeader.size());
+
+std::vector<traceHop> readTraceHops;
+REQUIRE(readStreamFrameHeaderTrace(frameHeader.c_str(), frameHeader.size(), readTraceHops) == true);
+REQUIRE(readTraceHops.size() == 2);
+REQUIRE(readTraceHops[0].type == TRANSMITTER_SEND);
+REQUIRE(readTraceHops[0].time == 1000);
+REQUIRE(readTraceHops[1].type == CASTER_INGEST);
+REQUIRE(readTraceHops[1].time == -5);
+
+//Untraced headers and truncated traces
+std::string untracedFrameHeader = createStreamFrameHeader(7, 8);
+REQUIRE(untracedFrameHeader.size() == STREAM_FRAME_HEADER_SIZE);
+REQUIRE(readStreamFrameHeaderTrace(untracedFrameHeader.c_str(), untracedFrameHeader.size(), readTraceHops) == false);
+REQUIRE(readStreamFrameHeaderTrace(frameHeader.c_str(), frameHeader.size()-1, readTraceHops) == false);
+}
+
+SECTION( "Aggregate traces into histograms")
+{
+latencyTracer tracer;
+tracer.addTrace({traceHop(TRANSMITTER_SEND, 0), traceHop(CASTER_INGEST, 1000), traceHop(CASTER_PUBLISH, 3000)});
+tracer.addTrace({traceHop(TRANSMITTER_SEND, 0), traceHop(CASTER_INGEST, 600)});
+
+latency_trace_report report = tracer.getReport();
+REQUIRE(report.histograms_size() == 3);
+
+const latency_histogram &endToEndHistogram = report.histograms(0);
+REQUIRE(endToEndHistogram.is_end_to_end() == true);
+REQUIRE(endToEndHistogram.number_of_samples() == 2);
+REQUIRE(endToEndHistogram.maximum_latency() == 3000);
+REQUIRE(endToEndHistogram.bucket_counts_size() == NUMBER_OF_LATENCY_HISTOGRAM_BUCKETS);
+REQUIRE(endToEndHistogram.bucket_counts(11) == 1); //2048 <= 3000 < 4096
+REQUIRE(endToEndHistogram.bucket_counts(9) == 1); //512 <= 600 < 1024
+
+const latency_histogram &sendToIngestHistogram = report.histograms(1);
+REQUIRE(sendToIngestHistogram.previous_hop() == TRANSMITTER_SEND);
+REQUIRE(sendToIngestHistogram.hop() == CASTER_INGEST);
+REQUIRE(sendToIngestHistogram.number_of_samples() == 2);
+REQUIRE(sendToIngestHistogram.total_latency() == 1600);
+
+const latency_histogram &ingestToPublishHistogram = report.histograms(2);
+REQUIRE(ingestToPublishHistogram.previous_hop() == CASTER_INGEST);
+REQUIRE(ingestToPublishHistogram.hop() == CASTER_PUBLISH);
+REQUIRE(ingestToPublishHistogram.number_of_samples() == 1);
+REQUIRE(ingestToPublishHistogram.bucket_counts(10) == 1); //1024 <= 2000 < 2048
+
+//Pending traces are completed by matching payloads
+std::string payload = "payload";
+tracer.addPendingTrace(payload.c_str(), payload.size(), {traceHop(RECEIVER_INGEST, getMonotonicTime())});
+REQUIRE(tracer.completePendingTrace("other", 5, SENDER_OUTPUT) == false);
+REQUIRE(tracer.completePendingTrace(payload.c_str(), payload.size(), SENDER_OUTPUT) == true);
+REQUIRE(tracer.completePendingTrace(payload.c_str(), payload.size(), SENDER_OUTPUT) == false);
+REQUIRE(tracer.getReport().histograms_size() == 4);
+}
+
+SECTION( "zmqDataReceiver passes traces to the data sender")
+{
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+Poco::Int64 casterID = 995;
+Poco::Int64 streamID = 4;
+
+std::unique_ptr<zmq::socket_t> casterPublishingSocket;
+
+SOM_TRY
+casterPublishingSocket.reset(new zmq::socket_t(*context, ZMQ_PUB));
+casterPublishingSocket->bind("tcp://*:9181");
+SOM_CATCH("Error making socket\n")
+
+latencyTracer tracer;
+zmqDataReceiver receiver("127.0.0.1:9181", casterID, streamID, *context, true, true, &tracer);
+FILE *outputFile = tmpfile();
+REQUIRE(outputFile != nullptr);
+fileDataSender sender(receiver.address(), *context, outputFile, &tracer);
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100)); //Let the subscriptions go through
+
+Poco::Int64 header[2];
+header[0] = Poco::ByteOrder::toNetwork(casterID);
+header[1] = Poco::ByteOrder::toNetwork(streamID);
+std::string message = std::string((const char *) header, sizeof(header)) + createStreamFrameHeader(0, Poco::Timestamp().epochMicroseconds(), {traceHop(CASTER_INGEST, getMonotonicTime()), traceHop(CASTER_PUBLISH, getMonotonicTime())}) + "payload";
+
+SOM_TRY
+casterPublishingSocket->send(message.c_str(), message.size());
+SOM_CATCH("Error sending message\n")
+
+latency_trace_report report;
+for(int i=0; i<50 && report.histograms_size() == 0; i++)
+{
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+report = tracer.getReport();
+}
+
+REQUIRE(report.histograms_size() == 4);
+REQUIRE(report.histograms(0).is_end_to_end() == true);
+REQUIRE(report.histograms(0).previous_hop() == CASTER_INGEST);
+REQUIRE(report.histograms(0).hop() == SENDER_OUTPUT);
+REQUIRE(report.histograms(3).previous_hop() == RECEIVER_INGEST);
+REQUIRE(report.histograms(3).hop() == SENDER_OUTPUT);
+}
+}
+
+TEST_CASE( "Test fused receiver and sender", "[test]")
+{
+SECTION( "fileDataSender fused with a zmqDataReceiver writes from the receiver's thread")
+{
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+Poco::Int64 casterID = 996;
+Poco::Int64 streamID = 5;
+
+std::unique_ptr<zmq::socket_t> casterPublishingSocket;
+
+SOM_TRY
+casterPublishingSocket.reset(new zmq::socket_t(*context, ZMQ_PUB));
+casterPublishingSocket->bind("tcp://*:9251");
+SOM_CATCH("Error making socket\n")
+
+latencyTracer tracer;
+zmqDataReceiver receiver("127.0.0.1:9251", casterID, streamID, *context, true, true, &tracer);
+FILE *outputFile = tmpfile();
+REQUIRE(outputFile != nullptr);
+int outputFileDescriptor = dup(fileno(outputFile)); //The sender closes its file
+REQUIRE(outputFileDescriptor >= 0);
+SOMScopeGuard fileDescriptorGuard([&](){close(outputFileDescriptor);});
+
+fileDataSender sender(receiver.address(), *context, outputFile, &tracer, receiver.directDataSinks());
+REQUIRE(sender.senderReactor.get() == nullptr);
+
+//The inproc publisher is still available to others
+std::unique_ptr<zmq::socket_t> dataSocket;
+
+SOM_TRY
+dataSocket.reset(new zmq::socket_t(*context, ZMQ_SUB));
+dataSocket->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
+int timeoutWaitTime = 5000; //Max 5 seconds
+dataSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+dataSocket->connect(receiver.address().c_str());
+SOM_CATCH("Error making socket\n")
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100)); //Let the subscriptions go through
+
+Poco::Int64 header[2];
+header[0] = Poco::ByteOrder::toNetwork(casterID);
+header[1] = Poco::ByteOrder::toNetwork(streamID);
+std::string message = std::string((const char *) header, sizeof(header)) + createStreamFrameHeader(0, Poco::Timestamp().epochMicroseconds(), {traceHop(CASTER_INGEST, getMonotonicTime())}) + "payload";
+
+SOM_TRY
+casterPublishingSocket->send(message.c_str(), message.size());
+SOM_CATCH("Error sending message\n")
+
+zmq::message_t messageBuffer;
+REQUIRE(dataSocket->recv(&messageBuffer) == true);
+REQUIRE(std::string((const char *) messageBuffer.data(), messageBuffer.size()) == "payload");
+
+latency_trace_report report;
+for(int i=0; i<50 && report.histograms_size() == 0; i++)
+{
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+report = tracer.getReport();
+}
+REQUIRE(report.histograms_size() > 0);
+
+char fileContents[16];
+REQUIRE(pread(outputFileDescriptor, fileContents, sizeof(fileContents), 0) == 7);
+REQUIRE(std::string(fileContents, 7) == "payload");
+}
+}
+
+TEST_CASE( "Test caster metrics", "[test]")
+{
+SECTION( "Registrations and messages are counted and served over HTTP")
+{
+//Make ZMQ context
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate keys to use
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+//Generate key manager signing key
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+Poco::Int64 casterID = 997;
+int registrationPort = 9190;
+int metricsPort = 9199;
+
+caster_configuration configuration = makeTestCasterConfiguration(casterID, {registrationPort, 9193, 9194, 9195, 9196, 9197}, casterPublicKey, casterPrivateKey, keyManagerPublicKey);
+configuration.set_metrics_port_number(metricsPort);
+caster myCaster(context.get(), configuration);
+
+REQUIRE(myCaster.getPrometheusMetrics().find("pylongps_caster_connections{class=\"COMMUNITY\"} 0") != std::string::npos);
+
+std::unique_ptr<zmq::socket_t> registrationSocket;
+
+SOM_TRY //Init socket
+registrationSocket.reset(new zmq::socket_t(*context, ZMQ_DEALER));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+int timeoutWaitTime = 5000; //Max 5 seconds
+registrationSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+SOM_CATCH("Error setting socket timeout\n")
+
+SOM_TRY //Connect to caster
+std::string connectionString = "tcp://127.0.0.1:" +std::to_string(registrationPort);
+registrationSocket->connect(connectionString.c_str());
+SOM_CATCH("Error connecting socket for registration with caster\n")
+
+transmitter_registration_request registrationRequest;
+auto basestationInfo = registrationRequest.mutable_stream_info();
+basestationInfo->set_latitude(1.0);
+basestationInfo->set_longitude(2.0);
+basestationInfo->set_expected_update_rate(1.0);
+basestationInfo->set_message_format(RTCM_V3_1);
+basestationInfo->set_informal_name("metricsBasestation");
+
+transmitter_registration_reply registrationReply;
+
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+SOM_TRY
+std::tie(messageReceived, messageDeserializedCorrectly) = remoteProcedureCall(*registrationSocket, registrationRequest, registrationReply);
+SOM_CATCH("Error, stream registration failed\n")
+
+REQUIRE(registrationReply.request_succeeded() == true);
+
+int numberOfMessagesToSend = 3;
+std::string update = "Update\n";
+for(int i=0; i<numberOfMessagesToSend; i++)
+{
+SOM_TRY
+registrationSocket->send(update.c_str(), update.size());
+SOM_CATCH("Error sending update\n")
+}
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+std::string metrics = myCaster.getPrometheusMetrics();
+REQUIRE(metrics.find("pylongps_caster_connections{class=\"COMMUNITY\"} 1") != std::string::npos);
+REQUIRE(metrics.find("pylongps_caster_received_messages_total{source=\"transmitter\"} " + std::to_string(numberOfMessagesToSend)) != std::string::npos);
+REQUIRE(metrics.find("pylongps_caster_received_bytes_total{source=\"transmitter\"} " + std::to_string(numberOfMessagesToSend*update.size())) != std::string::npos);
+REQUIRE(metrics.find("pylongps_caster_failed_catalog_writes_total 0") != std::string::npos);
+
+//Scrape the metrics the way Prometheus would
+Poco::Net::StreamSocket scrapingSocket;
+scrapingSocket.connect(Poco::Net::SocketAddress("127.0.0.1", metricsPort));
+std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+scrapingSocket.sendBytes(request.c_str(), request.size());
+
+std::string reply;
+char buffer[4096];
+int numberOfBytesReceived = 0;
+while((numberOfBytesReceived = scrapingSocket.receiveBytes(buffer, sizeof(buffer))) > 0)
+{ //Server closes the connection after the reply
+reply += std::string(buffer, numberOfBytesReceived);
+}
+
+REQUIRE(reply.find("HTTP/1.0 200 OK") == 0);
+REQUIRE(reply.find("pylongps_caster_connections{class=\"COMMUNITY\"} 1") != std::string::npos);
+}
+}
+
+TEST_CASE( "Test trace rings", "[test]")
+{
+SECTION( "Records are dumped per thread, oldest first, and a full ring keeps the most recent records")
+{
+uint64_t numberOfRecordsToWrite = TRACE_RING_SIZE + 10;
+std::thread tracingThread([&]()
+{
+setTraceThreadName("traceRingTestThread");
+for(uint64_t i=0; i<numberOfRecordsToWrite; i++)
+{
+recordTraceEvent(TRACE_MESSAGE_RECEIVED, i, 2*i);
+}
+});
+tracingThread.join();
+
+trace_ring_dump dump = dumpTraceRings();
+REQUIRE(dump.dump_monotonic_time() > 0);
+
+const trace_ring_thread *testThread = nullptr;
+for(int i=0; i<dump.threads_size(); i++)
+{
+if(dump.threads(i).thread_name() == "traceRingTestThread")
+{
+testThread = &dump.threads(i);
+}
+}
+
+REQUIRE(testThread != nullptr);
+REQUIRE(testThread->thread_has_exited() == true);
+REQUIRE((testThread->records_size() + testThread->number_of_overwritten_records()) == numberOfRecordsToWrite);
+REQUIRE(testThread->records_size() >= (TRACE_RING_SIZE - 1));
+
+int64_t expectedFirstID = testThread->number_of_overwritten_records();
+for(int i=0; i<testThread->records_size(); i++)
+{
+REQUIRE(testThread->records(i).type() == TRACE_MESSAGE_RECEIVED);
+REQUIRE(testThread->records(i).first_id() == (expectedFirstID + i));
+REQUIRE(testThread->records(i).second_id() == 2*(expectedFirstID + i));
+if(i > 0)
+{
+REQUIRE(testThread->records(i).time() >= testThread->records(i-1).time());
+}
+}
+}
+}
+
+TEST_CASE( "Test virtual time source", "[test]")
+{
+SECTION( "Virtual time only moves forward and only when advanced")
+{
+virtualTimeSource clock(1000000);
+REQUIRE(clock.now().epochMicroseconds() == 1000000);
+
+clock.advanceBy(500);
+REQUIRE(clock.now().epochMicroseconds() == 1000500);
+
+clock.advanceTo(Poco::Timestamp(1000000));
+REQUIRE(clock.now().epochMicroseconds() == 1000500);
+
+clock.reactorIsIdle(Poco::Timestamp(2000000)); //Not advancing when idle
+REQUIRE(clock.now().epochMicroseconds() == 1000500);
+
+virtualTimeSource idleAdvancingClock(1000000, true);
+idleAdvancingClock.reactorIsIdle(Poco::Timestamp(2000000));
+REQUIRE(idleAdvancingClock.now().epochMicroseconds() == 2000000);
+}
+
+SECTION( "Caster connections time out when the virtual time passes, without waiting for it")
+{
+//Make ZMQ context
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate keys to use
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+//Generate key manager signing key
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+Poco::Int64 casterID = 998;
+int registrationPort = 9200;
+
+virtualTimeSource clock;
+caster myCaster(context.get(), makeTestCasterConfiguration(casterID, {registrationPort, 9203, 9204, 9205, 9206, 9207}, casterPublicKey, casterPrivateKey, keyManagerPublicKey), &clock);
+
+std::unique_ptr<zmq::socket_t> registrationSocket;
+
+SOM_TRY //Init socket
+registrationSocket.reset(new zmq::socket_t(*context, ZMQ_DEALER));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+int timeoutWaitTime = 5000; //Max 5 seconds
+registrationSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+SOM_CATCH("Error setting socket timeout\n")
+
+SOM_TRY //Connect to caster
+std::string connectionString = "tcp://127.0.0.1:" +std::to_string(registrationPort);
+registrationSocket->connect(connectionString.c_str());
+SOM_CATCH("Error connecting socket for registration with caster\n")
+
+transmitter_registration_request registrationRequest;
+auto basestationInfo = registrationRequest.mutable_stream_info();
+basestationInfo->set_latitude(1.0);
+basestationInfo->set_longitude(2.0);
+basestationInfo->set_expected_update_rate(1.0);
+basestationInfo->set_message_format(RTCM_V3_1);
+basestationInfo->set_informal_name("virtualTimeBasestation");
+
+transmitter_registration_reply registrationReply;
+
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+SOM_TRY
+std::tie(messageReceived, messageDeserializedCorrectly) = remoteProcedureCall(*registrationSocket, registrationRequest, registrationReply);
+SOM_CATCH("Error, stream registration failed\n")
+
+REQUIRE(registrationReply.request_succeeded() == true);
+
+std::string connectedMetric = "pylongps_caster_connections{class=\"COMMUNITY\"} 1";
+std::string disconnectedMetric = "pylongps_caster_connections{class=\"COMMUNITY\"} 0";
+
+//Not long enough to time out
+clock.advanceBy((SECONDS_BEFORE_CONNECTION_TIMEOUT/2.0)*1000000.0);
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+REQUIRE(myCaster.getPrometheusMetrics().find(connectedMetric) != std::string::npos);
+
+//A message restarts the timeout
+std::string update = "Update\n";
+SOM_TRY
+registrationSocket->send(update.c_str(), update.size());
+SOM_CATCH("Error sending update\n")
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+clock.advanceBy((SECONDS_BEFORE_CONNECTION_TIMEOUT*.75)*1000000.0);
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+REQUIRE(myCaster.getPrometheusMetrics().find(connectedMetric) != std::string::npos);
+
+clock.advanceBy(SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0);
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+REQUIRE(myCaster.getPrometheusMetrics().find(disconnectedMetric) != std::string::npos);
+}
+}
+
+TEST_CASE( "Test coalesced connection timeouts", "[test]")
+{
+SECTION( "A streaming connection only ever has one pending timeout event")
+{
+//Make ZMQ context
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate keys to use
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+//Generate key manager signing key
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+Poco::Int64 casterID = 999;
+int registrationPort = 9210;
+
+//The clock doesn't move unless advanced, so every message would schedule a timeout for the same point in time if they weren't coalesced
+virtualTimeSource clock;
+double ingestBurstSize = 1000.0;
+caster_configuration configuration = makeTestCasterConfiguration(casterID, {registrationPort, 9213, 9214, 9215, 9216, 9217}, casterPublicKey, casterPrivateKey, keyManagerPublicKey);
+configuration.set_ingest_burst_size(ingestBurstSize);
+caster myCaster(context.get(), configuration, &clock);
+
+std::unique_ptr<zmq::socket_t> registrationSocket;
+
+SOM_TRY //Init socket
+registrationSocket.reset(new zmq::socket_t(*context, ZMQ_DEALER));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+int timeoutWaitTime = 5000; //Max 5 seconds
+registrationSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+SOM_CATCH("Error setting socket timeout\n")
+
+SOM_TRY //Connect to caster
+std::string connectionString = "tcp://127.0.0.1:" +std::to_string(registrationPort);
+registrationSocket->connect(connectionString.c_str());
+SOM_CATCH("Error connecting socket for registration with caster\n")
+
+transmitter_registration_request registrationRequest;
+auto basestationInfo = registrationRequest.mutable_stream_info();
+basestationInfo->set_latitude(1.0);
+basestationInfo->set_longitude(2.0);
+basestationInfo->set_expected_update_rate(1000.0);
+basestationInfo->set_message_format(RTCM_V3_1);
+basestationInfo->set_informal_name("coalescedTimeoutBasestation");
+
+transmitter_registration_reply registrationReply;
+
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+SOM_TRY
+std::tie(messageReceived, messageDeserializedCorrectly) = remoteProcedureCall(*registrationSocket, registrationRequest, registrationReply);
+SOM_CATCH("Error, stream registration failed\n")
+
+REQUIRE(registrationReply.request_succeeded() == true);
+
+int numberOfMessagesToSend = 200;
+std::string update = "Update\n";
+for(int i=0; i<numberOfMessagesToSend; i++)
+{
+SOM_TRY
+registrationSocket->send(update.c_str(), update.size());
+SOM_CATCH("Error sending update\n")
+}
+std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+std::string metrics = myCaster.getPrometheusMetrics();
+REQUIRE(metrics.find("pylongps_caster_received_messages_total{source=\"transmitter\"} " + std::to_string(numberOfMessagesToSend)) != std::string::npos);
+REQUIRE(metrics.find("pylongps_caster_event_queue_size{reactor=\"stream_registration_and_publishing\"} 1\n") != std::string::npos);
+REQUIRE(metrics.find("pylongps_caster_event_queue_bytes{reactor=\"stream_registration_and_publishing\"} 0\n") == std::string::npos);
+
+//The pending timeout is moved forward rather than duplicated when it fires before the connection has gone quiet long enough
+clock.advanceBy((SECONDS_BEFORE_CONNECTION_TIMEOUT/2.0)*1000000.0);
+SOM_TRY
+registrationSocket->send(update.c_str(), update.size());
+SOM_CATCH("Error sending update\n")
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+clock.advanceBy((SECONDS_BEFORE_CONNECTION_TIMEOUT*.75)*1000000.0);
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+metrics = myCaster.getPrometheusMetrics();
+REQUIRE(metrics.find("pylongps_caster_connections{class=\"COMMUNITY\"} 1") != std::string::npos);
+REQUIRE(metrics.find("pylongps_caster_event_queue_size{reactor=\"stream_registration_and_publishing\"} 1\n") != std::string::npos);
+
+//Once the connection times out, nothing is left in the queue
+clock.advanceBy(SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0);
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+metrics = myCaster.getPrometheusMetrics();
+REQUIRE(metrics.find("pylongps_caster_connections{class=\"COMMUNITY\"} 0") != std::string::npos);
+REQUIRE(metrics.find("pylongps_caster_event_queue_size{reactor=\"stream_registration_and_publishing\"} 0\n") != std::string::npos);
+REQUIRE(metrics.find("pylongps_caster_event_queue_bytes{reactor=\"stream_registration_and_publishing\"} 0\n") != std::string::npos);
+}
+}
+
+TEST_CASE( "Test asynchronous proxy management", "[test]")
+{
+SECTION( "Add proxies in parallel, retry unreachable ones with backoff and give up on them")
+{
+//Make ZMQ context
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate keys to use
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+//Generate key manager signing key
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+int firstRegistrationPort = 9220;
+int firstClientRequestPort = 9221;
+int firstClientPublishingPort = 9222;
+int firstStreamStatusNotificationPort = 9224;
+caster firstCaster(context.get(), 1000, firstRegistrationPort, firstClientRequestPort, firstClientPublishingPort, 9223, firstStreamStatusNotificationPort, 9225, casterPublicKey, casterPrivateKey, keyManagerPublicKey, std::vector<std::string>(0), std::vector<std::string>(0), std::vector<std::string>(0));
+
+//The second caster's clock only moves when advanced, so the retries of the unreachable proxy can be stepped through
+virtualTimeSource clock;
+caster secondCaster(context.get(), makeTestCasterConfiguration(1001, {9230, 9231, 9232, 9233, 9234, 9235}, casterPublicKey, casterPrivateKey, keyManagerPublicKey), &clock);
+
+//Register a stream with the first caster
+std::unique_ptr<zmq::socket_t> registrationSocket;
+
+SOM_TRY //Init socket
+registrationSocket.reset(new zmq::socket_t(*context, ZMQ_DEALER));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+int timeoutWaitTime = 5000; //Max 5 seconds
+registrationSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+SOM_CATCH("Error setting socket timeout\n")
+
+SOM_TRY //Connect to caster
+std::string connectionString = "tcp://127.0.0.1:" +std::to_string(firstRegistrationPort);
+registrationSocket->connect(connectionString.c_str());
+SOM_CATCH("Error connecting socket for registration with caster\n")
+
+transmitter_registration_request registrationRequest;
+auto basestationInfo = registrationRequest.mutable_stream_info();
+basestationInfo->set_latitude(1.0);
+basestationInfo->set_longitude(2.0);
+basestationInfo->set_expected_update_rate(1.0);
+basestationInfo->set_message_format(RTCM_V3_1);
+basestationInfo->set_informal_name("asyncProxyBasestation");
+
+transmitter_registration_reply registrationReply;
+
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+SOM_TRY
+std::tie(messageReceived, messageDeserializedCorrectly) = remoteProcedureCall(*registrationSocket, registrationRequest, registrationReply);
+SOM_CATCH("Error, stream registration failed\n")
+
+REQUIRE(registrationReply.request_succeeded() == true);
+
+//Start all of the additions before waiting for any of them
+std::string firstClientRequestConnectionString = "tcp://127.0.0.1:" + std::to_string(firstClientRequestPort);
+std::string unreachableClientRequestConnectionString = "tcp://127.0.0.1:9299";
+
+std::future<void> firstAddition = secondCaster.addProxyAsync(firstClientRequestConnectionString, "tcp://127.0.0.1:" + std::to_string(firstClientPublishingPort), "tcp://127.0.0.1:" + std::to_string(firstStreamStatusNotificationPort));
+std::future<void> unreachableAddition = secondCaster.addProxyAsync(unreachableClientRequestConnectionString, "tcp://127.0.0.1:9298", "tcp://127.0.0.1:9297");
+std::future<void> repeatedAddition = secondCaster.addProxyAsync(firstClientRequestConnectionString, "tcp://127.0.0.1:" + std::to_string(firstClientPublishingPort), "tcp://127.0.0.1:" + std::to_string(firstStreamStatusNotificationPort));
+
+REQUIRE(firstAddition.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+REQUIRE_NOTHROW(firstAddition.get());
+REQUIRE(repeatedAddition.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+REQUIRE_NOTHROW(repeatedAddition.get());
+REQUIRE(unreachableAddition.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready);
+
+std::string metrics = secondCaster.getPrometheusMetrics();
+REQUIRE(metrics.find("pylongps_caster_proxied_casters 2\n") != std::string::npos);
+REQUIRE(metrics.find("pylongps_caster_proxied_streams 1\n") != std::string::npos);
+
+//Each step is long enough for a query to time out or for the (doubling) retry delay to pass
+for(uint32_t i=0; i < PROXY_BOOTSTRAP_MAXIMUM_ATTEMPTS*2 && unreachableAddition.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready; i++)
+{
+clock.advanceBy(PROXY_CLIENT_REQUEST_MAX_WAIT_TIME*1000);
+}
+
+REQUIRE(unreachableAddition.wait_for(std::chrono::milliseconds(50)) == std::future_status::ready);
+REQUIRE_THROWS(unreachableAddition.get());
+
+metrics = secondCaster.getPrometheusMetrics();
+REQUIRE(metrics.find("pylongps_caster_proxied_casters 1\n") != std::string::npos);
+
+REQUIRE_NOTHROW(secondCaster.removeProxyAsync(firstClientRequestConnectionString).get());
+metrics = secondCaster.getPrometheusMetrics();
+REQUIRE(metrics.find("pylongps_caster_proxied_casters 0\n") != std::string::npos);
+}
+}
+
+TEST_CASE( "Test proxy stream table", "[test]")
+{
+SECTION( "Match a std::map through growth, wraparound and backward shift deletion")
+{
+proxyStreamTable table(4);
+std::map<std::pair<int64_t, int64_t>, int64_t> expectedEntries;
+
+REQUIRE(table.find(1, 1) == nullptr);
+REQUIRE(table.erase(1, 1) == false);
+
+//A few casters with sequential stream IDs, like the ones the table sees in practice
+uint64_t state = 12345;
+for(int i=0; i<20000; i++)
+{
+state = state*6364136223846793005ULL + 1442695040888963407ULL;
+int64_t foreignCasterID = (state >> 33) % 4;
+int64_t foreignStreamID = (state >> 40) % 300;
+std::pair<int64_t, int64_t> key(foreignCasterID, foreignStreamID);
+
+if((state >> 20) % 3 == 0)
+{
+REQUIRE(table.erase(foreignCasterID, foreignStreamID) == (expectedEntries.erase(key) > 0));
+}
+else
+{
+proxyStreamTableEntry *entry = table.insert(foreignCasterID, foreignStreamID, i);
+REQUIRE((entry != nullptr) == (expectedEntries.count(key) == 0));
+if(entry != nullptr)
+{
+expectedEntries[key] = i;
+}
+}
+}
+
+REQUIRE(table.size() == expectedEntries.size());
+REQUIRE(table.getEntries().size() == expectedEntries.size());
+for(auto iter = expectedEntries.begin(); iter != expectedEntries.end(); iter++)
+{
+proxyStreamTableEntry *entry = table.find(iter->first.first, iter->first.second);
+REQUIRE(entry != nullptr);
+REQUIRE(entry->localStreamID == iter->second);
+REQUIRE(entry->timeoutEventTime == -1);
+}
+
+for(int64_t foreignCasterID = 0; foreignCasterID < 4; foreignCasterID++)
+{
+for(int64_t foreignStreamID = 0; foreignStreamID < 300; foreignStreamID++)
+{
+REQUIRE((table.find(foreignCasterID, foreignStreamID) != nullptr) == (expectedEntries.count(std::pair<int64_t, int64_t>(foreignCasterID, foreignStreamID)) > 0));
+}
+}
+}
+}
+
+TEST_CASE( "Test verified credentials cache", "[test]")
+{
+SECTION( "Key credentials by their contents and evict the least recently used")
+{
+credentials firstCredentials;
+firstCredentials.set_permissions("permissions");
+signature *firstSignature = firstCredentials.add_signatures();
+firstSignature->set_public_key("key");
+firstSignature->set_cryptographic_signature("signature");
+
+credentials secondCredentials = firstCredentials;
+secondCredentials.mutable_signatures(0)->set_cryptographic_signature("different signature");
+
+credentials thirdCredentials = firstCredentials;
+thirdCredentials.set_permissions("permissionskey"); //Same bytes if the fields were simply concatenated
+thirdCredentials.mutable_signatures(0)->set_public_key("");
+
+std::string firstKey = verifiedCredentialsCache::generateKey(firstCredentials);
+std::string secondKey = verifiedCredentialsCache::generateKey(secondCredentials);
+std::string thirdKey = verifiedCredentialsCache::generateKey(thirdCredentials);
+
+REQUIRE(firstKey == verifiedCredentialsCache::generateKey(firstCredentials));
+REQUIRE(firstKey != secondKey);
+REQUIRE(firstKey != thirdKey);
+
+verifiedCredentialsCache cache(2);
+REQUIRE(cache.find(firstKey) == nullptr);
+
+verifiedCredentialsCacheEntry entry;
+entry.credentialsAreValid = true;
+entry.isSignedByOfficialEntityKey = true;
+entry.isSignedByRegisteredCommunityKey = false;
+entry.permissions.set_public_key("connection key");
+entry.permissions.set_valid_until(10);
+cache.insert(firstKey, entry);
+
+entry.credentialsAreValid = false;
+cache.insert(secondKey, entry);
+
+REQUIRE(cache.find(firstKey) != nullptr);
+REQUIRE(cache.find(firstKey)->credentialsAreValid == true);
+REQUIRE(cache.find(firstKey)->permissions.public_key() == "connection key");
+
+//The second entry is now the least recently used
+cache.insert(thirdKey, entry);
+REQUIRE(cache.size() == 2);
+REQUIRE(cache.find(secondKey) == nullptr);
+REQUIRE(cache.find(firstKey) != nullptr);
+REQUIRE(cache.find(thirdKey) != nullptr);
+
+cache.clear();
+REQUIRE(cache.size() == 0);
+REQUIRE(cache.find(firstKey) == nullptr);
+}
+}
+
+TEST_CASE( "Test key graph", "[test]")
+{
+SECTION( "Link keys and connections and remove them")
+{
+keyGraph graph;
+uint32_t signingKey = graph.addNode(SIGNING_KEY_NODE, "signing key");
+uint32_t otherSigningKey = graph.addNode(SIGNING_KEY_NODE, "other signing key");
+uint32_t connectionKey = graph.addNode(CONNECTION_KEY_NODE, "connection key");
+uint32_t connection = graph.addNode(AUTHENTICATED_CONNECTION_NODE, "connection key"); //Same name, different type
+
+REQUIRE(connection != connectionKey);
+REQUIRE(graph.addNode(CONNECTION_KEY_NODE, "connection key") == connectionKey);
+REQUIRE(graph.findNode(CONNECTION_KEY_NODE, "connection key") == connectionKey);
+REQUIRE(graph.findNode(SIGNING_KEY_NODE, "connection key") == KEY_GRAPH_INVALID_NODE_ID);
+REQUIRE(graph.getName(signingKey) == "signing key");
+REQUIRE(graph.getType(connection) == AUTHENTICATED_CONNECTION_NODE);
+
+REQUIRE(graph.addEdge(signingKey, connectionKey));
+REQUIRE(graph.addEdge(otherSigningKey, connectionKey));
+REQUIRE(graph.addEdge(connectionKey, connection));
+REQUIRE(!graph.addEdge(connectionKey, signingKey));
+
+REQUIRE(graph.getNumberOfNeighbors(connectionKey) == 3);
+REQUIRE(graph.getNumberOfNeighbors(connectionKey, SIGNING_KEY_NODE) == 2);
+REQUIRE(graph.getNumberOfNeighbors(connectionKey, AUTHENTICATED_CONNECTION_NODE) == 1);
+REQUIRE(graph.getNeighbor(connection, 0) == connectionKey);
+
+//Removing an edge from the middle of the neighbors must keep the reverse edges consistent
+REQUIRE(graph.removeEdge(connectionKey, signingKey));
+REQUIRE(!graph.removeEdge(signingKey, connectionKey));
+REQUIRE(graph.getNumberOfNeighbors(signingKey) == 0);
+REQUIRE(graph.getNumberOfNeighbors(connectionKey, SIGNING_KEY_NODE) == 1);
+REQUIRE(graph.removeEdge(otherSigningKey, connectionKey));
+REQUIRE(graph.getNumberOfNeighbors(connectionKey) == 1);
+REQUIRE(graph.getNeighbor(connectionKey, 0) == connection);
+
+graph.removeNode(connectionKey);
+REQUIRE(graph.getNumberOfNeighbors(connection) == 0);
+REQUIRE(graph.findNode(CONNECTION_KEY_NODE, "connection key") == KEY_GRAPH_INVALID_NODE_ID);
+REQUIRE(graph.getNumberOfNodes(CONNECTION_KEY_NODE) == 0);
+REQUIRE(graph.getNumberOfNodes(SIGNING_KEY_NODE) == 2);
+
+//IDs of removed nodes are reused
+REQUIRE(graph.addNode(CONNECTION_KEY_NODE, "new connection key") == connectionKey);
+REQUIRE(graph.getNumberOfNeighbors(connectionKey) == 0);
+}
+
+SECTION( "Remove everything signed by a signing key")
+{
+keyGraph graph;
+uint32_t signingKey = graph.addNode(SIGNING_KEY_NODE, "signing key");
+uint32_t otherSigningKey = graph.addNode(SIGNING_KEY_NODE, "other signing key");
+for(int i=0; i<100; i++)
+{
+uint32_t connectionKey = graph.addNode(CONNECTION_KEY_NODE, "connection key " + std::to_string(i));
+graph.addEdge(signingKey, connectionKey);
+if((i % 10) == 0)
+{
+graph.addEdge(otherSigningKey, connectionKey);
+}
+graph.addEdge(connectionKey, graph.addNode(AUTHENTICATED_CONNECTION_NODE, "connection " + std::to_string(i)));
+}
+
+//The same walk caster::removeSigningKey does
+while(graph.getNumberOfNeighbors(signingKey) > 0)
+{
+uint32_t connectionKey = graph.getNeighbor(signingKey, graph.getNumberOfNeighbors(signingKey) - 1);
+if(graph.getNumberOfNeighbors(connectionKey, SIGNING_KEY_NODE) >= 2)
+{
+graph.removeEdge(signingKey, connectionKey);
+continue;
+}
+
+for(uint32_t i = graph.getNumberOfNeighbors(connectionKey); i > 0; i--)
+{
+if(graph.getType(graph.getNeighbor(connectionKey, i-1)) == AUTHENTICATED_CONNECTION_NODE)
+{
+graph.removeNode(graph.getNeighbor(connectionKey, i-1));
+}
+}
+graph.removeNode(connectionKey);
+}
+graph.removeNode(signingKey);
+
+REQUIRE(graph.getNumberOfNodes(SIGNING_KEY_NODE) == 1);
+REQUIRE(graph.getNumberOfNodes(CONNECTION_KEY_NODE) == 10);
+REQUIRE(graph.getNumberOfNodes(AUTHENTICATED_CONNECTION_NODE) == 10);
+REQUIRE(graph.getNumberOfNeighbors(otherSigningKey) == 10);
+for(uint32_t connectionKey : graph.getNodes(CONNECTION_KEY_NODE))
+{
+REQUIRE(graph.getNumberOfNeighbors(connectionKey) == 2);
+REQUIRE(graph.getNumberOfNeighbors(connectionKey, SIGNING_KEY_NODE) == 1);
+}
+}
+}
+
+TEST_CASE( "Test registration admission rate and catalog writes", "[test]")
+{
+SECTION( "Registrations beyond the admission rate are turned away and the database follows the catalog")
+{
+//Make ZMQ context
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate keys to use
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+//Generate key manager signing key
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+Poco::Int64 casterID = 1002;
+int registrationPort = 9240;
+int clientRequestPort = 9241;
+
+virtualTimeSource clock;
+caster_configuration configuration = makeTestCasterConfiguration(casterID, {registrationPort, clientRequestPort, 9242, 9243, 9244, 9245}, casterPublicKey, casterPrivateKey, keyManagerPublicKey);
+configuration.set_registration_admission_rate(2.0);
+caster myCaster(context.get(), configuration, &clock);
+
+transmitter_registration_request registrationRequest;
+auto basestationInfo = registrationRequest.mutable_stream_info();
+basestationInfo->set_latitude(1.0);
+basestationInfo->set_longitude(2.0);
+basestationInfo->set_expected_update_rate(1.0);
+basestationInfo->set_message_format(RTCM_V3_1);
+basestationInfo->set_informal_name("admissionRateBasestation");
+
+//Each registration comes from its own connection
+std::vector<std::unique_ptr<zmq::socket_t> > registrationSockets;
+auto registerLambda = [&]()
+{
+registrationSockets.emplace_back(new zmq::socket_t(*context, ZMQ_DEALER));
+
+int timeoutWaitTime = 5000; //Max 5 seconds
+registrationSockets.back()->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+
+std::string connectionString = "tcp://127.0.0.1:" +std::to_string(registrationPort);
+registrationSockets.back()->connect(connectionString.c_str());
+
+transmitter_registration_reply registrationReply;
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+std::tie(messageReceived, messageDeserializedCorrectly) = remoteProcedureCall(*registrationSockets.back(), registrationRequest, registrationReply);
+REQUIRE(messageReceived);
+REQUIRE(messageDeserializedCorrectly);
+
+return registrationReply;
+};
+
+auto getNumberOfStationsInDatabaseLambda = [&]()
+{
+zmq::socket_t querySocket(*context, ZMQ_REQ);
+int timeoutWaitTime = 5000; //Max 5 seconds
+querySocket.setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+
+std::string connectionString = "tcp://127.0.0.1:" +std::to_string(clientRequestPort);
+querySocket.connect(connectionString.c_str());
+
+client_query_request queryRequest; //Empty request returns all
+client_query_reply queryReply;
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+std::tie(messageReceived, messageDeserializedCorrectly) = remoteProcedureCall(querySocket, queryRequest, queryReply);
+REQUIRE(messageReceived);
+REQUIRE(messageDeserializedCorrectly);
+
+return queryReply.base_stations_size();
+};
+
+//The bucket starts with a second's worth of registrations
+REQUIRE(registerLambda().request_succeeded());
+REQUIRE(registerLambda().request_succeeded());
+
+transmitter_registration_reply rejectedReply = registerLambda();
+REQUIRE(!rejectedReply.request_succeeded());
+REQUIRE(rejectedReply.failure_reason() == REGISTRATION_RATE_LIMITED);
+REQUIRE(myCaster.getPrometheusMetrics().find("pylongps_caster_rate_limited_registrations_total 1\n") != std::string::npos);
+
+//Half a second later there is room for one more
+clock.advanceBy(500000);
+REQUIRE(registerLambda().request_succeeded());
+REQUIRE(!registerLambda().request_succeeded());
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+REQUIRE(getNumberOfStationsInDatabaseLambda() == 3);
+
+//A registration missing a field the catalog requires is turned away rather than failing the batched database write
+clock.advanceBy(500000);
+basestationInfo->clear_latitude();
+transmitter_registration_reply missingFieldReply = registerLambda();
+REQUIRE(!missingFieldReply.request_succeeded());
+REQUIRE(missingFieldReply.failure_reason() == MISSING_REQUIRED_FIELD);
+
+clock.advanceBy(500000);
+basestationInfo->set_latitude(1.0);
+REQUIRE(registerLambda().request_succeeded());
+
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+REQUIRE(getNumberOfStationsInDatabaseLambda() == 4);
+
+//Timing out removes the streams from the catalog and the database
+clock.advanceBy(SECONDS_BEFORE_CONNECTION_TIMEOUT*2*1000000.0);
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+REQUIRE(myCaster.getPrometheusMetrics().find("pylongps_caster_connections{class=\"COMMUNITY\"} 0") != std::string::npos);
+REQUIRE(getNumberOfStationsInDatabaseLambda() == 0);
+}
+
+SECTION( "A rate limited casterDataSender keeps trying until it is registered")
+{
+//Make ZMQ context
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+//Generate keys to use
+std::string casterPublicKey;
+std::string casterPrivateKey;
+std::tie(casterPublicKey, casterPrivateKey) = generateSigningKeys();
+
+//Generate key manager signing key
+unsigned char keyManagerPublicKeyArray[crypto_sign_PUBLICKEYBYTES];
+unsigned char keyManagerSecretKeyArray[crypto_sign_SECRETKEYBYTES];
+crypto_sign_keypair(keyManagerPublicKeyArray, keyManagerSecretKeyArray);
+
+std::string keyManagerPublicKey((const char *) keyManagerPublicKeyArray, crypto_sign_PUBLICKEYBYTES);
+
+int registrationPort = 9257;
+
+virtualTimeSource clock;
+caster_configuration configuration = makeTestCasterConfiguration(1003, {registrationPort, 9258, 9259, 9267, 9268, 9269}, casterPublicKey, casterPrivateKey, keyManagerPublicKey);
+configuration.set_registration_admission_rate(1.0);
+caster myCaster(context.get(), configuration, &clock);
+
+zmq::socket_t sourceSocket(*context, ZMQ_PUB);
+sourceSocket.bind("inproc://rateLimitedCasterDataSenderSource");
+
+//Use up the bucket, so the sender is turned away until the caster's clock moves on
+std::unique_ptr<casterDataSender> firstSender(new casterDataSender("inproc://rateLimitedCasterDataSenderSource", *context, "127.0.0.1:" + std::to_string(registrationPort), 1.0, 2.0, RTCM_V3_1, "firstSender", 1.0));
+
+std::unique_ptr<casterDataSender> limitedSender;
+std::atomic<bool> registrationFinished(false);
+bool registrationSucceeded = false;
+std::thread registrationThread([&]()
+{ //The constructor doesn't return until the sender is registered
+try
+{
+limitedSender.reset(new casterDataSender("inproc://rateLimitedCasterDataSenderSource", *context, "127.0.0.1:" + std::to_string(registrationPort), 1.0, 2.0, RTCM_V3_1, "limitedSender", 1.0));
+registrationSucceeded = true;
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "%s", inputException.what());
+}
+registrationFinished = true;
+});
+SOMScopeGuard registrationThreadGuard([&]() { registrationThread.join(); });
+
+std::this_thread::sleep_for(std::chrono::milliseconds(300));
+REQUIRE(myCaster.getPrometheusMetrics().find("pylongps_caster_rate_limited_registrations_total 0\n") == std::string::npos);
+REQUIRE(!registrationFinished);
+
+clock.advanceBy(1000000);
+registrationThreadGuard.dismiss();
+registrationThread.join();
+
+REQUIRE(registrationSucceeded);
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+REQUIRE(myCaster.getPrometheusMetrics().find("pylongps_caster_connections{class=\"COMMUNITY\"} 2") != std::string::npos);
+}
+}
+
+TEST_CASE( "Test tcp data sender fan-out", "[test]")
+{
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+std::unique_ptr<zmq::socket_t> sourceSocket;
+
+SOM_TRY
+sourceSocket.reset(new zmq::socket_t(*context, ZMQ_PUB));
+sourceSocket->bind("inproc://tcpDataSenderFanOutSource");
+SOM_CATCH("Error making socket\n")
+
+//Connects a blocking client to the sender, optionally with a tiny receive buffer
+auto connectClient = [](int inputPort, int inputReceiveBufferSize)
+{
+int fileDescriptor = socket(AF_INET, SOCK_STREAM, 0);
+REQUIRE(fileDescriptor >= 0);
+
+if(inputReceiveBufferSize > 0)
+{
+setsockopt(fileDescriptor, SOL_SOCKET, SO_RCVBUF, (void *) &inputReceiveBufferSize, sizeof(inputReceiveBufferSize));
+}
+
+timeval timeout = {5, 0};
+setsockopt(fileDescriptor, SOL_SOCKET, SO_RCVTIMEO, (void *) &timeout, sizeof(timeout));
+
+sockaddr_in address;
+memset((void *) &address, 0, sizeof(address));
+address.sin_family = AF_INET;
+address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+address.sin_port = htons(inputPort);
+REQUIRE(connect(fileDescriptor, (sockaddr *) &address, sizeof(address)) == 0);
+
+return fileDescriptor;
+};
+
+SECTION( "Every client gets every message")
+{
+tcpDataSender sender("inproc://tcpDataSenderFanOutSource", *context, 9252);
+
+std::vector<int> clients;
+SOMScopeGuard clientsGuard([&](){for(int client : clients) {close(client);}});
+for(int i=0; i<3; i++)
+{
+clients.push_back(connectClient(9252, 0));
+}
+
+std::this_thread::sleep_for(std::chrono::milliseconds(200)); //Let the subscription and connections go through
+
+std::string expectedData;
+for(int i=0; i<20; i++)
+{
+std::string message = "message" + std::to_string(i) + "\n";
+expectedData += message;
+
+SOM_TRY
+sourceSocket->send(message.c_str(), message.size());
+SOM_CATCH("Error sending message\n")
+}
+
+for(int client : clients)
+{
+std::string receivedData;
+char buffer[1024];
+while(receivedData.size() < expectedData.size())
+{
+ssize_t numberOfBytesRead = recv(client, buffer, sizeof(buffer), 0);
+REQUIRE(numberOfBytesRead > 0);
+receivedData += std::string(buffer, numberOfBytesRead);
+}
+
+REQUIRE(receivedData == expectedData);
+}
+
+std::this_thread::sleep_for(std::chrono::milliseconds((int) (TCP_DATA_SENDER_STATISTICS_UPDATE_INTERVAL*3000))); //Let the statistics snapshot catch up
+std::vector<tcpDataSenderClientStatistics> statistics = sender.getClientStatistics();
+
+REQUIRE(statistics.size() == clients.size());
+for(const tcpDataSenderClientStatistics &clientStatistics : statistics)
+{
+REQUIRE(clientStatistics.numberOfMessagesBehind == 0);
+REQUIRE(clientStatistics.numberOfSentBytes == expectedData.size());
+REQUIRE(clientStatistics.address.find("127.0.0.1:") == 0);
+}
+}
+
+SECTION( "A client which stops reading is evicted without holding up the others")
+{
+tcpDataSender sender("inproc://tcpDataSenderFanOutSource", *context, 9253, nullptr, TCP_DATA_SENDER_EVICT);
+
+int stalledClient = connectClient(9253, 4096);
+SOMScopeGuard stalledClientGuard([&](){close(stalledClient);});
+int readingClient = connectClient(9253, 0);
+SOMScopeGuard readingClientGuard([&](){close(readingClient);});
+
+std::this_thread::sleep_for(std::chrono::milliseconds(200)); //Let the subscription and connections go through
+
+//Much more than the socket buffers hold, in more messages than the backlog holds
+std::string message(64*1024, 'x');
+uint64_t numberOfMessages = TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE*2;
+uint64_t numberOfBytesRead = 0;
+char buffer[64*1024];
+for(uint64_t i=0; i<numberOfMessages; i++)
+{
+SOM_TRY
+sourceSocket->send(message.c_str(), message.size());
+SOM_CATCH("Error sending message\n")
+
+//Keep up so that only the stalled client falls behind
+while(numberOfBytesRead + message.size()*(TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE/2) < (i+1)*message.size())
+{
+ssize_t numberOfBytesReceived = recv(readingClient, buffer, sizeof(buffer), 0);
+REQUIRE(numberOfBytesReceived > 0);
+numberOfBytesRead += numberOfBytesReceived;
+}
+}
+
+while(numberOfBytesRead < numberOfMessages*message.size())
+{
+ssize_t numberOfBytesReceived = recv(readingClient, buffer, sizeof(buffer), 0);
+REQUIRE(numberOfBytesReceived > 0);
+numberOfBytesRead += numberOfBytesReceived;
+}
+
+for(int i=0; i<50 && sender.getNumberOfEvictedClients() == 0; i++)
+{
+std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+REQUIRE(sender.getNumberOfEvictedClients() == 1);
+}
+
+SECTION( "A client which connects when the process is out of file descriptors is refused")
+{
+tcpDataSender sender("inproc://tcpDataSenderFanOutSource", *context, 9254);
+
+int connectedClient = connectClient(9254, 0);
+SOMScopeGuard connectedClientGuard([&](){close(connectedClient);});
+
+std::this_thread::sleep_for(std::chrono::milliseconds(200)); //Let the subscription and connection go through
+
+int refusedClient = socket(AF_INET, SOCK_STREAM, 0);
+REQUIRE(refusedClient >= 0);
+SOMScopeGuard refusedClientGuard([&](){close(refusedClient);});
+timeval timeout = {5, 0};
+setsockopt(refusedClient, SOL_SOCKET, SO_RCVTIMEO, (void *) &timeout, sizeof(timeout));
+
+//Lower the descriptor limit to the lowest unused descriptor, so the sender can't accept anything else
+int lowestUnusedFileDescriptor = 0;
+while(fcntl(lowestUnusedFileDescriptor, F_GETFD) != -1)
+{
+lowestUnusedFileDescriptor++;
+}
+
+rlimit originalLimit;
+REQUIRE(getrlimit(RLIMIT_NOFILE, &originalLimit) == 0);
+SOMScopeGuard limitGuard([&](){setrlimit(RLIMIT_NOFILE, &originalLimit);});
+
+rlimit lowerLimit = originalLimit;
+lowerLimit.rlim_cur = lowestUnusedFileDescriptor;
+REQUIRE(setrlimit(RLIMIT_NOFILE, &lowerLimit) == 0);
+
+sockaddr_in address;
+memset((void *) &address, 0, sizeof(address));
+address.sin_family = AF_INET;
+address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+address.sin_port = htons(9254);
+REQUIRE(connect(refusedClient, (sockaddr *) &address, sizeof(address)) == 0);
+
+//The refused client is disconnected rather than left waiting
+char buffer[1024];
+ssize_t numberOfBytesRead = recv(refusedClient, buffer, sizeof(buffer), 0);
+REQUIRE((numberOfBytesRead == 0 || (numberOfBytesRead < 0 && errno == ECONNRESET)));
+REQUIRE(sender.getNumberOfRefusedClients() == 1);
+
+setrlimit(RLIMIT_NOFILE, &originalLimit);
+
+//Existing and new clients are still served
+int newClient = connectClient(9254, 0);
+SOMScopeGuard newClientGuard([&](){close(newClient);});
+std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+std::string message = "after refusal\n";
+SOM_TRY
+sourceSocket->send(message.c_str(), message.size());
+SOM_CATCH("Error sending message\n")
+
+for(int client : {connectedClient, newClient})
+{
+std::string receivedData;
+while(receivedData.size() < message.size())
+{
+numberOfBytesRead = recv(client, buffer, sizeof(buffer), 0);
+REQUIRE(numberOfBytesRead > 0);
+receivedData += std::string(buffer, numberOfBytesRead);
+}
+REQUIRE(receivedData == message);
+}
+}
+}
+
+TEST_CASE( "Test file data receiver framing and memory mapping", "[test]")
+{
+SECTION( "CRC of a known RTCM 3 frame")
+{
+//Station coordinates (1005) example frame from the RTCM 3 standard
+std::string frame("\xD3\x00\x13\x3E\xD7\xD3\x02\x02\x98\x0E\xDE\xEF\x34\xB4\xBD\x62\xAC\x09\x41\x98\x6F\x33\x36\x0B\x98", 25);
+
+REQUIRE(calculateRTCMV3CRC(frame.c_str(), frame.size() - RTCM_V3_CRC_SIZE) == 0x360B98);
+REQUIRE(calculateRTCMV3CRC(frame.c_str(), frame.size()) == 0);
+}
+
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+std::string tempFilePath = "tempFile5b1c93d0e7";
+remove(tempFilePath.c_str());
+SOMScopeGuard tempFileGuard([&](){remove(tempFilePath.c_str());});
+
+//Create the (empty) file so the receiver can open it and then append to it once the subscriber is connected
+FILE *recordingFile = fopen(tempFilePath.c_str(), "ab");
+REQUIRE(recordingFile != nullptr);
+SOMScopeGuard recordingFileGuard([&](){fclose(recordingFile);});
+
+auto appendToFile = [&](const std::string &inputData)
+{
+REQUIRE(fwrite(inputData.c_str(), 1, inputData.size(), recordingFile) == inputData.size());
+REQUIRE(fflush(recordingFile) == 0);
+};
+
+auto subscribe = [&](const std::string &inputAddress)
+{
+std::unique_ptr<zmq::socket_t> subscriberSocket(new zmq::socket_t(*context, ZMQ_SUB));
+int timeoutWaitTime = 5000;
+subscriberSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+subscriberSocket->connect(inputAddress.c_str());
+subscriberSocket->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
+std::this_thread::sleep_for(std::chrono::milliseconds(50));
+return subscriberSocket;
+};
+
+SECTION( "RTCM 3 framing publishes whole frames and drops everything else")
+{
+//Makes a frame with the given type and payload length (including the type)
+auto makeFrame = [](uint32_t inputMessageType, uint32_t inputPayloadLength)
+{
+std::string frame;
+frame.push_back((char) RTCM_V3_PREAMBLE);
+frame.push_back((char) ((inputPayloadLength >> 8) & 0x03));
+frame.push_back((char) (inputPayloadLength & 0xFF));
+frame.push_back((char) (inputMessageType >> 4));
+frame.push_back((char) ((inputMessageType & 0x0F) << 4));
+for(uint32_t i=2; i<inputPayloadLength; i++)
+{
+frame.push_back((char) (i*7));
+}
+
+uint32_t crc = calculateRTCMV3CRC(frame.c_str(), frame.size());
+frame.push_back((char) (crc >> 16));
+frame.push_back((char) ((crc >> 8) & 0xFF));
+frame.push_back((char) (crc & 0xFF));
+return frame;
+};
+
+std::vector<std::string> frames = {makeFrame(1005, 19), makeFrame(1077, 200), makeFrame(1230, 6)};
+std::string falsePreamble("\xD3\x00\x05" "aaaaa", 8);
+
+fileDataReceiver receiver(tempFilePath, *context, 64, FILE_DATA_RECEIVER_RTCM_V3_FRAMING);
+std::unique_ptr<zmq::socket_t> subscriberSocket = subscribe(receiver.address());
+
+//Write it in pieces so frames are split across reads
+std::string data = "xyz" + frames[0] + falsePreamble + frames[1] + frames[2];
+for(uint64_t offset = 0; offset < data.size(); offset += 50)
+{
+appendToFile(data.substr(offset, 50));
+std::this_thread::sleep_for(std::chrono::milliseconds(5));
+}
+
+for(const std::string &frame : frames)
+{
+zmq::message_t messageBuffer;
+REQUIRE(subscriberSocket->recv(&messageBuffer) == true);
+REQUIRE(std::string((const char *) messageBuffer.data(), messageBuffer.size()) == frame);
+}
+
+REQUIRE(receiver.getNumberOfDiscardedBytes() == 3 + falsePreamble.size());
+}
+
+SECTION( "Large appends are published from a memory mapping in buffer sized chunks")
+{
+uint64_t bufferSize = 4096;
+fileDataReceiver receiver(tempFilePath, *context, bufferSize, FILE_DATA_RECEIVER_NO_FRAMING, true);
+std::unique_ptr<zmq::socket_t> subscriberSocket = subscribe(receiver.address());
+
+std::string data;
+for(uint64_t i=0; i<(3*bufferSize + 100); i++)
+{
+data.push_back((char) (i % 251));
+}
+appendToFile(data);
+
+//A small append after the mapped data is read normally
+appendToFile("tail");
+data += "tail";
+
+std::string receivedData;
+while(receivedData.size() < data.size())
+{
+zmq::message_t messageBuffer;
+REQUIRE(subscriberSocket->recv(&messageBuffer) == true);
+REQUIRE(messageBuffer.size() <= bufferSize);
+receivedData.append((const char *) messageBuffer.data(), messageBuffer.size());
+}
+
+REQUIRE(receivedData == data);
+}
+}
+
+TEST_CASE( "Test batched file writer", "[test]")
+{
+std::string tempFilePath = "tempFile7d04e1a6b2";
+auto removeFiles = [&]()
+{
+remove(tempFilePath.c_str());
+for(int i=1; i<=3; i++)
+{
+remove((tempFilePath + "." + std::to_string(i)).c_str());
+}
+};
+removeFiles();
+SOMScopeGuard tempFileGuard(removeFiles);
+
+auto getFileSize = [](const std::string &inputPath)
+{
+struct stat fileStatus;
+REQUIRE(stat(inputPath.c_str(), &fileStatus) == 0);
+return (int64_t) fileStatus.st_size;
+};
+
+std::string message(10, 'm');
+
+SECTION( "Batches are written when they fill up or get old enough")
+{
+batchedFileWriterPolicy policy;
+policy.writeEachMessage = false;
+policy.writeBufferSize = 100;
+policy.maximumWriteDelay = 1.0;
+
+batchedFileWriter writer(tempFilePath, policy, 0);
+for(int i=0; i<3; i++)
+{
+writer.write(message.c_str(), message.size(), 0);
+}
+REQUIRE(getFileSize(tempFilePath) == 0);
+
+REQUIRE(writer.processDeadlines(500000) == 1000000);
+REQUIRE(getFileSize(tempFilePath) == 0);
+
+writer.processDeadlines(1000000);
+REQUIRE(getFileSize(tempFilePath) == 30);
+REQUIRE(writer.getNumberOfWrites() == 1);
+
+//Doesn't fit with what is batched, so the batch is written first
+std::string largerMessage(60, 'l');
+writer.write(largerMessage.c_str(), largerMessage.size(), 1000000);
+writer.write(largerMessage.c_str(), largerMessage.size(), 1000000);
+REQUIRE(getFileSize(tempFilePath) == 90);
+REQUIRE(writer.getNumberOfWrites() == 2);
+
+writer.flush();
+REQUIRE(getFileSize(tempFilePath) == 150);
+}
+
+SECTION( "Each message is written as it arrives by default")
+{
+batchedFileWriterPolicy policy;
+
+batchedFileWriter writer(tempFilePath, policy, 0);
+REQUIRE(writer.hasDeadlines() == false);
+
+for(int i=0; i<3; i++)
+{
+writer.write(message.c_str(), message.size(), 0);
+REQUIRE(getFileSize(tempFilePath) == 10*(i+1));
+}
+REQUIRE(writer.getNumberOfWrites() == 3);
+}
+
+SECTION( "Files are rotated by size and age")
+{
+batchedFileWriterPolicy policy;
+policy.writeEachMessage = true;
+policy.rotationSize = 25;
+policy.rotationInterval = 1.0;
+
+batchedFileWriter writer(tempFilePath, policy, 0);
+for(int i=0; i<3; i++)
+{
+writer.write(message.c_str(), message.size(), 0);
+}
+
+//Messages aren't split, so the third went in a new file
+REQUIRE(writer.getNumberOfRotations() == 1);
+REQUIRE(getFileSize(tempFilePath + ".1") == 20);
+REQUIRE(getFileSize(tempFilePath) == 10);
+
+REQUIRE(writer.processDeadlines(1000000) == 2000000);
+REQUIRE(writer.getNumberOfRotations() == 2);
+REQUIRE(getFileSize(tempFilePath + ".2") == 10);
+REQUIRE(getFileSize(tempFilePath) == 0);
+
+//Nothing written, so no empty file is left behind
+writer.processDeadlines(2000000);
+REQUIRE(writer.getNumberOfRotations() == 2);
+}
+
+SECTION( "Rotated files don't overwrite existing ones")
+{
+FILE *existingFile = fopen((tempFilePath + ".1").c_str(), "wb");
+REQUIRE(existingFile != nullptr);
+REQUIRE(fwrite("old", 1, 3, existingFile) == 3);
+fclose(existingFile);
+
+batchedFileWriterPolicy policy;
+policy.rotationSize = 15;
+
+batchedFileWriter writer(tempFilePath, policy, 0);
+for(int i=0; i<3; i++)
+{
+writer.write(message.c_str(), message.size(), 0);
+}
+
+REQUIRE(writer.getNumberOfRotations() == 2);
+REQUIRE(getFileSize(tempFilePath + ".1") == 3);
+REQUIRE(getFileSize(tempFilePath + ".2") == 10);
+REQUIRE(getFileSize(tempFilePath + ".3") == 10);
+REQUIRE(getFileSize(tempFilePath) == 10);
+}
+
+SECTION( "A failed rotation leaves the writer using the current file")
+{
+batchedFileWriterPolicy policy;
+policy.rotationSize = 15;
+
+batchedFileWriter writer(tempFilePath, policy, 0);
+writer.write(message.c_str(), message.size(), 0);
+
+//Nothing to rename, so the rotation fails
+REQUIRE(remove(tempFilePath.c_str()) == 0);
+REQUIRE_NOTHROW(writer.write(message.c_str(), message.size(), 0));
+REQUIRE(writer.getNumberOfRotations() == 0);
+REQUIRE(writer.getNumberOfFailedRotations() == 1);
+REQUIRE(writer.getCurrentFileSize() == 20);
+}
+
+SECTION( "Files given as pointers can't be rotated")
+{
+batchedFileWriterPolicy policy;
+policy.rotationSize = 100;
+
+FILE *file = tmpfile();
+REQUIRE(file != nullptr);
+REQUIRE_THROWS(batchedFileWriter(file, policy, 0));
+}
+}
+
+TEST_CASE( "Test stream recordings", "[test]")
+{
+std::string tempFilePath = "tempFile3e6a58c1f4";
+auto removeFiles = [&]()
+{
+remove(tempFilePath.c_str());
+remove((tempFilePath + ".1").c_str());
+};
+removeFiles();
+SOMScopeGuard tempFileGuard(removeFiles);
+
+auto writeFile = [](const std::string &inputPath, const std::string &inputData)
+{
+FILE *file = fopen(inputPath.c_str(), "wb");
+REQUIRE(file != nullptr);
+REQUIRE(fwrite(inputData.c_str(), 1, inputData.size(), file) == inputData.size());
+REQUIRE(fclose(file) == 0);
+};
+
+//A record every second, alternating between streams 1 and 2 and indexing every third record
+std::vector<std::string> payloads;
+std::vector<streamRecordingIndexEntry> index;
+std::string recording = createStreamRecordingHeader(0);
+for(int64_t i=0; i<10; i++)
+{
+payloads.emplace_back("message" + std::to_string(i));
+
+if((i % 3) == 0)
+{
+streamRecordingIndexEntry entry;
+entry.receiveTime = i*1000000;
+entry.offset = recording.size();
+index.emplace_back(entry);
+}
+
+appendStreamRecordingRecord(recording, (i % 2) + 1, i*1000000, payloads[i].c_str(), payloads[i].size());
+}
+
+//Checks that the records from the given offset are the ones starting with the given index
+auto requireRecordsFrom = [&](const streamRecordingReader &inputReader, uint64_t inputOffset, int64_t inputFirstRecordIndex)
+{
+streamRecordingRecord record;
+int64_t recordIndex = inputFirstRecordIndex;
+while(inputReader.readRecord(inputOffset, record))
+{
+REQUIRE(recordIndex < 10);
+REQUIRE(record.streamID == ((recordIndex % 2) + 1));
+REQUIRE(record.receiveTime == recordIndex*1000000);
+REQUIRE(std::string(record.payload, record.payloadSize) == payloads[recordIndex]);
+recordIndex++;
+}
+REQUIRE(recordIndex == 10);
+};
+
+SECTION( "Records can be read back and found by time with the index")
+{
+writeFile(tempFilePath, recording + createStreamRecordingFooter(index, recording.size()));
+
+streamRecordingReader reader(tempFilePath);
+REQUIRE(reader.getStartTime() == 0);
+REQUIRE(reader.getStartOfRecords() == STREAM_RECORDING_HEADER_SIZE);
+REQUIRE(reader.getEndOfRecords() == recording.size());
+REQUIRE(reader.getIndex().size() == 4);
+REQUIRE(reader.getIndex()[2].offset == index[2].offset);
+
+requireRecordsFrom(reader, reader.getStartOfRecords(), 0);
+requireRecordsFrom(reader, reader.seek(4500000), 5);
+requireRecordsFrom(reader, reader.seek(6000000), 6);
+requireRecordsFrom(reader, reader.seek(-1), 0);
+REQUIRE(reader.seek(9000001) == reader.getEndOfRecords());
+}
+
+SECTION( "Recordings which were cut off can still be read")
+{
+std::string partialRecord;
+appendStreamRecordingRecord(partialRecord, 1, 10000000, "lost", 4);
+writeFile(tempFilePath, recording + partialRecord.substr(0, partialRecord.size() - 1));
+
+streamRecordingReader reader(tempFilePath);
+REQUIRE(reader.getIndex().size() == 0);
+
+requireRecordsFrom(reader, reader.getStartOfRecords(), 0);
+requireRecordsFrom(reader, reader.seek(4500000), 5);
+
+uint64_t offset = recording.size();
+streamRecordingRecord record;
+REQUIRE(reader.readRecord(offset, record) == false);
+}
+
+SECTION( "Corrupt footers are ignored")
+{
+//An index entry pointing past the records drops the index but keeps the footer out of the records
+std::vector<streamRecordingIndexEntry> corruptIndex = index;
+corruptIndex[1].offset = recording.size() + 5;
+writeFile(tempFilePath, recording + createStreamRecordingFooter(corruptIndex, recording.size()));
+
+{
+streamRecordingReader reader(tempFilePath);
+REQUIRE(reader.getIndex().size() == 0);
+REQUIRE(reader.getEndOfRecords() == recording.size());
+
+requireRecordsFrom(reader, reader.seek(4500000), 5);
+}
+
+//An index offset which only matches the file size by wrapping around is rejected
+uint64_t fileSize = recording.size() + STREAM_RECORDING_FOOTER_TRAILER_SIZE;
+uint64_t numberOfIndexEntries = fileSize/STREAM_RECORDING_INDEX_ENTRY_SIZE;
+uint64_t indexOffset = (fileSize - STREAM_RECORDING_FOOTER_TRAILER_SIZE) - numberOfIndexEntries*STREAM_RECORDING_INDEX_ENTRY_SIZE; //Wraps around to a huge offset
+Poco::UInt64 trailerValues[2];
+trailerValues[0] = Poco::ByteOrder::toNetwork((Poco::UInt64) indexOffset);
+trailerValues[1] = Poco::ByteOrder::toNetwork((Poco::UInt64) numberOfIndexEntries);
+writeFile(tempFilePath, recording + std::string((const char *) trailerValues, sizeof(trailerValues)) + std::string(STREAM_RECORDING_INDEX_MAGIC, sizeof(STREAM_RECORDING_INDEX_MAGIC)));
+
+{
+streamRecordingReader reader(tempFilePath);
+REQUIRE(reader.getIndex().size() == 0);
+REQUIRE(reader.getEndOfRecords() == fileSize);
+
+requireRecordsFrom(reader, reader.getStartOfRecords(), 0);
+}
+}
+
+SECTION( "Each rotated file is a complete recording")
+{
+batchedFileWriterPolicy policy;
+policy.writeEachMessage = true;
+policy.rotationSize = 90;
+
+{
+batchedFileWriter writer(tempFilePath, policy, 0);
+writer.setFileHeaderAndTrailerFunctions([](Poco::Timestamp::TimeVal inputCurrentTime) { return createStreamRecordingHeader(inputCurrentTime); }, [](uint64_t inputFileSize) { return createStreamRecordingFooter(std::vector<streamRecordingIndexEntry>(), inputFileSize); }, 0);
+
+for(int64_t i=0; i<3; i++)
+{
+std::string record;
+appendStreamRecordingRecord(record, 1, i*1000000, payloads[i].c_str(), payloads[i].size());
+writer.write(record.c_str(), record.size(), i*1000000);
+}
+REQUIRE(writer.getNumberOfRotations() == 1);
+}
+
+//Header, 2 records and a footer, then header, the last record and a footer
+streamRecordingReader firstReader(tempFilePath + ".1");
+REQUIRE(firstReader.getStartTime() == 0);
+REQUIRE(firstReader.getEndOfRecords() == STREAM_RECORDING_HEADER_SIZE + 2*(STREAM_RECORDING_RECORD_HEADER_SIZE + payloads[0].size()));
+
+streamRecordingReader secondReader(tempFilePath);
+REQUIRE(secondReader.getStartTime() == 2000000);
+REQUIRE(secondReader.getEndOfRecords() == STREAM_RECORDING_HEADER_SIZE + STREAM_RECORDING_RECORD_HEADER_SIZE + payloads[2].size());
+
+uint64_t offset = secondReader.getStartOfRecords();
+streamRecordingRecord record;
+REQUIRE(secondReader.readRecord(offset, record));
+REQUIRE(std::string(record.payload, record.payloadSize) == payloads[2]);
+}
+
+std::unique_ptr<zmq::context_t> context;
+
+SOM_TRY
+context.reset(new zmq::context_t);
+SOM_CATCH("Error initializing ZMQ context\n")
+
+auto subscribe = [&](const std::string &inputAddress)
+{
+std::unique_ptr<zmq::socket_t> subscriberSocket(new zmq::socket_t(*context, ZMQ_SUB));
+int timeoutWaitTime = 5000;
+subscriberSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &timeoutWaitTime, sizeof(timeoutWaitTime));
+subscriberSocket->connect(inputAddress.c_str());
+subscriberSocket->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
+std::this_thread::sleep_for(std::chrono::milliseconds(50));
+return subscriberSocket;
+};
+
+auto receiveString = [](zmq::socket_t &inputSocket)
+{
+zmq::message_t message;
+REQUIRE(inputSocket.recv(&message) == true);
+return std::string((const char *) message.data(), message.size());
+};
+
+SECTION( "Recorded messages are replayed with their spacing")
+{
+zmq::socket_t sourceSocket(*context, ZMQ_PUB);
+sourceSocket.bind("inproc://streamRecordingTestSource");
+
+{
+recordingDataSender sender("inproc://streamRecordingTestSource", *context, tempFilePath, 7, batchedFileWriterPolicy(), 0.0);
+std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+for(int64_t i=0; i<5; i++)
+{
+REQUIRE(sourceSocket.send(payloads[i].c_str(), payloads[i].size()) == payloads[i].size());
+std::this_thread::sleep_for(std::chrono::milliseconds(40));
+}
+
+for(int i=0; i<500 && sender.getNumberOfRecordedMessages() < 5; i++)
+{
+std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+REQUIRE(sender.getNumberOfRecordedMessages() == 5);
+} //Destroying the sender finishes the file
+
+std::vector<int64_t> receiveTimes;
+{
+streamRecordingReader reader(tempFilePath);
+REQUIRE(reader.getIndex().size() == 5);
+
+uint64_t offset = reader.getStartOfRecords();
+streamRecordingRecord record;
+while(reader.readRecord(offset, record))
+{
+REQUIRE(record.streamID == 7);
+REQUIRE(std::string(record.payload, record.payloadSize) == payloads[receiveTimes.size()]);
+REQUIRE(reader.getIndex()[receiveTimes.size()].receiveTime == record.receiveTime);
+receiveTimes.emplace_back(record.receiveTime);
+}
+}
+REQUIRE(receiveTimes.size() == 5);
+
+//Replay from the second message at double speed
+recordingDataReceiver receiver(tempFilePath, *context, 2.0, receiveTimes[1], std::vector<int64_t>(), false);
+std::unique_ptr<zmq::socket_t> subscriberSocket = subscribe(receiver.address());
+
+Poco::Timestamp::TimeVal replayStartTime = Poco::Timestamp().epochMicroseconds();
+receiver.startReplay();
+for(int64_t i=1; i<5; i++)
+{
+REQUIRE(receiveString(*subscriberSocket) == payloads[i]);
+}
+REQUIRE((Poco::Timestamp().epochMicroseconds() - replayStartTime) >= (receiveTimes[4] - receiveTimes[1])/2);
+REQUIRE(receiver.getNumberOfReplayedMessages() == 4);
+}
+
+SECTION( "Selected streams can be replayed as fast as possible")
+{
+writeFile(tempFilePath, recording + createStreamRecordingFooter(index, recording.size()));
+
+recordingDataReceiver receiver(tempFilePath, *context, 0.0, 0, std::vector<int64_t>{2}, false);
+std::unique_ptr<zmq::socket_t> subscriberSocket = subscribe(receiver.address());
+
+//The recording spans 9 seconds, but none of that is waited
+Poco::Timestamp::TimeVal replayStartTime = Poco::Timestamp().epochMicroseconds();
+receiver.startReplay();
+for(int64_t i=1; i<10; i += 2)
+{
+REQUIRE(receiveString(*subscriberSocket) == payloads[i]);
+}
+REQUIRE((Poco::Timestamp().epochMicroseconds() - replayStartTime) < 4000000);
+
+for(int i=0; i<500 && !receiver.replayHasFinished(); i++)
+{
+std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+REQUIRE(receiver.replayHasFinished());
+REQUIRE(receiver.getNumberOfReplayedMessages() == 5);
+}
+}
@@ -0,0 +1,463 @@
+#include "batchedFileWriter.hpp"
+
+using namespace pylongps;
+
+/**
+This function checks that the settings in a policy make sense.
+@param inputPolicy: The policy to check
+
+@throws: This function can throw exceptions
+*/
+static void checkPolicy(const batchedFileWriterPolicy &inputPolicy)
+{
+if(!inputPolicy.writeEachMessage && (inputPolicy.writeBufferSize == 0 || inputPolicy.maximumWriteDelay <= 0.0))
+{
+throw SOMException("Batching needs a positive buffer size and write delay\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+}
+}
+
+/**
+This function initializes the writer to write to the given file.  The object takes ownership of the file and closes it on destruction.  Files given this way can't be rotated.
+@param inputFilePointer: The file to write to
+@param inputPolicy: How to write the data
+@param inputCurrentTime: The current time (microseconds since the epoch)
+
+@throws: This function can throw exceptions
+*/
+batchedFileWriter::batchedFileWriter(FILE *inputFilePointer, const batchedFileWriterPolicy &inputPolicy, Poco::Timestamp::TimeVal inputCurrentTime) : policy(inputPolicy), filePointer(inputFilePointer, &fclose)
+{
+if(inputFilePointer == nullptr)
+{
+throw SOMException("Received null file pointer\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+}
+
+SOM_TRY
+checkPolicy(policy);
+SOM_CATCH("Invalid policy\n")
+
+if(policy.rotationSize > 0 || policy.rotationInterval > 0.0)
+{
+throw SOMException("Files given as pointers can't be rotated\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+}
+
+//Writes bypass the stream's buffer, so anything already in it has to go first
+fflush(filePointer.get());
+
+if(!policy.writeEachMessage)
+{
+writeBuffer.reserve(policy.writeBufferSize);
+}
+
+timeOfLastSync = inputCurrentTime;
+timeFileWasStarted = inputCurrentTime;
+}
+
+/**
+This function initializes the writer to write to the file at the given path, replacing anything already there.
+@param inputFilePath: The path of the file to write to
+@param inputPolicy: How to write the data
+@param inputCurrentTime: The current time (microseconds since the epoch)
+
+@throws: This function can throw exceptions
+*/
+batchedFileWriter::batchedFileWriter(const std::string &inputFilePath, const batchedFileWriterPolicy &inputPolicy, Poco::Timestamp::TimeVal inputCurrentTime) : policy(inputPolicy), filePath(inputFilePath), filePointer(nullptr, &fclose)
+{
+SOM_TRY
+checkPolicy(policy);
+SOM_CATCH("Invalid policy\n")
+
+filePointer.reset(fopen(filePath.c_str(), "wb"));
+if(filePointer.get() == nullptr)
+{
+throw SOMException("Unable to open file path\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+}
+
+if(!policy.writeEachMessage)
+{
+writeBuffer.reserve(policy.writeBufferSize);
+}
+
+timeOfLastSync = inputCurrentTime;
+timeFileWasStarted = inputCurrentTime;
+}
+
+/**
+This function writes a message or adds it to the batch, rotating the file first if the message would take it past the rotation size.
+@param inputData: The message
+@param inputDataSize: The size of the message in bytes
+@param inputCurrentTime: The current time (microseconds since the epoch)
+
+@throws: This function can throw exceptions
+*/
+void batchedFileWriter::write(const char *inputData, uint64_t inputDataSize, Poco::Timestamp::TimeVal inputCurrentTime)
+{
+if(policy.rotationSize > 0 && currentFileSize > currentFileHeaderSize && (currentFileSize + inputDataSize) > policy.rotationSize)
+{ //Messages aren't split between files
+SOM_TRY
+rotate(inputCurrentTime);
+SOM_CATCH("Error rotating file\n")
+}
+
+if(policy.writeEachMessage)
+{
+SOM_TRY
+writeToFile(inputData, inputDataSize);
+SOM_CATCH("Error writing message\n")
+
+currentFileSize += inputDataSize;
+return;
+}
+
+if(writeBuffer.size() > 0 && (writeBuffer.size() + inputDataSize) > policy.writeBufferSize)
+{ //Make room
+SOM_TRY
+flush();
+SOM_CATCH("Error writing batched data\n")
+}
+
+if(inputDataSize >= policy.writeBufferSize)
+{ //Too big to be worth copying into the batch
+SOM_TRY
+writeToFile(inputData, inputDataSize);
+SOM_CATCH("Error writing message\n")
+}
+else
+{
+if(writeBuffer.size() == 0)
+{
+timeOldestBatchedDataWasAdded = inputCurrentTime;
+}
+
+writeBuffer.append(inputData, inputDataSize);
+
+if(writeBuffer.size() >= policy.writeBufferSize)
+{
+SOM_TRY
+flush();
+SOM_CATCH("Error writing batched data\n")
+}
+}
+
+currentFileSize += inputDataSize;
+}
+
+/**
+This function writes/syncs/rotates if any of the time based thresholds have been reached.
+@param inputCurrentTime: The current time (microseconds since the epoch)
+@return: When this should next be called (microseconds since the epoch) or -1 if none of the time based settings are used
+
+@throws: This function can throw exceptions
+*/
+Poco::Timestamp::TimeVal batchedFileWriter::processDeadlines(Poco::Timestamp::TimeVal inputCurrentTime)
+{
+if(!hasDeadlines())
+{
+return -1;
+}
+
+Poco::Timestamp::TimeVal maximumWriteDelay = policy.maximumWriteDelay*1000000.0;
+Poco::Timestamp::TimeVal syncInterval = policy.syncInterval*1000000.0;
+Poco::Timestamp::TimeVal rotationInterval = policy.rotationInterval*1000000.0;
+
+if(!policy.writeEachMessage && writeBuffer.size() > 0 && inputCurrentTime >= (timeOldestBatchedDataWasAdded + maximumWriteDelay))
+{
+SOM_TRY
+flush();
+SOM_CATCH("Error writing batched data\n")
+}
+
+if(policy.syncInterval > 0.0 && inputCurrentTime >= (timeOfLastSync + syncInterval))
+{
+SOM_TRY
+sync(inputCurrentTime);
+SOM_CATCH("Error syncing file\n")
+}
+
+if(policy.rotationInterval > 0.0 && inputCurrentTime >= (timeFileWasStarted + rotationInterval))
+{
+bool rotated = false;
+if(currentFileSize > currentFileHeaderSize)
+{
+SOM_TRY
+rotated = rotate(inputCurrentTime);
+SOM_CATCH("Error rotating file\n")
+}
+
+if(!rotated)
+{ //Don't leave a trail of empty files for idle streams (or retry a failed rotation every time this is called)
+timeFileWasStarted = inputCurrentTime;
+}
+}
+
+//The write delay is checked periodically even with nothing batched since data can be added before the next call
+Poco::Timestamp::TimeVal nextDeadline = std::numeric_limits<Poco::Timestamp::TimeVal>::max();
+if(!policy.writeEachMessage)
+{
+nextDeadline = std::min(nextDeadline, (writeBuffer.size() > 0 ? timeOldestBatchedDataWasAdded : inputCurrentTime) + maximumWriteDelay);
+}
+
+if(policy.syncInterval > 0.0)
+{
+nextDeadline = std::min(nextDeadline, timeOfLastSync + syncInterval);
+}
+
+if(policy.rotationInterval > 0.0)
+{
+nextDeadline = std::min(nextDeadline, timeFileWasStarted + rotationInterval);
+}
+
+return nextDeadline;
+}
+
+/**
+This function writes any batched data to the file.
+
+@throws: This function can throw exceptions
+*/
+void batchedFileWriter::flush()
+{
+if(writeBuffer.size() == 0)
+{
+return;
+}
+
+SOM_TRY
+writeToFile(writeBuffer.data(), writeBuffer.size());
+SOM_CATCH("Error writing batched data\n")
+
+writeBuffer.clear();
+}
+
+/**
+This function sets functions to call to get the data that each file has to start/end with (such as a header and an index).  The trailer function is called just before a file is finished (by rotation or destruction of the writer) and the header function is called when each new file is started by rotation (and right away if nothing has been written to the current file yet).  Files with nothing but a header aren't rotated.
+@param inputFileHeaderFunction: Called with the current time (microseconds since the epoch) to get the data to start a new file with (can be nullptr)
+@param inputFileTrailerFunction: Called with the size of the file to get the data to end it with (can be nullptr)
+@param inputCurrentTime: The current time (microseconds since the epoch)
+
+@throws: This function can throw exceptions
+*/
+void batchedFileWriter::setFileHeaderAndTrailerFunctions(const std::function<std::string (Poco::Timestamp::TimeVal)> &inputFileHeaderFunction, const std::function<std::string (uint64_t)> &inputFileTrailerFunction, Poco::Timestamp::TimeVal inputCurrentTime)
+{
+fileHeaderFunction = inputFileHeaderFunction;
+fileTrailerFunction = inputFileTrailerFunction;
+
+if(fileHeaderFunction && currentFileSize == 0)
+{
+std::string header = fileHeaderFunction(inputCurrentTime);
+
+SOM_TRY
+write(header.c_str(), header.size(), inputCurrentTime);
+SOM_CATCH("Error writing file header\n")
+
+currentFileHeaderSize = header.size();
+}
+}
+
+/**
+This function returns how many bytes have been given to the writer for the current file (including any which are still batched), which is the offset the next message will be written at if it doesn't cause a rotation.
+@return: The size of the current file
+*/
+uint64_t batchedFileWriter::getCurrentFileSize() const
+{
+return currentFileSize;
+}
+
+/**
+This function returns if the writer needs processDeadlines to be called.
+@return: true if any of the time based settings are used
+*/
+bool batchedFileWriter::hasDeadlines() const
+{
+return !policy.writeEachMessage || policy.syncInterval > 0.0 || policy.rotationInterval > 0.0;
+}
+
+/**
+This function returns how many files have been finished by rotation.
+@return: The number of rotations
+*/
+uint64_t batchedFileWriter::getNumberOfRotations() const
+{
+return numberOfRotations;
+}
+
+/**
+This function returns how many rotations couldn't be done because the file couldn't be renamed or the new file couldn't be opened (the writer kept using the current file each time).
+@return: The number of failed rotations
+*/
+uint64_t batchedFileWriter::getNumberOfFailedRotations() const
+{
+return numberOfFailedRotations;
+}
+
+/**
+This function returns how many write calls have been made to put data in the file(s).
+@return: The number of writes
+*/
+uint64_t batchedFileWriter::getNumberOfWrites() const
+{
+return numberOfWrites;
+}
+
+/**
+This function writes any batched data and closes the file.
+*/
+batchedFileWriter::~batchedFileWriter()
+{
+try
+{
+flush();
+
+if(fileTrailerFunction)
+{
+std::string trailer = fileTrailerFunction(currentFileSize);
+writeToFile(trailer.c_str(), trailer.size());
+}
+
+if(policy.syncInterval > 0.0)
+{
+sync(Poco::Timestamp().epochMicroseconds());
+}
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "%s", inputException.what());
+}
+}
+
+/**
+This function writes the given data to the file, retrying until all of it is written.
+@param inputData: The data to write
+@param inputDataSize: The number of bytes to write
+
+@throws: This function can throw exceptions
+*/
+void batchedFileWriter::writeToFile(const char *inputData, uint64_t inputDataSize)
+{
+int fileNumber = fileno(filePointer.get());
+uint64_t numberOfBytesWritten = 0;
+while(numberOfBytesWritten < inputDataSize)
+{
+ssize_t result = ::write(fileNumber, (const void *) (inputData + numberOfBytesWritten), inputDataSize - numberOfBytesWritten);
+numberOfWrites++;
+
+if(result < 0)
+{
+if(errno == EINTR)
+{
+continue;
+}
+
+throw SOMException("File write error\n", SERVER_REQUEST_FAILED, __FILE__, __LINE__);
+}
+
+numberOfBytesWritten += result;
+}
+
+hasUnsyncedData = true;
+}
+
+/**
+This function fdatasyncs the file if anything has been written since the last sync.
+@param inputCurrentTime: The current time (microseconds since the epoch)
+
+@throws: This function can throw exceptions
+*/
+void batchedFileWriter::sync(Poco::Timestamp::TimeVal inputCurrentTime)
+{
+//Batched data counts as already received, so it is written first
+SOM_TRY
+flush();
+SOM_CATCH("Error writing batched data\n")
+
+timeOfLastSync = inputCurrentTime;
+
+if(!hasUnsyncedData)
+{
+return;
+}
+
+if(fdatasync(fileno(filePointer.get())) != 0)
+{
+throw SOMException("Unable to sync file\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+
+hasUnsyncedData = false;
+}
+
+/**
+This function finishes the current file (renaming it to the next unused <path>.<number>) and starts a new one at the path.  The current file is only finished once it has been renamed and the new file has been opened, so if either fails the writer carries on with the current file and the rotation is tried again the next time it is due.
+@param inputCurrentTime: The current time (microseconds since the epoch)
+@return: false if the file couldn't be rotated
+
+@throws: This function can throw exceptions
+*/
+bool batchedFileWriter::rotate(Poco::Timestamp::TimeVal inputCurrentTime)
+{
+SOM_TRY
+flush();
+SOM_CATCH("Error writing batched data\n")
+
+//Don't overwrite files left by an earlier writer using the same path
+while(access((filePath + "." + std::to_string(nextRotatedFileNumber)).c_str(), F_OK) == 0)
+{
+nextRotatedFileNumber++;
+}
+
+//The open file follows the rename, so it can still be finished afterwards
+std::string finishedFilePath = filePath + "." + std::to_string(nextRotatedFileNumber);
+if(rename(filePath.c_str(), finishedFilePath.c_str()) != 0)
+{
+numberOfFailedRotations++;
+return false;
+}
+
+std::unique_ptr<FILE, decltype(&fclose)> newFilePointer(fopen(filePath.c_str(), "wb"), &fclose);
+if(newFilePointer.get() == nullptr)
+{ //Put the current file back where it was
+numberOfFailedRotations++;
+if(rename(finishedFilePath.c_str(), filePath.c_str()) != 0)
+{
+throw SOMException("Unable to open new file after rotation or restore the original\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+return false;
+}
+
+if(fileTrailerFunction)
+{
+std::string trailer = fileTrailerFunction(currentFileSize);
+
+SOM_TRY
+writeToFile(trailer.c_str(), trailer.size());
+SOM_CATCH("Error writing file trailer\n")
+}
+
+if(policy.syncInterval > 0.0)
+{
+SOM_TRY
+sync(inputCurrentTime);
+SOM_CATCH("Error syncing file\n")
+}
+
+filePointer = std::move(newFilePointer);
+numberOfRotations++;
+nextRotatedFileNumber++;
+
+currentFileSize = 0;
+currentFileHeaderSize = 0;
+hasUnsyncedData = false;
+timeFileWasStarted = inputCurrentTime;
+
+if(fileHeaderFunction)
+{
+std::string header = fileHeaderFunction(inputCurrentTime);
+
+SOM_TRY
+writeToFile(header.c_str(), header.size());
+SOM_CATCH("Error writing file header\n")
+
+currentFileSize = header.size();
+currentFileHeaderSize = header.size();
+}
+
+return true;
+}
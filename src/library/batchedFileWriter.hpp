@@ -0,0 +1,180 @@
+#ifndef BATCHEDFILEWRITERHPP
+#define BATCHEDFILEWRITERHPP
+
+#include<cstdint>
+#include<cstdio>
+#include<cerrno>
+#include<string>
+#include<memory>
+#include<functional>
+#include<algorithm>
+#include<limits>
+#include<unistd.h>
+
+#include "SOMException.hpp"
+#include "Poco/Timestamp.h"
+
+namespace pylongps
+{
+
+const uint64_t BATCHED_FILE_WRITER_DEFAULT_WRITE_BUFFER_SIZE = 65536; //Bytes
+const double BATCHED_FILE_WRITER_DEFAULT_MAXIMUM_WRITE_DELAY = .25; //Seconds
+
+/**
+This class holds the settings for how a batchedFileWriter gets data onto the disk.  By default, each message is written as it is given and batching has to be asked for.
+*/
+class batchedFileWriterPolicy
+{
+public:
+bool writeEachMessage = true; //Write each message to the file as it is given rather than batching (the write buffer settings only apply if this is false)
+uint64_t writeBufferSize = BATCHED_FILE_WRITER_DEFAULT_WRITE_BUFFER_SIZE; //Batched data is written once there is at least this much
+double maximumWriteDelay = BATCHED_FILE_WRITER_DEFAULT_MAXIMUM_WRITE_DELAY; //Seconds batched data can wait before being written
+double syncInterval = 0.0; //If positive, written data is fdatasync'ed at least this often (seconds)
+uint64_t rotationSize = 0; //If positive, a new file is started before a message would take the current one past this many bytes
+double rotationInterval = 0.0; //If positive, a new file is started after this many seconds (if anything has been written to the current one)
+};
+
+/**
+This class writes messages to a file, either one write per message or batched into large writes which happen once enough data is waiting or the oldest data has waited long enough.  It can also periodically fdatasync the file and rotate it by size or age.  When a file is rotated, it is renamed to <path>.<number> (counting up from 1 and skipping numbers which are already taken, so existing files aren't overwritten and higher numbers are newer) and a new file is started at the original path.  If the rename or opening the new file fails, the writer keeps using the current file and tries again the next time a rotation is due.  The object isn't threadsafe and processDeadlines must be called periodically (at the latest at the time it returns) for the time based settings to work.
+*/
+class batchedFileWriter
+{
+public:
+/**
+This function initializes the writer to write to the given file.  The object takes ownership of the file and closes it on destruction.  Files given this way can't be rotated.
+@param inputFilePointer: The file to write to
+@param inputPolicy: How to write the data
+@param inputCurrentTime: The current time (microseconds since the epoch)
+
+@throws: This function can throw exceptions
+*/
+batchedFileWriter(FILE *inputFilePointer, const batchedFileWriterPolicy &inputPolicy, Poco::Timestamp::TimeVal inputCurrentTime);
+
+/**
+This function initializes the writer to write to the file at the given path, replacing anything already there.
+@param inputFilePath: The path of the file to write to
+@param inputPolicy: How to write the data
+@param inputCurrentTime: The current time (microseconds since the epoch)
+
+@throws: This function can throw exceptions
+*/
+batchedFileWriter(const std::string &inputFilePath, const batchedFileWriterPolicy &inputPolicy, Poco::Timestamp::TimeVal inputCurrentTime);
+
+/**
+This function writes a message or adds it to the batch, rotating the file first if the message would take it past the rotation size.
+@param inputData: The message
+@param inputDataSize: The size of the message in bytes
+@param inputCurrentTime: The current time (microseconds since the epoch)
+
+@throws: This function can throw exceptions
+*/
+void write(const char *inputData, uint64_t inputDataSize, Poco::Timestamp::TimeVal inputCurrentTime);
+
+/**
+This function writes/syncs/rotates if any of the time based thresholds have been reached.
+@param inputCurrentTime: The current time (microseconds since the epoch)
+@return: When this should next be called (microseconds since the epoch) or -1 if none of the time based settings are used
+
+@throws: This function can throw exceptions
+*/
+Poco::Timestamp::TimeVal processDeadlines(Poco::Timestamp::TimeVal inputCurrentTime);
+
+/**
+This function writes any batched data to the file.
+
+@throws: This function can throw exceptions
+*/
+void flush();
+
+/**
+This function sets functions to call to get the data that each file has to start/end with (such as a header and an index).  The trailer function is called just before a file is finished (by rotation or destruction of the writer) and the header function is called when each new file is started by rotation (and right away if nothing has been written to the current file yet).  Files with nothing but a header aren't rotated.
+@param inputFileHeaderFunction: Called with the current time (microseconds since the epoch) to get the data to start a new file with (can be nullptr)
+@param inputFileTrailerFunction: Called with the size of the file to get the data to end it with (can be nullptr)
+@param inputCurrentTime: The current time (microseconds since the epoch)
+
+@throws: This function can throw exceptions
+*/
+void setFileHeaderAndTrailerFunctions(const std::function<std::string (Poco::Timestamp::TimeVal)> &inputFileHeaderFunction, const std::function<std::string (uint64_t)> &inputFileTrailerFunction, Poco::Timestamp::TimeVal inputCurrentTime);
+
+/**
+This function returns how many bytes have been given to the writer for the current file (including any which are still batched), which is the offset the next message will be written at if it doesn't cause a rotation.
+@return: The size of the current file
+*/
+uint64_t getCurrentFileSize() const;
+
+/**
+This function returns if the writer needs processDeadlines to be called.
+@return: true if any of the time based settings are used
+*/
+bool hasDeadlines() const;
+
+/**
+This function returns how many files have been finished by rotation.
+@return: The number of rotations
+*/
+uint64_t getNumberOfRotations() const;
+
+/**
+This function returns how many rotations couldn't be done because the file couldn't be renamed or the new file couldn't be opened (the writer kept using the current file each time).
+@return: The number of failed rotations
+*/
+uint64_t getNumberOfFailedRotations() const;
+
+/**
+This function returns how many write calls have been made to put data in the file(s).
+@return: The number of writes
+*/
+uint64_t getNumberOfWrites() const;
+
+/**
+This function writes any batched data and closes the file.
+*/
+~batchedFileWriter();
+
+protected:
+/**
+This function writes the given data to the file, retrying until all of it is written.
+@param inputData: The data to write
+@param inputDataSize: The number of bytes to write
+
+@throws: This function can throw exceptions
+*/
+void writeToFile(const char *inputData, uint64_t inputDataSize);
+
+/**
+This function fdatasyncs the file if anything has been written since the last sync.
+@param inputCurrentTime: The current time (microseconds since the epoch)
+
+@throws: This function can throw exceptions
+*/
+void sync(Poco::Timestamp::TimeVal inputCurrentTime);
+
+/**
+This function finishes the current file (renaming it to the next unused <path>.<number>) and starts a new one at the path.  The current file is only finished once it has been renamed and the new file has been opened, so if either fails the writer carries on with the current file and the rotation is tried again the next time it is due.
+@param inputCurrentTime: The current time (microseconds since the epoch)
+@return: false if the file couldn't be rotated
+
+@throws: This function can throw exceptions
+*/
+bool rotate(Poco::Timestamp::TimeVal inputCurrentTime);
+
+batchedFileWriterPolicy policy;
+std::string filePath; //Empty if the file was given as a pointer
+std::unique_ptr<FILE, decltype(&fclose)> filePointer;
+std::string writeBuffer; //Batched data waiting to be written
+Poco::Timestamp::TimeVal timeOldestBatchedDataWasAdded = 0;
+Poco::Timestamp::TimeVal timeOfLastSync = 0;
+Poco::Timestamp::TimeVal timeFileWasStarted = 0;
+uint64_t currentFileSize = 0; //Including batched data
+uint64_t currentFileHeaderSize = 0; //Bytes at the start of the current file from fileHeaderFunction
+bool hasUnsyncedData = false;
+uint64_t numberOfRotations = 0;
+uint64_t numberOfFailedRotations = 0;
+uint64_t nextRotatedFileNumber = 1; //Checked against existing files before each rotation
+uint64_t numberOfWrites = 0;
+std::function<std::string (Poco::Timestamp::TimeVal)> fileHeaderFunction;
+std::function<std::string (uint64_t)> fileTrailerFunction;
+};
+
+}
+#endif
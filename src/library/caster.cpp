@@ -20,12 +20,44 @@ This function initializes the class, creates the associated database, and starts
 @param inputBlacklistedKeys: A list of signing keys not to trust 
 @param inputCasterSQLITEConnectionString: The connection string used to connect to or create the SQLITE database used for stream source entry management and query resolution.  If an empty string is given (by default), it will connect/create an in memory database with a random 64 bit number string (example: "file:9735926149617295559?mode=memory&cache=shared")
 
+The other options (see caster_configuration.proto) and the time source are only available through the caster_configuration constructor.
+
 @throws: This function can throw exceptions
 */
 caster::caster(zmq::context_t *inputContext, int64_t inputCasterID, uint32_t inputTransmitterRegistrationAndStreamingPortNumber, uint32_t inputClientRequestPortNumber, uint32_t inputClientStreamPublishingPortNumber, uint32_t inputProxyStreamPublishingPortNumber, uint32_t inputStreamStatusNotificationPortNumber, uint32_t inputKeyRegistrationAndRemovalPortNumber, const std::string &inputCasterPublicKey, const std::string &inputCasterSecretKey, const std::string &inputSigningKeysManagementKey, const std::vector<std::string> &inputOfficialSigningKeys, const std::vector<std::string> &inputRegisteredCommunitySigningKeys, const std::vector<std::string> &inputBlacklistedKeys, const std::string &inputCasterSQLITEConnectionString)  : databaseConnection(nullptr, &sqlite3_close_v2)
 {
+//Everything else is left at its default
+caster_configuration configuration;
+configuration.set_caster_id(inputCasterID);
+configuration.set_transmitter_registration_and_streaming_port_number(inputTransmitterRegistrationAndStreamingPortNumber);
+configuration.set_client_request_port_number(inputClientRequestPortNumber);
+configuration.set_client_stream_publishing_port_number(inputClientStreamPublishingPortNumber);
+configuration.set_proxy_stream_publishing_port_number(inputProxyStreamPublishingPortNumber);
+configuration.set_stream_status_notification_port_number(inputStreamStatusNotificationPortNumber);
+configuration.set_key_registration_and_removal_port_number(inputKeyRegistrationAndRemovalPortNumber);
+configuration.set_caster_public_key(inputCasterPublicKey);
+configuration.set_caster_secret_key(inputCasterSecretKey);
+configuration.set_signing_keys_management_key(inputSigningKeysManagementKey);
+
+for(int i=0; i<inputOfficialSigningKeys.size(); i++)
+{
+configuration.add_official_signing_keys(inputOfficialSigningKeys[i]);
+}
+
+for(int i=0; i<inputRegisteredCommunitySigningKeys.size(); i++)
+{
+configuration.add_registered_community_signing_keys(inputRegisteredCommunitySigningKeys[i]);
+}
+
+for(int i=0; i<inputBlacklistedKeys.size(); i++)
+{
+configuration.add_blacklisted_keys(inputBlacklistedKeys[i]);
+}
+
+configuration.set_caster_sqlite_connection_string(inputCasterSQLITEConnectionString);
+
 SOM_TRY
-commonConstructor(inputContext, inputCasterID, inputTransmitterRegistrationAndStreamingPortNumber, inputClientRequestPortNumber, inputClientStreamPublishingPortNumber, inputProxyStreamPublishingPortNumber, inputStreamStatusNotificationPortNumber, inputKeyRegistrationAndRemovalPortNumber, inputCasterPublicKey, inputCasterSecretKey, inputSigningKeysManagementKey, inputOfficialSigningKeys, inputRegisteredCommunitySigningKeys, inputBlacklistedKeys, inputCasterSQLITEConnectionString);
+commonConstructor(inputContext, configuration, nullptr);
 SOM_CATCH("Error in subconstructor\n")
 }
 
@@ -33,57 +65,26 @@ SOM_CATCH("Error in subconstructor\n")
 This function intializes the object based on the parameters in a protobuf message (which allows serialization/deserialization of configuration parameters).
 @param inputContext: The ZMQ context to use
 @param inputConfiguration: The protobuf message containing the configuration information
+@param inputTimeSource: The source of the current time for all timeouts/expirations (the wall clock if nullptr).  It must outlive the caster
 
 @throws: This function can throw exceptions
 */
-caster::caster(zmq::context_t *inputContext, const caster_configuration &inputConfiguration)  : databaseConnection(nullptr, &sqlite3_close_v2)
-{
-//Convert repeated fields into std::vectors
-std::vector<std::string> officialSigningKeys;
-for(int i=0; i<inputConfiguration.official_signing_keys_size(); i++)
-{
-officialSigningKeys.push_back(inputConfiguration.official_signing_keys(i));
-}
-
-std::vector<std::string> registeredCommunitySigningKeys;
-for(int i=0; i<inputConfiguration.registered_community_signing_keys_size(); i++)
-{
-registeredCommunitySigningKeys.push_back(inputConfiguration.registered_community_signing_keys(i));
-}
-
-std::vector<std::string> blacklistedKeys;
-for(int i=0; i<inputConfiguration.blacklisted_keys_size(); i++)
+caster::caster(zmq::context_t *inputContext, const caster_configuration &inputConfiguration, timeSource *inputTimeSource)  : databaseConnection(nullptr, &sqlite3_close_v2)
 {
-blacklistedKeys.push_back(inputConfiguration.blacklisted_keys(i));
-}
-
-
 SOM_TRY
-commonConstructor(inputContext, inputConfiguration.caster_id(), inputConfiguration.transmitter_registration_and_streaming_port_number(), inputConfiguration.client_request_port_number(), inputConfiguration.client_stream_publishing_port_number(), inputConfiguration.proxy_stream_publishing_port_number(), inputConfiguration.stream_status_notification_port_number(), inputConfiguration.key_registration_and_removal_port_number(), inputConfiguration.caster_public_key(), inputConfiguration.caster_secret_key(), inputConfiguration.signing_keys_management_key(), officialSigningKeys, registeredCommunitySigningKeys, blacklistedKeys);
+commonConstructor(inputContext, inputConfiguration, inputTimeSource);
 SOM_CATCH("Error in subconstructor\n")
 }
 
 /**
 This function initializes the class, creates the associated database, and starts the two threads associated with it (used in constructors).
 @param inputContext: The ZMQ context that this object should use
-@param inputCasterID: The 64 bit ID associated with this caster (make sure it does not collide with caster IDs the clients are likely to run into)
-@param inputTransmitterRegistrationAndStreamingPortNumber: The port number to register the ZMQ router socket used for receiving PylonGPS transmitter registrations/streams
-@param inputClientRequestPortNumber: The port to open to receive client requests (including requests from proxies for the list of sources)
-@param inputClientStreamPublishingPortNumber: The port to open for the interface to publish stream data to clients
-@param inputProxyStreamPublishingPortNumber: The port to open for the interface to publish stream data to proxies (potentially higher priority)
-@param inputStreamStatusNotificationPortNumber: The port for the interface that is used to to publish stream status changes
-@param inputKeyRegistrationAndRemovalPortNumber: The port for the interface that is used to add/remove 
-@param inputCasterPublicKey: The public key for this caster to use for encryption/authentation
-@param inputCasterSecretKey: The secret key for this caster to use for encryption/authentation
-@param inputSigningKeysManagementKey: The signing key that has permission to add/remove allowed signing keys from the caster
-@param inputOfficialSigningKeys: A list of the initial set of approved keys for official basestations
-@param inputRegisteredCommunitySigningKeys: A list of the initial set of approved keys for registered community basestations
-@param inputBlacklistedKeys: A list of signing keys not to trust 
-@param inputCasterSQLITEConnectionString: The connection string used to connect to or create the SQLITE database used for stream source entry management and query resolution.  If an empty string is given (by default), it will connect/create an in memory database with a random 64 bit number string (example: "file:9735926149617295559?mode=memory&cache=shared")
+@param inputConfiguration: The configuration of the caster (see caster_configuration.proto)
+@param inputTimeSource: The source of the current time for all timeouts/expirations (the wall clock if nullptr, a virtualTimeSource lets tests simulate hours in seconds).  It must outlive the caster
 
 @throws: This function can throw exceptions
 */
-void caster::commonConstructor(zmq::context_t *inputContext, int64_t inputCasterID, uint32_t inputTransmitterRegistrationAndStreamingPortNumber, uint32_t inputClientRequestPortNumber, uint32_t inputClientStreamPublishingPortNumber, uint32_t inputProxyStreamPublishingPortNumber, uint32_t inputStreamStatusNotificationPortNumber, uint32_t inputKeyRegistrationAndRemovalPortNumber, const std::string &inputCasterPublicKey, const std::string &inputCasterSecretKey, const std::string &inputSigningKeysManagementKey, const std::vector<std::string> &inputOfficialSigningKeys, const std::vector<std::string> &inputRegisteredCommunitySigningKeys, const std::vector<std::string> &inputBlacklistedKeys, const std::string &inputCasterSQLITEConnectionString)
+void caster::commonConstructor(zmq::context_t *inputContext, const caster_configuration &inputConfiguration, timeSource *inputTimeSource)
 {
 if(inputContext == nullptr)
 {
@@ -91,59 +92,71 @@ throw SOMException("Invalid ZMQ context\n", INVALID_FUNCTION_INPUT, __FILE__, __
 }
 
 //Check that keys are the right size
-if((inputCasterPublicKey.size() != crypto_sign_PUBLICKEYBYTES) || (inputCasterSecretKey.size() != crypto_sign_SECRETKEYBYTES ))
+if((inputConfiguration.caster_public_key().size() != crypto_sign_PUBLICKEYBYTES) || (inputConfiguration.caster_secret_key().size() != crypto_sign_SECRETKEYBYTES ))
 {
 throw SOMException("Invalid ZMQ key(s)\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
 }
 
 //Save given parameters
 context = inputContext;
-casterID = inputCasterID;
-transmitterRegistrationAndStreamingPortNumber = inputTransmitterRegistrationAndStreamingPortNumber;
-clientRequestPortNumber = inputClientRequestPortNumber;
-clientStreamPublishingPortNumber = inputClientStreamPublishingPortNumber;
-proxyStreamPublishingPortNumber = inputProxyStreamPublishingPortNumber;
-streamStatusNotificationPortNumber = inputStreamStatusNotificationPortNumber;
-casterPublicKey = inputCasterPublicKey;
-casterSecretKey = inputCasterSecretKey;
+casterID = inputConfiguration.caster_id();
+transmitterRegistrationAndStreamingPortNumber = inputConfiguration.transmitter_registration_and_streaming_port_number();
+clientRequestPortNumber = inputConfiguration.client_request_port_number();
+clientStreamPublishingPortNumber = inputConfiguration.client_stream_publishing_port_number();
+proxyStreamPublishingPortNumber = inputConfiguration.proxy_stream_publishing_port_number();
+streamStatusNotificationPortNumber = inputConfiguration.stream_status_notification_port_number();
+keyRegistrationAndRemovalPortNumber = inputConfiguration.key_registration_and_removal_port_number();
+metricsPortNumber = inputConfiguration.metrics_port_number();
+casterTimeSource = inputTimeSource != nullptr ? inputTimeSource : &getSystemTimeSource();
+casterPublicKey = inputConfiguration.caster_public_key();
+casterSecretKey = inputConfiguration.caster_secret_key();
+stateHasBeenHandedOff = false;
+ingestBurstSize = inputConfiguration.ingest_burst_size();
+globalIngestRateLimiter = tokenBucket(inputConfiguration.global_ingest_rate_limit(), inputConfiguration.global_ingest_rate_limit(), casterTimeSource->now().epochMicroseconds()); //Allow up to a second's worth of burst
+registrationAdmissionRateLimiter = tokenBucket(inputConfiguration.registration_admission_rate(), inputConfiguration.registration_admission_rate(), casterTimeSource->now().epochMicroseconds());
+stationClassToPublishingQueue.emplace(std::piecewise_construct, std::forward_as_tuple(OFFICIAL), std::forward_as_tuple(OFFICIAL_PUBLISHING_WEIGHT, inputConfiguration.official_publishing_high_water_mark()));
+stationClassToPublishingQueue.emplace(std::piecewise_construct, std::forward_as_tuple(REGISTERED_COMMUNITY), std::forward_as_tuple(REGISTERED_COMMUNITY_PUBLISHING_WEIGHT, inputConfiguration.registered_community_publishing_high_water_mark()));
+stationClassToPublishingQueue.emplace(std::piecewise_construct, std::forward_as_tuple(COMMUNITY), std::forward_as_tuple(COMMUNITY_PUBLISHING_WEIGHT, inputConfiguration.community_publishing_high_water_mark()));
+addStreamFrameHeaders = inputConfiguration.add_stream_frame_headers();
+traceSamplingInterval = inputConfiguration.trace_sampling_interval();
 
 //Check key lengths and place the keys in the set
-if(inputSigningKeysManagementKey.size() != crypto_sign_PUBLICKEYBYTES)
+if(inputConfiguration.signing_keys_management_key().size() != crypto_sign_PUBLICKEYBYTES)
 {
 throw SOMException("Master signing key is incorrect length\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
 }
-signingKeysManagementKey = inputSigningKeysManagementKey;
+signingKeysManagementKey = inputConfiguration.signing_keys_management_key();
 
-for(int i=0; i<inputOfficialSigningKeys.size(); i++)
+for(int i=0; i<inputConfiguration.official_signing_keys_size(); i++)
 {
-if(inputOfficialSigningKeys[i].size() != crypto_sign_PUBLICKEYBYTES)
+if(inputConfiguration.official_signing_keys(i).size() != crypto_sign_PUBLICKEYBYTES)
 {
 throw SOMException("One of the official signing keys is incorrect length\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
 }
-officialSigningKeys.insert(inputOfficialSigningKeys[i]);
+officialSigningKeys.insert(inputConfiguration.official_signing_keys(i));
 }
 
-for(int i=0; i<inputRegisteredCommunitySigningKeys.size(); i++)
+for(int i=0; i<inputConfiguration.registered_community_signing_keys_size(); i++)
 {
-if(inputRegisteredCommunitySigningKeys[i].size() != crypto_sign_PUBLICKEYBYTES)
+if(inputConfiguration.registered_community_signing_keys(i).size() != crypto_sign_PUBLICKEYBYTES)
 {
 throw SOMException("One of the registered community signing keys is incorrect length\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
 }
-registeredCommunitySigningKeys.insert(inputRegisteredCommunitySigningKeys[i]);
+registeredCommunitySigningKeys.insert(inputConfiguration.registered_community_signing_keys(i));
 }
 
-for(int i=0; i<inputBlacklistedKeys.size(); i++)
+for(int i=0; i<inputConfiguration.blacklisted_keys_size(); i++)
 {
-if(inputBlacklistedKeys[i].size() != crypto_sign_PUBLICKEYBYTES)
+if(inputConfiguration.blacklisted_keys(i).size() != crypto_sign_PUBLICKEYBYTES)
 {
 throw SOMException("One of the signing keys in the blacklist is a incorrect length\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
 }
-blacklistedSigningKeys.insert(inputBlacklistedKeys[i]);
+blacklistedSigningKeys.insert(inputConfiguration.blacklisted_keys(i));
 }
 
 
 //Set database connection string 
-if(inputCasterSQLITEConnectionString == "")
+if(inputConfiguration.caster_sqlite_connection_string() == "")
 {
 //Generate random 64 bit unsigned int
 std::random_device randomnessSource;
@@ -154,7 +167,7 @@ databaseConnectionString = "file:" + std::to_string(connectionInteger) + "?mode=
 }
 else
 {
-databaseConnectionString = inputCasterSQLITEConnectionString;
+databaseConnectionString = inputConfiguration.caster_sqlite_connection_string();
 }
 
 //Attempt to connect to the database
@@ -190,6 +203,19 @@ SOM_TRY
 setupBaseStationToSQLInterface();
 SOM_CATCH("Error setting up basestationToSQLInterface\n")
 
+//If this caster is replacing another one, get the other caster's state before binding (the ports are shared with the other caster, which keeps serving the connections it has while new ones come here)
+caster_state_handoff_reply previousCasterState;
+bool isTakingOverPorts = inputConfiguration.previous_caster_state_handoff_connection_string() != "";
+int bindingMaxWaitTime = 0; //Only try once unless the ports are being taken over
+if(isTakingOverPorts)
+{
+SOM_TRY
+retrieveStateFromPreviousCaster(inputConfiguration.previous_caster_state_handoff_connection_string(), previousCasterState);
+SOM_CATCH("Error retrieving state from previous caster\n")
+
+bindingMaxWaitTime = STATE_HANDOFF_MAX_WAIT_TIME;
+}
+
 
 //Initialize and bind shutdown socket
 SOM_TRY
@@ -243,23 +269,18 @@ transmitterRegistrationAndStreamingInterface.reset(new zmq::socket_t(*(context),
 SOM_CATCH("Error intializing transmitterRegistrationAndStreamingInterface\n")
 
 SOM_TRY
-std::string bindingAddress = "tcp://*:" + std::to_string(transmitterRegistrationAndStreamingPortNumber);
-transmitterRegistrationAndStreamingInterface->bind(bindingAddress.c_str());
+bindZMQSocketToSharedTCPPort(*transmitterRegistrationAndStreamingInterface, transmitterRegistrationAndStreamingPortNumber, isTakingOverPorts, bindingMaxWaitTime);
 SOM_CATCH("Error binding transmitterRegistrationAndStreamingInterface\n")
 
 
 
-//Initialize and add filter for proxiesUpdatesListeningSocket
-//A TCP SUB socket which subscribes to other casters so that it can republish the updates it received.  Used in the streamRegistrationAndPublishingThread.
+//Initialize proxiesUpdatesListeningSocket
+//A TCP SUB socket which subscribes to other casters so that it can republish the updates it received.  Used in the streamRegistrationAndPublishingThread.  Its subscriptions are set by updateProxyUpstreamSubscriptions to the proxied streams that local clients are subscribed to.
 std::unique_ptr<zmq::socket_t> proxiesUpdatesListeningSocket; 
 SOM_TRY
 proxiesUpdatesListeningSocket.reset(new zmq::socket_t(*(context), ZMQ_SUB));
 SOM_CATCH("Error intializing proxiesUpdatesListeningSocket\n")
 
-SOM_TRY //Set filter to allow any published messages to be received
-proxiesUpdatesListeningSocket->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
-SOM_CATCH("Error setting subscription for proxiesUpdatesListeningSocket\n")
-
 //Initialize and add filter for proxiesNotificationsListeningSocket
  //A TCP SUB socket which subscribes to other casters so that it can know when they add/remove a basestation. Used in the streamRegistrationAndPublishingThread.
 std::unique_ptr<zmq::socket_t> proxiesNotificationsListeningSocket;
@@ -293,8 +314,7 @@ keyRegistrationAndRemovalInterface.reset(new zmq::socket_t(*(context), ZMQ_REP))
 SOM_CATCH("Error intializing keyRegistrationAndRemovalInterface\n")
 
 SOM_TRY
-std::string bindingAddress = "tcp://*:" + std::to_string(inputKeyRegistrationAndRemovalPortNumber);
-keyRegistrationAndRemovalInterface->bind(bindingAddress.c_str());
+bindZMQSocketToSharedTCPPort(*keyRegistrationAndRemovalInterface, inputConfiguration.key_registration_and_removal_port_number(), isTakingOverPorts, bindingMaxWaitTime);
 SOM_CATCH("Error binding keyRegistrationAndRemovalInterface\n")
 
 //Initialize and bind clientRequestInterface socket
@@ -305,28 +325,39 @@ clientRequestInterface.reset(new zmq::socket_t(*(context), ZMQ_REP));
 SOM_CATCH("Error intializing clientRequestInterface\n")
 
 SOM_TRY
-std::string bindingAddress = "tcp://*:" + std::to_string(clientRequestPortNumber);
-clientRequestInterface->bind(bindingAddress.c_str());
+bindZMQSocketToSharedTCPPort(*clientRequestInterface, clientRequestPortNumber, isTakingOverPorts, bindingMaxWaitTime);
 SOM_CATCH("Error binding clientRequestInterface\n")
 
 //Initialize and bind clientStreamPublishingInterface socket
 SOM_TRY
-clientStreamPublishingInterface.reset(new zmq::socket_t(*(context), ZMQ_PUB));
+clientStreamPublishingInterface.reset(new zmq::socket_t(*(context), ZMQ_XPUB));
 SOM_CATCH("Error intializing clientStreamPublishingInterface\n")
 
+#ifdef ZMQ_XPUB_VERBOSER
+SOM_TRY //Pass on every subscribe/unsubscribe (rather than just the first/last for each prefix) so that the subscribers to each stream can be counted
+int verboseSubscriptionsValue = 1;
+clientStreamPublishingInterface->setsockopt(ZMQ_XPUB_VERBOSER, (void *) &verboseSubscriptionsValue, sizeof(verboseSubscriptionsValue));
+SOM_CATCH("Error setting clientStreamPublishingInterface to report all subscriptions\n")
+#endif
+
 SOM_TRY
-std::string bindingAddress = "tcp://*:" + std::to_string(clientStreamPublishingPortNumber);
-clientStreamPublishingInterface->bind(bindingAddress.c_str());
+bindZMQSocketToSharedTCPPort(*clientStreamPublishingInterface, clientStreamPublishingPortNumber, isTakingOverPorts, bindingMaxWaitTime);
 SOM_CATCH("Error binding clientStreamPublishingInterface\n")
 
 //Initialize and bind proxyStreamPublishingInterface socket
 SOM_TRY
-proxyStreamPublishingInterface.reset(new zmq::socket_t(*(context), ZMQ_PUB));
+proxyStreamPublishingInterface.reset(new zmq::socket_t(*(context), ZMQ_XPUB));
 SOM_CATCH("Error intializing proxyStreamPublishingInterface\n")
 
+#ifdef ZMQ_XPUB_VERBOSER
+SOM_TRY //Pass on every subscribe/unsubscribe so that the downstream proxies subscribed to each stream can be counted
+int verboseSubscriptionsValue = 1;
+proxyStreamPublishingInterface->setsockopt(ZMQ_XPUB_VERBOSER, (void *) &verboseSubscriptionsValue, sizeof(verboseSubscriptionsValue));
+SOM_CATCH("Error setting proxyStreamPublishingInterface to report all subscriptions\n")
+#endif
+
 SOM_TRY
-std::string bindingAddress = "tcp://*:" + std::to_string(proxyStreamPublishingPortNumber);
-proxyStreamPublishingInterface->bind(bindingAddress.c_str());
+bindZMQSocketToSharedTCPPort(*proxyStreamPublishingInterface, proxyStreamPublishingPortNumber, isTakingOverPorts, bindingMaxWaitTime);
 SOM_CATCH("Error binding proxyStreamPublishingInterface\n")
 
 //Initialize and bind streamStatusNotificationInterface socket
@@ -335,24 +366,22 @@ streamStatusNotificationInterface.reset(new zmq::socket_t(*(context), ZMQ_PUB));
 SOM_CATCH("Error intializing streamStatusNotificationInterface\n")
 
 SOM_TRY
-std::string bindingAddress = "tcp://*:" + std::to_string(streamStatusNotificationPortNumber);
-streamStatusNotificationInterface->bind(bindingAddress.c_str());
+bindZMQSocketToSharedTCPPort(*streamStatusNotificationInterface, streamStatusNotificationPortNumber, isTakingOverPorts, bindingMaxWaitTime);
 SOM_CATCH("Error binding streamStatusNotificationInterface\n")
 
-//Initialize and bind internalNotificationPublisher socket
+//Initialize and bind the metrics interface if metrics should be served
+//A ZMQ STREAM socket which answers HTTP requests with the metrics in the Prometheus text format.  Used by clientAndDatabaseRequestHandlingReactor.
+std::unique_ptr<zmq::socket_t> metricsInterface;
+if(metricsPortNumber != 0)
+{
 SOM_TRY
-internalNotificationPublisher.reset(new zmq::socket_t(*(context), ZMQ_PUB));
-SOM_CATCH("Error intializing internalNotificationPublisher\n")
-
-extensionStringNumber = 0;
-SOM_TRY //Bind to an dynamically generated address
-std::tie(internalNotificationPublisherConnectionString,extensionStringNumber) = bindZMQSocketWithAutomaticAddressGeneration(*internalNotificationPublisher, "internalNotificationPublisher");
-SOM_CATCH("Error binding internalNotificationPublisher\n")
+metricsInterface.reset(new zmq::socket_t(*(context), ZMQ_STREAM));
+SOM_CATCH("Error intializing metricsInterface\n")
 
-//Connect to internal notifications socket to hear internally generated notifications about casters this one is proxying
 SOM_TRY
-proxiesNotificationsListeningSocket->connect(internalNotificationPublisherConnectionString.c_str());
-SOM_CATCH("Error connecting to internal notification publisher\n")
+bindZMQSocketToSharedTCPPort(*metricsInterface, metricsPortNumber, isTakingOverPorts, bindingMaxWaitTime);
+SOM_CATCH("Error binding metricsInterface\n")
+}
 
 //Initialize and connect the statistic reactor's streamStatusNotificationListener
 //A TCP SUB socket used in the statisticsGatheringThread to listen to the streamStatusNotificationInterface
@@ -377,8 +406,9 @@ SOM_TRY
 proxyStreamListener.reset(new zmq::socket_t(*(context), ZMQ_SUB));
 SOM_CATCH("Error intializing proxyStreamListener\n")
 
-SOM_TRY //Set filter to allow any published messages to be received
-proxyStreamListener->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
+SOM_TRY //Subscribe to just the caster ID, which matches every published message but isn't counted as demand for proxied streams (see processProxyStreamSubscription)
+std::string casterIDPrefix = generateStreamSubscriptionPrefix(casterID, 0).substr(0, sizeof(Poco::Int64));
+proxyStreamListener->setsockopt(ZMQ_SUBSCRIBE, (void *) casterIDPrefix.c_str(), casterIDPrefix.size());
 SOM_CATCH("Error setting subscription for socket listening for proxy stream\n")
 
 SOM_TRY 
@@ -386,9 +416,34 @@ std::string connectionAddress = "tcp://127.0.0.1:" + std::to_string(proxyStreamP
 proxyStreamListener->connect(connectionAddress.c_str());
 SOM_CATCH("Error connecting proxyStreamListener socket")
 
+//Initialize and bind the state handoff interface if a replacement caster should be able to take over for this one
+//A ZMQ REP socket which expects a caster_state_handoff_request and responds with a caster_state_handoff_reply.  Used by streamRegistrationAndPublishingReactor.
+std::unique_ptr<zmq::socket_t> stateHandoffInterface;
+if(inputConfiguration.state_handoff_connection_string() != "")
+{
+SOM_TRY
+stateHandoffInterface.reset(new zmq::socket_t(*(context), ZMQ_REP));
+SOM_CATCH("Error intializing stateHandoffInterface\n")
+
+SOM_TRY
+stateHandoffInterface->bind(inputConfiguration.state_handoff_connection_string().c_str());
+SOM_CATCH("Error binding stateHandoffInterface\n")
+
+stateHandoffConnectionString = inputConfiguration.state_handoff_connection_string();
+}
+
+//Load the state of the caster being replaced before any of the reactors start
+std::vector<event> streamRegistrationAndPublishingStartingEvents;
+if(inputConfiguration.previous_caster_state_handoff_connection_string() != "")
+{
+SOM_TRY
+loadStateHandoffReply(previousCasterState, *proxiesUpdatesListeningSocket, *proxiesNotificationsListeningSocket, streamRegistrationAndPublishingStartingEvents);
+SOM_CATCH("Error loading state from previous caster\n")
+}
+
 //Responsible for streamStatusNotificationListener, proxyStreamListener, statisticsDatabaseRequestSocket
 SOM_TRY
-statisticsGatheringReactor.reset(new reactor<caster>(context, this, &caster::handleReactorEvents));
+statisticsGatheringReactor.reset(new reactor<caster>(context, this, &caster::handleReactorEvents, casterTimeSource));
 SOM_CATCH("Error creating reactor\n")
 
 SOM_TRY
@@ -404,7 +459,7 @@ statisticsGatheringReactor->addInterface(statisticsDatabaseRequestSocket, &caste
 SOM_CATCH("Error adding interface to reactor\n")
 
 //Add event to manage the update cycle
-Poco::Timestamp currentTime;
+Poco::Timestamp currentTime = casterTimeSource->now();
 auto timeValue = currentTime.epochMicroseconds();
 update_statistics_event updateEventSubMessage;
 event updateEvent(timeValue + 1000000.0); //Active in 1 second
@@ -418,9 +473,9 @@ statisticsGatheringReactor->start(statisticsStartingEvents);
 SOM_CATCH("Error starting reactor\n")
 
 //Create reactor to handle client requests
-//Responsible for databaseAccessSocket, clientRequestInterface
+//Responsible for databaseAccessSocket, clientRequestInterface, metricsInterface
 SOM_TRY
-clientAndDatabaseRequestHandlingReactor.reset(new reactor<caster>(context, this, &caster::handleReactorEvents));
+clientAndDatabaseRequestHandlingReactor.reset(new reactor<caster>(context, this, &caster::handleReactorEvents, casterTimeSource));
 SOM_CATCH("Error creating reactor\n")
 
 SOM_TRY
@@ -431,15 +486,22 @@ SOM_TRY
 clientAndDatabaseRequestHandlingReactor->addInterface(clientRequestInterface, &caster::processClientQueryRequest, "clientRequestInterface"); //Reactor takes ownership
 SOM_CATCH("Error adding interface to reactor\n")
 
+if(metricsInterface)
+{
+SOM_TRY
+clientAndDatabaseRequestHandlingReactor->addInterface(metricsInterface, &caster::processMetricsRequest, "metricsInterface"); //Reactor takes ownership
+SOM_CATCH("Error adding interface to reactor\n")
+}
+
 SOM_TRY
 clientAndDatabaseRequestHandlingReactor->start();
 SOM_CATCH("Error starting reactor\n")
 
 //Create reactor to handle registrations, key addition/deletion, and update publishing
-//Responsible for transmitterRegistrationAndStreamingInterface, registrationDatabaseRequestSocket, keyRegistrationAndRemovalInterface, addRemoveProxiesSocket, proxiesUpdatesListeningSocket, proxiesNotificationsListeningSocket
+//Responsible for transmitterRegistrationAndStreamingInterface, registrationDatabaseRequestSocket, keyRegistrationAndRemovalInterface, addRemoveProxiesSocket, proxiesUpdatesListeningSocket, proxiesNotificationsListeningSocket, clientStreamPublishingInterface and proxyStreamPublishingInterface (subscriptions)
 //Publishes to clientStreamPublishingInterface, proxyStreamPublishingInterface, streamStatusNotificationInterface
 SOM_TRY
-streamRegistrationAndPublishingReactor.reset(new reactor<caster>(context, this, &caster::handleReactorEvents));
+streamRegistrationAndPublishingReactor.reset(new reactor<caster>(context, this, &caster::handleReactorEvents, casterTimeSource));
 SOM_CATCH("Error creating reactor\n")
 
 SOM_TRY
@@ -467,174 +529,289 @@ SOM_TRY
 streamRegistrationAndPublishingReactor->addInterface(proxiesNotificationsListeningSocket, &caster::listenForProxyNotifications, "proxiesNotificationsListeningSocket"); //Reactor takes ownership
 SOM_CATCH("Error adding interface to reactor\n")
 
+SOM_TRY
+streamRegistrationAndPublishingReactor->addInterface(clientStreamPublishingInterface, &caster::processClientStreamSubscription, "clientStreamPublishingInterface"); //Reactor takes ownership
+SOM_CATCH("Error adding interface to reactor\n")
+
+SOM_TRY
+streamRegistrationAndPublishingReactor->addInterface(proxyStreamPublishingInterface, &caster::processProxyStreamSubscription, "proxyStreamPublishingInterface"); //Reactor takes ownership
+SOM_CATCH("Error adding interface to reactor\n")
+
+if(stateHandoffInterface)
+{
+SOM_TRY
+streamRegistrationAndPublishingReactor->addInterface(stateHandoffInterface, &caster::processStateHandoffRequest, "stateHandoffInterface"); //Reactor takes ownership
+SOM_CATCH("Error adding interface to reactor\n")
+}
 
 SOM_TRY
-streamRegistrationAndPublishingReactor->start();
+streamRegistrationAndPublishingReactor->start(streamRegistrationAndPublishingStartingEvents);
 SOM_CATCH("Error starting reactor\n")
 }
 
 /**
-This thread safe function adds a new caster to proxy.  The function may have some lag as a query needs to be sent to the caster to proxy and the results returned before this function does.
+This thread safe function adds a new caster to proxy and waits until the proxy is established (see addProxyAsync).
 @param inputClientRequestConnectionString: The ZMQ connection string to use to connect to the client query answering port of the caster to proxy
-@param inputBasestationPublishingConnectionString: The ZMQ connection string to use to connect to the interface that publishes the basestation updates
+@param inputBasestationPublishingConnectionString: The ZMQ connection string to use to connect to the interface that publishes the basestation updates (only the streams that local clients or downstream proxies are subscribed to are requested, and both of the foreign caster's stream publishing interfaces pass the subscriptions on through chains of proxies)
 @param inputConnectionDisconnectionNotificationConnectionString: The ZMQ connection string to use to connect to the basestation connect/disconnect notification port on the caster to proxy
 
 @throws: This function can throw exceptions
 */
 void caster::addProxy(const std::string &inputClientRequestConnectionString, const std::string &inputBasestationPublishingConnectionString, const std::string &inputConnectDisconnectNotificationConnectionString)
 {
-//Create request socket to send request to caster threads
-std::unique_ptr<zmq::socket_t> addProxyRequestSocket;
+std::future<void> result;
 SOM_TRY
-addProxyRequestSocket.reset(new zmq::socket_t(*(context), ZMQ_REQ));
-SOM_CATCH("Error intializing addProxyRequestSocket\n")
+result = addProxyAsync(inputClientRequestConnectionString, inputBasestationPublishingConnectionString, inputConnectDisconnectNotificationConnectionString);
+SOM_CATCH("Error starting proxy addition\n")
 
 SOM_TRY
-addProxyRequestSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &PROXY_CLIENT_REQUEST_MAX_WAIT_TIME, sizeof(PROXY_CLIENT_REQUEST_MAX_WAIT_TIME));
-SOM_CATCH("Error setting timeout time\n")
+result.get();
+SOM_CATCH("Error adding proxy\n")
+}
 
-SOM_TRY
-addProxyRequestSocket->connect(addRemoveProxyConnectionString.c_str());
-SOM_CATCH("Error connecting addProxyRequestSocket")
+/**
+This thread safe function starts adding a new caster to proxy and returns without waiting for it.  The caster starts listening to the foreign caster's notifications and updates and then queries it for the metadata of its basestations (retrying with backoff up to PROXY_BOOTSTRAP_MAXIMUM_ATTEMPTS times), registering all of them in one batch.  Any number of proxies can be in the process of being added at once.  Adding a caster which is already proxied succeeds once its first addition has.
+@param inputClientRequestConnectionString: The ZMQ connection string to use to connect to the client query answering port of the caster to proxy
+@param inputBasestationPublishingConnectionString: The ZMQ connection string to use to connect to the interface that publishes the basestation updates (see addProxy)
+@param inputConnectionDisconnectionNotificationConnectionString: The ZMQ connection string to use to connect to the basestation connect/disconnect notification port on the caster to proxy
+@return: A future which becomes ready once the proxy is established (get() throws if it could not be, in which case the caster stops listening to the foreign caster)
 
+@throws: This function can throw exceptions
+*/
+std::future<void> caster::addProxyAsync(const std::string &inputClientRequestConnectionString, const std::string &inputBasestationPublishingConnectionString, const std::string &inputConnectDisconnectNotificationConnectionString)
+{
 //Make request
 add_remove_proxy_request request;
 request.set_client_request_connection_string(inputClientRequestConnectionString);
 request.set_connect_disconnect_notification_connection_string(inputConnectDisconnectNotificationConnectionString);
 request.set_base_station_publishing_connection_string(inputBasestationPublishingConnectionString);
 
-//Get send request/get reply, causing the caster to start listening to the other caster's notifications and updates
-add_remove_proxy_reply reply;
-bool replyReceived = false;
-bool replyDeserializedCorrectly = false;
+std::future<void> result;
+{
+std::lock_guard<std::mutex> lock(proxyOperationPromisesMutex);
+request.set_operation_id(nextProxyOperationID);
+nextProxyOperationID++;
+result = proxyOperationIDToPromise[request.operation_id()].get_future();
+}
+
+//Nothing will report the result if the request isn't accepted
+SOMScopeGuard promiseGuard([&]()
+{
+std::lock_guard<std::mutex> lock(proxyOperationPromisesMutex);
+proxyOperationIDToPromise.erase(request.operation_id());
+});
 
 SOM_TRY
-std::tie(replyReceived, replyDeserializedCorrectly) = remoteProcedureCall(*addProxyRequestSocket, request, reply);
-SOM_CATCH("Error with RPC\n")
+sendAddRemoveProxyRequest(request);
+SOM_CATCH("Error sending add proxy request\n")
 
-if(!replyReceived)
-{
-throw SOMException("Local caster timed out\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+promiseGuard.dismiss();
+return result;
 }
 
-if(!replyDeserializedCorrectly)
+/**
+This thread safe function removes a foreign caster from monitoring by this caster and waits until it has been removed (see removeProxyAsync).
+@param inputClientRequestConnectionString: The ZMQ connection string used to send a query to the foreign caster
+
+@throws: This function can throw exceptions
+*/
+void caster::removeProxy(const std::string &inputClientRequestConnectionString)
 {
-throw SOMException("Invalid response from caster\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+std::future<void> result;
+SOM_TRY
+result = removeProxyAsync(inputClientRequestConnectionString);
+SOM_CATCH("Error starting proxy removal\n")
+
+SOM_TRY
+result.get();
+SOM_CATCH("Error removing proxy\n")
 }
 
-if(reply.has_reason())
-{ //Request failed
-throw SOMException("Invalid response from caster\n", SERVER_REQUEST_FAILED, __FILE__, __LINE__);
+/**
+This thread safe function starts removing a foreign caster from monitoring by this caster and returns without waiting for it.  If the caster is still being added, the addition fails.
+@param inputClientRequestConnectionString: The ZMQ connection string used to send a query to the foreign caster
+@return: A future which becomes ready once the caster has been removed
+
+@throws: This function can throw exceptions
+*/
+std::future<void> caster::removeProxyAsync(const std::string &inputClientRequestConnectionString)
+{
+//Make request
+add_remove_proxy_request request;
+request.set_client_request_connection_string_for_caster_to_remove(inputClientRequestConnectionString);
+
+std::future<void> result;
+{
+std::lock_guard<std::mutex> lock(proxyOperationPromisesMutex);
+request.set_operation_id(nextProxyOperationID);
+nextProxyOperationID++;
+result = proxyOperationIDToPromise[request.operation_id()].get_future();
 }
 
-//Wait for a millisecond or two to allow the subscriptions to take effect
-std::this_thread::sleep_for(std::chrono::milliseconds(2));
+//Nothing will report the result if the request isn't accepted
+SOMScopeGuard promiseGuard([&]()
+{
+std::lock_guard<std::mutex> lock(proxyOperationPromisesMutex);
+proxyOperationIDToPromise.erase(request.operation_id());
+});
+
+SOM_TRY
+sendAddRemoveProxyRequest(request);
+SOM_CATCH("Error sending remove proxy request\n")
 
-//The caster is listening, so it will start registering/forwarding basestations that have registered at the other caster after it started listening.  Removals will be ignored and entries that are removed before the whole set of basestations are registered will have to be removed by timeout
+promiseGuard.dismiss();
+return result;
+}
 
-//Send query to get all of the metadata for the basestations in the other caster
-//Create/connect ephemeral socket to send query to source caster
-std::unique_ptr<zmq::socket_t> ephemeralQuerySocket;
+/**
+This function sends an add_remove_proxy_request to the streamRegistrationAndPublishingReactor and waits for it to be accepted.  The result of the operation is reported through the promise associated with its operation ID.
+@param inputRequest: The request to send
+
+@throws: This function can throw exceptions
+*/
+void caster::sendAddRemoveProxyRequest(const add_remove_proxy_request &inputRequest)
+{
+//Create request socket to send request to caster threads
+std::unique_ptr<zmq::socket_t> addRemoveProxyRequestSocket;
 SOM_TRY
-ephemeralQuerySocket.reset(new zmq::socket_t(*(context), ZMQ_REQ));
-SOM_CATCH("Error intializing ephemeralQuerySocket\n")
+addRemoveProxyRequestSocket.reset(new zmq::socket_t(*(context), ZMQ_REQ));
+SOM_CATCH("Error intializing addRemoveProxyRequestSocket\n")
 
 SOM_TRY
-ephemeralQuerySocket->setsockopt(ZMQ_RCVTIMEO, (void *) &PROXY_CLIENT_REQUEST_MAX_WAIT_TIME, sizeof(PROXY_CLIENT_REQUEST_MAX_WAIT_TIME));
+addRemoveProxyRequestSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &PROXY_CLIENT_REQUEST_MAX_WAIT_TIME, sizeof(PROXY_CLIENT_REQUEST_MAX_WAIT_TIME));
 SOM_CATCH("Error setting timeout time\n")
 
 SOM_TRY
-ephemeralQuerySocket->connect(request.client_request_connection_string().c_str());
-SOM_CATCH("Error connecting ephemeralQuerySocket\n")
+addRemoveProxyRequestSocket->connect(addRemoveProxyConnectionString.c_str());
+SOM_CATCH("Error connecting addRemoveProxyRequestSocket")
 
-client_query_request queryRequest;
-client_query_reply queryReply;
+//Send request/get reply, which the caster sends as soon as it has started the operation
+add_remove_proxy_reply reply;
+bool replyReceived = false;
+bool replyDeserializedCorrectly = false;
 
 SOM_TRY
-std::tie(replyReceived, replyDeserializedCorrectly) = remoteProcedureCall(*ephemeralQuerySocket, queryRequest, queryReply);
+std::tie(replyReceived, replyDeserializedCorrectly) = remoteProcedureCall(*addRemoveProxyRequestSocket, inputRequest, reply);
 SOM_CATCH("Error with RPC\n")
 
-if(!replyReceived || !replyDeserializedCorrectly)
+if(!replyReceived)
 {
-throw SOMException("Invalid response from caster\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+throw SOMException("Local caster timed out\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
 }
 
-if(queryReply.has_failure_reason() || !queryReply.has_caster_id())
+if(!replyDeserializedCorrectly)
 {
-throw SOMException("Query to caster to proxy failed\n", SERVER_REQUEST_FAILED, __FILE__, __LINE__);
+throw SOMException("Invalid response from caster\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
 }
 
-//Publish all basestations on the internal proxy notification socket
-int64_t foreignCasterID = queryReply.caster_id();
-Poco::Int64 header[2] = {0, 0};
-header[0] = Poco::ByteOrder::toNetwork(Poco::Int64(foreignCasterID));
-for(int i=0; i < queryReply.base_stations_size(); i++)
-{
-//Make status update message
-base_station_stream_information *basestation = queryReply.mutable_base_stations(i);
+if(reply.has_reason())
+{ //Request failed
+throw SOMException("Invalid response from caster\n", SERVER_REQUEST_FAILED, __FILE__, __LINE__);
+}
+}
 
-if(!basestation->has_base_station_id())
+/**
+This function reports the result of an addProxyAsync/removeProxyAsync operation to the caller.  Operation IDs without a waiting caller are ignored.
+@param inputOperationID: The ID of the operation
+@param inputFailureMessage: Why the operation failed (empty if it succeeded)
+*/
+void caster::completeProxyOperation(int64_t inputOperationID, const std::string &inputFailureMessage)
 {
-throw SOMException("Caster returned base station without id\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+std::lock_guard<std::mutex> lock(proxyOperationPromisesMutex);
+if(proxyOperationIDToPromise.count(inputOperationID) == 0)
+{
+return;
 }
 
-int64_t baseStationID = basestation->base_station_id();
-header[1] = Poco::ByteOrder::toNetwork(Poco::Int64(baseStationID));
-
-stream_status_update updateMessage;
-*updateMessage.mutable_new_base_station_info() = *basestation;
-
-//Send notification with caster ID and stream ID preappended
-SOM_TRY
-sendProtobufMessage(*internalNotificationPublisher, updateMessage, std::string((const char *) header, sizeof(Poco::Int64)*2));
-SOM_CATCH("Error sending notification\n")
+if(inputFailureMessage.size() == 0)
+{
+proxyOperationIDToPromise.at(inputOperationID).set_value();
+}
+else
+{
+proxyOperationIDToPromise.at(inputOperationID).set_exception(std::make_exception_ptr(SOMException(inputFailureMessage, SERVER_REQUEST_FAILED, __FILE__, __LINE__)));
 }
 
-//The caster has been subscribed to an all basestation metadata retrieved, so the proxy is established
+proxyOperationIDToPromise.erase(inputOperationID);
 }
 
 /**
-This thread safe function removes a foreign caster from monitoring by this caster.
-@param inputClientRequestConnectionString: The ZMQ connection string used to send a query to the foreign caster
+This thread safe function returns true if the caster has handed off its state to a replacement caster.  Once that happens (and the ports have been released, if the replacement asked for them), the caster has no connections left to serve and can be shut down.
+@return: true if the state has been handed off
+*/
+bool caster::hasHandedOffState()
+{
+return stateHasBeenHandedOff;
+}
 
-@throws: This function can throw exceptions
+/**
+This thread safe function returns how many client subscriptions there currently are for each of the streams published by this caster (only streams with at least one subscription are included).  Subscriptions which match every stream of this caster are not included (see getAllClientStreamsSubscriberCount).
+@return: A map of localStreamID -> number of subscriptions
 */
-void caster::removeProxy(const std::string &inputClientRequestConnectionString)
+std::map<int64_t, int64_t> caster::getClientStreamSubscriberCounts()
 {
-//Create request socket to send request to caster
-std::unique_ptr<zmq::socket_t> addProxyRequestSocket;
-SOM_TRY
-addProxyRequestSocket.reset(new zmq::socket_t(*(context), ZMQ_REQ));
-SOM_CATCH("Error intializing addProxyRequestSocket\n")
+std::lock_guard<std::mutex> lock(clientStreamSubscriberCountsMutex);
+return localStreamIDToClientSubscriberCount;
+}
 
-SOM_TRY
-addProxyRequestSocket->connect(addRemoveProxyConnectionString.c_str());
-SOM_CATCH("Error connecting addProxyRequestSocket")
+/**
+This thread safe function returns how many client subscriptions there currently are which match every stream published by this caster (such as an empty subscription or one to just the caster ID).
+@return: The number of subscriptions
+*/
+int64_t caster::getAllClientStreamsSubscriberCount()
+{
+std::lock_guard<std::mutex> lock(clientStreamSubscriberCountsMutex);
+return allClientStreamsSubscriberCount;
+}
 
-//Make request
-add_remove_proxy_request request;
-request.set_client_request_connection_string_for_caster_to_remove(inputClientRequestConnectionString);
+/**
+This thread safe function returns how many messages have been dropped for each stream because the transmitter exceeded its rate limit or the global ingest budget was used up (only streams with drops are included).
+@return: A map of localStreamID -> number of dropped messages
+*/
+std::map<int64_t, uint64_t> caster::getStreamIngestDropCounts()
+{
+std::map<int64_t, uint64_t> dropCounts;
 
-//Get send request/get reply, causing the caster to stop listening to the other caster's notifications and updates
-add_remove_proxy_reply reply;
-bool replyReceived = false;
-bool replyDeserializedCorrectly = false;
+std::lock_guard<std::mutex> lock(ingestDropCountsMutex);
+for(const auto &streamIDAndCount : localStreamIDToNumberOfDroppedMessages)
+{
+dropCounts[streamIDAndCount.first] = streamIDAndCount.second.load(std::memory_order_relaxed);
+}
 
-SOM_TRY
-std::tie(replyReceived, replyDeserializedCorrectly) = remoteProcedureCall(*addProxyRequestSocket, request, reply);
-SOM_CATCH("Error with RPC\n")
+return dropCounts;
+}
 
-if(!replyReceived || !replyDeserializedCorrectly)
+/**
+This thread safe function returns how many messages of each station class have been published/dropped/are waiting and how long the published ones waited.
+@return: A map of station class -> publishing counters
+*/
+std::map<base_station_class, stationClassPublishingStatistics> caster::getStationClassPublishingStatistics()
+{ //The map itself isn't changed after construction, so only the counters are shared
+std::map<base_station_class, stationClassPublishingStatistics> statistics;
+for(const auto &classAndQueue : stationClassToPublishingQueue)
 {
-throw SOMException("Invalid response from caster\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+statistics[classAndQueue.first] = classAndQueue.second.getStatistics();
 }
 
-if(reply.has_reason())
-{ //Request failed
-throw SOMException("Invalid response from caster\n", SERVER_REQUEST_FAILED, __FILE__, __LINE__);
+return statistics;
 }
 
-//All of the basestations from the foreign caster will timeout shortly because it will no longer receive updates for them
+/**
+This thread safe function returns the latency histograms of the traced messages this caster has published.  Hop times come from the monotonic clock, so only traces from transmitters/casters on the same machine are meaningful.
+@return: The histograms
+*/
+latency_trace_report caster::getLatencyTraceReport()
+{
+return publishedMessageTracer.getReport();
+}
+
+/**
+This thread safe function returns the caster's metrics (connections by class, messages/bytes in and out, signature failures, event queue sizes, database request/query latency histograms, proxy counts and lag) in the Prometheus text exposition format.  This is what is served on the metrics port.
+@return: The metrics
+*/
+std::string caster::getPrometheusMetrics()
+{
+return metrics.generatePrometheusText(casterTimeSource->now().epochMicroseconds());
 }
 
 /**
@@ -660,48 +837,376 @@ fprintf(stderr, "%s", inputException.what());
 
 
 /**
-This function processes any events that are scheduled to have occurred by now and returns when the next event is scheduled to occur.
-@param inputReactor: The reactor to process events for
-@return: The time point associated with the soonest event timeout (negative if there are no outstanding events)
+This function sends a caster_state_handoff_request to the caster being replaced and waits for its state.  The caster being replaced keeps its listening sockets, which share their ports with this caster's (see bindZMQSocketToSharedTCPPort), and serves its existing connections until it shuts down.
+@param inputPreviousCasterStateHandoffConnectionString: The address of the state handoff interface of the caster being replaced
+@param inputStateBuffer: The message to store the retrieved state in
 
 @throws: This function can throw exceptions
 */
-Poco::Timestamp caster::handleReactorEvents(reactor<caster> &inputReactor)
+void caster::retrieveStateFromPreviousCaster(const std::string &inputPreviousCasterStateHandoffConnectionString, caster_state_handoff_reply &inputStateBuffer)
 {
-while(true)
-{//Process an event if its time is less than the current timestamp
-
-if(inputReactor.eventQueue.size() == 0)
-{//No events left, so return negative
-return Poco::Timestamp(-1);
-}
+//Create request socket to send request to the caster being replaced
+std::unique_ptr<zmq::socket_t> stateHandoffRequestSocket;
+SOM_TRY
+stateHandoffRequestSocket.reset(new zmq::socket_t(*(context), ZMQ_REQ));
+SOM_CATCH("Error intializing stateHandoffRequestSocket\n")
 
-Poco::Timestamp currentTime;
-auto timeValue = currentTime.epochMicroseconds();
+SOM_TRY
+stateHandoffRequestSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &STATE_HANDOFF_MAX_WAIT_TIME, sizeof(STATE_HANDOFF_MAX_WAIT_TIME));
+SOM_CATCH("Error setting timeout time\n")
 
-if(inputReactor.eventQueue.top().time > currentTime )
-{ //Next event isn't happening yet
-return inputReactor.eventQueue.top().time;
-}
+SOM_TRY
+stateHandoffRequestSocket->connect(inputPreviousCasterStateHandoffConnectionString.c_str());
+SOM_CATCH("Error connecting stateHandoffRequestSocket\n")
 
-//There is an event to process
-event eventToProcess = inputReactor.eventQueue.top();
-inputReactor.eventQueue.pop(); //Remove event from queue
+caster_state_handoff_request request;
+request.set_caster_id(casterID);
 
+bool replyReceived = false;
+bool replyDeserializedCorrectly = false;
 
-//Process events
-if(eventToProcess.HasExtension(possible_base_station_event_timeout::possible_base_station_event_timeout_field))
-{ //possible_base_station_event_timeout
-possible_base_station_event_timeout eventInstance = eventToProcess.GetExtension(possible_base_station_event_timeout::possible_base_station_event_timeout_field);
+SOM_TRY
+std::tie(replyReceived, replyDeserializedCorrectly) = remoteProcedureCall(*stateHandoffRequestSocket, request, inputStateBuffer);
+SOM_CATCH("Error with RPC\n")
 
-if((connectionIDToConnectionStatus.at(eventInstance.connection_id()).timeLastMessageWasReceived.epochMicroseconds() + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0) <= eventToProcess.time.epochMicroseconds())
-{//It has been more than SECONDS_BEFORE_CONNECTION_TIMEOUT since a message was received, so drop connection
-if(eventInstance.is_authenticated())
+if(!replyReceived)
 {
-SOM_TRY //Remove from database
+throw SOMException("Previous caster timed out\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+}
+
+if(!replyDeserializedCorrectly)
+{
+throw SOMException("Invalid response from previous caster\n", AN_ASSUMPTION_WAS_VIOLATED_ERROR, __FILE__, __LINE__);
+}
+
+if(inputStateBuffer.has_failure_reason())
+{ //Request failed
+throw SOMException("Previous caster refused state handoff (" + std::to_string((int) inputStateBuffer.failure_reason()) + ")\n", SERVER_REQUEST_FAILED, __FILE__, __LINE__);
+}
+}
+
+/**
+This function loads the state retrieved from a caster being replaced into the maps/sets and the database.  It is called in commonConstructor before the reactors are started.
+@param inputState: The state to load
+@param inputProxiesUpdatesListeningSocket: The socket to connect to the update publishers of the proxied casters
+@param inputProxiesNotificationsListeningSocket: The socket to connect to the notification publishers of the proxied casters
+@param inputStartingEventsBuffer: The vector to add the events the streamRegistrationAndPublishingReactor should start with to
+
+@throws: This function can throw exceptions
+*/
+void caster::loadStateHandoffReply(const caster_state_handoff_reply &inputState, zmq::socket_t &inputProxiesUpdatesListeningSocket, zmq::socket_t &inputProxiesNotificationsListeningSocket, std::vector<event> &inputStartingEventsBuffer)
+{
+Poco::Timestamp currentTime = casterTimeSource->now();
+auto timeValue = currentTime.epochMicroseconds();
+
+//The previous caster keeps serving the connections until it shuts down, so give their peers time to drain and reconnect here before they can time out
+int64_t handedOffConnectionLastMessageTime = timeValue + (STATE_HANDOFF_DRAIN_TIME + STATE_HANDOFF_RECONNECT_TIME)*1000000.0;
+
+//Don't reuse stream IDs
+if(inputState.last_assigned_stream_id() > lastAssignedConnectionID)
+{
+lastAssignedConnectionID = inputState.last_assigned_stream_id();
+}
+
+//Add keys
+for(int i=0; i<inputState.official_signing_keys_size(); i++)
+{
+officialSigningKeys.insert(inputState.official_signing_keys(i));
+}
+
+for(int i=0; i<inputState.registered_community_signing_keys_size(); i++)
+{
+registeredCommunitySigningKeys.insert(inputState.registered_community_signing_keys(i));
+}
+
+for(int i=0; i<inputState.blacklisted_keys_size(); i++)
+{
+blacklistedSigningKeys.insert(inputState.blacklisted_keys(i));
+}
+verifiedCredentials.clear();
+
+for(int i=0; i<inputState.connection_keys_size(); i++)
+{
+uint32_t connectionKeyNodeID = authenticationKeys.addNode(CONNECTION_KEY_NODE, inputState.connection_keys(i).connection_key());
+for(int a=0; a<inputState.connection_keys(i).signing_keys_size(); a++)
+{
+authenticationKeys.addEdge(authenticationKeys.addNode(SIGNING_KEY_NODE, inputState.connection_keys(i).signing_keys(a)), connectionKeyNodeID);
+}
+}
+
+//Restore pending key expirations
+for(int i=0; i<inputState.key_expiration_events_size(); i++)
+{
+event restoredEvent(inputState.key_expiration_events(i).time());
+restoredEvent.CopyFrom(inputState.key_expiration_events(i).event());
+
+inputStartingEventsBuffer.push_back(restoredEvent);
+}
+
+//Add the catalog to the database
+std::map<int64_t, int> baseStationIDToIndex; //Used to set the ingest limits of the connections
+for(int i=0; i<inputState.base_stations_size(); i++)
+{
+base_station_stream_information baseStation = inputState.base_stations(i);
+baseStation.clear_uptime();
+baseStationIDToIndex[baseStation.base_station_id()] = i;
+
+SOM_TRY
+basestationToSQLInterface->store(baseStation);
+SOM_CATCH("Error inserting basestation to database\n")
+localStreamIDToCatalogEntry[baseStation.base_station_id()] = baseStation;
+
+basestationIDToCreationTime[baseStation.base_station_id()] = timeValue;
+basestationIDToNumberOfSentMessages[baseStation.base_station_id()] = 0;
+}
+
+//Add connections and schedule their timeouts
+for(int i=0; i<inputState.connections_size(); i++)
+{
+const transmitter_connection_state &connection = inputState.connections(i);
+
+connectionStatus associatedConnectionStatus;
+associatedConnectionStatus.hasBeenRegistered = true;
+associatedConnectionStatus.requestToTheDatabaseHasBeenSent = true;
+associatedConnectionStatus.baseStationID = connection.base_station_id();
+associatedConnectionStatus.timeLastMessageWasReceived = handedOffConnectionLastMessageTime;
+associatedConnectionStatus.sendsStreamFrameHeaders = connection.sends_stream_frame_headers();
+if(baseStationIDToIndex.count(connection.base_station_id()) > 0)
+{
+setConnectionIngestLimits(associatedConnectionStatus, inputState.base_stations(baseStationIDToIndex.at(connection.base_station_id())), timeValue);
+associatedConnectionStatus.stationClass = inputState.base_stations(baseStationIDToIndex.at(connection.base_station_id())).station_class();
+}
+if(connectionIDToConnectionStatus.count(connection.connection_id()) == 0)
+{ //Don't double count a connection that is being overwritten
+metrics.changeNumberOfConnections(associatedConnectionStatus.stationClass, 1);
+}
+connectionIDToConnectionStatus[connection.connection_id()] = associatedConnectionStatus;
+
+if(connection.has_connection_key())
+{
+authenticationKeys.addEdge(authenticationKeys.addNode(CONNECTION_KEY_NODE, connection.connection_key()), authenticationKeys.addNode(AUTHENTICATED_CONNECTION_NODE, connection.connection_id()));
+}
+
+inputStartingEventsBuffer.push_back(createConnectionTimeoutEvent(connection.connection_id(), connection.has_connection_key(), handedOffConnectionLastMessageTime + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0, connectionIDToConnectionStatus.at(connection.connection_id())));
+}
+
+//Reconnect to the proxied casters
+for(int i=0; i<inputState.proxies_size(); i++)
+{
+const add_remove_proxy_request &proxy = inputState.proxies(i);
+
+SOM_TRY
+inputProxiesNotificationsListeningSocket.connect(proxy.connect_disconnect_notification_connection_string().c_str());
+SOM_CATCH("Error connecting proxiesNotificationsListeningSocket\n")
+
+SOM_TRY
+inputProxiesUpdatesListeningSocket.connect(proxy.base_station_publishing_connection_string().c_str());
+SOM_CATCH("Error connecting update listening socket\n")
+
+clientRequestConnectionStringToCasterConnectionStrings.emplace(proxy.client_request_connection_string(), std::tuple<std::string, std::string, std::string>(proxy.client_request_connection_string(), proxy.connect_disconnect_notification_connection_string(), proxy.base_station_publishing_connection_string()));
+}
+
+for(int i=0; i<inputState.proxy_streams_size(); i++)
+{
+const proxy_stream_translation &translation = inputState.proxy_streams(i);
+
+proxyStreamTableEntry *proxyStream = proxyStreams.insert(translation.foreign_caster_id(), translation.foreign_stream_id(), translation.local_stream_id());
+if(proxyStream == nullptr)
+{ //Duplicate translation
+continue;
+}
+
+foreignCasterIDToNumberOfProxiedStreams[translation.foreign_caster_id()]++;
+localBasestationIDToForeignCasterIDAndStreamID[translation.local_stream_id()] = std::pair<int64_t, int64_t>(translation.foreign_caster_id(), translation.foreign_stream_id());
+proxyStream->lastMessageTime = handedOffConnectionLastMessageTime;
+proxyStream->foreignCasterAddsStreamFrameHeaders = translation.foreign_caster_adds_stream_frame_headers();
+if(baseStationIDToIndex.count(translation.local_stream_id()) > 0)
+{
+proxyStream->stationClass = inputState.base_stations(baseStationIDToIndex.at(translation.local_stream_id())).station_class();
+}
+
+inputStartingEventsBuffer.push_back(createProxyStreamTimeoutEvent(*proxyStream, handedOffConnectionLastMessageTime + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0));
+}
+
+metrics.numberOfProxiedCasters.store(clientRequestConnectionStringToCasterConnectionStrings.size(), std::memory_order_relaxed);
+metrics.numberOfProxiedStreams.store(proxyStreams.size(), std::memory_order_relaxed);
+}
+
+/**
+This function sets the ingest rate limit of a connection based on the expected update rate it declared and whether it is exempt from the global ingest budget based on its class.
+@param inputConnectionStatus: The status of the connection to set the limits of
+@param inputStreamInfo: The information the connection registered with
+@param inputCurrentTime: The current time (microseconds since the epoch)
+*/
+void caster::setConnectionIngestLimits(connectionStatus &inputConnectionStatus, const base_station_stream_information &inputStreamInfo, Poco::Timestamp::TimeVal inputCurrentTime)
+{
+double expectedUpdateRate = MINIMUM_INGEST_RATE;
+if(inputStreamInfo.has_expected_update_rate())
+{
+expectedUpdateRate = std::max(inputStreamInfo.expected_update_rate(), MINIMUM_INGEST_RATE);
+}
+
+inputConnectionStatus.ingestRateLimiter = tokenBucket(expectedUpdateRate*INGEST_RATE_LIMIT_MULTIPLIER, ingestBurstSize, inputCurrentTime);
+inputConnectionStatus.isExemptFromGlobalIngestLimit = inputStreamInfo.station_class() == OFFICIAL;
+}
+
+/**
+This function makes the timeout event for a connection and records it as the connection's one pending timeout (any event scheduled for it before is ignored when it fires).  Messages from the connection only update its last message time, so the event queue holds one timeout per connection rather than one per message.
+@param inputConnectionID: The connection to schedule the timeout for
+@param inputIsAuthenticated: True if the connection is authenticated
+@param inputTimeoutTime: When the timeout should be checked (microseconds since the epoch)
+@param inputConnectionStatus: The status of the connection (its timeoutEventTime is set)
+@return: The event, which should be added to the event queue
+*/
+event caster::createConnectionTimeoutEvent(const std::string &inputConnectionID, bool inputIsAuthenticated, Poco::Timestamp::TimeVal inputTimeoutTime, connectionStatus &inputConnectionStatus)
+{
+possible_base_station_event_timeout timeoutEventSubMessage;
+timeoutEventSubMessage.set_connection_id(inputConnectionID);
+timeoutEventSubMessage.set_is_authenticated(inputIsAuthenticated);
+
+event timeoutEvent(inputTimeoutTime);
+(*timeoutEvent.MutableExtension(possible_base_station_event_timeout::possible_base_station_event_timeout_field)) = timeoutEventSubMessage;
+
+inputConnectionStatus.timeoutEventTime = inputTimeoutTime;
+
+return timeoutEvent;
+}
+
+/**
+This function makes the timeout event for a proxied stream and records it as the stream's one pending timeout (any event scheduled for it before is ignored when it fires).
+@param inputProxyStream: The proxyStreams entry of the stream (its timeoutEventTime is set)
+@param inputTimeoutTime: When the timeout should be checked (microseconds since the epoch)
+@return: The event, which should be added to the event queue
+*/
+event caster::createProxyStreamTimeoutEvent(proxyStreamTableEntry &inputProxyStream, Poco::Timestamp::TimeVal inputTimeoutTime)
+{
+possible_proxy_stream_timeout_event timeoutEventSubMessage;
+timeoutEventSubMessage.set_caster_id(inputProxyStream.foreignCasterID);
+timeoutEventSubMessage.set_stream_id(inputProxyStream.foreignStreamID);
+
+event timeoutEvent(inputTimeoutTime);
+(*timeoutEvent.MutableExtension(possible_proxy_stream_timeout_event::possible_proxy_stream_timeout_event_field)) = timeoutEventSubMessage;
+
+inputProxyStream.timeoutEventTime = inputTimeoutTime;
+
+return timeoutEvent;
+}
+
+/**
+This function decides if the next message ingested by the caster should be sampled for latency tracing (one of every traceSamplingInterval messages).
+@return: true if the message should be traced
+*/
+bool caster::shouldSampleMessageForTracing()
+{
+if(!addStreamFrameHeaders || traceSamplingInterval == 0)
+{
+return false;
+}
+
+bool sampleMessage = (numberOfMessagesSinceLastTraceSample % traceSamplingInterval) == 0;
+numberOfMessagesSinceLastTraceSample++;
+return sampleMessage;
+}
+
+/**
+This function processes any events that are scheduled to have occurred by now and returns when the next event is scheduled to occur.  When called by the streamRegistrationAndPublishingReactor, it first publishes queued stream messages (see publishQueuedMessages) and flushes queued catalog writes (see flushCatalogWrites).
+@param inputReactor: The reactor to process events for
+@return: The time point associated with the soonest event timeout (negative if there are no outstanding events, the current time if events have queued catalog writes).  Messages left waiting to be published don't make it return early, since they are only left when stream data is waiting to be received (which wakes the reactor's poll)
+
+@throws: This function can throw exceptions
+*/
+Poco::Timestamp caster::handleReactorEvents(reactor<caster> &inputReactor)
+{
+//Record how many events are waiting and how much memory they use when this returns (the reactor is identified by an interface only it has)
+std::atomic<uint64_t> *eventQueueSizeGauge = &metrics.statisticsGatheringEventQueueSize;
+std::atomic<uint64_t> *eventQueueBytesGauge = &metrics.statisticsGatheringEventQueueBytes;
+if(inputReactor.nameToSocket.count("clientStreamPublishingInterface") > 0)
+{
+eventQueueSizeGauge = &metrics.streamRegistrationAndPublishingEventQueueSize;
+eventQueueBytesGauge = &metrics.streamRegistrationAndPublishingEventQueueBytes;
+}
+else if(inputReactor.nameToSocket.count("databaseAccessSocket") > 0)
+{
+eventQueueSizeGauge = &metrics.clientAndDatabaseRequestHandlingEventQueueSize;
+eventQueueBytesGauge = &metrics.clientAndDatabaseRequestHandlingEventQueueBytes;
+}
+SOMScopeGuard eventQueueSizeGuard([&]()
+{
+eventQueueSizeGauge->store(inputReactor.eventQueue.size(), std::memory_order_relaxed);
+eventQueueBytesGauge->store(inputReactor.eventQueue.getMemoryUsage(), std::memory_order_relaxed);
+});
+
+//Publish the messages that were queued since the last call (only the streamRegistrationAndPublishingReactor has the publishing interface)
+bool isStreamRegistrationAndPublishingReactor = inputReactor.nameToSocket.count("clientStreamPublishingInterface") > 0;
+if(isStreamRegistrationAndPublishingReactor)
+{
+SOM_TRY
+publishQueuedMessages(inputReactor);
+SOM_CATCH("Error publishing queued messages\n")
+
+SOM_TRY //Everything handled since the last call goes to the database in one request
+flushCatalogWrites(inputReactor);
+SOM_CATCH("Error flushing catalog writes\n")
+}
+
+while(true)
+{//Process an event if its time is less than the current timestamp
+bool catalogWritesArePending = isStreamRegistrationAndPublishingReactor && (pendingCatalogWrites.base_stations_to_register_size() > 0 || pendingCatalogWrites.delete_base_station_ids_size() > 0);
+
+if(catalogWritesArePending && (inputReactor.eventQueue.size() == 0 || inputReactor.eventQueue.top().time > casterTimeSource->now()))
+{ //Come back as soon as possible to flush the writes queued by the events processed in this call
+return casterTimeSource->now();
+}
+
+if(inputReactor.eventQueue.size() == 0)
+{//No events left, so return negative
+return Poco::Timestamp(-1);
+}
+
+Poco::Timestamp currentTime = casterTimeSource->now();
+auto timeValue = currentTime.epochMicroseconds();
+
+if(inputReactor.eventQueue.top().time > currentTime )
+{ //Next event isn't happening yet
+return inputReactor.eventQueue.top().time;
+}
+
+//There is an event to process
+event eventToProcess = inputReactor.eventQueue.top();
+inputReactor.eventQueue.pop(); //Remove event from queue
+recordTraceEvent(TRACE_EVENT_FIRED, eventToProcess.time.epochMicroseconds(), inputReactor.eventQueue.size());
+
+
+//Process events
+if(eventToProcess.HasExtension(possible_base_station_event_timeout::possible_base_station_event_timeout_field))
+{ //possible_base_station_event_timeout
+possible_base_station_event_timeout eventInstance = eventToProcess.GetExtension(possible_base_station_event_timeout::possible_base_station_event_timeout_field);
+
+if(connectionIDToConnectionStatus.count(eventInstance.connection_id()) == 0)
+{ //Connection has already been removed
+continue;
+}
+
+connectionStatus &timedConnectionStatus = connectionIDToConnectionStatus.at(eventInstance.connection_id());
+if(timedConnectionStatus.timeoutEventTime != eventToProcess.time.epochMicroseconds())
+{ //The connection was registered again, so a later event is responsible for it
+continue;
+}
+
+Poco::Timestamp::TimeVal connectionTimeoutTime = timedConnectionStatus.timeLastMessageWasReceived.epochMicroseconds() + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0;
+if(connectionTimeoutTime > eventToProcess.time.epochMicroseconds())
+{ //A message has been received since the event was scheduled, so check again SECONDS_BEFORE_CONNECTION_TIMEOUT after the last one
+inputReactor.eventQueue.push(createConnectionTimeoutEvent(eventInstance.connection_id(), eventInstance.is_authenticated(), connectionTimeoutTime, timedConnectionStatus));
+continue;
+}
+
+//It has been more than SECONDS_BEFORE_CONNECTION_TIMEOUT since a message was received, so drop connection
+recordTraceEvent(TRACE_CONNECTION_TIMED_OUT, timedConnectionStatus.baseStationID, timedConnectionStatus.timeLastMessageWasReceived.epochMicroseconds());
+if(eventInstance.is_authenticated())
+{
+SOM_TRY //Remove from database
 removeAuthenticatedConnection(eventInstance.connection_id(), inputReactor);
 SOM_CATCH("Error, unable to remove authenticated connection\n")
-continue;
 }
 else
 {
@@ -709,13 +1214,13 @@ SOM_TRY
 removeUnauthenticatedConnection(eventInstance.connection_id(), inputReactor);
 SOM_CATCH("Error, unable to remove unauthenticated connection\n")
 }
-}
-
+continue;
 }
  
 if(eventToProcess.HasExtension(blacklist_key_timeout_event::blacklist_key_timeout_event_field))
 { //Blacklist entry timed out, so simply remove the key from the blacklist
 blacklistedSigningKeys.erase(eventToProcess.GetExtension(blacklist_key_timeout_event::blacklist_key_timeout_event_field).blacklist_key());
+verifiedCredentials.clear();
 continue;
 }
 
@@ -761,7 +1266,7 @@ SOM_CATCH("Error sending database request\n")
 };
 
 
-Poco::Timestamp currentTime;
+Poco::Timestamp currentTime = casterTimeSource->now();
 auto timeValue = currentTime.epochMicroseconds();
 
 if(basestationIDToCreationTime.size() < UPDATE_RATES_TO_UPDATE_PER_SECOND)
@@ -821,39 +1326,122 @@ if(eventToProcess.HasExtension(possible_proxy_stream_timeout_event::possible_pro
 { //Check if a proxy stream has timed out and delete it if so
 int64_t foreignCasterID = eventToProcess.GetExtension(possible_proxy_stream_timeout_event::possible_proxy_stream_timeout_event_field).caster_id();
 int64_t foreignStreamID = eventToProcess.GetExtension(possible_proxy_stream_timeout_event::possible_proxy_stream_timeout_event_field).stream_id();
-int64_t localStreamID = 0;
 
-//Ignore timeout if the foreign stream isn't in the map
-if(casterIDToMapFromOriginalBasestationIDToLocalBasestationID.count(foreignCasterID) != 0)
-{
-if(casterIDToMapFromOriginalBasestationIDToLocalBasestationID.at(foreignCasterID).count(foreignStreamID) == 0)
+//Ignore timeout if the foreign stream isn't in the table
+proxyStreamTableEntry *proxyStream = proxyStreams.find(foreignCasterID, foreignStreamID);
+if(proxyStream == nullptr)
 {
 continue;
 }
-}
-else
-{
+
+if(proxyStream->timeoutEventTime != eventToProcess.time.epochMicroseconds())
+{ //A later event is responsible for the stream
 continue;
 }
 
-localStreamID = casterIDToMapFromOriginalBasestationIDToLocalBasestationID.at(foreignCasterID).at(foreignStreamID);
+Poco::Timestamp::TimeVal streamTimeoutTime = proxyStream->lastMessageTime + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0;
+if(!proxyStreamIsSubscribedUpstream(foreignCasterID, foreignStreamID))
+{ //Updates aren't being received for streams no local client wants, so rely on the foreign caster's removal notifications instead (its last message time is reset when it is subscribed to)
+streamTimeoutTime = eventToProcess.time.epochMicroseconds() + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0;
+}
 
-if(localBasestationIDToLastMessageTimestamp.count(localStreamID) == 0)
-{
+if(streamTimeoutTime > eventToProcess.time.epochMicroseconds())
+{ //Still alive, so check again SECONDS_BEFORE_CONNECTION_TIMEOUT after the last message
+inputReactor.eventQueue.push(createProxyStreamTimeoutEvent(*proxyStream, streamTimeoutTime));
 continue;
 }
 
-Poco::Timestamp currentTime;
-
-if((currentTime - eventToProcess.time) > SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0)
-{ //Delete basestation
+//Delete basestation
+recordTraceEvent(TRACE_PROXY_STREAM_TIMED_OUT, foreignCasterID, foreignStreamID);
 SOM_TRY
 deleteProxyStream(inputReactor, foreignCasterID, foreignStreamID, BASE_STATION_TIMED_OUT);
 SOM_CATCH("Error removing proxy basestation\n")
-}  
 
 }//end possible_proxy_stream_timeout_event
 
+if(eventToProcess.HasExtension(possible_add_remove_socket_query_timeout_event::possible_add_remove_socket_query_timeout_event_field))
+{ //Give up on a query to a caster being added as a proxy if it is still waiting for the reply
+std::string socketPointerString = eventToProcess.GetExtension(possible_add_remove_socket_query_timeout_event::possible_add_remove_socket_query_timeout_event_field).ephemeral_socket_pointer();
+if(socketPointerString.size() != sizeof(zmq::socket_t *))
+{
+continue;
+}
+
+zmq::socket_t *querySocket = nullptr;
+memcpy((void *) &querySocket, socketPointerString.c_str(), sizeof(querySocket));
+
+if(proxyQuerySocketToClientRequestConnectionString.count(querySocket) == 0)
+{ //Already answered
+continue;
+}
+
+std::string clientRequestConnectionString = proxyQuerySocketToClientRequestConnectionString.at(querySocket);
+proxyBootstrapStatus &bootstrapStatus = clientRequestConnectionStringToProxyBootstrapStatus.at(clientRequestConnectionString);
+if(bootstrapStatus.eventTime != eventToProcess.time.epochMicroseconds())
+{ //The timeout of an earlier socket which had the same address
+continue;
+}
+
+proxyQuerySocketToClientRequestConnectionString.erase(querySocket);
+bootstrapStatus.querySocket = nullptr;
+
+SOM_TRY
+inputReactor.removeInterface(querySocket);
+SOM_CATCH("Error removing proxy query socket\n")
+
+SOM_TRY
+handleFailedProxyBootstrapQuery(inputReactor, clientRequestConnectionString, "Caster to proxy timed out\n");
+SOM_CATCH("Error handling failed proxy query\n")
+continue;
+}
+
+if(eventToProcess.HasExtension(proxy_bootstrap_retry_event::proxy_bootstrap_retry_event_field))
+{ //Query a caster being added as a proxy again
+std::string clientRequestConnectionString = eventToProcess.GetExtension(proxy_bootstrap_retry_event::proxy_bootstrap_retry_event_field).client_request_connection_string();
+
+if(clientRequestConnectionStringToProxyBootstrapStatus.count(clientRequestConnectionString) == 0)
+{ //Removed in the meantime
+continue;
+}
+
+if(clientRequestConnectionStringToProxyBootstrapStatus.at(clientRequestConnectionString).eventTime != eventToProcess.time.epochMicroseconds())
+{ //A later event is responsible for the proxy
+continue;
+}
+
+SOM_TRY
+sendProxyBootstrapQuery(inputReactor, clientRequestConnectionString);
+SOM_CATCH("Error querying caster to proxy\n")
+continue;
+}
+
+if(eventToProcess.HasExtension(proxy_upstream_unsubscribe_event::proxy_upstream_unsubscribe_event_field))
+{ //Drop the upstream subscription if no local client has subscribed to the stream again during the linger period
+std::string subscriptionPrefix = eventToProcess.GetExtension(proxy_upstream_unsubscribe_event::proxy_upstream_unsubscribe_event_field).subscription_prefix();
+
+if(proxyUpstreamSubscriptionToRemovalTime.count(subscriptionPrefix) == 0)
+{ //Subscribed to again
+continue;
+}
+
+if(proxyUpstreamSubscriptionToRemovalTime.at(subscriptionPrefix) != eventToProcess.time.epochMicroseconds())
+{ //Subscribed to again and then dropped, so a later event is responsible for it
+continue;
+}
+
+zmq::socket_t *proxiesUpdatesListeningSocket = nullptr;
+SOM_TRY
+proxiesUpdatesListeningSocket = inputReactor.getSocket("proxiesUpdatesListeningSocket");
+SOM_CATCH("Error getting socket\n")
+
+SOM_TRY
+proxiesUpdatesListeningSocket->setsockopt(ZMQ_UNSUBSCRIBE, (void *) subscriptionPrefix.c_str(), subscriptionPrefix.size());
+SOM_CATCH("Error removing subscription from proxiesUpdatesListeningSocket\n")
+
+proxyUpstreamSubscriptionToRemovalTime.erase(subscriptionPrefix);
+proxyUpstreamSubscriptions.erase(subscriptionPrefix);
+}//end proxy_upstream_unsubscribe_event
+
 }//end while
 
 }
@@ -871,46 +1459,33 @@ This function adds a authenticated connection by placing it in the associated ma
 */
 void caster::addAuthenticatedConnection(const std::string &inputConnectionID,  const std::string &inputConnectionKey, const connectionStatus &inputConnectionStatus, const base_station_stream_information &inputBaseStationStreamInfo, reactor<caster> &inputReactor)
 {
-if(connectionKeyToSigningKeys.count(inputConnectionID))
+uint32_t connectionKeyNodeID = authenticationKeys.findNode(CONNECTION_KEY_NODE, inputConnectionKey);
+if(connectionKeyNodeID == KEY_GRAPH_INVALID_NODE_ID)
 {
 return; //Connection key entry not found, so the connection cannot be registered
 }
 
-zmq::socket_t *registrationDatabaseRequestSocket;
-SOM_TRY
-registrationDatabaseRequestSocket = inputReactor.getSocket("registrationDatabaseRequestSocket");
-SOM_CATCH("Error getting socket\n")
-
-//Add to maps/sets
-authenticatedConnectionIDToConnectionKey.emplace(inputConnectionID, inputConnectionKey);
-connectionKeyToAuthenticatedConnectionIDs.emplace(inputConnectionKey, inputConnectionID);
+//Add to maps/sets (a connection which is being overwritten stops using its old connection key)
+uint32_t connectionNodeID = authenticationKeys.addNode(AUTHENTICATED_CONNECTION_NODE, inputConnectionID);
+while(authenticationKeys.getNumberOfNeighbors(connectionNodeID) > 0)
+{
+authenticationKeys.removeEdge(connectionNodeID, authenticationKeys.getNeighbor(connectionNodeID, 0));
+}
+authenticationKeys.addEdge(connectionKeyNodeID, connectionNodeID);
+if(connectionIDToConnectionStatus.count(inputConnectionID) == 0)
+{ //Don't double count a connection that is being overwritten
+metrics.changeNumberOfConnections(inputConnectionStatus.stationClass, 1);
+}
 connectionIDToConnectionStatus[inputConnectionID] = inputConnectionStatus;
 
-//Send registration request to database
-std::string serializedDatabaseRequest;
-database_request databaseRequest;
-(*databaseRequest.mutable_base_station_to_register()) = inputBaseStationStreamInfo;
-databaseRequest.set_registration_connection_id(inputConnectionID);
-
-databaseRequest.SerializeToString(&serializedDatabaseRequest);
-
-SOM_TRY
-registrationDatabaseRequestSocket->send(nullptr, 0, ZMQ_SNDMORE);
-registrationDatabaseRequestSocket->send(serializedDatabaseRequest.c_str(), serializedDatabaseRequest.size());
-SOM_CATCH("Error sending database request\n")
+//Add to the catalog (the database is updated behind it, see flushCatalogWrites)
+addToCatalog(inputBaseStationStreamInfo);
 
 //Add timeout event to queue
-Poco::Timestamp currentTime;
+Poco::Timestamp currentTime = casterTimeSource->now();
 auto timeValue = currentTime.epochMicroseconds();
 
-possible_base_station_event_timeout timeoutEventSubMessage;
-timeoutEventSubMessage.set_connection_id(inputConnectionID);
-timeoutEventSubMessage.set_is_authenticated(true);
-
-event timeoutEvent(timeValue + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0);
-(*timeoutEvent.MutableExtension(possible_base_station_event_timeout::possible_base_station_event_timeout_field)) = timeoutEventSubMessage;
-
-inputReactor.eventQueue.push(timeoutEvent);
+inputReactor.eventQueue.push(createConnectionTimeoutEvent(inputConnectionID, true, timeValue + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0, connectionIDToConnectionStatus.at(inputConnectionID)));
 }
 
 /**
@@ -923,36 +1498,27 @@ This function removes a authenticated connection and updates the associated data
 void caster::removeAuthenticatedConnection(const std::string &inputConnectionID, reactor<caster> &inputReactor)
 {
 //Check if it has already been erased
-if(authenticatedConnectionIDToConnectionKey.count(inputConnectionID) == 0)
+uint32_t connectionNodeID = authenticationKeys.findNode(AUTHENTICATED_CONNECTION_NODE, inputConnectionID);
+if(connectionNodeID == KEY_GRAPH_INVALID_NODE_ID)
 {
 return;
 }
 
-zmq::socket_t *registrationDatabaseRequestSocket = nullptr;
-SOM_TRY
-registrationDatabaseRequestSocket = inputReactor.getSocket("registrationDatabaseRequestSocket");
-SOM_CATCH("Error, unable to get socket\n")
-
 //Remove from maps/sets
-std::string connectionKey(authenticatedConnectionIDToConnectionKey.at(inputConnectionID));
-authenticatedConnectionIDToConnectionKey.erase(inputConnectionID);
-
-removeKeyValuePairFromStringMultimap(connectionKeyToAuthenticatedConnectionIDs, connectionKey, inputConnectionID);
+authenticationKeys.removeNode(connectionNodeID);
 
 auto basestationID = connectionIDToConnectionStatus.at(inputConnectionID).baseStationID;
+metrics.changeNumberOfConnections(connectionIDToConnectionStatus.at(inputConnectionID).stationClass, -1);
+recordTraceEvent(TRACE_STREAM_REMOVED, basestationID, 1);
 connectionIDToConnectionStatus.erase(inputConnectionID);
+localStreamIDToLastMessageCache.erase(basestationID);
+{
+std::lock_guard<std::mutex> lock(ingestDropCountsMutex);
+localStreamIDToNumberOfDroppedMessages.erase(basestationID);
+}
 
-//Remove from database
-std::string serializedDatabaseRequest;
-database_request databaseRequest;
-databaseRequest.add_delete_base_station_ids(basestationID);
-
-databaseRequest.SerializeToString(&serializedDatabaseRequest);
-
-SOM_TRY
-registrationDatabaseRequestSocket->send(nullptr, 0, ZMQ_SNDMORE);
-registrationDatabaseRequestSocket->send(serializedDatabaseRequest.c_str(), serializedDatabaseRequest.size());
-SOM_CATCH("Error sending database request\n")
+//Remove from the catalog (and the database behind it)
+removeFromCatalog(basestationID);
 }
 
 /**
@@ -1004,10 +1570,10 @@ set = &listOfRegisteredCommunitySigningKeys;
 }
 
 //Add to maps
+uint32_t connectionKeyNodeID = authenticationKeys.addNode(CONNECTION_KEY_NODE, inputConnectionKey);
 for(auto iter = set->begin(); iter!=set->end(); iter++)
 {
-signingKeyToConnectionKeys.emplace(*iter, inputConnectionKey);
-connectionKeyToSigningKeys.emplace(inputConnectionKey, *iter);
+authenticationKeys.addEdge(authenticationKeys.addNode(SIGNING_KEY_NODE, *iter), connectionKeyNodeID);
 }
 
 //Add timeout event to queue
@@ -1034,24 +1600,43 @@ This function removes the given connection key from the maps and removes all ass
 */
 void caster::removeConnectionKey(const std::string &inputConnectionKey, reactor<caster> &inputReactor)
 {
-//Remove/delete all affiliated connections
-auto equal_range = connectionKeyToAuthenticatedConnectionIDs.equal_range(inputConnectionKey);
-for(auto iter = equal_range.first; iter != equal_range.second;)
+uint32_t connectionKeyNodeID = authenticationKeys.findNode(CONNECTION_KEY_NODE, inputConnectionKey);
+if(connectionKeyNodeID == KEY_GRAPH_INVALID_NODE_ID)
 {
-auto buffer = iter++; //Iter's entry gets deleted, so we have to increment before that happens
+return;
+}
+
 SOM_TRY
-removeAuthenticatedConnection(iter->second, inputReactor);
-SOM_CATCH("Error removing authenticated connection\n")
-iter = buffer; 
+removeConnectionKey(connectionKeyNodeID, inputReactor);
+SOM_CATCH("Error removing connection key\n")
 }
 
-//Remove from maps
-equal_range = connectionKeyToSigningKeys.equal_range(inputConnectionKey);
-for(auto iter = equal_range.first; iter != equal_range.second;)
+/**
+This function removes the given connection key from authenticationKeys and removes all associated connections.
+@param inputConnectionKeyNodeID: The authenticationKeys node of the connection key to remove
+@param inputReactor: The reactor that is calling the function
+
+@throws: This function can throw exceptions
+*/
+void caster::removeConnectionKey(uint32_t inputConnectionKeyNodeID, reactor<caster> &inputReactor)
 {
-removeKeyValuePairFromStringMultimap(signingKeyToConnectionKeys, iter->second, inputConnectionKey);
+//Remove/delete all affiliated connections (walking from the end, since removing one moves the last neighbor into its place)
+for(uint32_t i = authenticationKeys.getNumberOfNeighbors(inputConnectionKeyNodeID); i > 0; i--)
+{
+uint32_t neighborNodeID = authenticationKeys.getNeighbor(inputConnectionKeyNodeID, i-1);
+if(authenticationKeys.getType(neighborNodeID) != AUTHENTICATED_CONNECTION_NODE)
+{
+continue; //Signing key
+}
+
+std::string connectionID = authenticationKeys.getName(neighborNodeID); //The node is reused once removed
+SOM_TRY
+removeAuthenticatedConnection(connectionID, inputReactor);
+SOM_CATCH("Error removing authenticated connection\n")
 }
-connectionKeyToSigningKeys.erase(inputConnectionKey);
+
+//Remove from maps (takes care of the signing keys' links to it)
+authenticationKeys.removeNode(inputConnectionKeyNodeID);
 }
 
 /**
@@ -1070,7 +1655,7 @@ if((officialSigningKeys.count(inputSigningKey) > 0 && inputIsOfficialSigningKey)
 return true; //The key has already been added
 }
 
-Poco::Timestamp currentTime;
+Poco::Timestamp currentTime = casterTimeSource->now();
 auto timeValue = currentTime.epochMicroseconds();
 if(inputExpirationTime < timeValue)
 {
@@ -1085,6 +1670,7 @@ else
 {
 registeredCommunitySigningKeys.insert(inputSigningKey);
 }
+verifiedCredentials.clear();
 
 //Add timeout event
 signing_key_timeout_event timeoutEventSubMessage;
@@ -1095,6 +1681,8 @@ event timeoutEvent(inputExpirationTime);
 (*timeoutEvent.MutableExtension(signing_key_timeout_event::signing_key_timeout_event_field)) = timeoutEventSubMessage;
 
 inputReactor.eventQueue.push(timeoutEvent);
+
+return true;
 }
 
 /**
@@ -1107,27 +1695,31 @@ This function removes a signing key.  This can cause a cascade where a connectio
 void caster::removeSigningKey(const std::string &inputSigningKey, reactor<caster> &inputReactor)
 {
 //Remove any affected connection keys and delete all references to this key
-auto equal_range = signingKeyToConnectionKeys.equal_range(inputSigningKey);
-for(auto iter = equal_range.first; iter != equal_range.second;)
+uint32_t signingKeyNodeID = authenticationKeys.findNode(SIGNING_KEY_NODE, inputSigningKey);
+if(signingKeyNodeID != KEY_GRAPH_INVALID_NODE_ID)
 {
-auto buffer = iter++; //Object refered to by iter will be removed
-if(connectionKeyToSigningKeys.count(iter->second) < 2)
+while(authenticationKeys.getNumberOfNeighbors(signingKeyNodeID) > 0)
+{ //Either branch removes the last link, so this always makes progress
+uint32_t connectionKeyNodeID = authenticationKeys.getNeighbor(signingKeyNodeID, authenticationKeys.getNumberOfNeighbors(signingKeyNodeID) - 1);
+if(authenticationKeys.getNumberOfNeighbors(connectionKeyNodeID, SIGNING_KEY_NODE) < 2)
 {//If this connection key is only signed by this signing key, remove it
 SOM_TRY
-removeConnectionKey(iter->second, inputReactor);
+removeConnectionKey(connectionKeyNodeID, inputReactor);
 SOM_CATCH("Error removing signing key\n")
 }
 else
 {
-removeKeyValuePairFromStringMultimap(connectionKeyToSigningKeys, iter->second, inputSigningKey);
-signingKeyToConnectionKeys.erase(iter);
+authenticationKeys.removeEdge(signingKeyNodeID, connectionKeyNodeID);
+}
+}
+
+authenticationKeys.removeNode(signingKeyNodeID);
 }
-iter = buffer;
-} //Takes care of signingKeyToConnectionKeys, connectionKeyToSigningKeys
 
 //Erase from both (won't do anything if not there)
 officialSigningKeys.erase(inputSigningKey);
 registeredCommunitySigningKeys.erase(inputSigningKey);
+verifiedCredentials.clear();
 }
 
 /**
@@ -1147,6 +1739,7 @@ SOM_CATCH("Error removing blacklist key\n")
 
 //Add to the list of blacklisted keys
 blacklistedSigningKeys.insert(inputBlacklistKey);
+verifiedCredentials.clear();
 
 //Add timeout event
 blacklist_key_timeout_event timeoutEventSubMessage;
@@ -1173,26 +1766,19 @@ if(connectionIDToConnectionStatus.count(inputConnectionID) == 0)
 return;
 }
 
-zmq::socket_t *registrationDatabaseRequestSocket = nullptr;
-SOM_TRY
-registrationDatabaseRequestSocket = inputReactor.getSocket("registrationDatabaseRequestSocket");
-SOM_CATCH("Error getting socket\n")
-
 //Remove from maps/sets
 auto basestationID = connectionIDToConnectionStatus.at(inputConnectionID).baseStationID;
+metrics.changeNumberOfConnections(connectionIDToConnectionStatus.at(inputConnectionID).stationClass, -1);
+recordTraceEvent(TRACE_STREAM_REMOVED, basestationID, 0);
 connectionIDToConnectionStatus.erase(inputConnectionID);
+localStreamIDToLastMessageCache.erase(basestationID);
+{
+std::lock_guard<std::mutex> lock(ingestDropCountsMutex);
+localStreamIDToNumberOfDroppedMessages.erase(basestationID);
+}
 
-//Remove from database
-std::string serializedDatabaseRequest;
-database_request databaseRequest;
-databaseRequest.add_delete_base_station_ids(basestationID);
-
-databaseRequest.SerializeToString(&serializedDatabaseRequest);
-
-SOM_TRY
-registrationDatabaseRequestSocket->send(nullptr, 0, ZMQ_SNDMORE);
-registrationDatabaseRequestSocket->send(serializedDatabaseRequest.c_str(), serializedDatabaseRequest.size());
-SOM_CATCH("Error sending database request\n")
+//Remove from the catalog (and the database behind it)
+removeFromCatalog(basestationID);
 }
 
 /**
@@ -1209,7 +1795,7 @@ SOM_CATCH("Error, unable to intialize message/SQL interface\n")
 }
 
 /**
-This function handles requests to add or remove a caster proxy.  The socket it handles is typically called "addRemoveProxiesSocket".
+This function handles requests to add or remove a caster proxy.  The socket it handles is typically called "addRemoveProxiesSocket".  Requests are acknowledged as soon as they have been started, with the result of an operation reported through completeProxyOperation once it has finished.
 @param inputReactor: The reactor that is calling the function
 @param inputSocket: The socket
 @return: true if the polling cycle should restart before processing any more messages
@@ -1254,6 +1840,7 @@ if(!messageDeserializedCorrectly)
 SOM_TRY
 sendReplyLambda(true, PROXY_REQUEST_DESERIALIZATION_FAILED);
 SOM_CATCH("Error sending reply\n")
+return false;
 }
 
 bool isAddRequest = request.has_client_request_connection_string() && request.has_connect_disconnect_notification_connection_string() && request.has_base_station_publishing_connection_string();
@@ -1263,29 +1850,311 @@ if(!(isAddRequest) && !(request.has_client_request_connection_string_for_caster_
 SOM_TRY //Isn't proper add request or proper remove request
 sendReplyLambda(true, PROXY_REQUEST_FORMAT_INVALID);
 SOM_CATCH("Error sending reply\n")
+return false;
+}
+
+if(request.has_client_request_connection_string_for_caster_to_remove() && !isAddRequest)
+{
+const std::string &casterToRemove = request.client_request_connection_string_for_caster_to_remove();
+
+SOM_TRY //Operation started, so inform requester
+sendReplyLambda(false, PROXY_REQUEST_FORMAT_INVALID);
+SOM_CATCH("Error sending reply\n")
+
+if(clientRequestConnectionStringToCasterConnectionStrings.count(casterToRemove) == 0)
+{ //We don't have that caster, so removal succeeded
+completeProxyOperation(request.operation_id());
+return false; 
+}
+
+bool pollingCycleShouldRestart = false;
+if(clientRequestConnectionStringToProxyBootstrapStatus.count(casterToRemove) > 0)
+{ //Still being added, so cancel the addition
+proxyBootstrapStatus bootstrapStatus = clientRequestConnectionStringToProxyBootstrapStatus.at(casterToRemove);
+clientRequestConnectionStringToProxyBootstrapStatus.erase(casterToRemove);
+
+if(bootstrapStatus.querySocket != nullptr)
+{
+proxyQuerySocketToClientRequestConnectionString.erase(bootstrapStatus.querySocket);
+SOM_TRY
+inputReactor.removeInterface(bootstrapStatus.querySocket);
+SOM_CATCH("Error removing proxy query socket\n")
+pollingCycleShouldRestart = true;
+}
+
+for(int64_t operationID : bootstrapStatus.operationIDs)
+{
+completeProxyOperation(operationID, "Proxy was removed before its basestations were retrieved\n");
+}
+}
+
+SOM_TRY
+stopProxyingCaster(inputReactor, casterToRemove);
+SOM_CATCH("Error removing proxy\n")
+
+//Removal of basestations will be handled by timeout mechanism
+
+completeProxyOperation(request.operation_id());
+return pollingCycleShouldRestart; 
+}
+
+//Handle add request
+SOM_TRY //Operation started, so inform requester
+sendReplyLambda(false, PROXY_REQUEST_FORMAT_INVALID);
+SOM_CATCH("Error sending reply\n")
+
+if(clientRequestConnectionStringToCasterConnectionStrings.count(request.client_request_connection_string()) > 0)
+{ //Already proxied, so succeed along with the first addition
+if(clientRequestConnectionStringToProxyBootstrapStatus.count(request.client_request_connection_string()) > 0)
+{
+clientRequestConnectionStringToProxyBootstrapStatus.at(request.client_request_connection_string()).operationIDs.push_back(request.operation_id());
+}
+else
+{
+completeProxyOperation(request.operation_id());
 }
 
-//Get sockets
+return false;
+}
+
+//Connect to the notification socket and update socket so that updates from new foreign basestations can be handled before the ones that are already there are retrieved
 zmq::socket_t *proxiesNotificationsListeningSocket = nullptr;
 SOM_TRY
 proxiesNotificationsListeningSocket = inputReactor.getSocket("proxiesNotificationsListeningSocket");
 SOM_CATCH("Error getting socket\n")
 
-if(request.has_client_request_connection_string_for_caster_to_remove() && !isAddRequest)
+SOM_TRY
+proxiesNotificationsListeningSocket->connect(request.connect_disconnect_notification_connection_string().c_str());
+SOM_CATCH("Error connecting proxiesNotificationsListeningSocket\n")
+
+zmq::socket_t *proxiesUpdatesListeningSocket = nullptr;
+SOM_TRY
+proxiesUpdatesListeningSocket = inputReactor.getSocket("proxiesUpdatesListeningSocket");
+SOM_CATCH("Error getting socket\n")
+
+SOM_TRY
+proxiesUpdatesListeningSocket->connect(request.base_station_publishing_connection_string().c_str());
+SOM_CATCH("Error connecting update listening socket\n")
+
+//Update map
+clientRequestConnectionStringToCasterConnectionStrings.emplace(request.client_request_connection_string(), std::tuple<std::string, std::string, std::string>(request.client_request_connection_string(), request.connect_disconnect_notification_connection_string(), request.base_station_publishing_connection_string()));
+metrics.numberOfProxiedCasters.store(clientRequestConnectionStringToCasterConnectionStrings.size(), std::memory_order_relaxed);
+
+//Ask the caster for the basestations it already has
+clientRequestConnectionStringToProxyBootstrapStatus[request.client_request_connection_string()].operationIDs.push_back(request.operation_id());
+
+SOM_TRY
+sendProxyBootstrapQuery(inputReactor, request.client_request_connection_string());
+SOM_CATCH("Error querying caster to proxy\n")
+
+return true; //The query socket has been added to the reactor
+}
+
+/**
+This function handles processes the reply to ephemeral sockets which are used to query a new proxy source to get the metadata for the caster's basestations.  This function removes the given socket from the reactor once it is completed
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+@return: true if the polling cycle should restart before processing any more messages
+
+@throws: This function can throw exceptions
+*/
+bool caster::processCasterProxyQueryReply(reactor<caster> &inputReactor, zmq::socket_t &inputSocket)
 {
-if(clientRequestConnectionStringToCasterConnectionStrings.count(request.client_request_connection_string_for_caster_to_remove()) == 0)
-{ //We don't have that caster, so removal succeeded
+bool replyReceived = false;
+bool replyDeserializedCorrectly = false;
+client_query_reply queryReply;
+
 SOM_TRY
-sendReplyLambda(false, PROXY_REQUEST_FORMAT_INVALID);
-SOM_CATCH("Error sending reply\n")
-return false; 
+std::tie(replyReceived, replyDeserializedCorrectly) = receiveProtobufMessage(inputSocket, queryReply, ZMQ_DONTWAIT);
+SOM_CATCH("Error receiving query reply\n")
+
+if(!replyReceived)
+{ //False alarm, no message to get
+return false;
+}
+
+if(proxyQuerySocketToClientRequestConnectionString.count(&inputSocket) == 0)
+{ //Shouldn't happen, but a socket without a proxy would never be removed otherwise
+SOM_TRY
+inputReactor.removeInterface(&inputSocket);
+SOM_CATCH("Error removing proxy query socket\n")
+return true;
+}
+
+//The socket is done with either way
+std::string clientRequestConnectionString = proxyQuerySocketToClientRequestConnectionString.at(&inputSocket);
+proxyQuerySocketToClientRequestConnectionString.erase(&inputSocket);
+clientRequestConnectionStringToProxyBootstrapStatus.at(clientRequestConnectionString).querySocket = nullptr;
+
+SOM_TRY
+inputReactor.removeInterface(&inputSocket);
+SOM_CATCH("Error removing proxy query socket\n")
+
+if(!replyDeserializedCorrectly || queryReply.has_failure_reason() || !queryReply.has_caster_id())
+{
+SOM_TRY
+handleFailedProxyBootstrapQuery(inputReactor, clientRequestConnectionString, "Query to caster to proxy failed\n");
+SOM_CATCH("Error handling failed proxy query\n")
+return true;
+}
+
+for(int i=0; i < queryReply.base_stations_size(); i++)
+{
+if(!queryReply.base_stations(i).has_base_station_id())
+{
+SOM_TRY
+handleFailedProxyBootstrapQuery(inputReactor, clientRequestConnectionString, "Caster returned base station without id\n");
+SOM_CATCH("Error handling failed proxy query\n")
+return true;
+}
+}
+
+//Add all of the basestations (their catalog writes are flushed as one transaction)
+int64_t foreignCasterID = queryReply.caster_id();
+for(int i=0; i < queryReply.base_stations_size(); i++)
+{
+base_station_stream_information *basestation = queryReply.mutable_base_stations(i);
+int64_t foreignStreamID = basestation->base_station_id();
+
+if(!streamHasRequiredCatalogFields(*basestation))
+{ //Can't be put in the catalog, so skip it rather than failing the batched database write
+continue;
+}
+
+bool streamWasAdded = false;
+SOM_TRY
+streamWasAdded = addProxyStream(inputReactor, foreignCasterID, foreignStreamID, *basestation);
+SOM_CATCH("Error adding proxy stream\n")
+
+if(streamWasAdded)
+{
+addToCatalog(*basestation);
+}
+}
+
+//The caster has been subscribed to and all basestation metadata retrieved, so the proxy is established
+std::vector<int64_t> operationIDs = clientRequestConnectionStringToProxyBootstrapStatus.at(clientRequestConnectionString).operationIDs;
+clientRequestConnectionStringToProxyBootstrapStatus.erase(clientRequestConnectionString);
+
+for(int64_t operationID : operationIDs)
+{
+completeProxyOperation(operationID);
+}
+
+return true; //The socket has been removed
+}
+
+/**
+This function queries a caster that is being added as a proxy for the metadata of its basestations using a new ephemeral socket (see processCasterProxyQueryReply) and schedules the query's timeout.
+@param inputReactor: The reactor that is calling the function
+@param inputClientRequestConnectionString: The connection string the proxy was added with
+
+@throws: This function can throw exceptions
+*/
+void caster::sendProxyBootstrapQuery(reactor<caster> &inputReactor, const std::string &inputClientRequestConnectionString)
+{
+//Create/connect ephemeral socket to send query to source caster
+std::unique_ptr<zmq::socket_t> ephemeralQuerySocket;
+SOM_TRY
+ephemeralQuerySocket.reset(new zmq::socket_t(*(context), ZMQ_REQ));
+SOM_CATCH("Error intializing ephemeralQuerySocket\n")
+
+SOM_TRY //Don't hold on to unsent queries when the socket is removed
+int lingerTime = 0;
+ephemeralQuerySocket->setsockopt(ZMQ_LINGER, (void *) &lingerTime, sizeof(lingerTime));
+SOM_CATCH("Error setting linger time\n")
+
+SOM_TRY
+ephemeralQuerySocket->connect(inputClientRequestConnectionString.c_str());
+SOM_CATCH("Error connecting ephemeralQuerySocket\n")
+
+client_query_request queryRequest;
+
+SOM_TRY
+sendProtobufMessage(*ephemeralQuerySocket, queryRequest);
+SOM_CATCH("Error sending query\n")
+
+zmq::socket_t *querySocket = ephemeralQuerySocket.get();
+SOM_TRY
+inputReactor.addInterface(ephemeralQuerySocket, &caster::processCasterProxyQueryReply);
+SOM_CATCH("Error adding query socket to reactor\n")
+
+proxyBootstrapStatus &bootstrapStatus = clientRequestConnectionStringToProxyBootstrapStatus.at(inputClientRequestConnectionString);
+bootstrapStatus.querySocket = querySocket;
+proxyQuerySocketToClientRequestConnectionString[querySocket] = inputClientRequestConnectionString;
+
+//Give up on the query if it hasn't been answered in time
+possible_add_remove_socket_query_timeout_event timeoutEventSubMessage;
+timeoutEventSubMessage.set_ephemeral_socket_pointer(std::string((const char *) &querySocket, sizeof(querySocket)));
+
+bootstrapStatus.eventTime = casterTimeSource->now().epochMicroseconds() + PROXY_CLIENT_REQUEST_MAX_WAIT_TIME*1000;
+event timeoutEvent(bootstrapStatus.eventTime);
+(*timeoutEvent.MutableExtension(possible_add_remove_socket_query_timeout_event::possible_add_remove_socket_query_timeout_event_field)) = timeoutEventSubMessage;
+
+inputReactor.eventQueue.push(timeoutEvent);
+}
+
+/**
+This function handles a failed query to a caster being added as a proxy.  The query is retried after a delay which doubles with each failure until PROXY_BOOTSTRAP_MAXIMUM_ATTEMPTS have failed, at which point the proxy is removed and the callers waiting for it are told that it failed.
+@param inputReactor: The reactor that is calling the function
+@param inputClientRequestConnectionString: The connection string the proxy was added with
+@param inputFailureMessage: Why the query failed
+
+@throws: This function can throw exceptions
+*/
+void caster::handleFailedProxyBootstrapQuery(reactor<caster> &inputReactor, const std::string &inputClientRequestConnectionString, const std::string &inputFailureMessage)
+{
+proxyBootstrapStatus &bootstrapStatus = clientRequestConnectionStringToProxyBootstrapStatus.at(inputClientRequestConnectionString);
+bootstrapStatus.numberOfFailedAttempts++;
+
+if(bootstrapStatus.numberOfFailedAttempts >= PROXY_BOOTSTRAP_MAXIMUM_ATTEMPTS)
+{ //Give up on the caster
+std::vector<int64_t> operationIDs = bootstrapStatus.operationIDs;
+clientRequestConnectionStringToProxyBootstrapStatus.erase(inputClientRequestConnectionString);
+
+SOM_TRY
+stopProxyingCaster(inputReactor, inputClientRequestConnectionString);
+SOM_CATCH("Error removing proxy\n")
+
+for(int64_t operationID : operationIDs)
+{
+completeProxyOperation(operationID, inputFailureMessage);
+}
+return;
+}
+
+//Try again later
+proxy_bootstrap_retry_event retryEventSubMessage;
+retryEventSubMessage.set_client_request_connection_string(inputClientRequestConnectionString);
+
+bootstrapStatus.eventTime = casterTimeSource->now().epochMicroseconds() + PROXY_BOOTSTRAP_INITIAL_RETRY_DELAY*pow(2.0, bootstrapStatus.numberOfFailedAttempts - 1)*1000000.0;
+event retryEvent(bootstrapStatus.eventTime);
+(*retryEvent.MutableExtension(proxy_bootstrap_retry_event::proxy_bootstrap_retry_event_field)) = retryEventSubMessage;
+
+inputReactor.eventQueue.push(retryEvent);
+}
+
+/**
+This function disconnects from a proxied caster's notification and update interfaces and forgets its connection strings.  Its streams are left to time out.
+@param inputReactor: The reactor that is calling the function
+@param inputClientRequestConnectionString: The connection string the proxy was added with
+
+@throws: This function can throw exceptions
+*/
+void caster::stopProxyingCaster(reactor<caster> &inputReactor, const std::string &inputClientRequestConnectionString)
+{
+if(clientRequestConnectionStringToCasterConnectionStrings.count(inputClientRequestConnectionString) == 0)
+{
+return;
 }
 
-auto casterConnectionStrings = clientRequestConnectionStringToCasterConnectionStrings.at(request.client_request_connection_string_for_caster_to_remove());
+auto casterConnectionStrings = clientRequestConnectionStringToCasterConnectionStrings.at(inputClientRequestConnectionString);
 
 zmq::socket_t *proxiesUpdatesListeningSocket = nullptr;
+zmq::socket_t *proxiesNotificationsListeningSocket = nullptr;
 SOM_TRY
 proxiesUpdatesListeningSocket = inputReactor.getSocket("proxiesUpdatesListeningSocket");
+proxiesNotificationsListeningSocket = inputReactor.getSocket("proxiesNotificationsListeningSocket");
 SOM_CATCH("Error getting socket\n")
 
 SOM_TRY //Disconnect from caster
@@ -1296,207 +2165,822 @@ SOM_TRY //Disconnect from caster
 proxiesNotificationsListeningSocket->disconnect(std::get<1>(casterConnectionStrings).c_str());
 SOM_CATCH("Error disconnecting socket\n")
 
-//Removal of basestations will be handled by timeout mechanism
-
-SOM_TRY //Operation succeeded, so inform requester
-sendReplyLambda(false, PROXY_REQUEST_FORMAT_INVALID);
-SOM_CATCH("Error sending reply\n")
-return false; 
+clientRequestConnectionStringToCasterConnectionStrings.erase(inputClientRequestConnectionString);
+metrics.numberOfProxiedCasters.store(clientRequestConnectionStringToCasterConnectionStrings.size(), std::memory_order_relaxed);
 }
 
-//Handle add request
+/**
+This function handles notifications of new or removed sockets from casters that this caster is proxying.  It expects to receive stream_status_update messages with caster ID and stream ID preappended.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+@return: true if the polling cycle should restart before processing any more messages
+
+@throws: This function can throw exceptions
+*/
+bool caster::listenForProxyNotifications(reactor<caster> &inputReactor, zmq::socket_t &inputSocket)
+{
+//Receive request
+bool messageReceived = false;
+bool messageDeserializedCorrectly = false;
+stream_status_update notification;
+
+Poco::Int64 header[2] = {0,0};
+
+SOM_TRY
+std::tie(messageReceived, messageDeserializedCorrectly) = receiveProtobufMessage(inputSocket, notification, ZMQ_DONTWAIT, (char *) header, sizeof(Poco::Int64)*2);
+SOM_CATCH("Error receiving request\n")
+
+if(!messageReceived || !messageDeserializedCorrectly)
+{ //False alarm, no valid message to process
+return false;
+}
+
+int64_t foreignCasterID = Poco::ByteOrder::fromNetwork(Poco::Int64(header[0]));
+int64_t foreignStreamID = Poco::ByteOrder::fromNetwork(Poco::Int64(header[1]));
+
+if(notification.has_base_station_removed())
+{//This is an update about a removed basestation, so remove the associated entries
+
+SOM_TRY
+deleteProxyStream(inputReactor, foreignCasterID, foreignStreamID, notification.removal_reason());
+SOM_CATCH("Error removing foreign basestation\n")
+
+return false;
+}
+
+if(notification.has_new_base_station_info())
+{ //This is an update about a new basestation that was added
+if(!streamHasRequiredCatalogFields(notification.new_base_station_info()))
+{ //Can't be put in the catalog, so ignore it rather than failing the batched database write
+return false;
+}
+
+bool streamWasAdded = false;
+SOM_TRY
+streamWasAdded = addProxyStream(inputReactor, foreignCasterID, foreignStreamID, *notification.mutable_new_base_station_info());
+SOM_CATCH("Error adding proxy stream\n")
+
+if(!streamWasAdded)
+{ //Already have it (such as from the query made when the proxy was added)
+return false;
+}
+
+addToCatalog(notification.new_base_station_info());
+
+return false;
+}
+
+
+return false;
+}
+
+/**
+This function starts proxying a stream of a foreign caster: it gives the stream a local ID, updates the associated maps, announces the stream on the stream status notification interface and schedules its timeout.  Streams which are already being proxied are skipped.
+@param inputReactor: The reactor that is calling the function
+@param inputForeignCasterID: The ID of the caster the stream is proxied from
+@param inputForeignStreamID: The ID of the stream on that caster
+@param inputStreamInfo: The foreign caster's information for the stream (its base_station_id is changed to the local stream ID and its has_stream_frame_headers to whether this caster adds them)
+@return: true if the stream was added (so it should be registered with the database)
+
+@throws: This function can throw exceptions
+*/
+bool caster::addProxyStream(reactor<caster> &inputReactor, int64_t inputForeignCasterID, int64_t inputForeignStreamID, base_station_stream_information &inputStreamInfo)
+{
+if(proxyStreams.find(inputForeignCasterID, inputForeignStreamID) != nullptr)
+{ //Already proxied
+return false;
+}
+
+int64_t localStreamID = getNewStreamID();
+
+//Update maps
+Poco::Timestamp currentTime = casterTimeSource->now();
+int64_t timeValue = currentTime.epochMicroseconds();
+
+proxyStreamTableEntry *proxyStream = proxyStreams.insert(inputForeignCasterID, inputForeignStreamID, localStreamID);
+proxyStream->lastMessageTime = timeValue; //Count notification as message
+proxyStream->foreignCasterAddsStreamFrameHeaders = inputStreamInfo.has_stream_frame_headers();
+if(inputStreamInfo.has_station_class())
+{
+proxyStream->stationClass = inputStreamInfo.station_class();
+}
+
+foreignCasterIDToNumberOfProxiedStreams[inputForeignCasterID]++;
+localBasestationIDToForeignCasterIDAndStreamID[localStreamID] = std::pair<int64_t, int64_t>(inputForeignCasterID, inputForeignStreamID);
+metrics.numberOfProxiedStreams.store(proxyStreams.size(), std::memory_order_relaxed);
+
+if(localStreamIDToClientSubscriberCount.count(localStreamID) > 0 || localStreamIDToProxySubscriberCount.count(localStreamID) > 0)
+{ //A client or downstream proxy subscribed before the stream showed up, so start receiving it
+SOM_TRY
+updateProxyUpstreamSubscriptions(inputReactor);
+SOM_CATCH("Error updating proxy upstream subscriptions\n")
+}
+
+//Send notification regarding new local stream (this caster publishes it with stream frame headers only if it adds them itself)
+inputStreamInfo.set_base_station_id(localStreamID);
+inputStreamInfo.set_has_stream_frame_headers(addStreamFrameHeaders);
+
+stream_status_update localCasterNotification;
+*localCasterNotification.mutable_new_base_station_info() = inputStreamInfo;
+
+SOM_TRY
+sendProtobufMessage(*streamStatusNotificationInterface, localCasterNotification);
+SOM_CATCH("Error sending notification out about proxy stream addition\n")
+
+//Add timeout event so it will be removed if it doesn't update within the allowed period
+inputReactor.eventQueue.push(createProxyStreamTimeoutEvent(*proxyStreams.find(inputForeignCasterID, inputForeignStreamID), timeValue + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0));
+
+return true;
+}
+
+/**
+This function handles updates from the foreign casters this caster has started proxying.  It processes up to MAXIMUM_INGEST_BATCH_SIZE waiting updates (see processProxyUpdate) so that they can be published in priority order.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+@return: true if the polling cycle should restart before processing any more messages
+
+@throws: This function can throw exceptions
+*/
+bool caster::listenForProxyUpdates(reactor<caster> &inputReactor, zmq::socket_t &inputSocket)
+{
+for(int i=0; i<MAXIMUM_INGEST_BATCH_SIZE; i++)
+{
+if(i > 0)
+{
+bool messageIsWaiting = false;
+SOM_TRY
+messageIsWaiting = socketHasMessageWaiting(inputSocket);
+SOM_CATCH("Error checking for waiting messages\n")
+
+if(!messageIsWaiting)
+{
+break;
+}
+}
+
+SOM_TRY
+processProxyUpdate(inputReactor, inputSocket);
+SOM_CATCH("Error processing proxy update\n")
+}
+
+return false;
+}
+
+/**
+This function handles an update from the foreign casters this caster has started proxying.  It expects binary blobs with casterID, streamID preappended, which are queued for publishing by the class of the stream.  It also updates the last message received times that the streams' pending timeout events check.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+
+@throws: This function can throw exceptions
+*/
+void caster::processProxyUpdate(reactor<caster> &inputReactor, zmq::socket_t &inputSocket)
+{
+//Receive request
+bool messageReceived = false;
+zmq::message_t messageBuffer;
+
+SOM_TRY
+messageReceived = inputSocket.recv(&messageBuffer, ZMQ_DONTWAIT);
+SOM_CATCH("Error, unable to receive message\n")
+
+if(!messageReceived || messageBuffer.size() < sizeof(Poco::Int64)*2)
+{
+return; //No message to get or too small
+}
+
+//Get time of reception
+Poco::Timestamp currentTime = casterTimeSource->now();
+
+int64_t foreignCasterID = Poco::ByteOrder::fromNetwork(((Poco::Int64 *) messageBuffer.data())[0]);
+int64_t foreignStreamID = Poco::ByteOrder::fromNetwork(((Poco::Int64 *) messageBuffer.data())[1]);
+
+//See if we have metadata for that entry (the table isn't modified until this function returns, so the entry stays valid)
+proxyStreamTableEntry *proxyStream = proxyStreams.find(foreignCasterID, foreignStreamID);
+if(proxyStream == nullptr)
+{
+return; //Don't have it, so ignore message
+}
+
+int64_t localID = proxyStream->localStreamID;
+
+metrics.numberOfReceivedProxyMessages.fetch_add(1, std::memory_order_relaxed);
+metrics.numberOfReceivedProxyBytes.fetch_add(messageBuffer.size(), std::memory_order_relaxed);
+recordTraceEvent(TRACE_PROXY_MESSAGE_RECEIVED, foreignCasterID, foreignStreamID);
+
+if(proxyStream->lastCasterMessageTime == nullptr)
+{ //Only takes the metrics lock the first time a caster sends
+if(foreignCasterIDToLastProxyMessageTime.count(foreignCasterID) == 0)
+{
+foreignCasterIDToLastProxyMessageTime[foreignCasterID] = &metrics.getProxiedCasterLastMessageTime(foreignCasterID, currentTime.epochMicroseconds());
+}
+proxyStream->lastCasterMessageTime = foreignCasterIDToLastProxyMessageTime.at(foreignCasterID);
+}
+proxyStream->lastCasterMessageTime->store(currentTime.epochMicroseconds(), std::memory_order_relaxed);
+
+//Replace header with local casterID/stream ID
+((Poco::Int64 *) messageBuffer.data())[0] = Poco::ByteOrder::toNetwork(casterID);
+((Poco::Int64 *) messageBuffer.data())[1] = Poco::ByteOrder::toNetwork(localID);
+
+//Queue it for publishing with the other messages of its class
+base_station_class stationClass = proxyStream->stationClass;
+
+//Builds the message to queue from the header, a stream frame header and the payload in a single copy
+auto queueMessage = [&](const std::string &inputFrameHeader, const char *inputPayload, uint64_t inputPayloadSize)
+{
+zmq::message_t message(sizeof(Poco::Int64)*2 + inputFrameHeader.size() + inputPayloadSize);
+memcpy(message.data(), messageBuffer.data(), sizeof(Poco::Int64)*2);
+memcpy(((char *) message.data()) + sizeof(Poco::Int64)*2, inputFrameHeader.c_str(), inputFrameHeader.size());
+memcpy(((char *) message.data()) + sizeof(Poco::Int64)*2 + inputFrameHeader.size(), inputPayload, inputPayloadSize);
+stationClassToPublishingQueue.at(stationClass).addMessage(message, localID, currentTime.epochMicroseconds());
+};
+
+//If both casters add stream frame headers, the foreign caster's are kept as they are (other than adding this caster to traces), so receivers measure loss/latency from the original caster
+const char *payload = ((const char *) messageBuffer.data()) + sizeof(Poco::Int64)*2;
+uint64_t payloadSize = messageBuffer.size() - sizeof(Poco::Int64)*2;
+uint64_t sequenceNumber = 0;
+int64_t ingestTime = 0;
+uint32_t frameHeaderSize = 0;
+std::vector<traceHop> traceHops;
+if(proxyStream->foreignCasterAddsStreamFrameHeaders && !readStreamFrameHeader(payload, payloadSize, sequenceNumber, ingestTime, frameHeaderSize))
+{ //Malformed message, so ignore it
+return;
+}
+
+if(proxyStream->foreignCasterAddsStreamFrameHeaders && addStreamFrameHeaders && readStreamFrameHeaderTrace(payload, payloadSize, traceHops))
+{
+traceHops.push_back(traceHop(PROXY_INGEST, getMonotonicTime()));
+queueMessage(createStreamFrameHeader(sequenceNumber, ingestTime, traceHops), payload + frameHeaderSize, payloadSize - frameHeaderSize);
+}
+else if(proxyStream->foreignCasterAddsStreamFrameHeaders && !addStreamFrameHeaders)
+{ //This caster's receivers don't expect headers, so remove the foreign caster's
+queueMessage(std::string(), payload + frameHeaderSize, payloadSize - frameHeaderSize);
+}
+else if(addStreamFrameHeaders && !proxyStream->foreignCasterAddsStreamFrameHeaders)
+{ //The foreign caster doesn't add headers, so add one here
+if(shouldSampleMessageForTracing())
+{
+traceHops.push_back(traceHop(PROXY_INGEST, getMonotonicTime()));
+}
+
+queueMessage(createStreamFrameHeader(proxyStream->nextSequenceNumber, currentTime.epochMicroseconds(), traceHops), payload, payloadSize);
+proxyStream->nextSequenceNumber++;
+}
+else
+{ //Forwarded as is (with the header rewritten in place), so the received message is queued without copying it
+stationClassToPublishingQueue.at(stationClass).addMessage(messageBuffer, localID, currentTime.epochMicroseconds());
+}
+
+//Update last message received time (the stream's pending timeout event checks it when it fires)
+proxyStream->lastMessageTime = currentTime.epochMicroseconds();
+}
+
+/**
+This function publishes the queued messages in batches of up to MAXIMUM_PUBLISHING_BATCH_SIZE.  The queues of the station classes are serviced in weighted rounds (highest priority class first), with each class publishing up to its weight in messages per round.  After each batch, it stops early if stream data is waiting on the ingest sockets so that it can be queued (and prioritized) with the rest.
+@param inputReactor: The reactor that is calling the function (streamRegistrationAndPublishingReactor)
+@return: true if there are still messages waiting to be published (only when stream data is waiting to be received, so the reactor's poll returns immediately)
+
+@throws: This function can throw exceptions
+*/
+bool caster::publishQueuedMessages(reactor<caster> &inputReactor)
+{
+zmq::socket_t *clientStreamPublishingSocket = nullptr;
+zmq::socket_t *proxyStreamPublishingSocket = nullptr;
+std::vector<zmq::socket_t *> ingestSockets;
+SOM_TRY
+clientStreamPublishingSocket = inputReactor.getSocket("clientStreamPublishingInterface");
+proxyStreamPublishingSocket = inputReactor.getSocket("proxyStreamPublishingInterface");
+for(const char *interfaceName : {"transmitterRegistrationAndStreamingInterface", "proxiesUpdatesListeningSocket"})
+{
+if(inputReactor.nameToSocket.count(interfaceName) > 0)
+{
+ingestSockets.push_back(inputReactor.getSocket(interfaceName));
+}
+}
+SOM_CATCH("Error getting socket\n")
+
+bool messagesAreWaiting = true;
+while(messagesAreWaiting)
+{
+int numberOfPublishedMessages = 0;
+while(messagesAreWaiting && numberOfPublishedMessages < MAXIMUM_PUBLISHING_BATCH_SIZE)
+{ //Each round, publish up to each class's weight in messages (map is ordered OFFICIAL, REGISTERED_COMMUNITY, COMMUNITY)
+messagesAreWaiting = false;
+for(auto &classAndQueue : stationClassToPublishingQueue)
+{
+stationClassPublishingQueue &queue = classAndQueue.second;
+
+for(uint32_t i=0; i<queue.weight && queue.messages.size() > 0 && numberOfPublishedMessages < MAXIMUM_PUBLISHING_BATCH_SIZE; i++)
+{
+queuedPublication &publication = queue.messages.front();
+int64_t streamID = publication.streamID;
+
+//Keep it so it can be replayed to new subscribers (skipping the stream frame header, which every queued message has if this caster adds them, when determining the message type).  The replay goes to every subscriber of the stream, so only station descriptions are kept.
+auto cacheIter = localStreamIDToLastMessageCache.find(streamID);
+if(cacheIter == localStreamIDToLastMessageCache.end())
+{
+cacheIter = localStreamIDToLastMessageCache.emplace(streamID, lastMessageCache(true)).first;
+}
+lastMessageCache &messageCache = cacheIter->second;
+
+const char *messageData = (const char *) publication.message.data();
+uint64_t messageSize = publication.message.size();
+uint64_t headerSize = sizeof(Poco::Int64)*2;
+uint64_t sequenceNumber = 0;
+int64_t ingestTime = 0;
+uint32_t frameHeaderSize = 0;
+std::vector<traceHop> traceHops;
+if(addStreamFrameHeaders && readStreamFrameHeader(messageData + headerSize, messageSize - headerSize, sequenceNumber, ingestTime, frameHeaderSize) && readStreamFrameHeaderTrace(messageData + headerSize, messageSize - headerSize, traceHops))
+{ //Traced message, so add when it was published and cache a copy without the trace (replays to new subscribers would skew the latencies)
+traceHops.push_back(traceHop(traceHops.back().type == PROXY_INGEST ? PROXY_PUBLISH : CASTER_PUBLISH, getMonotonicTime()));
+publishedMessageTracer.addTrace(traceHops);
+
+std::string untracedMessage = std::string(messageData, headerSize) + createStreamFrameHeader(sequenceNumber, ingestTime);
+untracedMessage.append(messageData + headerSize + frameHeaderSize, messageSize - headerSize - frameHeaderSize);
+messageCache.addMessage(untracedMessage.c_str(), untracedMessage.size(), headerSize + STREAM_FRAME_HEADER_SIZE);
+
+std::string tracedMessage = std::string(messageData, headerSize) + createStreamFrameHeader(sequenceNumber, ingestTime, traceHops);
+tracedMessage.append(messageData + headerSize + frameHeaderSize, messageSize - headerSize - frameHeaderSize);
+publication.message.rebuild(tracedMessage.size());
+memcpy(publication.message.data(), tracedMessage.c_str(), tracedMessage.size());
+}
+else
+{
+headerSize += frameHeaderSize; //0 if this caster doesn't add frame headers
+messageCache.addMessage(messageData, messageSize, headerSize);
+}
+
+//Sending hands the message to ZMQ, so get the size first
+uint64_t sentMessageSize = publication.message.size();
+
+//Forward message (only sent to clients if someone is subscribed to the stream)
+bool streamHasSubscribers = streamHasClientSubscribers(streamID);
+if(streamHasSubscribers)
+{
+zmq::message_t clientMessage;
+SOM_TRY //Shares the buffer rather than copying it
+clientMessage.copy(&publication.message);
+clientStreamPublishingSocket->send(clientMessage);
+SOM_CATCH("Error, unable to forward message\n")
+
+metrics.numberOfMessagesSentToClients.fetch_add(1, std::memory_order_relaxed);
+metrics.numberOfBytesSentToClients.fetch_add(sentMessageSize, std::memory_order_relaxed);
+}
+
+SOM_TRY
+proxyStreamPublishingSocket->send(publication.message);
+SOM_CATCH("Error, unable to forward message\n")
+
+metrics.numberOfMessagesSentToProxies.fetch_add(1, std::memory_order_relaxed);
+metrics.numberOfBytesSentToProxies.fetch_add(sentMessageSize, std::memory_order_relaxed);
+recordTraceEvent(TRACE_MESSAGE_PUBLISHED, streamID, streamHasSubscribers);
+
+queue.removePublishedMessage(casterTimeSource->now().epochMicroseconds());
+numberOfPublishedMessages++;
+}
+
+if(queue.messages.size() > 0)
+{
+messagesAreWaiting = true;
+}
+}
+}
+
+//Stop if more stream data has arrived, so it gets queued by priority before the rest is published
+for(zmq::socket_t *ingestSocket : ingestSockets)
+{
+if(messagesAreWaiting && socketHasMessageWaiting(*ingestSocket))
+{
+return true;
+}
+}
+}
+
+return false;
+}
+
+/**
+This function processes the subscription messages received by the clientStreamPublishingInterface XPUB socket and updates the number of subscribers for each stream.  When a stream is subscribed to, its cached station description messages are published again so that the new subscriber gets them immediately.  Subscriptions are interpreted by parseStreamSubscription.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+@return: true if the polling cycle should restart before processing any more messages
+
+@throws: This function can throw exceptions
+*/
+bool caster::processClientStreamSubscription(reactor<caster> &inputReactor, zmq::socket_t &inputSocket)
+{
+//Receive subscription message
+bool messageReceived = false;
+zmq::message_t messageBuffer;
+
+SOM_TRY
+messageReceived = inputSocket.recv(&messageBuffer, ZMQ_DONTWAIT);
+SOM_CATCH("Error, unable to receive message\n")
+
+int64_t countChange = 0;
+int64_t streamID = 0;
+if(!messageReceived || !parseStreamSubscription(messageBuffer, casterID, countChange, streamID))
+{
+return false; //No message to get or not for this caster's streams
+}
+
+if(streamID < 0)
+{ //Doesn't include a whole stream ID, so it is for all of this caster's streams
+bool subscribedStreamsChanged = false;
+{
+std::lock_guard<std::mutex> lock(clientStreamSubscriberCountsMutex);
+int64_t newCount = std::max<int64_t>(allClientStreamsSubscriberCount + countChange, 0);
+subscribedStreamsChanged = (newCount == 0) != (allClientStreamsSubscriberCount == 0);
+allClientStreamsSubscriberCount = newCount;
+}
+
+if(subscribedStreamsChanged)
+{
+SOM_TRY
+updateProxyUpstreamSubscriptions(inputReactor);
+SOM_CATCH("Error updating proxy upstream subscriptions\n")
+}
+
+return false;
+}
+
+bool subscribedStreamsChanged = false;
+{
+std::lock_guard<std::mutex> lock(clientStreamSubscriberCountsMutex);
+int64_t oldCount = 0;
+if(localStreamIDToClientSubscriberCount.count(streamID) > 0)
+{
+oldCount = localStreamIDToClientSubscriberCount.at(streamID);
+}
+
+int64_t newCount = oldCount + countChange;
+if(newCount <= 0)
+{
+localStreamIDToClientSubscriberCount.erase(streamID);
+}
+else
+{
+localStreamIDToClientSubscriberCount[streamID] = newCount;
+}
+subscribedStreamsChanged = (newCount <= 0) != (oldCount <= 0);
+}
+
+if(countChange > 0 && localStreamIDToLastMessageCache.count(streamID) > 0)
+{ //Replay the station descriptions so the new subscriber doesn't have to wait for them (XPUB can't address one subscriber, so subscribers which already had them get them again)
+std::vector<const std::string *> cachedMessages = localStreamIDToLastMessageCache.at(streamID).getMessages();
+
+for(int i=0; i<cachedMessages.size(); i++)
+{
+SOM_TRY
+inputSocket.send(cachedMessages[i]->c_str(), cachedMessages[i]->size());
+SOM_CATCH("Error replaying cached message\n")
+}
+}
+
+if(subscribedStreamsChanged && localBasestationIDToForeignCasterIDAndStreamID.count(streamID) > 0)
+{ //A proxied stream gained its first subscriber or lost its last one
+SOM_TRY
+updateProxyUpstreamSubscriptions(inputReactor);
+SOM_CATCH("Error updating proxy upstream subscriptions\n")
+}
+
+return false;
+}
+
+/**
+This function processes the subscription messages received by the proxyStreamPublishingInterface XPUB socket and updates the number of downstream proxy subscribers for each stream, so that chained proxies only pull the streams someone at the end of the chain wants.  Subscriptions to just this caster's ID are how the statisticsGatheringThread listens to every stream, so they don't count as demand.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+@return: true if the polling cycle should restart before processing any more messages
+
+@throws: This function can throw exceptions
+*/
+bool caster::processProxyStreamSubscription(reactor<caster> &inputReactor, zmq::socket_t &inputSocket)
+{
+//Receive subscription message
+bool messageReceived = false;
+zmq::message_t messageBuffer;
+
+SOM_TRY
+messageReceived = inputSocket.recv(&messageBuffer, ZMQ_DONTWAIT);
+SOM_CATCH("Error, unable to receive message\n")
+
+if(!messageReceived || messageBuffer.size() == 1 + sizeof(Poco::Int64))
+{
+return false; //No message to get or the statistics listener's subscription
+}
+
+int64_t countChange = 0;
+int64_t streamID = 0;
+if(!parseStreamSubscription(messageBuffer, casterID, countChange, streamID))
+{
+return false; //Not for this caster's streams
+}
+
+bool subscribedStreamsChanged = false;
+if(streamID < 0)
+{ //Matches all of this caster's streams
+int64_t newCount = std::max<int64_t>(allProxyStreamsSubscriberCount + countChange, 0);
+subscribedStreamsChanged = (newCount == 0) != (allProxyStreamsSubscriberCount == 0);
+allProxyStreamsSubscriberCount = newCount;
+}
+else
+{
+int64_t oldCount = 0;
+if(localStreamIDToProxySubscriberCount.count(streamID) > 0)
+{
+oldCount = localStreamIDToProxySubscriberCount.at(streamID);
+}
+
+int64_t newCount = oldCount + countChange;
+if(newCount <= 0)
+{
+localStreamIDToProxySubscriberCount.erase(streamID);
+}
+else
+{
+localStreamIDToProxySubscriberCount[streamID] = newCount;
+}
+subscribedStreamsChanged = ((newCount <= 0) != (oldCount <= 0)) && localBasestationIDToForeignCasterIDAndStreamID.count(streamID) > 0;
+}
+
+if(subscribedStreamsChanged)
+{ //A proxied stream gained its first subscriber or lost its last one
+SOM_TRY
+updateProxyUpstreamSubscriptions(inputReactor);
+SOM_CATCH("Error updating proxy upstream subscriptions\n")
+}
+
+return false;
+}
+
+/**
+This function makes the subscriptions of the proxiesUpdatesListeningSocket match the proxied streams that local clients or downstream proxies are subscribed to.  New subscriptions are made immediately, while subscriptions which are no longer wanted are dropped after PROXY_UPSTREAM_UNSUBSCRIBE_LINGER_TIME so that clients which quickly resubscribe don't cause churn.
+@param inputReactor: The reactor that is calling the function (streamRegistrationAndPublishingReactor)
+
+@throws: This function can throw exceptions
+*/
+void caster::updateProxyUpstreamSubscriptions(reactor<caster> &inputReactor)
+{
+//Determine which prefixes should be subscribed to, prefix -> local stream ID (-1 for all streams)
+std::map<std::string, int64_t> wantedSubscriptions;
+if(allClientStreamsSubscriberCount > 0 || allProxyStreamsSubscriberCount > 0)
+{
+wantedSubscriptions[""] = -1;
+}
+else
+{
+for(const std::map<int64_t, int64_t> *subscriberCounts : {&localStreamIDToClientSubscriberCount, &localStreamIDToProxySubscriberCount})
+{
+for(auto iter = subscriberCounts->begin(); iter != subscriberCounts->end(); iter++)
+{
+if(localBasestationIDToForeignCasterIDAndStreamID.count(iter->first) == 0)
+{
+continue; //Not a proxied stream
+}
+
+const std::pair<int64_t, int64_t> &foreignIDs = localBasestationIDToForeignCasterIDAndStreamID.at(iter->first);
+wantedSubscriptions[generateStreamSubscriptionPrefix(foreignIDs.first, foreignIDs.second)] = iter->first;
+}
+}
+}
+
+zmq::socket_t *proxiesUpdatesListeningSocket = nullptr;
+SOM_TRY
+proxiesUpdatesListeningSocket = inputReactor.getSocket("proxiesUpdatesListeningSocket");
+SOM_CATCH("Error getting socket\n")
+
+Poco::Timestamp currentTime = casterTimeSource->now();
+
+//Subscribe to the streams which are wanted
+for(auto iter = wantedSubscriptions.begin(); iter != wantedSubscriptions.end(); iter++)
+{
+proxyUpstreamSubscriptionToRemovalTime.erase(iter->first); //Cancel removal if it was pending
+
+if(proxyUpstreamSubscriptions.count(iter->first) > 0)
+{
+continue; //Already subscribed
+}
+
+SOM_TRY
+proxiesUpdatesListeningSocket->setsockopt(ZMQ_SUBSCRIBE, (void *) iter->first.c_str(), iter->first.size());
+SOM_CATCH("Error adding subscription to proxiesUpdatesListeningSocket\n")
+
+proxyUpstreamSubscriptions.insert(iter->first);
+
+//Give the newly received streams a full period before they can time out
+if(iter->second < 0)
+{
+std::vector<proxyStreamTableEntry *> proxyStreamEntries = proxyStreams.getEntries();
+for(proxyStreamTableEntry *proxyStream : proxyStreamEntries)
+{
+proxyStream->lastMessageTime = currentTime.epochMicroseconds();
+}
+}
+else if(localBasestationIDToForeignCasterIDAndStreamID.count(iter->second) > 0)
+{
+const std::pair<int64_t, int64_t> &foreignIDs = localBasestationIDToForeignCasterIDAndStreamID.at(iter->second);
+proxyStreamTableEntry *proxyStream = proxyStreams.find(foreignIDs.first, foreignIDs.second);
+if(proxyStream != nullptr)
+{
+proxyStream->lastMessageTime = currentTime.epochMicroseconds();
+}
+}
+}
 
-//Connect to the notification socket and update socket so that updates from new foreign basestations  can be handled 
+//Schedule the removal of the subscriptions which are no longer wanted
+for(auto iter = proxyUpstreamSubscriptions.begin(); iter != proxyUpstreamSubscriptions.end(); iter++)
+{
+if(wantedSubscriptions.count(*iter) > 0 || proxyUpstreamSubscriptionToRemovalTime.count(*iter) > 0)
+{
+continue; //Still wanted or removal is already scheduled
+}
 
-SOM_TRY
-proxiesNotificationsListeningSocket->connect(request.connect_disconnect_notification_connection_string().c_str());
-SOM_CATCH("Error connecting proxiesNotificationsListeningSocket\n")
+Poco::Timestamp::TimeVal removalTime = currentTime.epochMicroseconds() + PROXY_UPSTREAM_UNSUBSCRIBE_LINGER_TIME*1000000.0;
+proxyUpstreamSubscriptionToRemovalTime[*iter] = removalTime;
 
-zmq::socket_t *proxiesUpdatesListeningSocket = nullptr;
-SOM_TRY
-proxiesUpdatesListeningSocket = inputReactor.getSocket("proxiesUpdatesListeningSocket");
-SOM_CATCH("Error getting socket\n")
+proxy_upstream_unsubscribe_event unsubscribeEventSubMessage;
+unsubscribeEventSubMessage.set_subscription_prefix(*iter);
 
-SOM_TRY //Disconnect from caster
-proxiesUpdatesListeningSocket->connect(request.base_station_publishing_connection_string().c_str());
-SOM_CATCH("Error connecting update listening socket\n")
+event unsubscribeEvent(removalTime);
+(*unsubscribeEvent.MutableExtension(proxy_upstream_unsubscribe_event::proxy_upstream_unsubscribe_event_field)) = unsubscribeEventSubMessage;
 
-//Update map
-clientRequestConnectionStringToCasterConnectionStrings.emplace(request.client_request_connection_string(), std::tuple<std::string, std::string, std::string>(request.client_request_connection_string(), request.connect_disconnect_notification_connection_string(), request.base_station_publishing_connection_string()));
+inputReactor.eventQueue.push(unsubscribeEvent);
+}
+}
 
-SOM_TRY
-sendReplyLambda(false, PROXY_REQUEST_FORMAT_INVALID);
-SOM_CATCH("Error sending reply\n")
-return false; //Proxy addition succeded
+/**
+This function returns true if proxiesUpdatesListeningSocket is currently subscribed to the given foreign stream (either directly or by subscribing to all streams).
+@param inputForeignCasterID: The ID of the foreign caster
+@param inputForeignStreamID: The ID of the stream on the foreign caster
+@return: true if updates for the stream are being received
+*/
+bool caster::proxyStreamIsSubscribedUpstream(int64_t inputForeignCasterID, int64_t inputForeignStreamID)
+{
+return proxyUpstreamSubscriptions.count("") > 0 || proxyUpstreamSubscriptions.count(generateStreamSubscriptionPrefix(inputForeignCasterID, inputForeignStreamID)) > 0;
 }
 
+/**
+This function returns true if any client is subscribed to the given stream (or to all of the streams of this caster).  It is only called from the streamRegistrationAndPublishingReactor, which is the only thread that changes the counts, so it does not need to lock.
+@param inputStreamID: The local ID of the stream to check
+@return: true if the stream's messages should be published to clients
+*/
+bool caster::streamHasClientSubscribers(int64_t inputStreamID)
+{
+return allClientStreamsSubscriberCount > 0 || localStreamIDToClientSubscriberCount.count(inputStreamID) > 0;
+}
 
 /**
-This function handles notifications of new or removed sockets from casters that this caster is proxying.  It expects to receive stream_status_update messages with caster ID and stream ID preappended.
+This function processes caster_state_handoff_request messages from a replacement caster.  It replies with the keys, connections, catalog and proxies of this caster.  The TCP interfaces are left bound, since unbinding would close every connection accepted on them at once.  The replacement binds the same ports (see bindZMQSocketToSharedTCPPort) and gets the new connections, while this caster keeps serving the existing ones until it is shut down (see STATE_HANDOFF_DRAIN_TIME).
 @param inputReactor: The reactor that is calling the function
 @param inputSocket: The socket
 @return: true if the polling cycle should restart before processing any more messages
 
 @throws: This function can throw exceptions
 */
-bool caster::listenForProxyNotifications(reactor<caster> &inputReactor, zmq::socket_t &inputSocket)
+bool caster::processStateHandoffRequest(reactor<caster> &inputReactor, zmq::socket_t &inputSocket)
+{
+//Create lambda to make it easy to send request failed replies
+auto sendFailureReplyLambda = [&] (enum caster_state_handoff_failure_reason inputReason)
 {
+caster_state_handoff_reply reply;
+reply.set_failure_reason(inputReason);
+
+SOM_TRY
+sendProtobufMessage(inputSocket, reply);
+SOM_CATCH("Error sending reply\n")
+};
+
 //Receive request
 bool messageReceived = false;
 bool messageDeserializedCorrectly = false;
-stream_status_update notification;
-
-Poco::Int64 header[2] = {0,0};
+caster_state_handoff_request request;
 
 SOM_TRY
-std::tie(messageReceived, messageDeserializedCorrectly) = receiveProtobufMessage(inputSocket, notification, ZMQ_DONTWAIT, (char *) header, sizeof(Poco::Int64)*2);
+std::tie(messageReceived, messageDeserializedCorrectly) = receiveProtobufMessage(inputSocket, request, ZMQ_DONTWAIT);
 SOM_CATCH("Error receiving request\n")
 
-if(!messageReceived || !messageDeserializedCorrectly)
-{ //False alarm, no valid message to process
+if(!messageReceived)
+{ //False alarm, no message to get
 return false;
 }
 
-//Get database socket
-zmq::socket_t *registrationDatabaseRequestSocket = nullptr;
-SOM_TRY
-registrationDatabaseRequestSocket = inputReactor.getSocket("registrationDatabaseRequestSocket");
-SOM_CATCH("Error getting required socket\n")
-
-int64_t foreignCasterID = Poco::ByteOrder::fromNetwork(Poco::Int64(header[0]));
-int64_t foreignStreamID = Poco::ByteOrder::fromNetwork(Poco::Int64(header[1]));
-int64_t localStreamID = 0;
-
-if(notification.has_base_station_removed())
-{//This is an update about a removed basestation, so remove the associated entries
-
+if(!messageDeserializedCorrectly)
+{
 SOM_TRY
-deleteProxyStream(inputReactor, foreignCasterID, foreignStreamID, notification.removal_reason());
-SOM_CATCH("Error removing foreign basestation\n")
-
+sendFailureReplyLambda(HANDOFF_REQUEST_DESERIALIZATION_FAILED);
+SOM_CATCH("Error sending reply\n")
 return false;
 }
 
-if(notification.has_new_base_station_info())
-{ //This is an update about a new basestation that was added
-localStreamID = getNewStreamID();
-
-//Update maps
-Poco::Timestamp currentTime;
-int64_t timeValue = currentTime.epochMicroseconds();
-localBasestationIDToLastMessageTimestamp[localStreamID] = timeValue; //Count notification as message
-
-if(casterIDToMapFromOriginalBasestationIDToLocalBasestationID.count(foreignCasterID) == 0)
-{ //Add map if there isn't one
-casterIDToMapFromOriginalBasestationIDToLocalBasestationID[foreignCasterID] = std::map<int64_t, int64_t>();
-}
-
-casterIDToMapFromOriginalBasestationIDToLocalBasestationID.at(foreignCasterID).emplace(foreignStreamID, localStreamID);
-
-//Send notification regarding new local stream
-stream_status_update localCasterNotification;
-*localCasterNotification.mutable_new_base_station_info() = *notification.mutable_new_base_station_info();
-localCasterNotification.mutable_new_base_station_info()->set_base_station_id(localStreamID);
-
-SOM_TRY
-sendProtobufMessage(*streamStatusNotificationInterface, localCasterNotification);
-SOM_CATCH("Error sending notification out about proxy stream addition\n")
-
-//Update database
-database_request databaseRequest;
-*databaseRequest.mutable_base_station_to_register() = *localCasterNotification.mutable_new_base_station_info();
-
+if(stateHasBeenHandedOff)
+{
 SOM_TRY
-registrationDatabaseRequestSocket->send(nullptr, 0, ZMQ_SNDMORE);
-sendProtobufMessage(*registrationDatabaseRequestSocket, databaseRequest);
-SOM_CATCH("Error sending database request\n")
-
-//Add timeout event so it will be removed if it doesn't update within the allowed period
-possible_proxy_stream_timeout_event timeoutEventSubMessage;
-timeoutEventSubMessage.set_caster_id(foreignCasterID);
-timeoutEventSubMessage.set_caster_id(foreignStreamID);
-
-event timeoutEvent(timeValue + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0);
-(*timeoutEvent.MutableExtension(possible_proxy_stream_timeout_event::possible_proxy_stream_timeout_event_field)) = timeoutEventSubMessage;
-
-inputReactor.eventQueue.push(timeoutEvent);
-
+sendFailureReplyLambda(HANDOFF_ALREADY_COMPLETED);
+SOM_CATCH("Error sending reply\n")
 return false;
 }
 
-
+if(request.caster_id() != casterID)
+{
+SOM_TRY
+sendFailureReplyLambda(HANDOFF_CASTER_ID_MISMATCH);
+SOM_CATCH("Error sending reply\n")
 return false;
 }
 
-/**
-This function handles updates from the foreign casters this caster has started proxying.  It expects binary blobs with casterID, streamID preappended.  It also schedules timeout events for each stream and updates their last message received times.
-@param inputReactor: The reactor that is calling the function
-@param inputSocket: The socket
-@return: true if the polling cycle should restart before processing any more messages
-
-@throws: This function can throw exceptions
-*/
-bool caster::listenForProxyUpdates(reactor<caster> &inputReactor, zmq::socket_t &inputSocket)
+//Make the reply (the catalog is kept by this reactor, so it doesn't need to be queried from the database)
+caster_state_handoff_reply reply;
+reply.set_caster_id(casterID);
+reply.set_last_assigned_stream_id(lastAssignedConnectionID);
+for(const auto &localStreamIDAndCatalogEntry : localStreamIDToCatalogEntry)
 {
-//Receive request
-bool messageReceived = false;
-zmq::message_t messageBuffer;
+*reply.add_base_stations() = localStreamIDAndCatalogEntry.second;
+}
 
-SOM_TRY
-messageReceived = inputSocket.recv(&messageBuffer, ZMQ_DONTWAIT);
-SOM_CATCH("Error, unable to receive message\n")
+for(auto iter = officialSigningKeys.begin(); iter != officialSigningKeys.end(); iter++)
+{
+reply.add_official_signing_keys(*iter);
+}
 
-if(!messageReceived || messageBuffer.size() < sizeof(Poco::Int64)*2)
+for(auto iter = registeredCommunitySigningKeys.begin(); iter != registeredCommunitySigningKeys.end(); iter++)
 {
-return false; //No message to get or too small
+reply.add_registered_community_signing_keys(*iter);
 }
 
-//Get time of reception
-Poco::Timestamp currentTime;
+for(auto iter = blacklistedSigningKeys.begin(); iter != blacklistedSigningKeys.end(); iter++)
+{
+reply.add_blacklisted_keys(*iter);
+}
 
-int64_t foreignCasterID = Poco::ByteOrder::fromNetwork(((Poco::Int64 *) messageBuffer.data())[0]);
-int64_t foreignStreamID = Poco::ByteOrder::fromNetwork(((Poco::Int64 *) messageBuffer.data())[1]);
+std::vector<uint32_t> connectionKeyNodeIDs = authenticationKeys.getNodes(CONNECTION_KEY_NODE);
+for(uint32_t connectionKeyNodeID : connectionKeyNodeIDs)
+{ //Add one entry per connection key
+connection_key_state *connectionKey = reply.add_connection_keys();
+connectionKey->set_connection_key(authenticationKeys.getName(connectionKeyNodeID));
 
-//See if we have metadata for that entry
-if(casterIDToMapFromOriginalBasestationIDToLocalBasestationID.count(foreignCasterID) != 0)
+for(uint32_t i=0; i<authenticationKeys.getNumberOfNeighbors(connectionKeyNodeID); i++)
 {
-if(casterIDToMapFromOriginalBasestationIDToLocalBasestationID.at(foreignCasterID).count(foreignStreamID) == 0)
+uint32_t neighborNodeID = authenticationKeys.getNeighbor(connectionKeyNodeID, i);
+if(authenticationKeys.getType(neighborNodeID) == SIGNING_KEY_NODE)
 {
-return false; //Don't have it, so ignore message
+connectionKey->add_signing_keys(authenticationKeys.getName(neighborNodeID));
 }
 }
-else
-{
-return false; //Don't have it, so ignore message
 }
 
-int64_t localID = casterIDToMapFromOriginalBasestationIDToLocalBasestationID.at(foreignCasterID).at(foreignStreamID);
+for(auto iter = connectionIDToConnectionStatus.begin(); iter != connectionIDToConnectionStatus.end(); iter++)
+{
+transmitter_connection_state *connection = reply.add_connections();
+connection->set_connection_id(iter->first);
+connection->set_base_station_id(iter->second.baseStationID);
+connection->set_sends_stream_frame_headers(iter->second.sendsStreamFrameHeaders);
 
-//Replace header with local casterID/stream ID
-((Poco::Int64 *) messageBuffer.data())[0] = Poco::ByteOrder::toNetwork(casterID);
-((Poco::Int64 *) messageBuffer.data())[1] = Poco::ByteOrder::toNetwork(localID);
+uint32_t connectionNodeID = authenticationKeys.findNode(AUTHENTICATED_CONNECTION_NODE, iter->first);
+if(connectionNodeID != KEY_GRAPH_INVALID_NODE_ID && authenticationKeys.getNumberOfNeighbors(connectionNodeID) > 0)
+{
+connection->set_connection_key(authenticationKeys.getName(authenticationKeys.getNeighbor(connectionNodeID, 0)));
+}
+}
 
-//Forward message
-SOM_TRY
-clientStreamPublishingInterface->send(messageBuffer.data(), messageBuffer.size());
-SOM_CATCH("Error sending message\n")
+for(auto iter = clientRequestConnectionStringToCasterConnectionStrings.begin(); iter != clientRequestConnectionStringToCasterConnectionStrings.end(); iter++)
+{
+add_remove_proxy_request *proxy = reply.add_proxies();
+proxy->set_client_request_connection_string(std::get<0>(iter->second));
+proxy->set_connect_disconnect_notification_connection_string(std::get<1>(iter->second));
+proxy->set_base_station_publishing_connection_string(std::get<2>(iter->second));
+}
 
-SOM_TRY
-proxyStreamPublishingInterface->send(messageBuffer.data(), messageBuffer.size());
-SOM_CATCH("Error sending message\n")
+std::vector<proxyStreamTableEntry *> proxyStreamEntries = proxyStreams.getEntries();
+for(proxyStreamTableEntry *proxyStream : proxyStreamEntries)
+{
+proxy_stream_translation *translation = reply.add_proxy_streams();
+translation->set_foreign_caster_id(proxyStream->foreignCasterID);
+translation->set_foreign_stream_id(proxyStream->foreignStreamID);
+translation->set_local_stream_id(proxyStream->localStreamID);
+translation->set_foreign_caster_adds_stream_frame_headers(proxyStream->foreignCasterAddsStreamFrameHeaders);
+}
 
-//Update last message received time
-localBasestationIDToLastMessageTimestamp[localID] = currentTime;
+//Copy the queue so that pending key expirations can be found without disturbing it
+std::priority_queue<pylongps::event> eventQueueCopy = inputReactor.eventQueue;
+while(eventQueueCopy.size() > 0)
+{
+const event &pendingEvent = eventQueueCopy.top();
 
-//Schedule timeout associated with the current update
-possible_proxy_stream_timeout_event timeoutEventSubMessage;
-timeoutEventSubMessage.set_caster_id(foreignCasterID);
-timeoutEventSubMessage.set_caster_id(foreignStreamID);
+if(pendingEvent.HasExtension(blacklist_key_timeout_event::blacklist_key_timeout_event_field) || pendingEvent.HasExtension(connection_key_timeout_event::connection_key_timeout_event_field) || pendingEvent.HasExtension(signing_key_timeout_event::signing_key_timeout_event_field))
+{
+scheduled_event_state *expirationEvent = reply.add_key_expiration_events();
+expirationEvent->set_time(pendingEvent.time.epochMicroseconds());
+expirationEvent->mutable_event()->CopyFrom(pendingEvent);
+}
 
-event timeoutEvent(currentTime + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0);
-(*timeoutEvent.MutableExtension(possible_proxy_stream_timeout_event::possible_proxy_stream_timeout_event_field)) = timeoutEventSubMessage;
+eventQueueCopy.pop();
+}
 
-inputReactor.eventQueue.push(timeoutEvent);
+SOM_TRY
+sendProtobufMessage(inputSocket, reply);
+SOM_CATCH("Error sending reply\n")
+
+stateHasBeenHandedOff = true;
 
 return false;
 }
@@ -1525,6 +3009,12 @@ return false; //No message to be had
 }
 SOM_CATCH("Error receiving server registration/deregistration message")
 
+//Record how long the request takes to process
+std::chrono::steady_clock::time_point requestStartTime = std::chrono::steady_clock::now();
+SOMScopeGuard requestLatencyGuard([&]() { metrics.databaseRequestLatency.addLatency(std::chrono::duration<double>(std::chrono::steady_clock::now() - requestStartTime).count()); });
+recordTraceEvent(TRACE_DATABASE_REQUEST_STARTED, messageBuffer->size());
+SOMScopeGuard requestTraceGuard([&]() { recordTraceEvent(TRACE_DATABASE_REQUEST_FINISHED, messageBuffer->size()); });
+
 //Create lambda to make it easy to send request failed replies
 auto sendReplyLambda = [&] (bool inputRequestFailed, enum database_request_failure_reason inputReason = DATABASE_REQUEST_DESERIALIZATION_FAILED, std::string inputConnectionString = std::string(""))
 {
@@ -1569,7 +3059,7 @@ if(request.has_registration_connection_id())
 replyConnectionID = request.registration_connection_id();
 }
 
-if(!request.base_station_to_register().has_latitude() || !request.base_station_to_register().has_longitude() || !request.base_station_to_register().has_base_station_id() || !request.base_station_to_register().has_start_time() || !request.base_station_to_register().has_message_format())
+if(!streamHasRequiredCatalogFields(request.base_station_to_register()))
 {//Message did not have required fields, so send back message saying request failed
 SOM_TRY
 sendReplyLambda(true, DATABASE_REQUEST_FORMAT_INVALID, replyConnectionID);
@@ -1588,15 +3078,87 @@ SOM_CATCH("Error sending reply\n")
 return false;
 }
 
-if(request.delete_base_station_ids_size() > 0)
-{//Perform delete operation
-for(int i=0; i<request.delete_base_station_ids_size(); i++)
+if(request.base_stations_to_register_size() > 0 || request.delete_base_station_ids_size() > 0)
+{//Add/remove basestations in a single transaction
+for(int i=0; i<request.base_stations_to_register_size(); i++)
 {
+const base_station_stream_information &baseStation = request.base_stations_to_register(i);
+if(!streamHasRequiredCatalogFields(baseStation))
+{//Message did not have required fields, so send back message saying request failed
 SOM_TRY
+sendReplyLambda(true, DATABASE_REQUEST_FORMAT_INVALID);
+return false;
+SOM_CATCH("Error sending reply")
+}
+}
+
+bool transactionSucceeded = false;
+if(sqlite3_exec(databaseConnection.get(), "BEGIN TRANSACTION;", NULL, NULL, NULL) == SQLITE_OK)
+{
+SOMScopeGuard transactionGuard([&]() { sqlite3_exec(databaseConnection.get(), "ROLLBACK;", NULL, NULL, NULL); });
+
+try
+{
+for(int i=0; i<request.base_stations_to_register_size(); i++)
+{
+basestationToSQLInterface->store(request.base_stations_to_register(i));
+}
+
+for(int i=0; i<request.delete_base_station_ids_size(); i++)
+{
+basestationToSQLInterface->deleteMessage(request.delete_base_station_ids(i));
+}
+
+if(sqlite3_exec(databaseConnection.get(), "COMMIT;", NULL, NULL, NULL) == SQLITE_OK)
+{
+transactionGuard.dismiss();
+transactionSucceeded = true;
+}
+}
+catch(const std::exception &)
+{ //Rolled back by the guard, then retried below
+}
+}
+
+uint64_t numberOfFailedWrites = 0;
+if(!transactionSucceeded)
+{ //Retry the writes one at a time, so that one the database rejects doesn't lose the rest of the batch
+for(int i=0; i<request.base_stations_to_register_size(); i++)
+{
+try
+{
+basestationToSQLInterface->store(request.base_stations_to_register(i));
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "Unable to add stream %ld to the database: %s", (long) request.base_stations_to_register(i).base_station_id(), inputException.what());
+numberOfFailedWrites++;
+}
+}
+
+for(int i=0; i<request.delete_base_station_ids_size(); i++)
+{
+try
+{
 basestationToSQLInterface->deleteMessage(request.delete_base_station_ids(i));
-SOM_CATCH("Error deleting from database\n")
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "Unable to delete stream %ld from the database: %s", (long) request.delete_base_station_ids(i), inputException.what());
+numberOfFailedWrites++;
+}
+}
 }
 
+if(numberOfFailedWrites > 0)
+{ //The catalog keeps the streams, but the database (and so client queries) won't match it for these
+metrics.numberOfFailedCatalogWrites.fetch_add(numberOfFailedWrites, std::memory_order_relaxed);
+
+SOM_TRY
+sendReplyLambda(true, DATABASE_CONSTRAINTS_VIOLATED);
+SOM_CATCH("Error sending reply\n")
+return false;
+}
 
 SOM_TRY
 sendReplyLambda(false); //Request succeeded
@@ -1647,6 +3209,10 @@ return false; //No message to be had
 }
 SOM_CATCH("Error receiving server registration/deregistration message")
 
+//Record how long the query takes to answer
+std::chrono::steady_clock::time_point queryStartTime = std::chrono::steady_clock::now();
+SOMScopeGuard queryLatencyGuard([&]() { metrics.clientQueryLatency.addLatency(std::chrono::duration<double>(std::chrono::steady_clock::now() - queryStartTime).count()); });
+
 //Create lambda to make it easy to send request failed replies
 auto sendReplyLambda = [&] (bool inputRequestFailed, enum client_query_request_failure_reason inputReason = CLIENT_QUERY_REQUEST_DESERIALIZATION_FAILED, ::google::protobuf::int64 inputCasterID = 0,  std::vector<base_station_stream_information> inputBaseStations = std::vector<base_station_stream_information>(0))
 {
@@ -1671,6 +3237,8 @@ reply.SerializeToString(&serializedReply);
 SOM_TRY
 inputSocket.send(serializedReply.c_str(), serializedReply.size());
 SOM_CATCH("Error sending reply message\n")
+
+recordTraceEvent(TRACE_CLIENT_QUERY, inputBaseStations.size(), inputRequestFailed);
 };
 
 //Attempt to deserialize
@@ -1765,7 +3333,7 @@ basestationToSQLInterface->retrieve(resultPrimaryKeys[i], results.back());
 SOM_CATCH("Error retrieving object associated with a query primary key\n")
 }
 
-Poco::Timestamp currentTime;
+Poco::Timestamp currentTime = casterTimeSource->now();
 auto timeValue = currentTime.epochMicroseconds();
 for(int i=0; i<results.size(); i++)
 {
@@ -1781,7 +3349,69 @@ return false;
 }
 
 /**
-This function processes messages from the transmitterRegistrationAndStreamingInterface.  A connection is expected to start with a transmitter_registration_request, to which this object replies with a transmitter_registration_reply.  Thereafter, the messages received are forwarded to the associated publisher interfaces until the publisher stops sending for an unacceptably long period (SECONDS_BEFORE_CONNECTION_TIMEOUT), at which point the object erases the associated the associated metadata and publishes that the base station disconnected.  In the authenticated case, the preapended signature is removed and checked.  If authentication fails, packet is dropped (eventually timing out).
+This function handles the ZMQ_STREAM metricsInterface.  Each HTTP GET request received is answered with the current metrics in the Prometheus text format (or, for GET /trace, with a dump of the process's trace rings which can be read with the traceDecoder tool), after which the connection is closed.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+@return: true if the polling cycle should restart before processing any more messages
+
+@throws: This function can throw exceptions
+*/
+bool caster::processMetricsRequest(reactor<caster> &inputReactor, zmq::socket_t &inputSocket)
+{
+//Receive the connection identity and the data (empty when a connection opens or closes)
+zmq::message_t identityBuffer;
+zmq::message_t dataBuffer;
+
+SOM_TRY
+if(inputSocket.recv(&identityBuffer, ZMQ_DONTWAIT) != true)
+{
+return false; //No message to be had
+}
+SOM_CATCH("Error receiving metrics request identity\n")
+
+SOM_TRY
+inputSocket.recv(&dataBuffer);
+SOM_CATCH("Error receiving metrics request\n")
+
+if(dataBuffer.size() == 0)
+{ //Connection notification, not a request
+return false;
+}
+
+//Any GET other than GET /trace gets the metrics (the request is expected to arrive in one piece, since the connection is closed after the reply)
+std::string request((const char *) dataBuffer.data(), dataBuffer.size());
+std::string status = "405 Method Not Allowed";
+std::string contentType = "text/plain; version=0.0.4";
+std::string body;
+if(request.compare(0, 11, "GET /trace ") == 0)
+{
+status = "200 OK";
+contentType = "application/octet-stream";
+dumpTraceRings().SerializeToString(&body);
+}
+else if(request.compare(0, 4, "GET ") == 0)
+{
+status = "200 OK";
+body = metrics.generatePrometheusText(casterTimeSource->now().epochMicroseconds());
+}
+
+std::string response = "HTTP/1.0 " + status + "\r\nContent-Type: " + contentType + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+SOM_TRY //Send reply
+inputSocket.send(identityBuffer.data(), identityBuffer.size(), ZMQ_SNDMORE);
+inputSocket.send(response.c_str(), response.size());
+SOM_CATCH("Error sending metrics reply\n")
+
+SOM_TRY //Sending empty data closes the connection
+inputSocket.send(identityBuffer.data(), identityBuffer.size(), ZMQ_SNDMORE);
+inputSocket.send(nullptr, 0);
+SOM_CATCH("Error closing metrics connection\n")
+
+return false;
+}
+
+/**
+This function processes messages from the transmitterRegistrationAndStreamingInterface.  A connection is expected to start with a transmitter_registration_request, to which this object replies with a transmitter_registration_reply.  Thereafter, the messages received are forwarded to the associated publisher interfaces until the publisher stops sending for an unacceptably long period (SECONDS_BEFORE_CONNECTION_TIMEOUT), at which point the object erases the associated the associated metadata and publishes that the base station disconnected.  In the authenticated case, the preapended signature is removed and checked.  If authentication fails, packet is dropped (eventually timing out).  Up to MAXIMUM_INGEST_BATCH_SIZE waiting messages are processed in each call so that the stream data can be published in priority order (see publishQueuedMessages).
 @param inputReactor: The reactor that is calling the function
 @param inputSocket: The socket
 @return: true if the polling cycle should restart before processing any more messages
@@ -1790,13 +3420,38 @@ This function processes messages from the transmitterRegistrationAndStreamingInt
 */
 bool caster::processAuthenticatedOrUnauthenticatedTransmitterRegistrationAndStreamingMessage(reactor<caster> &inputReactor, zmq::socket_t &inputSocket)
 {
-zmq::socket_t *registrationDatabaseRequestSocket = nullptr;
+for(int i=0; i<MAXIMUM_INGEST_BATCH_SIZE; i++)
+{
+if(i > 0)
+{
+bool messageIsWaiting = false;
+SOM_TRY
+messageIsWaiting = socketHasMessageWaiting(inputSocket);
+SOM_CATCH("Error checking for waiting messages\n")
+
+if(!messageIsWaiting)
+{
+break;
+}
+}
 
 SOM_TRY
-registrationDatabaseRequestSocket = inputReactor.getSocket("registrationDatabaseRequestSocket");
-SOM_CATCH("Error getting required socket\n")
+processTransmitterRegistrationOrStreamingMessage(inputReactor, inputSocket);
+SOM_CATCH("Error processing transmitter message\n")
+}
+
+return false;
+}
 
+/**
+This function processes a single message from the transmitterRegistrationAndStreamingInterface (see processAuthenticatedOrUnauthenticatedTransmitterRegistrationAndStreamingMessage).  Stream data is queued for publishing by the class of the stream rather than being published immediately.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
 
+@throws: This function can throw exceptions
+*/
+void caster::processTransmitterRegistrationOrStreamingMessage(reactor<caster> &inputReactor, zmq::socket_t &inputSocket)
+{
 //Send reply
 auto sendReplyLambda = [&] (const std::string &inputAddress, bool inputRequestSucceeded, request_failure_reason inputFailureReason = MESSAGE_FORMAT_INVALID)
 {
@@ -1831,13 +3486,13 @@ SOM_CATCH("Error retrieving router message\n")
 
 if(!messageRetrievalSuccessful)
 { //Invalid message, so ignore
-return false;
+return;
 }
 
 
 std::string connectionID = receivedContent[0];
 //Get current time
-Poco::Timestamp currentTime;
+Poco::Timestamp currentTime = casterTimeSource->now();
 auto timeValue = currentTime.epochMicroseconds();
 
 //Check if 
@@ -1855,8 +3510,17 @@ request.ParseFromArray(receivedContent[1].c_str(), receivedContent[1].size());
 if(!request.IsInitialized())
 {//Message header serialization failed, so send back message saying request failed
 SOM_TRY
-sendReplyLambda(connectionID, false, MESSAGE_FORMAT_INVALID);
-return false;
+sendReplyLambda(connectionID, false, MESSAGE_FORMAT_INVALID);
+return;
+SOM_CATCH("Error sending reply");
+}
+
+if(!registrationAdmissionRateLimiter.takeToken(timeValue))
+{ //Turn the registration away before checking its credentials so that a reconnect storm costs as little as possible
+metrics.numberOfRateLimitedRegistrations.fetch_add(1, std::memory_order_relaxed);
+SOM_TRY
+sendReplyLambda(connectionID, false, REGISTRATION_RATE_LIMITED);
+return;
 SOM_CATCH("Error sending reply");
 }
 
@@ -1870,11 +3534,11 @@ credentialsPointer = request.mutable_transmitter_credentials();
 
 base_station_stream_information *streamInfo = request.mutable_stream_info();
 
-if(!streamInfo->has_message_format())
-{//Missing a required field
+if(!streamInfo->has_message_format() || !streamInfo->has_latitude() || !streamInfo->has_longitude())
+{//Missing a field the catalog requires (the caster fills in the stream ID and start time), which would otherwise fail the batched database write it is part of
 SOM_TRY
 sendReplyLambda(connectionID, false, MISSING_REQUIRED_FIELD);
-return false;
+return;
 SOM_CATCH("Error sending reply")
 }
 
@@ -1892,7 +3556,7 @@ if(!credentialsMessageIsValid)
 { //Either authorized_permissions could not be deserialized or one of the signatures didn't match or the key didn't match
 SOM_TRY
 sendReplyLambda(connectionID, false, CREDENTIALS_DESERIALIZATION_FAILED);
-return false;
+return;
 SOM_CATCH("Error sending reply");
 }
 
@@ -1903,7 +3567,7 @@ if(timeValue > permissionsBuffer.valid_until())
 { //Permissions recognized but expired
 SOM_TRY
 sendReplyLambda(connectionID, false, CREDENTIALS_DESERIALIZATION_FAILED);
-return false;
+return;
 SOM_CATCH("Error sending reply");
 }
 }
@@ -1911,7 +3575,7 @@ else
 {
 SOM_TRY
 sendReplyLambda(connectionID, false, CREDENTIALS_DESERIALIZATION_FAILED);
-return false;
+return;
 SOM_CATCH("Error sending reply");
 }
 
@@ -1920,7 +3584,7 @@ if(permissionsBuffer.public_key().size() != crypto_sign_PUBLICKEYBYTES)
 { //The public key is not a valid size
 SOM_TRY
 sendReplyLambda(connectionID, false, CREDENTIALS_DESERIALIZATION_FAILED);
-return false;
+return;
 SOM_CATCH("Error sending reply");
 }
 
@@ -1938,7 +3602,7 @@ if(addConnectionKey(permissionsBuffer.public_key(), permissionsBuffer.valid_unti
 {
 SOM_TRY
 sendReplyLambda(connectionID, false, INSUFFICIENT_PERMISSIONS);
-return false;
+return;
 SOM_CATCH("Error sending reply");
 }
 }
@@ -1962,7 +3626,7 @@ else
 {
 SOM_TRY
 sendReplyLambda(connectionID, false, INSUFFICIENT_PERMISSIONS);
-return false;
+return;
 SOM_CATCH("Error sending reply");
 }
 }
@@ -1984,21 +3648,12 @@ streamInfo->clear_source_public_key();
 streamInfo->clear_real_update_rate();
 streamInfo->clear_uptime();
 streamInfo->set_start_time(timeValue);
+streamInfo->set_has_stream_frame_headers(addStreamFrameHeaders);
 
-//Make/send request to database
+//Add to the catalog (the database is updated behind it, see flushCatalogWrites)
 if(!connectionIsAuthenticated)
 {
-std::string serializedDatabaseRequest;
-database_request databaseRequest;
-(*databaseRequest.mutable_base_station_to_register()) = (*streamInfo);
-databaseRequest.set_registration_connection_id(connectionID);
-
-databaseRequest.SerializeToString(&serializedDatabaseRequest);
-
-SOM_TRY
-registrationDatabaseRequestSocket->send(nullptr, 0, ZMQ_SNDMORE);
-registrationDatabaseRequestSocket->send(serializedDatabaseRequest.c_str(), serializedDatabaseRequest.size());
-SOM_CATCH("Error sending database request\n")
+addToCatalog(*streamInfo);
 }
 
 //Add to map
@@ -2006,6 +3661,9 @@ connectionStatus associatedConnectionStatus;
 associatedConnectionStatus.requestToTheDatabaseHasBeenSent = true;
 associatedConnectionStatus.baseStationID = streamID;
 associatedConnectionStatus.timeLastMessageWasReceived = timeValue;
+associatedConnectionStatus.stationClass = streamInfo->station_class();
+associatedConnectionStatus.sendsStreamFrameHeaders = request.sends_stream_frame_headers();
+setConnectionIngestLimits(associatedConnectionStatus, *streamInfo, timeValue);
 if(connectionIsAuthenticated)
 {
 SOM_TRY
@@ -2014,6 +3672,10 @@ SOM_CATCH("Error adding authenticated connection\n")
 }
 else
 {
+if(connectionIDToConnectionStatus.count(connectionID) == 0)
+{ //Don't double count a connection that is being overwritten
+metrics.changeNumberOfConnections(associatedConnectionStatus.stationClass, 1);
+}
 connectionIDToConnectionStatus[connectionID] = associatedConnectionStatus;
 }
 
@@ -2021,14 +3683,7 @@ connectionIDToConnectionStatus[connectionID] = associatedConnectionStatus;
 if(!connectionIsAuthenticated)
 {
 //Register possible stream timeout event
-possible_base_station_event_timeout timeoutEventSubMessage;
-timeoutEventSubMessage.set_connection_id(connectionID);
-timeoutEventSubMessage.set_is_authenticated(connectionIsAuthenticated);
-
-event timeoutEvent(timeValue + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0);
-(*timeoutEvent.MutableExtension(possible_base_station_event_timeout::possible_base_station_event_timeout_field)) = timeoutEventSubMessage;
-
-inputReactor.eventQueue.push(timeoutEvent);
+inputReactor.eventQueue.push(createConnectionTimeoutEvent(connectionID, connectionIsAuthenticated, timeValue + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0, connectionIDToConnectionStatus.at(connectionID)));
 }
 
 
@@ -2036,6 +3691,7 @@ inputReactor.eventQueue.push(timeoutEvent);
 SOM_TRY
 sendReplyLambda(connectionID, true);
 SOM_CATCH("Error sending registration succeeded message")
+recordTraceEvent(TRACE_STREAM_REGISTERED, streamID, streamInfo->station_class());
 
 //Make message to announce new station
 std::string serializedUpdateMessage;
@@ -2055,91 +3711,114 @@ SOM_TRY
 streamStatusNotificationInterface->send(notificiationMessage.c_str(), notificiationMessage.size());
 SOM_CATCH("Error publishing new station registration\n")
 
-return false;//Registration finished
+return;//Registration finished
 }//End station registration
 
 
 //Base station has already been registered, so forward it and update the timeout info
+metrics.numberOfReceivedMessages.fetch_add(1, std::memory_order_relaxed);
+metrics.numberOfReceivedBytes.fetch_add(receivedContent[1].size(), std::memory_order_relaxed);
 
-//Mark if it is an authenticated connection
-connectionIsAuthenticated = authenticatedConnectionIDToConnectionKey.count(connectionID) != 0;
+//Drop messages beyond the connection's rate limit (or the global ingest budget, which OFFICIAL stations are exempt from) before doing any more work on them
+connectionStatus &currentConnectionStatus = connectionIDToConnectionStatus.at(connectionID);
+recordTraceEvent(TRACE_MESSAGE_RECEIVED, currentConnectionStatus.baseStationID, receivedContent[1].size());
+bool messageIsWithinLimits = currentConnectionStatus.ingestRateLimiter.takeToken(timeValue);
+if(messageIsWithinLimits && !currentConnectionStatus.isExemptFromGlobalIngestLimit && !globalIngestRateLimiter.takeToken(timeValue))
+{ //Dropped because of the other transmitters, so the connection keeps its token
+currentConnectionStatus.ingestRateLimiter.returnToken();
+messageIsWithinLimits = false;
+}
+
+if(!messageIsWithinLimits)
+{
+recordTraceEvent(TRACE_MESSAGE_RATE_LIMITED, currentConnectionStatus.baseStationID, receivedContent[1].size());
+if(currentConnectionStatus.numberOfDroppedMessages == nullptr)
+{ //Only takes the lock the first time one of the stream's messages is dropped
+std::lock_guard<std::mutex> lock(ingestDropCountsMutex);
+currentConnectionStatus.numberOfDroppedMessages = &localStreamIDToNumberOfDroppedMessages[currentConnectionStatus.baseStationID];
+}
+currentConnectionStatus.numberOfDroppedMessages->fetch_add(1, std::memory_order_relaxed);
+return;
+}
+
+//Mark if it is an authenticated connection (its only link is to its connection key)
+uint32_t connectionNodeID = authenticationKeys.findNode(AUTHENTICATED_CONNECTION_NODE, connectionID);
+connectionIsAuthenticated = connectionNodeID != KEY_GRAPH_INVALID_NODE_ID && authenticationKeys.getNumberOfNeighbors(connectionNodeID) > 0;
 
 if(connectionIsAuthenticated && receivedContent[1].size() < crypto_sign_BYTES)
 { //Authenticated message isn't long enough to have a signature, so ignore it
-return false; 
+metrics.numberOfSignatureFailures.fetch_add(1, std::memory_order_relaxed);
+recordTraceEvent(TRACE_SIGNATURE_REJECTED, currentConnectionStatus.baseStationID, receivedContent[1].size());
+return; 
 }
 
 if(connectionIsAuthenticated)
 {//Check the signature
 std::string messageSignature = receivedContent[1].substr(0,crypto_sign_BYTES);
 
-if(crypto_sign_verify_detached((const unsigned char *) messageSignature.c_str(), (const unsigned char *) receivedContent[1].c_str() + crypto_sign_BYTES, receivedContent[1].size() - crypto_sign_BYTES, (const unsigned char *) authenticatedConnectionIDToConnectionKey.at(connectionID).c_str()) != 0) 
+if(crypto_sign_verify_detached((const unsigned char *) messageSignature.c_str(), (const unsigned char *) receivedContent[1].c_str() + crypto_sign_BYTES, receivedContent[1].size() - crypto_sign_BYTES, (const unsigned char *) authenticationKeys.getName(authenticationKeys.getNeighbor(connectionNodeID, 0)).c_str()) != 0) 
 { //Signature did not match, so ignore invalid message
-return false;
+metrics.numberOfSignatureFailures.fetch_add(1, std::memory_order_relaxed);
+recordTraceEvent(TRACE_SIGNATURE_REJECTED, currentConnectionStatus.baseStationID, receivedContent[1].size());
+return;
 }
+recordTraceEvent(TRACE_SIGNATURE_VERIFIED, currentConnectionStatus.baseStationID, receivedContent[1].size());
 }
 
-//Allocate memory and copy the caster ID, stream ID and data to it
-int totalMessageSize = 0;
-
-if(connectionIsAuthenticated)
-{
-totalMessageSize = receivedContent[1].size() + sizeof(Poco::Int64)+sizeof(Poco::Int64) - crypto_sign_BYTES; //Subtract size of signature since it is not forwarded
-}
-else
-{
-totalMessageSize = receivedContent[1].size() + sizeof(Poco::Int64)+sizeof(Poco::Int64);
+//Copy the caster ID, stream ID and data into the publishing queue of the stream's class
+Poco::Int64 header[2];
+header[0] = Poco::ByteOrder::toNetwork(Poco::Int64(casterID));
+header[1] = Poco::ByteOrder::toNetwork(Poco::Int64(currentConnectionStatus.baseStationID));
+
+//The signature is not forwarded
+uint64_t payloadOffset = connectionIsAuthenticated ? crypto_sign_BYTES : 0;
+const char *payload = receivedContent[1].c_str() + payloadOffset;
+uint64_t payloadSize = receivedContent[1].size() - payloadOffset;
+
+//Transmitters which registered with sends_stream_frame_headers start each message with a stream frame header (carrying the trace, if the message is traced), which is removed here
+std::vector<traceHop> traceHops;
+if(currentConnectionStatus.sendsStreamFrameHeaders)
+{
+uint64_t transmitterSequenceNumber = 0;
+int64_t transmitterIngestTime = 0;
+uint32_t transmitterFrameHeaderSize = 0;
+if(!readStreamFrameHeader(payload, payloadSize, transmitterSequenceNumber, transmitterIngestTime, transmitterFrameHeaderSize))
+{ //Malformed message, so ignore it
+return;
 }
 
-char *memoryBuffer = new char[totalMessageSize];
-SOMScopeGuard memoryBufferScopeGuard([&]() { delete[] memoryBuffer; }); 
-
-//Poco saves the day again (good serialization functions)
-//Update map
-Poco::Int64 streamID = 0;
-streamID = connectionIDToConnectionStatus.at(connectionID).baseStationID;
-
-*((Poco::Int64 *) memoryBuffer) = Poco::ByteOrder::toNetwork(Poco::Int64(casterID));
-*(((Poco::Int64 *) memoryBuffer) + 1) = Poco::ByteOrder::toNetwork(Poco::Int64(streamID));
-
-//Copy message to buffer
-if(connectionIsAuthenticated)
-{
-memcpy((void *) &memoryBuffer[sizeof(Poco::Int64)*2], (void *) receivedContent[1].c_str() + crypto_sign_BYTES, receivedContent[1].size() - crypto_sign_BYTES);
+readStreamFrameHeaderTrace(payload, payloadSize, traceHops);
+payload += transmitterFrameHeaderSize;
+payloadSize -= transmitterFrameHeaderSize;
 }
-else
+
+std::string frameHeader;
+if(addStreamFrameHeaders)
+{ //Add the sequence number and ingest time so that receivers can detect loss and measure latency
+if(traceHops.size() > 0 || shouldSampleMessageForTracing())
 {
-memcpy((void *) &memoryBuffer[sizeof(Poco::Int64)*2], (void *) receivedContent[1].c_str(), receivedContent[1].size());
+traceHops.push_back(traceHop(CASTER_INGEST, getMonotonicTime()));
 }
 
-//Forward message
-SOM_TRY
-clientStreamPublishingInterface->send(memoryBuffer, totalMessageSize);
-SOM_CATCH("Error, unable to forward message\n")
+frameHeader = createStreamFrameHeader(currentConnectionStatus.nextSequenceNumber, timeValue, traceHops);
+currentConnectionStatus.nextSequenceNumber++;
+}
 
-SOM_TRY
-proxyStreamPublishingInterface->send(memoryBuffer, totalMessageSize);
-SOM_CATCH("Error, unable to forward message\n")
+//Built in place, since the queue hands the message to the publishing sockets without copying it again
+zmq::message_t message(sizeof(header) + frameHeader.size() + payloadSize);
+memcpy(message.data(), header, sizeof(header));
+memcpy(((char *) message.data()) + sizeof(header), frameHeader.c_str(), frameHeader.size());
+memcpy(((char *) message.data()) + sizeof(header) + frameHeader.size(), payload, payloadSize);
+stationClassToPublishingQueue.at(currentConnectionStatus.stationClass).addMessage(message, currentConnectionStatus.baseStationID, timeValue);
+recordTraceEvent(TRACE_MESSAGE_QUEUED, currentConnectionStatus.baseStationID, currentConnectionStatus.stationClass);
 
-//Update map and register potential timeout event
-//Update map
+//Update map (the connection's pending timeout event checks the last message time when it fires)
 connectionIDToConnectionStatus.at(connectionID).timeLastMessageWasReceived = timeValue;
-
-//Register possible stream timeout event
-possible_base_station_event_timeout timeoutEventSubMessage;
-timeoutEventSubMessage.set_connection_id(connectionID);
-timeoutEventSubMessage.set_is_authenticated(connectionIsAuthenticated);
-
-event timeoutEvent(timeValue + SECONDS_BEFORE_CONNECTION_TIMEOUT*1000000.0);
-(*timeoutEvent.MutableExtension(possible_base_station_event_timeout::possible_base_station_event_timeout_field)) = timeoutEventSubMessage;
-
-inputReactor.eventQueue.push(timeoutEvent);
-return false;
 }
 
 
 /**
-This function processes reply messages sent to registrationDatabaseRequestSocket.  It expects database operations to succeed, so it throws an exception upon receiving a failure message.
+This function processes reply messages sent to registrationDatabaseRequestSocket.  A failed request is logged rather than thrown, since that would stop the streamRegistrationAndPublishingReactor (the database thread has already retried the writes one at a time and counted the ones which still failed in the metrics).
 @param inputReactor: The reactor that is calling the function
 @param inputSocket: The socket
 @return: true if the polling cycle should restart before processing any more messages
@@ -2175,10 +3854,11 @@ SOM_CATCH("Error receiving server registration message")
 
 database_reply reply;
 reply.ParseFromArray(messageBuffer->data(), messageBuffer->size());
+recordTraceEvent(TRACE_DATABASE_REPLY_RECEIVED, reply.has_reason());
 
 if(reply.has_reason())
-{
-throw SOMException("Database request failed (" +std::to_string((int) reply.reason())+ "\n", SQLITE3_ERROR, __FILE__, __LINE__);
+{ //The database thread has already logged and counted the writes which failed
+fprintf(stderr, "Catalog database write failed (%d)\n", (int) reply.reason());
 }
 
 return false;
@@ -2358,7 +4038,7 @@ return false; //Invalid message
 
 if(update.has_new_base_station_info())
 { //Add basestation to maps
-Poco::Timestamp currentTime;
+Poco::Timestamp currentTime = casterTimeSource->now();
 auto timeValue = currentTime.epochMicroseconds();
 basestationIDToCreationTime[streamID]  = timeValue;
 basestationIDToNumberOfSentMessages[streamID] = 0;
@@ -2453,6 +4133,7 @@ SOM_CATCH("Error receiving server registration message")
 
 database_reply reply;
 reply.ParseFromArray(messageBuffer->data(), messageBuffer->size());
+recordTraceEvent(TRACE_DATABASE_REPLY_RECEIVED, reply.has_reason());
 
 if(reply.has_reason())
 {
@@ -2474,35 +4155,16 @@ This function is used inside the streamRegistrationAndPublishingReactor to remov
 */
 void caster::deleteProxyStream(reactor<caster> &inputReactor, int64_t inputCasterID, int64_t inputStreamID, base_station_removal_reason inputReason)
 {
-
-if(casterIDToMapFromOriginalBasestationIDToLocalBasestationID.count(inputCasterID) == 0)
-{
-return; //Can't remove what isn't there
-}
-else
-{
-if(casterIDToMapFromOriginalBasestationIDToLocalBasestationID.at(inputCasterID).count(inputStreamID) == 0)
+proxyStreamTableEntry *proxyStream = proxyStreams.find(inputCasterID, inputStreamID);
+if(proxyStream == nullptr)
 {
 return; //Can't remove what isn't there
 }
-}
-
-int64_t localStreamID = casterIDToMapFromOriginalBasestationIDToLocalBasestationID.at(inputCasterID).at(inputStreamID);
-
-//Remove from database
-zmq::socket_t *registrationDatabaseRequestSocket = nullptr;
-
-SOM_TRY
-registrationDatabaseRequestSocket = inputReactor.getSocket("registrationDatabaseRequestSocket");
-SOM_CATCH("Error getting required socket\n")
 
-database_request databaseRequest;
-databaseRequest.add_delete_base_station_ids(localStreamID);
+int64_t localStreamID = proxyStream->localStreamID;
 
-SOM_TRY
-registrationDatabaseRequestSocket->send(nullptr, 0, ZMQ_SNDMORE);
-sendProtobufMessage(*registrationDatabaseRequestSocket, databaseRequest);
-SOM_CATCH("Error sending database request\n")
+//Remove from the catalog (and the database behind it)
+removeFromCatalog(localStreamID);
 
 //Send notification regarding local stream removal
 stream_status_update localCasterNotification;
@@ -2525,8 +4187,83 @@ sendProtobufMessage(*streamStatusNotificationInterface, localCasterNotification,
 SOM_CATCH("Error sending notification out proxy stream removal\n")
 
 //update maps
-localBasestationIDToLastMessageTimestamp.erase(localStreamID);
-casterIDToMapFromOriginalBasestationIDToLocalBasestationID.at(inputCasterID).erase(localStreamID);
+proxyStreams.erase(inputCasterID, inputStreamID); //Removes its pending timeout as well
+localBasestationIDToForeignCasterIDAndStreamID.erase(localStreamID);
+localStreamIDToLastMessageCache.erase(localStreamID);
+foreignCasterIDToNumberOfProxiedStreams[inputCasterID]--;
+if(foreignCasterIDToNumberOfProxiedStreams.at(inputCasterID) <= 0)
+{ //Last stream from that caster, so stop reporting its lag
+foreignCasterIDToNumberOfProxiedStreams.erase(inputCasterID);
+foreignCasterIDToLastProxyMessageTime.erase(inputCasterID);
+metrics.removeProxiedCaster(inputCasterID);
+}
+metrics.numberOfProxiedStreams.store(proxyStreams.size(), std::memory_order_relaxed);
+
+SOM_TRY //Stop receiving the stream (after the linger time)
+updateProxyUpstreamSubscriptions(inputReactor);
+SOM_CATCH("Error updating proxy upstream subscriptions\n")
+}
+
+/**
+This function adds a stream to the catalog and queues its registration with the database (see flushCatalogWrites).
+@param inputStreamInfo: The information of the stream (base_station_id is the local stream ID)
+*/
+void caster::addToCatalog(const base_station_stream_information &inputStreamInfo)
+{
+localStreamIDToCatalogEntry[inputStreamInfo.base_station_id()] = inputStreamInfo;
+*pendingCatalogWrites.add_base_stations_to_register() = inputStreamInfo;
+}
+
+/**
+This function removes a stream from the catalog and queues its deletion from the database (see flushCatalogWrites).  A stream whose registration hasn't been flushed yet is simply dropped from the queue.
+@param inputLocalStreamID: The local ID of the stream
+*/
+void caster::removeFromCatalog(int64_t inputLocalStreamID)
+{
+if(localStreamIDToCatalogEntry.erase(inputLocalStreamID) == 0)
+{
+return; //Not in the catalog
+}
+
+google::protobuf::RepeatedPtrField<base_station_stream_information> &pendingRegistrations = *pendingCatalogWrites.mutable_base_stations_to_register();
+for(int i=0; i<pendingRegistrations.size(); i++)
+{
+if(pendingRegistrations.Get(i).base_station_id() == inputLocalStreamID)
+{ //Never reached the database, so there is nothing to delete
+pendingRegistrations.SwapElements(i, pendingRegistrations.size() - 1);
+pendingRegistrations.RemoveLast();
+return;
+}
+}
+
+pendingCatalogWrites.add_delete_base_station_ids(inputLocalStreamID);
+}
+
+/**
+This function sends the queued catalog registrations/deletions to the database as a single request, which it applies in one transaction.  The streamRegistrationAndPublishingReactor calls it each time around its poll loop, so the writes of everything handled in one pass are batched together.
+@param inputReactor: The reactor that is calling the function
+
+@throws: This function can throw exceptions
+*/
+void caster::flushCatalogWrites(reactor<caster> &inputReactor)
+{
+if(pendingCatalogWrites.base_stations_to_register_size() == 0 && pendingCatalogWrites.delete_base_station_ids_size() == 0)
+{
+return;
+}
+
+zmq::socket_t *registrationDatabaseRequestSocket = nullptr;
+SOM_TRY
+registrationDatabaseRequestSocket = inputReactor.getSocket("registrationDatabaseRequestSocket");
+SOM_CATCH("Error getting required socket\n")
+
+SOM_TRY
+registrationDatabaseRequestSocket->send(nullptr, 0, ZMQ_SNDMORE);
+sendProtobufMessage(*registrationDatabaseRequestSocket, pendingCatalogWrites);
+SOM_CATCH("Error sending database request\n")
+recordTraceEvent(TRACE_DATABASE_REQUEST_SENT, pendingCatalogWrites.base_stations_to_register_size(), pendingCatalogWrites.delete_base_station_ids_size());
+
+pendingCatalogWrites.Clear();
 }
 
 
@@ -2710,6 +4447,218 @@ return false; //Message is invalid, so mark it so
 return true;
 }
 
+/**
+This function checks if a socket has a message waiting to be received (without receiving it).
+@param inputSocket: The socket to check
+@return: true if a message can be received without blocking
+
+@throws: This function can throw exceptions
+*/
+bool pylongps::socketHasMessageWaiting(zmq::socket_t &inputSocket)
+{
+int events = 0;
+size_t eventsSize = sizeof(events);
+
+SOM_TRY
+inputSocket.getsockopt(ZMQ_EVENTS, (void *) &events, &eventsSize);
+SOM_CATCH("Error checking socket events\n")
+
+return (events & ZMQ_POLLIN) != 0;
+}
+
+/**
+This function generates the ZMQ subscription prefix used to receive a particular stream from a caster (caster ID and stream ID in network byte order).
+@param inputCasterID: The ID of the caster publishing the stream
+@param inputStreamID: The ID of the stream
+@return: The subscription prefix
+*/
+std::string pylongps::generateStreamSubscriptionPrefix(int64_t inputCasterID, int64_t inputStreamID)
+{
+Poco::Int64 header[2];
+header[0] = Poco::ByteOrder::toNetwork(Poco::Int64(inputCasterID));
+header[1] = Poco::ByteOrder::toNetwork(Poco::Int64(inputStreamID));
+
+return std::string((const char *) header, sizeof(header));
+}
+
+/**
+This function interprets a subscription message received by an XPUB socket which publishes a caster's streams.  Subscriptions are expected to be casterID/streamID prefixes, so a subscription which is a prefix of the caster's ID matches all of its streams and a subscription with another caster's ID matches none of them.
+@param inputMessage: The subscription message (1 for subscribe or 0 for unsubscribe followed by the prefix)
+@param inputCasterID: The ID of the caster publishing the streams
+@param outputCountChange: 1 for a subscription and -1 for an unsubscription
+@param outputStreamID: The ID of the subscribed stream or -1 if the subscription matches all of them
+@return: true if the message changes the subscriptions to the caster's streams
+*/
+bool pylongps::parseStreamSubscription(const zmq::message_t &inputMessage, int64_t inputCasterID, int64_t &outputCountChange, int64_t &outputStreamID)
+{
+if(inputMessage.size() < 1)
+{
+return false; //Too small
+}
+
+//First byte is 1 for subscribe and 0 for unsubscribe, the rest is the prefix
+const char *messageData = (const char *) inputMessage.data();
+if(messageData[0] == 1)
+{
+outputCountChange = 1;
+}
+else if(messageData[0] == 0)
+{
+outputCountChange = -1;
+}
+else
+{
+return false; //Not a subscription message
+}
+
+std::string prefix(messageData + 1, inputMessage.size() - 1);
+std::string casterIDString = generateStreamSubscriptionPrefix(inputCasterID, 0).substr(0, sizeof(Poco::Int64));
+
+if(prefix.size() < sizeof(Poco::Int64)*2)
+{ //Doesn't include a whole stream ID, so it is either for all of the caster's streams or none of them
+outputStreamID = -1;
+return casterIDString.compare(0, std::min(prefix.size(), casterIDString.size()), prefix, 0, std::min(prefix.size(), casterIDString.size())) == 0;
+}
+
+if(prefix.compare(0, sizeof(Poco::Int64), casterIDString) != 0)
+{
+return false; //Different caster
+}
+
+outputStreamID = Poco::ByteOrder::fromNetwork(*((Poco::Int64 *) (prefix.c_str() + sizeof(Poco::Int64))));
+return true;
+}
+
+/**
+This function checks if stream information has the fields which the caster's database requires of each stream in its catalog.
+@param inputStreamInfo: The stream information to check
+@return: true if the latitude, longitude, base_station_id, start_time and message_format are all present
+*/
+bool pylongps::streamHasRequiredCatalogFields(const base_station_stream_information &inputStreamInfo)
+{
+return inputStreamInfo.has_latitude() && inputStreamInfo.has_longitude() && inputStreamInfo.has_base_station_id() && inputStreamInfo.has_start_time() && inputStreamInfo.has_message_format();
+}
+
+/**
+This function binds the given socket to the given address.  If the address is in use, it keeps trying until the given amount of time has passed (used when taking over a port from a caster which doesn't share it).
+@param inputSocket: The socket to bind
+@param inputBindingAddress: The address to bind to
+@param inputMaxWaitTime: How long to keep trying in milliseconds (0 to only try once)
+@return: The endpoint the socket was bound to (ZMQ_LAST_ENDPOINT), which is what has to be given to unbind (tcp:// wildcard addresses are rejected by it)
+
+@throws: This function can throw exceptions
+*/
+std::string pylongps::bindZMQSocketWithRetry(zmq::socket_t &inputSocket, const std::string &inputBindingAddress, int inputMaxWaitTime)
+{
+Poco::Timestamp startTime;
+
+while(true)
+{
+try
+{
+inputSocket.bind(inputBindingAddress.c_str());
+
+char endpointBuffer[256];
+size_t endpointBufferSize = sizeof(endpointBuffer);
+inputSocket.getsockopt(ZMQ_LAST_ENDPOINT, (void *) endpointBuffer, &endpointBufferSize);
+return std::string(endpointBuffer, strnlen(endpointBuffer, endpointBufferSize));
+}
+catch(const zmq::error_t &inputError)
+{
+if(inputError.num() != EADDRINUSE || startTime.elapsed() >= inputMaxWaitTime*1000)
+{
+throw SOMException("Unable to bind to " + inputBindingAddress + ": " + inputError.what() + "\n", ZMQ_ERROR, __FILE__, __LINE__);
+}
+}
+
+//Give the other process a chance to release the address
+std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+}
+
+/**
+This function binds the given socket to a TCP port (on all interfaces) through a listening socket made with SO_REUSEPORT, so that a replacement caster can bind the same port while this one keeps serving the connections it has already accepted.  When the listening socket can't be given to ZMQ (ZMQ_USE_FD needs libzmq 4.2), it binds the port normally with bindZMQSocketWithRetry.
+@param inputSocket: The socket to bind
+@param inputPortNumber: The port to bind to
+@param inputSteerNewConnectionsHere: True if new connections to the port should come to this socket rather than to the listening socket of the caster being replaced
+@param inputMaxWaitTime: How long to keep trying in milliseconds if the port is in use (0 to only try once)
+@return: The endpoint the socket was bound to (ZMQ_LAST_ENDPOINT)
+
+@throws: This function can throw exceptions
+*/
+std::string pylongps::bindZMQSocketToSharedTCPPort(zmq::socket_t &inputSocket, uint32_t inputPortNumber, bool inputSteerNewConnectionsHere, int inputMaxWaitTime)
+{
+std::string bindingAddress = "tcp://*:" + std::to_string(inputPortNumber);
+
+#ifdef ZMQ_USE_FD
+int listeningSocketFileDescriptor = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+if(listeningSocketFileDescriptor < 0)
+{
+throw SOMException("Unable to create TCP socket\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+SOMScopeGuard listeningSocketGuard([&]() { close(listeningSocketFileDescriptor); });
+
+int reuseValue = 1;
+setsockopt(listeningSocketFileDescriptor, SOL_SOCKET, SO_REUSEADDR, (void *) &reuseValue, sizeof(reuseValue));
+if(setsockopt(listeningSocketFileDescriptor, SOL_SOCKET, SO_REUSEPORT, (void *) &reuseValue, sizeof(reuseValue)) != 0)
+{
+throw SOMException("Unable to share TCP port " + std::to_string(inputPortNumber) +"\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+
+sockaddr_in bindAddress;
+memset((void *) &bindAddress, 0, sizeof(bindAddress));
+bindAddress.sin_family = AF_INET;
+bindAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+bindAddress.sin_port = htons(inputPortNumber);
+
+Poco::Timestamp startTime;
+while(bind(listeningSocketFileDescriptor, (sockaddr *) &bindAddress, sizeof(bindAddress)) != 0)
+{ //Only in use if the caster being replaced doesn't share its ports, in which case it releases them when it shuts down
+if(errno != EADDRINUSE || startTime.elapsed() >= inputMaxWaitTime*1000)
+{
+throw SOMException("Unable to bind TCP port " + std::to_string(inputPortNumber) +"\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+
+std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+if(listen(listeningSocketFileDescriptor, SOMAXCONN) != 0)
+{
+throw SOMException("Unable to listen on TCP port\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+if(inputSteerNewConnectionsHere)
+{ //Sockets sharing a port are indexed in the order they were bound, so the caster being replaced has 0 and this one has 1.  Once the caster being replaced closes its socket, this one moves to 0 and the out of range index makes the kernel go back to spreading connections by hash.
+sock_filter steerToNewestSocket[] = {{BPF_RET | BPF_K, 0, 0, 1}};
+sock_fprog steeringProgram;
+steeringProgram.len = 1;
+steeringProgram.filter = steerToNewestSocket;
+
+if(setsockopt(listeningSocketFileDescriptor, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, (void *) &steeringProgram, sizeof(steeringProgram)) != 0)
+{ //Not fatal, the kernel just spreads the new connections over both casters until the one being replaced shuts down
+fprintf(stderr, "Unable to steer new connections on port %u to the replacement caster\n", inputPortNumber);
+}
+}
+#endif
+
+//ZMQ takes ownership of the listening socket when it binds
+SOM_TRY
+inputSocket.setsockopt(ZMQ_USE_FD, (void *) &listeningSocketFileDescriptor, sizeof(listeningSocketFileDescriptor));
+SOM_CATCH("Error giving listening socket to ZMQ\n")
+
+std::string endpoint;
+SOM_TRY
+endpoint = bindZMQSocketWithRetry(inputSocket, bindingAddress, 0);
+SOM_CATCH("Error binding socket with listening socket\n")
+listeningSocketGuard.dismiss();
+
+return endpoint;
+#else
+return bindZMQSocketWithRetry(inputSocket, bindingAddress, inputMaxWaitTime);
+#endif
+}
+
 /**
 This function helps with creating SQL query strings for client requests.
 @param inputRelation: The relation to resolve into a SQL string part (such as "<= ?"
@@ -2792,7 +4741,7 @@ SOM_CATCH("Error binding statement\n")
 parameterCount++;
 }
 
-Poco::Timestamp currentTime;
+Poco::Timestamp currentTime = casterTimeSource->now();
 auto timeValue = currentTime.epochMicroseconds();
 for(int a=0; a<inputRequest.subqueries(i).uptime_condition_size(); a++)
 { //Handle uptime conditions
@@ -2883,13 +4832,42 @@ return lastAssignedConnectionID;
 }
 
 /**
-This function checks whether the permissions in a credentials message are considered valid according to the current lists of trusted keys.  
+This function checks whether the permissions in a credentials message are considered valid according to the current lists of trusted keys.  Results are cached (see verifiedCredentialsCache), so credentials which have been seen before since the key lists last changed don't have their signatures verified again.
 @param inputCredentials: The credentials giving the permissions/signing keys
 @param inputAuthorizedPermissionsBuffer: The object to return the authorized_permissions with
 @return: A tuple of <messageIsValid, isSignedByOfficialEntityKey, isSignedByRegisteredCommunityKey>
 */
 std::tuple<bool, bool, bool> caster::checkCredentials(credentials &inputCredentials, authorized_permissions &inputAuthorizedPermissionsBuffer)
 {
+std::string cacheKey = verifiedCredentialsCache::generateKey(inputCredentials);
+
+const verifiedCredentialsCacheEntry *cachedResult = verifiedCredentials.find(cacheKey);
+if(cachedResult != nullptr)
+{
+metrics.numberOfCredentialsCacheHits.fetch_add(1, std::memory_order_relaxed);
+inputAuthorizedPermissionsBuffer = cachedResult->permissions;
+return std::tuple<bool, bool, bool>(cachedResult->credentialsAreValid, cachedResult->isSignedByOfficialEntityKey, cachedResult->isSignedByRegisteredCommunityKey);
+}
+
+metrics.numberOfCredentialsCacheMisses.fetch_add(1, std::memory_order_relaxed);
+
+verifiedCredentialsCacheEntry result;
+std::tie(result.credentialsAreValid, result.isSignedByOfficialEntityKey, result.isSignedByRegisteredCommunityKey) = verifyCredentials(inputCredentials, result.permissions);
+
+inputAuthorizedPermissionsBuffer = result.permissions;
+verifiedCredentials.insert(cacheKey, result);
+
+return std::tuple<bool, bool, bool>(result.credentialsAreValid, result.isSignedByOfficialEntityKey, result.isSignedByRegisteredCommunityKey);
+}
+
+/**
+This function does the work of checkCredentials without the cache: it verifies each signature and parses the permissions.
+@param inputCredentials: The credentials giving the permissions/signing keys
+@param inputAuthorizedPermissionsBuffer: The object to return the authorized_permissions with
+@return: A tuple of <messageIsValid, isSignedByOfficialEntityKey, isSignedByRegisteredCommunityKey>
+*/
+std::tuple<bool, bool, bool> caster::verifyCredentials(credentials &inputCredentials, authorized_permissions &inputAuthorizedPermissionsBuffer)
+{
 bool isSignedByOfficialEntityKey = false;
 bool isSignedByRegisteredCommunityKey = false;
 
@@ -2939,7 +4917,7 @@ This function removes a basestation connection from both the maps and the databa
 void caster::removeConnection(const std::string &inputConnectionID, reactor<caster> &inputReactor)
 {
 
-if(authenticatedConnectionIDToConnectionKey.count(inputConnectionID) > 0)
+if(authenticationKeys.findNode(AUTHENTICATED_CONNECTION_NODE, inputConnectionID) != KEY_GRAPH_INVALID_NODE_ID)
 { //Handle if authenticated
 SOM_TRY
 removeAuthenticatedConnection(inputConnectionID, inputReactor);
@@ -3109,28 +5087,5 @@ sqlite3_result_double(inputContext, 0.0);
 }
 }
 
-/**
-This function removes all entries of the map with the specific key/value.
-@param inputMultimap: the multimap to delete from
-@param inputKey: the key of the key/value pair
-@param inputValue: The value of the key/value pair
-*/
-void pylongps::removeKeyValuePairFromStringMultimap(std::multimap<std::string, std::string> &inputMultimap, const std::string &inputKey, const std::string &inputValue)
-{
-auto equalRange = inputMultimap.equal_range(inputKey);
-for(auto iter = equalRange.first; iter!=equalRange.second;)
-{
-if(iter->second == inputValue)
-{
-iter = inputMultimap.erase(iter); //Erase the pair and move to the next position
-}
-else
-{
-iter++; //Just go to the next entry to check
-}
-}
-
-}
-
 
 
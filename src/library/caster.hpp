@@ -12,6 +12,16 @@
 #include<random>
 #include<cmath>
 #include<cstring>
+#include<atomic>
+#include<mutex>
+#include<future>
+#include<algorithm>
+#include<cerrno>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<netinet/in.h>
+#include<arpa/inet.h>
+#include<linux/filter.h>
 #include "SOMException.hpp"
 #include "SOMScopeGuard.hpp"
 #include "event.hpp"
@@ -21,6 +31,18 @@
 #include "messageDatabaseDefinition.hpp"
 #include "sqlite3.h"
 #include "connectionStatus.hpp"
+#include "proxyBootstrapStatus.hpp"
+#include "proxyStreamTable.hpp"
+#include "verifiedCredentialsCache.hpp"
+#include "keyGraph.hpp"
+#include "tokenBucket.hpp"
+#include "lastMessageCache.hpp"
+#include "stationClassPublishingQueue.hpp"
+#include "streamFrameHeader.hpp"
+#include "latencyTracer.hpp"
+#include "casterMetrics.hpp"
+#include "traceRing.hpp"
+#include "timeSource.hpp"
 #include <sodium.h>
 #include "reactor.hpp"
 
@@ -45,6 +67,11 @@
 #include "add_remove_proxy_request.pb.h"
 #include "add_remove_proxy_reply.pb.h"
 #include "possible_proxy_stream_timeout_event.pb.h"
+#include "proxy_upstream_unsubscribe_event.pb.h"
+#include "possible_add_remove_socket_query_timeout_event.pb.h"
+#include "proxy_bootstrap_retry_event.pb.h"
+#include "caster_state_handoff_request.pb.h"
+#include "caster_state_handoff_reply.pb.h"
 
 namespace pylongps
 {
@@ -58,6 +85,44 @@ const int UPDATE_RATES_TO_UPDATE_PER_SECOND = 100;
 //How long to wait for the caster to add to return its basestations' metadata or the local caster to subscribe to the foreign caster
 const int PROXY_CLIENT_REQUEST_MAX_WAIT_TIME = 5000; //5000 milliseconds
 
+//How many times a caster being added as a proxy is queried for its basestations before the proxy is given up on
+const uint32_t PROXY_BOOTSTRAP_MAXIMUM_ATTEMPTS = 5;
+
+//How long to wait before querying a caster being added as a proxy again after the first failed attempt (doubles with each further failure)
+const double PROXY_BOOTSTRAP_INITIAL_RETRY_DELAY = 0.25; //Seconds
+
+//How many messages a transmitter can send in a burst beyond the rate derived from its expected update rate
+const double DEFAULT_INGEST_BURST_SIZE = 20.0;
+
+//Transmitters are allowed to send this many times their expected update rate (messages are often split into several ZMQ messages by the data receivers)
+const double INGEST_RATE_LIMIT_MULTIPLIER = 4.0;
+
+//The lowest expected update rate used to derive a transmitter's rate limit (messages/second)
+const double MINIMUM_INGEST_RATE = 1.0;
+
+//How many messages of each station class are published in each round of servicing the publishing queues (higher priority classes get more of the publishing capacity)
+const uint32_t OFFICIAL_PUBLISHING_WEIGHT = 4;
+const uint32_t REGISTERED_COMMUNITY_PUBLISHING_WEIGHT = 2;
+const uint32_t COMMUNITY_PUBLISHING_WEIGHT = 1;
+
+//The most waiting messages that are read from a transmitter or proxy socket before the publishing queues are serviced
+const int MAXIMUM_INGEST_BATCH_SIZE = 64;
+
+//The most queued messages that are published each time the publishing queues are serviced
+const int MAXIMUM_PUBLISHING_BATCH_SIZE = 64;
+
+//How long to keep receiving a proxied stream from the foreign caster after the last local client unsubscribes from it (absorbs subscription churn)
+const double PROXY_UPSTREAM_UNSUBSCRIBE_LINGER_TIME = 2.0; //Seconds
+
+//How long to wait for a caster being replaced to send its state (or to release a port it doesn't share)
+const int STATE_HANDOFF_MAX_WAIT_TIME = 5000; //5000 milliseconds
+
+//How long a caster which has handed off its state keeps serving its existing connections before it shuts down (the replacement gets the new connections in the meantime)
+const double STATE_HANDOFF_DRAIN_TIME = 30.0; //Seconds
+
+//How long the peers of connections handed off to a replacement caster have to reconnect to it after the caster being replaced shuts down, before the connections can time out
+const double STATE_HANDOFF_RECONNECT_TIME = 10.0; //Seconds
+
 /**
 This class represents a pylonGPS 2.0 caster.  It opens several ZMQ ports to provide caster services, an in-memory SQLITE database and creates 2 threads to manage its duties.
 
@@ -86,6 +151,8 @@ This function initializes the class, creates the associated database, and starts
 @param inputBlacklistedKeys: A list of signing keys not to trust 
 @param inputCasterSQLITEConnectionString: The connection string used to connect to or create the SQLITE database used for stream source entry management and query resolution.  If an empty string is given (by default), it will connect/create an in memory database with a random 64 bit number string (example: "file:9735926149617295559?mode=memory&cache=shared")
 
+The other options (see caster_configuration.proto) and the time source are only available through the caster_configuration constructor.
+
 @throws: This function can throw exceptions
 */
 caster(zmq::context_t *inputContext, int64_t inputCasterID, uint32_t inputTransmitterRegistrationAndStreamingPortNumber, uint32_t inputClientRequestPortNumber, uint32_t inputClientStreamPublishingPortNumber, uint32_t inputProxyStreamPublishingPortNumber, uint32_t inputStreamStatusNotificationPortNumber, uint32_t inputKeyRegistrationAndRemovalPortNumber, const std::string &inputCasterPublicKey, const std::string &inputCasterSecretKey, const std::string &inputSigningKeysManagementKey, const std::vector<std::string> &inputOfficialSigningKeys, const std::vector<std::string> &inputRegisteredCommunitySigningKeys, const std::vector<std::string> &inputBlacklistedKeys, const std::string &inputCasterSQLITEConnectionString = "");
@@ -94,15 +161,16 @@ caster(zmq::context_t *inputContext, int64_t inputCasterID, uint32_t inputTransm
 This function intializes the object based on the parameters in a protobuf message (which allows serialization/deserialization of configuration parameters).
 @param inputContext: The ZMQ context to use
 @param inputConfiguration: The protobuf message containing the configuration information
+@param inputTimeSource: The source of the current time for all timeouts/expirations (the wall clock if nullptr).  It must outlive the caster
 
 @throws: This function can throw exceptions
 */
-caster(zmq::context_t *inputContext, const caster_configuration &inputConfiguration);
+caster(zmq::context_t *inputContext, const caster_configuration &inputConfiguration, timeSource *inputTimeSource = nullptr);
 
 /**
-This thread safe function adds a new caster to proxy.  The function may have some lag as a query needs to be sent to the caster to proxy and the results returned before this function does.
+This thread safe function adds a new caster to proxy and waits until the proxy is established (see addProxyAsync).
 @param inputClientRequestConnectionString: The ZMQ connection string to use to connect to the client query answering port of the caster to proxy
-@param inputBasestationPublishingConnectionString: The ZMQ connection string to use to connect to the interface that publishes the basestation updates
+@param inputBasestationPublishingConnectionString: The ZMQ connection string to use to connect to the interface that publishes the basestation updates (only the streams that local clients or downstream proxies are subscribed to are requested, and both of the foreign caster's stream publishing interfaces pass the subscriptions on through chains of proxies)
 @param inputConnectionDisconnectionNotificationConnectionString: The ZMQ connection string to use to connect to the basestation connect/disconnect notification port on the caster to proxy
 
 @throws: This function can throw exceptions
@@ -110,13 +178,75 @@ This thread safe function adds a new caster to proxy.  The function may have som
 void addProxy(const std::string &inputClientRequestConnectionString, const std::string &inputBasestationPublishingConnectionString, const std::string &inputConnectDisconnectNotificationConnectionString);
 
 /**
-This thread safe function removes a foreign caster from monitoring by this caster.
+This thread safe function starts adding a new caster to proxy and returns without waiting for it.  The caster starts listening to the foreign caster's notifications and updates and then queries it for the metadata of its basestations (retrying with backoff up to PROXY_BOOTSTRAP_MAXIMUM_ATTEMPTS times), registering all of them in one batch.  Any number of proxies can be in the process of being added at once.  Adding a caster which is already proxied succeeds once its first addition has.
+@param inputClientRequestConnectionString: The ZMQ connection string to use to connect to the client query answering port of the caster to proxy
+@param inputBasestationPublishingConnectionString: The ZMQ connection string to use to connect to the interface that publishes the basestation updates (see addProxy)
+@param inputConnectionDisconnectionNotificationConnectionString: The ZMQ connection string to use to connect to the basestation connect/disconnect notification port on the caster to proxy
+@return: A future which becomes ready once the proxy is established (get() throws if it could not be, in which case the caster stops listening to the foreign caster)
+
+@throws: This function can throw exceptions
+*/
+std::future<void> addProxyAsync(const std::string &inputClientRequestConnectionString, const std::string &inputBasestationPublishingConnectionString, const std::string &inputConnectDisconnectNotificationConnectionString);
+
+/**
+This thread safe function removes a foreign caster from monitoring by this caster and waits until it has been removed (see removeProxyAsync).
 @param inputClientRequestConnectionString: The ZMQ connection string used to send a query to the foreign caster
 
 @throws: This function can throw exceptions
 */
 void removeProxy(const std::string &inputClientRequestConnectionString);
 
+/**
+This thread safe function starts removing a foreign caster from monitoring by this caster and returns without waiting for it.  If the caster is still being added, the addition fails.
+@param inputClientRequestConnectionString: The ZMQ connection string used to send a query to the foreign caster
+@return: A future which becomes ready once the caster has been removed
+
+@throws: This function can throw exceptions
+*/
+std::future<void> removeProxyAsync(const std::string &inputClientRequestConnectionString);
+
+/**
+This thread safe function returns true if the caster has handed off its state to a replacement caster.  Once that happens, new connections go to the replacement, so the caster should be shut down after serving its existing connections for STATE_HANDOFF_DRAIN_TIME.
+@return: true if the state has been handed off
+*/
+bool hasHandedOffState();
+
+/**
+This thread safe function returns how many client subscriptions there currently are for each of the streams published by this caster (only streams with at least one subscription are included).  Subscriptions which match every stream of this caster are not included (see getAllClientStreamsSubscriberCount).
+@return: A map of localStreamID -> number of subscriptions
+*/
+std::map<int64_t, int64_t> getClientStreamSubscriberCounts();
+
+/**
+This thread safe function returns how many client subscriptions there currently are which match every stream published by this caster (such as an empty subscription or one to just the caster ID).
+@return: The number of subscriptions
+*/
+int64_t getAllClientStreamsSubscriberCount();
+
+/**
+This thread safe function returns how many messages have been dropped for each stream because the transmitter exceeded its rate limit or the global ingest budget was used up (only streams with drops are included).
+@return: A map of localStreamID -> number of dropped messages
+*/
+std::map<int64_t, uint64_t> getStreamIngestDropCounts();
+
+/**
+This thread safe function returns how many messages of each station class have been published/dropped/are waiting and how long the published ones waited.
+@return: A map of station class -> publishing counters
+*/
+std::map<base_station_class, stationClassPublishingStatistics> getStationClassPublishingStatistics();
+
+/**
+This thread safe function returns the latency histograms of the traced messages this caster has published.  Hop times come from the monotonic clock, so only traces from transmitters/casters on the same machine are meaningful.
+@return: The histograms
+*/
+latency_trace_report getLatencyTraceReport();
+
+/**
+This thread safe function returns the caster's metrics (connections by class, messages/bytes in and out, signature failures, event queue sizes, database request/query latency histograms, proxy counts and lag) in the Prometheus text exposition format.  This is what is served on the metrics port.
+@return: The metrics
+*/
+std::string getPrometheusMetrics();
+
 /**
 This function signals for the threads to shut down and then waits for them to do so.
 */
@@ -129,68 +259,152 @@ uint32_t clientRequestPortNumber;
 uint32_t clientStreamPublishingPortNumber;
 uint32_t proxyStreamPublishingPortNumber;
 uint32_t streamStatusNotificationPortNumber;
+uint32_t keyRegistrationAndRemovalPortNumber;
+uint32_t metricsPortNumber; //0 if metrics are not served
 std::string databaseConnectionString; //The connection string to use to connect to the associated SQLITE database
 std::string casterPublicKey;
 std::string addRemoveProxyConnectionString;
+std::string stateHandoffConnectionString; //The address the state handoff interface is bound to (empty if there isn't one)
+
+friend class casterBenchmarkAccess; //Lets the benchmarks executable time private hot paths (query generation/execution, credential checks) directly
 
 private:
 std::string shutdownPublishingConnectionString; //string to use for inproc connection for receiving notifications for when the threads associated with this object should shut down
 std::string databaseAccessConnectionString; //String to use for inproc connection to send requests to modify the database
 std::string casterSecretKey;
+std::atomic<bool> stateHasBeenHandedOff; //Set by the streamRegistrationAndPublishingReactor once the state has been sent to a replacement caster
 
 //Owned by streamRegistrationAndPublishingThread
 std::string signingKeysManagementKey; //The public key of the entity allowed to add/remove sigining keys (registration taken care of in streamRegistrationAndPublishingThread)
 std::set<std::string> officialSigningKeys; //A list of acceptable signing keys for "Official" basestations
 std::set<std::string> registeredCommunitySigningKeys; //A list of acceptable signing keys for "Registered Community" basestations
 std::set<std::string> blacklistedSigningKeys; //A list of all signing keys that have been blacklisted
+verifiedCredentialsCache verifiedCredentials; //Results of checkCredentials, cleared whenever the signing key lists change
 
-//See article on key management for how these maps are used
-std::multimap<std::string, std::string> signingKeyToConnectionKeys;
-std::multimap<std::string, std::string> connectionKeyToSigningKeys;
-std::multimap<std::string, std::string> connectionKeyToAuthenticatedConnectionIDs;
-std::map<std::string, std::string> authenticatedConnectionIDToConnectionKey;
+//See article on key management for how these relationships are used: signing key <-> connection keys it signed <-> authenticated connection IDs using the connection key
+keyGraph authenticationKeys;
 
 //Used to keep track of the current status of each basestation connection
 int64_t lastAssignedConnectionID = 0; //Incremented to make unique streamIDs
 std::map<std::string, connectionStatus> connectionIDToConnectionStatus;
 
+//Used to skip publishing streams that no client is subscribed to (only changed by streamRegistrationAndPublishingThread, locked so the counts can be read by other threads)
+std::mutex clientStreamSubscriberCountsMutex;
+std::map<int64_t, int64_t> localStreamIDToClientSubscriberCount; //localStreamID -> number of client subscriptions to that specific stream
+int64_t allClientStreamsSubscriberCount = 0; //Number of client subscriptions that match all of this caster's streams
+
+//Subscriptions of downstream proxies to the proxyStreamPublishingInterface, which are added to the clients' when deciding what to receive from upstream casters (only used by streamRegistrationAndPublishingThread)
+std::map<int64_t, int64_t> localStreamIDToProxySubscriberCount; //localStreamID -> number of proxy subscriptions to that specific stream
+int64_t allProxyStreamsSubscriberCount = 0; //Number of proxy subscriptions that match all of this caster's streams
+std::map<int64_t, lastMessageCache> localStreamIDToLastMessageCache; //The most recent station description messages (with header) of each stream, replayed when a client subscribes to the stream
+
+//Used to shed messages from transmitters sending faster than they should (owned by streamRegistrationAndPublishingThread)
+double ingestBurstSize;
+tokenBucket globalIngestRateLimiter; //Shared by all non-OFFICIAL connections
+std::mutex ingestDropCountsMutex; //Locked when streams are added to/removed from the drop counts (the counts themselves are atomic, so each connection keeps a pointer to its own)
+std::map<int64_t, std::atomic<uint64_t> > localStreamIDToNumberOfDroppedMessages;
+tokenBucket registrationAdmissionRateLimiter; //Shared by all transmitter registrations
+
+//The catalog of the streams (local and proxied) is kept here and updated as streams are added/removed, while the database used to answer client queries is updated behind it in batches (owned by streamRegistrationAndPublishingThread)
+std::map<int64_t, base_station_stream_information> localStreamIDToCatalogEntry;
+database_request pendingCatalogWrites; //Registrations/deletions waiting for flushCatalogWrites
+
+//Messages are queued by station class and published by publishQueuedMessages (owned by streamRegistrationAndPublishingThread, other threads only read the queues' atomic counters)
+std::map<base_station_class, stationClassPublishingQueue> stationClassToPublishingQueue;
+bool addStreamFrameHeaders; //True if stream frame headers are added to forwarded messages (see streamFrameHeader.hpp)
+uint32_t traceSamplingInterval; //1 of every this many ingested messages are traced (0 to only trace messages traced by their transmitters)
+uint64_t numberOfMessagesSinceLastTraceSample = 0;
+latencyTracer publishedMessageTracer; //Traces are added as messages are published
+
+//Updated by all of the reactor threads with relaxed atomic operations and read when the metrics are scraped
+timeSource *casterTimeSource; //Not owned
+casterMetrics metrics;
+std::map<int64_t, std::atomic<int64_t> *> foreignCasterIDToLastProxyMessageTime; //Slots in metrics, cached so the metrics lock is only taken the first time a caster sends (owned by streamRegistrationAndPublishingThread)
+
 //Owned by statistics gathering thread
 int mapUpdateIndex = 0; //The appropriate position to start in the map with the next update cycle.
 std::map<int64_t, int64_t> basestationIDToCreationTime; //Resolves when basestation was made (Poco timestamp timevalue)
 std::map<int64_t, int64_t> basestationIDToNumberOfSentMessages; //Keeps track of how many messages each basestation has sent
 
 
-//This map translates from the caster to proxies labeling system to that of this caster casterID -> (streamID -> localStreamID)
-std::map<int64_t, std::map<int64_t, int64_t> > casterIDToMapFromOriginalBasestationIDToLocalBasestationID;
+//This table translates from the proxied casters' labeling system to that of this caster (foreign casterID, foreign streamID) -> local stream ID, last message time, pending timeout, etc
+proxyStreamTable proxyStreams;
+std::map<int64_t, int64_t> foreignCasterIDToNumberOfProxiedStreams; //Used to tell when the last stream of a proxied caster is removed
 
 //This map stores the connect strings for each of the current casters to proxy client_request_connection_string -> <client_request_connection_string, connect_disconnect_notification_connection_string, base_station_publishing_connection_string>
 std::map<std::string, std::tuple<std::string, std::string, std::string> > clientRequestConnectionStringToCasterConnectionStrings; 
 
-//Used to determine if a proxied basestation has timed out localID -> poco timestamp
-std::map<int64_t, Poco::Timestamp> localBasestationIDToLastMessageTimestamp;
+//The proxies which have been added but whose basestations haven't been retrieved yet client_request_connection_string -> status
+std::map<std::string, proxyBootstrapStatus> clientRequestConnectionStringToProxyBootstrapStatus;
+std::map<zmq::socket_t *, std::string> proxyQuerySocketToClientRequestConnectionString; //The ephemeral sockets waiting for the foreign casters' replies
+
+//Used to only receive the proxied streams that local clients are subscribed to
+std::map<int64_t, std::pair<int64_t, int64_t> > localBasestationIDToForeignCasterIDAndStreamID; //localID -> <foreign casterID, foreign streamID>
+std::set<std::string> proxyUpstreamSubscriptions; //The prefixes proxiesUpdatesListeningSocket is subscribed to ("" for all streams)
+std::map<std::string, Poco::Timestamp::TimeVal> proxyUpstreamSubscriptionToRemovalTime; //Subscriptions which are no longer wanted -> when they are scheduled to be dropped
 
 
 /**
 This function initializes the class, creates the associated database, and starts the two threads associated with it (used in constructors).
 @param inputContext: The ZMQ context that this object should use
-@param inputCasterID: The 64 bit ID associated with this caster (make sure it does not collide with caster IDs the clients are likely to run into)
-@param inputTransmitterRegistrationAndStreamingPortNumber: The port number to register the ZMQ router socket used for receiving PylonGPS transmitter registrations/streams
-@param inputClientRequestPortNumber: The port to open to receive client requests (including requests from proxies for the list of sources)
-@param inputClientStreamPublishingPortNumber: The port to open for the interface to publish stream data to clients
-@param inputProxyStreamPublishingPortNumber: The port to open for the interface to publish stream data to proxies (potentially higher priority)
-@param inputStreamStatusNotificationPortNumber: The port for the interface that is used to to publish stream status changes
-@param inputKeyRegistrationAndRemovalPortNumber: The port for the interface that is used to add/remove 
-@param inputCasterPublicKey: The public key for this caster to use for encryption/authentation
-@param inputCasterSecretKey: The secret key for this caster to use for encryption/authentation
-@param inputSigningKeysManagementKey: The signing key that has permission to add/remove allowed signing keys from the caster
-@param inputOfficialSigningKeys: A list of the initial set of approved keys for official basestations
-@param inputRegisteredCommunitySigningKeys: A list of the initial set of approved keys for registered community basestations
-@param inputBlacklistedKeys: A list of signing keys not to trust 
-@param inputCasterSQLITEConnectionString: The connection string used to connect to or create the SQLITE database used for stream source entry management and query resolution.  If an empty string is given (by default), it will connect/create an in memory database with a random 64 bit number string (example: "file:9735926149617295559?mode=memory&cache=shared")
+@param inputConfiguration: The configuration of the caster (see caster_configuration.proto)
+@param inputTimeSource: The source of the current time for all timeouts/expirations (the wall clock if nullptr, a virtualTimeSource lets tests simulate hours in seconds).  It must outlive the caster
 
 @throws: This function can throw exceptions
 */
-void commonConstructor(zmq::context_t *inputContext, int64_t inputCasterID, uint32_t inputTransmitterRegistrationAndStreamingPortNumber, uint32_t inputClientRequestPortNumber, uint32_t inputClientStreamPublishingPortNumber, uint32_t inputProxyStreamPublishingPortNumber, uint32_t inputStreamStatusNotificationPortNumber, uint32_t inputKeyRegistrationAndRemovalPortNumber, const std::string &inputCasterPublicKey, const std::string &inputCasterSecretKey, const std::string &inputSigningKeysManagementKey, const std::vector<std::string> &inputOfficialSigningKeys, const std::vector<std::string> &inputRegisteredCommunitySigningKeys, const std::vector<std::string> &inputBlacklistedKeys, const std::string &inputCasterSQLITEConnectionString = "");
+void commonConstructor(zmq::context_t *inputContext, const caster_configuration &inputConfiguration, timeSource *inputTimeSource);
+
+/**
+This function sends a caster_state_handoff_request to the caster being replaced and waits for its state.  The caster being replaced keeps its listening sockets, which share their ports with this caster's (see bindZMQSocketToSharedTCPPort), and serves its existing connections until it shuts down.
+@param inputPreviousCasterStateHandoffConnectionString: The address of the state handoff interface of the caster being replaced
+@param inputStateBuffer: The message to store the retrieved state in
+
+@throws: This function can throw exceptions
+*/
+void retrieveStateFromPreviousCaster(const std::string &inputPreviousCasterStateHandoffConnectionString, caster_state_handoff_reply &inputStateBuffer);
+
+/**
+This function loads the state retrieved from a caster being replaced into the maps/sets and the database.  It is called in commonConstructor before the reactors are started.
+@param inputState: The state to load
+@param inputProxiesUpdatesListeningSocket: The socket to connect to the update publishers of the proxied casters
+@param inputProxiesNotificationsListeningSocket: The socket to connect to the notification publishers of the proxied casters
+@param inputStartingEventsBuffer: The vector to add the events the streamRegistrationAndPublishingReactor should start with to
+
+@throws: This function can throw exceptions
+*/
+void loadStateHandoffReply(const caster_state_handoff_reply &inputState, zmq::socket_t &inputProxiesUpdatesListeningSocket, zmq::socket_t &inputProxiesNotificationsListeningSocket, std::vector<event> &inputStartingEventsBuffer);
+
+/**
+This function sets the ingest rate limit of a connection based on the expected update rate it declared and whether it is exempt from the global ingest budget based on its class.
+@param inputConnectionStatus: The status of the connection to set the limits of
+@param inputStreamInfo: The information the connection registered with
+@param inputCurrentTime: The current time (microseconds since the epoch)
+*/
+void setConnectionIngestLimits(connectionStatus &inputConnectionStatus, const base_station_stream_information &inputStreamInfo, Poco::Timestamp::TimeVal inputCurrentTime);
+
+/**
+This function makes the timeout event for a connection and records it as the connection's one pending timeout (any event scheduled for it before is ignored when it fires).  Messages from the connection only update its last message time, so the event queue holds one timeout per connection rather than one per message.
+@param inputConnectionID: The connection to schedule the timeout for
+@param inputIsAuthenticated: True if the connection is authenticated
+@param inputTimeoutTime: When the timeout should be checked (microseconds since the epoch)
+@param inputConnectionStatus: The status of the connection (its timeoutEventTime is set)
+@return: The event, which should be added to the event queue
+*/
+event createConnectionTimeoutEvent(const std::string &inputConnectionID, bool inputIsAuthenticated, Poco::Timestamp::TimeVal inputTimeoutTime, connectionStatus &inputConnectionStatus);
+
+/**
+This function makes the timeout event for a proxied stream and records it as the stream's one pending timeout (any event scheduled for it before is ignored when it fires).
+@param inputProxyStream: The proxyStreams entry of the stream (its timeoutEventTime is set)
+@param inputTimeoutTime: When the timeout should be checked (microseconds since the epoch)
+@return: The event, which should be added to the event queue
+*/
+event createProxyStreamTimeoutEvent(proxyStreamTableEntry &inputProxyStream, Poco::Timestamp::TimeVal inputTimeoutTime);
+
+/**
+This function decides if the next message ingested by the caster should be sampled for latency tracing (one of every traceSamplingInterval messages).
+@return: true if the message should be traced
+*/
+bool shouldSampleMessageForTracing();
 
 /**
 This function processes any events that are scheduled to have occurred by now and returns when the next event is scheduled to occur.  Which thread is calling this function is determined by the type of events in the event queue.
@@ -202,9 +416,9 @@ This function processes any events that are scheduled to have occurred by now an
 Poco::Timestamp handleEvents(std::priority_queue<pylongps::event> &inputEventQueue);
 
 /**
-This function processes any events that are scheduled to have occurred by now and returns when the next event is scheduled to occur.
+This function processes any events that are scheduled to have occurred by now and returns when the next event is scheduled to occur.  When called by the streamRegistrationAndPublishingReactor, it first publishes queued stream messages (see publishQueuedMessages) and flushes queued catalog writes (see flushCatalogWrites).
 @param inputReactor: The reactor to process events for
-@return: The time point associated with the soonest event timeout (negative if there are no outstanding events)
+@return: The time point associated with the soonest event timeout (negative if there are no outstanding events, the current time if events have queued catalog writes).  Messages left waiting to be published don't make it return early, since they are only left when stream data is waiting to be received (which wakes the reactor's poll)
 
 @throws: This function can throw exceptions
 */
@@ -217,13 +431,29 @@ std::unique_ptr<sqlite3, decltype(&sqlite3_close_v2)> databaseConnection; //Poin
 std::unique_ptr<messageDatabaseDefinition> basestationToSQLInterface; //Allows storage/retrieval of base_station_stream_information objects in the database
 
 //Interfaces
-std::unique_ptr<zmq::socket_t> clientStreamPublishingInterface; ///A ZMQ PUB socket which publishes all data associated with all streams with the caster ID and stream ID preappended for clients to subscribe.  Used by streamRegistrationAndPublishingThread.
-std::unique_ptr<zmq::socket_t> proxyStreamPublishingInterface; ///A ZMQ PUB socket which publishes all data associated with all streams with the caster ID and stream ID preappended for clients to subscribe.  Used by streamRegistrationAndPublishingThread.
+std::unique_ptr<zmq::socket_t> clientStreamPublishingInterface; ///A ZMQ XPUB socket which publishes the data associated with each stream that has subscribers with the caster ID and stream ID preappended for clients to subscribe.  Owned by streamRegistrationAndPublishingReactor (which tracks the subscriptions) once it is started.
+std::unique_ptr<zmq::socket_t> proxyStreamPublishingInterface; ///A ZMQ XPUB socket which publishes all data associated with all streams with the caster ID and stream ID preappended for proxies to subscribe.  Owned by streamRegistrationAndPublishingReactor (which adds the proxies' subscriptions to the upstream demand) once it is started.
 std::unique_ptr<zmq::socket_t> streamStatusNotificationInterface; ///A ZMQ PUB socket which publishes stream_status_update messages.  Used by streamRegistrationAndPublishingThread.
 
-//Functions and objects used internally
-std::string internalNotificationPublisherConnectionString; //The connection string to use to connect to the publish
-std::unique_ptr<zmq::socket_t> internalNotificationPublisher; //A ZMQ PUB socket which is used to publish stream_status_update about the basestations that the caster is currently proxying (but might not have the metadata for)
+//Used by addProxyAsync/removeProxyAsync to get the results of their operations from the streamRegistrationAndPublishingReactor
+std::mutex proxyOperationPromisesMutex;
+int64_t nextProxyOperationID = 1; //Guarded by proxyOperationPromisesMutex
+std::map<int64_t, std::promise<void> > proxyOperationIDToPromise; //Guarded by proxyOperationPromisesMutex
+
+/**
+This function sends an add_remove_proxy_request to the streamRegistrationAndPublishingReactor and waits for it to be accepted.  The result of the operation is reported through the promise associated with its operation ID.
+@param inputRequest: The request to send
+
+@throws: This function can throw exceptions
+*/
+void sendAddRemoveProxyRequest(const add_remove_proxy_request &inputRequest);
+
+/**
+This function reports the result of an addProxyAsync/removeProxyAsync operation to the caller.  Operation IDs without a waiting caller are ignored.
+@param inputOperationID: The ID of the operation
+@param inputFailureMessage: Why the operation failed (empty if it succeeded)
+*/
+void completeProxyOperation(int64_t inputOperationID, const std::string &inputFailureMessage = "");
 
 //Ensure reactors are destroyed before publishing sockets
 std::unique_ptr<reactor<caster> > clientAndDatabaseRequestHandlingReactor; //Handles client requests and requests by the stream registration and statistics threads to make changes to the database
@@ -232,7 +462,7 @@ std::unique_ptr<reactor<caster> > statisticsGatheringReactor; //This reactor ana
 
 
 /**
-This function adds a authenticated connection by placing it in the associated maps/sets and the database.  The call is ignored if the connection key is not found in connectionKeyToSigningKeys, so addConnectionKey should have been called first for the connection key.
+This function adds a authenticated connection by placing it in the associated maps/sets and the database.  The call is ignored if the connection key is not found in authenticationKeys, so addConnectionKey should have been called first for the connection key.
 @param inputConnectionID: The ZMQ connection ID string of the connection to add
 @param inputConnectionKey: The ZMQ CURVE key that is being used with this connection (connection key)
 @param inputConnectionStatus: The current status of the connection
@@ -272,6 +502,15 @@ This function removes the given connection key from the maps and removes all ass
 */
 void removeConnectionKey(const std::string &inputConnectionKey, reactor<caster> &inputReactor);
 
+/**
+This function removes the given connection key from authenticationKeys and removes all associated connections.
+@param inputConnectionKeyNodeID: The authenticationKeys node of the connection key to remove
+@param inputReactor: The reactor that is calling the function
+
+@throws: This function can throw exceptions
+*/
+void removeConnectionKey(uint32_t inputConnectionKeyNodeID, reactor<caster> &inputReactor);
+
 /**
 This function adds a new signing key and schedules its timeout.
 @param inputSigningKey: The signing key to add
@@ -348,6 +587,46 @@ This function handles processes the reply to ephemeral sockets which are used to
 */
 bool processCasterProxyQueryReply(reactor<caster> &inputReactor, zmq::socket_t &inputSocket);
 
+/**
+This function queries a caster that is being added as a proxy for the metadata of its basestations using a new ephemeral socket (see processCasterProxyQueryReply) and schedules the query's timeout.
+@param inputReactor: The reactor that is calling the function
+@param inputClientRequestConnectionString: The connection string the proxy was added with
+
+@throws: This function can throw exceptions
+*/
+void sendProxyBootstrapQuery(reactor<caster> &inputReactor, const std::string &inputClientRequestConnectionString);
+
+/**
+This function handles a failed query to a caster being added as a proxy.  The query is retried after a delay which doubles with each failure until PROXY_BOOTSTRAP_MAXIMUM_ATTEMPTS have failed, at which point the proxy is removed and the callers waiting for it are told that it failed.
+@param inputReactor: The reactor that is calling the function
+@param inputClientRequestConnectionString: The connection string the proxy was added with
+@param inputFailureMessage: Why the query failed
+
+@throws: This function can throw exceptions
+*/
+void handleFailedProxyBootstrapQuery(reactor<caster> &inputReactor, const std::string &inputClientRequestConnectionString, const std::string &inputFailureMessage);
+
+/**
+This function disconnects from a proxied caster's notification and update interfaces and forgets its connection strings.  Its streams are left to time out.
+@param inputReactor: The reactor that is calling the function
+@param inputClientRequestConnectionString: The connection string the proxy was added with
+
+@throws: This function can throw exceptions
+*/
+void stopProxyingCaster(reactor<caster> &inputReactor, const std::string &inputClientRequestConnectionString);
+
+/**
+This function starts proxying a stream of a foreign caster: it gives the stream a local ID, updates the associated maps, announces the stream on the stream status notification interface and schedules its timeout.  Streams which are already being proxied are skipped.
+@param inputReactor: The reactor that is calling the function
+@param inputForeignCasterID: The ID of the caster the stream is proxied from
+@param inputForeignStreamID: The ID of the stream on that caster
+@param inputStreamInfo: The foreign caster's information for the stream (its base_station_id is changed to the local stream ID)
+@return: true if the stream was added (so it should be registered with the database)
+
+@throws: This function can throw exceptions
+*/
+bool addProxyStream(reactor<caster> &inputReactor, int64_t inputForeignCasterID, int64_t inputForeignStreamID, base_station_stream_information &inputStreamInfo);
+
 /**
 This function handles notifications of new or removed sockets from casters that this caster is proxying.  It expects to receive stream_status_update messages with caster ID and stream ID preappended.
 @param inputReactor: The reactor that is calling the function
@@ -359,7 +638,7 @@ This function handles notifications of new or removed sockets from casters that
 bool listenForProxyNotifications(reactor<caster> &inputReactor, zmq::socket_t &inputSocket);
 
 /**
-This function handles updates from the foreign casters this caster has started proxying.  It expects binary blobs with casterID, streamID preappended.  It also schedules timeout events for each stream and updates their last message received times.
+This function handles updates from the foreign casters this caster has started proxying.  It processes up to MAXIMUM_INGEST_BATCH_SIZE waiting updates (see processProxyUpdate) so that they can be published in priority order.
 @param inputReactor: The reactor that is calling the function
 @param inputSocket: The socket
 @return: true if the polling cycle should restart before processing any more messages
@@ -368,6 +647,77 @@ This function handles updates from the foreign casters this caster has started p
 */
 bool listenForProxyUpdates(reactor<caster> &inputReactor, zmq::socket_t &inputSocket);
 
+/**
+This function handles an update from the foreign casters this caster has started proxying.  It expects binary blobs with casterID, streamID preappended, which are queued for publishing by the class of the stream.  It also updates the last message received times that the streams' pending timeout events check.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+
+@throws: This function can throw exceptions
+*/
+void processProxyUpdate(reactor<caster> &inputReactor, zmq::socket_t &inputSocket);
+
+/**
+This function publishes the queued messages in batches of up to MAXIMUM_PUBLISHING_BATCH_SIZE.  The queues of the station classes are serviced in weighted rounds (highest priority class first), with each class publishing up to its weight in messages per round.  After each batch, it stops early if stream data is waiting on the ingest sockets so that it can be queued (and prioritized) with the rest.
+@param inputReactor: The reactor that is calling the function (streamRegistrationAndPublishingReactor)
+@return: true if there are still messages waiting to be published (only when stream data is waiting to be received, so the reactor's poll returns immediately)
+
+@throws: This function can throw exceptions
+*/
+bool publishQueuedMessages(reactor<caster> &inputReactor);
+
+/**
+This function processes the subscription messages received by the clientStreamPublishingInterface XPUB socket and updates the number of subscribers for each stream.  When a stream is subscribed to, its cached station description messages are published again so that the new subscriber gets them immediately.  Subscriptions are interpreted by parseStreamSubscription.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+@return: true if the polling cycle should restart before processing any more messages
+
+@throws: This function can throw exceptions
+*/
+bool processClientStreamSubscription(reactor<caster> &inputReactor, zmq::socket_t &inputSocket);
+
+/**
+This function processes the subscription messages received by the proxyStreamPublishingInterface XPUB socket and updates the number of downstream proxy subscribers for each stream, so that chained proxies only pull the streams someone at the end of the chain wants.  Subscriptions to just this caster's ID are how the statisticsGatheringThread listens to every stream, so they don't count as demand.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+@return: true if the polling cycle should restart before processing any more messages
+
+@throws: This function can throw exceptions
+*/
+bool processProxyStreamSubscription(reactor<caster> &inputReactor, zmq::socket_t &inputSocket);
+
+/**
+This function makes the subscriptions of the proxiesUpdatesListeningSocket match the proxied streams that local clients or downstream proxies are subscribed to.  New subscriptions are made immediately, while subscriptions which are no longer wanted are dropped after PROXY_UPSTREAM_UNSUBSCRIBE_LINGER_TIME so that clients which quickly resubscribe don't cause churn.
+@param inputReactor: The reactor that is calling the function (streamRegistrationAndPublishingReactor)
+
+@throws: This function can throw exceptions
+*/
+void updateProxyUpstreamSubscriptions(reactor<caster> &inputReactor);
+
+/**
+This function returns true if proxiesUpdatesListeningSocket is currently subscribed to the given foreign stream (either directly or by subscribing to all streams).
+@param inputForeignCasterID: The ID of the foreign caster
+@param inputForeignStreamID: The ID of the stream on the foreign caster
+@return: true if updates for the stream are being received
+*/
+bool proxyStreamIsSubscribedUpstream(int64_t inputForeignCasterID, int64_t inputForeignStreamID);
+
+/**
+This function returns true if any client is subscribed to the given stream (or to all of the streams of this caster).  It is only called from the streamRegistrationAndPublishingReactor, which is the only thread that changes the counts, so it does not need to lock.
+@param inputStreamID: The local ID of the stream to check
+@return: true if the stream's messages should be published to clients
+*/
+bool streamHasClientSubscribers(int64_t inputStreamID);
+
+/**
+This function processes caster_state_handoff_request messages from a replacement caster.  It replies with the keys, connections, catalog and proxies of this caster.  The TCP interfaces are left bound, since unbinding would close every connection accepted on them at once.  The replacement binds the same ports (see bindZMQSocketToSharedTCPPort) and gets the new connections, while this caster keeps serving the existing ones until it is shut down (see STATE_HANDOFF_DRAIN_TIME).
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+@return: true if the polling cycle should restart before processing any more messages
+
+@throws: This function can throw exceptions
+*/
+bool processStateHandoffRequest(reactor<caster> &inputReactor, zmq::socket_t &inputSocket);
+
 /**
 This function checks if the databaseAccessSocket has received a database_request message and (if so) processes the message and sends a database_reply in response.
 @param inputReactor: The reactor that is calling the function
@@ -388,9 +738,19 @@ This function checks if the clientRequestInterface has received a client_query_r
 */
 bool processClientQueryRequest(reactor<caster> &inputReactor, zmq::socket_t &inputSocket);
 
+/**
+This function handles the ZMQ_STREAM metricsInterface.  Each HTTP GET request received is answered with the current metrics in the Prometheus text format (or, for GET /trace, with a dump of the process's trace rings which can be read with the traceDecoder tool), after which the connection is closed.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+@return: true if the polling cycle should restart before processing any more messages
+
+@throws: This function can throw exceptions
+*/
+bool processMetricsRequest(reactor<caster> &inputReactor, zmq::socket_t &inputSocket);
+
 
 /**
-This function processes messages from the transmitterRegistrationAndStreamingInterface.  A connection is expected to start with a transmitter_registration_request, to which this object replies with a transmitter_registration_reply.  Thereafter, the messages received are forwarded to the associated publisher interfaces until the publisher stops sending for an unacceptably long period (SECONDS_BEFORE_CONNECTION_TIMEOUT), at which point the object erases the associated the associated metadata and publishes that the base station disconnected.  In the authenticated case, the preapended signature is removed and checked.  If authentication fails, packet is dropped (eventually timing out).
+This function processes messages from the transmitterRegistrationAndStreamingInterface.  A connection is expected to start with a transmitter_registration_request, to which this object replies with a transmitter_registration_reply.  Thereafter, the messages received are forwarded to the associated publisher interfaces until the publisher stops sending for an unacceptably long period (SECONDS_BEFORE_CONNECTION_TIMEOUT), at which point the object erases the associated the associated metadata and publishes that the base station disconnected.  In the authenticated case, the preapended signature is removed and checked.  If authentication fails, packet is dropped (eventually timing out).  Up to MAXIMUM_INGEST_BATCH_SIZE waiting messages are processed in each call so that the stream data can be published in priority order (see publishQueuedMessages).
 @param inputReactor: The reactor that is calling the function
 @param inputSocket: The socket
 @return: true if the polling cycle should restart before processing any more messages
@@ -399,6 +759,15 @@ This function processes messages from the transmitterRegistrationAndStreamingInt
 */
 bool processAuthenticatedOrUnauthenticatedTransmitterRegistrationAndStreamingMessage(reactor<caster> &inputReactor, zmq::socket_t &inputSocket);
 
+/**
+This function processes a single message from the transmitterRegistrationAndStreamingInterface (see processAuthenticatedOrUnauthenticatedTransmitterRegistrationAndStreamingMessage).  Stream data is queued for publishing by the class of the stream rather than being published immediately.
+@param inputReactor: The reactor that is calling the function
+@param inputSocket: The socket
+
+@throws: This function can throw exceptions
+*/
+void processTransmitterRegistrationOrStreamingMessage(reactor<caster> &inputReactor, zmq::socket_t &inputSocket);
+
 /**
 This function processes reply messages sent to registrationDatabaseRequestSocket.  It expects database operations to succeed, so it throws an exception upon receiving a failure message.
 @param inputReactor: The reactor that is calling the function
@@ -460,6 +829,26 @@ This function is used inside the streamRegistrationAndPublishingReactor to remov
 */
 void deleteProxyStream(reactor<caster> &inputReactor, int64_t inputCasterID, int64_t inputStreamID, base_station_removal_reason inputReason);
 
+/**
+This function adds a stream to the catalog and queues its registration with the database (see flushCatalogWrites).
+@param inputStreamInfo: The information of the stream (base_station_id is the local stream ID)
+*/
+void addToCatalog(const base_station_stream_information &inputStreamInfo);
+
+/**
+This function removes a stream from the catalog and queues its deletion from the database (see flushCatalogWrites).  A stream whose registration hasn't been flushed yet is simply dropped from the queue.
+@param inputLocalStreamID: The local ID of the stream
+*/
+void removeFromCatalog(int64_t inputLocalStreamID);
+
+/**
+This function sends the queued catalog registrations/deletions to the database as a single request, which it applies in one transaction.  The streamRegistrationAndPublishingReactor calls it each time around its poll loop, so the writes of everything handled in one pass are batched together.
+@param inputReactor: The reactor that is calling the function
+
+@throws: This function can throw exceptions
+*/
+void flushCatalogWrites(reactor<caster> &inputReactor);
+
 /**
 This function generates the complete query string required to get all of the ids of the stations that meet the query's requirements.
 @param inputRequest: This is the request to generate the query string for
@@ -487,12 +876,20 @@ This (non-threadsafe) function generates new unique (sequential) connection ids.
 int64_t getNewStreamID();
 
 /**
-This function checks whether the permissions in a credentials message are considered valid according to the current lists of trusted keys.  
+This function checks whether the permissions in a credentials message are considered valid according to the current lists of trusted keys.  Results are cached (see verifiedCredentialsCache), so credentials which have been seen before since the key lists last changed don't have their signatures verified again.
 @param inputCredentials: The credentials giving the permissions/signing keys
 @param inputAuthorizedPermissionsBuffer: The object to return the authorized_permissions with
 @return: A tuple of <messageIsValid, isSignedByOfficialEntityKey, isSignedByRegisteredCommunityKey>
 */
 std::tuple<bool, bool, bool> checkCredentials(credentials &inputCredentials, authorized_permissions &inputAuthorizedPermissionsBuffer);
+
+/**
+This function does the work of checkCredentials without the cache: it verifies each signature and parses the permissions.
+@param inputCredentials: The credentials giving the permissions/signing keys
+@param inputAuthorizedPermissionsBuffer: The object to return the authorized_permissions with
+@return: A tuple of <messageIsValid, isSignedByOfficialEntityKey, isSignedByRegisteredCommunityKey>
+*/
+std::tuple<bool, bool, bool> verifyCredentials(credentials &inputCredentials, authorized_permissions &inputAuthorizedPermissionsBuffer);
 };
 
 /**
@@ -505,6 +902,63 @@ This function makes it easier to process messages from a ZMQ router socket.  It
 */
 bool retrieveRouterMessage(zmq::socket_t &inputSocket, std::vector<std::string> &inputMessageBuffer);
 
+/**
+This function checks if a socket has a message waiting to be received (without receiving it).
+@param inputSocket: The socket to check
+@return: true if a message can be received without blocking
+
+@throws: This function can throw exceptions
+*/
+bool socketHasMessageWaiting(zmq::socket_t &inputSocket);
+
+/**
+This function generates the ZMQ subscription prefix used to receive a particular stream from a caster (caster ID and stream ID in network byte order).
+@param inputCasterID: The ID of the caster publishing the stream
+@param inputStreamID: The ID of the stream
+@return: The subscription prefix
+*/
+std::string generateStreamSubscriptionPrefix(int64_t inputCasterID, int64_t inputStreamID);
+
+/**
+This function interprets a subscription message received by an XPUB socket which publishes a caster's streams.  Subscriptions are expected to be casterID/streamID prefixes, so a subscription which is a prefix of the caster's ID matches all of its streams and a subscription with another caster's ID matches none of them.
+@param inputMessage: The subscription message (1 for subscribe or 0 for unsubscribe followed by the prefix)
+@param inputCasterID: The ID of the caster publishing the streams
+@param outputCountChange: 1 for a subscription and -1 for an unsubscription
+@param outputStreamID: The ID of the subscribed stream or -1 if the subscription matches all of them
+@return: true if the message changes the subscriptions to the caster's streams
+*/
+bool parseStreamSubscription(const zmq::message_t &inputMessage, int64_t inputCasterID, int64_t &outputCountChange, int64_t &outputStreamID);
+
+/**
+This function checks if stream information has the fields which the caster's database requires of each stream in its catalog.
+@param inputStreamInfo: The stream information to check
+@return: true if the latitude, longitude, base_station_id, start_time and message_format are all present
+*/
+bool streamHasRequiredCatalogFields(const base_station_stream_information &inputStreamInfo);
+
+/**
+This function binds the given socket to the given address.  If the address is in use, it keeps trying until the given amount of time has passed (used when taking over a port from a caster which doesn't share it).
+@param inputSocket: The socket to bind
+@param inputBindingAddress: The address to bind to
+@param inputMaxWaitTime: How long to keep trying in milliseconds (0 to only try once)
+@return: The endpoint the socket was bound to (ZMQ_LAST_ENDPOINT), which is what has to be given to unbind (tcp:// wildcard addresses are rejected by it)
+
+@throws: This function can throw exceptions
+*/
+std::string bindZMQSocketWithRetry(zmq::socket_t &inputSocket, const std::string &inputBindingAddress, int inputMaxWaitTime);
+
+/**
+This function binds the given socket to a TCP port (on all interfaces) through a listening socket made with SO_REUSEPORT, so that a replacement caster can bind the same port while this one keeps serving the connections it has already accepted.  When the listening socket can't be given to ZMQ (ZMQ_USE_FD needs libzmq 4.2), it binds the port normally with bindZMQSocketWithRetry.
+@param inputSocket: The socket to bind
+@param inputPortNumber: The port to bind to
+@param inputSteerNewConnectionsHere: True if new connections to the port should come to this socket rather than to the listening socket of the caster being replaced
+@param inputMaxWaitTime: How long to keep trying in milliseconds if the port is in use (0 to only try once)
+@return: The endpoint the socket was bound to (ZMQ_LAST_ENDPOINT)
+
+@throws: This function can throw exceptions
+*/
+std::string bindZMQSocketToSharedTCPPort(zmq::socket_t &inputSocket, uint32_t inputPortNumber, bool inputSteerNewConnectionsHere, int inputMaxWaitTime);
+
 /**
 This function helps with creating SQL query strings for client requests.
 @param inputRelation: The relation to resolve into a SQL string part (such as "<= ?"
@@ -572,14 +1026,6 @@ This function can be used to add the "acos" function to the current SQLite conne
 */
 void SQLiteAcosFunctionDegrees(sqlite3_context *inputContext, int inputArraySize, sqlite3_value **inputValues);
 
-/**
-This function removes all entries of the map with the specific key/value.
-@param inputMultimap: the multimap to delete from
-@param inputKey: the key of the key/value pair
-@param inputValue: The value of the key/value pair
-*/
-void removeKeyValuePairFromStringMultimap(std::multimap<std::string, std::string> &inputMultimap, const std::string &inputKey, const std::string &inputValue);
-
 
 
 }
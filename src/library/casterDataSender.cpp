@@ -12,10 +12,11 @@ This function initializes the casterDataSender to establish a connection and reg
 @param inputMessageFormat: The message format used with the updates
 @param inputInformalName: The name that should be displayed when the basestation appears in a list
 @param inputExpectedUpdateRate: Expected updates per second 
+@param inputTraceSamplingInterval: If not 0, the stream is registered with sends_stream_frame_headers and every message is sent with a stream frame header (which the caster removes), with one of every this many holding a latency trace
 
 @throws: This function can throw exceptions
 */
-casterDataSender::casterDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate) : casterDataSender(inputSourceConnectionString, inputContext, std::string(),  credentials(), inputCasterRegistrationIPAddressAndPort, inputLatitude, inputLongitude, inputMessageFormat, inputInformalName, inputExpectedUpdateRate, false)
+casterDataSender::casterDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate, uint32_t inputTraceSamplingInterval) : casterDataSender(inputSourceConnectionString, inputContext, std::string(),  credentials(), inputCasterRegistrationIPAddressAndPort, inputLatitude, inputLongitude, inputMessageFormat, inputInformalName, inputExpectedUpdateRate, false, inputTraceSamplingInterval)
 { //Delegate to more complex constructor
 }
 
@@ -32,11 +33,14 @@ This function initializes the casterDataSender to establish a connection and reg
 @param inputInformalName: The name that should be displayed when the basestation appears in a list
 @param inputExpectedUpdateRate: Expected updates per second 
 @param inputIsAuthenticatedConnection: Flag to allow function to be used to create unauthenticated connections so that it can be used a delegate constructor
+@param inputTraceSamplingInterval: If not 0, the stream is registered with sends_stream_frame_headers and every message is sent with a stream frame header (which the caster removes), with one of every this many holding a latency trace
 
 @throws: This function can throw exceptions
 */
-casterDataSender::casterDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, const std::string &inputSecretSigningKey, const credentials &inputCredentials, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate, bool inputIsAuthenticatedConnection) : context(inputContext)
+casterDataSender::casterDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, const std::string &inputSecretSigningKey, const credentials &inputCredentials, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate, bool inputIsAuthenticatedConnection, uint32_t inputTraceSamplingInterval) : context(inputContext)
 {
+traceSamplingInterval = inputTraceSamplingInterval;
+
 if(inputIsAuthenticatedConnection)
 {
 if(inputSecretSigningKey.size() != crypto_sign_SECRETKEYBYTES)
@@ -59,6 +63,15 @@ SOM_TRY //Set maximum wait for registration response
 sendingSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &CASTER_DATA_SENDER_MAX_WAIT_TIME, sizeof(CASTER_DATA_SENDER_MAX_WAIT_TIME));
 SOM_CATCH("Error setting socket timeout\n")
 
+//Use a random identity so that a caster which takes over for the current one (state handoff) recognizes this connection when it reconnects
+std::string connectionIdentity(CASTER_DATA_SENDER_IDENTITY_SIZE, '\0');
+randombytes_buf((void *) &connectionIdentity[0], connectionIdentity.size());
+connectionIdentity[0] = 'P'; //ZMQ identities are not allowed to start with a zero byte
+
+SOM_TRY
+sendingSocket->setsockopt(ZMQ_IDENTITY, (const void *) connectionIdentity.c_str(), connectionIdentity.size());
+SOM_CATCH("Error setting socket identity\n")
+
 SOM_TRY //Connect to caster
 std::string connectionString = "tcp://"+inputCasterRegistrationIPAddressAndPort;
 sendingSocket->connect(connectionString.c_str());
@@ -73,13 +86,17 @@ basestationInfo->set_longitude(inputLongitude);
 basestationInfo->set_expected_update_rate(inputExpectedUpdateRate);
 basestationInfo->set_message_format(inputMessageFormat);
 basestationInfo->set_informal_name(inputInformalName);
+registrationRequest.set_sends_stream_frame_headers(traceSamplingInterval > 0);
 
 if(secretKey.size() != 0)
 { //This is an authenticated basestation stream
 (*registrationRequest.mutable_transmitter_credentials()) = basestationCredentialsMessage;
 }
 
-//Send request to caster and get response
+//Send request to caster and get response, backing off while the caster is rate limiting registrations (with jitter, so transmitters turned away together don't all come back together)
+uint32_t retryDelay = CASTER_DATA_SENDER_INITIAL_REGISTRATION_RETRY_DELAY;
+for(int attempt = 1; ; attempt++)
+{
 bool replyReceived = false;
 bool replyDeserialized = false;
 
@@ -92,10 +109,20 @@ if(!replyReceived || !replyDeserialized)
 throw SOMException("Registration failed\n", SERVER_REQUEST_FAILED, __FILE__, __LINE__);
 }
 
-if(!registrationReply.request_succeeded())
+if(registrationReply.request_succeeded())
+{
+break; //We have registered as a basestation and the socket can now be used for distributing updates
+}
+
+if(!registrationReply.has_failure_reason() || registrationReply.failure_reason() != REGISTRATION_RATE_LIMITED || attempt >= CASTER_DATA_SENDER_MAXIMUM_REGISTRATION_ATTEMPTS)
 {
 throw SOMException("Registration failed\n", SERVER_REQUEST_FAILED, __FILE__, __LINE__);
-} //We have registered as a basestation and the socket can now be used for distributing updates
+}
+
+//Wait somewhere between half and all of the current delay
+std::this_thread::sleep_for(std::chrono::milliseconds(retryDelay/2 + randombytes_uniform(retryDelay/2 + 1)));
+retryDelay = std::min(2*retryDelay, CASTER_DATA_SENDER_MAXIMUM_REGISTRATION_RETRY_DELAY);
+}
 
 //Construct reactor
 SOM_TRY
@@ -166,19 +193,35 @@ SOM_TRY
 inputSocket.recv(&messageBuffer);
 SOM_CATCH("Error, unable to receive message\n")
 
-if(secretKey.size() == 0)
-{ //Unauthenticated connection
+bool traceMessage = traceSamplingInterval > 0 && (numberOfSentMessages % traceSamplingInterval) == 0;
+numberOfSentMessages++;
+
+if(secretKey.size() == 0 && traceSamplingInterval == 0)
+{ //Unauthenticated connection without stream frame headers
 SOM_TRY
 sendingSocket->send(messageBuffer.data(), messageBuffer.size());
 SOM_CATCH("Error forwarding to publisher\n")
 }
 else
+{
+std::string messageString;
+if(traceMessage)
+{ //Start the trace in the stream frame header (the caster removes it)
+messageString = createStreamFrameHeader(numberOfSentMessages - 1, Poco::Timestamp().epochMicroseconds(), std::vector<traceHop>{traceHop(TRANSMITTER_SEND, getMonotonicTime())});
+}
+else if(traceSamplingInterval > 0)
+{ //Registered as sending stream frame headers, so untraced messages get one too
+messageString = createStreamFrameHeader(numberOfSentMessages - 1, Poco::Timestamp().epochMicroseconds());
+}
+messageString.append((const char *) messageBuffer.data(), messageBuffer.size());
+
+if(secretKey.size() != 0)
 { //Authenticated connection, so add signature
-std::string messageString((char *) messageBuffer.data(), messageBuffer.size());
-std::string messageStringWithSignature = calculateAndPreappendSignature(messageString, secretKey);
+messageString = calculateAndPreappendSignature(messageString, secretKey);
+}
 
 SOM_TRY
-sendingSocket->send(messageStringWithSignature.c_str(), messageStringWithSignature.size());
+sendingSocket->send(messageString.c_str(), messageString.size());
 SOM_CATCH("Error forwarding to publisher\n")
 }
 
@@ -6,6 +6,8 @@
 #include<string>
 #include<cstdio>
 #include<unistd.h>
+#include<chrono>
+#include<algorithm>
 
 #include "dataSender.hpp"
 #include "SOMException.hpp"
@@ -13,6 +15,8 @@
 #include "zmq.hpp"
 #include "reactor.hpp"
 #include "utilityFunctions.hpp"
+#include "streamFrameHeader.hpp"
+#include "Poco/Timestamp.h"
 #include "data_receiver_status_notification.pb.h" 
 #include "transmitter_registration_request.pb.h"
 #include "transmitter_registration_reply.pb.h"
@@ -23,9 +27,13 @@ namespace pylongps
 {
 
 const int CASTER_DATA_SENDER_MAX_WAIT_TIME = 5000; //Milliseconds
+const int CASTER_DATA_SENDER_IDENTITY_SIZE = 16; //Bytes in the random ZMQ identity used for the connection to the caster
+const uint32_t CASTER_DATA_SENDER_INITIAL_REGISTRATION_RETRY_DELAY = 100; //Milliseconds before retrying a registration the caster rate limited (doubled for each retry)
+const uint32_t CASTER_DATA_SENDER_MAXIMUM_REGISTRATION_RETRY_DELAY = 5000; //Milliseconds
+const int CASTER_DATA_SENDER_MAXIMUM_REGISTRATION_ATTEMPTS = 10; //Rate limited registrations are given up on after this many tries
 
 /**
-This class takes data published on an inproc ZMQ PUB socket and forwards it to PylonGPS caster.
+This class takes data published on an inproc ZMQ PUB socket and forwards it to PylonGPS caster.  If the caster turns the registration away because it is rate limiting registrations, the constructor retries with a jittered exponential backoff.
 */
 class casterDataSender : public dataSender
 {
@@ -40,10 +48,11 @@ This function initializes the casterDataSender to establish a connection and reg
 @param inputMessageFormat: The message format used with the updates
 @param inputInformalName: The name that should be displayed when the basestation appears in a list
 @param inputExpectedUpdateRate: Expected updates per second 
+@param inputTraceSamplingInterval: If not 0, the stream is registered with sends_stream_frame_headers and every message is sent with a stream frame header (which the caster removes), with one of every this many holding a latency trace
 
 @throws: This function can throw exceptions
 */
-casterDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate = 0.0);
+casterDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate = 0.0, uint32_t inputTraceSamplingInterval = 0);
 
 /**
 This function initializes the casterDataSender to establish a connection and register an authenticated basestation with it.
@@ -58,10 +67,11 @@ This function initializes the casterDataSender to establish a connection and reg
 @param inputInformalName: The name that should be displayed when the basestation appears in a list
 @param inputExpectedUpdateRate: Expected updates per second 
 @param inputIsAuthenticatedConnection: Flag to allow function to be used to create unauthenticated connections so that it can be used a delegate constructor
+@param inputTraceSamplingInterval: If not 0, the stream is registered with sends_stream_frame_headers and every message is sent with a stream frame header (which the caster removes), with one of every this many holding a latency trace
 
 @throws: This function can throw exceptions
 */
-casterDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, const std::string &inputSecretSigningKey, const credentials &inputCredentials, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate = 0.0, bool inputIsAuthenticatedConnection = true);
+casterDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, const std::string &inputSecretSigningKey, const credentials &inputCredentials, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate = 0.0, bool inputIsAuthenticatedConnection = true, uint32_t inputTraceSamplingInterval = 0);
 
 
 
@@ -85,6 +95,9 @@ protected:
 std::string secretKey;
 credentials basestationCredentialsMessage;
 
+uint32_t traceSamplingInterval; //1 of every this many messages is traced (0 for none)
+uint64_t numberOfSentMessages = 0;
+
 /**
 This function forwards any received messages to the "sending" socket
 @param inputReactor: The reactor which called the function
@@ -0,0 +1,185 @@
+#include "casterMetrics.hpp"
+#include<vector>
+#include<cstdio>
+
+using namespace pylongps;
+
+/**
+This function reads an atomic counter/gauge and converts it to a string.
+@param inputValue: The value to read
+@return: The value as a string
+*/
+template<class valueType> static std::string load(const std::atomic<valueType> &inputValue)
+{
+return std::to_string(inputValue.load(std::memory_order_relaxed));
+}
+
+/**
+This function initializes the buckets to zero.
+*/
+metricsLatencyHistogram::metricsLatencyHistogram() : totalLatency(0)
+{
+for(std::atomic<uint64_t> &bucketCount : bucketCounts)
+{
+bucketCount = 0;
+}
+}
+
+/**
+This function adds a latency to the histogram.
+@param inputLatency: The latency in seconds
+*/
+void metricsLatencyHistogram::addLatency(double inputLatency)
+{
+uint32_t bucketIndex = 0;
+double bucketUpperBound = METRICS_LATENCY_BUCKET_START;
+while(bucketIndex < NUMBER_OF_METRICS_LATENCY_BUCKETS && inputLatency > bucketUpperBound)
+{
+bucketIndex++;
+bucketUpperBound *= 2.0;
+}
+
+bucketCounts[bucketIndex].fetch_add(1, std::memory_order_relaxed);
+totalLatency.fetch_add(inputLatency > 0.0 ? inputLatency*1e9 : 0, std::memory_order_relaxed);
+}
+
+/**
+This function renders the histogram in the Prometheus text exposition format.
+@param inputName: The metric name
+@param inputHelp: The help string of the metric
+@return: The rendered histogram
+*/
+std::string metricsLatencyHistogram::render(const std::string &inputName, const std::string &inputHelp) const
+{
+std::string result = "# HELP " + inputName + " " + inputHelp + "\n# TYPE " + inputName + " histogram\n";
+
+char buffer[64];
+uint64_t cumulativeCount = 0;
+double bucketUpperBound = METRICS_LATENCY_BUCKET_START;
+for(uint32_t i=0; i<NUMBER_OF_METRICS_LATENCY_BUCKETS; i++)
+{
+cumulativeCount += bucketCounts[i].load(std::memory_order_relaxed);
+snprintf(buffer, sizeof(buffer), "%g", bucketUpperBound);
+result += inputName + "_bucket{le=\"" + buffer + "\"} " + std::to_string(cumulativeCount) + "\n";
+bucketUpperBound *= 2.0;
+}
+cumulativeCount += bucketCounts[NUMBER_OF_METRICS_LATENCY_BUCKETS].load(std::memory_order_relaxed);
+result += inputName + "_bucket{le=\"+Inf\"} " + std::to_string(cumulativeCount) + "\n";
+
+snprintf(buffer, sizeof(buffer), "%.9f", totalLatency.load(std::memory_order_relaxed)/1e9);
+result += inputName + "_sum " + buffer + "\n";
+result += inputName + "_count " + std::to_string(cumulativeCount) + "\n";
+
+return result;
+}
+
+/**
+This function initializes all of the counters/gauges to zero.
+*/
+casterMetrics::casterMetrics() : numberOfReceivedMessages(0), numberOfReceivedBytes(0), numberOfReceivedProxyMessages(0), numberOfReceivedProxyBytes(0), numberOfMessagesSentToClients(0), numberOfBytesSentToClients(0), numberOfMessagesSentToProxies(0), numberOfBytesSentToProxies(0), numberOfSignatureFailures(0), numberOfCredentialsCacheHits(0), numberOfCredentialsCacheMisses(0), numberOfRateLimitedRegistrations(0), numberOfFailedCatalogWrites(0), streamRegistrationAndPublishingEventQueueSize(0), clientAndDatabaseRequestHandlingEventQueueSize(0), statisticsGatheringEventQueueSize(0), streamRegistrationAndPublishingEventQueueBytes(0), clientAndDatabaseRequestHandlingEventQueueBytes(0), statisticsGatheringEventQueueBytes(0), numberOfProxiedCasters(0), numberOfProxiedStreams(0)
+{
+for(std::atomic<int64_t> &numberOfConnections : stationClassToNumberOfConnections)
+{
+numberOfConnections = 0;
+}
+}
+
+/**
+This function adjusts the number of connections of a station class.
+@param inputStationClass: The class of the connection
+@param inputChange: +1 for an added connection, -1 for a removed one
+*/
+void casterMetrics::changeNumberOfConnections(base_station_class inputStationClass, int64_t inputChange)
+{
+if(inputStationClass < 1 || ((uint32_t) inputStationClass) > NUMBER_OF_STATION_CLASSES)
+{
+return;
+}
+
+stationClassToNumberOfConnections[inputStationClass - 1].fetch_add(inputChange, std::memory_order_relaxed);
+}
+
+/**
+This function returns the last message time slot of a proxied caster, creating it if need be.  Callers are expected to keep the returned reference (the slot stays valid until removeProxiedCaster is called) so that the lock is only taken once per proxied caster.
+@param inputForeignCasterID: The ID of the proxied caster
+@param inputCurrentTime: The time to initialize a new slot with (microseconds since the epoch)
+@return: The time the last message from that caster was received (microseconds since the epoch)
+*/
+std::atomic<int64_t> &casterMetrics::getProxiedCasterLastMessageTime(int64_t inputForeignCasterID, Poco::Timestamp::TimeVal inputCurrentTime)
+{
+std::lock_guard<std::mutex> lock(proxiedCasterLastMessageTimesMutex);
+auto iter = foreignCasterIDToLastMessageTime.find(inputForeignCasterID);
+if(iter == foreignCasterIDToLastMessageTime.end())
+{
+iter = foreignCasterIDToLastMessageTime.emplace(std::piecewise_construct, std::forward_as_tuple(inputForeignCasterID), std::forward_as_tuple(inputCurrentTime)).first;
+}
+
+return iter->second;
+}
+
+/**
+This function stops reporting the lag of a proxied caster.
+@param inputForeignCasterID: The ID of the proxied caster
+*/
+void casterMetrics::removeProxiedCaster(int64_t inputForeignCasterID)
+{
+std::lock_guard<std::mutex> lock(proxiedCasterLastMessageTimesMutex);
+foreignCasterIDToLastMessageTime.erase(inputForeignCasterID);
+}
+
+/**
+This function renders all of the metrics in the Prometheus text exposition format (version 0.0.4).
+@param inputCurrentTime: The time to measure the proxy lags from (microseconds since the epoch)
+@return: The rendered metrics
+*/
+std::string casterMetrics::generatePrometheusText(Poco::Timestamp::TimeVal inputCurrentTime)
+{
+std::string result;
+
+auto addMetric = [&](const std::string &inputName, const std::string &inputType, const std::string &inputHelp, const std::vector<std::pair<std::string, std::string> > &inputLabelsAndValues)
+{
+result += "# HELP " + inputName + " " + inputHelp + "\n# TYPE " + inputName + " " + inputType + "\n";
+for(const std::pair<std::string, std::string> &labelsAndValue : inputLabelsAndValues)
+{
+result += inputName + labelsAndValue.first + " " + labelsAndValue.second + "\n";
+}
+};
+
+std::vector<std::pair<std::string, std::string> > connectionsByClass;
+for(uint32_t i=0; i<NUMBER_OF_STATION_CLASSES; i++)
+{
+connectionsByClass.emplace_back("{class=\"" + base_station_class_Name((base_station_class) (i+1)) + "\"}", load(stationClassToNumberOfConnections[i]));
+}
+addMetric("pylongps_caster_connections", "gauge", "Registered transmitter connections by station class", connectionsByClass);
+
+addMetric("pylongps_caster_received_messages_total", "counter", "Stream messages received", {{"{source=\"transmitter\"}", load(numberOfReceivedMessages)}, {"{source=\"proxy\"}", load(numberOfReceivedProxyMessages)}});
+addMetric("pylongps_caster_received_bytes_total", "counter", "Stream message bytes received", {{"{source=\"transmitter\"}", load(numberOfReceivedBytes)}, {"{source=\"proxy\"}", load(numberOfReceivedProxyBytes)}});
+addMetric("pylongps_caster_sent_messages_total", "counter", "Stream messages published", {{"{interface=\"client\"}", load(numberOfMessagesSentToClients)}, {"{interface=\"proxy\"}", load(numberOfMessagesSentToProxies)}});
+addMetric("pylongps_caster_sent_bytes_total", "counter", "Stream message bytes published", {{"{interface=\"client\"}", load(numberOfBytesSentToClients)}, {"{interface=\"proxy\"}", load(numberOfBytesSentToProxies)}});
+addMetric("pylongps_caster_signature_failures_total", "counter", "Authenticated messages dropped because their signature was missing or invalid", {{"", load(numberOfSignatureFailures)}});
+addMetric("pylongps_caster_credentials_cache_lookups_total", "counter", "Transmitter credentials checks by whether the signature verification result was cached", {{"{result=\"hit\"}", load(numberOfCredentialsCacheHits)}, {"{result=\"miss\"}", load(numberOfCredentialsCacheMisses)}});
+addMetric("pylongps_caster_rate_limited_registrations_total", "counter", "Transmitter registrations rejected because they arrived faster than the registration admission rate", {{"", load(numberOfRateLimitedRegistrations)}});
+addMetric("pylongps_caster_failed_catalog_writes_total", "counter", "Stream registrations/deletions the database couldn't apply", {{"", load(numberOfFailedCatalogWrites)}});
+addMetric("pylongps_caster_event_queue_size", "gauge", "Scheduled events waiting in each reactor", {{"{reactor=\"stream_registration_and_publishing\"}", load(streamRegistrationAndPublishingEventQueueSize)}, {"{reactor=\"client_and_database_request_handling\"}", load(clientAndDatabaseRequestHandlingEventQueueSize)}, {"{reactor=\"statistics_gathering\"}", load(statisticsGatheringEventQueueSize)}});
+addMetric("pylongps_caster_event_queue_bytes", "gauge", "Estimated memory used by the scheduled events waiting in each reactor", {{"{reactor=\"stream_registration_and_publishing\"}", load(streamRegistrationAndPublishingEventQueueBytes)}, {"{reactor=\"client_and_database_request_handling\"}", load(clientAndDatabaseRequestHandlingEventQueueBytes)}, {"{reactor=\"statistics_gathering\"}", load(statisticsGatheringEventQueueBytes)}});
+
+result += databaseRequestLatency.render("pylongps_caster_database_request_duration_seconds", "Time to process a database request");
+result += clientQueryLatency.render("pylongps_caster_client_query_duration_seconds", "Time to answer a client query");
+
+addMetric("pylongps_caster_proxied_casters", "gauge", "Casters being proxied", {{"", load(numberOfProxiedCasters)}});
+addMetric("pylongps_caster_proxied_streams", "gauge", "Streams being proxied from other casters", {{"", load(numberOfProxiedStreams)}});
+
+std::vector<std::pair<std::string, std::string> > proxyLags;
+{
+std::lock_guard<std::mutex> lock(proxiedCasterLastMessageTimesMutex);
+for(const auto &foreignCasterIDAndLastMessageTime : foreignCasterIDToLastMessageTime)
+{
+char buffer[64];
+snprintf(buffer, sizeof(buffer), "%.6f", (inputCurrentTime - foreignCasterIDAndLastMessageTime.second.load(std::memory_order_relaxed))/1e6);
+proxyLags.emplace_back("{foreign_caster_id=\"" + std::to_string(foreignCasterIDAndLastMessageTime.first) + "\"}", buffer);
+}
+}
+addMetric("pylongps_caster_proxy_lag_seconds", "gauge", "Time since the last stream message was received from each proxied caster", proxyLags);
+
+return result;
+}
@@ -0,0 +1,119 @@
+#ifndef CASTERMETRICSHPP
+#define CASTERMETRICSHPP
+
+#include<cstdint>
+#include<string>
+#include<array>
+#include<map>
+#include<mutex>
+#include<atomic>
+#include "Poco/Timestamp.h"
+#include "common_enums.pb.h"
+
+namespace pylongps
+{
+
+const uint32_t NUMBER_OF_METRICS_LATENCY_BUCKETS = 16; //Power of two buckets starting at METRICS_LATENCY_BUCKET_START (the last ends at about 3.3 seconds), plus +Inf
+const double METRICS_LATENCY_BUCKET_START = .0001; //Seconds
+const uint32_t NUMBER_OF_STATION_CLASSES = 3; //OFFICIAL, REGISTERED_COMMUNITY, COMMUNITY
+
+/**
+This class is a Prometheus style latency histogram which can be added to from any thread without locking.
+*/
+class metricsLatencyHistogram
+{
+public:
+/**
+This function initializes the buckets to zero.
+*/
+metricsLatencyHistogram();
+
+/**
+This function adds a latency to the histogram.
+@param inputLatency: The latency in seconds
+*/
+void addLatency(double inputLatency);
+
+/**
+This function renders the histogram in the Prometheus text exposition format.
+@param inputName: The metric name
+@param inputHelp: The help string of the metric
+@return: The rendered histogram
+*/
+std::string render(const std::string &inputName, const std::string &inputHelp) const;
+
+std::array<std::atomic<uint64_t>, NUMBER_OF_METRICS_LATENCY_BUCKETS + 1> bucketCounts; //Not cumulative, the last bucket is +Inf
+std::atomic<uint64_t> totalLatency; //Nanoseconds
+};
+
+/**
+This class holds the runtime counters/gauges of a caster.  The reactor threads update them with relaxed atomic operations (so keeping them costs next to nothing when no one is scraping) and generatePrometheusText reads them.  Only adding/removing a proxied caster takes a lock.
+*/
+class casterMetrics
+{
+public:
+/**
+This function initializes all of the counters/gauges to zero.
+*/
+casterMetrics();
+
+/**
+This function adjusts the number of connections of a station class.
+@param inputStationClass: The class of the connection
+@param inputChange: +1 for an added connection, -1 for a removed one
+*/
+void changeNumberOfConnections(base_station_class inputStationClass, int64_t inputChange);
+
+/**
+This function returns the last message time slot of a proxied caster, creating it if need be.  Callers are expected to keep the returned reference (the slot stays valid until removeProxiedCaster is called) so that the lock is only taken once per proxied caster.
+@param inputForeignCasterID: The ID of the proxied caster
+@param inputCurrentTime: The time to initialize a new slot with (microseconds since the epoch)
+@return: The time the last message from that caster was received (microseconds since the epoch)
+*/
+std::atomic<int64_t> &getProxiedCasterLastMessageTime(int64_t inputForeignCasterID, Poco::Timestamp::TimeVal inputCurrentTime);
+
+/**
+This function stops reporting the lag of a proxied caster.
+@param inputForeignCasterID: The ID of the proxied caster
+*/
+void removeProxiedCaster(int64_t inputForeignCasterID);
+
+/**
+This function renders all of the metrics in the Prometheus text exposition format (version 0.0.4).
+@param inputCurrentTime: The time to measure the proxy lags from (microseconds since the epoch)
+@return: The rendered metrics
+*/
+std::string generatePrometheusText(Poco::Timestamp::TimeVal inputCurrentTime);
+
+std::array<std::atomic<int64_t>, NUMBER_OF_STATION_CLASSES> stationClassToNumberOfConnections; //Indexed by base_station_class - 1
+std::atomic<uint64_t> numberOfReceivedMessages; //From registered transmitters
+std::atomic<uint64_t> numberOfReceivedBytes;
+std::atomic<uint64_t> numberOfReceivedProxyMessages; //From proxied casters
+std::atomic<uint64_t> numberOfReceivedProxyBytes;
+std::atomic<uint64_t> numberOfMessagesSentToClients;
+std::atomic<uint64_t> numberOfBytesSentToClients;
+std::atomic<uint64_t> numberOfMessagesSentToProxies;
+std::atomic<uint64_t> numberOfBytesSentToProxies;
+std::atomic<uint64_t> numberOfSignatureFailures;
+std::atomic<uint64_t> numberOfCredentialsCacheHits; //Transmitter registrations whose credentials were already verified
+std::atomic<uint64_t> numberOfCredentialsCacheMisses;
+std::atomic<uint64_t> numberOfRateLimitedRegistrations; //Transmitter registrations turned away by the registration admission rate
+std::atomic<uint64_t> numberOfFailedCatalogWrites; //Stream registrations/deletions the database couldn't apply, so client queries don't reflect them
+std::atomic<uint64_t> streamRegistrationAndPublishingEventQueueSize;
+std::atomic<uint64_t> clientAndDatabaseRequestHandlingEventQueueSize;
+std::atomic<uint64_t> statisticsGatheringEventQueueSize;
+std::atomic<uint64_t> streamRegistrationAndPublishingEventQueueBytes; //See eventPriorityQueue::getMemoryUsage
+std::atomic<uint64_t> clientAndDatabaseRequestHandlingEventQueueBytes;
+std::atomic<uint64_t> statisticsGatheringEventQueueBytes;
+std::atomic<int64_t> numberOfProxiedCasters; //Proxies added with addProxy
+std::atomic<int64_t> numberOfProxiedStreams;
+metricsLatencyHistogram databaseRequestLatency;
+metricsLatencyHistogram clientQueryLatency;
+
+private:
+std::mutex proxiedCasterLastMessageTimesMutex;
+std::map<int64_t, std::atomic<int64_t> > foreignCasterIDToLastMessageTime; //std::map so references stay valid as casters are added
+};
+
+}
+#endif
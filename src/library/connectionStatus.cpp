@@ -3,12 +3,18 @@
 using namespace pylongps;
 
 /*
-This function sets hasBeenRegistered to false and timeLastMessageWasReceived to 0.
+This function sets hasBeenRegistered to false, timeLastMessageWasReceived to 0, timeoutEventTime to -1, stationClass to COMMUNITY, nextSequenceNumber to 0, sendsStreamFrameHeaders to false, numberOfDroppedMessages to nullptr and leaves the connection without an ingest rate limit.
 */
 connectionStatus::connectionStatus()
 {
 hasBeenRegistered = false;
 timeLastMessageWasReceived = 0;
+timeoutEventTime = -1;
 requestToTheDatabaseHasBeenSent = false;
 baseStationID = 0;
+isExemptFromGlobalIngestLimit = false;
+numberOfDroppedMessages = nullptr;
+stationClass = COMMUNITY;
+nextSequenceNumber = 0;
+sendsStreamFrameHeaders = false;
 } 
@@ -1,7 +1,10 @@
 #ifndef CONNECTIONSTATUSHPP
 #define CONNECTIONSTATUSHPP
 
+#include<atomic>
 #include "Poco/Timestamp.h"
+#include "tokenBucket.hpp"
+#include "common_enums.pb.h"
 
 
 namespace pylongps
@@ -15,7 +18,7 @@ class connectionStatus
 {
 public:
 /*
-This function sets hasBeenRegistered to false and timeLastMessageWasReceived to 0.
+This function sets hasBeenRegistered to false, timeLastMessageWasReceived to 0, timeoutEventTime to -1, stationClass to COMMUNITY, nextSequenceNumber to 0, sendsStreamFrameHeaders to false, numberOfDroppedMessages to nullptr and leaves the connection without an ingest rate limit.
 */
 connectionStatus();
 
@@ -23,6 +26,13 @@ bool hasBeenRegistered;
 bool requestToTheDatabaseHasBeenSent;
 int64_t baseStationID;
 Poco::Timestamp timeLastMessageWasReceived;
+Poco::Timestamp::TimeVal timeoutEventTime; //When the connection's one pending possible_base_station_event_timeout is scheduled (events with other times are stale and ignored), -1 if none
+tokenBucket ingestRateLimiter; //Limits how many messages per second are accepted from the connection
+bool isExemptFromGlobalIngestLimit; //True for OFFICIAL stations, which keep being served when the global ingest budget is exhausted
+std::atomic<uint64_t> *numberOfDroppedMessages; //The stream's count in the caster's drop counts, nullptr until a message is first dropped
+base_station_class stationClass; //Determines which publishing queue the connection's messages go to
+uint64_t nextSequenceNumber; //The sequence number to put in the stream frame header of the next message
+bool sendsStreamFrameHeaders; //True if the transmitter registered as starting each message with a stream frame header
 };
 
 
@@ -1,6 +1,7 @@
 #pragma once
 
-
+#include<string>
+#include "directDataSink.hpp"
 
 namespace pylongps
 {
@@ -25,6 +26,15 @@ This function is required to return a ZMQ inproc address which can be used with
 */
 virtual std::string notificationAddress() = 0;
 
+/**
+This function returns the list that data senders in the same process can attach to in order to be handed the receiver's messages directly (the messages are still published at address() for anyone else).
+@return: The list or nullptr if the receiver doesn't support direct data sinks
+*/
+virtual directDataSinkList *directDataSinks()
+{
+return nullptr;
+}
+
 /**
 This specifies the destructor as virtual so that the derived classes will have their destructors called if a base class pointer to them is deleted.
 */
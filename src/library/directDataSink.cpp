@@ -0,0 +1,47 @@
+#include "directDataSink.hpp"
+
+using namespace pylongps;
+
+/**
+This function attaches a sink so that it is given every message published after this call.
+@param inputSink: The sink to attach (not owned)
+*/
+void directDataSinkList::add(directDataSink *inputSink)
+{
+std::lock_guard<std::mutex> lock(sinksMutex);
+
+sinks.push_back(inputSink);
+numberOfSinks = sinks.size();
+}
+
+/**
+This function detaches a sink, waiting for any call to it in progress to finish.
+@param inputSink: The sink to detach
+*/
+void directDataSinkList::remove(directDataSink *inputSink)
+{
+std::lock_guard<std::mutex> lock(sinksMutex);
+
+sinks.erase(std::remove(sinks.begin(), sinks.end(), inputSink), sinks.end());
+numberOfSinks = sinks.size();
+}
+
+/**
+This function passes a message to all of the attached sinks.
+@param inputData: The message
+@param inputDataSize: The size of the message in bytes
+*/
+void directDataSinkList::publish(const char *inputData, uint64_t inputDataSize)
+{
+if(numberOfSinks == 0)
+{
+return;
+}
+
+std::lock_guard<std::mutex> lock(sinksMutex);
+
+for(directDataSink *sink : sinks)
+{
+sink->handleDirectData(inputData, inputDataSize);
+}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include<cstdint>
+#include<vector>
+#include<mutex>
+#include<atomic>
+#include<algorithm>
+
+namespace pylongps
+{
+
+/**
+This class is an abstract base class for data senders which can be handed messages directly by a data receiver in the same process, skipping the receiver's inproc publisher and the sender's subscriber (and the copies/thread handoff that go with them).
+*/
+class directDataSink
+{
+public:
+/**
+This function is called from the data receiver's thread with each message the receiver publishes.  It must not throw (errors should be reported on the sender's notification socket instead).
+@param inputData: The message (only valid for the duration of the call)
+@param inputDataSize: The size of the message in bytes
+*/
+virtual void handleDirectData(const char *inputData, uint64_t inputDataSize) = 0;
+
+/**
+This specifies the destructor as virtual so that the derived classes will have their destructors called if a base class pointer to them is deleted.
+*/
+virtual ~directDataSink() {}
+};
+
+/**
+This class holds the direct data sinks attached to a data receiver.  The receiver's thread passes each message to every sink while holding the list's mutex, so once remove returns the sink will not be called again and can be destroyed.  The receiver must outlive the sinks attached to it.
+*/
+class directDataSinkList
+{
+public:
+/**
+This function attaches a sink so that it is given every message published after this call.
+@param inputSink: The sink to attach (not owned)
+*/
+void add(directDataSink *inputSink);
+
+/**
+This function detaches a sink, waiting for any call to it in progress to finish.
+@param inputSink: The sink to detach
+*/
+void remove(directDataSink *inputSink);
+
+/**
+This function passes a message to all of the attached sinks.
+@param inputData: The message
+@param inputDataSize: The size of the message in bytes
+*/
+void publish(const char *inputData, uint64_t inputDataSize);
+
+private:
+std::mutex sinksMutex;
+std::vector<directDataSink *> sinks;
+std::atomic<uint64_t> numberOfSinks{0}; //Lets publish skip the mutex when there is nothing attached
+};
+
+}
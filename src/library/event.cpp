@@ -23,3 +23,43 @@ bool pylongps::operator<(const event &inputLeftEvent, const event &inputRightEve
 {
 return inputLeftEvent.time > inputRightEvent.time;
 }
+
+/**
+This function initializes the queue as empty.
+*/
+eventPriorityQueue::eventPriorityQueue() : memoryUsage(0)
+{
+}
+
+/**
+This function adds an event to the queue.
+@param inputEvent: The event to add
+*/
+void eventPriorityQueue::push(const event &inputEvent)
+{
+memoryUsage += sizeof(event) + inputEvent.ByteSizeLong();
+std::priority_queue<event>::push(inputEvent);
+}
+
+/**
+This function removes the soonest event from the queue.
+*/
+void eventPriorityQueue::pop()
+{
+if(size() == 0)
+{
+return;
+}
+
+memoryUsage -= sizeof(event) + top().ByteSizeLong();
+std::priority_queue<event>::pop();
+}
+
+/**
+This function returns an estimate of how much memory the queued events are using (the size of each event object plus the serialized size of its contents, not counting unused capacity of the queue's storage).
+@return: The estimated number of bytes used
+*/
+uint64_t eventPriorityQueue::getMemoryUsage() const
+{
+return memoryUsage;
+}
@@ -1,6 +1,8 @@
 #ifndef  EVENTHPP
 #define EVENTHPP
 
+#include<queue>
+#include<cstdint>
 #include "Poco/Timestamp.h"
 #include "event_message.pb.h"
 
@@ -33,6 +35,39 @@ This function returns left.time > right.time
 */
 bool operator<(const event &inputLeftEvent, const event &inputRightEvent);
 
+/**
+\ingroup Events
+This class is the priority queue reactors keep their scheduled events in.  It keeps a running total of the memory held by the queued events so that it can be reported without walking the queue.
+*/
+class eventPriorityQueue : public std::priority_queue<event>
+{
+public:
+/**
+This function initializes the queue as empty.
+*/
+eventPriorityQueue();
+
+/**
+This function adds an event to the queue.
+@param inputEvent: The event to add
+*/
+void push(const event &inputEvent);
+
+/**
+This function removes the soonest event from the queue.
+*/
+void pop();
+
+/**
+This function returns an estimate of how much memory the queued events are using (the size of each event object plus the serialized size of its contents, not counting unused capacity of the queue's storage).
+@return: The estimated number of bytes used
+*/
+uint64_t getMemoryUsage() const;
+
+private:
+uint64_t memoryUsage;
+};
+
 
 
 
@@ -2,14 +2,48 @@
 
 using namespace pylongps;
 
+/**
+This function is used by ZMQ to free a read buffer which was given to a message.
+@param inputData: The buffer
+@param inputHint: Unused
+*/
+static void freeReadBuffer(void *inputData, void *inputHint)
+{
+delete[] ((char *) inputData);
+}
+
+/**
+This function is used by ZMQ to release the reference to a fileDataReceiverMapping held by a message published from the mapping.
+@param inputData: Unused
+@param inputHint: A heap allocated shared_ptr to the mapping
+*/
+static void releaseMappingReference(void *inputData, void *inputHint)
+{
+delete ((std::shared_ptr<fileDataReceiverMapping> *) inputHint);
+}
+
+/**
+This function unmaps the section.
+*/
+fileDataReceiverMapping::~fileDataReceiverMapping()
+{
+if(mappingAddress != nullptr)
+{
+munmap(mappingAddress, mappingSize);
+}
+}
+
 /**
 This function initializes the fileDataReceiver to retrieve data from the given file descriptor.  The object takes ownership of the file and closes the pointer on destruction.
 @param inputFilePointer: A file stream pointer to retrieve data from
 @param inputContext: A reference to the ZMQ context to use
+@param inputBufferSize: The largest number of bytes to read/publish at a time
+@param inputFramingMode: How to split the data into messages
+@param inputMemoryMapRegularFiles: True if data should be published straight from a memory mapping of the file when it is a regular file with at least inputBufferSize bytes waiting (the file must not be truncated while the receiver is using it)
 
 @throws: This function can throw exceptions
 */
-fileDataReceiver::fileDataReceiver(FILE *inputFilePointer, zmq::context_t &inputContext) : context(inputContext)
+fileDataReceiver::fileDataReceiver(FILE *inputFilePointer, zmq::context_t &inputContext, uint64_t inputBufferSize, fileDataReceiverFramingMode inputFramingMode, bool inputMemoryMapRegularFiles) : context(inputContext), bufferSize(inputBufferSize), framingMode(inputFramingMode), memoryMapRegularFiles(inputMemoryMapRegularFiles)
 {
 SOM_TRY
 subConstructor(inputFilePointer);
@@ -20,10 +54,13 @@ SOM_CATCH("Error with subconstructor\n")
 This function initializes the fileDataReceiver to retrieve data from the file that the given path points to.
 @param inputFilePath: The path to the file to retrieve data from
 @param inputContext: A reference to the ZMQ context to use
+@param inputBufferSize: The largest number of bytes to read/publish at a time
+@param inputFramingMode: How to split the data into messages
+@param inputMemoryMapRegularFiles: True if data should be published straight from a memory mapping of the file when it is a regular file with at least inputBufferSize bytes waiting (the file must not be truncated while the receiver is using it)
 
 @throws: This function can throw exceptions
 */
-fileDataReceiver::fileDataReceiver(const std::string &inputFilePath, zmq::context_t &inputContext)  : context(inputContext)
+fileDataReceiver::fileDataReceiver(const std::string &inputFilePath, zmq::context_t &inputContext, uint64_t inputBufferSize, fileDataReceiverFramingMode inputFramingMode, bool inputMemoryMapRegularFiles) : context(inputContext), bufferSize(inputBufferSize), framingMode(inputFramingMode), memoryMapRegularFiles(inputMemoryMapRegularFiles)
 {
 FILE *file = fopen(inputFilePath.c_str(), "rb");
 if(file == nullptr)
@@ -54,6 +91,24 @@ std::string fileDataReceiver::notificationAddress()
 return notificationConnectionString;
 }
 
+/**
+This function returns the list that data senders in the same process can attach to in order to be handed the receiver's messages directly (the messages are still published at address() for anyone else).
+@return: The list
+*/
+directDataSinkList *fileDataReceiver::directDataSinks()
+{
+return &directSinks;
+}
+
+/**
+This function returns how many bytes have been thrown away by RTCM 3 framing because they weren't part of a valid frame.
+@return: The number of discarded bytes
+*/
+uint64_t fileDataReceiver::getNumberOfDiscardedBytes()
+{
+return numberOfDiscardedBytes;
+}
+
 /**
 This function performs a nonblocking read of the given file descriptor and (if there is any data) forwards the received data to the publisher socket.
 @param inputReactor: The reactor which called the function
@@ -65,9 +120,27 @@ bool fileDataReceiver::readAndPublishData(reactor<fileDataReceiver> &inputReacto
 {
 auto fileNumber = fileno(inputFileDescriptor);
 
-int32_t numberOfBytesRead = 0;
+if(isRegularFile && memoryMapRegularFiles)
+{
+bool publishedMappedData = false;
+SOM_TRY
+publishedMappedData = publishMappedData(fileNumber);
+SOM_CATCH("Error publishing mapped data\n")
+
+if(publishedMappedData)
+{
+return false;
+}
+}
+
+if(readBuffer.get() == nullptr)
+{ //Last one was given to a message
+readBuffer.reset(new char[bufferSize]);
+}
 
-numberOfBytesRead = read(fileNumber, (void *) dataBuffer, FILE_DATA_RECEIVER_DATA_BUFFER_SIZE);
+int64_t numberOfBytesRead = 0;
+
+numberOfBytesRead = read(fileNumber, (void *) readBuffer.get(), bufferSize);
 
 if(numberOfBytesRead < 0)
 {//Read error
@@ -87,13 +160,221 @@ if(numberOfBytesRead == 0)
 return false;
 }
 
+if(isRegularFile)
+{
+fileOffset += numberOfBytesRead;
+}
+
+if(framingMode == FILE_DATA_RECEIVER_RTCM_V3_FRAMING)
+{
+SOM_TRY
+frameAndPublishData(readBuffer.get(), numberOfBytesRead);
+SOM_CATCH("Error framing data\n")
+
+return false;
+}
+
+if(((uint64_t) numberOfBytesRead)*2 >= bufferSize)
+{ //Mostly full, so hand the buffer to the message rather than copying it
+zmq::message_t message((void *) readBuffer.get(), numberOfBytesRead, freeReadBuffer);
+readBuffer.release();
+
+SOM_TRY
+publishMessage(message);
+SOM_CATCH("Error publishing data\n")
+
+return false;
+}
+
+//Copy small reads so that queued messages don't hold mostly empty buffers
+zmq::message_t message(numberOfBytesRead);
+memcpy(message.data(), readBuffer.get(), numberOfBytesRead);
+
 SOM_TRY
-publishingSocket->send(dataBuffer, numberOfBytesRead);
+publishMessage(message);
 SOM_CATCH("Error publishing data\n")
 
 return false;
 }
 
+/**
+This function publishes the next (up to) bufferSize bytes of the file from a memory mapping, mapping the unread part of the file first if needed.
+@param inputFileNumber: The file descriptor of the file
+@return: false if there wasn't enough unread data to be worth mapping (so it should be read instead)
+
+@throw: This function can throw exceptions
+*/
+bool fileDataReceiver::publishMappedData(int inputFileNumber)
+{
+if(currentMapping.get() == nullptr)
+{
+struct stat fileStatus;
+if(fstat(inputFileNumber, &fileStatus) != 0)
+{
+throw SOMException("Unable to get file size\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+
+if(fileStatus.st_size < 0 || ((uint64_t) fileStatus.st_size) < fileOffset + bufferSize)
+{ //Small appends are cheaper to read
+return false;
+}
+
+//Mappings have to start on a page boundary
+uint64_t pageSize = sysconf(_SC_PAGESIZE);
+uint64_t mappingOffset = fileOffset - (fileOffset % pageSize);
+uint64_t mappingSize = fileStatus.st_size - mappingOffset;
+
+void *mappingAddress = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, inputFileNumber, mappingOffset);
+if(mappingAddress == MAP_FAILED)
+{ //File system doesn't support it, so stick to reading
+memoryMapRegularFiles = false;
+return false;
+}
+madvise(mappingAddress, mappingSize, MADV_SEQUENTIAL);
+
+currentMapping.reset(new fileDataReceiverMapping);
+currentMapping->mappingAddress = mappingAddress;
+currentMapping->mappingSize = mappingSize;
+mappedData = ((const char *) mappingAddress) + (fileOffset - mappingOffset);
+mappedFileEnd = fileStatus.st_size;
+}
+
+uint64_t numberOfBytesToPublish = std::min(bufferSize, mappedFileEnd - fileOffset);
+
+if(framingMode == FILE_DATA_RECEIVER_RTCM_V3_FRAMING)
+{
+SOM_TRY
+frameAndPublishData(mappedData, numberOfBytesToPublish);
+SOM_CATCH("Error framing data\n")
+}
+else
+{ //The message refers to the mapping rather than copying from it
+std::unique_ptr<std::shared_ptr<fileDataReceiverMapping> > mappingReference(new std::shared_ptr<fileDataReceiverMapping>(currentMapping));
+zmq::message_t message((void *) mappedData, numberOfBytesToPublish, releaseMappingReference, (void *) mappingReference.get());
+mappingReference.release();
+
+SOM_TRY
+publishMessage(message);
+SOM_CATCH("Error publishing data\n")
+}
+
+mappedData += numberOfBytesToPublish;
+fileOffset += numberOfBytesToPublish;
+
+if(fileOffset >= mappedFileEnd)
+{ //Done with the mapping (it is unmapped when the last message using it is freed), so go back to reading from here
+currentMapping.reset();
+mappedData = nullptr;
+
+if(lseek(inputFileNumber, fileOffset, SEEK_SET) < 0)
+{
+throw SOMException("Unable to seek to the end of the mapped data\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+}
+
+return true;
+}
+
+/**
+This function publishes a message and then passes it to the direct sinks.
+@param inputMessage: The message to publish (moved from)
+
+@throw: This function can throw exceptions
+*/
+void fileDataReceiver::publishMessage(zmq::message_t &inputMessage)
+{
+//The direct sinks go first since the data can be freed by a subscriber as soon as it is sent
+directSinks.publish((const char *) inputMessage.data(), inputMessage.size());
+
+SOM_TRY
+publishingSocket->send(inputMessage);
+SOM_CATCH("Error publishing data\n")
+}
+
+/**
+This function adds data to the bytes waiting to be framed and publishes each complete RTCM 3 frame as its own message.
+@param inputData: The data to add
+@param inputDataSize: The number of bytes to add
+
+@throw: This function can throw exceptions
+*/
+void fileDataReceiver::frameAndPublishData(const char *inputData, uint64_t inputDataSize)
+{
+//Frame straight from the given data unless there is a partial frame left over from last time
+bool isUsingWaitingData = dataWaitingToBeFramed.size() > 0;
+if(isUsingWaitingData)
+{
+dataWaitingToBeFramed.append(inputData, inputDataSize);
+}
+
+const char *data = isUsingWaitingData ? dataWaitingToBeFramed.data() : inputData;
+uint64_t dataSize = isUsingWaitingData ? dataWaitingToBeFramed.size() : inputDataSize;
+const unsigned char *bytes = (const unsigned char *) data;
+
+uint64_t position = 0;
+uint64_t discardedBytes = 0;
+while(position < dataSize)
+{
+if(bytes[position] != RTCM_V3_PREAMBLE)
+{
+position++;
+discardedBytes++;
+continue;
+}
+
+if(dataSize - position < RTCM_V3_HEADER_SIZE)
+{ //Wait for the rest of the header
+break;
+}
+
+if((bytes[position + 1] & 0xFC) != 0)
+{ //Reserved bits are set, so it isn't really a preamble
+position++;
+discardedBytes++;
+continue;
+}
+
+uint64_t payloadLength = (((uint64_t) (bytes[position + 1] & 0x03)) << 8) | bytes[position + 2];
+uint64_t frameSize = RTCM_V3_HEADER_SIZE + payloadLength + RTCM_V3_CRC_SIZE;
+if(dataSize - position < frameSize)
+{ //Wait for the rest of the frame
+break;
+}
+
+if(calculateRTCMV3CRC(data + position, frameSize) != 0)
+{ //Resynchronize starting with the next byte
+position++;
+discardedBytes++;
+continue;
+}
+
+//Count the bytes skipped to get here before the frame is seen
+numberOfDiscardedBytes += discardedBytes;
+discardedBytes = 0;
+
+zmq::message_t message(frameSize);
+memcpy(message.data(), data + position, frameSize);
+
+SOM_TRY
+publishMessage(message);
+SOM_CATCH("Error publishing frame\n")
+
+position += frameSize;
+}
+
+numberOfDiscardedBytes += discardedBytes;
+
+//Keep the partial frame (if any) for next time
+if(isUsingWaitingData)
+{
+dataWaitingToBeFramed.erase(0, position);
+}
+else
+{
+dataWaitingToBeFramed.assign(data + position, dataSize - position);
+}
+}
+
 /**
 Helper function for the common elements between constructors that delegation doesn't appear to fit well.  Should only be called as part of a constructor
 @param inputFilePointer: A file stream pointer to retrieve data from
@@ -107,6 +388,26 @@ if(inputFilePointer == nullptr)
 throw SOMException("File pointer is nullptr\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
 }
 
+if(bufferSize == 0)
+{
+throw SOMException("Buffer size must be positive\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+}
+
+readBuffer.reset(new char[bufferSize]);
+
+//Keep track of the position in regular files so they can be memory mapped
+int fileNumber = fileno(inputFilePointer);
+struct stat fileStatus;
+if(fstat(fileNumber, &fileStatus) == 0 && S_ISREG(fileStatus.st_mode))
+{
+off_t currentOffset = lseek(fileNumber, 0, SEEK_CUR);
+if(currentOffset >= 0)
+{
+isRegularFile = true;
+fileOffset = currentOffset;
+}
+}
+
 //Construct reactor
 SOM_TRY
 receiverReactor.reset(new reactor<fileDataReceiver>(&context, this));
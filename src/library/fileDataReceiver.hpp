@@ -5,7 +5,12 @@
 #include<thread>
 #include<string>
 #include<cstdio>
+#include<cstring>
+#include<atomic>
+#include<algorithm>
 #include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
 
 #include "dataReceiver.hpp"
 #include "SOMException.hpp"
@@ -13,14 +18,40 @@
 #include "zmq.hpp"
 #include "reactor.hpp"
 #include "utilityFunctions.hpp"
+#include "rtcmV3Utilities.hpp"
 #include "data_receiver_status_notification.pb.h"
 
 
 
 namespace pylongps
 {
-const int FILE_DATA_RECEIVER_DATA_BUFFER_SIZE = 1024;
+const uint64_t FILE_DATA_RECEIVER_DATA_BUFFER_SIZE = 65536; //Default largest number of bytes read/published at a time
 
+//How the data read from the file is split into messages
+enum fileDataReceiverFramingMode
+{
+FILE_DATA_RECEIVER_NO_FRAMING = 0, //Publish whatever each read returned
+FILE_DATA_RECEIVER_RTCM_V3_FRAMING = 1 //Publish each complete RTCM 3 frame as its own message, discarding any bytes which aren't part of a frame with a valid CRC
+};
+
+/**
+This class holds a memory mapped section of a file.  Messages published from the section hold a reference to it, so it is unmapped once the receiver has moved past it and the last of those messages has been freed.
+*/
+class fileDataReceiverMapping
+{
+public:
+/**
+This function unmaps the section.
+*/
+~fileDataReceiverMapping();
+
+void *mappingAddress = nullptr;
+uint64_t mappingSize = 0;
+};
+
+/**
+This class reads data from a file, pipe or serial port and publishes it.  Reads go straight into the buffers of the published messages and regular files which are only appended to (such as recordings) are memory mapped so that replaying them doesn't copy the data at all.
+*/
 class fileDataReceiver : public dataReceiver
 {
 public:
@@ -28,19 +59,25 @@ public:
 This function initializes the fileDataReceiver to retrieve data from the given file descriptor.  The object takes ownership of the file and closes the pointer on destruction.
 @param inputFilePointer: A file stream pointer to retrieve data from
 @param inputContext: A reference to the ZMQ context to use
+@param inputBufferSize: The largest number of bytes to read/publish at a time
+@param inputFramingMode: How to split the data into messages
+@param inputMemoryMapRegularFiles: True if data should be published straight from a memory mapping of the file when it is a regular file with at least inputBufferSize bytes waiting (the file must not be truncated while the receiver is using it)
 
 @throws: This function can throw exceptions
 */
-fileDataReceiver(FILE *inputFilePointer, zmq::context_t &inputContext);
+fileDataReceiver(FILE *inputFilePointer, zmq::context_t &inputContext, uint64_t inputBufferSize = FILE_DATA_RECEIVER_DATA_BUFFER_SIZE, fileDataReceiverFramingMode inputFramingMode = FILE_DATA_RECEIVER_NO_FRAMING, bool inputMemoryMapRegularFiles = false);
 
 /**
 This function initializes the fileDataReceiver to retrieve data from the file that the given path points to.
 @param inputFilePath: The path to the file to retrieve data from
 @param inputContext: A reference to the ZMQ context to use
+@param inputBufferSize: The largest number of bytes to read/publish at a time
+@param inputFramingMode: How to split the data into messages
+@param inputMemoryMapRegularFiles: True if data should be published straight from a memory mapping of the file when it is a regular file with at least inputBufferSize bytes waiting (the file must not be truncated while the receiver is using it)
 
 @throws: This function can throw exceptions
 */
-fileDataReceiver(const std::string &inputFilePath, zmq::context_t &inputContext);
+fileDataReceiver(const std::string &inputFilePath, zmq::context_t &inputContext, uint64_t inputBufferSize = FILE_DATA_RECEIVER_DATA_BUFFER_SIZE, fileDataReceiverFramingMode inputFramingMode = FILE_DATA_RECEIVER_NO_FRAMING, bool inputMemoryMapRegularFiles = false);
 
 /**
 This function returns a string containing the ZMQ connection string required to connect this object's publisher (which forwards data from the associated file).
@@ -54,13 +91,27 @@ This function is required to return a ZMQ inproc address which can be used with
 */
 virtual std::string notificationAddress();
 
+/**
+This function returns the list that data senders in the same process can attach to in order to be handed the receiver's messages directly (the messages are still published at address() for anyone else).
+@return: The list
+*/
+virtual directDataSinkList *directDataSinks();
+
+/**
+This function returns how many bytes have been thrown away by RTCM 3 framing because they weren't part of a valid frame.
+@return: The number of discarded bytes
+*/
+uint64_t getNumberOfDiscardedBytes();
+
 zmq::context_t &context;
 std::unique_ptr<zmq::socket_t> publishingSocket;
 std::unique_ptr<zmq::socket_t> notificationPublishingSocket;
 std::string publisherConnectionString; //String used to connect to this object's publisher
 std::string notificationConnectionString; //String used to publish status changes (such as unrecoverable disconnects)
-char dataBuffer[sizeof(char)*FILE_DATA_RECEIVER_DATA_BUFFER_SIZE];
-std::unique_ptr<reactor<fileDataReceiver> > receiverReactor;
+uint64_t bufferSize;
+fileDataReceiverFramingMode framingMode;
+bool memoryMapRegularFiles;
+directDataSinkList directSinks; //Given each message after it is published (declared before the reactor so it outlives the reactor's thread)
 
 protected:
 /**
@@ -72,6 +123,32 @@ This function performs a nonblocking read of the given file descriptor and (if t
 */
 bool readAndPublishData(reactor<fileDataReceiver> &inputReactor, FILE *inputFileDescriptor);
 
+/**
+This function publishes the next (up to) bufferSize bytes of the file from a memory mapping, mapping the unread part of the file first if needed.
+@param inputFileNumber: The file descriptor of the file
+@return: false if there wasn't enough unread data to be worth mapping (so it should be read instead)
+
+@throw: This function can throw exceptions
+*/
+bool publishMappedData(int inputFileNumber);
+
+/**
+This function publishes a message and then passes it to the direct sinks.
+@param inputMessage: The message to publish (moved from)
+
+@throw: This function can throw exceptions
+*/
+void publishMessage(zmq::message_t &inputMessage);
+
+/**
+This function adds data to the bytes waiting to be framed and publishes each complete RTCM 3 frame as its own message.
+@param inputData: The data to add
+@param inputDataSize: The number of bytes to add
+
+@throw: This function can throw exceptions
+*/
+void frameAndPublishData(const char *inputData, uint64_t inputDataSize);
+
 /**
 Helper function for the common elements between constructors that delegation doesn't appear to fit well.  Should only be called as part of a constructor
 @param inputFilePointer: A file stream pointer to retrieve data from
@@ -79,6 +156,19 @@ Helper function for the common elements between constructors that delegation doe
 @throw: This function can throw exceptions
 */
 void subConstructor(FILE *inputFilePointer);
+
+//Only used by the reactor thread
+std::unique_ptr<char[]> readBuffer; //Given to the published message if it is at least half full, otherwise reused
+bool isRegularFile = false;
+uint64_t fileOffset = 0; //Offset of the next unread byte if it is a regular file
+std::shared_ptr<fileDataReceiverMapping> currentMapping; //nullptr if the unread part of the file isn't mapped
+const char *mappedData = nullptr; //The byte of the mapping at fileOffset
+uint64_t mappedFileEnd = 0; //File offset of the end of the mapping
+std::string dataWaitingToBeFramed;
+
+std::atomic<uint64_t> numberOfDiscardedBytes{0};
+
+std::unique_ptr<reactor<fileDataReceiver> > receiverReactor; //Declared last so its thread is stopped before the state it uses is destroyed
 };
 
 
@@ -7,13 +7,27 @@ This function initializes the fileDataSender to send data to the given file.  Th
 @param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
 @param inputContext: A reference to the ZMQ context to use
 @param inputFilePointer: A file stream pointer to retrieve data from
+@param inputLatencyTracer: If not nullptr, traces of the messages written out are completed with this tracer (see zmqDataReceiver)
+@param inputDirectSource: If not nullptr, the sinks of the receiver publishing at the source connection string, which this object attaches to in place of subscribing (the receiver must outlive this object)
+@param inputWritePolicy: How the data is written to the file (files given as pointers can't be rotated)
 
 @throws: This function can throw exceptions
 */
-fileDataSender::fileDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, FILE *inputFilePointer) : filePointer(nullptr, &fclose), context(inputContext)
+fileDataSender::fileDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, FILE *inputFilePointer, latencyTracer *inputLatencyTracer, directDataSinkList *inputDirectSource, const batchedFileWriterPolicy &inputWritePolicy) : context(inputContext)
 {
+tracer = inputLatencyTracer;
+
+if(inputFilePointer == nullptr)
+{
+throw SOMException("Received null file descriptor\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+}
+
+SOM_TRY
+fileWriter.reset(new batchedFileWriter(inputFilePointer, inputWritePolicy, Poco::Timestamp().epochMicroseconds()));
+SOM_CATCH("Error initializing file writer\n")
+
 SOM_TRY
-subConstructor(inputSourceConnectionString, inputFilePointer);
+subConstructor(inputSourceConnectionString, inputDirectSource);
 SOM_CATCH("Error with subconstructor\n")
 }
 
@@ -22,19 +36,22 @@ This function initializes the fileDataSender to send data to the given file.  Th
 @param inputZMQConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
 @param inputContext: A reference to the ZMQ context to use
 @param inputFilePath: The path to the file to send data to
+@param inputLatencyTracer: If not nullptr, traces of the messages written out are completed with this tracer (see zmqDataReceiver)
+@param inputDirectSource: If not nullptr, the sinks of the receiver publishing at the source connection string, which this object attaches to in place of subscribing (the receiver must outlive this object)
+@param inputWritePolicy: How the data is written to the file (files given as pointers can't be rotated)
 
 @throws: This function can throw exceptions
 */
-fileDataSender::fileDataSender(const std::string &inputZMQConnectionString, zmq::context_t &inputContext, const std::string &inputFilePath) : filePointer(nullptr, &fclose), context(inputContext)
-{
-FILE *file = fopen(inputFilePath.c_str(), "wb");
-if(file == nullptr)
+fileDataSender::fileDataSender(const std::string &inputZMQConnectionString, zmq::context_t &inputContext, const std::string &inputFilePath, latencyTracer *inputLatencyTracer, directDataSinkList *inputDirectSource, const batchedFileWriterPolicy &inputWritePolicy) : context(inputContext)
 {
-throw SOMException("Unable to open file path\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
-}
+tracer = inputLatencyTracer;
 
 SOM_TRY
-subConstructor(inputZMQConnectionString, file);
+fileWriter.reset(new batchedFileWriter(inputFilePath, inputWritePolicy, Poco::Timestamp().epochMicroseconds()));
+SOM_CATCH("Error initializing file writer\n")
+
+SOM_TRY
+subConstructor(inputZMQConnectionString, inputDirectSource);
 SOM_CATCH("Error with subconstructor\n")
 }
 
@@ -47,6 +64,44 @@ std::string fileDataSender::notificationAddress()
 return notificationConnectionString;
 }
 
+/**
+This function writes a message handed over directly by the source receiver (on the receiver's thread).  If the write fails, a notification is sent and later messages are dropped.
+@param inputData: The message
+@param inputDataSize: The size of the message in bytes
+*/
+void fileDataSender::handleDirectData(const char *inputData, uint64_t inputDataSize)
+{
+std::lock_guard<std::mutex> lock(fileWriterMutex);
+
+if(writeHasFailed)
+{
+return;
+}
+
+try
+{
+writeData(inputData, inputDataSize);
+}
+catch(const std::exception &inputException)
+{ //Can't throw into the receiver's thread, so stop writing instead of killing a reactor
+reportWriteFailure();
+}
+}
+
+/**
+This function detaches from the source receiver, if attached, and writes any batched data.
+*/
+fileDataSender::~fileDataSender()
+{
+if(directSource != nullptr)
+{
+directSource->remove(this);
+}
+
+//Stop the deadline processing before the writer goes away (the writer writes what is left when it is destroyed)
+senderReactor.reset();
+}
+
 /**
 This function forwards any received messages to the given file descriptor
 @param inputReactor: The reactor which called the function
@@ -64,11 +119,15 @@ SOM_TRY
 inputSocket.recv(&messageBuffer);
 SOM_CATCH("Error, unable to receive message\n")
 
-if(fwrite(messageBuffer.data(), messageBuffer.size(), 1, filePointer.get()) != 1)
-{//File write error
-throw SOMException("File write error\n", SERVER_REQUEST_FAILED, __FILE__, __LINE__);
+std::lock_guard<std::mutex> lock(fileWriterMutex);
+if(writeHasFailed)
+{ //A deadline write failed and already sent the notification
+return false;
 }
-fflush(filePointer.get());
+
+SOM_TRY
+writeData((const char *) messageBuffer.data(), messageBuffer.size());
+SOM_CATCH("Error writing data\n")
 }
 catch(const std::exception &inputException)
 {
@@ -87,28 +146,111 @@ return false;
 }
 
 /**
-Helper function for the common elements between constructors that delegation doesn't appear to fit well.  Should only be called as part of a constructor
-@param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
-@param inputFilePointer: A file stream pointer to retrieve data from
+This function writes a message to the file (or adds it to the batch) and completes its trace.  fileWriterMutex must be held.
+@param inputData: The message
+@param inputDataSize: The size of the message in bytes
 
 @throw: This function can throw exceptions
 */
-void fileDataSender::subConstructor(const std::string &inputSourceConnectionString, FILE *inputFilePointer)
+void fileDataSender::writeData(const char *inputData, uint64_t inputDataSize)
 {
-if(inputFilePointer == nullptr)
+SOM_TRY
+fileWriter->write(inputData, inputDataSize, Poco::Timestamp().epochMicroseconds());
+SOM_CATCH("File write error\n")
+
+if(tracer != nullptr)
+{ //Batched messages count as output once they are in the batch
+tracer->completePendingTrace(inputData, inputDataSize, SENDER_OUTPUT);
+}
+}
+
+/**
+This function stops further writes and sends a notification that an unrecoverable error has occurred.  fileWriterMutex must be held.
+*/
+void fileDataSender::reportWriteFailure()
 {
-throw SOMException("Received null file descriptor\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+writeHasFailed = true;
+
+data_receiver_status_notification notification;
+notification.set_unrecoverable_error_has_occurred(true);
+
+try
+{
+sendProtobufMessage(*notificationPublishingSocket, notification);
+}
+catch(const std::exception &inputNotificationException)
+{
+fprintf(stderr, "%s", inputNotificationException.what());
+}
+}
+
+/**
+This function is used as the reactor's event handler to write/sync/rotate the file when the write policy's time based thresholds are reached.
+@param inputReactor: The reactor which called the function
+@return: When the function should next be called (negative if never)
+*/
+Poco::Timestamp fileDataSender::processWriterDeadlines(reactor<fileDataSender> &inputReactor)
+{
+std::lock_guard<std::mutex> lock(fileWriterMutex);
+
+if(writeHasFailed)
+{
+return Poco::Timestamp(-1);
 }
 
+try
+{
+return Poco::Timestamp(fileWriter->processDeadlines(Poco::Timestamp().epochMicroseconds()));
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "%s", inputException.what());
+reportWriteFailure();
+}
+
+return Poco::Timestamp(-1);
+}
+
+/**
+Helper function for the common elements between constructors that delegation doesn't appear to fit well.  Should only be called as part of a constructor, after fileWriter has been created
+@param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
+@param inputDirectSource: If not nullptr, the sinks to attach to in place of subscribing
+
+@throw: This function can throw exceptions
+*/
+void fileDataSender::subConstructor(const std::string &inputSourceConnectionString, directDataSinkList *inputDirectSource)
+{
 informationSourceConnectionString = inputSourceConnectionString;
 
+//Create socket for notification publishing
+SOM_TRY
+notificationPublishingSocket.reset(new zmq::socket_t(context, ZMQ_PUB));
+SOM_CATCH("Error making socket\n")
+
+//Bind socket for publishing and store address
+int extensionStringNumber = 0;
+SOM_TRY //Bind to an dynamically generated address
+std::tie(notificationConnectionString, extensionStringNumber) = bindZMQSocketWithAutomaticAddressGeneration(*notificationPublishingSocket, "tcpDataSenderNotificationSocketAddress");
+SOM_CATCH("Error binding notificationPublishingSocket\n")
+
+if(inputDirectSource != nullptr)
+{ //Messages are written from the receiver's thread, so no subscriber is needed and the reactor is only needed for the deadlines
+if(fileWriter->hasDeadlines())
+{
 SOM_TRY
-filePointer.reset(inputFilePointer);
-SOM_CATCH("Error, unable to store file pointer\n")
+senderReactor.reset(new reactor<fileDataSender>(&context, this, &fileDataSender::processWriterDeadlines));
+senderReactor->start();
+SOM_CATCH("Error starting reactor\n")
+}
+
+directSource = inputDirectSource;
+directSource->add(this);
+return;
+}
 
 //Construct reactor
 SOM_TRY
-senderReactor.reset(new reactor<fileDataSender>(&context, this));
+senderReactor.reset(new reactor<fileDataSender>(&context, this, &fileDataSender::processWriterDeadlines));
 SOM_CATCH("Error initializing reactor\n")
 
 //Create socket for subscribing
@@ -126,17 +268,6 @@ SOM_TRY
 subscriberSocket->connect(informationSourceConnectionString.c_str());
 SOM_CATCH("Error connecting socket\n")
 
-//Create socket for notification publishing
-SOM_TRY
-notificationPublishingSocket.reset(new zmq::socket_t(context, ZMQ_PUB));
-SOM_CATCH("Error making socket\n")
-
-//Bind socket for publishing and store address
-int extensionStringNumber = 0;
-SOM_TRY //Bind to an dynamically generated address
-std::tie(notificationConnectionString, extensionStringNumber) = bindZMQSocketWithAutomaticAddressGeneration(*notificationPublishingSocket, "tcpDataSenderNotificationSocketAddress");
-SOM_CATCH("Error binding notificationPublishingSocket\n")
-
 //Give ownership of the subscriber socket to the reactor
 SOM_TRY
 senderReactor->addInterface(subscriberSocket, &fileDataSender::readAndWriteData);
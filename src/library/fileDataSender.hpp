@@ -5,6 +5,7 @@
 #include<thread>
 #include<string>
 #include<cstdio>
+#include<mutex>
 #include<unistd.h>
 
 #include "dataSender.hpp"
@@ -13,6 +14,10 @@
 #include "zmq.hpp"
 #include "reactor.hpp"
 #include "utilityFunctions.hpp"
+#include "latencyTracer.hpp"
+#include "directDataSink.hpp"
+#include "batchedFileWriter.hpp"
+#include "Poco/Timestamp.h"
 #include "data_receiver_status_notification.pb.h" 
 
 namespace pylongps
@@ -20,9 +25,9 @@ namespace pylongps
 
 
 /**
-This class takes data published on an inproc ZMQ PUB socket and forwards it to a file stream.
+This class takes data published on an inproc ZMQ PUB socket and forwards it to a file stream.  If it is given the direct data sinks of a receiver in the same process, it instead writes each message from the receiver's thread and only starts a thread of its own if the write policy has time based settings.  By default, each message is written as it arrives.  A write policy with writeEachMessage set to false batches them into large writes instead (see batchedFileWriter).
 */
-class fileDataSender : public dataSender
+class fileDataSender : public dataSender, public directDataSink
 {
 public:
 /**
@@ -30,20 +35,26 @@ This function initializes the fileDataSender to send data to the given file.  Th
 @param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
 @param inputContext: A reference to the ZMQ context to use
 @param inputFilePointer: A file stream pointer to retrieve data from
+@param inputLatencyTracer: If not nullptr, traces of the messages written out are completed with this tracer (see zmqDataReceiver)
+@param inputDirectSource: If not nullptr, the sinks of the receiver publishing at the source connection string, which this object attaches to in place of subscribing (the receiver must outlive this object)
+@param inputWritePolicy: How the data is written to the file (files given as pointers can't be rotated)
 
 @throws: This function can throw exceptions
 */
-fileDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, FILE *inputFilePointer);
+fileDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, FILE *inputFilePointer, latencyTracer *inputLatencyTracer = nullptr, directDataSinkList *inputDirectSource = nullptr, const batchedFileWriterPolicy &inputWritePolicy = batchedFileWriterPolicy());
 
 /**
 This function initializes the fileDataSender to send data to the given file.  The object takes ownership of the file and closes the pointer on destruction.
 @param inputZMQConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
 @param inputContext: A reference to the ZMQ context to use
 @param inputFilePath: The path to the file to send data to
+@param inputLatencyTracer: If not nullptr, traces of the messages written out are completed with this tracer (see zmqDataReceiver)
+@param inputDirectSource: If not nullptr, the sinks of the receiver publishing at the source connection string, which this object attaches to in place of subscribing (the receiver must outlive this object)
+@param inputWritePolicy: How the data is written to the file (files given as pointers can't be rotated)
 
 @throws: This function can throw exceptions
 */
-fileDataSender(const std::string &inputZMQConnectionString, zmq::context_t &inputContext, const std::string &inputFilePath);
+fileDataSender(const std::string &inputZMQConnectionString, zmq::context_t &inputContext, const std::string &inputFilePath, latencyTracer *inputLatencyTracer = nullptr, directDataSinkList *inputDirectSource = nullptr, const batchedFileWriterPolicy &inputWritePolicy = batchedFileWriterPolicy());
 
 
 /**
@@ -52,15 +63,52 @@ This function is required to return a ZMQ inproc address which can be used with
 */
 virtual std::string notificationAddress();
 
+/**
+This function writes a message handed over directly by the source receiver (on the receiver's thread).  If the write fails, a notification is sent and later messages are dropped.
+@param inputData: The message
+@param inputDataSize: The size of the message in bytes
+*/
+virtual void handleDirectData(const char *inputData, uint64_t inputDataSize);
+
+/**
+This function detaches from the source receiver, if attached, and writes any batched data.
+*/
+~fileDataSender();
+
 zmq::context_t &context;
-std::unique_ptr<FILE, decltype(&fclose)> filePointer;
+std::mutex fileWriterMutex; //Guards fileWriter, writeHasFailed and the notification socket (messages and deadlines can be handled by different threads)
+std::unique_ptr<batchedFileWriter> fileWriter;
+bool writeHasFailed = false;
 std::unique_ptr<zmq::socket_t> subscriberSocket;
 std::unique_ptr<zmq::socket_t> notificationPublishingSocket;
 std::string informationSourceConnectionString; //String used to connect to the data source
 std::string notificationConnectionString; //String used to publish status changes (such as unrecoverable disconnects)
 std::unique_ptr<reactor<fileDataSender> > senderReactor;
+latencyTracer *tracer = nullptr; //Not owned
+directDataSinkList *directSource = nullptr; //Not owned, the sinks this object is attached to in place of subscribing if not nullptr
 
 protected:
+/**
+This function writes a message to the file (or adds it to the batch) and completes its trace.  fileWriterMutex must be held.
+@param inputData: The message
+@param inputDataSize: The size of the message in bytes
+
+@throw: This function can throw exceptions
+*/
+void writeData(const char *inputData, uint64_t inputDataSize);
+
+/**
+This function stops further writes and sends a notification that an unrecoverable error has occurred.  fileWriterMutex must be held.
+*/
+void reportWriteFailure();
+
+/**
+This function is used as the reactor's event handler to write/sync/rotate the file when the write policy's time based thresholds are reached.
+@param inputReactor: The reactor which called the function
+@return: When the function should next be called (negative if never)
+*/
+Poco::Timestamp processWriterDeadlines(reactor<fileDataSender> &inputReactor);
+
 /**
 This function forwards any received messages to the given file descriptor
 @param inputReactor: The reactor which called the function
@@ -71,13 +119,13 @@ This function forwards any received messages to the given file descriptor
 bool readAndWriteData(reactor<fileDataSender> &inputReactor, zmq::socket_t &inputSocket);
 
 /**
-Helper function for the common elements between constructors that delegation doesn't appear to fit well.  Should only be called as part of a constructor
+Helper function for the common elements between constructors that delegation doesn't appear to fit well.  Should only be called as part of a constructor, after fileWriter has been created
 @param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
-@param inputFilePointer: A file stream pointer to retrieve data from
+@param inputDirectSource: If not nullptr, the sinks to attach to in place of subscribing
 
 @throw: This function can throw exceptions
 */
-void subConstructor(const std::string &inputSourceConnectionString, FILE *inputFilePointer);
+void subConstructor(const std::string &inputSourceConnectionString, directDataSinkList *inputDirectSource);
 };
 
 }
@@ -0,0 +1,242 @@
+#include "keyGraph.hpp"
+
+using namespace pylongps;
+
+/**
+This function returns the ID of the given key/connection, adding a node for it if there isn't one.
+@param inputType: What the name refers to
+@param inputName: The key or connection ID
+@return: The ID of the node
+*/
+uint32_t keyGraph::addNode(keyGraphNodeType inputType, const std::string &inputName)
+{
+auto iter = nameToNodeID[inputType].find(inputName);
+if(iter != nameToNodeID[inputType].end())
+{
+return iter->second;
+}
+
+uint32_t nodeID = nodes.size();
+if(unusedNodeIDs.size() > 0)
+{
+nodeID = unusedNodeIDs.back();
+unusedNodeIDs.pop_back();
+}
+else
+{
+nodes.emplace_back();
+}
+
+keyGraphNode &node = nodes[nodeID];
+node.name = inputName;
+node.type = inputType;
+node.isInUse = true;
+node.edges.clear();
+node.numberOfNeighborsByType.fill(0);
+
+nameToNodeID[inputType].emplace(inputName, nodeID);
+return nodeID;
+}
+
+/**
+This function returns the ID of the given key/connection.
+@param inputType: What the name refers to
+@param inputName: The key or connection ID
+@return: The ID of the node or KEY_GRAPH_INVALID_NODE_ID if there isn't one
+*/
+uint32_t keyGraph::findNode(keyGraphNodeType inputType, const std::string &inputName) const
+{
+auto iter = nameToNodeID[inputType].find(inputName);
+if(iter == nameToNodeID[inputType].end())
+{
+return KEY_GRAPH_INVALID_NODE_ID;
+}
+
+return iter->second;
+}
+
+/**
+This function returns the key or connection ID of a node.
+@param inputNodeID: The ID of the node
+@return: The name (valid until the node is removed)
+*/
+const std::string &keyGraph::getName(uint32_t inputNodeID) const
+{
+return nodes[inputNodeID].name;
+}
+
+/**
+This function returns what a node refers to.
+@param inputNodeID: The ID of the node
+@return: The type of the node
+*/
+keyGraphNodeType keyGraph::getType(uint32_t inputNodeID) const
+{
+return nodes[inputNodeID].type;
+}
+
+/**
+This function links two nodes.
+@param inputFirstNodeID: The ID of one node
+@param inputSecondNodeID: The ID of the other node
+@return: false if they were already linked
+*/
+bool keyGraph::addEdge(uint32_t inputFirstNodeID, uint32_t inputSecondNodeID)
+{
+keyGraphNode &firstNode = nodes[inputFirstNodeID];
+keyGraphNode &secondNode = nodes[inputSecondNodeID];
+
+//Check the node with fewer edges (a connection key has a few signing keys while a signing key can have many connection keys)
+const keyGraphNode &nodeToSearch = firstNode.edges.size() <= secondNode.edges.size() ? firstNode : secondNode;
+uint32_t neighborToFind = &nodeToSearch == &firstNode ? inputSecondNodeID : inputFirstNodeID;
+for(const std::pair<uint32_t, uint32_t> &edge : nodeToSearch.edges)
+{
+if(edge.first == neighborToFind)
+{
+return false;
+}
+}
+
+firstNode.edges.emplace_back(inputSecondNodeID, secondNode.edges.size());
+secondNode.edges.emplace_back(inputFirstNodeID, firstNode.edges.size() - 1);
+firstNode.numberOfNeighborsByType[secondNode.type]++;
+secondNode.numberOfNeighborsByType[firstNode.type]++;
+
+return true;
+}
+
+/**
+This function unlinks two nodes.
+@param inputFirstNodeID: The ID of one node
+@param inputSecondNodeID: The ID of the other node
+@return: false if they weren't linked
+*/
+bool keyGraph::removeEdge(uint32_t inputFirstNodeID, uint32_t inputSecondNodeID)
+{
+const keyGraphNode &firstNode = nodes[inputFirstNodeID];
+const keyGraphNode &secondNode = nodes[inputSecondNodeID];
+
+//Search the node with fewer edges, then go straight to the reverse edge
+bool searchFirstNode = firstNode.edges.size() <= secondNode.edges.size();
+const keyGraphNode &nodeToSearch = searchFirstNode ? firstNode : secondNode;
+uint32_t searchedNodeID = searchFirstNode ? inputFirstNodeID : inputSecondNodeID;
+uint32_t neighborToFind = searchFirstNode ? inputSecondNodeID : inputFirstNodeID;
+
+for(uint32_t i=0; i<nodeToSearch.edges.size(); i++)
+{
+if(nodeToSearch.edges[i].first == neighborToFind)
+{
+removeHalfEdge(neighborToFind, nodeToSearch.edges[i].second);
+removeHalfEdge(searchedNodeID, i);
+return true;
+}
+}
+
+return false;
+}
+
+/**
+This function returns how many nodes are linked to a node.  Removing an edge moves the node's last neighbor into the removed edge's position, so callers which remove edges while walking the neighbors should walk from the last one.
+@param inputNodeID: The ID of the node
+@return: The number of neighbors
+*/
+uint32_t keyGraph::getNumberOfNeighbors(uint32_t inputNodeID) const
+{
+return nodes[inputNodeID].edges.size();
+}
+
+/**
+This function returns how many nodes of the given type are linked to a node.
+@param inputNodeID: The ID of the node
+@param inputType: The type of neighbor to count
+@return: The number of neighbors of that type
+*/
+uint32_t keyGraph::getNumberOfNeighbors(uint32_t inputNodeID, keyGraphNodeType inputType) const
+{
+return nodes[inputNodeID].numberOfNeighborsByType[inputType];
+}
+
+/**
+This function returns one of the nodes linked to a node.
+@param inputNodeID: The ID of the node
+@param inputNeighborIndex: Which neighbor to get (less than getNumberOfNeighbors)
+@return: The ID of the neighbor
+*/
+uint32_t keyGraph::getNeighbor(uint32_t inputNodeID, uint32_t inputNeighborIndex) const
+{
+return nodes[inputNodeID].edges[inputNeighborIndex].first;
+}
+
+/**
+This function removes a node and all of its edges.  Its ID can be given to a node added later.
+@param inputNodeID: The ID of the node
+*/
+void keyGraph::removeNode(uint32_t inputNodeID)
+{
+keyGraphNode &node = nodes[inputNodeID];
+if(!node.isInUse)
+{
+return;
+}
+
+//Only the neighbors' reverse edges need fixing since all of this node's edges are going away
+for(const std::pair<uint32_t, uint32_t> &edge : node.edges)
+{
+removeHalfEdge(edge.first, edge.second);
+}
+
+nameToNodeID[node.type].erase(node.name);
+node.edges.clear(); //Keeps its capacity for the next node given this ID
+node.numberOfNeighborsByType.fill(0);
+node.isInUse = false;
+unusedNodeIDs.push_back(inputNodeID);
+}
+
+/**
+This function returns the IDs of all of the nodes of the given type (in no particular order).
+@param inputType: The type of node to return
+@return: The IDs
+*/
+std::vector<uint32_t> keyGraph::getNodes(keyGraphNodeType inputType) const
+{
+std::vector<uint32_t> nodeIDs;
+nodeIDs.reserve(nameToNodeID[inputType].size());
+
+for(const auto &nameAndNodeID : nameToNodeID[inputType])
+{
+nodeIDs.push_back(nameAndNodeID.second);
+}
+
+return nodeIDs;
+}
+
+/**
+This function returns how many nodes of the given type there are.
+@param inputType: The type of node to count
+@return: The number of nodes
+*/
+uint64_t keyGraph::getNumberOfNodes(keyGraphNodeType inputType) const
+{
+return nameToNodeID[inputType].size();
+}
+
+/**
+This function removes one edge of a node by moving the node's last edge into its place and fixing the moved edge's reverse edge.  The reverse of the removed edge is not touched.
+@param inputNodeID: The ID of the node
+@param inputEdgeIndex: The position of the edge in the node's edges
+*/
+void keyGraph::removeHalfEdge(uint32_t inputNodeID, uint32_t inputEdgeIndex)
+{
+keyGraphNode &node = nodes[inputNodeID];
+node.numberOfNeighborsByType[nodes[node.edges[inputEdgeIndex].first].type]--;
+
+uint32_t lastEdgeIndex = node.edges.size() - 1;
+if(inputEdgeIndex != lastEdgeIndex)
+{
+node.edges[inputEdgeIndex] = node.edges[lastEdgeIndex];
+const std::pair<uint32_t, uint32_t> &movedEdge = node.edges[inputEdgeIndex];
+nodes[movedEdge.first].edges[movedEdge.second].second = inputEdgeIndex;
+}
+
+node.edges.pop_back();
+}
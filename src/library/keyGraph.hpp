@@ -0,0 +1,147 @@
+#ifndef KEYGRAPHHPP
+#define KEYGRAPHHPP
+
+#include<cstdint>
+#include<string>
+#include<vector>
+#include<array>
+#include<limits>
+#include<unordered_map>
+
+namespace pylongps
+{
+
+const uint32_t KEY_GRAPH_INVALID_NODE_ID = std::numeric_limits<uint32_t>::max();
+
+enum keyGraphNodeType
+{
+SIGNING_KEY_NODE = 0,
+CONNECTION_KEY_NODE = 1,
+AUTHENTICATED_CONNECTION_NODE = 2
+};
+
+const uint32_t NUMBER_OF_KEY_GRAPH_NODE_TYPES = 3;
+
+/**
+This class holds one node of a keyGraph.
+*/
+class keyGraphNode
+{
+public:
+std::string name; //The key or connection ID
+keyGraphNodeType type;
+bool isInUse;
+std::vector<std::pair<uint32_t, uint32_t> > edges; //<neighbor node ID, index of the reverse edge in the neighbor's edges>
+std::array<uint32_t, NUMBER_OF_KEY_GRAPH_NODE_TYPES> numberOfNeighborsByType;
+};
+
+/**
+This class stores the relationships between signing keys, the connection keys they have signed and the authenticated connections using each connection key.  Keys and connection IDs are interned into dense integer IDs once, after which the relationships are undirected edges kept in per-node adjacency vectors.  Each edge records where its reverse edge is stored, so edges (and nodes, along with all of their edges) are removed in constant time per edge by swapping with the last edge rather than by searching.  IDs of removed nodes are reused, and removed nodes keep their vectors' memory, so a steady state of additions and removals doesn't allocate.  It is not threadsafe.
+*/
+class keyGraph
+{
+public:
+/**
+This function returns the ID of the given key/connection, adding a node for it if there isn't one.
+@param inputType: What the name refers to
+@param inputName: The key or connection ID
+@return: The ID of the node
+*/
+uint32_t addNode(keyGraphNodeType inputType, const std::string &inputName);
+
+/**
+This function returns the ID of the given key/connection.
+@param inputType: What the name refers to
+@param inputName: The key or connection ID
+@return: The ID of the node or KEY_GRAPH_INVALID_NODE_ID if there isn't one
+*/
+uint32_t findNode(keyGraphNodeType inputType, const std::string &inputName) const;
+
+/**
+This function returns the key or connection ID of a node.
+@param inputNodeID: The ID of the node
+@return: The name (valid until the node is removed)
+*/
+const std::string &getName(uint32_t inputNodeID) const;
+
+/**
+This function returns what a node refers to.
+@param inputNodeID: The ID of the node
+@return: The type of the node
+*/
+keyGraphNodeType getType(uint32_t inputNodeID) const;
+
+/**
+This function links two nodes.
+@param inputFirstNodeID: The ID of one node
+@param inputSecondNodeID: The ID of the other node
+@return: false if they were already linked
+*/
+bool addEdge(uint32_t inputFirstNodeID, uint32_t inputSecondNodeID);
+
+/**
+This function unlinks two nodes.
+@param inputFirstNodeID: The ID of one node
+@param inputSecondNodeID: The ID of the other node
+@return: false if they weren't linked
+*/
+bool removeEdge(uint32_t inputFirstNodeID, uint32_t inputSecondNodeID);
+
+/**
+This function returns how many nodes are linked to a node.  Removing an edge moves the node's last neighbor into the removed edge's position, so callers which remove edges while walking the neighbors should walk from the last one.
+@param inputNodeID: The ID of the node
+@return: The number of neighbors
+*/
+uint32_t getNumberOfNeighbors(uint32_t inputNodeID) const;
+
+/**
+This function returns how many nodes of the given type are linked to a node.
+@param inputNodeID: The ID of the node
+@param inputType: The type of neighbor to count
+@return: The number of neighbors of that type
+*/
+uint32_t getNumberOfNeighbors(uint32_t inputNodeID, keyGraphNodeType inputType) const;
+
+/**
+This function returns one of the nodes linked to a node.
+@param inputNodeID: The ID of the node
+@param inputNeighborIndex: Which neighbor to get (less than getNumberOfNeighbors)
+@return: The ID of the neighbor
+*/
+uint32_t getNeighbor(uint32_t inputNodeID, uint32_t inputNeighborIndex) const;
+
+/**
+This function removes a node and all of its edges.  Its ID can be given to a node added later.
+@param inputNodeID: The ID of the node
+*/
+void removeNode(uint32_t inputNodeID);
+
+/**
+This function returns the IDs of all of the nodes of the given type (in no particular order).
+@param inputType: The type of node to return
+@return: The IDs
+*/
+std::vector<uint32_t> getNodes(keyGraphNodeType inputType) const;
+
+/**
+This function returns how many nodes of the given type there are.
+@param inputType: The type of node to count
+@return: The number of nodes
+*/
+uint64_t getNumberOfNodes(keyGraphNodeType inputType) const;
+
+private:
+/**
+This function removes one edge of a node by moving the node's last edge into its place and fixing the moved edge's reverse edge.  The reverse of the removed edge is not touched.
+@param inputNodeID: The ID of the node
+@param inputEdgeIndex: The position of the edge in the node's edges
+*/
+void removeHalfEdge(uint32_t inputNodeID, uint32_t inputEdgeIndex);
+
+std::vector<keyGraphNode> nodes;
+std::vector<uint32_t> unusedNodeIDs;
+std::array<std::unordered_map<std::string, uint32_t>, NUMBER_OF_KEY_GRAPH_NODE_TYPES> nameToNodeID; //One map per type
+};
+
+}
+#endif
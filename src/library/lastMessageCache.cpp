@@ -0,0 +1,110 @@
+#include "lastMessageCache.hpp"
+
+using namespace pylongps;
+
+/**
+This function initializes the cache.
+@param inputOnlyKeepStationDescriptions: True if only RTCM 3 station description messages (see isRTCMV3StationDescriptionMessageType) should be kept
+*/
+lastMessageCache::lastMessageCache(bool inputOnlyKeepStationDescriptions)
+{
+onlyKeepStationDescriptions = inputOnlyKeepStationDescriptions;
+}
+
+/**
+This function adds a message to the cache, replacing the last message of the same RTCM type.  Messages which aren't a single RTCM 3 frame are ignored.
+@param inputMessage: The message to add (including any header)
+@param inputMessageSize: The size of the message in bytes
+@param inputHeaderSize: How many bytes at the start of the message come before the payload (such as the casterID/streamID header) and should be skipped when determining the message type
+*/
+void lastMessageCache::addMessage(const char *inputMessage, uint64_t inputMessageSize, uint64_t inputHeaderSize)
+{
+numberOfMessagesAdded++;
+
+std::pair<bool, uint32_t> rtcmType(false, 0);
+if(inputMessageSize > inputHeaderSize)
+{
+rtcmType = getRTCMV3MessageType(inputMessage + inputHeaderSize, inputMessageSize - inputHeaderSize);
+}
+
+if(!rtcmType.first || (onlyKeepStationDescriptions && !isRTCMV3StationDescriptionMessageType(rtcmType.second)))
+{
+return;
+}
+
+//Only keep the latest of each type
+std::pair<uint64_t, std::string> &entry = rtcmMessageTypeToLastMessage[rtcmType.second];
+entry.first = numberOfMessagesAdded;
+entry.second.assign(inputMessage, inputMessageSize);
+}
+
+/**
+This function returns the cached messages in the order they were added.
+@return: Pointers to the cached messages (valid until the cache is next modified)
+*/
+std::vector<const std::string *> lastMessageCache::getMessages() const
+{
+std::vector<std::pair<uint64_t, const std::string *> > orderedMessages;
+
+for(auto iter = rtcmMessageTypeToLastMessage.begin(); iter != rtcmMessageTypeToLastMessage.end(); iter++)
+{
+orderedMessages.emplace_back(iter->second.first, &iter->second.second);
+}
+
+std::sort(orderedMessages.begin(), orderedMessages.end());
+
+std::vector<const std::string *> messages;
+for(auto iter = orderedMessages.begin(); iter != orderedMessages.end(); iter++)
+{
+messages.push_back(iter->second);
+}
+
+return messages;
+}
+
+/**
+This function checks if the given data is a single complete RTCM 3 frame and returns its message type if so.
+@param inputData: The data to check
+@param inputDataSize: The size of the data in bytes
+@return: <true if it is a single RTCM 3 frame, message type>
+*/
+std::pair<bool, uint32_t> pylongps::getRTCMV3MessageType(const char *inputData, uint64_t inputDataSize)
+{
+const unsigned char *data = (const unsigned char *) inputData;
+
+//Need the header, the 12 bit message type and the CRC
+if(inputDataSize < RTCM_V3_HEADER_SIZE + 2 + RTCM_V3_CRC_SIZE || data[0] != RTCM_V3_PREAMBLE)
+{
+return std::pair<bool, uint32_t>(false, 0);
+}
+
+uint64_t payloadLength = (((uint64_t) (data[1] & 0x03)) << 8) | data[2];
+if(RTCM_V3_HEADER_SIZE + payloadLength + RTCM_V3_CRC_SIZE != inputDataSize)
+{ //Partial frame or several frames
+return std::pair<bool, uint32_t>(false, 0);
+}
+
+uint32_t messageType = (((uint32_t) data[3]) << 4) | (data[4] >> 4);
+return std::pair<bool, uint32_t>(true, messageType);
+}
+
+/**
+This function checks if the given RTCM 3 message type describes the station rather than carrying observations (antenna reference point 1005/1006, antenna/receiver descriptors 1007/1008/1033 and GLONASS biases 1230).  These messages stay valid, so replaying them to a subscriber which already has them is harmless.
+@param inputMessageType: The RTCM 3 message type
+@return: true if it is a station description message
+*/
+bool pylongps::isRTCMV3StationDescriptionMessageType(uint32_t inputMessageType)
+{
+switch(inputMessageType)
+{
+case 1005:
+case 1006:
+case 1007:
+case 1008:
+case 1033:
+case 1230:
+return true;
+default:
+return false;
+}
+}
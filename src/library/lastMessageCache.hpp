@@ -0,0 +1,63 @@
+#ifndef LASTMESSAGECACHEHPP
+#define LASTMESSAGECACHEHPP
+
+#include<cstdint>
+#include<string>
+#include<vector>
+#include<map>
+#include<algorithm>
+
+#include "rtcmV3Utilities.hpp"
+
+namespace pylongps
+{
+
+/**
+This class keeps the most recent messages published for a stream so that they can be replayed to a new subscriber (RTCM 3 rovers can't compute a fix until they have seen slow cycling messages such as the station coordinates).  Messages which are a single RTCM 3 frame are stored by message type (keeping only the latest of each type).  Other messages are not kept, since the replay goes to every subscriber of the stream and there is no way to tell which of them are safe to repeat.  The cache can instead be limited to the RTCM 3 station description messages, which don't go stale, for when the replay also reaches subscribers which already have them.  Stored strings are reused, so adding a message normally doesn't allocate.
+*/
+class lastMessageCache
+{
+public:
+/**
+This function initializes the cache.
+@param inputOnlyKeepStationDescriptions: True if only RTCM 3 station description messages (see isRTCMV3StationDescriptionMessageType) should be kept
+*/
+lastMessageCache(bool inputOnlyKeepStationDescriptions = false);
+
+/**
+This function adds a message to the cache, replacing the last message of the same RTCM type.  Messages which aren't a single RTCM 3 frame are ignored.
+@param inputMessage: The message to add (including any header)
+@param inputMessageSize: The size of the message in bytes
+@param inputHeaderSize: How many bytes at the start of the message come before the payload (such as the casterID/streamID header) and should be skipped when determining the message type
+*/
+void addMessage(const char *inputMessage, uint64_t inputMessageSize, uint64_t inputHeaderSize = 0);
+
+/**
+This function returns the cached messages in the order they were added.
+@return: Pointers to the cached messages (valid until the cache is next modified)
+*/
+std::vector<const std::string *> getMessages() const;
+
+private:
+bool onlyKeepStationDescriptions;
+uint64_t numberOfMessagesAdded = 0; //Used to keep track of the order messages were added in
+std::map<uint32_t, std::pair<uint64_t, std::string> > rtcmMessageTypeToLastMessage; //RTCM 3 type -> <order added, message>
+};
+
+/**
+This function checks if the given data is a single complete RTCM 3 frame and returns its message type if so.
+@param inputData: The data to check
+@param inputDataSize: The size of the data in bytes
+@return: <true if it is a single RTCM 3 frame, message type>
+*/
+std::pair<bool, uint32_t> getRTCMV3MessageType(const char *inputData, uint64_t inputDataSize);
+
+/**
+This function checks if the given RTCM 3 message type describes the station rather than carrying observations (antenna reference point 1005/1006, antenna/receiver descriptors 1007/1008/1033 and GLONASS biases 1230).  These messages stay valid, so replaying them to a subscriber which already has them is harmless.
+@param inputMessageType: The RTCM 3 message type
+@return: true if it is a station description message
+*/
+bool isRTCMV3StationDescriptionMessageType(uint32_t inputMessageType);
+
+}
+#endif
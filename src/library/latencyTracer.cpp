@@ -0,0 +1,165 @@
+#include "latencyTracer.hpp"
+
+using namespace pylongps;
+
+/**
+This function adds the latencies of a completed trace to the histograms.
+@param inputTraceHops: The hops of the trace, in the order they happened
+*/
+void latencyTracer::addTrace(const std::vector<traceHop> &inputTraceHops)
+{
+if(inputTraceHops.size() < 2)
+{
+return; //No latencies to add
+}
+
+std::lock_guard<std::mutex> lock(tracerMutex);
+for(uint64_t i=1; i<inputTraceHops.size(); i++)
+{
+std::pair<trace_hop_type, trace_hop_type> hopPair(inputTraceHops[i-1].type, inputTraceHops[i].type);
+if(hopPairToHistogram.count(hopPair) == 0)
+{
+hopPairToHistogram[hopPair].set_previous_hop(hopPair.first);
+hopPairToHistogram[hopPair].set_hop(hopPair.second);
+}
+
+addLatencyToHistogram(inputTraceHops[i].time - inputTraceHops[i-1].time, hopPairToHistogram.at(hopPair));
+}
+
+endToEndHistogram.set_previous_hop(inputTraceHops.front().type);
+endToEndHistogram.set_hop(inputTraceHops.back().type);
+endToEndHistogram.set_is_end_to_end(true);
+addLatencyToHistogram(inputTraceHops.back().time - inputTraceHops.front().time, endToEndHistogram);
+}
+
+/**
+This function holds a trace until a data sender outputs the given payload or PENDING_TRACE_TIMEOUT passes.
+@param inputPayload: The payload of the traced message
+@param inputPayloadSize: The size of the payload in bytes
+@param inputTraceHops: The hops of the trace so far
+*/
+void latencyTracer::addPendingTrace(const char *inputPayload, uint64_t inputPayloadSize, const std::vector<traceHop> &inputTraceHops)
+{
+int64_t currentTime = getMonotonicTime();
+std::string payload(inputPayload, inputPayloadSize);
+
+std::lock_guard<std::mutex> lock(tracerMutex);
+removeExpiredPendingTraces(currentTime);
+
+payloadToPendingTrace[payload] = inputTraceHops;
+pendingTraceTimesAndPayloads.emplace_back(currentTime, payload);
+}
+
+/**
+This function checks if a trace is pending for the given payload and, if so, adds the final hop (at the current time) and adds the trace to the histograms.
+@param inputPayload: The payload that was output
+@param inputPayloadSize: The size of the payload in bytes
+@param inputFinalHop: The type of hop to add
+@return: true if a trace was completed
+*/
+bool latencyTracer::completePendingTrace(const char *inputPayload, uint64_t inputPayloadSize, trace_hop_type inputFinalHop)
+{
+int64_t currentTime = getMonotonicTime();
+std::vector<traceHop> traceHops;
+
+{
+std::lock_guard<std::mutex> lock(tracerMutex);
+removeExpiredPendingTraces(currentTime);
+
+if(payloadToPendingTrace.size() == 0)
+{ //Usual case, so avoid copying the payload
+return false;
+}
+
+auto iter = payloadToPendingTrace.find(std::string(inputPayload, inputPayloadSize));
+if(iter == payloadToPendingTrace.end())
+{
+return false;
+}
+
+traceHops = std::move(iter->second);
+payloadToPendingTrace.erase(iter);
+}
+
+traceHops.push_back(traceHop(inputFinalHop, currentTime));
+addTrace(traceHops);
+return true;
+}
+
+/**
+This function returns the histograms collected so far.
+@return: The histograms, with the end to end histogram first (if any traces have been added)
+*/
+latency_trace_report latencyTracer::getReport()
+{
+latency_trace_report report;
+
+std::lock_guard<std::mutex> lock(tracerMutex);
+if(endToEndHistogram.number_of_samples() > 0)
+{
+(*report.add_histograms()) = endToEndHistogram;
+}
+
+for(const auto &hopPairAndHistogram : hopPairToHistogram)
+{
+(*report.add_histograms()) = hopPairAndHistogram.second;
+}
+
+return report;
+}
+
+/**
+This function removes all histograms and pending traces.
+*/
+void latencyTracer::clear()
+{
+std::lock_guard<std::mutex> lock(tracerMutex);
+hopPairToHistogram.clear();
+endToEndHistogram.Clear();
+payloadToPendingTrace.clear();
+pendingTraceTimesAndPayloads.clear();
+}
+
+/**
+This function removes pending traces that are older than PENDING_TRACE_TIMEOUT.  The mutex is expected to be held by the caller.
+@param inputCurrentTime: The current time (see getMonotonicTime)
+*/
+void latencyTracer::removeExpiredPendingTraces(int64_t inputCurrentTime)
+{
+while(pendingTraceTimesAndPayloads.size() > 0 && (inputCurrentTime - pendingTraceTimesAndPayloads.front().first) > PENDING_TRACE_TIMEOUT*1000000000.0)
+{
+payloadToPendingTrace.erase(pendingTraceTimesAndPayloads.front().second);
+pendingTraceTimesAndPayloads.pop_front();
+}
+}
+
+/**
+This function adds a latency to a histogram, initializing its buckets if this is the first sample.
+@param inputLatency: The latency to add in nanoseconds
+@param inputHistogram: The histogram to update
+*/
+void pylongps::addLatencyToHistogram(int64_t inputLatency, latency_histogram &inputHistogram)
+{
+if(inputHistogram.bucket_counts_size() != NUMBER_OF_LATENCY_HISTOGRAM_BUCKETS)
+{
+inputHistogram.clear_bucket_counts();
+for(uint32_t i=0; i<NUMBER_OF_LATENCY_HISTOGRAM_BUCKETS; i++)
+{
+inputHistogram.add_bucket_counts(0);
+}
+}
+
+inputLatency = std::max<int64_t>(inputLatency, 0); //Shouldn't happen with a monotonic clock
+
+//Find the highest set bit
+uint32_t bucketIndex = 0;
+for(uint64_t remainingLatency = inputLatency >> 1; remainingLatency > 0 && bucketIndex < (NUMBER_OF_LATENCY_HISTOGRAM_BUCKETS - 1); remainingLatency >>= 1)
+{
+bucketIndex++;
+}
+
+inputHistogram.set_bucket_counts(bucketIndex, inputHistogram.bucket_counts(bucketIndex) + 1);
+inputHistogram.set_number_of_samples(inputHistogram.number_of_samples() + 1);
+inputHistogram.set_total_latency(inputHistogram.total_latency() + inputLatency);
+inputHistogram.set_maximum_latency(std::max<int64_t>(inputHistogram.maximum_latency(), inputLatency));
+}
@@ -0,0 +1,83 @@
+#ifndef LATENCYTRACERHPP
+#define LATENCYTRACERHPP
+
+#include<cstdint>
+#include<string>
+#include<vector>
+#include<map>
+#include<unordered_map>
+#include<deque>
+#include<mutex>
+#include "streamFrameHeader.hpp"
+#include "latency_histogram.pb.h"
+#include "latency_trace_report.pb.h"
+
+namespace pylongps
+{
+
+const uint32_t NUMBER_OF_LATENCY_HISTOGRAM_BUCKETS = 40; //Power of two buckets, so the last one starts at about 9 minutes
+const double PENDING_TRACE_TIMEOUT = 1.0; //Seconds before a trace which was not completed by a data sender is dropped
+
+/**
+This class aggregates the latency traces of sampled stream messages into a histogram per pair of consecutive hops and an end to end histogram (first hop to last hop).  It can also hold traces which have reached a zmqDataReceiver until a data sender writes out the same payload, since the payload is all the receiver passes on.  It is threadsafe, so it can be shared by the receivers/senders of a transceiver.
+*/
+class latencyTracer
+{
+public:
+/**
+This function adds the latencies of a completed trace to the histograms.
+@param inputTraceHops: The hops of the trace, in the order they happened
+*/
+void addTrace(const std::vector<traceHop> &inputTraceHops);
+
+/**
+This function holds a trace until a data sender outputs the given payload or PENDING_TRACE_TIMEOUT passes.
+@param inputPayload: The payload of the traced message
+@param inputPayloadSize: The size of the payload in bytes
+@param inputTraceHops: The hops of the trace so far
+*/
+void addPendingTrace(const char *inputPayload, uint64_t inputPayloadSize, const std::vector<traceHop> &inputTraceHops);
+
+/**
+This function checks if a trace is pending for the given payload and, if so, adds the final hop (at the current time) and adds the trace to the histograms.
+@param inputPayload: The payload that was output
+@param inputPayloadSize: The size of the payload in bytes
+@param inputFinalHop: The type of hop to add
+@return: true if a trace was completed
+*/
+bool completePendingTrace(const char *inputPayload, uint64_t inputPayloadSize, trace_hop_type inputFinalHop);
+
+/**
+This function returns the histograms collected so far.
+@return: The histograms, with the end to end histogram first (if any traces have been added)
+*/
+latency_trace_report getReport();
+
+/**
+This function removes all histograms and pending traces.
+*/
+void clear();
+
+private:
+/**
+This function removes pending traces that are older than PENDING_TRACE_TIMEOUT.  The mutex is expected to be held by the caller.
+@param inputCurrentTime: The current time (see getMonotonicTime)
+*/
+void removeExpiredPendingTraces(int64_t inputCurrentTime);
+
+std::mutex tracerMutex;
+std::map<std::pair<trace_hop_type, trace_hop_type>, latency_histogram> hopPairToHistogram;
+latency_histogram endToEndHistogram;
+std::unordered_map<std::string, std::vector<traceHop> > payloadToPendingTrace;
+std::deque<std::pair<int64_t, std::string> > pendingTraceTimesAndPayloads; //Oldest first
+};
+
+/**
+This function adds a latency to a histogram, initializing its buckets if this is the first sample.
+@param inputLatency: The latency to add in nanoseconds
+@param inputHistogram: The histogram to update
+*/
+void addLatencyToHistogram(int64_t inputLatency, latency_histogram &inputHistogram);
+
+}
+#endif
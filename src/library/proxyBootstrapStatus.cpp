@@ -0,0 +1,13 @@
+#include "proxyBootstrapStatus.hpp"
+
+using namespace pylongps;
+
+/*
+This function sets numberOfFailedAttempts to 0, querySocket to nullptr and eventTime to -1.
+*/
+proxyBootstrapStatus::proxyBootstrapStatus()
+{
+numberOfFailedAttempts = 0;
+querySocket = nullptr;
+eventTime = -1;
+}
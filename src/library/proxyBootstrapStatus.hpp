@@ -0,0 +1,32 @@
+#ifndef PROXYBOOTSTRAPSTATUSHPP
+#define PROXYBOOTSTRAPSTATUSHPP
+
+#include<cstdint>
+#include<vector>
+#include "Poco/Timestamp.h"
+#include "zmq.hpp"
+
+
+namespace pylongps
+{
+ 
+
+/**
+This class is used in a map to keep track of a caster that has been added as a proxy but has not returned the metadata for its basestations yet.
+*/
+class proxyBootstrapStatus
+{
+public:
+/*
+This function sets numberOfFailedAttempts to 0, querySocket to nullptr and eventTime to -1.
+*/
+proxyBootstrapStatus();
+
+std::vector<int64_t> operationIDs; //The addProxyAsync calls waiting for the proxy to be established
+uint32_t numberOfFailedAttempts;
+zmq::socket_t *querySocket; //The ephemeral socket the current query was sent on (owned by the reactor), nullptr while waiting to retry
+Poco::Timestamp::TimeVal eventTime; //When the proxy's one pending query timeout or retry event is scheduled (events with other times are stale and ignored)
+};
+
+}
+#endif
@@ -0,0 +1,190 @@
+#include "proxyStreamTable.hpp"
+
+using namespace pylongps;
+
+/*
+This function sets the entry to an empty slot.
+*/
+proxyStreamTableEntry::proxyStreamTableEntry() : foreignCasterID(0), foreignStreamID(0), localStreamID(0), lastMessageTime(0), timeoutEventTime(-1), stationClass(COMMUNITY), nextSequenceNumber(0), foreignCasterAddsStreamFrameHeaders(false), lastCasterMessageTime(nullptr), isOccupied(false)
+{
+}
+
+/**
+This function initializes the table.
+@param inputInitialCapacity: How many slots to start with (rounded up to a power of 2)
+*/
+proxyStreamTable::proxyStreamTable(uint64_t inputInitialCapacity) : numberOfEntries(0)
+{
+uint64_t capacity = 2;
+while(capacity < inputInitialCapacity)
+{
+capacity *= 2;
+}
+
+slots.resize(capacity);
+}
+
+/**
+This function finds the entry of a proxied stream.
+@param inputForeignCasterID: The ID of the caster the stream is proxied from
+@param inputForeignStreamID: The ID of the stream on that caster
+@return: The entry (valid until the table is next modified) or nullptr if the stream isn't in the table
+*/
+proxyStreamTableEntry *proxyStreamTable::find(int64_t inputForeignCasterID, int64_t inputForeignStreamID)
+{
+uint64_t mask = slots.size() - 1;
+for(uint64_t i = getHomeSlot(inputForeignCasterID, inputForeignStreamID); slots[i].isOccupied; i = (i + 1) & mask)
+{ //The table is never full, so the probe always reaches an empty slot
+if(slots[i].foreignCasterID == inputForeignCasterID && slots[i].foreignStreamID == inputForeignStreamID)
+{
+return &slots[i];
+}
+}
+
+return nullptr;
+}
+
+/**
+This function adds an entry for a proxied stream.  Other than its IDs, the entry's fields are left at their defaults for the caller to fill in.
+@param inputForeignCasterID: The ID of the caster the stream is proxied from
+@param inputForeignStreamID: The ID of the stream on that caster
+@param inputLocalStreamID: The ID of the stream on this caster
+@return: The new entry (valid until the table is next modified) or nullptr if the stream was already in the table
+*/
+proxyStreamTableEntry *proxyStreamTable::insert(int64_t inputForeignCasterID, int64_t inputForeignStreamID, int64_t inputLocalStreamID)
+{
+if(find(inputForeignCasterID, inputForeignStreamID) != nullptr)
+{
+return nullptr;
+}
+
+if((numberOfEntries + 1)*2 > slots.size())
+{ //Keep the table at most half full so probes stay short
+grow();
+}
+
+uint64_t mask = slots.size() - 1;
+uint64_t slotIndex = getHomeSlot(inputForeignCasterID, inputForeignStreamID);
+while(slots[slotIndex].isOccupied)
+{
+slotIndex = (slotIndex + 1) & mask;
+}
+
+proxyStreamTableEntry &entry = slots[slotIndex];
+entry = proxyStreamTableEntry();
+entry.foreignCasterID = inputForeignCasterID;
+entry.foreignStreamID = inputForeignStreamID;
+entry.localStreamID = inputLocalStreamID;
+entry.isOccupied = true;
+numberOfEntries++;
+
+return &entry;
+}
+
+/**
+This function removes the entry of a proxied stream.
+@param inputForeignCasterID: The ID of the caster the stream is proxied from
+@param inputForeignStreamID: The ID of the stream on that caster
+@return: true if the stream was in the table
+*/
+bool proxyStreamTable::erase(int64_t inputForeignCasterID, int64_t inputForeignStreamID)
+{
+proxyStreamTableEntry *entry = find(inputForeignCasterID, inputForeignStreamID);
+if(entry == nullptr)
+{
+return false;
+}
+
+//Move later entries of the probe run back into the gap if their home slot allows it, so lookups never stop early at it
+uint64_t mask = slots.size() - 1;
+uint64_t gapIndex = entry - slots.data();
+for(uint64_t i = (gapIndex + 1) & mask; slots[i].isOccupied; i = (i + 1) & mask)
+{
+uint64_t homeSlot = getHomeSlot(slots[i].foreignCasterID, slots[i].foreignStreamID);
+
+//Distance probed from the home slot to the entry vs to the gap (modulo the table size)
+if(((i - homeSlot) & mask) >= ((i - gapIndex) & mask))
+{
+slots[gapIndex] = slots[i];
+gapIndex = i;
+}
+}
+
+slots[gapIndex] = proxyStreamTableEntry();
+numberOfEntries--;
+
+return true;
+}
+
+/**
+This function returns the entries in the table (in no particular order).
+@return: Pointers to the entries (valid until the table is next modified)
+*/
+std::vector<proxyStreamTableEntry *> proxyStreamTable::getEntries()
+{
+std::vector<proxyStreamTableEntry *> entries;
+entries.reserve(numberOfEntries);
+
+for(proxyStreamTableEntry &slot : slots)
+{
+if(slot.isOccupied)
+{
+entries.push_back(&slot);
+}
+}
+
+return entries;
+}
+
+/**
+This function returns how many streams are in the table.
+@return: The number of entries
+*/
+uint64_t proxyStreamTable::size() const
+{
+return numberOfEntries;
+}
+
+/**
+This function returns the slot that the given stream's probe sequence starts at.
+@param inputForeignCasterID: The ID of the caster the stream is proxied from
+@param inputForeignStreamID: The ID of the stream on that caster
+@return: The index of the slot
+*/
+uint64_t proxyStreamTable::getHomeSlot(int64_t inputForeignCasterID, int64_t inputForeignStreamID) const
+{
+//Combine the IDs and mix the bits (splitmix64 finalizer), since stream IDs are often sequential
+uint64_t hash = ((uint64_t) inputForeignCasterID)*0x9E3779B97F4A7C15ULL ^ ((uint64_t) inputForeignStreamID);
+hash ^= hash >> 30;
+hash *= 0xBF58476D1CE4E5B9ULL;
+hash ^= hash >> 27;
+hash *= 0x94D049BB133111EBULL;
+hash ^= hash >> 31;
+
+return hash & (slots.size() - 1);
+}
+
+/**
+This function moves the entries into a table with twice as many slots.
+*/
+void proxyStreamTable::grow()
+{
+std::vector<proxyStreamTableEntry> oldSlots(slots.size()*2);
+oldSlots.swap(slots);
+
+uint64_t mask = slots.size() - 1;
+for(const proxyStreamTableEntry &oldSlot : oldSlots)
+{
+if(!oldSlot.isOccupied)
+{
+continue;
+}
+
+uint64_t slotIndex = getHomeSlot(oldSlot.foreignCasterID, oldSlot.foreignStreamID);
+while(slots[slotIndex].isOccupied)
+{
+slotIndex = (slotIndex + 1) & mask;
+}
+slots[slotIndex] = oldSlot;
+}
+}
@@ -0,0 +1,106 @@
+#ifndef PROXYSTREAMTABLEHPP
+#define PROXYSTREAMTABLEHPP
+
+#include<cstdint>
+#include<vector>
+#include<atomic>
+#include "Poco/Timestamp.h"
+#include "common_enums.pb.h"
+
+namespace pylongps
+{
+
+const uint64_t PROXY_STREAM_TABLE_INITIAL_CAPACITY = 64; //Must be a power of 2
+
+/**
+This class holds everything the caster needs to forward the messages of one proxied stream, so that handling a proxied message takes a single table lookup.
+*/
+class proxyStreamTableEntry
+{
+public:
+/*
+This function sets the entry to an empty slot.
+*/
+proxyStreamTableEntry();
+
+int64_t foreignCasterID;
+int64_t foreignStreamID;
+int64_t localStreamID;
+Poco::Timestamp::TimeVal lastMessageTime; //When the last message (or notification) for the stream was received
+Poco::Timestamp::TimeVal timeoutEventTime; //When the stream's one pending possible_proxy_stream_timeout_event is scheduled (events with other times are stale and ignored), -1 if none
+base_station_class stationClass; //Determines which publishing queue the stream's messages go to
+uint64_t nextSequenceNumber; //Sequence number to give the next message which arrives without a stream frame header
+bool foreignCasterAddsStreamFrameHeaders; //True if the foreign caster announced that it publishes the stream with stream frame headers
+std::atomic<int64_t> *lastCasterMessageTime; //The metrics slot of the foreign caster (cached on the first message), nullptr until then
+bool isOccupied;
+};
+
+/**
+This class maps (foreign caster ID, foreign stream ID) to the entry of a proxied stream.  It is an open addressing hash table with linear probing which is kept at most half full, so lookups normally touch one or two adjacent slots and don't allocate.  Erased entries are filled by shifting the following entries back rather than leaving tombstones.  It is not threadsafe.
+*/
+class proxyStreamTable
+{
+public:
+/**
+This function initializes the table.
+@param inputInitialCapacity: How many slots to start with (rounded up to a power of 2)
+*/
+proxyStreamTable(uint64_t inputInitialCapacity = PROXY_STREAM_TABLE_INITIAL_CAPACITY);
+
+/**
+This function finds the entry of a proxied stream.
+@param inputForeignCasterID: The ID of the caster the stream is proxied from
+@param inputForeignStreamID: The ID of the stream on that caster
+@return: The entry (valid until the table is next modified) or nullptr if the stream isn't in the table
+*/
+proxyStreamTableEntry *find(int64_t inputForeignCasterID, int64_t inputForeignStreamID);
+
+/**
+This function adds an entry for a proxied stream.  Other than its IDs, the entry's fields are left at their defaults for the caller to fill in.
+@param inputForeignCasterID: The ID of the caster the stream is proxied from
+@param inputForeignStreamID: The ID of the stream on that caster
+@param inputLocalStreamID: The ID of the stream on this caster
+@return: The new entry (valid until the table is next modified) or nullptr if the stream was already in the table
+*/
+proxyStreamTableEntry *insert(int64_t inputForeignCasterID, int64_t inputForeignStreamID, int64_t inputLocalStreamID);
+
+/**
+This function removes the entry of a proxied stream.
+@param inputForeignCasterID: The ID of the caster the stream is proxied from
+@param inputForeignStreamID: The ID of the stream on that caster
+@return: true if the stream was in the table
+*/
+bool erase(int64_t inputForeignCasterID, int64_t inputForeignStreamID);
+
+/**
+This function returns the entries in the table (in no particular order).
+@return: Pointers to the entries (valid until the table is next modified)
+*/
+std::vector<proxyStreamTableEntry *> getEntries();
+
+/**
+This function returns how many streams are in the table.
+@return: The number of entries
+*/
+uint64_t size() const;
+
+private:
+/**
+This function returns the slot that the given stream's probe sequence starts at.
+@param inputForeignCasterID: The ID of the caster the stream is proxied from
+@param inputForeignStreamID: The ID of the stream on that caster
+@return: The index of the slot
+*/
+uint64_t getHomeSlot(int64_t inputForeignCasterID, int64_t inputForeignStreamID) const;
+
+/**
+This function moves the entries into a table with twice as many slots.
+*/
+void grow();
+
+std::vector<proxyStreamTableEntry> slots;
+uint64_t numberOfEntries;
+};
+
+}
+#endif
@@ -9,6 +9,8 @@
 #include "SOMScopeGuard.hpp"
 #include "event.hpp"
 #include "utilityFunctions.hpp"
+#include "traceRing.hpp"
+#include "timeSource.hpp"
 #include "Poco/Timestamp.h"
 #include "zmq.hpp"
 
@@ -26,10 +28,11 @@ This function initializes the reactor with the function that should be called to
 @param inputContext: The ZMQ context that this object should use
 @param inputClassInstance: The instance of the class that the given functions should operate on
 @param inputEventHandler: The function to call to handle events in the queue (should return negative if there are no outstanding events).  Can be set to nullptr to disable event handling.
+@param inputTimeSource: The source of the current time used to decide when events are due (the wall clock if nullptr).  It must outlive the reactor
 
 @throws: This function can throw exceptions
 */
-reactor(zmq::context_t *inputContext, classType *inputClassInstance, std::function<Poco::Timestamp (classType*, reactor<classType> &)> inputEventHandler = nullptr);
+reactor(zmq::context_t *inputContext, classType *inputClassInstance, std::function<Poco::Timestamp (classType*, reactor<classType> &)> inputEventHandler = nullptr, timeSource *inputTimeSource = nullptr);
 
 /**
 This (not thread safe) function adds a new socket for the reactor to take ownership of and the member function to call/pass the socket reference to when a message is waiting on that interface.
@@ -111,7 +114,7 @@ void regenerateZMQPollArray();
 
 
 
-std::priority_queue<pylongps::event> eventQueue;
+pylongps::eventPriorityQueue eventQueue;
 std::map<zmq::socket_t *, std::unique_ptr<zmq::socket_t> > interfaces;
 std::map<int, FILE *> fileInterfaces;
 
@@ -121,6 +124,8 @@ std::map<int, std::function<bool (classType*, reactor<classType> &, FILE *)> > f
 std::map<std::string, zmq::socket_t *> nameToSocket;
 std::map<std::string, FILE *> nameToFileDescriptor;
 
+timeSource *reactorTimeSource; //Not owned
+
 private:
 std::function<Poco::Timestamp (classType*, reactor<classType> &)> eventHandlerFunction;
 
@@ -5,10 +5,11 @@ This function initializes the reactor with the function that should be called to
 @param inputContext: The ZMQ context that this object should use
 @param inputClassInstance: The instance of the class that the given functions should operate on
 @param inputEventHandler: The function to call to handle events in the queue (should return negative if there are no outstanding events).  Can be set to nullptr to disable event handling.
+@param inputTimeSource: The source of the current time used to decide when events are due (the wall clock if nullptr).  It must outlive the reactor
 
 @throws: This function can throw exceptions
 */
-template <class classType> reactor<classType>::reactor(zmq::context_t *inputContext, classType *inputClassInstance, std::function<Poco::Timestamp (classType*, reactor<classType> &)> inputEventHandler)
+template <class classType> reactor<classType>::reactor(zmq::context_t *inputContext, classType *inputClassInstance, std::function<Poco::Timestamp (classType*, reactor<classType> &)> inputEventHandler, timeSource *inputTimeSource)
 {
 if(inputContext == nullptr || inputClassInstance == nullptr)
 {
@@ -20,6 +21,8 @@ context = inputContext;
 
 classInstance = inputClassInstance;
 
+reactorTimeSource = inputTimeSource != nullptr ? inputTimeSource : &getSystemTimeSource();
+
 if(inputEventHandler != nullptr)
 {
 eventHandlerFunction = inputEventHandler;
@@ -187,6 +190,11 @@ for(int i=0; i<inputStartingEvents.size(); i++)
 eventQueue.push(inputStartingEvents[i]);
 }
 
+//Reactors which only handle events haven't had an interface added to make the poll items (including the one for the shutdown socket) yet
+SOM_TRY
+regenerateZMQPollArray();
+SOM_CATCH("Error, unable to regenerate poll items\n")
+
 //start the thread
 
 SOM_TRY
@@ -258,6 +266,14 @@ This function is called by the thread object to perform the message and event pr
 */
 template <class classType> void reactor<classType>::reactorThreadFunction()
 {
+//Name the thread's trace ring after the interfaces it serves so the thread can be identified in trace dumps
+std::string traceThreadName = "reactor(";
+for(auto iter = nameToSocket.begin(); iter != nameToSocket.end(); iter++)
+{
+traceThreadName += (iter == nameToSocket.begin() ? "" : ",") + iter->first;
+}
+setTraceThreadName(traceThreadName + ")");
+
 try
 {//Run event/message loop
 
@@ -267,20 +283,29 @@ int64_t timeUntilNextEventInMilliseconds = 0;
 while(true)
 {
 nextEventTime = eventHandlerFunction(classInstance, *this);
+Poco::Timestamp currentTime = reactorTimeSource->now();
 
 if(nextEventTime < 0)
 {
 timeUntilNextEventInMilliseconds = -1; //No events, so block until a message is received
 }
+else if(nextEventTime <= currentTime)
+{
+timeUntilNextEventInMilliseconds = 0; //Already due, so just check for messages without waiting
+}
 else
 {
-timeUntilNextEventInMilliseconds = (nextEventTime - Poco::Timestamp())/1000 + 1; //Time in milliseconds till the next event, rounding up
+timeUntilNextEventInMilliseconds = (nextEventTime - currentTime)/1000 + 1; //Time in milliseconds till the next event, rounding up
 }
 
-//Poll until the next event timeout and resolve any messages that are received
+//Poll until the next event timeout (as the time source sees it) and resolve any messages that are received
 SOM_TRY
-if(zmq::poll(pollItems.get(), numberOfPollItems, timeUntilNextEventInMilliseconds) == 0)
+if(zmq::poll(pollItems.get(), numberOfPollItems, reactorTimeSource->getPollTimeout(timeUntilNextEventInMilliseconds)) == 0)
 {
+if(timeUntilNextEventInMilliseconds != 0)
+{ //Nothing to do until the next event, which a virtual time source can skip ahead to
+reactorTimeSource->reactorIsIdle(nextEventTime);
+}
 continue; //Poll returned without indicating any messages have been received, so check events and go back to polling
 }
 SOM_CATCH("Error polling\n")
@@ -334,6 +359,7 @@ iter++;
 }
 catch(const std::exception &inputException)
 { //If an exception is thrown, swallow it, send error message and terminate
+recordTraceEvent(TRACE_REACTOR_EXCEPTION);
 fprintf(stderr, "ReactorThread: %s\n", inputException.what());
 return;
 }
@@ -0,0 +1,209 @@
+#include "recordingDataReceiver.hpp"
+
+using namespace pylongps;
+
+/**
+This function initializes the recordingDataReceiver to replay the given recording.
+@param inputFilePath: The path to the recording
+@param inputContext: A reference to the ZMQ context to use
+@param inputPlaybackSpeed: How many times faster than recorded to replay the messages (0 or less to replay them as fast as possible)
+@param inputStartTime: Replay starts with the first record received at or after this time (microseconds since the epoch)
+@param inputStreamIDsToReplay: The IDs of the streams to replay (all of them if empty)
+@param inputStartReplay: false if replay should wait for startReplay to be called (such as to give subscribers time to connect)
+
+@throws: This function can throw exceptions
+*/
+recordingDataReceiver::recordingDataReceiver(const std::string &inputFilePath, zmq::context_t &inputContext, double inputPlaybackSpeed, int64_t inputStartTime, const std::vector<int64_t> &inputStreamIDsToReplay, bool inputStartReplay) : context(inputContext)
+{
+playbackSpeed = inputPlaybackSpeed;
+streamIDsToReplay.insert(inputStreamIDsToReplay.begin(), inputStreamIDsToReplay.end());
+
+SOM_TRY
+reader.reset(new streamRecordingReader(inputFilePath));
+SOM_CATCH("Error opening recording\n")
+
+//Find where to start
+nextRecordOffset = reader->seek(inputStartTime);
+readNextRecord();
+
+//Create socket for publishing
+SOM_TRY
+publishingSocket.reset(new zmq::socket_t(context, ZMQ_PUB));
+SOM_CATCH("Error making socket\n")
+
+//Bind socket for publishing and store address
+int extensionStringNumber = 0;
+SOM_TRY //Bind to an dynamically generated address
+std::tie(publisherConnectionString, extensionStringNumber) = bindZMQSocketWithAutomaticAddressGeneration(*publishingSocket, "recordingDataReceiverSocketAddress");
+SOM_CATCH("Error binding publishingSocket\n")
+
+//Create socket for notification publishing
+SOM_TRY
+notificationPublishingSocket.reset(new zmq::socket_t(context, ZMQ_PUB));
+SOM_CATCH("Error making socket\n")
+
+//Bind socket for publishing and store address
+SOM_TRY //Bind to an dynamically generated address
+std::tie(notificationConnectionString, extensionStringNumber) = bindZMQSocketWithAutomaticAddressGeneration(*notificationPublishingSocket, "recordingDataReceiverNotificationSocketAddress");
+SOM_CATCH("Error binding notificationPublishingSocket\n")
+
+if(inputStartReplay)
+{
+SOM_TRY
+startReplay();
+SOM_CATCH("Error starting replay\n")
+}
+}
+
+/**
+This function starts replaying the recording, if it hasn't been started already.
+
+@throws: This function can throw exceptions
+*/
+void recordingDataReceiver::startReplay()
+{
+if(receiverReactor.get() != nullptr)
+{
+return;
+}
+
+//Records are due relative to when replay started
+timeReplayStarted = Poco::Timestamp().epochMicroseconds();
+firstRecordTime = hasNextRecord ? nextRecord.receiveTime : 0;
+
+//The reactor has no sockets to read, so it just calls the event handler when records are due
+SOM_TRY
+receiverReactor.reset(new reactor<recordingDataReceiver>(&context, this, &recordingDataReceiver::publishDueRecords));
+SOM_CATCH("Error initializing reactor\n")
+
+SOM_TRY
+receiverReactor->start();
+SOM_CATCH("Error, unable to start reactor\n")
+}
+
+/**
+This function returns how many messages have been replayed.
+@return: The number of messages
+*/
+uint64_t recordingDataReceiver::getNumberOfReplayedMessages()
+{
+return numberOfReplayedMessages;
+}
+
+/**
+This function returns if all of the messages to be replayed have been published.
+@return: true if replay is finished
+*/
+bool recordingDataReceiver::replayHasFinished()
+{
+return hasFinished;
+}
+
+/**
+This function returns a string containing the ZMQ connection string required to connect this object's publisher (which replays the recording).
+@return: The connection string to use to connect to this data source
+*/
+std::string recordingDataReceiver::address()
+{
+return publisherConnectionString;
+}
+
+/**
+This function is required to return a ZMQ inproc address which can be used with the context given to the data receiver to access status notifications regarding the object.
+@return: The connection string required to connect to the given object's notification stream
+*/
+std::string recordingDataReceiver::notificationAddress()
+{
+return notificationConnectionString;
+}
+
+/**
+This function returns the list that data senders in the same process can attach to in order to be handed the receiver's messages directly (the messages are still published at address() for anyone else).
+@return: The list
+*/
+directDataSinkList *recordingDataReceiver::directDataSinks()
+{
+return &directSinks;
+}
+
+/**
+This function is used as the reactor's event handler to publish the records which are due.
+@param inputReactor: The reactor which called the function
+@return: When the function should next be called (negative if replay is finished)
+*/
+Poco::Timestamp recordingDataReceiver::publishDueRecords(reactor<recordingDataReceiver> &inputReactor)
+{
+Poco::Timestamp::TimeVal currentTime = Poco::Timestamp().epochMicroseconds();
+
+try
+{
+for(uint64_t i=0; i<RECORDING_DATA_RECEIVER_MAXIMUM_BATCH_SIZE && hasNextRecord; i++)
+{
+if(playbackSpeed > 0.0)
+{
+Poco::Timestamp::TimeVal dueTime = timeReplayStarted + (Poco::Timestamp::TimeVal) ((nextRecord.receiveTime - firstRecordTime)/playbackSpeed);
+if(dueTime > currentTime)
+{
+return Poco::Timestamp(dueTime);
+}
+}
+
+//The payload is copied out of the mapping since ZMQ may still be sending it after the reader is gone
+zmq::message_t message(nextRecord.payloadSize);
+memcpy(message.data(), nextRecord.payload, nextRecord.payloadSize);
+
+SOM_TRY
+publishingSocket->send(message);
+SOM_CATCH("Error publishing message\n")
+
+directSinks.publish(nextRecord.payload, nextRecord.payloadSize);
+numberOfReplayedMessages++;
+
+readNextRecord();
+}
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "%s", inputException.what());
+hasNextRecord = false;
+
+data_receiver_status_notification notification;
+notification.set_unrecoverable_error_has_occurred(true);
+
+try
+{
+sendProtobufMessage(*notificationPublishingSocket, notification);
+}
+catch(const std::exception &inputNotificationException)
+{
+fprintf(stderr, "%s", inputNotificationException.what());
+}
+}
+
+if(!hasNextRecord)
+{
+hasFinished = true;
+return Poco::Timestamp(-1);
+}
+
+return Poco::Timestamp(currentTime); //More are due, so come back right after checking for shutdown
+}
+
+/**
+This function reads the next record of one of the streams being replayed into nextRecord.
+@return: false if there are no more records to replay
+*/
+bool recordingDataReceiver::readNextRecord()
+{
+while(reader->readRecord(nextRecordOffset, nextRecord))
+{
+if(streamIDsToReplay.size() == 0 || streamIDsToReplay.count(nextRecord.streamID) > 0)
+{
+hasNextRecord = true;
+return true;
+}
+}
+
+hasNextRecord = false;
+return false;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include<cstdint>
+#include<cstring>
+#include<memory>
+#include<thread>
+#include<string>
+#include<vector>
+#include<set>
+#include<atomic>
+#include<unistd.h>
+
+#include "dataReceiver.hpp"
+#include "SOMException.hpp"
+#include "SOMScopeGuard.hpp"
+#include "zmq.hpp"
+#include "reactor.hpp"
+#include "utilityFunctions.hpp"
+#include "streamRecording.hpp"
+#include "directDataSink.hpp"
+#include "Poco/Timestamp.h"
+#include "data_receiver_status_notification.pb.h"
+
+namespace pylongps
+{
+
+const uint64_t RECORDING_DATA_RECEIVER_MAXIMUM_BATCH_SIZE = 1024; //Most records published before the reactor checks for shutdown
+
+/**
+This class replays a stream recording (see streamRecording.hpp and recordingDataSender), publishing the recorded messages at the associated inproc ZMQ publisher address.  The file is memory mapped and the index is used to start from a given time without reading the records before it.  Messages can be replayed with their recorded spacing (optionally sped up or slowed down) or as fast as possible.
+*/
+class recordingDataReceiver : public dataReceiver
+{
+public:
+/**
+This function initializes the recordingDataReceiver to replay the given recording.
+@param inputFilePath: The path to the recording
+@param inputContext: A reference to the ZMQ context to use
+@param inputPlaybackSpeed: How many times faster than recorded to replay the messages (0 or less to replay them as fast as possible)
+@param inputStartTime: Replay starts with the first record received at or after this time (microseconds since the epoch)
+@param inputStreamIDsToReplay: The IDs of the streams to replay (all of them if empty)
+@param inputStartReplay: false if replay should wait for startReplay to be called (such as to give subscribers time to connect)
+
+@throws: This function can throw exceptions
+*/
+recordingDataReceiver(const std::string &inputFilePath, zmq::context_t &inputContext, double inputPlaybackSpeed = 1.0, int64_t inputStartTime = 0, const std::vector<int64_t> &inputStreamIDsToReplay = std::vector<int64_t>(), bool inputStartReplay = true);
+
+/**
+This function starts replaying the recording, if it hasn't been started already.
+
+@throws: This function can throw exceptions
+*/
+void startReplay();
+
+/**
+This function returns how many messages have been replayed.
+@return: The number of messages
+*/
+uint64_t getNumberOfReplayedMessages();
+
+/**
+This function returns if all of the messages to be replayed have been published.
+@return: true if replay is finished
+*/
+bool replayHasFinished();
+
+/**
+This function returns a string containing the ZMQ connection string required to connect this object's publisher (which replays the recording).
+@return: The connection string to use to connect to this data source
+*/
+virtual std::string address();
+
+/**
+This function is required to return a ZMQ inproc address which can be used with the context given to the data receiver to access status notifications regarding the object.
+@return: The connection string required to connect to the given object's notification stream
+*/
+virtual std::string notificationAddress();
+
+/**
+This function returns the list that data senders in the same process can attach to in order to be handed the receiver's messages directly (the messages are still published at address() for anyone else).
+@return: The list
+*/
+virtual directDataSinkList *directDataSinks();
+
+zmq::context_t &context;
+std::unique_ptr<zmq::socket_t> publishingSocket;
+std::unique_ptr<zmq::socket_t> notificationPublishingSocket;
+std::string publisherConnectionString; //String used to connect to this object's publisher
+std::string notificationConnectionString; //String used to publish status changes (such as unrecoverable disconnects)
+directDataSinkList directSinks; //Given each message after it is published (declared before the reactor so it outlives the reactor's thread)
+
+protected:
+/**
+This function is used as the reactor's event handler to publish the records which are due.
+@param inputReactor: The reactor which called the function
+@return: When the function should next be called (negative if replay is finished)
+*/
+Poco::Timestamp publishDueRecords(reactor<recordingDataReceiver> &inputReactor);
+
+/**
+This function reads the next record of one of the streams being replayed into nextRecord.
+@return: false if there are no more records to replay
+*/
+bool readNextRecord();
+
+std::unique_ptr<streamRecordingReader> reader;
+double playbackSpeed;
+std::set<int64_t> streamIDsToReplay; //Empty to replay all of them
+uint64_t nextRecordOffset = 0;
+streamRecordingRecord nextRecord;
+bool hasNextRecord = false;
+Poco::Timestamp::TimeVal timeReplayStarted = 0;
+int64_t firstRecordTime = 0; //Receive time of the first record replayed
+std::atomic<uint64_t> numberOfReplayedMessages{0};
+std::atomic<bool> hasFinished{false};
+std::unique_ptr<reactor<recordingDataReceiver> > receiverReactor; //Declared last so its thread is stopped before anything it uses is destroyed
+};
+
+}
@@ -0,0 +1,219 @@
+#include "recordingDataSender.hpp"
+
+using namespace pylongps;
+
+/**
+This function initializes the recordingDataSender to record data to the given file.
+@param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
+@param inputContext: A reference to the ZMQ context to use
+@param inputFilePath: The path of the file to record to (replacing anything already there)
+@param inputStreamID: The stream ID to record the messages with
+@param inputWritePolicy: How the data is written to the file
+@param inputIndexInterval: The minimum number of seconds between the records given entries in each file's index (0 to index every record)
+
+@throws: This function can throw exceptions
+*/
+recordingDataSender::recordingDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, const std::string &inputFilePath, int64_t inputStreamID, const batchedFileWriterPolicy &inputWritePolicy, double inputIndexInterval) : context(inputContext)
+{
+if(inputIndexInterval < 0.0)
+{
+throw SOMException("Index interval can't be negative\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+}
+
+streamID = inputStreamID;
+indexInterval = (Poco::Timestamp::TimeVal) (inputIndexInterval*1000000.0);
+informationSourceConnectionString = inputSourceConnectionString;
+
+Poco::Timestamp::TimeVal currentTime = Poco::Timestamp().epochMicroseconds();
+
+SOM_TRY
+fileWriter.reset(new batchedFileWriter(inputFilePath, inputWritePolicy, currentTime));
+SOM_CATCH("Error initializing file writer\n")
+
+SOM_TRY //Each file gets a header when it is started and its index when it is finished
+fileWriter->setFileHeaderAndTrailerFunctions([](Poco::Timestamp::TimeVal inputCurrentTime) { return createStreamRecordingHeader(inputCurrentTime); }, [this](uint64_t inputFileSize) { return finishIndex(inputFileSize); }, currentTime);
+SOM_CATCH("Error setting file header/trailer functions\n")
+
+//Create socket for notification publishing
+SOM_TRY
+notificationPublishingSocket.reset(new zmq::socket_t(context, ZMQ_PUB));
+SOM_CATCH("Error making socket\n")
+
+//Bind socket for publishing and store address
+int extensionStringNumber = 0;
+SOM_TRY //Bind to an dynamically generated address
+std::tie(notificationConnectionString, extensionStringNumber) = bindZMQSocketWithAutomaticAddressGeneration(*notificationPublishingSocket, "recordingDataSenderNotificationSocketAddress");
+SOM_CATCH("Error binding notificationPublishingSocket\n")
+
+//Construct reactor
+SOM_TRY
+senderReactor.reset(new reactor<recordingDataSender>(&context, this, &recordingDataSender::processWriterDeadlines));
+SOM_CATCH("Error initializing reactor\n")
+
+//Create socket for subscribing
+SOM_TRY
+subscriberSocket.reset(new zmq::socket_t(context, ZMQ_SUB));
+SOM_CATCH("Error making socket\n")
+
+//Set to receive all messages
+SOM_TRY //Set filter to allow any published messages to be received
+subscriberSocket->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
+SOM_CATCH("Error setting subscription for subscriberSocket\n")
+
+//Connect to information source
+SOM_TRY
+subscriberSocket->connect(informationSourceConnectionString.c_str());
+SOM_CATCH("Error connecting socket\n")
+
+//Give ownership of the subscriber socket to the reactor
+SOM_TRY
+senderReactor->addInterface(subscriberSocket, &recordingDataSender::readAndRecordData);
+SOM_CATCH("Error, unable to add interface\n")
+
+//Start the reactor thread
+SOM_TRY
+senderReactor->start();
+SOM_CATCH("Error, unable to start interface\n")
+}
+
+/**
+This function is required to return a ZMQ inproc address which can be used with the context given to the data receiver to access status notifications regarding the object.
+@return: The connection string required to connect to the given object's notification stream
+*/
+std::string recordingDataSender::notificationAddress()
+{
+return notificationConnectionString;
+}
+
+/**
+This function returns how many messages have been recorded.
+@return: The number of messages
+*/
+uint64_t recordingDataSender::getNumberOfRecordedMessages()
+{
+return numberOfRecordedMessages;
+}
+
+/**
+This function records any received messages to the file.
+@param inputReactor: The reactor which called the function
+@param inputSocket: The ZMQ socket to read from
+
+@throw: This function can throw exceptions
+*/
+bool recordingDataSender::readAndRecordData(reactor<recordingDataSender> &inputReactor, zmq::socket_t &inputSocket)
+{
+try
+{
+zmq::message_t messageBuffer;
+
+SOM_TRY
+if(!inputSocket.recv(&messageBuffer))
+{
+return false; //False alarm
+}
+SOM_CATCH("Error, unable to receive message\n")
+
+if(writeHasFailed)
+{ //A deadline write failed and already sent the notification
+return false;
+}
+
+Poco::Timestamp::TimeVal receiveTime = Poco::Timestamp().epochMicroseconds();
+
+recordBuffer.clear();
+SOM_TRY
+appendStreamRecordingRecord(recordBuffer, streamID, receiveTime, (const char *) messageBuffer.data(), messageBuffer.size());
+SOM_CATCH("Error making record\n")
+
+SOM_TRY //Can rotate the file, which finishes the current index before the record is added to the new file
+fileWriter->write(recordBuffer.data(), recordBuffer.size(), receiveTime);
+SOM_CATCH("File write error\n")
+
+if(indexEntries.size() == 0 || (receiveTime - timeOfLastIndexEntry) >= indexInterval)
+{
+streamRecordingIndexEntry entry;
+entry.receiveTime = receiveTime;
+entry.offset = fileWriter->getCurrentFileSize() - recordBuffer.size();
+indexEntries.emplace_back(entry);
+timeOfLastIndexEntry = receiveTime;
+}
+
+numberOfRecordedMessages++;
+}
+catch(const std::exception &inputException)
+{
+//Send notification and then kill the reactor by throwing an exception
+writeHasFailed = true;
+
+SOM_TRY
+sendFailureNotification();
+SOM_CATCH("Error sending error notification\n")
+
+throw inputException;
+}
+
+return false;
+}
+
+/**
+This function is used as the reactor's event handler to write/sync/rotate the file when the write policy's time based thresholds are reached.
+@param inputReactor: The reactor which called the function
+@return: When the function should next be called (negative if never)
+*/
+Poco::Timestamp recordingDataSender::processWriterDeadlines(reactor<recordingDataSender> &inputReactor)
+{
+if(writeHasFailed)
+{
+return Poco::Timestamp(-1);
+}
+
+try
+{
+return Poco::Timestamp(fileWriter->processDeadlines(Poco::Timestamp().epochMicroseconds()));
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "%s", inputException.what());
+writeHasFailed = true;
+
+try
+{
+sendFailureNotification();
+}
+catch(const std::exception &inputNotificationException)
+{
+fprintf(stderr, "%s", inputNotificationException.what());
+}
+}
+
+return Poco::Timestamp(-1);
+}
+
+/**
+This function sends a notification that an unrecoverable error has occurred.
+
+@throws: This function can throw exceptions
+*/
+void recordingDataSender::sendFailureNotification()
+{
+data_receiver_status_notification notification;
+notification.set_unrecoverable_error_has_occurred(true);
+
+SOM_TRY
+sendProtobufMessage(*notificationPublishingSocket, notification);
+SOM_CATCH("Error sending notification\n")
+}
+
+/**
+This function makes the footer for the file being finished from the index entries collected for it and starts a new index.
+@param inputFileSize: The size of the file (where the footer will be written)
+@return: The footer
+*/
+std::string recordingDataSender::finishIndex(uint64_t inputFileSize)
+{
+std::string footer = createStreamRecordingFooter(indexEntries, inputFileSize);
+indexEntries.clear();
+
+return footer;
+}
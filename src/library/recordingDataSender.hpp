@@ -0,0 +1,104 @@
+#pragma once
+
+#include<cstdint>
+#include<memory>
+#include<thread>
+#include<string>
+#include<vector>
+#include<atomic>
+#include<unistd.h>
+
+#include "dataSender.hpp"
+#include "SOMException.hpp"
+#include "SOMScopeGuard.hpp"
+#include "zmq.hpp"
+#include "reactor.hpp"
+#include "utilityFunctions.hpp"
+#include "batchedFileWriter.hpp"
+#include "streamRecording.hpp"
+#include "Poco/Timestamp.h"
+#include "data_receiver_status_notification.pb.h"
+
+namespace pylongps
+{
+
+/**
+This class takes data published on an inproc ZMQ PUB socket and records it to a file in the stream recording format (see streamRecording.hpp), with each message stamped with the given stream ID and the time it was received.  The file is written with a batchedFileWriter, so the write policy controls batching/syncing/rotation and each rotated file is a complete recording with its own header and index.  Recordings can be played back with a recordingDataReceiver.
+*/
+class recordingDataSender : public dataSender
+{
+public:
+/**
+This function initializes the recordingDataSender to record data to the given file.
+@param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
+@param inputContext: A reference to the ZMQ context to use
+@param inputFilePath: The path of the file to record to (replacing anything already there)
+@param inputStreamID: The stream ID to record the messages with
+@param inputWritePolicy: How the data is written to the file
+@param inputIndexInterval: The minimum number of seconds between the records given entries in each file's index (0 to index every record)
+
+@throws: This function can throw exceptions
+*/
+recordingDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, const std::string &inputFilePath, int64_t inputStreamID, const batchedFileWriterPolicy &inputWritePolicy = batchedFileWriterPolicy(), double inputIndexInterval = STREAM_RECORDING_DEFAULT_INDEX_INTERVAL);
+
+/**
+This function is required to return a ZMQ inproc address which can be used with the context given to the data receiver to access status notifications regarding the object.
+@return: The connection string required to connect to the given object's notification stream
+*/
+virtual std::string notificationAddress();
+
+/**
+This function returns how many messages have been recorded.
+@return: The number of messages
+*/
+uint64_t getNumberOfRecordedMessages();
+
+zmq::context_t &context;
+std::unique_ptr<zmq::socket_t> subscriberSocket;
+std::unique_ptr<zmq::socket_t> notificationPublishingSocket;
+std::string informationSourceConnectionString; //String used to connect to the data source
+std::string notificationConnectionString; //String used to publish status changes (such as unrecoverable disconnects)
+
+protected:
+/**
+This function records any received messages to the file.
+@param inputReactor: The reactor which called the function
+@param inputSocket: The ZMQ socket to read from
+
+@throw: This function can throw exceptions
+*/
+bool readAndRecordData(reactor<recordingDataSender> &inputReactor, zmq::socket_t &inputSocket);
+
+/**
+This function is used as the reactor's event handler to write/sync/rotate the file when the write policy's time based thresholds are reached.
+@param inputReactor: The reactor which called the function
+@return: When the function should next be called (negative if never)
+*/
+Poco::Timestamp processWriterDeadlines(reactor<recordingDataSender> &inputReactor);
+
+/**
+This function sends a notification that an unrecoverable error has occurred.
+
+@throws: This function can throw exceptions
+*/
+void sendFailureNotification();
+
+/**
+This function makes the footer for the file being finished from the index entries collected for it and starts a new index.
+@param inputFileSize: The size of the file (where the footer will be written)
+@return: The footer
+*/
+std::string finishIndex(uint64_t inputFileSize);
+
+int64_t streamID;
+Poco::Timestamp::TimeVal indexInterval; //Microseconds
+std::string recordBuffer; //Reused for each record
+std::vector<streamRecordingIndexEntry> indexEntries; //Index of the current file
+Poco::Timestamp::TimeVal timeOfLastIndexEntry = 0;
+std::atomic<uint64_t> numberOfRecordedMessages{0};
+bool writeHasFailed = false;
+std::unique_ptr<batchedFileWriter> fileWriter; //Declared after the index so the last file's footer can be written when it is destroyed
+std::unique_ptr<reactor<recordingDataSender> > senderReactor; //Declared last so its thread is stopped before anything it uses is destroyed
+};
+
+}
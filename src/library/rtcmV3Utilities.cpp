@@ -0,0 +1,31 @@
+#include "rtcmV3Utilities.hpp"
+
+using namespace pylongps;
+
+/**
+This function calculates the CRC-24Q used to protect RTCM 3 frames.  Running it over a whole frame (header, payload and CRC) gives 0 if the frame is intact.
+@param inputData: The data to calculate the CRC of
+@param inputDataSize: The size of the data in bytes
+@return: The 24 bit CRC
+*/
+uint32_t pylongps::calculateRTCMV3CRC(const char *inputData, uint64_t inputDataSize)
+{
+const uint32_t CRC24Q_POLYNOMIAL = 0x1864CFB;
+const unsigned char *data = (const unsigned char *) inputData;
+
+uint32_t crc = 0;
+for(uint64_t i=0; i<inputDataSize; i++)
+{
+crc ^= ((uint32_t) data[i]) << 16;
+for(int bit=0; bit<8; bit++)
+{
+crc <<= 1;
+if(crc & 0x1000000)
+{
+crc ^= CRC24Q_POLYNOMIAL;
+}
+}
+}
+
+return crc & 0xFFFFFF;
+}
@@ -0,0 +1,23 @@
+#ifndef RTCMV3UTILITIESHPP
+#define RTCMV3UTILITIESHPP
+
+#include<cstdint>
+
+namespace pylongps
+{
+
+//RTCM 3 framing: preamble byte, 10 bit length in the next 2 bytes and a 24 bit CRC at the end
+const unsigned char RTCM_V3_PREAMBLE = 0xD3;
+const uint32_t RTCM_V3_HEADER_SIZE = 3;
+const uint32_t RTCM_V3_CRC_SIZE = 3;
+
+/**
+This function calculates the CRC-24Q used to protect RTCM 3 frames.  Running it over a whole frame (header, payload and CRC) gives 0 if the frame is intact.
+@param inputData: The data to calculate the CRC of
+@param inputDataSize: The size of the data in bytes
+@return: The 24 bit CRC
+*/
+uint32_t calculateRTCMV3CRC(const char *inputData, uint64_t inputDataSize);
+
+}
+#endif
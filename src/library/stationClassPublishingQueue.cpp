@@ -0,0 +1,111 @@
+#include "stationClassPublishingQueue.hpp"
+
+using namespace pylongps;
+
+/**
+This function sets all of the counters to zero.
+*/
+stationClassPublishingStatistics::stationClassPublishingStatistics()
+{
+numberOfPublishedMessages = 0;
+numberOfDroppedMessages = 0;
+numberOfQueuedMessages = 0;
+totalPublishingDelay = 0;
+maximumPublishingDelay = 0;
+}
+
+/**
+This function sets all of the counters to zero.
+*/
+stationClassPublishingCounters::stationClassPublishingCounters() : numberOfPublishedMessages(0), numberOfDroppedMessages(0), numberOfQueuedMessages(0), totalPublishingDelay(0), maximumPublishingDelay(0)
+{
+}
+
+/**
+This function initializes the queue.
+@param inputWeight: How many messages to publish from this queue in each servicing round
+@param inputHighWaterMark: How many messages can be waiting before new ones are dropped
+*/
+stationClassPublishingQueue::stationClassPublishingQueue(uint32_t inputWeight, uint64_t inputHighWaterMark)
+{
+weight = inputWeight;
+highWaterMark = inputHighWaterMark;
+}
+
+/**
+This function adds a message to the end of the queue, unless the queue is at its high water mark (in which case the message is dropped and counted).
+@param inputMessage: The message to add (with the caster ID and stream ID preappended), which is moved into the queue (leaving it empty) if it is added
+@param inputStreamID: The local ID of the stream the message belongs to
+@param inputTimeReceived: When the caster received the message (microseconds since the epoch)
+@return: true if the message was added
+*/
+bool stationClassPublishingQueue::addMessage(zmq::message_t &inputMessage, int64_t inputStreamID, Poco::Timestamp::TimeVal inputTimeReceived)
+{
+if(messages.size() >= highWaterMark)
+{
+statistics.numberOfDroppedMessages.fetch_add(1, std::memory_order_relaxed);
+return false;
+}
+
+messages.emplace_back();
+messages.back().message.move(&inputMessage);
+messages.back().streamID = inputStreamID;
+messages.back().timeReceived = inputTimeReceived;
+
+statistics.numberOfQueuedMessages.store(messages.size(), std::memory_order_relaxed);
+return true;
+}
+
+/**
+This function copies a message to the end of the queue, unless the queue is at its high water mark (in which case the message is dropped and counted).
+@param inputMessage: The message to add (with the caster ID and stream ID preappended)
+@param inputMessageSize: The size of the message in bytes
+@param inputStreamID: The local ID of the stream the message belongs to
+@param inputTimeReceived: When the caster received the message (microseconds since the epoch)
+@return: true if the message was added
+*/
+bool stationClassPublishingQueue::addMessage(const char *inputMessage, uint64_t inputMessageSize, int64_t inputStreamID, Poco::Timestamp::TimeVal inputTimeReceived)
+{
+zmq::message_t message(inputMessage, inputMessageSize);
+return addMessage(message, inputStreamID, inputTimeReceived);
+}
+
+/**
+This function removes the message at the front of the queue and counts it as published.
+@param inputTimePublished: When the message was published (microseconds since the epoch)
+*/
+void stationClassPublishingQueue::removePublishedMessage(Poco::Timestamp::TimeVal inputTimePublished)
+{
+if(messages.size() == 0)
+{
+return;
+}
+
+//Only the publishing thread changes the counters, so the maximum can be updated with a plain load and store
+int64_t publishingDelay = inputTimePublished - messages.front().timeReceived;
+statistics.numberOfPublishedMessages.fetch_add(1, std::memory_order_relaxed);
+statistics.totalPublishingDelay.fetch_add(publishingDelay, std::memory_order_relaxed);
+if(publishingDelay > statistics.maximumPublishingDelay.load(std::memory_order_relaxed))
+{
+statistics.maximumPublishingDelay.store(publishingDelay, std::memory_order_relaxed);
+}
+
+messages.pop_front();
+statistics.numberOfQueuedMessages.store(messages.size(), std::memory_order_relaxed);
+}
+
+/**
+This thread safe function returns a snapshot of the queue's counters.
+@return: The counters
+*/
+stationClassPublishingStatistics stationClassPublishingQueue::getStatistics() const
+{
+stationClassPublishingStatistics snapshot;
+snapshot.numberOfPublishedMessages = statistics.numberOfPublishedMessages.load(std::memory_order_relaxed);
+snapshot.numberOfDroppedMessages = statistics.numberOfDroppedMessages.load(std::memory_order_relaxed);
+snapshot.numberOfQueuedMessages = statistics.numberOfQueuedMessages.load(std::memory_order_relaxed);
+snapshot.totalPublishingDelay = statistics.totalPublishingDelay.load(std::memory_order_relaxed);
+snapshot.maximumPublishingDelay = statistics.maximumPublishingDelay.load(std::memory_order_relaxed);
+
+return snapshot;
+}
@@ -0,0 +1,115 @@
+#ifndef STATIONCLASSPUBLISHINGQUEUEHPP
+#define STATIONCLASSPUBLISHINGQUEUEHPP
+
+#include "Poco/Timestamp.h"
+#include "zmq.hpp"
+#include<cstdint>
+#include<string>
+#include<deque>
+#include<atomic>
+
+namespace pylongps
+{
+
+//How many messages of a station class can be waiting to be published before new ones are dropped
+const uint64_t DEFAULT_STATION_CLASS_PUBLISHING_HIGH_WATER_MARK = 1000;
+
+/**
+This class holds a message that is waiting to be published, along with what is needed to publish it and to measure how long it waited.
+*/
+class queuedPublication
+{
+public:
+zmq::message_t message; //The message with the caster ID and stream ID preappended
+int64_t streamID;
+Poco::Timestamp::TimeVal timeReceived; //Microseconds since the epoch
+};
+
+/**
+This class holds a snapshot of the publishing counters of a station class.
+*/
+class stationClassPublishingStatistics
+{
+public:
+/**
+This function sets all of the counters to zero.
+*/
+stationClassPublishingStatistics();
+
+uint64_t numberOfPublishedMessages;
+uint64_t numberOfDroppedMessages; //Dropped because the class was at its high water mark
+uint64_t numberOfQueuedMessages; //Waiting to be published
+int64_t totalPublishingDelay; //Sum of how long the published messages waited between being received and being published (microseconds)
+int64_t maximumPublishingDelay; //Microseconds
+};
+
+/**
+This class holds the publishing counters of a station class.  Only the thread which owns the queue changes them, but they can be read from any thread (see stationClassPublishingQueue::getStatistics).
+*/
+class stationClassPublishingCounters
+{
+public:
+/**
+This function sets all of the counters to zero.
+*/
+stationClassPublishingCounters();
+
+std::atomic<uint64_t> numberOfPublishedMessages;
+std::atomic<uint64_t> numberOfDroppedMessages; //Dropped because the class was at its high water mark
+std::atomic<uint64_t> numberOfQueuedMessages; //Waiting to be published
+std::atomic<int64_t> totalPublishingDelay; //Sum of how long the published messages waited between being received and being published (microseconds)
+std::atomic<int64_t> maximumPublishingDelay; //Microseconds
+};
+
+/**
+This class keeps the messages from the streams of one station class (OFFICIAL, REGISTERED_COMMUNITY, COMMUNITY) that are waiting to be published.  The caster services the queues of the different classes in proportion to their weights, so higher priority classes keep their low latency when the caster is overloaded and the lower priority classes are the ones which reach their high water mark and drop messages.  The queue isn't threadsafe (only the thread which publishes the messages should use it), other than getStatistics.
+*/
+class stationClassPublishingQueue
+{
+public:
+/**
+This function initializes the queue.
+@param inputWeight: How many messages to publish from this queue in each servicing round
+@param inputHighWaterMark: How many messages can be waiting before new ones are dropped
+*/
+stationClassPublishingQueue(uint32_t inputWeight = 1, uint64_t inputHighWaterMark = DEFAULT_STATION_CLASS_PUBLISHING_HIGH_WATER_MARK);
+
+/**
+This function adds a message to the end of the queue, unless the queue is at its high water mark (in which case the message is dropped and counted).
+@param inputMessage: The message to add (with the caster ID and stream ID preappended), which is moved into the queue (leaving it empty) if it is added
+@param inputStreamID: The local ID of the stream the message belongs to
+@param inputTimeReceived: When the caster received the message (microseconds since the epoch)
+@return: true if the message was added
+*/
+bool addMessage(zmq::message_t &inputMessage, int64_t inputStreamID, Poco::Timestamp::TimeVal inputTimeReceived);
+
+/**
+This function copies a message to the end of the queue, unless the queue is at its high water mark (in which case the message is dropped and counted).
+@param inputMessage: The message to add (with the caster ID and stream ID preappended)
+@param inputMessageSize: The size of the message in bytes
+@param inputStreamID: The local ID of the stream the message belongs to
+@param inputTimeReceived: When the caster received the message (microseconds since the epoch)
+@return: true if the message was added
+*/
+bool addMessage(const char *inputMessage, uint64_t inputMessageSize, int64_t inputStreamID, Poco::Timestamp::TimeVal inputTimeReceived);
+
+/**
+This function removes the message at the front of the queue and counts it as published.
+@param inputTimePublished: When the message was published (microseconds since the epoch)
+*/
+void removePublishedMessage(Poco::Timestamp::TimeVal inputTimePublished);
+
+/**
+This thread safe function returns a snapshot of the queue's counters.
+@return: The counters
+*/
+stationClassPublishingStatistics getStatistics() const;
+
+std::deque<queuedPublication> messages; //A deque so the messages never have to be moved once they are queued
+uint32_t weight;
+uint64_t highWaterMark;
+stationClassPublishingCounters statistics;
+};
+
+}
+#endif
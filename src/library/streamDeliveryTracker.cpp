@@ -0,0 +1,59 @@
+#include "streamDeliveryTracker.hpp"
+
+using namespace pylongps;
+
+/**
+This function initializes the tracker with no messages received.
+@param inputCasterID: The ID of the caster the stream is received from
+@param inputStreamID: The ID of the stream at that caster
+*/
+streamDeliveryTracker::streamDeliveryTracker(int64_t inputCasterID, int64_t inputStreamID)
+{
+statistics.set_caster_id(inputCasterID);
+statistics.set_stream_id(inputStreamID);
+statistics.set_number_of_received_messages(0);
+statistics.set_number_of_missed_messages(0);
+statistics.set_number_of_gaps(0);
+statistics.set_number_of_out_of_order_messages(0);
+}
+
+/**
+This function updates the statistics with a received message.  A sequence number of 0 after other messages have been received is treated as the caster restarting the stream (such as after a state handoff) rather than as an out of order message.
+@param inputSequenceNumber: The sequence number from the message's stream frame header
+@param inputIngestTime: The ingest time from the message's stream frame header (microseconds since the epoch)
+@param inputReceptionTime: When the message was received (microseconds since the epoch)
+@return: true if messages were missed before this one
+*/
+bool streamDeliveryTracker::addMessage(uint64_t inputSequenceNumber, int64_t inputIngestTime, int64_t inputReceptionTime)
+{
+bool messagesWereMissed = false;
+
+if(aMessageHasBeenReceived && inputSequenceNumber < nextExpectedSequenceNumber && inputSequenceNumber != 0)
+{ //Late or repeated message, so don't move the expected sequence number back
+statistics.set_number_of_out_of_order_messages(statistics.number_of_out_of_order_messages() + 1);
+}
+else
+{
+if(aMessageHasBeenReceived && inputSequenceNumber > nextExpectedSequenceNumber)
+{
+statistics.set_number_of_missed_messages(statistics.number_of_missed_messages() + (inputSequenceNumber - nextExpectedSequenceNumber));
+statistics.set_number_of_gaps(statistics.number_of_gaps() + 1);
+messagesWereMissed = true;
+}
+
+nextExpectedSequenceNumber = inputSequenceNumber + 1;
+}
+aMessageHasBeenReceived = true;
+
+int64_t latency = inputReceptionTime - inputIngestTime;
+totalLatency += latency;
+statistics.set_number_of_received_messages(statistics.number_of_received_messages() + 1);
+statistics.set_last_latency(latency);
+statistics.set_average_latency(totalLatency / ((int64_t) statistics.number_of_received_messages()));
+if(!statistics.has_maximum_latency() || latency > statistics.maximum_latency())
+{
+statistics.set_maximum_latency(latency);
+}
+
+return messagesWereMissed;
+}
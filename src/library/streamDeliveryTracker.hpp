@@ -0,0 +1,41 @@
+#ifndef STREAMDELIVERYTRACKERHPP
+#define STREAMDELIVERYTRACKERHPP
+
+#include<cstdint>
+#include "stream_delivery_statistics.pb.h"
+
+namespace pylongps
+{
+
+/**
+This class keeps track of the sequence numbers and ingest times in the stream frame headers of the messages received from a caster stream, so that missed messages and the one way latency can be reported.
+*/
+class streamDeliveryTracker
+{
+public:
+/**
+This function initializes the tracker with no messages received.
+@param inputCasterID: The ID of the caster the stream is received from
+@param inputStreamID: The ID of the stream at that caster
+*/
+streamDeliveryTracker(int64_t inputCasterID = 0, int64_t inputStreamID = 0);
+
+/**
+This function updates the statistics with a received message.  A sequence number of 0 after other messages have been received is treated as the caster restarting the stream (such as after a state handoff) rather than as an out of order message.
+@param inputSequenceNumber: The sequence number from the message's stream frame header
+@param inputIngestTime: The ingest time from the message's stream frame header (microseconds since the epoch)
+@param inputReceptionTime: When the message was received (microseconds since the epoch)
+@return: true if messages were missed before this one
+*/
+bool addMessage(uint64_t inputSequenceNumber, int64_t inputIngestTime, int64_t inputReceptionTime);
+
+stream_delivery_statistics statistics;
+
+private:
+bool aMessageHasBeenReceived = false;
+uint64_t nextExpectedSequenceNumber = 0;
+int64_t totalLatency = 0;
+};
+
+}
+#endif
@@ -0,0 +1,149 @@
+#include "streamFrameHeader.hpp"
+
+using namespace pylongps;
+
+/**
+This function initializes the hop.
+@param inputType: Which point the message passed
+@param inputTime: When it passed it (see getMonotonicTime)
+*/
+traceHop::traceHop(trace_hop_type inputType, int64_t inputTime) : type(inputType), time(inputTime)
+{
+}
+
+/**
+This function returns the current time of the monotonic clock used for latency tracing.
+@return: Nanoseconds since an arbitrary (but fixed for the machine) point
+*/
+int64_t pylongps::getMonotonicTime()
+{
+return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+This function writes a stream frame header to the given buffer.
+@param inputBuffer: The buffer to write to (must have at least STREAM_FRAME_HEADER_SIZE bytes)
+@param inputSequenceNumber: The sequence number of the message in its stream
+@param inputIngestTime: When the caster received the message (microseconds since the epoch)
+*/
+void pylongps::writeStreamFrameHeader(char *inputBuffer, uint64_t inputSequenceNumber, int64_t inputIngestTime)
+{
+memcpy(inputBuffer, STREAM_FRAME_HEADER_MAGIC, sizeof(STREAM_FRAME_HEADER_MAGIC));
+inputBuffer[4] = (char) STREAM_FRAME_HEADER_VERSION;
+inputBuffer[5] = (char) STREAM_FRAME_HEADER_SIZE;
+inputBuffer[6] = 0; //No flags
+inputBuffer[7] = 0;
+
+Poco::UInt64 networkOrderSequenceNumber = Poco::ByteOrder::toNetwork(Poco::UInt64(inputSequenceNumber));
+Poco::Int64 networkOrderIngestTime = Poco::ByteOrder::toNetwork(Poco::Int64(inputIngestTime));
+memcpy(inputBuffer + 8, &networkOrderSequenceNumber, sizeof(networkOrderSequenceNumber));
+memcpy(inputBuffer + 16, &networkOrderIngestTime, sizeof(networkOrderIngestTime));
+}
+
+/**
+This function checks if the given data starts with a stream frame header and reads it if so.
+@param inputData: The data to check (the part of the message after the casterID/streamID)
+@param inputDataSize: The size of the data in bytes
+@param inputSequenceNumberBuffer: The variable to store the sequence number in
+@param inputIngestTimeBuffer: The variable to store the ingest time in
+@param inputHeaderSizeBuffer: The variable to store the size of the header in (how many bytes to skip to get to the payload)
+@return: true if the data started with a valid header
+*/
+bool pylongps::readStreamFrameHeader(const char *inputData, uint64_t inputDataSize, uint64_t &inputSequenceNumberBuffer, int64_t &inputIngestTimeBuffer, uint32_t &inputHeaderSizeBuffer)
+{
+if(inputDataSize < STREAM_FRAME_HEADER_SIZE || memcmp(inputData, STREAM_FRAME_HEADER_MAGIC, sizeof(STREAM_FRAME_HEADER_MAGIC)) != 0)
+{
+return false;
+}
+
+uint8_t version = (uint8_t) inputData[4];
+uint8_t headerSize = (uint8_t) inputData[5];
+if(version < 1 || headerSize < STREAM_FRAME_HEADER_SIZE || headerSize > inputDataSize)
+{ //Not a header this version knows how to read
+return false;
+}
+
+Poco::UInt64 networkOrderSequenceNumber = 0;
+Poco::Int64 networkOrderIngestTime = 0;
+memcpy(&networkOrderSequenceNumber, inputData + 8, sizeof(networkOrderSequenceNumber));
+memcpy(&networkOrderIngestTime, inputData + 16, sizeof(networkOrderIngestTime));
+
+inputSequenceNumberBuffer = Poco::ByteOrder::fromNetwork(networkOrderSequenceNumber);
+inputIngestTimeBuffer = Poco::ByteOrder::fromNetwork(networkOrderIngestTime);
+inputHeaderSizeBuffer = headerSize;
+return true;
+}
+
+/**
+This function makes a stream frame header with an optional latency trace.
+@param inputSequenceNumber: The sequence number of the message in its stream
+@param inputIngestTime: When the caster received the message (microseconds since the epoch)
+@param inputTraceHops: The hops of the latency trace (the header is marked as traced if this is not empty, hops past MAXIMUM_NUMBER_OF_TRACE_HOPS are dropped)
+@return: The header
+*/
+std::string pylongps::createStreamFrameHeader(uint64_t inputSequenceNumber, int64_t inputIngestTime, const std::vector<traceHop> &inputTraceHops)
+{
+std::string header(STREAM_FRAME_HEADER_SIZE, '\0');
+writeStreamFrameHeader(&header[0], inputSequenceNumber, inputIngestTime);
+
+if(inputTraceHops.size() == 0)
+{
+return header;
+}
+
+uint32_t numberOfHops = std::min<uint32_t>(inputTraceHops.size(), MAXIMUM_NUMBER_OF_TRACE_HOPS);
+header[5] = (char) (STREAM_FRAME_HEADER_SIZE + 1 + numberOfHops*STREAM_FRAME_HEADER_TRACE_HOP_SIZE);
+header[6] = (char) STREAM_FRAME_HEADER_TRACE_FLAG;
+header.push_back((char) numberOfHops);
+
+for(uint32_t i=0; i<numberOfHops; i++)
+{
+Poco::Int64 networkOrderTime = Poco::ByteOrder::toNetwork(Poco::Int64(inputTraceHops[i].time));
+header.push_back((char) inputTraceHops[i].type);
+header.append((const char *) &networkOrderTime, sizeof(networkOrderTime));
+}
+
+return header;
+}
+
+/**
+This function reads the latency trace of a stream frame header.
+@param inputData: The data to check (the part of the message after the casterID/streamID)
+@param inputDataSize: The size of the data in bytes
+@param inputTraceHopsBuffer: The vector to store the hops of the trace in
+@return: true if the data started with a valid header which has a trace
+*/
+bool pylongps::readStreamFrameHeaderTrace(const char *inputData, uint64_t inputDataSize, std::vector<traceHop> &inputTraceHopsBuffer)
+{
+uint64_t sequenceNumber = 0;
+int64_t ingestTime = 0;
+uint32_t headerSize = 0;
+if(!readStreamFrameHeader(inputData, inputDataSize, sequenceNumber, ingestTime, headerSize))
+{
+return false;
+}
+
+if((((uint8_t) inputData[6]) & STREAM_FRAME_HEADER_TRACE_FLAG) == 0 || headerSize < (STREAM_FRAME_HEADER_SIZE + 1))
+{ //No trace
+return false;
+}
+
+uint32_t numberOfHops = (uint8_t) inputData[STREAM_FRAME_HEADER_SIZE];
+if(numberOfHops == 0 || (STREAM_FRAME_HEADER_SIZE + 1 + numberOfHops*STREAM_FRAME_HEADER_TRACE_HOP_SIZE) > headerSize)
+{ //Empty trace or hops don't fit in the header, so it is invalid
+return false;
+}
+
+inputTraceHopsBuffer.clear();
+const char *hopData = inputData + STREAM_FRAME_HEADER_SIZE + 1;
+for(uint32_t i=0; i<numberOfHops; i++)
+{
+Poco::Int64 networkOrderTime = 0;
+memcpy(&networkOrderTime, hopData + 1, sizeof(networkOrderTime));
+
+inputTraceHopsBuffer.push_back(traceHop((trace_hop_type) ((uint8_t) hopData[0]), Poco::ByteOrder::fromNetwork(networkOrderTime)));
+hopData += STREAM_FRAME_HEADER_TRACE_HOP_SIZE;
+}
+
+return true;
+}
@@ -0,0 +1,93 @@
+#ifndef STREAMFRAMEHEADERHPP
+#define STREAMFRAMEHEADERHPP
+
+#include<cstdint>
+#include<cstring>
+#include<string>
+#include<vector>
+#include<chrono>
+#include<algorithm>
+#include "Poco/ByteOrder.h"
+#include "common_enums.pb.h"
+
+namespace pylongps
+{
+
+/*
+Casters can be configured to add a versioned header between the casterID/streamID and the payload of each forwarded stream message, so that receivers can detect lost messages and measure latency:
+magic (4 bytes, "PGSQ") | version (1 byte) | header size (1 byte) | flags (1 byte) | reserved (1 byte) | sequence number (8 bytes) | ingest time (8 bytes)
+Integers are in network byte order.  The sequence number counts the messages of a stream accepted by the caster (starting at 0) and the ingest time is when the caster received the message (microseconds since the epoch).  Later versions may make the header longer, so readers should skip "header size" bytes rather than assume STREAM_FRAME_HEADER_SIZE.  Whether a stream's messages have the header is announced rather than inferred from the magic (which payloads can contain): casters set has_stream_frame_headers in the stream's information and transmitters register with sends_stream_frame_headers.
+
+If the STREAM_FRAME_HEADER_TRACE_FLAG is set, the message has been sampled for latency tracing and the fixed part of the header is followed by:
+number of hops (1 byte) | hop type (1 byte) | hop time (8 bytes) | hop type | hop time ...
+Hop times are nanoseconds of the monotonic clock (see getMonotonicTime), so traces can only be compared between processes on the same machine.
+*/
+const char STREAM_FRAME_HEADER_MAGIC[4] = {'P', 'G', 'S', 'Q'};
+const uint8_t STREAM_FRAME_HEADER_VERSION = 1;
+const uint32_t STREAM_FRAME_HEADER_SIZE = 24;
+const uint8_t STREAM_FRAME_HEADER_TRACE_FLAG = 0x01;
+const uint32_t STREAM_FRAME_HEADER_TRACE_HOP_SIZE = 9;
+const uint32_t MAXIMUM_NUMBER_OF_TRACE_HOPS = 25; //Limited by the one byte header size
+
+/**
+This class holds when a traced message passed one of the points along its path.
+*/
+class traceHop
+{
+public:
+/**
+This function initializes the hop.
+@param inputType: Which point the message passed
+@param inputTime: When it passed it (see getMonotonicTime)
+*/
+traceHop(trace_hop_type inputType = TRANSMITTER_SEND, int64_t inputTime = 0);
+
+trace_hop_type type;
+int64_t time;
+};
+
+/**
+This function returns the current time of the monotonic clock used for latency tracing.
+@return: Nanoseconds since an arbitrary (but fixed for the machine) point
+*/
+int64_t getMonotonicTime();
+
+/**
+This function makes a stream frame header with an optional latency trace.
+@param inputSequenceNumber: The sequence number of the message in its stream
+@param inputIngestTime: When the caster received the message (microseconds since the epoch)
+@param inputTraceHops: The hops of the latency trace (the header is marked as traced if this is not empty, hops past MAXIMUM_NUMBER_OF_TRACE_HOPS are dropped)
+@return: The header
+*/
+std::string createStreamFrameHeader(uint64_t inputSequenceNumber, int64_t inputIngestTime, const std::vector<traceHop> &inputTraceHops = std::vector<traceHop>());
+
+/**
+This function writes a stream frame header to the given buffer.
+@param inputBuffer: The buffer to write to (must have at least STREAM_FRAME_HEADER_SIZE bytes)
+@param inputSequenceNumber: The sequence number of the message in its stream
+@param inputIngestTime: When the caster received the message (microseconds since the epoch)
+*/
+void writeStreamFrameHeader(char *inputBuffer, uint64_t inputSequenceNumber, int64_t inputIngestTime);
+
+/**
+This function checks if the given data starts with a stream frame header and reads it if so.
+@param inputData: The data to check (the part of the message after the casterID/streamID)
+@param inputDataSize: The size of the data in bytes
+@param inputSequenceNumberBuffer: The variable to store the sequence number in
+@param inputIngestTimeBuffer: The variable to store the ingest time in
+@param inputHeaderSizeBuffer: The variable to store the size of the header in (how many bytes to skip to get to the payload)
+@return: true if the data started with a valid header
+*/
+bool readStreamFrameHeader(const char *inputData, uint64_t inputDataSize, uint64_t &inputSequenceNumberBuffer, int64_t &inputIngestTimeBuffer, uint32_t &inputHeaderSizeBuffer);
+
+/**
+This function reads the latency trace of a stream frame header.
+@param inputData: The data to check (the part of the message after the casterID/streamID)
+@param inputDataSize: The size of the data in bytes
+@param inputTraceHopsBuffer: The vector to store the hops of the trace in
+@return: true if the data started with a valid header which has a trace
+*/
+bool readStreamFrameHeaderTrace(const char *inputData, uint64_t inputDataSize, std::vector<traceHop> &inputTraceHopsBuffer);
+
+}
+#endif
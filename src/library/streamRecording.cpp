@@ -0,0 +1,280 @@
+#include "streamRecording.hpp"
+
+using namespace pylongps;
+
+/**
+This function writes an integer to the given buffer in network byte order.
+@param inputBuffer: The buffer to write to
+@param inputValue: The value to write
+*/
+static void writeNetworkOrderUInt64(char *inputBuffer, uint64_t inputValue)
+{
+Poco::UInt64 networkOrderValue = Poco::ByteOrder::toNetwork(Poco::UInt64(inputValue));
+memcpy(inputBuffer, &networkOrderValue, sizeof(networkOrderValue));
+}
+
+/**
+This function reads an integer in network byte order from the given buffer.
+@param inputBuffer: The buffer to read from
+@return: The value
+*/
+static uint64_t readNetworkOrderUInt64(const char *inputBuffer)
+{
+Poco::UInt64 networkOrderValue = 0;
+memcpy(&networkOrderValue, inputBuffer, sizeof(networkOrderValue));
+return Poco::ByteOrder::fromNetwork(networkOrderValue);
+}
+
+/**
+This function makes the header that starts each recording file.
+@param inputStartTime: When the file was started (microseconds since the epoch)
+@return: The header
+*/
+std::string pylongps::createStreamRecordingHeader(int64_t inputStartTime)
+{
+std::string header(STREAM_RECORDING_HEADER_SIZE, '\0');
+memcpy(&header[0], STREAM_RECORDING_MAGIC, sizeof(STREAM_RECORDING_MAGIC));
+header[4] = (char) STREAM_RECORDING_VERSION;
+header[5] = (char) STREAM_RECORDING_HEADER_SIZE;
+writeNetworkOrderUInt64(&header[8], inputStartTime);
+
+return header;
+}
+
+/**
+This function adds a record to the end of the given buffer.
+@param inputBuffer: The buffer to add to
+@param inputStreamID: The ID of the stream the payload came from
+@param inputReceiveTime: When the payload was received (microseconds since the epoch)
+@param inputPayload: The payload
+@param inputPayloadSize: The size of the payload in bytes
+
+@throws: This function can throw exceptions
+*/
+void pylongps::appendStreamRecordingRecord(std::string &inputBuffer, int64_t inputStreamID, int64_t inputReceiveTime, const char *inputPayload, uint64_t inputPayloadSize)
+{
+if(inputPayloadSize > UINT32_MAX)
+{
+throw SOMException("Payload is too large to record\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+}
+
+uint64_t recordOffset = inputBuffer.size();
+inputBuffer.resize(recordOffset + STREAM_RECORDING_RECORD_HEADER_SIZE);
+
+char *recordHeader = &inputBuffer[recordOffset];
+writeNetworkOrderUInt64(recordHeader, inputStreamID);
+writeNetworkOrderUInt64(recordHeader + 8, inputReceiveTime);
+Poco::UInt32 networkOrderPayloadSize = Poco::ByteOrder::toNetwork(Poco::UInt32(inputPayloadSize));
+memcpy(recordHeader + 16, &networkOrderPayloadSize, sizeof(networkOrderPayloadSize));
+
+inputBuffer.append(inputPayload, inputPayloadSize);
+}
+
+/**
+This function makes the footer which holds the index of a recording file.
+@param inputIndexEntries: The entries of the index (in order)
+@param inputIndexOffset: The offset in the file that the footer will be written at
+@return: The footer
+*/
+std::string pylongps::createStreamRecordingFooter(const std::vector<streamRecordingIndexEntry> &inputIndexEntries, uint64_t inputIndexOffset)
+{
+std::string footer(inputIndexEntries.size()*STREAM_RECORDING_INDEX_ENTRY_SIZE + STREAM_RECORDING_FOOTER_TRAILER_SIZE, '\0');
+
+char *position = &footer[0];
+for(const streamRecordingIndexEntry &entry : inputIndexEntries)
+{
+writeNetworkOrderUInt64(position, entry.receiveTime);
+writeNetworkOrderUInt64(position + 8, entry.offset);
+position += STREAM_RECORDING_INDEX_ENTRY_SIZE;
+}
+
+writeNetworkOrderUInt64(position, inputIndexOffset);
+writeNetworkOrderUInt64(position + 8, inputIndexEntries.size());
+memcpy(position + 16, STREAM_RECORDING_INDEX_MAGIC, sizeof(STREAM_RECORDING_INDEX_MAGIC));
+
+return footer;
+}
+
+/**
+This function maps the file and reads its header and index.
+@param inputFilePath: The path to the recording
+
+@throws: This function can throw exceptions
+*/
+streamRecordingReader::streamRecordingReader(const std::string &inputFilePath)
+{
+int fileDescriptor = open(inputFilePath.c_str(), O_RDONLY);
+if(fileDescriptor < 0)
+{
+throw SOMException("Unable to open recording\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+}
+SOMScopeGuard fileDescriptorGuard([&](){close(fileDescriptor);}); //The mapping stays valid after the file is closed
+
+struct stat fileStatus;
+if(fstat(fileDescriptor, &fileStatus) != 0)
+{
+throw SOMException("Unable to get recording size\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+
+if(fileStatus.st_size < ((off_t) STREAM_RECORDING_HEADER_SIZE))
+{
+throw SOMException("File is too small to be a recording\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+}
+
+mappedSize = fileStatus.st_size;
+void *mappingAddress = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+if(mappingAddress == MAP_FAILED)
+{
+throw SOMException("Unable to map recording\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+mappedData = (const char *) mappingAddress;
+SOMScopeGuard mappingGuard([&](){munmap((void *) mappedData, mappedSize);});
+
+//Read header
+uint8_t headerSize = (uint8_t) mappedData[5];
+if(memcmp(mappedData, STREAM_RECORDING_MAGIC, sizeof(STREAM_RECORDING_MAGIC)) != 0 || ((uint8_t) mappedData[4]) < 1 || headerSize < STREAM_RECORDING_HEADER_SIZE || headerSize > mappedSize)
+{
+throw SOMException("File is not a recording this version can read\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+}
+startTime = readNetworkOrderUInt64(mappedData + 8);
+startOfRecords = headerSize;
+endOfRecords = mappedSize;
+
+//Read the index if the file was finished
+if(mappedSize >= startOfRecords + STREAM_RECORDING_FOOTER_TRAILER_SIZE)
+{
+const char *trailer = mappedData + mappedSize - STREAM_RECORDING_FOOTER_TRAILER_SIZE;
+uint64_t indexOffset = readNetworkOrderUInt64(trailer);
+uint64_t numberOfIndexEntries = readNetworkOrderUInt64(trailer + 8);
+
+//The trailer's values are checked without adding them, so corrupt values can't wrap around to a size that matches
+uint64_t endOfIndex = mappedSize - STREAM_RECORDING_FOOTER_TRAILER_SIZE;
+if(memcmp(trailer + 16, STREAM_RECORDING_INDEX_MAGIC, sizeof(STREAM_RECORDING_INDEX_MAGIC)) == 0 && indexOffset >= startOfRecords && indexOffset <= endOfIndex && (endOfIndex - indexOffset) % STREAM_RECORDING_INDEX_ENTRY_SIZE == 0 && numberOfIndexEntries == (endOfIndex - indexOffset)/STREAM_RECORDING_INDEX_ENTRY_SIZE)
+{
+endOfRecords = indexOffset;
+
+index.resize(numberOfIndexEntries);
+for(uint64_t i=0; i<numberOfIndexEntries; i++)
+{
+const char *entry = mappedData + indexOffset + i*STREAM_RECORDING_INDEX_ENTRY_SIZE;
+index[i].receiveTime = readNetworkOrderUInt64(entry);
+index[i].offset = readNetworkOrderUInt64(entry + 8);
+
+if(index[i].offset < startOfRecords || index[i].offset >= endOfRecords || (i > 0 && (index[i].offset <= index[i-1].offset || index[i].receiveTime < index[i-1].receiveTime)))
+{ //Entries must point at records in order, so ignore a corrupt index (seeks then scan from the first record)
+index.clear();
+break;
+}
+}
+}
+}
+
+madvise((void *) mappedData, mappedSize, MADV_SEQUENTIAL);
+mappingGuard.dismiss();
+}
+
+/**
+This function returns the offset of the first record received at or after the given time.
+@param inputTime: The time to find (microseconds since the epoch)
+@return: The offset (equal to getEndOfRecords() if there is no such record)
+*/
+uint64_t streamRecordingReader::seek(int64_t inputTime) const
+{
+//Start from the last indexed record received before the time (the index is sorted by time)
+auto iter = std::lower_bound(index.begin(), index.end(), inputTime, [](const streamRecordingIndexEntry &inputEntry, int64_t inputTime) { return inputEntry.receiveTime < inputTime; });
+
+uint64_t offset = startOfRecords;
+if(iter != index.begin())
+{
+offset = std::prev(iter)->offset;
+}
+
+streamRecordingRecord record;
+uint64_t nextOffset = offset;
+while(readRecord(nextOffset, record))
+{
+if(record.receiveTime >= inputTime)
+{
+return offset;
+}
+offset = nextOffset;
+}
+
+return endOfRecords;
+}
+
+/**
+This function reads the record at the given offset.
+@param inputOffset: The offset of the record, which is moved to the next record if it is read
+@param inputRecordBuffer: The object to store the record in
+@return: false if there isn't a complete record at the offset
+*/
+bool streamRecordingReader::readRecord(uint64_t &inputOffset, streamRecordingRecord &inputRecordBuffer) const
+{
+if(inputOffset < startOfRecords || inputOffset >= endOfRecords || (endOfRecords - inputOffset) < STREAM_RECORDING_RECORD_HEADER_SIZE)
+{
+return false;
+}
+
+const char *recordHeader = mappedData + inputOffset;
+Poco::UInt32 networkOrderPayloadSize = 0;
+memcpy(&networkOrderPayloadSize, recordHeader + 16, sizeof(networkOrderPayloadSize));
+uint32_t payloadSize = Poco::ByteOrder::fromNetwork(networkOrderPayloadSize);
+
+if((endOfRecords - inputOffset - STREAM_RECORDING_RECORD_HEADER_SIZE) < payloadSize)
+{ //Cut off
+return false;
+}
+
+inputRecordBuffer.streamID = readNetworkOrderUInt64(recordHeader);
+inputRecordBuffer.receiveTime = readNetworkOrderUInt64(recordHeader + 8);
+inputRecordBuffer.payload = recordHeader + STREAM_RECORDING_RECORD_HEADER_SIZE;
+inputRecordBuffer.payloadSize = payloadSize;
+
+inputOffset += STREAM_RECORDING_RECORD_HEADER_SIZE + payloadSize;
+return true;
+}
+
+/**
+This function returns the offset of the first record.
+@return: The offset
+*/
+uint64_t streamRecordingReader::getStartOfRecords() const
+{
+return startOfRecords;
+}
+
+/**
+This function returns the offset just past the last record.
+@return: The offset
+*/
+uint64_t streamRecordingReader::getEndOfRecords() const
+{
+return endOfRecords;
+}
+
+/**
+This function returns when the file was started.
+@return: The time from the header (microseconds since the epoch)
+*/
+int64_t streamRecordingReader::getStartTime() const
+{
+return startTime;
+}
+
+/**
+This function returns the recording's time index.
+@return: The entries (empty if the recording has no footer or its index is corrupt)
+*/
+const std::vector<streamRecordingIndexEntry> &streamRecordingReader::getIndex() const
+{
+return index;
+}
+
+/**
+This function unmaps the file.
+*/
+streamRecordingReader::~streamRecordingReader()
+{
+munmap((void *) mappedData, mappedSize);
+}
@@ -0,0 +1,155 @@
+#ifndef STREAMRECORDINGHPP
+#define STREAMRECORDINGHPP
+
+#include<cstdint>
+#include<cstring>
+#include<string>
+#include<vector>
+#include<algorithm>
+#include<iterator>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+
+#include "SOMException.hpp"
+#include "SOMScopeGuard.hpp"
+#include "Poco/ByteOrder.h"
+
+namespace pylongps
+{
+
+/*
+Stream recordings (see recordingDataSender/recordingDataReceiver) are files with the following layout:
+header: magic (4 bytes, "PGRC") | version (1 byte) | header size (1 byte) | reserved (2 bytes) | time the file was started (8 bytes)
+records: stream ID (8 bytes) | receive time (8 bytes) | payload size (4 bytes) | payload, repeated
+footer: index entry receive time (8 bytes) | index entry offset (8 bytes), repeated, followed by index offset (8 bytes) | number of index entries (8 bytes) | magic (4 bytes, "PGRI")
+Integers are in network byte order and times are microseconds since the epoch.  The index is sparse: it has an entry for the first record and for each record received at least the index interval after the last record with an entry, giving the record's receive time and offset in the file.  The footer is written when the file is finished, so a recording which was cut off has no index and ends with the last complete record.  Readers should skip "header size" bytes rather than assume STREAM_RECORDING_HEADER_SIZE.
+*/
+const char STREAM_RECORDING_MAGIC[4] = {'P', 'G', 'R', 'C'};
+const char STREAM_RECORDING_INDEX_MAGIC[4] = {'P', 'G', 'R', 'I'};
+const uint8_t STREAM_RECORDING_VERSION = 1;
+const uint32_t STREAM_RECORDING_HEADER_SIZE = 16;
+const uint32_t STREAM_RECORDING_RECORD_HEADER_SIZE = 20;
+const uint32_t STREAM_RECORDING_INDEX_ENTRY_SIZE = 16;
+const uint32_t STREAM_RECORDING_FOOTER_TRAILER_SIZE = 20;
+const double STREAM_RECORDING_DEFAULT_INDEX_INTERVAL = 1.0; //Seconds
+
+/**
+This class holds one entry of a recording's time index.
+*/
+class streamRecordingIndexEntry
+{
+public:
+int64_t receiveTime = 0;
+uint64_t offset = 0; //Offset of the record in the file
+};
+
+/**
+This class refers to one record of a recording.
+*/
+class streamRecordingRecord
+{
+public:
+int64_t streamID = 0;
+int64_t receiveTime = 0;
+const char *payload = nullptr; //Points into the reader's mapping of the file
+uint32_t payloadSize = 0;
+};
+
+/**
+This function makes the header that starts each recording file.
+@param inputStartTime: When the file was started (microseconds since the epoch)
+@return: The header
+*/
+std::string createStreamRecordingHeader(int64_t inputStartTime);
+
+/**
+This function adds a record to the end of the given buffer.
+@param inputBuffer: The buffer to add to
+@param inputStreamID: The ID of the stream the payload came from
+@param inputReceiveTime: When the payload was received (microseconds since the epoch)
+@param inputPayload: The payload
+@param inputPayloadSize: The size of the payload in bytes
+
+@throws: This function can throw exceptions
+*/
+void appendStreamRecordingRecord(std::string &inputBuffer, int64_t inputStreamID, int64_t inputReceiveTime, const char *inputPayload, uint64_t inputPayloadSize);
+
+/**
+This function makes the footer which holds the index of a recording file.
+@param inputIndexEntries: The entries of the index (in order)
+@param inputIndexOffset: The offset in the file that the footer will be written at
+@return: The footer
+*/
+std::string createStreamRecordingFooter(const std::vector<streamRecordingIndexEntry> &inputIndexEntries, uint64_t inputIndexOffset);
+
+/**
+This class memory maps a recording file so that its records can be read without copying them and uses its index (if it has one) to find the records received at a given time without reading the ones before them.
+*/
+class streamRecordingReader
+{
+public:
+/**
+This function maps the file and reads its header and index.
+@param inputFilePath: The path to the recording
+
+@throws: This function can throw exceptions
+*/
+streamRecordingReader(const std::string &inputFilePath);
+
+/**
+This function returns the offset of the first record received at or after the given time.
+@param inputTime: The time to find (microseconds since the epoch)
+@return: The offset (equal to getEndOfRecords() if there is no such record)
+*/
+uint64_t seek(int64_t inputTime) const;
+
+/**
+This function reads the record at the given offset.
+@param inputOffset: The offset of the record, which is moved to the next record if it is read
+@param inputRecordBuffer: The object to store the record in
+@return: false if there isn't a complete record at the offset
+*/
+bool readRecord(uint64_t &inputOffset, streamRecordingRecord &inputRecordBuffer) const;
+
+/**
+This function returns the offset of the first record.
+@return: The offset
+*/
+uint64_t getStartOfRecords() const;
+
+/**
+This function returns the offset just past the last record.
+@return: The offset
+*/
+uint64_t getEndOfRecords() const;
+
+/**
+This function returns when the file was started.
+@return: The time from the header (microseconds since the epoch)
+*/
+int64_t getStartTime() const;
+
+/**
+This function returns the recording's time index.
+@return: The entries (empty if the recording has no footer or its index is corrupt)
+*/
+const std::vector<streamRecordingIndexEntry> &getIndex() const;
+
+/**
+This function unmaps the file.
+*/
+~streamRecordingReader();
+
+protected:
+const char *mappedData = nullptr;
+uint64_t mappedSize = 0;
+uint64_t startOfRecords = 0;
+uint64_t endOfRecords = 0;
+int64_t startTime = 0;
+std::vector<streamRecordingIndexEntry> index;
+};
+
+}
+#endif
@@ -80,6 +80,15 @@ std::string tcpDataReceiver::notificationAddress()
 return notificationConnectionString;
 }
 
+/**
+This function returns the list that data senders in the same process can attach to in order to be handed the receiver's messages directly (the messages are still published at address() for anyone else).
+@return: The list
+*/
+directDataSinkList *tcpDataReceiver::directDataSinks()
+{
+return &directSinks;
+}
+
 /**
 This function reads from the TCP port and forwards the received data to the publisher socket.
 @param inputReactor: The reactor which called the function
@@ -106,6 +115,8 @@ if(!messageBuffer.more())
 SOM_TRY
 publishingSocket->send(messageBuffer.data(), messageBuffer.size());
 SOM_CATCH("Error publishing data\n")
+
+directSinks.publish((const char *) messageBuffer.data(), messageBuffer.size());
 }
 
 }
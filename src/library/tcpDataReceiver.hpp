@@ -46,11 +46,18 @@ This function is required to return a ZMQ inproc address which can be used with
 */
 virtual std::string notificationAddress();
 
+/**
+This function returns the list that data senders in the same process can attach to in order to be handed the receiver's messages directly (the messages are still published at address() for anyone else).
+@return: The list
+*/
+virtual directDataSinkList *directDataSinks();
+
 zmq::context_t &context;
 std::unique_ptr<zmq::socket_t> publishingSocket;
 std::unique_ptr<zmq::socket_t> notificationPublishingSocket;
 std::string publisherConnectionString; //String used to connect to this object's publisher
 std::string notificationConnectionString; //String used to publish status changes (such as unrecoverable disconnects)
+directDataSinkList directSinks; //Given each message after it is published (declared before the reactor so it outlives the reactor's thread)
 std::unique_ptr<reactor<tcpDataReceiver> > receiverReactor;
 
 protected:
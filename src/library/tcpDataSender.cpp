@@ -7,39 +7,112 @@ This function initializes the tcpDataSender to publish data via a bound TCP port
 @param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
 @param inputContext: A reference to the ZMQ context to use
 @param inputPortNumberToPublishOn: The TCP port number to bind/use for publishing
+@param inputLatencyTracer: If not nullptr, traces of the messages written out are completed with this tracer (see zmqDataReceiver)
+@param inputSlowClientPolicy: What to do with clients which fall more than TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE messages behind
 
 @throws: This function can throw exceptions
 */
-tcpDataSender::tcpDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, int inputPortNumberToPublishOn) : context(inputContext)
+tcpDataSender::tcpDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, int inputPortNumberToPublishOn, latencyTracer *inputLatencyTracer, tcpDataSenderSlowClientPolicy inputSlowClientPolicy) : context(inputContext), backlog(TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE)
 {
-if(inputPortNumberToPublishOn < 0)
+tracer = inputLatencyTracer;
+slowClientPolicy = inputSlowClientPolicy;
+
+if(inputPortNumberToPublishOn < 0 || inputPortNumberToPublishOn > 65535)
 {
-throw SOMException("Received negative port number\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+throw SOMException("Received invalid port number\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
 }
 
 informationSourceConnectionString = inputSourceConnectionString;
-SOM_TRY //Make TCP socket for server to use
-tcpSocket.reset(new Poco::Net::ServerSocket(inputPortNumberToPublishOn));
-SOM_CATCH("Error, unable to create Poco server socket\n")
 
-tcpDataSenderTCPServerConnectionFactoryImplementation *connectionFactory = nullptr;
-SOM_TRY //Make connection factory for server to use
-connectionFactory = new tcpDataSenderTCPServerConnectionFactoryImplementation(informationSourceConnectionString, context);
-SOM_CATCH("Error, unable to make Poco connection factory\n")
+//Close whatever has been opened if construction fails
+SOMScopeGuard fileDescriptorGuard([&]()
+{
+for(int fileDescriptor : {listeningSocketFileDescriptor, epollFileDescriptor, shutdownEventFileDescriptor, spareFileDescriptor})
+{
+if(fileDescriptor >= 0)
+{
+close(fileDescriptor);
+}
+}
+});
+
+//Reserve a descriptor to be able to refuse clients when out of descriptors
+spareFileDescriptor = open("/dev/null", O_RDONLY | O_CLOEXEC);
+if(spareFileDescriptor < 0)
+{
+throw SOMException("Unable to open /dev/null\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+
+//Make the nonblocking listening socket
+listeningSocketFileDescriptor = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+if(listeningSocketFileDescriptor < 0)
+{
+throw SOMException("Unable to create TCP socket\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+
+int reuseAddress = 1;
+setsockopt(listeningSocketFileDescriptor, SOL_SOCKET, SO_REUSEADDR, (void *) &reuseAddress, sizeof(reuseAddress));
+
+sockaddr_in bindAddress;
+memset((void *) &bindAddress, 0, sizeof(bindAddress));
+bindAddress.sin_family = AF_INET;
+bindAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+bindAddress.sin_port = htons(inputPortNumberToPublishOn);
+
+if(bind(listeningSocketFileDescriptor, (sockaddr *) &bindAddress, sizeof(bindAddress)) != 0)
+{
+throw SOMException("Unable to bind TCP port " + std::to_string(inputPortNumberToPublishOn) +"\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
 
-Poco::Net::TCPServerParams *serverParameters = new Poco::Net::TCPServerParams; //TCPServer takes ownership
+if(listen(listeningSocketFileDescriptor, SOMAXCONN) != 0)
+{
+throw SOMException("Unable to listen on TCP port\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
 
-Poco::Net::ServerSocket *serverSocket = tcpSocket.get();
+//Subscribe once for all of the clients
+SOM_TRY
+subscriberSocket.reset(new zmq::socket_t(context, ZMQ_SUB));
+SOM_CATCH("Error making socket\n")
 
-tcpSocket.release(); //Release ownership
+SOM_TRY //Set filter to allow any published messages to be received
+subscriberSocket->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
+SOM_CATCH("Error setting subscription for socket\n")
 
-SOM_TRY //tcpServer takes ownership of connection factory
-tcpServer.reset(new Poco::Net::TCPServer(connectionFactory, *serverSocket, serverParameters));
-SOM_CATCH("Error initializing Poco tcp server\n")
+SOM_TRY
+subscriberSocket->connect(informationSourceConnectionString.c_str());
+SOM_CATCH("Error connecting socket with info source\n")
 
 SOM_TRY
-tcpServer->start();
-SOM_CATCH("Error starting tcp server\n")
+size_t fileDescriptorSize = sizeof(subscriberSocketFileDescriptor);
+subscriberSocket->getsockopt(ZMQ_FD, (void *) &subscriberSocketFileDescriptor, &fileDescriptorSize);
+SOM_CATCH("Error getting file descriptor of socket\n")
+
+//Make the epoll set with the listening socket, subscriber and shutdown event
+shutdownEventFileDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+epollFileDescriptor = epoll_create1(EPOLL_CLOEXEC);
+if(shutdownEventFileDescriptor < 0 || epollFileDescriptor < 0)
+{
+throw SOMException("Unable to create epoll set\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+
+for(int fileDescriptor : {listeningSocketFileDescriptor, subscriberSocketFileDescriptor, shutdownEventFileDescriptor})
+{
+epoll_event event;
+memset((void *) &event, 0, sizeof(event));
+event.events = EPOLLIN;
+event.data.fd = fileDescriptor;
+
+if(epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, fileDescriptor, &event) != 0)
+{
+throw SOMException("Unable to add to epoll set\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+}
+
+SOM_TRY
+sendingThread.reset(new std::thread(&tcpDataSender::run, this));
+SOM_CATCH("Error starting sending thread\n")
+
+fileDescriptorGuard.dismiss();
 }
 
 
@@ -53,82 +126,544 @@ return notificationConnectionString;
 }
 
 /**
-This function shuts down the Poco TCP server.
+This function returns how far behind each of the connected clients is, as of the last statistics update (at most TCP_DATA_SENDER_STATISTICS_UPDATE_INTERVAL old).
+@return: The statistics of each client
+*/
+std::vector<tcpDataSenderClientStatistics> tcpDataSender::getClientStatistics()
+{
+std::lock_guard<std::mutex> lock(clientStatisticsMutex);
+return clientStatistics;
+}
+
+/**
+This function returns how many clients have been disconnected for falling too far behind.
+@return: The number of evicted clients
+*/
+uint64_t tcpDataSender::getNumberOfEvictedClients()
+{
+return numberOfEvictedClients;
+}
+
+/**
+This function returns how many clients have been disconnected right after connecting because the process was out of file descriptors.
+@return: The number of refused clients
+*/
+uint64_t tcpDataSender::getNumberOfRefusedClients()
+{
+return numberOfRefusedClients;
+}
+
+/**
+This function stops the sending thread and closes the client connections.
 */
 tcpDataSender::~tcpDataSender()
 {
-tcpServer->stop();
+uint64_t shutdownSignal = 1;
+if(write(shutdownEventFileDescriptor, (void *) &shutdownSignal, sizeof(shutdownSignal)) != sizeof(shutdownSignal))
+{
+fprintf(stderr, "Error signaling tcpDataSender thread to shut down\n");
+}
+
+sendingThread->join();
+
+for(const auto &fileDescriptorAndClient : fileDescriptorToClient)
+{
+close(fileDescriptorAndClient.first);
+}
+
+close(listeningSocketFileDescriptor);
+close(epollFileDescriptor);
+close(shutdownEventFileDescriptor);
+if(spareFileDescriptor >= 0)
+{
+close(spareFileDescriptor);
+}
+}
+
+/**
+This function runs the epoll loop until shutdown is signaled.
+*/
+void tcpDataSender::run()
+{
+std::vector<epoll_event> events(64);
+
+try
+{
+while(true)
+{
+int numberOfEvents = epoll_wait(epollFileDescriptor, events.data(), events.size(), TCP_DATA_SENDER_MAXIMUM_POLL_WAIT_TIME);
+if(numberOfEvents < 0)
+{
+if(errno == EINTR)
+{
+continue;
+}
+throw SOMException("epoll_wait failed\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+
+for(int i=0; i<numberOfEvents; i++)
+{
+int fileDescriptor = events[i].data.fd;
+
+if(fileDescriptor == shutdownEventFileDescriptor)
+{
+return;
+}
+
+if(fileDescriptor == listeningSocketFileDescriptor)
+{
+acceptConnections();
+continue;
+}
+
+if(fileDescriptor == subscriberSocketFileDescriptor)
+{ //Handled below
+continue;
+}
+
+auto clientIter = fileDescriptorToClient.find(fileDescriptor);
+if(clientIter == fileDescriptorToClient.end())
+{ //Removed earlier in this batch of events
+continue;
+}
+
+if(events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+{
+removeClient(fileDescriptor);
+continue;
+}
+
+if(events[i].events & EPOLLIN)
+{ //Clients aren't expected to send anything, so discard it
+char discardBuffer[512];
+ssize_t numberOfBytesRead = recv(fileDescriptor, discardBuffer, sizeof(discardBuffer), MSG_DONTWAIT);
+if(numberOfBytesRead == 0 || (numberOfBytesRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+{
+removeClient(fileDescriptor);
+continue;
+}
+}
+
+if((events[i].events & EPOLLOUT) && !writeToClient(clientIter->second))
+{
+removeClient(fileDescriptor);
+}
+}
+
+//ZMQ_FD only signals edges, so the subscriber is drained every iteration rather than only when it is flagged
+readAndForwardData();
+
+Poco::Timestamp::TimeVal currentTime = Poco::Timestamp().epochMicroseconds();
+if((currentTime - timeClientStatisticsWereLastUpdated) >= TCP_DATA_SENDER_STATISTICS_UPDATE_INTERVAL*1000000.0)
+{
+updateClientStatistics();
+timeClientStatisticsWereLastUpdated = currentTime;
+}
+
+if(!listeningSocketIsWatched && (currentTime - timeListeningSocketWasLastUnwatched) >= TCP_DATA_SENDER_ACCEPT_BACKOFF_TIME*1000000.0)
+{
+setListeningSocketIsWatched(true);
+}
+}
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "%s", inputException.what());
+}
 }
 
 /**
-This function initializes the connection handler so that it can forward data received from the given source connection string.
-@param inputConnectionSocket: The socket to forward data to
-@param inputSourceConnectionString: The connection string to use for the data source
-@param inputContext: The context to use with the source connection string
+This function accepts all waiting connections.
 
-@throws: This function can throw exception
+@throws: This function can throw exceptions
 */
-tcpDataSenderTCPConnectionHandler::tcpDataSenderTCPConnectionHandler(const Poco::Net::StreamSocket &inputConnectionSocket, const std::string &inputSourceConnectionString, zmq::context_t &inputContext) : Poco::Net::TCPServerConnection(inputConnectionSocket), context(inputContext), connectionSocket(inputConnectionSocket)
+void tcpDataSender::acceptConnections()
+{
+while(true)
+{
+sockaddr_storage clientAddress;
+socklen_t clientAddressSize = sizeof(clientAddress);
+int fileDescriptor = accept4(listeningSocketFileDescriptor, (sockaddr *) &clientAddress, &clientAddressSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
+if(fileDescriptor < 0)
 {
-sourceConnectionString = inputSourceConnectionString;
+int acceptError = errno;
+if(acceptError == EINTR || acceptError == ECONNABORTED)
+{
+continue;
+}
 
-SOM_TRY //Init socket
-subscriberSocket.reset(new zmq::socket_t(context, ZMQ_SUB));
-SOM_CATCH("Error making socket\n")
+if((acceptError == EMFILE || acceptError == ENFILE) && refuseWaitingConnection())
+{
+continue;
+}
+return; //Nothing waiting (or accepting has been paused)
+}
 
-SOM_TRY //Set filter to allow any published messages to be received
-subscriberSocket->setsockopt(ZMQ_SUBSCRIBE, nullptr, 0);
-SOM_CATCH("Error setting subscription for socket\n")
+int noDelay = 1; //Corrections are latency sensitive and batching is done here
+setsockopt(fileDescriptor, IPPROTO_TCP, TCP_NODELAY, (void *) &noDelay, sizeof(noDelay));
 
-SOM_TRY //Connect to caster
-subscriberSocket->connect(sourceConnectionString.c_str());
-SOM_CATCH("Error connecting socket with info source\n")
+epoll_event event;
+memset((void *) &event, 0, sizeof(event));
+event.events = EPOLLIN | EPOLLRDHUP;
+event.data.fd = fileDescriptor;
+if(epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, fileDescriptor, &event) != 0)
+{
+close(fileDescriptor);
+continue;
+}
+
+tcpDataSenderClient &client = fileDescriptorToClient[fileDescriptor];
+client.fileDescriptor = fileDescriptor;
+client.nextMessageIndex = nextBacklogIndex; //Start with the next message, like a new subscriber would
+
+char addressBuffer[INET6_ADDRSTRLEN] = "";
+int port = 0;
+if(clientAddress.ss_family == AF_INET)
+{
+sockaddr_in *address = (sockaddr_in *) &clientAddress;
+inet_ntop(AF_INET, (void *) &address->sin_addr, addressBuffer, sizeof(addressBuffer));
+port = ntohs(address->sin_port);
+}
+else if(clientAddress.ss_family == AF_INET6)
+{
+sockaddr_in6 *address = (sockaddr_in6 *) &clientAddress;
+inet_ntop(AF_INET6, (void *) &address->sin6_addr, addressBuffer, sizeof(addressBuffer));
+port = ntohs(address->sin6_port);
+}
+client.address = std::string(addressBuffer) + ":" + std::to_string(port);
+}
 }
 
 /**
-This function is called to handle the TCP connection that is owned by the base TCPServerConnection object and forwards the received data over the connection.
+This function is called when a connection is waiting but can't be accepted because the process is out of file descriptors.  It frees the reserved descriptor to accept the connection and close it right away, so the client is refused rather than left waiting (the level triggered listening socket would otherwise wake the thread continuously).  If that doesn't work, the listening socket is ignored for TCP_DATA_SENDER_ACCEPT_BACKOFF_TIME.
+@return: true if a connection was refused (so there may be more waiting)
 */
-void tcpDataSenderTCPConnectionHandler::run()
+bool tcpDataSender::refuseWaitingConnection()
 {
-std::unique_ptr<zmq::message_t> messageBuffer;
-Poco::Net::StreamSocket &connection = socket();
+bool connectionWasRefused = false;
+if(spareFileDescriptor >= 0)
+{
+close(spareFileDescriptor);
+
+int fileDescriptor = accept4(listeningSocketFileDescriptor, nullptr, nullptr, SOCK_CLOEXEC);
+if(fileDescriptor >= 0)
+{
+numberOfRefusedClients++; //Counted first so it is visible by the time the client sees the disconnect
+close(fileDescriptor);
+connectionWasRefused = true;
+}
+
+spareFileDescriptor = open("/dev/null", O_RDONLY | O_CLOEXEC); //Tried again next time if this fails
+}
+
+if(!connectionWasRefused)
+{
+SOM_TRY
+setListeningSocketIsWatched(false);
+SOM_CATCH("Error pausing accepting connections\n")
+}
+
+return connectionWasRefused;
+}
+
+/**
+This function sets whether the listening socket is in the epoll set's interest list.
+@param inputWatchListeningSocket: False to stop accepting connections until this is called with true
+
+@throws: This function can throw exceptions
+*/
+void tcpDataSender::setListeningSocketIsWatched(bool inputWatchListeningSocket)
+{
+epoll_event event;
+memset((void *) &event, 0, sizeof(event));
+event.events = inputWatchListeningSocket ? (uint32_t) EPOLLIN : 0u;
+event.data.fd = listeningSocketFileDescriptor;
 
+if(epoll_ctl(epollFileDescriptor, EPOLL_CTL_MOD, listeningSocketFileDescriptor, &event) != 0)
+{
+throw SOMException("Unable to update epoll set\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+
+listeningSocketIsWatched = inputWatchListeningSocket;
+if(!inputWatchListeningSocket)
+{
+timeListeningSocketWasLastUnwatched = Poco::Timestamp().epochMicroseconds();
+}
+}
+
+/**
+This function adds all of the waiting messages from the source to the backlog and then passes them on to the clients.
+
+@throws: This function can throw exceptions
+*/
+void tcpDataSender::readAndForwardData()
+{
+uint64_t numberOfNewMessages = 0;
 while(true)
 {
+std::shared_ptr<zmq::message_t> message;
+
 SOM_TRY
-messageBuffer.reset(new zmq::message_t);
+message.reset(new zmq::message_t);
 SOM_CATCH("Error making zmq message buffer\n")
 
+bool messageReceived = false;
 SOM_TRY
-if(subscriberSocket->recv(messageBuffer.get()) == false)
+messageReceived = subscriberSocket->recv(message.get(), ZMQ_DONTWAIT);
+SOM_CATCH("Error, unable to receive data\n")
+
+if(!messageReceived)
 {
-continue; //Nothing received
+break;
 }
-SOM_CATCH("Error, unable to forward data\n")
 
-SOM_TRY
-connection.sendBytes(messageBuffer->data(), messageBuffer->size());
-SOM_CATCH("Error, couldn't send via Poco socket\n")
+//Received messages are shared by the clients rather than copied
+backlog[nextBacklogIndex % TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE] = message;
+nextBacklogIndex++;
+numberOfNewMessages++;
+}
+
+if(numberOfNewMessages == 0)
+{
+return;
+}
+
+//Clients waiting for EPOLLOUT are written to when their sockets drain
+std::vector<int> clientsToRemove;
+for(auto &fileDescriptorAndClient : fileDescriptorToClient)
+{
+tcpDataSenderClient &client = fileDescriptorAndClient.second;
+
+if(!checkClientLag(client) || (!client.isWaitingUntilWritable && !writeToClient(client)))
+{
+clientsToRemove.push_back(fileDescriptorAndClient.first);
+}
+}
+
+for(int fileDescriptor : clientsToRemove)
+{
+removeClient(fileDescriptor);
+}
+
+//Messages which left the backlog without being completely written anywhere can't be traced
+if(nextBacklogIndex - nextMessageIndexToTrace > TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE)
+{
+nextMessageIndexToTrace = nextBacklogIndex - TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE;
+}
+}
+
+/**
+This function writes as much of the client's pending data as the socket will take, registering it for EPOLLOUT if the socket fills up.
+@param inputClient: The client to write to
+@return: false if the connection has failed and the client should be removed
+*/
+bool tcpDataSender::writeToClient(tcpDataSenderClient &inputClient)
+{
+if(!checkClientLag(inputClient))
+{
+return false;
+}
+
+while(true)
+{
+//Gather the partially sent message and as many backlog messages as fit in one call
+iovec buffers[TCP_DATA_SENDER_MAXIMUM_WRITE_BATCH_SIZE];
+int numberOfBuffers = 0;
+uint64_t numberOfBytesToWrite = 0;
+
+if(inputClient.partiallySentMessage.get() != nullptr)
+{
+buffers[numberOfBuffers].iov_base = ((char *) inputClient.partiallySentMessage->data()) + inputClient.partiallySentMessageOffset;
+buffers[numberOfBuffers].iov_len = inputClient.partiallySentMessage->size() - inputClient.partiallySentMessageOffset;
+numberOfBytesToWrite += buffers[numberOfBuffers].iov_len;
+numberOfBuffers++;
+}
+
+for(uint64_t messageIndex = inputClient.nextMessageIndex; messageIndex < nextBacklogIndex && numberOfBuffers < TCP_DATA_SENDER_MAXIMUM_WRITE_BATCH_SIZE; messageIndex++)
+{
+zmq::message_t &message = *backlog[messageIndex % TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE];
+buffers[numberOfBuffers].iov_base = message.data();
+buffers[numberOfBuffers].iov_len = message.size();
+numberOfBytesToWrite += message.size();
+numberOfBuffers++;
+}
+
+if(numberOfBuffers == 0)
+{ //Caught up
+return setClientWaitingUntilWritable(inputClient, false);
+}
+
+msghdr messageHeader;
+memset((void *) &messageHeader, 0, sizeof(messageHeader));
+messageHeader.msg_iov = buffers;
+messageHeader.msg_iovlen = numberOfBuffers;
+
+ssize_t numberOfBytesWritten = sendmsg(inputClient.fileDescriptor, &messageHeader, MSG_NOSIGNAL | MSG_DONTWAIT);
+if(numberOfBytesWritten < 0)
+{
+if(errno == EINTR)
+{
+continue;
+}
+
+if(errno == EAGAIN || errno == EWOULDBLOCK)
+{
+return setClientWaitingUntilWritable(inputClient, true);
+}
+
+return false; //Connection failed
+}
+
+inputClient.numberOfSentBytes += numberOfBytesWritten;
+
+//Messages before the first one in this write were either traced by a faster client or skipped
+uint64_t firstWrittenMessageIndex = inputClient.partiallySentMessage.get() == nullptr ? inputClient.nextMessageIndex : inputClient.nextMessageIndex - 1;
+nextMessageIndexToTrace = std::max(nextMessageIndexToTrace, firstWrittenMessageIndex);
+
+//Advance through the written messages
+uint64_t numberOfBytesLeft = numberOfBytesWritten;
+if(inputClient.partiallySentMessage.get() != nullptr)
+{
+uint64_t numberOfBytesRemainingInMessage = inputClient.partiallySentMessage->size() - inputClient.partiallySentMessageOffset;
+if(numberOfBytesLeft < numberOfBytesRemainingInMessage)
+{
+inputClient.partiallySentMessageOffset += numberOfBytesLeft;
+return setClientWaitingUntilWritable(inputClient, true);
+}
+
+numberOfBytesLeft -= numberOfBytesRemainingInMessage;
+inputClient.partiallySentMessage.reset();
+inputClient.partiallySentMessageOffset = 0;
+}
+
+while(numberOfBytesLeft > 0)
+{
+std::shared_ptr<zmq::message_t> &message = backlog[inputClient.nextMessageIndex % TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE];
+inputClient.nextMessageIndex++;
+
+if(numberOfBytesLeft < message->size())
+{
+inputClient.partiallySentMessage = message;
+inputClient.partiallySentMessageOffset = numberOfBytesLeft;
+break;
+}
+
+numberOfBytesLeft -= message->size();
+}
+
+//Complete the traces of messages this is the first client to finish writing
+uint64_t endOfCompletedMessages = inputClient.partiallySentMessage.get() == nullptr ? inputClient.nextMessageIndex : inputClient.nextMessageIndex - 1;
+for(; nextMessageIndexToTrace < endOfCompletedMessages; nextMessageIndexToTrace++)
+{
+if(tracer != nullptr)
+{
+zmq::message_t &message = *backlog[nextMessageIndexToTrace % TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE];
+tracer->completePendingTrace((const char *) message.data(), message.size(), SENDER_OUTPUT);
+}
+}
+
+if(((uint64_t) numberOfBytesWritten) < numberOfBytesToWrite)
+{ //Socket buffer is full
+return setClientWaitingUntilWritable(inputClient, true);
+}
 }
 }
 
 /**
-This function initializes the factory with the values to pass to the connection handlers.
-@param inputSourceConnectionString: The connection string to connect to a ZMQ_PUB socket which is sending information to forward
-@param inputContext: The zmq context to use
+This function checks if a client has fallen further behind than the backlog holds and applies the slow client policy if so.
+@param inputClient: The client to check
+@return: false if the client should be removed
 */
-tcpDataSenderTCPServerConnectionFactoryImplementation::tcpDataSenderTCPServerConnectionFactoryImplementation(const std::string &inputSourceConnectionString, zmq::context_t &inputContext) : context(inputContext)
+bool tcpDataSender::checkClientLag(tcpDataSenderClient &inputClient)
 {
-sourceConnectionString = inputSourceConnectionString;
+if((nextBacklogIndex - inputClient.nextMessageIndex) <= TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE)
+{
+return true;
+}
+
+if(slowClientPolicy == TCP_DATA_SENDER_EVICT)
+{
+numberOfEvictedClients++;
+return false;
+}
+
+//Skip to the newest message (a partially sent message is still finished so the client doesn't get a truncated message)
+inputClient.numberOfSkippedMessages += (nextBacklogIndex - 1) - inputClient.nextMessageIndex;
+inputClient.nextMessageIndex = nextBacklogIndex - 1;
+return true;
 }
 
 /**
-This function creates a tcpDataSenderTCPConnectionHandler to handle a particular TCP connection.
-@param inputConnectionSocket: The connection socket to forward the data over
+This function sets whether a client's socket is registered for EPOLLOUT.
+@param inputClient: The client to update
+@param inputWaitUntilWritable: True if the client should be woken when its socket can be written to
+@return: false if the registration failed
 */
-Poco::Net::TCPServerConnection *tcpDataSenderTCPServerConnectionFactoryImplementation::createConnection(const Poco::Net::StreamSocket &inputConnectionSocket)
+bool tcpDataSender::setClientWaitingUntilWritable(tcpDataSenderClient &inputClient, bool inputWaitUntilWritable)
 {
-SOM_TRY
-return new tcpDataSenderTCPConnectionHandler(inputConnectionSocket, sourceConnectionString, context);
-SOM_CATCH("Error, unable to create connection handler\n")
+if(inputClient.isWaitingUntilWritable == inputWaitUntilWritable)
+{
+return true;
+}
+
+epoll_event event;
+memset((void *) &event, 0, sizeof(event));
+event.events = EPOLLIN | EPOLLRDHUP | (inputWaitUntilWritable ? (uint32_t) EPOLLOUT : 0u);
+event.data.fd = inputClient.fileDescriptor;
+
+if(epoll_ctl(epollFileDescriptor, EPOLL_CTL_MOD, inputClient.fileDescriptor, &event) != 0)
+{
+return false;
+}
+
+inputClient.isWaitingUntilWritable = inputWaitUntilWritable;
+return true;
+}
+
+/**
+This function closes a client's connection and forgets it.
+@param inputFileDescriptor: The client's socket
+*/
+void tcpDataSender::removeClient(int inputFileDescriptor)
+{
+epoll_ctl(epollFileDescriptor, EPOLL_CTL_DEL, inputFileDescriptor, nullptr);
+close(inputFileDescriptor);
+fileDescriptorToClient.erase(inputFileDescriptor);
+}
+
+/**
+This function refreshes the snapshot returned by getClientStatistics.
+*/
+void tcpDataSender::updateClientStatistics()
+{
+std::vector<tcpDataSenderClientStatistics> statistics;
+statistics.reserve(fileDescriptorToClient.size());
+
+for(const auto &fileDescriptorAndClient : fileDescriptorToClient)
+{
+const tcpDataSenderClient &client = fileDescriptorAndClient.second;
+
+statistics.emplace_back();
+tcpDataSenderClientStatistics &statisticsOfClient = statistics.back();
+statisticsOfClient.address = client.address;
+statisticsOfClient.numberOfSkippedMessages = client.numberOfSkippedMessages;
+statisticsOfClient.numberOfSentBytes = client.numberOfSentBytes;
+
+if(client.partiallySentMessage.get() != nullptr)
+{
+statisticsOfClient.numberOfMessagesBehind++;
+statisticsOfClient.numberOfBytesBehind += client.partiallySentMessage->size() - client.partiallySentMessageOffset;
+}
+
+//Messages which have left the backlog are handled by the slow client policy on the next write
+uint64_t firstMessageIndex = std::max(client.nextMessageIndex, nextBacklogIndex > TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE ? nextBacklogIndex - TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE : 0);
+statisticsOfClient.numberOfMessagesBehind += nextBacklogIndex - client.nextMessageIndex;
+for(uint64_t messageIndex = firstMessageIndex; messageIndex < nextBacklogIndex; messageIndex++)
+{
+statisticsOfClient.numberOfBytesBehind += backlog[messageIndex % TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE]->size();
+}
+}
+
+std::lock_guard<std::mutex> lock(clientStatisticsMutex);
+clientStatistics = std::move(statistics);
 }
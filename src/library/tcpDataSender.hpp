@@ -5,27 +5,81 @@
 #include<thread>
 #include<string>
 #include<cstdio>
+#include<cstring>
+#include<cerrno>
 #include<unistd.h>
 #include<set>
-
-#include<Poco/Net/TCPServer.h>
-#include<Poco/Net/TCPServerConnection.h>
-#include<Poco/Net/TCPServerConnectionFactory.h>
+#include<vector>
+#include<mutex>
+#include<atomic>
+#include<unordered_map>
+#include<algorithm>
+
+#include<fcntl.h>
+#include<sys/socket.h>
+#include<sys/epoll.h>
+#include<sys/eventfd.h>
+#include<sys/uio.h>
+#include<netinet/in.h>
+#include<netinet/tcp.h>
+#include<arpa/inet.h>
 
 #include "dataSender.hpp"
 #include "SOMException.hpp"
 #include "SOMScopeGuard.hpp"
 #include "zmq.hpp"
-#include "reactor.hpp"
 #include "utilityFunctions.hpp"
-#include "data_receiver_status_notification.pb.h" 
+#include "latencyTracer.hpp"
+#include "Poco/Timestamp.h"
+#include "data_receiver_status_notification.pb.h"
 
 namespace pylongps
 {
 
+const uint64_t TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE = 256; //How many messages a client can fall behind before the slow client policy is applied
+const int TCP_DATA_SENDER_MAXIMUM_WRITE_BATCH_SIZE = 64; //Most messages gathered into one write call
+const int TCP_DATA_SENDER_MAXIMUM_POLL_WAIT_TIME = 100; //Milliseconds
+const double TCP_DATA_SENDER_STATISTICS_UPDATE_INTERVAL = .25; //How often the client statistics snapshot is refreshed, in seconds
+const double TCP_DATA_SENDER_ACCEPT_BACKOFF_TIME = .5; //How long to stop accepting connections if the process is out of file descriptors and the waiting connection can't be refused, in seconds
+
+//What to do with a client which has fallen more than TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE messages behind
+enum tcpDataSenderSlowClientPolicy
+{
+TCP_DATA_SENDER_SKIP_TO_LATEST = 0, //Drop the backlog (after finishing any partially sent message) and continue with the newest message
+TCP_DATA_SENDER_EVICT = 1 //Close the connection
+};
+
+/**
+This class holds how far behind one client of a tcpDataSender is.
+*/
+class tcpDataSenderClientStatistics
+{
+public:
+std::string address; //IP address:port of the client
+uint64_t numberOfMessagesBehind = 0; //Messages received from the source which haven't been completely written to the client
+uint64_t numberOfBytesBehind = 0;
+uint64_t numberOfSkippedMessages = 0; //Messages dropped by TCP_DATA_SENDER_SKIP_TO_LATEST
+uint64_t numberOfSentBytes = 0;
+};
+
+/**
+This class holds the state of one client of a tcpDataSender.  Clients don't have their own copies of the messages, just their position in the sender's backlog.
+*/
+class tcpDataSenderClient
+{
+public:
+int fileDescriptor = -1;
+std::string address; //IP address:port of the client
+uint64_t nextMessageIndex = 0; //Index of the next message in the backlog to send
+std::shared_ptr<zmq::message_t> partiallySentMessage; //Message that a write stopped partway through (kept alive even if it leaves the backlog), nullptr if none
+uint64_t partiallySentMessageOffset = 0;
+bool isWaitingUntilWritable = false; //True if the socket's buffer was full and it is registered for EPOLLOUT
+uint64_t numberOfSkippedMessages = 0;
+uint64_t numberOfSentBytes = 0;
+};
 
 /**
-This class takes data published on an inproc ZMQ PUB socket and forwards it to anyone that connects to it via a TCP socket. Due to Ubuntu only having ZMQ 4.0 in the repositories (rather than 4.1), this needs to be done using a Poco TCP server, which means notifications aren't really currently supported
+This class takes data published on an inproc ZMQ PUB socket and forwards it to anyone that connects to it via a TCP socket.  A single thread subscribes once and serves every client from an epoll loop: received messages are added to a shared backlog of the last TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE messages, each client keeps its position in the backlog and the pending messages are written to a client with one gathering write per batch.  Clients which can't keep up are handled according to the slow client policy rather than being allowed to hold an unbounded amount of data.  Notifications aren't currently supported.
 */
 class tcpDataSender : public dataSender
 {
@@ -35,10 +89,12 @@ This function initializes the tcpDataSender to publish data via a bound TCP port
 @param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
 @param inputContext: A reference to the ZMQ context to use
 @param inputPortNumberToPublishOn: The TCP port number to bind/use for publishing
+@param inputLatencyTracer: If not nullptr, traces of the messages written out are completed with this tracer (see zmqDataReceiver)
+@param inputSlowClientPolicy: What to do with clients which fall more than TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE messages behind
 
 @throws: This function can throw exceptions
 */
-tcpDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, int inputPortNumberToPublishOn);
+tcpDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, int inputPortNumberToPublishOn, latencyTracer *inputLatencyTracer = nullptr, tcpDataSenderSlowClientPolicy inputSlowClientPolicy = TCP_DATA_SENDER_SKIP_TO_LATEST);
 
 
 /**
@@ -48,66 +104,124 @@ This function is required to return a ZMQ inproc address which can be used with
 virtual std::string notificationAddress();
 
 /**
-This function shuts down the Poco TCP server.
+This function returns how far behind each of the connected clients is, as of the last statistics update (at most TCP_DATA_SENDER_STATISTICS_UPDATE_INTERVAL old).
+@return: The statistics of each client
+*/
+std::vector<tcpDataSenderClientStatistics> getClientStatistics();
+
+/**
+This function returns how many clients have been disconnected for falling too far behind.
+@return: The number of evicted clients
+*/
+uint64_t getNumberOfEvictedClients();
+
+/**
+This function returns how many clients have been disconnected right after connecting because the process was out of file descriptors.
+@return: The number of refused clients
+*/
+uint64_t getNumberOfRefusedClients();
+
+/**
+This function stops the sending thread and closes the client connections.
 */
 ~tcpDataSender();
 
 zmq::context_t &context;
 std::unique_ptr<zmq::socket_t> notificationPublishingSocket;
+std::string informationSourceConnectionString; //String used to connect to the data source
+std::string notificationConnectionString; //String used to publish status changes (such as unrecoverable disconnects)
+latencyTracer *tracer = nullptr; //Not owned
+
+protected:
+/**
+This function runs the epoll loop until shutdown is signaled.
+*/
+void run();
 
-std::unique_ptr<Poco::Net::ServerSocket> tcpSocket;
-std::unique_ptr<Poco::Net::TCPServer> tcpServer;
+/**
+This function accepts all waiting connections.
 
+@throws: This function can throw exceptions
+*/
+void acceptConnections();
 
-std::string informationSourceConnectionString; //String used to connect to the data source
-std::string notificationConnectionString; //String used to publish status changes (such as unrecoverable disconnects)
+/**
+This function is called when a connection is waiting but can't be accepted because the process is out of file descriptors.  It frees the reserved descriptor to accept the connection and close it right away, so the client is refused rather than left waiting (the level triggered listening socket would otherwise wake the thread continuously).  If that doesn't work, the listening socket is ignored for TCP_DATA_SENDER_ACCEPT_BACKOFF_TIME.
+@return: true if a connection was refused (so there may be more waiting)
+*/
+bool refuseWaitingConnection();
 
-};
+/**
+This function sets whether the listening socket is in the epoll set's interest list.
+@param inputWatchListeningSocket: False to stop accepting connections until this is called with true
 
+@throws: This function can throw exceptions
+*/
+void setListeningSocketIsWatched(bool inputWatchListeningSocket);
 
-class tcpDataSenderTCPConnectionHandler : public Poco::Net::TCPServerConnection
-{
-public:
 /**
-This function initializes the connection handler so that it can forward data received from the given source connection string.
-@param inputConnectionSocket: The socket to forward data to
-@param inputSourceConnectionString: The connection string to use for the data source
-@param inputContext: The context to use with the source connection string
+This function adds all of the waiting messages from the source to the backlog and then passes them on to the clients.
 
-@throws: This function can throw exception
+@throws: This function can throw exceptions
 */
-tcpDataSenderTCPConnectionHandler(const Poco::Net::StreamSocket &inputConnectionSocket, const std::string &inputSourceConnectionString, zmq::context_t &inputContext);
+void readAndForwardData();
 
 /**
-This function is called to handle the TCP connection that is owned by the base TCPServerConnection object and forwards the received data over the connection.
+This function writes as much of the client's pending data as the socket will take, registering it for EPOLLOUT if the socket fills up.
+@param inputClient: The client to write to
+@return: false if the connection has failed and the client should be removed
 */
-void run();
+bool writeToClient(tcpDataSenderClient &inputClient);
 
-std::string sourceConnectionString; //String used to connect to the data source
-std::unique_ptr<zmq::socket_t> subscriberSocket; //A ZMQ_SUB socket connected to the information source
-zmq::context_t &context;
-const Poco::Net::StreamSocket &connectionSocket;
-};
+/**
+This function checks if a client has fallen further behind than the backlog holds and applies the slow client policy if so.
+@param inputClient: The client to check
+@return: false if the client should be removed
+*/
+bool checkClientLag(tcpDataSenderClient &inputClient);
 
-class tcpDataSenderTCPServerConnectionFactoryImplementation : public Poco::Net::TCPServerConnectionFactory
-{
-public:
 /**
-This function initializes the factory with the values to pass to the connection handlers.
-@param inputSourceConnectionString: The connection string to connect to a ZMQ_PUB socket which is sending information to forward
-@param inputContext: The zmq context to use
+This function sets whether a client's socket is registered for EPOLLOUT.
+@param inputClient: The client to update
+@param inputWaitUntilWritable: True if the client should be woken when its socket can be written to
+@return: false if the registration failed
 */
-tcpDataSenderTCPServerConnectionFactoryImplementation(const std::string &inputSourceConnectionString, zmq::context_t &inputContext);
+bool setClientWaitingUntilWritable(tcpDataSenderClient &inputClient, bool inputWaitUntilWritable);
 
 /**
-This function creates a tcpDataSenderTCPConnectionHandler to handle a particular TCP connection.
-@param inputConnectionSocket: The connection socket to forward the data over
+This function closes a client's connection and forgets it.
+@param inputFileDescriptor: The client's socket
 */
-Poco::Net::TCPServerConnection *createConnection(const Poco::Net::StreamSocket &inputConnectionSocket);
+void removeClient(int inputFileDescriptor);
 
-zmq::context_t &context;
-std::string sourceConnectionString;
+/**
+This function refreshes the snapshot returned by getClientStatistics.
+*/
+void updateClientStatistics();
+
+tcpDataSenderSlowClientPolicy slowClientPolicy;
+int listeningSocketFileDescriptor = -1;
+int epollFileDescriptor = -1;
+int shutdownEventFileDescriptor = -1;
+int subscriberSocketFileDescriptor = -1; //ZMQ_FD of subscriberSocket
+int spareFileDescriptor = -1; //Kept open (to /dev/null) so it can be closed to make room to refuse a connection when the process is out of descriptors
+std::unique_ptr<zmq::socket_t> subscriberSocket; //Only used by the sending thread after construction
+
+//Only used by the sending thread
+std::vector<std::shared_ptr<zmq::message_t> > backlog; //Message with index i is at i % TCP_DATA_SENDER_CLIENT_BACKLOG_SIZE
+uint64_t nextBacklogIndex = 0; //Index the next received message will get
+uint64_t nextMessageIndexToTrace = 0; //Messages before this have either had their traces completed or left the backlog
+std::unordered_map<int, tcpDataSenderClient> fileDescriptorToClient;
+Poco::Timestamp::TimeVal timeClientStatisticsWereLastUpdated = 0;
+bool listeningSocketIsWatched = true;
+Poco::Timestamp::TimeVal timeListeningSocketWasLastUnwatched = 0;
+
+std::mutex clientStatisticsMutex;
+std::vector<tcpDataSenderClientStatistics> clientStatistics; //Guarded by clientStatisticsMutex
+std::atomic<uint64_t> numberOfEvictedClients{0};
+std::atomic<uint64_t> numberOfRefusedClients{0};
+
+std::unique_ptr<std::thread> sendingThread;
 };
 
-
 }
@@ -0,0 +1,119 @@
+#include "timeSource.hpp"
+
+using namespace pylongps;
+
+/**
+This function allows subclasses to be deleted through base class pointers.
+*/
+timeSource::~timeSource()
+{
+}
+
+/**
+This function returns the current time.
+@return: The current time
+*/
+Poco::Timestamp systemTimeSource::now()
+{
+return Poco::Timestamp();
+}
+
+/**
+This function returns how long a reactor should wait for messages when its next event is the given number of milliseconds away.
+@param inputTimeUntilNextEvent: Milliseconds until the next event (-1 if there are no events)
+@return: inputTimeUntilNextEvent, since the wall clock keeps running while the reactor waits
+*/
+int64_t systemTimeSource::getPollTimeout(int64_t inputTimeUntilNextEvent)
+{
+return inputTimeUntilNextEvent;
+}
+
+/**
+This function does nothing, since the wall clock doesn't need to be advanced.
+@param inputNextEventTime: When the reactor's next event is due
+*/
+void systemTimeSource::reactorIsIdle(const Poco::Timestamp &/*inputNextEventTime*/)
+{
+}
+
+/**
+This function initializes the clock.
+@param inputStartTime: The time the clock starts at (microseconds since the epoch)
+@param inputAdvanceWhenIdle: True if the clock should be advanced to the next event of any reactor using it which is idle
+@param inputIdleWait: How many real milliseconds a reactor has to go without receiving messages before it is considered idle (it also sets how quickly reactors notice explicit advancement)
+*/
+virtualTimeSource::virtualTimeSource(Poco::Timestamp::TimeVal inputStartTime, bool inputAdvanceWhenIdle, int64_t inputIdleWait) : currentTime(inputStartTime), advanceWhenIdle(inputAdvanceWhenIdle), idleWait(inputIdleWait)
+{
+}
+
+/**
+This function returns the current (simulated) time.
+@return: The current time
+*/
+Poco::Timestamp virtualTimeSource::now()
+{
+return Poco::Timestamp(currentTime.load());
+}
+
+/**
+This function returns how long a reactor should wait for messages.  Since simulated time does not pass while the reactor waits, it only waits the idle period so that it can notice the clock being advanced.
+@param inputTimeUntilNextEvent: Simulated milliseconds until the next event (-1 if there are no events)
+@return: 0 if the event is due, otherwise the idle wait
+*/
+int64_t virtualTimeSource::getPollTimeout(int64_t inputTimeUntilNextEvent)
+{
+if(inputTimeUntilNextEvent == 0)
+{
+return 0;
+}
+
+return idleWait;
+}
+
+/**
+This function advances the clock to the reactor's next event if advancing when idle is enabled.
+@param inputNextEventTime: When the reactor's next event is due (negative if there are no events)
+*/
+void virtualTimeSource::reactorIsIdle(const Poco::Timestamp &inputNextEventTime)
+{
+if(!advanceWhenIdle || inputNextEventTime < 0)
+{
+return;
+}
+
+advanceTo(inputNextEventTime);
+}
+
+/**
+This function moves the clock forward by the given amount.
+@param inputTimeToAdvance: How far to advance the clock in microseconds
+*/
+void virtualTimeSource::advanceBy(Poco::Timestamp::TimeDiff inputTimeToAdvance)
+{
+if(inputTimeToAdvance > 0)
+{
+currentTime.fetch_add(inputTimeToAdvance);
+}
+}
+
+/**
+This function moves the clock forward to the given time (it never moves backward).
+@param inputTime: The time to advance to
+*/
+void virtualTimeSource::advanceTo(const Poco::Timestamp &inputTime)
+{
+Poco::Timestamp::TimeVal time = currentTime.load();
+while(time < inputTime.epochMicroseconds() && !currentTime.compare_exchange_weak(time, inputTime.epochMicroseconds()))
+{ //Retry if another thread moved the clock in the meantime
+}
+}
+
+/**
+This function returns the time source used when none is given.
+@return: A process wide systemTimeSource
+*/
+timeSource &pylongps::getSystemTimeSource()
+{
+static systemTimeSource *defaultTimeSource = new systemTimeSource;
+return *defaultTimeSource;
+}
@@ -0,0 +1,128 @@
+#ifndef TIMESOURCEHPP
+#define TIMESOURCEHPP
+
+#include<cstdint>
+#include<atomic>
+#include "Poco/Timestamp.h"
+
+namespace pylongps
+{
+
+const int64_t VIRTUAL_TIME_SOURCE_DEFAULT_IDLE_WAIT = 1; //Milliseconds a reactor using a virtual time source waits for messages before checking if the time has been advanced
+
+/**
+This class is the source of the current time for reactors and the classes that use them (such as the caster).  Everything that schedules or checks timeouts takes its time from one of these rather than Poco::Timestamp(), so tests can substitute a virtualTimeSource and run hours of timeout behaviour in seconds.
+*/
+class timeSource
+{
+public:
+/**
+This function allows subclasses to be deleted through base class pointers.
+*/
+virtual ~timeSource();
+
+/**
+This function returns the current time.
+@return: The current time
+*/
+virtual Poco::Timestamp now() = 0;
+
+/**
+This function returns how long a reactor should wait for messages when its next event is the given number of (this time source's) milliseconds away.
+@param inputTimeUntilNextEvent: Milliseconds until the next event (-1 if there are no events)
+@return: The number of real milliseconds to wait for messages (-1 to wait until one arrives)
+*/
+virtual int64_t getPollTimeout(int64_t inputTimeUntilNextEvent) = 0;
+
+/**
+This function is called by a reactor when it waited for messages without receiving any and its next event is not due yet.
+@param inputNextEventTime: When the reactor's next event is due (negative if there are no events)
+*/
+virtual void reactorIsIdle(const Poco::Timestamp &inputNextEventTime) = 0;
+};
+
+/**
+This class gives the current wall clock time.
+*/
+class systemTimeSource : public timeSource
+{
+public:
+/**
+This function returns the current time.
+@return: The current time
+*/
+virtual Poco::Timestamp now();
+
+/**
+This function returns how long a reactor should wait for messages when its next event is the given number of milliseconds away.
+@param inputTimeUntilNextEvent: Milliseconds until the next event (-1 if there are no events)
+@return: inputTimeUntilNextEvent, since the wall clock keeps running while the reactor waits
+*/
+virtual int64_t getPollTimeout(int64_t inputTimeUntilNextEvent);
+
+/**
+This function does nothing, since the wall clock doesn't need to be advanced.
+@param inputNextEventTime: When the reactor's next event is due
+*/
+virtual void reactorIsIdle(const Poco::Timestamp &inputNextEventTime);
+};
+
+/**
+This class is a simulated clock which only moves when it is advanced, either explicitly (advanceBy/advanceTo) or, if advancing when idle is enabled, to the time of a reactor's next event whenever that reactor has nothing else to do.  Explicit advancement is deterministic.  Advancing when idle lets days of scheduled events run back to back, but with several reactors sharing the clock one reactor can jump the time forward while a message for another is still in flight, so it is best suited to soak testing.  It is threadsafe.
+*/
+class virtualTimeSource : public timeSource
+{
+public:
+/**
+This function initializes the clock.
+@param inputStartTime: The time the clock starts at (microseconds since the epoch)
+@param inputAdvanceWhenIdle: True if the clock should be advanced to the next event of any reactor using it which is idle
+@param inputIdleWait: How many real milliseconds a reactor has to go without receiving messages before it is considered idle (it also sets how quickly reactors notice explicit advancement)
+*/
+virtualTimeSource(Poco::Timestamp::TimeVal inputStartTime = Poco::Timestamp().epochMicroseconds(), bool inputAdvanceWhenIdle = false, int64_t inputIdleWait = VIRTUAL_TIME_SOURCE_DEFAULT_IDLE_WAIT);
+
+/**
+This function returns the current (simulated) time.
+@return: The current time
+*/
+virtual Poco::Timestamp now();
+
+/**
+This function returns how long a reactor should wait for messages.  Since simulated time does not pass while the reactor waits, it only waits the idle period so that it can notice the clock being advanced.
+@param inputTimeUntilNextEvent: Simulated milliseconds until the next event (-1 if there are no events)
+@return: 0 if the event is due, otherwise the idle wait
+*/
+virtual int64_t getPollTimeout(int64_t inputTimeUntilNextEvent);
+
+/**
+This function advances the clock to the reactor's next event if advancing when idle is enabled.
+@param inputNextEventTime: When the reactor's next event is due (negative if there are no events)
+*/
+virtual void reactorIsIdle(const Poco::Timestamp &inputNextEventTime);
+
+/**
+This function moves the clock forward by the given amount.
+@param inputTimeToAdvance: How far to advance the clock in microseconds
+*/
+void advanceBy(Poco::Timestamp::TimeDiff inputTimeToAdvance);
+
+/**
+This function moves the clock forward to the given time (it never moves backward).
+@param inputTime: The time to advance to
+*/
+void advanceTo(const Poco::Timestamp &inputTime);
+
+private:
+std::atomic<Poco::Timestamp::TimeVal> currentTime;
+bool advanceWhenIdle;
+int64_t idleWait;
+};
+
+/**
+This function returns the time source used when none is given.
+@return: A process wide systemTimeSource
+*/
+timeSource &getSystemTimeSource();
+
+}
+#endif
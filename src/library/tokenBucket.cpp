@@ -0,0 +1,52 @@
+#include "tokenBucket.hpp"
+
+using namespace pylongps;
+
+/**
+This function initializes the bucket with a full set of tokens.
+@param inputTokensPerSecond: How many tokens are added each second (0 or less means there is no limit)
+@param inputMaximumNumberOfTokens: The most tokens the bucket can hold (how large of a burst is allowed)
+@param inputCurrentTime: The time to start adding tokens from (microseconds since the epoch)
+*/
+tokenBucket::tokenBucket(double inputTokensPerSecond, double inputMaximumNumberOfTokens, Poco::Timestamp::TimeVal inputCurrentTime)
+{
+tokensPerSecond = inputTokensPerSecond;
+maximumNumberOfTokens = std::max(inputMaximumNumberOfTokens, 1.0);
+availableTokens = maximumNumberOfTokens;
+timeTokensWereLastAdded = inputCurrentTime;
+}
+
+/**
+This function adds the tokens that have accumulated since the last call and then tries to take a token.
+@param inputCurrentTime: The current time (microseconds since the epoch)
+@return: true if a token was available (the event should be accepted)
+*/
+bool tokenBucket::takeToken(Poco::Timestamp::TimeVal inputCurrentTime)
+{
+if(tokensPerSecond <= 0.0)
+{ //No limit
+return true;
+}
+
+if(inputCurrentTime > timeTokensWereLastAdded)
+{
+availableTokens = std::min(maximumNumberOfTokens, availableTokens + ((inputCurrentTime - timeTokensWereLastAdded)/1000000.0)*tokensPerSecond);
+timeTokensWereLastAdded = inputCurrentTime;
+}
+
+if(availableTokens < 1.0)
+{
+return false;
+}
+
+availableTokens -= 1.0;
+return true;
+}
+
+/**
+This function gives back a token taken by takeToken, such as when the event was then rejected by another limit.
+*/
+void tokenBucket::returnToken()
+{
+availableTokens = std::min(maximumNumberOfTokens, availableTokens + 1.0);
+}
@@ -0,0 +1,43 @@
+#ifndef TOKENBUCKETHPP
+#define TOKENBUCKETHPP
+
+#include "Poco/Timestamp.h"
+#include<algorithm>
+
+namespace pylongps
+{
+
+/**
+This class implements a token bucket rate limiter.  Tokens are added at a fixed rate up to a maximum (the allowed burst) and each accepted event takes one token.
+*/
+class tokenBucket
+{
+public:
+/**
+This function initializes the bucket with a full set of tokens.
+@param inputTokensPerSecond: How many tokens are added each second (0 or less means there is no limit)
+@param inputMaximumNumberOfTokens: The most tokens the bucket can hold (how large of a burst is allowed)
+@param inputCurrentTime: The time to start adding tokens from (microseconds since the epoch)
+*/
+tokenBucket(double inputTokensPerSecond = 0.0, double inputMaximumNumberOfTokens = 0.0, Poco::Timestamp::TimeVal inputCurrentTime = 0);
+
+/**
+This function adds the tokens that have accumulated since the last call and then tries to take a token.
+@param inputCurrentTime: The current time (microseconds since the epoch)
+@return: true if a token was available (the event should be accepted)
+*/
+bool takeToken(Poco::Timestamp::TimeVal inputCurrentTime);
+
+/**
+This function gives back a token taken by takeToken, such as when the event was then rejected by another limit.
+*/
+void returnToken();
+
+double tokensPerSecond;
+double maximumNumberOfTokens;
+double availableTokens;
+Poco::Timestamp::TimeVal timeTokensWereLastAdded;
+};
+
+}
+#endif
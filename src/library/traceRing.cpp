@@ -0,0 +1,254 @@
+#include "traceRing.hpp"
+#include "streamFrameHeader.hpp"
+#include "utilityFunctions.hpp"
+#include "SOMException.hpp"
+#include "Poco/Timestamp.h"
+#include<vector>
+#include<memory>
+#include<mutex>
+#include<thread>
+#include<csignal>
+#include<cstdio>
+#include<unistd.h>
+#include<pthread.h>
+#include<sys/syscall.h>
+
+using namespace pylongps;
+
+/**
+This function returns the mutex guarding the list of trace rings.  It is never destroyed, so threads which are still running while the process exits can safely release their rings.
+@return: The mutex
+*/
+static std::mutex &getTraceRingsMutex()
+{
+static std::mutex *traceRingsMutex = new std::mutex;
+return *traceRingsMutex;
+}
+
+/**
+This function returns the list of every trace ring that has been created (the rings are reused rather than destroyed).
+@return: The list
+*/
+static std::vector<std::unique_ptr<traceRing> > &getTraceRings()
+{
+static std::vector<std::unique_ptr<traceRing> > *traceRings = new std::vector<std::unique_ptr<traceRing> >;
+return *traceRings;
+}
+
+/**
+This class gives each thread its trace ring the first time the thread records an event and releases it for reuse when the thread exits.
+*/
+class traceRingThreadHolder
+{
+public:
+/**
+This function takes an unused ring (or creates one if there are none).
+*/
+traceRingThreadHolder()
+{
+int64_t threadID = syscall(SYS_gettid);
+
+std::lock_guard<std::mutex> lock(getTraceRingsMutex());
+for(std::unique_ptr<traceRing> &ringPointer : getTraceRings())
+{
+if(!ringPointer->isInUse)
+{ //Reuse the ring of an exited thread
+ring = ringPointer.get();
+ring->numberOfRecordsWritten.store(0, std::memory_order_relaxed);
+break;
+}
+}
+
+if(ring == nullptr)
+{
+getTraceRings().emplace_back(new traceRing);
+ring = getTraceRings().back().get();
+}
+
+ring->isInUse = true;
+ring->threadID = threadID;
+ring->threadName = "thread " + std::to_string(threadID);
+}
+
+/**
+This function marks the ring as reusable (its records stay available for dumps until it is reused).
+*/
+~traceRingThreadHolder()
+{
+std::lock_guard<std::mutex> lock(getTraceRingsMutex());
+ring->isInUse = false;
+}
+
+traceRing *ring = nullptr;
+};
+
+static thread_local traceRingThreadHolder threadTraceRingHolder;
+
+/**
+This function initializes the ring as empty.
+*/
+traceRing::traceRing() : numberOfRecordsWritten(0), threadID(0), isInUse(false)
+{
+}
+
+/**
+This function adds a record to the ring, overwriting the oldest record if the ring is full.  Only the thread that owns the ring should call it.
+@param inputType: What happened
+@param inputFirstID: The first ID associated with the event (see trace_ring_event_type)
+@param inputSecondID: The second ID associated with the event
+*/
+void traceRing::addRecord(trace_ring_event_type inputType, int64_t inputFirstID, int64_t inputSecondID)
+{
+uint64_t recordIndex = numberOfRecordsWritten.load(std::memory_order_relaxed);
+
+//Keeps the overwrite of this slot from becoming visible before the count that tells readers the slot's old record is invalid
+std::atomic_thread_fence(std::memory_order_release);
+
+traceRingRecord &record = records[recordIndex & (TRACE_RING_SIZE - 1)];
+record.time.store(getMonotonicTime(), std::memory_order_relaxed);
+record.type.store(inputType, std::memory_order_relaxed);
+record.firstID.store(inputFirstID, std::memory_order_relaxed);
+record.secondID.store(inputSecondID, std::memory_order_relaxed);
+
+numberOfRecordsWritten.store(recordIndex + 1, std::memory_order_release);
+}
+
+/**
+This function copies the records currently in the ring to the given message, oldest first.  It can be called from any thread.
+@param inputThreadBuffer: The message to add the records to
+*/
+void traceRing::copyRecords(trace_ring_thread &inputThreadBuffer) const
+{
+uint64_t endIndex = numberOfRecordsWritten.load(std::memory_order_acquire);
+uint64_t startIndex = endIndex > TRACE_RING_SIZE ? endIndex - TRACE_RING_SIZE : 0;
+
+std::vector<std::array<int64_t, 4> > copiedRecords;
+copiedRecords.reserve(endIndex - startIndex);
+for(uint64_t i = startIndex; i < endIndex; i++)
+{
+const traceRingRecord &record = records[i & (TRACE_RING_SIZE - 1)];
+copiedRecords.push_back({{record.time.load(std::memory_order_relaxed), record.type.load(std::memory_order_relaxed), record.firstID.load(std::memory_order_relaxed), record.secondID.load(std::memory_order_relaxed)}});
+}
+
+//Anything the writer could have started overwriting while the records were being copied is dropped (including the slot it may be in the middle of)
+std::atomic_thread_fence(std::memory_order_acquire);
+uint64_t endIndexAfterCopy = numberOfRecordsWritten.load(std::memory_order_relaxed);
+uint64_t firstValidIndex = (endIndexAfterCopy + 1) > TRACE_RING_SIZE ? endIndexAfterCopy + 1 - TRACE_RING_SIZE : 0;
+
+inputThreadBuffer.set_number_of_overwritten_records(std::max(startIndex, firstValidIndex));
+for(uint64_t i = std::max(startIndex, firstValidIndex); i < endIndex; i++)
+{
+const std::array<int64_t, 4> &copiedRecord = copiedRecords[i - startIndex];
+if(!trace_ring_event_type_IsValid(copiedRecord[1]))
+{
+continue;
+}
+
+trace_ring_record *record = inputThreadBuffer.add_records();
+record->set_time(copiedRecord[0]);
+record->set_type((trace_ring_event_type) copiedRecord[1]);
+record->set_first_id(copiedRecord[2]);
+record->set_second_id(copiedRecord[3]);
+}
+}
+
+/**
+This function adds a record to the calling thread's trace ring (creating the ring the first time the thread calls it).  It is meant to be cheap enough to leave in the hot paths permanently.
+@param inputType: What happened
+@param inputFirstID: The first ID associated with the event (see trace_ring_event_type)
+@param inputSecondID: The second ID associated with the event
+*/
+void pylongps::recordTraceEvent(trace_ring_event_type inputType, int64_t inputFirstID, int64_t inputSecondID)
+{
+threadTraceRingHolder.ring->addRecord(inputType, inputFirstID, inputSecondID);
+}
+
+/**
+This function sets the name the calling thread's trace ring is given in dumps.
+@param inputThreadName: The name to use
+*/
+void pylongps::setTraceThreadName(const std::string &inputThreadName)
+{
+traceRing *ring = threadTraceRingHolder.ring;
+
+std::lock_guard<std::mutex> lock(getTraceRingsMutex());
+ring->threadName = inputThreadName;
+}
+
+/**
+This function copies the contents of all of the trace rings in the process, including those of threads which have exited but whose rings have not been reused yet.
+@return: The dump
+*/
+trace_ring_dump pylongps::dumpTraceRings()
+{
+trace_ring_dump dump;
+dump.set_process_id(getpid());
+dump.set_dump_monotonic_time(getMonotonicTime());
+dump.set_dump_epoch_time(Poco::Timestamp().epochMicroseconds());
+
+std::lock_guard<std::mutex> lock(getTraceRingsMutex());
+for(const std::unique_ptr<traceRing> &ring : getTraceRings())
+{
+trace_ring_thread *thread = dump.add_threads();
+thread->set_thread_name(ring->threadName);
+thread->set_thread_id(ring->threadID);
+thread->set_thread_has_exited(!ring->isInUse);
+ring->copyRecords(*thread);
+}
+
+return dump;
+}
+
+/**
+This function dumps the trace rings to the given file (readable with the traceDecoder tool).
+@param inputPath: The path of the file to write
+@return: true if the file was written
+*/
+bool pylongps::saveTraceRingDump(const std::string &inputPath)
+{
+trace_ring_dump dump = dumpTraceRings();
+
+return saveProtobufObjectToFile(inputPath, dump);
+}
+
+/**
+This function blocks SIGUSR1 and starts a thread which dumps the trace rings to a new file in the given directory each time the process receives SIGUSR1.  Since threads inherit the signal mask of the thread that creates them, it must be called before any other threads are started (such as in main before creating a caster).
+@param inputDirectory: The directory to write the dumps to (they are named pylonGPSTrace-processID-epochMicroseconds.trace)
+
+@throws: This function can throw exceptions
+*/
+void pylongps::startTraceRingDumpOnSignal(const std::string &inputDirectory)
+{
+sigset_t dumpSignalSet;
+sigemptyset(&dumpSignalSet);
+sigaddset(&dumpSignalSet, SIGUSR1);
+
+if(pthread_sigmask(SIG_BLOCK, &dumpSignalSet, nullptr) != 0)
+{
+throw SOMException("Unable to block SIGUSR1\n", SYSTEM_ERROR, __FILE__, __LINE__);
+}
+
+SOM_TRY //The signal is only ever delivered to this thread, so the dump isn't limited to what is safe in a signal handler
+std::thread([inputDirectory, dumpSignalSet]()
+{
+while(true)
+{
+int receivedSignal = 0;
+if(sigwait(&dumpSignalSet, &receivedSignal) != 0)
+{
+continue;
+}
+
+std::string dumpPath = inputDirectory + "/pylonGPSTrace-" + std::to_string(getpid()) + "-" + std::to_string(Poco::Timestamp().epochMicroseconds()) + ".trace";
+if(saveTraceRingDump(dumpPath))
+{
+fprintf(stderr, "Trace rings dumped to %s\n", dumpPath.c_str());
+}
+else
+{
+fprintf(stderr, "Unable to dump trace rings to %s\n", dumpPath.c_str());
+}
+}
+}).detach();
+SOM_CATCH("Error starting trace dump thread\n")
+}
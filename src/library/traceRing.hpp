@@ -0,0 +1,96 @@
+#ifndef TRACERINGHPP
+#define TRACERINGHPP
+
+#include<cstdint>
+#include<string>
+#include<array>
+#include<atomic>
+#include "common_enums.pb.h"
+#include "trace_ring_dump.pb.h"
+
+namespace pylongps
+{
+
+const uint64_t TRACE_RING_SIZE = 4096; //Records kept per thread (must be a power of 2), so each ring takes 128 KB
+
+/**
+This class holds one trace record.  The fields are atomic so that a dump can read a ring while its thread is writing to it, but they are only ever accessed with relaxed operations (plain loads/stores on x86).
+*/
+class traceRingRecord
+{
+public:
+std::atomic<int64_t> time; //See getMonotonicTime
+std::atomic<int64_t> type; //trace_ring_event_type
+std::atomic<int64_t> firstID;
+std::atomic<int64_t> secondID;
+};
+
+/**
+This class holds the most recent TRACE_RING_SIZE trace records of one thread.  Only the owning thread adds records, so adding one is a clock read and a few stores with no locking.  Dumps can copy the ring from any other thread without stopping the writer (records that might be being overwritten during the copy are left out).
+*/
+class traceRing
+{
+public:
+/**
+This function initializes the ring as empty.
+*/
+traceRing();
+
+/**
+This function adds a record to the ring, overwriting the oldest record if the ring is full.  Only the thread that owns the ring should call it.
+@param inputType: What happened
+@param inputFirstID: The first ID associated with the event (see trace_ring_event_type)
+@param inputSecondID: The second ID associated with the event
+*/
+void addRecord(trace_ring_event_type inputType, int64_t inputFirstID, int64_t inputSecondID);
+
+/**
+This function copies the records currently in the ring to the given message, oldest first.  It can be called from any thread.
+@param inputThreadBuffer: The message to add the records to
+*/
+void copyRecords(trace_ring_thread &inputThreadBuffer) const;
+
+std::array<traceRingRecord, TRACE_RING_SIZE> records;
+std::atomic<uint64_t> numberOfRecordsWritten;
+std::string threadName; //Guarded by the ring list mutex
+int64_t threadID; //Guarded by the ring list mutex
+bool isInUse; //Guarded by the ring list mutex, false once the owning thread has exited (the ring is kept for dumps until another thread reuses it)
+};
+
+/**
+This function adds a record to the calling thread's trace ring (creating the ring the first time the thread calls it).  It is meant to be cheap enough to leave in the hot paths permanently.
+@param inputType: What happened
+@param inputFirstID: The first ID associated with the event (see trace_ring_event_type)
+@param inputSecondID: The second ID associated with the event
+*/
+void recordTraceEvent(trace_ring_event_type inputType, int64_t inputFirstID = 0, int64_t inputSecondID = 0);
+
+/**
+This function sets the name the calling thread's trace ring is given in dumps.
+@param inputThreadName: The name to use
+*/
+void setTraceThreadName(const std::string &inputThreadName);
+
+/**
+This function copies the contents of all of the trace rings in the process, including those of threads which have exited but whose rings have not been reused yet.
+@return: The dump
+*/
+trace_ring_dump dumpTraceRings();
+
+/**
+This function dumps the trace rings to the given file (readable with the traceDecoder tool).
+@param inputPath: The path of the file to write
+@return: true if the file was written
+*/
+bool saveTraceRingDump(const std::string &inputPath);
+
+/**
+This function blocks SIGUSR1 and starts a thread which dumps the trace rings to a new file in the given directory each time the process receives SIGUSR1.  Since threads inherit the signal mask of the thread that creates them, it must be called before any other threads are started (such as in main before creating a caster).
+@param inputDirectory: The directory to write the dumps to (they are named pylonGPSTrace-processID-epochMicroseconds.trace)
+
+@throws: This function can throw exceptions
+*/
+void startTraceRingDumpOnSignal(const std::string &inputDirectory);
+
+}
+#endif
@@ -57,7 +57,7 @@ continue;
 
 std::string connectionString;
 SOM_TRY
-connectionString = createPylonGPSV2DataReceiver(casterIPAddress + ":" + std::to_string(DEFAULT_CASTER_CLIENT_STREAM_PORT_NUMBER),dataReceiverConfiguration.caster_id(), dataReceiverConfiguration.stream_id());
+connectionString = createPylonGPSV2DataReceiver(casterIPAddress + ":" + std::to_string(DEFAULT_CASTER_CLIENT_STREAM_PORT_NUMBER),dataReceiverConfiguration.caster_id(), dataReceiverConfiguration.stream_id(), dataReceiverConfiguration.basestation_details().has_stream_frame_headers());
 SOM_CATCH("Error, unable to create basestation data receiver\n")
 
 receiverIDToConnectionString[dataReceiverConfiguration.receiver_id()] = connectionString;
@@ -135,13 +135,13 @@ const std::string casterConnectionString = casterIPAddress + ":" + std::to_strin
 if(dataSenderConfiguration.has_registration_credentials())
 {
 SOM_TRY
-createPylonGPSV2DataSender(receiverConnectionString, dataSenderConfiguration.secret_key(), dataSenderConfiguration.registration_credentials(), casterConnectionString, dataSenderConfiguration.latitude(), dataSenderConfiguration.longitude(), dataSenderConfiguration.message_format(), dataSenderConfiguration.informal_basestation_name(), dataSenderConfiguration.expected_update_rate());
+createPylonGPSV2DataSender(receiverConnectionString, dataSenderConfiguration.secret_key(), dataSenderConfiguration.registration_credentials(), casterConnectionString, dataSenderConfiguration.latitude(), dataSenderConfiguration.longitude(), dataSenderConfiguration.message_format(), dataSenderConfiguration.informal_basestation_name(), dataSenderConfiguration.expected_update_rate(), dataSenderConfiguration.trace_sampling_interval());
 SOM_CATCH("Error creating basestation sender\n")
 }
 else
 {
 SOM_TRY
-createPylonGPSV2DataSender(receiverConnectionString, casterConnectionString, dataSenderConfiguration.latitude(), dataSenderConfiguration.longitude(), dataSenderConfiguration.message_format(), dataSenderConfiguration.informal_basestation_name(), dataSenderConfiguration.expected_update_rate());
+createPylonGPSV2DataSender(receiverConnectionString, casterConnectionString, dataSenderConfiguration.latitude(), dataSenderConfiguration.longitude(), dataSenderConfiguration.message_format(), dataSenderConfiguration.informal_basestation_name(), dataSenderConfiguration.expected_update_rate(), dataSenderConfiguration.trace_sampling_interval());
 SOM_CATCH("Error creating basestation sender\n")
 }
 }
@@ -197,20 +197,34 @@ SOM_CATCH("Error, unable to create ZMQ data sender\n")
 }
 
 /**
-This function creates a zmqDataReceiver which can listen to a data stream from a Pylon GPS 2.0 caster.
+This function creates a zmqDataReceiver which can listen to a data stream from a Pylon GPS 2.0 caster.  Receivers of streams from the same caster share one subscriber connection.
 @param inputIPAddressAndPort: A string with the IP address/port in format "IPAddress:portNumber"
 @param inputCasterID: The ID of the caster to listen to (host format)
 @param inputStreamID: The stream ID associated with the stream to listen to (host format)
+@param inputCasterAddsStreamFrameHeaders: True if the caster publishes its messages with stream frame headers (the has_stream_frame_headers field of the stream's information)
 @return: The ZMQ connection string to use to connect to this information stream (used with createXXXXDataSender functions).
 
 @throws: This function can throw exceptions
 */
-std::string transceiver::createPylonGPSV2DataReceiver(const std::string &inputIPAddressAndPort, int64_t inputCasterID, int64_t inputStreamID)
+std::string transceiver::createPylonGPSV2DataReceiver(const std::string &inputIPAddressAndPort, int64_t inputCasterID, int64_t inputStreamID, bool inputCasterAddsStreamFrameHeaders)
 {
+//Reuse the connection to the caster if another receiver already has one
+std::pair<std::string, bool> subscriberKey(inputIPAddressAndPort, inputCasterAddsStreamFrameHeaders);
+std::shared_ptr<zmqCasterSubscriber> casterSubscriber = casterAddressAndFrameHeaderOptionToCasterSubscriber[subscriberKey].lock();
+
+if(casterSubscriber.get() == nullptr)
+{
+SOM_TRY
+casterSubscriber.reset(new zmqCasterSubscriber(inputIPAddressAndPort, context, inputCasterAddsStreamFrameHeaders, &receivedMessageTracer));
+SOM_CATCH("Error, unable to initialize zmqCasterSubscriber\n")
+
+casterAddressAndFrameHeaderOptionToCasterSubscriber[subscriberKey] = casterSubscriber;
+}
+
 std::unique_ptr<dataReceiver> receiver;
 
 SOM_TRY
-receiver.reset((dataReceiver *) new zmqDataReceiver(inputIPAddressAndPort, inputCasterID, inputStreamID, context));
+receiver.reset((dataReceiver *) new zmqDataReceiver(casterSubscriber, inputCasterID, inputStreamID, context));
 SOM_CATCH("Error, unable to initialize zmqDataReceiver\n")
 
 std::string address = receiver->address();
@@ -245,16 +259,19 @@ return address;
 /**
 This function creates a fileDataReceiver to retrieve data from the given file descriptor.  It takes ownership of the file descriptor and will close it when the receiver is destroyed.
 @param inputFilePointer: A file stream pointer to retrieve data from
+@param inputBufferSize: The largest number of bytes to read/publish at a time
+@param inputFramingMode: How to split the data into messages
+@param inputMemoryMapRegularFiles: True if data should be published straight from a memory mapping of the file when it is a regular file with at least inputBufferSize bytes waiting (the file must not be truncated while the receiver is using it)
 @return: The ZMQ connection string to use to connect to this information stream (used with createXXXXDataSender functions).
 
 @throws: This function can throw exceptions
 */
-std::string transceiver::createFileDataReceiver(FILE *inputFilePointer)
+std::string transceiver::createFileDataReceiver(FILE *inputFilePointer, uint64_t inputBufferSize, fileDataReceiverFramingMode inputFramingMode, bool inputMemoryMapRegularFiles)
 {
 std::unique_ptr<fileDataReceiver> receiver;
 
 SOM_TRY
-receiver.reset(new fileDataReceiver(inputFilePointer, context));
+receiver.reset(new fileDataReceiver(inputFilePointer, context, inputBufferSize, inputFramingMode, inputMemoryMapRegularFiles));
 SOM_CATCH("Error, unable to initialize fileDataReceiver\n")
 
 std::string address = receiver->address();
@@ -267,16 +284,19 @@ return address;
 /**
 This function creates a fileDataReceiver to retrieve data from the given file descriptor.
 @param inputFilePath: The path to the file to retrieve data from
+@param inputBufferSize: The largest number of bytes to read/publish at a time
+@param inputFramingMode: How to split the data into messages
+@param inputMemoryMapRegularFiles: True if data should be published straight from a memory mapping of the file when it is a regular file with at least inputBufferSize bytes waiting (the file must not be truncated while the receiver is using it)
 @return: The ZMQ connection string to use to connect to this information stream (used with createXXXXDataSender functions).
 
 @throws: This function can throw exceptions
 */
-std::string transceiver::createFileDataReceiver(const std::string &inputFilePath)
+std::string transceiver::createFileDataReceiver(const std::string &inputFilePath, uint64_t inputBufferSize, fileDataReceiverFramingMode inputFramingMode, bool inputMemoryMapRegularFiles)
 {
 std::unique_ptr<fileDataReceiver> receiver;
 
 SOM_TRY
-receiver.reset(new fileDataReceiver(inputFilePath, context));
+receiver.reset(new fileDataReceiver(inputFilePath, context, inputBufferSize, inputFramingMode, inputMemoryMapRegularFiles));
 SOM_CATCH("Error, unable to initialize fileDataReceiver\n")
 
 std::string address = receiver->address();
@@ -286,6 +306,30 @@ dataReceiverConnectionStringToDataReceiver.emplace(address, std::move(receiver))
 return address;
 }
 
+/**
+This function creates a recordingDataReceiver to replay the given stream recording.
+@param inputFilePath: The path to the recording
+@param inputPlaybackSpeed: How many times faster than recorded to replay the messages (0 or less to replay them as fast as possible)
+@param inputStartTime: Replay starts with the first record received at or after this time (microseconds since the epoch)
+@return: The ZMQ connection string to use to connect to this information stream (used with createXXXXDataSender functions).
+
+@throws: This function can throw exceptions
+*/
+std::string transceiver::createRecordingDataReceiver(const std::string &inputFilePath, double inputPlaybackSpeed, int64_t inputStartTime)
+{
+std::unique_ptr<recordingDataReceiver> receiver;
+
+SOM_TRY
+receiver.reset(new recordingDataReceiver(inputFilePath, context, inputPlaybackSpeed, inputStartTime));
+SOM_CATCH("Error, unable to initialize recordingDataReceiver\n")
+
+std::string address = receiver->address();
+
+dataReceiverConnectionStringToDataReceiver.emplace(address, std::move(receiver));
+
+return address;
+}
+
 /**
 This function creates a tcpDataReceiver to retrieve data from the given raw TCP server (establishes connection and then expects a data stream).
 @param inputIPAddressAndPort: A string with the IP address/port in format "IPAddress:portNumber"
@@ -322,7 +366,7 @@ std::string transceiver::createTCPDataSender(const std::string &inputSourceConne
 std::unique_ptr<dataSender> sender;
 
 SOM_TRY
-sender.reset((dataSender *) new tcpDataSender(inputSourceConnectionString, context, inputPortNumberToPublishOn));
+sender.reset((dataSender *) new tcpDataSender(inputSourceConnectionString, context, inputPortNumberToPublishOn, &receivedMessageTracer));
 SOM_CATCH("Error, unable to initialize tcpDataSender\n")
 
 return addDataSender(inputSourceConnectionString, sender);
@@ -341,7 +385,7 @@ std::string transceiver::createZMQDataSender(const std::string &inputSourceConne
 std::unique_ptr<dataSender> sender;
 
 SOM_TRY
-sender.reset((dataSender *) new zmqDataSender(inputSourceConnectionString, context, inputPortNumberToPublishOn));
+sender.reset((dataSender *) new zmqDataSender(inputSourceConnectionString, context, inputPortNumberToPublishOn, getDirectDataSinks(inputSourceConnectionString)));
 SOM_CATCH("Error, unable to initialize tcpDataSender\n")
 
 return addDataSender(inputSourceConnectionString, sender);
@@ -357,16 +401,17 @@ This function initializes a casterDataSender to establish a connection and regis
 @param inputMessageFormat: The message format used with the updates
 @param inputInformalName: The name that should be displayed when the basestation appears in a list
 @param inputExpectedUpdateRate: Expected updates per second 
+@param inputTraceSamplingInterval: If not 0, one of every this many messages is sampled for latency tracing (the caster needs stream frame headers enabled to carry the trace further)
 @return: The data sender ID to use for operations on the data sender
 
 @throws: This function can throw exceptions
 */
-std::string transceiver::createPylonGPSV2DataSender(const std::string &inputSourceConnectionString, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate)
+std::string transceiver::createPylonGPSV2DataSender(const std::string &inputSourceConnectionString, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate, uint32_t inputTraceSamplingInterval)
 {
 std::unique_ptr<dataSender> sender;
 
 SOM_TRY
-sender.reset((dataSender *) new casterDataSender(inputSourceConnectionString, context, inputCasterRegistrationIPAddressAndPort, inputLatitude, inputLongitude, inputMessageFormat, inputInformalName, inputExpectedUpdateRate));
+sender.reset((dataSender *) new casterDataSender(inputSourceConnectionString, context, inputCasterRegistrationIPAddressAndPort, inputLatitude, inputLongitude, inputMessageFormat, inputInformalName, inputExpectedUpdateRate, inputTraceSamplingInterval));
 SOM_CATCH("Error, unable to initialize casterDataSender\n")
 
 return addDataSender(inputSourceConnectionString, sender);
@@ -383,16 +428,17 @@ This function initializes a casterDataSender to establish a connection and regis
 @param inputMessageFormat: The message format used with the updates
 @param inputInformalName: The name that should be displayed when the basestation appears in a list
 @param inputExpectedUpdateRate: Expected updates per second 
+@param inputTraceSamplingInterval: If not 0, one of every this many messages is sampled for latency tracing (the caster needs stream frame headers enabled to carry the trace further)
 @return: The data sender ID to use for operations on the data sender
 
 @throws: This function can throw exceptions
 */
-std::string transceiver::createPylonGPSV2DataSender(const std::string &inputSourceConnectionString, const std::string &inputSecretSigningKey, const credentials &inputCredentials, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate)
+std::string transceiver::createPylonGPSV2DataSender(const std::string &inputSourceConnectionString, const std::string &inputSecretSigningKey, const credentials &inputCredentials, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate, uint32_t inputTraceSamplingInterval)
 {
 std::unique_ptr<dataSender> sender;
 
 SOM_TRY
-sender.reset((dataSender *) new casterDataSender(inputSourceConnectionString, context, inputSecretSigningKey, inputCredentials, inputCasterRegistrationIPAddressAndPort, inputLatitude, inputLongitude, inputMessageFormat, inputInformalName, inputExpectedUpdateRate));
+sender.reset((dataSender *) new casterDataSender(inputSourceConnectionString, context, inputSecretSigningKey, inputCredentials, inputCasterRegistrationIPAddressAndPort, inputLatitude, inputLongitude, inputMessageFormat, inputInformalName, inputExpectedUpdateRate, true, inputTraceSamplingInterval));
 SOM_CATCH("Error, unable to initialize casterDataSender\n")
 
 return addDataSender(inputSourceConnectionString, sender);
@@ -402,16 +448,17 @@ return addDataSender(inputSourceConnectionString, sender);
 This function initializes a fileDataSender to send data to the given file.  The object takes ownership of the file and closes the pointer on destruction.
 @param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
 @param inputFilePointer: A file stream pointer to retrieve data from
+@param inputWritePolicy: How the data is written to the file
 @return: The data sender ID to use for operations on the data sender
 
 @throws: This function can throw exceptions
 */
-std::string transceiver::createFileDataSender(const std::string &inputSourceConnectionString, FILE *inputFilePointer)
+std::string transceiver::createFileDataSender(const std::string &inputSourceConnectionString, FILE *inputFilePointer, const batchedFileWriterPolicy &inputWritePolicy)
 {
 std::unique_ptr<dataSender> sender;
 
 SOM_TRY
-sender.reset((dataSender *) new fileDataSender(inputSourceConnectionString, context, inputFilePointer));
+sender.reset((dataSender *) new fileDataSender(inputSourceConnectionString, context, inputFilePointer, &receivedMessageTracer, getDirectDataSinks(inputSourceConnectionString), inputWritePolicy));
 SOM_CATCH("Error, unable to initialize fileDataSender\n")
 
 return addDataSender(inputSourceConnectionString, sender);
@@ -421,21 +468,52 @@ return addDataSender(inputSourceConnectionString, sender);
 This function initializes a fileDataSender to send data to the given file.  
 @param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
 @param inputFilePath: The path to the file to send data to
+@param inputWritePolicy: How the data is written to the file
 @return: The data sender ID to use for operations on the data sender
 
 @throws: This function can throw exceptions
 */
-std::string transceiver::createFileDataSender(const std::string &inputSourceConnectionString, const std::string &inputFilePath)
+std::string transceiver::createFileDataSender(const std::string &inputSourceConnectionString, const std::string &inputFilePath, const batchedFileWriterPolicy &inputWritePolicy)
 {
 std::unique_ptr<dataSender> sender;
 
 SOM_TRY
-sender.reset((dataSender *) new fileDataSender(inputSourceConnectionString, context, inputFilePath));
+sender.reset((dataSender *) new fileDataSender(inputSourceConnectionString, context, inputFilePath, &receivedMessageTracer, getDirectDataSinks(inputSourceConnectionString), inputWritePolicy));
 SOM_CATCH("Error, unable to initialize fileDataSender\n")
 
 return addDataSender(inputSourceConnectionString, sender);
 }
 
+/**
+This function initializes a recordingDataSender to record data to the given file in the stream recording format.
+@param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
+@param inputFilePath: The path of the file to record to
+@param inputStreamID: The stream ID to record the messages with
+@param inputWritePolicy: How the data is written to the file
+@return: The data sender ID to use for operations on the data sender
+
+@throws: This function can throw exceptions
+*/
+std::string transceiver::createRecordingDataSender(const std::string &inputSourceConnectionString, const std::string &inputFilePath, int64_t inputStreamID, const batchedFileWriterPolicy &inputWritePolicy)
+{
+std::unique_ptr<dataSender> sender;
+
+SOM_TRY
+sender.reset((dataSender *) new recordingDataSender(inputSourceConnectionString, context, inputFilePath, inputStreamID, inputWritePolicy));
+SOM_CATCH("Error, unable to initialize recordingDataSender\n")
+
+return addDataSender(inputSourceConnectionString, sender);
+}
+
+/**
+This function returns the latency histograms of the traced caster stream messages that have been written out by this transceiver's tcp/file data senders.  Traces only include hops on machines other than this one if their clocks are the same monotonic clock (such as local casters).
+@return: The histograms
+*/
+latency_trace_report transceiver::getLatencyTraceReport()
+{
+return receivedMessageTracer.getReport();
+}
+
 /**
 This function shuts down and removes the data receiver associated with the given connection string.  It also shuts down and removes all data senders in the transceiver that are listening to that data receiver.
 @param inputDataReceiverConnectionString: The connection string associated with the data receiver
@@ -542,3 +620,24 @@ dataReceiverConnectionStringToListeningDataSenderIDs.at(inputSourceConnectionStr
 
 return URI;
 }
+
+/**
+This function returns the direct data sinks of the receiver in this transceiver publishing at the given connection string, if senders are to be fused with it.
+@param inputSourceConnectionString: The connection string that the sender is to get data from
+@return: The sinks or nullptr if the sender should subscribe to the connection string instead
+*/
+directDataSinkList *transceiver::getDirectDataSinks(const std::string &inputSourceConnectionString)
+{
+if(!fuseReceiversAndSenders)
+{
+return nullptr;
+}
+
+auto receiverIter = dataReceiverConnectionStringToDataReceiver.find(inputSourceConnectionString);
+if(receiverIter == dataReceiverConnectionStringToDataReceiver.end())
+{ //Not one of ours, so subscribe to it
+return nullptr;
+}
+
+return receiverIter->second->directDataSinks();
+}
@@ -7,10 +7,14 @@
 #include "casterDataSender.hpp"
 #include "fileDataReceiver.hpp"
 #include "fileDataSender.hpp"
+#include "recordingDataReceiver.hpp"
+#include "recordingDataSender.hpp"
 #include "tcpDataReceiver.hpp"
 #include "tcpDataSender.hpp"
 #include "zmqDataReceiver.hpp"
+#include "zmqCasterSubscriber.hpp"
 #include "zmqDataSender.hpp"
+#include "latencyTracer.hpp"
 #include "client_query_request.pb.h"
 #include "client_query_reply.pb.h"
 #include "transceiver_configuration.pb.h"
@@ -46,15 +50,16 @@ This function loads a configuration and attempts to set this transceiver's recei
 void load(const transceiver_configuration &inputConfiguration);
 
 /**
-This function creates a zmqDataReceiver which can listen to a data stream from a Pylon GPS 2.0 caster.
+This function creates a zmqDataReceiver which can listen to a data stream from a Pylon GPS 2.0 caster.  Receivers of streams from the same caster share one subscriber connection.
 @param inputIPAddressAndPort: A string with the IP address/port in format "IPAddress:portNumber"
 @param inputCasterID: The ID of the caster to listen to (host format)
 @param inputStreamID: The stream ID associated with the stream to listen to (host format)
+@param inputCasterAddsStreamFrameHeaders: True if the caster publishes its messages with stream frame headers (the has_stream_frame_headers field of the stream's information)
 @return: The ZMQ connection string to use to connect to this information stream (used with createXXXXDataSender functions).
 
 @throws: This function can throw exceptions
 */
-std::string createPylonGPSV2DataReceiver(const std::string &inputIPAddressAndPort, int64_t inputCasterID, int64_t inputStreamID);
+std::string createPylonGPSV2DataReceiver(const std::string &inputIPAddressAndPort, int64_t inputCasterID, int64_t inputStreamID, bool inputCasterAddsStreamFrameHeaders = false);
 
 /**
 This function creates a zmqDataReceiver which can listen to a data stream published from a raw ZMQ PUB socket (just publishing the data).
@@ -68,20 +73,37 @@ std::string createZMQPubDataReceiver(const std::string &inputIPAddressAndPort);
 /**
 This function creates a fileDataReceiver to retrieve data from the given file descriptor.  It takes ownership of the file descriptor and will close it when the receiver is destroyed.
 @param inputFilePointer: A file stream pointer to retrieve data from
+@param inputBufferSize: The largest number of bytes to read/publish at a time
+@param inputFramingMode: How to split the data into messages
+@param inputMemoryMapRegularFiles: True if data should be published straight from a memory mapping of the file when it is a regular file with at least inputBufferSize bytes waiting (the file must not be truncated while the receiver is using it)
 @return: The ZMQ connection string to use to connect to this information stream (used with createXXXXDataSender functions).
 
 @throws: This function can throw exceptions
 */
-std::string createFileDataReceiver(FILE *inputFilePointer);
+std::string createFileDataReceiver(FILE *inputFilePointer, uint64_t inputBufferSize = FILE_DATA_RECEIVER_DATA_BUFFER_SIZE, fileDataReceiverFramingMode inputFramingMode = FILE_DATA_RECEIVER_NO_FRAMING, bool inputMemoryMapRegularFiles = false);
 
 /**
 This function creates a fileDataReceiver to retrieve data from the given file descriptor.
 @param inputFilePath: The path to the file to retrieve data from
+@param inputBufferSize: The largest number of bytes to read/publish at a time
+@param inputFramingMode: How to split the data into messages
+@param inputMemoryMapRegularFiles: True if data should be published straight from a memory mapping of the file when it is a regular file with at least inputBufferSize bytes waiting (the file must not be truncated while the receiver is using it)
 @return: The ZMQ connection string to use to connect to this information stream (used with createXXXXDataSender functions).
 
 @throws: This function can throw exceptions
 */
-std::string createFileDataReceiver(const std::string &inputFilePath);
+std::string createFileDataReceiver(const std::string &inputFilePath, uint64_t inputBufferSize = FILE_DATA_RECEIVER_DATA_BUFFER_SIZE, fileDataReceiverFramingMode inputFramingMode = FILE_DATA_RECEIVER_NO_FRAMING, bool inputMemoryMapRegularFiles = false);
+
+/**
+This function creates a recordingDataReceiver to replay the given stream recording.
+@param inputFilePath: The path to the recording
+@param inputPlaybackSpeed: How many times faster than recorded to replay the messages (0 or less to replay them as fast as possible)
+@param inputStartTime: Replay starts with the first record received at or after this time (microseconds since the epoch)
+@return: The ZMQ connection string to use to connect to this information stream (used with createXXXXDataSender functions).
+
+@throws: This function can throw exceptions
+*/
+std::string createRecordingDataReceiver(const std::string &inputFilePath, double inputPlaybackSpeed = 1.0, int64_t inputStartTime = 0);
 
 /**
 This function creates a tcpDataReceiver to retrieve data from the given raw TCP server (establishes connection and then expects a data stream).
@@ -121,11 +143,12 @@ This function initializes a casterDataSender to establish a connection and regis
 @param inputMessageFormat: The message format used with the updates
 @param inputInformalName: The name that should be displayed when the basestation appears in a list
 @param inputExpectedUpdateRate: Expected updates per second 
+@param inputTraceSamplingInterval: If not 0, one of every this many messages is sampled for latency tracing (the caster needs stream frame headers enabled to carry the trace further)
 @return: The data sender ID to use for operations on the data sender
 
 @throws: This function can throw exceptions
 */
-std::string createPylonGPSV2DataSender(const std::string &inputSourceConnectionString, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate = 0.0);
+std::string createPylonGPSV2DataSender(const std::string &inputSourceConnectionString, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate = 0.0, uint32_t inputTraceSamplingInterval = 0);
 
 /**
 This function initializes a casterDataSender to establish a connection and register an authenticated basestation with it.
@@ -138,31 +161,46 @@ This function initializes a casterDataSender to establish a connection and regis
 @param inputMessageFormat: The message format used with the updates
 @param inputInformalName: The name that should be displayed when the basestation appears in a list
 @param inputExpectedUpdateRate: Expected updates per second 
+@param inputTraceSamplingInterval: If not 0, one of every this many messages is sampled for latency tracing (the caster needs stream frame headers enabled to carry the trace further)
 @return: The data sender ID to use for operations on the data sender
 
 @throws: This function can throw exceptions
 */
-std::string createPylonGPSV2DataSender(const std::string &inputSourceConnectionString, const std::string &inputSecretSigningKey, const credentials &inputCredentials, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate = 0.0);
+std::string createPylonGPSV2DataSender(const std::string &inputSourceConnectionString, const std::string &inputSecretSigningKey, const credentials &inputCredentials, const std::string &inputCasterRegistrationIPAddressAndPort, double inputLatitude, double inputLongitude, corrections_message_format inputMessageFormat, const std::string &inputInformalName, double inputExpectedUpdateRate = 0.0, uint32_t inputTraceSamplingInterval = 0);
 
 /**
 This function initializes a fileDataSender to send data to the given file.  The object takes ownership of the file and closes the pointer on destruction.
 @param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
 @param inputFilePointer: A file stream pointer to retrieve data from
+@param inputWritePolicy: How the data is written to the file
 @return: The data sender ID to use for operations on the data sender
 
 @throws: This function can throw exceptions
 */
-std::string createFileDataSender(const std::string &inputSourceConnectionString, FILE *inputFilePointer);
+std::string createFileDataSender(const std::string &inputSourceConnectionString, FILE *inputFilePointer, const batchedFileWriterPolicy &inputWritePolicy = batchedFileWriterPolicy());
 
 /**
 This function initializes a fileDataSender to send data to the given file.  
 @param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
 @param inputFilePath: The path to the file to send data to
+@param inputWritePolicy: How the data is written to the file
 @return: The data sender ID to use for operations on the data sender
 
 @throws: This function can throw exceptions
 */
-std::string createFileDataSender(const std::string &inputSourceConnectionString, const std::string &inputFilePath);
+std::string createFileDataSender(const std::string &inputSourceConnectionString, const std::string &inputFilePath, const batchedFileWriterPolicy &inputWritePolicy = batchedFileWriterPolicy());
+
+/**
+This function initializes a recordingDataSender to record data to the given file in the stream recording format.
+@param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
+@param inputFilePath: The path of the file to record to
+@param inputStreamID: The stream ID to record the messages with
+@param inputWritePolicy: How the data is written to the file
+@return: The data sender ID to use for operations on the data sender
+
+@throws: This function can throw exceptions
+*/
+std::string createRecordingDataSender(const std::string &inputSourceConnectionString, const std::string &inputFilePath, int64_t inputStreamID, const batchedFileWriterPolicy &inputWritePolicy = batchedFileWriterPolicy());
 
 
 /**
@@ -187,10 +225,19 @@ This function can be used to send a query to a caster to get a list of all bases
 */
 static client_query_reply queryPylonGPSV2Caster(const client_query_request &inputRequest, const std::string &inputClientRequestIPAddressAndPort, int inputTimeoutDuration, zmq::context_t &inputContext);
 
+/**
+This function returns the latency histograms of the traced caster stream messages that have been written out by this transceiver's tcp/file data senders.  Traces only include hops on machines other than this one if their clocks are the same monotonic clock (such as local casters).
+@return: The histograms
+*/
+latency_trace_report getLatencyTraceReport();
+
 zmq::context_t &context;
+latencyTracer receivedMessageTracer; //Shared by the caster data receivers and the tcp/file data senders (declared first so it outlives them)
+std::map<std::pair<std::string, bool>, std::weak_ptr<zmqCasterSubscriber> > casterAddressAndFrameHeaderOptionToCasterSubscriber; //Lets the receivers of streams from the same caster share one connection (expires with the last of them)
 std::map<std::string, std::unique_ptr<dataReceiver> > dataReceiverConnectionStringToDataReceiver;
 std::map<std::string, std::unique_ptr<dataSender> > dataSenderIDToDataSender;
 std::map<std::string, std::set<std::string> > dataReceiverConnectionStringToListeningDataSenderIDs; 
+bool fuseReceiversAndSenders = true; //If true, file/ZMQ data senders whose source is a receiver in this transceiver are handed its messages directly on the receiver's thread rather than subscribing to it
 
 protected:
 int URINumberGenerator = 0;
@@ -203,6 +250,13 @@ This function adds the given data sender reference to the transceiver's maps and
 @return: The URI that has been assigned to this sender
 */
 std::string addDataSender(const std::string &inputSourceConnectionString, std::unique_ptr<dataSender> &inputDataSender);
+
+/**
+This function returns the direct data sinks of the receiver in this transceiver publishing at the given connection string, if senders are to be fused with it.
+@param inputSourceConnectionString: The connection string that the sender is to get data from
+@return: The sinks or nullptr if the sender should subscribe to the connection string instead
+*/
+directDataSinkList *getDirectDataSinks(const std::string &inputSourceConnectionString);
 };
 
 
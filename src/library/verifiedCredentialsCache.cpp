@@ -0,0 +1,107 @@
+#include "verifiedCredentialsCache.hpp"
+
+using namespace pylongps;
+
+/**
+This function initializes the cache.
+@param inputMaximumNumberOfEntries: How many entries to keep before evicting the least recently used one
+*/
+verifiedCredentialsCache::verifiedCredentialsCache(uint32_t inputMaximumNumberOfEntries) : maximumNumberOfEntries(inputMaximumNumberOfEntries)
+{
+}
+
+/**
+This function generates the key a credentials message is cached under.
+@param inputCredentials: The credentials message
+@return: The hash of the permissions and signatures
+*/
+std::string verifiedCredentialsCache::generateKey(const credentials &inputCredentials)
+{
+crypto_generichash_state hashState;
+crypto_generichash_init(&hashState, nullptr, 0, crypto_generichash_BYTES);
+
+//Each field is preceded by its length so that different messages can't hash the same bytes
+auto addField = [&](const std::string &inputField)
+{
+uint64_t fieldSize = inputField.size();
+crypto_generichash_update(&hashState, (const unsigned char *) &fieldSize, sizeof(fieldSize));
+crypto_generichash_update(&hashState, (const unsigned char *) inputField.c_str(), inputField.size());
+};
+
+addField(inputCredentials.permissions());
+for(int i=0; i<inputCredentials.signatures_size(); i++)
+{
+addField(inputCredentials.signatures(i).public_key());
+addField(inputCredentials.signatures(i).cryptographic_signature());
+}
+
+unsigned char hash[crypto_generichash_BYTES];
+crypto_generichash_final(&hashState, hash, sizeof(hash));
+
+return std::string((const char *) hash, sizeof(hash));
+}
+
+/**
+This function looks up the result for a credentials message and marks it as the most recently used.
+@param inputKey: The key of the credentials (from generateKey)
+@return: The entry (valid until the cache is next modified) or nullptr if it isn't in the cache
+*/
+const verifiedCredentialsCacheEntry *verifiedCredentialsCache::find(const std::string &inputKey)
+{
+auto iter = keyToEntry.find(inputKey);
+if(iter == keyToEntry.end())
+{
+return nullptr;
+}
+
+entries.splice(entries.begin(), entries, iter->second); //Iterators stay valid
+return &iter->second->second;
+}
+
+/**
+This function stores the result for a credentials message, evicting the least recently used entry if the cache is full.
+@param inputKey: The key of the credentials (from generateKey)
+@param inputEntry: The result of checking them
+*/
+void verifiedCredentialsCache::insert(const std::string &inputKey, const verifiedCredentialsCacheEntry &inputEntry)
+{
+if(maximumNumberOfEntries == 0)
+{
+return;
+}
+
+auto iter = keyToEntry.find(inputKey);
+if(iter != keyToEntry.end())
+{ //Replace the existing result
+iter->second->second = inputEntry;
+entries.splice(entries.begin(), entries, iter->second);
+return;
+}
+
+if(entries.size() >= maximumNumberOfEntries)
+{
+keyToEntry.erase(entries.back().first);
+entries.pop_back();
+}
+
+entries.emplace_front(inputKey, inputEntry);
+keyToEntry[inputKey] = entries.begin();
+}
+
+/**
+This function removes all of the entries.
+*/
+void verifiedCredentialsCache::clear()
+{
+keyToEntry.clear();
+entries.clear();
+}
+
+/**
+This function returns how many entries are in the cache.
+@return: The number of entries
+*/
+uint64_t verifiedCredentialsCache::size() const
+{
+return keyToEntry.size();
+}
@@ -0,0 +1,80 @@
+#ifndef VERIFIEDCREDENTIALSCACHEHPP
+#define VERIFIEDCREDENTIALSCACHEHPP
+
+#include<cstdint>
+#include<string>
+#include<list>
+#include<unordered_map>
+#include<sodium.h>
+#include "credentials.pb.h"
+#include "authorized_permissions.pb.h"
+
+namespace pylongps
+{
+
+const uint32_t VERIFIED_CREDENTIALS_CACHE_SIZE = 4096; //Most distinct credentials messages whose check results are kept
+
+/**
+This class holds the result of checking one credentials message.
+*/
+class verifiedCredentialsCacheEntry
+{
+public:
+bool credentialsAreValid;
+bool isSignedByOfficialEntityKey;
+bool isSignedByRegisteredCommunityKey;
+authorized_permissions permissions; //The parsed permissions
+};
+
+/**
+This class remembers the results of checking credentials messages, so that transmitters which reconnect with the same credentials (such as a fleet of basestations after an outage) don't repeat the signature verifications.  Entries are keyed by a BLAKE2b hash of the permissions and signatures and the least recently used entry is evicted once the cache is full.  The results depend on the trusted signing keys, so the cache must be cleared whenever those change.  It is not threadsafe.
+*/
+class verifiedCredentialsCache
+{
+public:
+/**
+This function initializes the cache.
+@param inputMaximumNumberOfEntries: How many entries to keep before evicting the least recently used one
+*/
+verifiedCredentialsCache(uint32_t inputMaximumNumberOfEntries = VERIFIED_CREDENTIALS_CACHE_SIZE);
+
+/**
+This function generates the key a credentials message is cached under.
+@param inputCredentials: The credentials message
+@return: The hash of the permissions and signatures
+*/
+static std::string generateKey(const credentials &inputCredentials);
+
+/**
+This function looks up the result for a credentials message and marks it as the most recently used.
+@param inputKey: The key of the credentials (from generateKey)
+@return: The entry (valid until the cache is next modified) or nullptr if it isn't in the cache
+*/
+const verifiedCredentialsCacheEntry *find(const std::string &inputKey);
+
+/**
+This function stores the result for a credentials message, evicting the least recently used entry if the cache is full.
+@param inputKey: The key of the credentials (from generateKey)
+@param inputEntry: The result of checking them
+*/
+void insert(const std::string &inputKey, const verifiedCredentialsCacheEntry &inputEntry);
+
+/**
+This function removes all of the entries.
+*/
+void clear();
+
+/**
+This function returns how many entries are in the cache.
+@return: The number of entries
+*/
+uint64_t size() const;
+
+private:
+uint32_t maximumNumberOfEntries;
+std::list<std::pair<std::string, verifiedCredentialsCacheEntry> > entries; //Most recently used first
+std::unordered_map<std::string, std::list<std::pair<std::string, verifiedCredentialsCacheEntry> >::iterator> keyToEntry;
+};
+
+}
+#endif
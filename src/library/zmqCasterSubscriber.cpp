@@ -0,0 +1,397 @@
+#include "zmqCasterSubscriber.hpp"
+
+using namespace pylongps;
+
+/**
+This function initializes the zmqCasterSubscriber and connects it to the given PylonGPS caster PUB socket (without subscribing to any streams).
+@param inputIPAddressAndPort: A string with the IP address/port in format "IPAddress:portNumber"
+@param inputContext: A reference to the ZMQ context to use
+@param inputCasterAddsStreamFrameHeaders: True if the caster publishes its messages with stream frame headers (its add_stream_frame_headers option, given as has_stream_frame_headers in its stream information), which are then removed and used for delivery statistics
+@param inputLatencyTracer: If not nullptr, the traces of traced messages are passed to this tracer (with the receiver hop added) so that the data sender which outputs the message can complete them
+
+@throws: This function can throw exceptions
+*/
+zmqCasterSubscriber::zmqCasterSubscriber(const std::string &inputIPAddressAndPort, zmq::context_t &inputContext, bool inputCasterAddsStreamFrameHeaders, latencyTracer *inputLatencyTracer) : context(inputContext), IPAddressAndPort(inputIPAddressAndPort), casterAddsStreamFrameHeaders(inputCasterAddsStreamFrameHeaders), tracer(inputLatencyTracer)
+{
+//Construct reactor
+SOM_TRY
+subscriberReactor.reset(new reactor<zmqCasterSubscriber>(&context, this));
+SOM_CATCH("Error initializing reactor\n")
+
+//Create socket to read from the caster (subscriptions are added with the streams)
+std::unique_ptr<zmq::socket_t> ZMQReadingSocket;
+
+SOM_TRY
+ZMQReadingSocket.reset(new zmq::socket_t(context, ZMQ_SUB));
+SOM_CATCH("Error making socket\n")
+
+SOM_TRY
+std::string connectionString = "tcp://" + inputIPAddressAndPort;
+ZMQReadingSocket->connect(connectionString.c_str());
+SOM_CATCH("Error connecting to ZMQ PUB socket\n")
+
+//Create socket for add/remove stream requests
+std::unique_ptr<zmq::socket_t> controlSocket;
+
+SOM_TRY
+controlSocket.reset(new zmq::socket_t(context, ZMQ_REP));
+SOM_CATCH("Error making socket\n")
+
+int extensionStringNumber = 0;
+SOM_TRY //Bind to an dynamically generated address
+std::tie(controlConnectionString, extensionStringNumber) = bindZMQSocketWithAutomaticAddressGeneration(*controlSocket, "zmqCasterSubscriberControlSocketAddress");
+SOM_CATCH("Error binding controlSocket\n")
+
+SOM_TRY //Relaxed/correlated so that a request can be sent after one times out, with the late reply to the old request discarded
+int enableOption = 1;
+controlRequestSocket.reset(new zmq::socket_t(context, ZMQ_REQ));
+controlRequestSocket->setsockopt(ZMQ_RCVTIMEO, (void *) &ZMQ_CASTER_SUBSCRIBER_MAX_WAIT_TIME, sizeof(ZMQ_CASTER_SUBSCRIBER_MAX_WAIT_TIME));
+controlRequestSocket->setsockopt(ZMQ_REQ_RELAXED, (void *) &enableOption, sizeof(enableOption));
+controlRequestSocket->setsockopt(ZMQ_REQ_CORRELATE, (void *) &enableOption, sizeof(enableOption));
+controlRequestSocket->connect(controlConnectionString.c_str());
+SOM_CATCH("Error making control request socket\n")
+
+//Give ownership of the sockets to the reactor
+subscribingSocket = ZMQReadingSocket.get();
+
+SOM_TRY
+subscriberReactor->addInterface(ZMQReadingSocket, &zmqCasterSubscriber::readAndPublishData, "subscribingSocket");
+subscriberReactor->addInterface(controlSocket, &zmqCasterSubscriber::processControlRequest, controlConnectionString);
+SOM_CATCH("Error, unable to add interface\n")
+
+//Start the reactor thread
+SOM_TRY
+subscriberReactor->start();
+SOM_CATCH("Error, unable to start reactor\n")
+}
+
+/**
+This function subscribes to the given stream (if it isn't already) and creates a new inproc publisher which the stream's messages are forwarded to.
+@param inputCasterID: The ID of the caster to listen to (host format)
+@param inputStreamID: The stream ID associated with the stream to listen to (host format)
+@param inputDirectSinks: If not nullptr, the stream's messages are also passed to these sinks (the list must stay valid until the stream is removed)
+@return: <connection string of the publisher, connection string of the publisher's status notifications>
+
+@throws: This function can throw exceptions
+*/
+std::tuple<std::string, std::string> zmqCasterSubscriber::addStream(int64_t inputCasterID, int64_t inputStreamID, directDataSinkList *inputDirectSinks)
+{
+Poco::Int64 header[2];
+header[0] = Poco::ByteOrder::toNetwork((Poco::Int64) inputCasterID);
+header[1] = Poco::ByteOrder::toNetwork((Poco::Int64) inputStreamID);
+
+std::string request = std::string(1, ZMQ_CASTER_SUBSCRIBER_ADD_STREAM_REQUEST) + std::string((const char *) header, sizeof(header)) + std::string((const char *) &inputDirectSinks, sizeof(inputDirectSinks));
+
+std::vector<std::string> reply;
+SOM_TRY
+reply = sendControlRequest(request);
+SOM_CATCH("Error sending add stream request\n")
+
+if(reply.size() != 2)
+{
+throw SOMException("Subscriber was unable to add stream\n", UNKNOWN, __FILE__, __LINE__);
+}
+
+return std::tuple<std::string, std::string>(reply[0], reply[1]);
+}
+
+/**
+This function closes an inproc publisher created by addStream, unsubscribing from its stream if no other publisher is using it.
+@param inputPublisherConnectionString: The connection string of the publisher to close
+
+@throws: This function can throw exceptions
+*/
+void zmqCasterSubscriber::removeStream(const std::string &inputPublisherConnectionString)
+{
+std::string request = std::string(1, ZMQ_CASTER_SUBSCRIBER_REMOVE_STREAM_REQUEST) + inputPublisherConnectionString;
+
+SOM_TRY
+sendControlRequest(request);
+SOM_CATCH("Error sending remove stream request\n")
+}
+
+/**
+This function returns the IP address/port of the caster the object is connected to.
+@return: The address in format "IPAddress:portNumber"
+*/
+std::string zmqCasterSubscriber::casterAddress()
+{
+return IPAddressAndPort;
+}
+
+/**
+This function sends a request to the control socket and waits for the reply.  If the subscriber thread doesn't reply in time an exception is thrown, and the late reply is discarded when it arrives.
+@param inputRequest: The request to send
+@return: The parts of the reply
+
+@throws: This function can throw exceptions
+*/
+std::vector<std::string> zmqCasterSubscriber::sendControlRequest(const std::string &inputRequest)
+{
+std::lock_guard<std::mutex> lock(controlRequestMutex);
+
+SOM_TRY
+controlRequestSocket->send(inputRequest.c_str(), inputRequest.size());
+SOM_CATCH("Error sending control request\n")
+
+std::vector<std::string> reply;
+while(true)
+{
+zmq::message_t messageBuffer;
+
+SOM_TRY
+if(!controlRequestSocket->recv(&messageBuffer))
+{
+throw SOMException("Subscriber thread did not reply in time\n", SERVER_REQUEST_FAILED, __FILE__, __LINE__);
+}
+SOM_CATCH("Error receiving control reply\n")
+
+reply.emplace_back((const char *) messageBuffer.data(), messageBuffer.size());
+
+if(!messageBuffer.more())
+{
+break;
+}
+}
+
+return reply;
+}
+
+/**
+This function reads from the caster's PUB port and forwards the received data (with the casterID/streamID and stream frame header removed) to the publishers of the stream it belongs to.
+@param inputReactor: The reactor which called the function
+@param inputSocket: The socket to read from
+@return: false if the reactor doesn't need to restart its poll cycle
+
+@throw: This function can throw exceptions
+*/
+bool zmqCasterSubscriber::readAndPublishData(reactor<zmqCasterSubscriber> &inputReactor, zmq::socket_t &inputSocket)
+{
+try
+{
+zmq::message_t messageBuffer;
+
+SOM_TRY
+if(!inputSocket.recv(&messageBuffer))
+{
+return false; //False alarm
+}
+SOM_CATCH("Error, unable to receive message\n")
+
+if(messageBuffer.size() < sizeof(Poco::Int64)*2)
+{
+return false; //Message is smaller then header, so ignore invalid message
+}
+
+//Demultiplex by the header
+Poco::Int64 header[2];
+memcpy((void *) header, messageBuffer.data(), sizeof(header));
+auto streamIter = casterIDAndStreamIDToStream.find(std::pair<int64_t, int64_t>(Poco::ByteOrder::fromNetwork(header[0]), Poco::ByteOrder::fromNetwork(header[1])));
+if(streamIter == casterIDAndStreamIDToStream.end())
+{
+return false; //Subscription was removed while the message was queued
+}
+zmqCasterSubscriberStream &stream = streamIter->second;
+
+const char *payload = ((const char *) messageBuffer.data())+sizeof(Poco::Int64)*2;
+uint64_t payloadSize = messageBuffer.size()-sizeof(Poco::Int64)*2;
+
+uint64_t sequenceNumber = 0;
+int64_t ingestTime = 0;
+uint32_t frameHeaderSize = 0;
+bool messageHasFrameHeader = false;
+if(casterAddsStreamFrameHeaders)
+{
+messageHasFrameHeader = readStreamFrameHeader(payload, payloadSize, sequenceNumber, ingestTime, frameHeaderSize);
+if(!messageHasFrameHeader)
+{
+return false; //Too small to hold the stream frame header, so ignore invalid message
+}
+}
+
+std::vector<traceHop> traceHops;
+if(messageHasFrameHeader && tracer != nullptr && readStreamFrameHeaderTrace(payload, payloadSize, traceHops))
+{ //Add this hop once, however many outputs the stream has
+traceHops.push_back(traceHop(RECEIVER_INGEST, getMonotonicTime()));
+tracer->addPendingTrace(payload + frameHeaderSize, payloadSize - frameHeaderSize, traceHops);
+}
+
+if(messageHasFrameHeader)
+{ //Skip the stream frame header
+payload += frameHeaderSize;
+payloadSize -= frameHeaderSize;
+}
+
+for(std::unique_ptr<zmqCasterSubscriberOutput> &output : stream.outputs)
+{
+SOM_TRY
+output->publishingSocket->send(payload, payloadSize);
+SOM_CATCH("Error publishing data\n")
+
+if(output->directSinks != nullptr)
+{
+output->directSinks->publish(payload, payloadSize);
+}
+}
+
+if(messageHasFrameHeader)
+{ //Update loss/latency statistics and report them if messages were missed or it has been long enough
+Poco::Timestamp::TimeVal receptionTime = Poco::Timestamp().epochMicroseconds();
+bool messagesWereMissed = stream.deliveryTracker.addMessage(sequenceNumber, ingestTime, receptionTime);
+
+if(messagesWereMissed || (receptionTime - stream.timeDeliveryStatisticsWereLastSent) >= STREAM_DELIVERY_STATISTICS_REPORT_INTERVAL*1000000.0)
+{
+data_receiver_status_notification notification;
+(*notification.mutable_delivery_statistics()) = stream.deliveryTracker.statistics;
+
+for(std::unique_ptr<zmqCasterSubscriberOutput> &output : stream.outputs)
+{
+SOM_TRY
+sendProtobufMessage(*output->notificationPublishingSocket, notification);
+SOM_CATCH("Error sending delivery statistics\n")
+}
+
+stream.timeDeliveryStatisticsWereLastSent = receptionTime;
+}
+}
+
+}
+catch(const std::exception &inputException)
+{
+//Send notification to every user of the connection and then kill the reactor by throwing an exception
+data_receiver_status_notification notification;
+notification.set_unrecoverable_error_has_occurred(true);
+
+SOM_TRY
+sendNotificationToAllOutputs(notification);
+SOM_CATCH("Error sending error notification\n")
+
+throw inputException;
+}
+
+return false;
+}
+
+/**
+This function processes add/remove stream requests from the control socket.
+@param inputReactor: The reactor which called the function
+@param inputSocket: The socket to read from
+@return: false if the reactor doesn't need to restart its poll cycle
+
+@throw: This function can throw exceptions
+*/
+bool zmqCasterSubscriber::processControlRequest(reactor<zmqCasterSubscriber> &inputReactor, zmq::socket_t &inputSocket)
+{
+zmq::message_t messageBuffer;
+
+SOM_TRY
+if(!inputSocket.recv(&messageBuffer))
+{
+return false; //False alarm
+}
+SOM_CATCH("Error, unable to receive message\n")
+
+const char *request = (const char *) messageBuffer.data();
+uint64_t requestSize = messageBuffer.size();
+
+if(requestSize == (1 + sizeof(Poco::Int64)*2 + sizeof(directDataSinkList *)) && request[0] == ZMQ_CASTER_SUBSCRIBER_ADD_STREAM_REQUEST)
+{
+Poco::Int64 header[2];
+memcpy((void *) header, request + 1, sizeof(header));
+std::pair<int64_t, int64_t> casterIDAndStreamID(Poco::ByteOrder::fromNetwork(header[0]), Poco::ByteOrder::fromNetwork(header[1]));
+
+std::unique_ptr<zmqCasterSubscriberOutput> output(new zmqCasterSubscriberOutput);
+memcpy((void *) &output->directSinks, request + 1 + sizeof(header), sizeof(output->directSinks));
+
+int extensionStringNumber = 0;
+SOM_TRY //Bind to dynamically generated addresses
+output->publishingSocket.reset(new zmq::socket_t(context, ZMQ_PUB));
+std::tie(output->publisherConnectionString, extensionStringNumber) = bindZMQSocketWithAutomaticAddressGeneration(*output->publishingSocket, "zmqDataReceiverSocketAddress");
+
+output->notificationPublishingSocket.reset(new zmq::socket_t(context, ZMQ_PUB));
+std::tie(output->notificationConnectionString, extensionStringNumber) = bindZMQSocketWithAutomaticAddressGeneration(*output->notificationPublishingSocket, "zmqDataReceiverNotificationSocketAddress");
+SOM_CATCH("Error binding output sockets\n")
+
+if(casterIDAndStreamIDToStream.count(casterIDAndStreamID) == 0)
+{ //First user of the stream, so subscribe to it
+SOM_TRY  //Set filter for casterID,streamID in network format
+subscribingSocket->setsockopt(ZMQ_SUBSCRIBE, (void *) header, sizeof(header));
+SOM_CATCH("Error setting subscription for subscribingSocket\n")
+
+casterIDAndStreamIDToStream[casterIDAndStreamID].deliveryTracker = streamDeliveryTracker(casterIDAndStreamID.first, casterIDAndStreamID.second);
+}
+
+std::string publisherConnectionString = output->publisherConnectionString;
+std::string notificationConnectionString = output->notificationConnectionString;
+casterIDAndStreamIDToStream[casterIDAndStreamID].outputs.emplace_back(std::move(output));
+publisherConnectionStringToCasterIDAndStreamID[publisherConnectionString] = casterIDAndStreamID;
+
+SOM_TRY
+inputSocket.send(publisherConnectionString.c_str(), publisherConnectionString.size(), ZMQ_SNDMORE);
+inputSocket.send(notificationConnectionString.c_str(), notificationConnectionString.size());
+SOM_CATCH("Error sending reply\n")
+
+return false;
+}
+
+if(requestSize > 1 && request[0] == ZMQ_CASTER_SUBSCRIBER_REMOVE_STREAM_REQUEST)
+{
+std::string publisherConnectionString(request + 1, requestSize - 1);
+
+auto connectionIter = publisherConnectionStringToCasterIDAndStreamID.find(publisherConnectionString);
+if(connectionIter != publisherConnectionStringToCasterIDAndStreamID.end())
+{
+std::pair<int64_t, int64_t> casterIDAndStreamID = connectionIter->second;
+publisherConnectionStringToCasterIDAndStreamID.erase(connectionIter);
+
+std::vector<std::unique_ptr<zmqCasterSubscriberOutput> > &outputs = casterIDAndStreamIDToStream[casterIDAndStreamID].outputs;
+for(auto outputIter = outputs.begin(); outputIter != outputs.end(); outputIter++)
+{
+if((*outputIter)->publisherConnectionString == publisherConnectionString)
+{
+outputs.erase(outputIter);
+break;
+}
+}
+
+if(outputs.size() == 0)
+{ //Last user of the stream, so unsubscribe from it
+Poco::Int64 header[2];
+header[0] = Poco::ByteOrder::toNetwork((Poco::Int64) casterIDAndStreamID.first);
+header[1] = Poco::ByteOrder::toNetwork((Poco::Int64) casterIDAndStreamID.second);
+
+SOM_TRY
+subscribingSocket->setsockopt(ZMQ_UNSUBSCRIBE, (void *) header, sizeof(header));
+SOM_CATCH("Error removing subscription for subscribingSocket\n")
+
+casterIDAndStreamIDToStream.erase(casterIDAndStreamID);
+}
+}
+}
+
+//Empty reply for removals and invalid requests
+SOM_TRY
+inputSocket.send(nullptr, 0);
+SOM_CATCH("Error sending reply\n")
+
+return false;
+}
+
+/**
+This function sends a notification to all of the publishers' notification sockets.
+@param inputNotification: The notification to send
+
+@throw: This function can throw exceptions
+*/
+void zmqCasterSubscriber::sendNotificationToAllOutputs(const data_receiver_status_notification &inputNotification)
+{
+for(auto &casterIDAndStreamIDAndStream : casterIDAndStreamIDToStream)
+{
+for(std::unique_ptr<zmqCasterSubscriberOutput> &output : casterIDAndStreamIDAndStream.second.outputs)
+{
+SOM_TRY
+sendProtobufMessage(*output->notificationPublishingSocket, inputNotification);
+SOM_CATCH("Error sending notification\n")
+}
+}
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include<cstdint>
+#include<cstring>
+#include<memory>
+#include<mutex>
+#include<map>
+#include<vector>
+#include<string>
+#include<tuple>
+#include<thread>
+
+#include "SOMException.hpp"
+#include "SOMScopeGuard.hpp"
+#include "zmq.hpp"
+#include "reactor.hpp"
+#include "utilityFunctions.hpp"
+#include "Poco/ByteOrder.h"
+#include "Poco/Timestamp.h"
+#include "streamFrameHeader.hpp"
+#include "streamDeliveryTracker.hpp"
+#include "latencyTracer.hpp"
+#include "directDataSink.hpp"
+#include "data_receiver_status_notification.pb.h"
+
+
+namespace pylongps
+{
+
+//How often to publish the delivery statistics of a caster stream with stream frame headers (they are also published whenever messages are missed)
+const double STREAM_DELIVERY_STATISTICS_REPORT_INTERVAL = 1.0; //Seconds
+
+const int ZMQ_CASTER_SUBSCRIBER_MAX_WAIT_TIME = 5000; //How long to wait for the subscriber thread to add/remove a stream, in milliseconds
+
+//The first byte of each request sent to a zmqCasterSubscriber's control socket
+const char ZMQ_CASTER_SUBSCRIBER_ADD_STREAM_REQUEST = 'a'; //Followed by the casterID/streamID in network format and the address of the output's directDataSinkList (the control socket is inproc)
+const char ZMQ_CASTER_SUBSCRIBER_REMOVE_STREAM_REQUEST = 'r'; //Followed by the publisher connection string of the output to remove
+
+/**
+This class holds the inproc sockets that the messages of one stream are forwarded to for one user of a zmqCasterSubscriber.
+*/
+class zmqCasterSubscriberOutput
+{
+public:
+std::unique_ptr<zmq::socket_t> publishingSocket;
+std::unique_ptr<zmq::socket_t> notificationPublishingSocket;
+std::string publisherConnectionString; //String used to connect to the output's publisher
+std::string notificationConnectionString; //String used to connect to the output's status notifications
+directDataSinkList *directSinks = nullptr; //Not owned, given each message after it is published if not nullptr
+};
+
+/**
+This class holds the state of one caster stream that a zmqCasterSubscriber is subscribed to.
+*/
+class zmqCasterSubscriberStream
+{
+public:
+streamDeliveryTracker deliveryTracker; //Updated with the stream frame headers of received messages
+Poco::Timestamp::TimeVal timeDeliveryStatisticsWereLastSent = 0;
+std::vector<std::unique_ptr<zmqCasterSubscriberOutput> > outputs; //Each gets a copy of every message
+};
+
+/**
+This class holds a single connection to the PUB socket of a PylonGPS caster and subscribes it to the casterID/streamID prefix of each stream that is added to it.  Received messages are demultiplexed by their header and forwarded (with the header and, if the caster adds them, the stream frame header removed) to an inproc publisher per added stream, so any number of zmqDataReceivers listening to the same caster share one TCP connection and one thread.  Streams are added and removed through a control socket serviced by the subscriber's thread, so addStream/removeStream are threadsafe.
+*/
+class zmqCasterSubscriber
+{
+public:
+/**
+This function initializes the zmqCasterSubscriber and connects it to the given PylonGPS caster PUB socket (without subscribing to any streams).
+@param inputIPAddressAndPort: A string with the IP address/port in format "IPAddress:portNumber"
+@param inputContext: A reference to the ZMQ context to use
+@param inputCasterAddsStreamFrameHeaders: True if the caster publishes its messages with stream frame headers (its add_stream_frame_headers option, given as has_stream_frame_headers in its stream information), which are then removed and used for delivery statistics
+@param inputLatencyTracer: If not nullptr, the traces of traced messages are passed to this tracer (with the receiver hop added) so that the data sender which outputs the message can complete them
+
+@throws: This function can throw exceptions
+*/
+zmqCasterSubscriber(const std::string &inputIPAddressAndPort, zmq::context_t &inputContext, bool inputCasterAddsStreamFrameHeaders = false, latencyTracer *inputLatencyTracer = nullptr);
+
+/**
+This function subscribes to the given stream (if it isn't already) and creates a new inproc publisher which the stream's messages are forwarded to.
+@param inputCasterID: The ID of the caster to listen to (host format)
+@param inputStreamID: The stream ID associated with the stream to listen to (host format)
+@param inputDirectSinks: If not nullptr, the stream's messages are also passed to these sinks (the list must stay valid until the stream is removed)
+@return: <connection string of the publisher, connection string of the publisher's status notifications>
+
+@throws: This function can throw exceptions
+*/
+std::tuple<std::string, std::string> addStream(int64_t inputCasterID, int64_t inputStreamID, directDataSinkList *inputDirectSinks = nullptr);
+
+/**
+This function closes an inproc publisher created by addStream, unsubscribing from its stream if no other publisher is using it.
+@param inputPublisherConnectionString: The connection string of the publisher to close
+
+@throws: This function can throw exceptions
+*/
+void removeStream(const std::string &inputPublisherConnectionString);
+
+/**
+This function returns the IP address/port of the caster the object is connected to.
+@return: The address in format "IPAddress:portNumber"
+*/
+std::string casterAddress();
+
+protected:
+/**
+This function sends a request to the control socket and waits for the reply.  If the subscriber thread doesn't reply in time an exception is thrown, and the late reply is discarded when it arrives.
+@param inputRequest: The request to send
+@return: The parts of the reply
+
+@throws: This function can throw exceptions
+*/
+std::vector<std::string> sendControlRequest(const std::string &inputRequest);
+
+/**
+This function reads from the caster's PUB port and forwards the received data (with the casterID/streamID and stream frame header removed) to the publishers of the stream it belongs to.
+@param inputReactor: The reactor which called the function
+@param inputSocket: The socket to read from
+@return: false if the reactor doesn't need to restart its poll cycle
+
+@throw: This function can throw exceptions
+*/
+bool readAndPublishData(reactor<zmqCasterSubscriber> &inputReactor, zmq::socket_t &inputSocket);
+
+/**
+This function processes add/remove stream requests from the control socket.
+@param inputReactor: The reactor which called the function
+@param inputSocket: The socket to read from
+@return: false if the reactor doesn't need to restart its poll cycle
+
+@throw: This function can throw exceptions
+*/
+bool processControlRequest(reactor<zmqCasterSubscriber> &inputReactor, zmq::socket_t &inputSocket);
+
+/**
+This function sends a notification to all of the publishers' notification sockets.
+@param inputNotification: The notification to send
+
+@throw: This function can throw exceptions
+*/
+void sendNotificationToAllOutputs(const data_receiver_status_notification &inputNotification);
+
+zmq::context_t &context;
+std::string IPAddressAndPort;
+bool casterAddsStreamFrameHeaders = false; //True if every message has a stream frame header after the casterID/streamID
+latencyTracer *tracer = nullptr; //Not owned
+zmq::socket_t *subscribingSocket = nullptr; //Owned by the reactor
+std::string controlConnectionString;
+
+//Only used by the reactor thread (declared before the reactor so they outlive its thread)
+std::map<std::pair<int64_t, int64_t>, zmqCasterSubscriberStream> casterIDAndStreamIDToStream;
+std::map<std::string, std::pair<int64_t, int64_t> > publisherConnectionStringToCasterIDAndStreamID;
+
+std::mutex controlRequestMutex; //Guards controlRequestSocket
+std::unique_ptr<zmq::socket_t> controlRequestSocket;
+std::unique_ptr<reactor<zmqCasterSubscriber> > subscriberReactor;
+};
+
+}
@@ -21,14 +21,19 @@ This function initializes the zmqDataReceiver to retrieve data from the given gi
 @param inputStreamID: The stream ID associated with the stream to listen to (host format)
 @param inputContext: A reference to the ZMQ context to use
 @param inputSubscribingToCaster: True if this object is subscribing to a caster and needs to strip the casterID/streamID from the stream before forwarding it 
+@param inputCasterAddsStreamFrameHeaders: True if the caster publishes its messages with stream frame headers (its add_stream_frame_headers option, given as has_stream_frame_headers in its stream information), which are then removed and used for delivery statistics
+@param inputLatencyTracer: If not nullptr, the traces of traced messages are passed to this tracer (with this receiver's hop added) so that the data sender which outputs the message can complete them
 
 @throws: This function can throw exceptions
 */
-zmqDataReceiver::zmqDataReceiver(const std::string &inputIPAddressAndPort, int64_t inputCasterID, int64_t inputStreamID, zmq::context_t &inputContext, bool inputSubscribingToCaster)  : context(inputContext)
+zmqDataReceiver::zmqDataReceiver(const std::string &inputIPAddressAndPort, int64_t inputCasterID, int64_t inputStreamID, zmq::context_t &inputContext, bool inputSubscribingToCaster, bool inputCasterAddsStreamFrameHeaders, latencyTracer *inputLatencyTracer)  : context(inputContext)
 {
+tracer = inputLatencyTracer;
 stripHeader = inputSubscribingToCaster;
+stripFrameHeader = inputSubscribingToCaster && inputCasterAddsStreamFrameHeaders;
 casterID = inputCasterID;
 streamID = inputStreamID;
+deliveryTracker = streamDeliveryTracker(casterID, streamID);
 
 //Construct reactor
 SOM_TRY
@@ -100,6 +105,53 @@ SOM_CATCH("Error, unable to add interface\n")
 }
 
 
+/**
+This function initializes the zmqDataReceiver to retrieve data from a PylonGPS caster through a subscriber shared with other receivers of the same caster's streams.
+@param inputCasterSubscriber: The subscriber connected to the caster (kept alive while this object exists)
+@param inputCasterID: The ID of the caster to listen to (host format)
+@param inputStreamID: The stream ID associated with the stream to listen to (host format)
+@param inputContext: A reference to the ZMQ context to use
+
+@throws: This function can throw exceptions
+*/
+zmqDataReceiver::zmqDataReceiver(const std::shared_ptr<zmqCasterSubscriber> &inputCasterSubscriber, int64_t inputCasterID, int64_t inputStreamID, zmq::context_t &inputContext) : context(inputContext)
+{
+if(inputCasterSubscriber.get() == nullptr)
+{
+throw SOMException("Null pointer given for required field\n", INVALID_FUNCTION_INPUT, __FILE__, __LINE__);
+}
+
+stripHeader = true;
+casterID = inputCasterID;
+streamID = inputStreamID;
+
+SOM_TRY //The subscriber's thread strips the headers and tracks delivery for the stream
+std::tie(publisherConnectionString, notificationConnectionString) = inputCasterSubscriber->addStream(casterID, streamID, &directSinks);
+SOM_CATCH("Error adding stream to caster subscriber\n")
+
+casterSubscriber = inputCasterSubscriber;
+}
+
+/**
+This function removes the stream from the shared subscriber, if there is one.
+*/
+zmqDataReceiver::~zmqDataReceiver()
+{
+if(casterSubscriber.get() == nullptr)
+{
+return;
+}
+
+try
+{
+casterSubscriber->removeStream(publisherConnectionString);
+}
+catch(const std::exception &inputException)
+{
+fprintf(stderr, "%s", inputException.what());
+}
+}
+
 /**
 This function returns a string containing the ZMQ connection string required to connect this object's publisher (which forwards data from the associated file).
 @return: The connection string to use to connect to this data source
@@ -119,7 +171,16 @@ return notificationConnectionString;
 }
 
 /**
-This function reads from the ZMQ PUB port and forwards the received data to the publisher socket.
+This function returns the list that data senders in the same process can attach to in order to be handed the receiver's messages directly (the messages are still published at address() for anyone else).
+@return: The list
+*/
+directDataSinkList *zmqDataReceiver::directDataSinks()
+{
+return &directSinks;
+}
+
+/**
+This function reads from the ZMQ PUB port and forwards the received data to the publisher socket.  When receiving from a caster, the casterID/streamID (and the stream frame header, if the caster adds them) are removed before forwarding.
 @param inputReactor: The reactor which called the function
 @param inputFileDescriptor: The file descriptor to read from
 @return: false if the reactor doesn't need to restart its poll cycle
@@ -144,6 +205,8 @@ if(!stripHeader)
 SOM_TRY
 publishingSocket->send(messageBuffer.data(), messageBuffer.size());
 SOM_CATCH("Error publishing data\n")
+
+directSinks.publish((const char *) messageBuffer.data(), messageBuffer.size());
 }
 else
 {
@@ -152,9 +215,58 @@ if(messageBuffer.size() < sizeof(Poco::Int64)*2)
 return false; //Message is smaller then header, so ignore invalid message
 }
 
+const char *payload = ((const char *) messageBuffer.data())+sizeof(Poco::Int64)*2;
+uint64_t payloadSize = messageBuffer.size()-sizeof(Poco::Int64)*2;
+
+uint64_t sequenceNumber = 0;
+int64_t ingestTime = 0;
+uint32_t frameHeaderSize = 0;
+bool messageHasFrameHeader = false;
+if(stripFrameHeader)
+{
+messageHasFrameHeader = readStreamFrameHeader(payload, payloadSize, sequenceNumber, ingestTime, frameHeaderSize);
+if(!messageHasFrameHeader)
+{
+return false; //Too small to hold the stream frame header, so ignore invalid message
+}
+}
+
+std::vector<traceHop> traceHops;
+if(messageHasFrameHeader && tracer != nullptr && readStreamFrameHeaderTrace(payload, payloadSize, traceHops))
+{ //Add this hop and leave the trace to be completed by the sender which outputs the message
+traceHops.push_back(traceHop(RECEIVER_INGEST, getMonotonicTime()));
+tracer->addPendingTrace(payload + frameHeaderSize, payloadSize - frameHeaderSize, traceHops);
+}
+
+if(messageHasFrameHeader)
+{ //Skip the stream frame header
+payload += frameHeaderSize;
+payloadSize -= frameHeaderSize;
+}
+
 SOM_TRY
-publishingSocket->send(((char *) messageBuffer.data())+sizeof(Poco::Int64)*2, messageBuffer.size()-sizeof(Poco::Int64)*2);
+publishingSocket->send(payload, payloadSize);
 SOM_CATCH("Error publishing data\n")
+
+directSinks.publish(payload, payloadSize);
+
+if(messageHasFrameHeader)
+{ //Update loss/latency statistics and report them if messages were missed or it has been long enough
+Poco::Timestamp::TimeVal receptionTime = Poco::Timestamp().epochMicroseconds();
+bool messagesWereMissed = deliveryTracker.addMessage(sequenceNumber, ingestTime, receptionTime);
+
+if(messagesWereMissed || (receptionTime - timeDeliveryStatisticsWereLastSent) >= STREAM_DELIVERY_STATISTICS_REPORT_INTERVAL*1000000.0)
+{
+data_receiver_status_notification notification;
+(*notification.mutable_delivery_statistics()) = deliveryTracker.statistics;
+
+SOM_TRY
+sendProtobufMessage(*notificationPublishingSocket, notification);
+SOM_CATCH("Error sending delivery statistics\n")
+
+timeDeliveryStatisticsWereLastSent = receptionTime;
+}
+}
 }
 
 }
@@ -14,6 +14,11 @@
 #include "reactor.hpp"
 #include "utilityFunctions.hpp"
 #include "Poco/ByteOrder.h"
+#include "Poco/Timestamp.h"
+#include "streamFrameHeader.hpp"
+#include "streamDeliveryTracker.hpp"
+#include "latencyTracer.hpp"
+#include "zmqCasterSubscriber.hpp"
 #include "data_receiver_status_notification.pb.h"
 
 
@@ -21,7 +26,7 @@ namespace pylongps
 {
 
 /**
-This class reads data from either a local ZMQ publisher or a PylonGPS caster and publishes it at the associated inproc ZMQ publisher address.
+This class reads data from either a local ZMQ publisher or a PylonGPS caster and publishes it at the associated inproc ZMQ publisher address.  If the caster adds stream frame headers, they are stripped and used to track missed messages and latency, which are reported on the notification socket.  Receivers of streams from the same caster can instead share the connection of a zmqCasterSubscriber, in which case the subscriber's thread publishes the stream at this object's addresses.
 */
 class zmqDataReceiver : public dataReceiver
 {
@@ -42,10 +47,28 @@ This function initializes the zmqDataReceiver to retrieve data from the given gi
 @param inputStreamID: The stream ID associated with the stream to listen to (host format)
 @param inputContext: A reference to the ZMQ context to use
 @param inputSubscribingToCaster: True if this object is subscribing to a caster and needs to strip the casterID/streamID from the stream before forwarding it 
+@param inputCasterAddsStreamFrameHeaders: True if the caster publishes its messages with stream frame headers (its add_stream_frame_headers option, given as has_stream_frame_headers in its stream information), which are then removed and used for delivery statistics
+@param inputLatencyTracer: If not nullptr, the traces of traced messages are passed to this tracer (with this receiver's hop added) so that the data sender which outputs the message can complete them
 
 @throws: This function can throw exceptions
 */
-zmqDataReceiver(const std::string &inputIPAddressAndPort, int64_t inputCasterID, int64_t inputStreamID, zmq::context_t &inputContext, bool inputSubscribingToCaster = true);
+zmqDataReceiver(const std::string &inputIPAddressAndPort, int64_t inputCasterID, int64_t inputStreamID, zmq::context_t &inputContext, bool inputSubscribingToCaster = true, bool inputCasterAddsStreamFrameHeaders = false, latencyTracer *inputLatencyTracer = nullptr);
+
+/**
+This function initializes the zmqDataReceiver to retrieve data from a PylonGPS caster through a subscriber shared with other receivers of the same caster's streams.
+@param inputCasterSubscriber: The subscriber connected to the caster (kept alive while this object exists)
+@param inputCasterID: The ID of the caster to listen to (host format)
+@param inputStreamID: The stream ID associated with the stream to listen to (host format)
+@param inputContext: A reference to the ZMQ context to use
+
+@throws: This function can throw exceptions
+*/
+zmqDataReceiver(const std::shared_ptr<zmqCasterSubscriber> &inputCasterSubscriber, int64_t inputCasterID, int64_t inputStreamID, zmq::context_t &inputContext);
+
+/**
+This function removes the stream from the shared subscriber, if there is one.
+*/
+~zmqDataReceiver();
 
 /**
 This function returns a string containing the ZMQ connection string required to connect this object's publisher (which forwards data from the associated file).
@@ -59,21 +82,32 @@ This function is required to return a ZMQ inproc address which can be used with
 */
 virtual std::string notificationAddress();
 
+/**
+This function returns the list that data senders in the same process can attach to in order to be handed the receiver's messages directly (the messages are still published at address() for anyone else).
+@return: The list
+*/
+virtual directDataSinkList *directDataSinks();
 
 zmq::context_t &context;
 std::unique_ptr<zmq::socket_t> publishingSocket;
 std::unique_ptr<zmq::socket_t> notificationPublishingSocket;
 std::string publisherConnectionString; //String used to connect to this object's publisher
 std::string notificationConnectionString; //String used to publish status changes (such as unrecoverable disconnects)
+directDataSinkList directSinks; //Given each message after it is published (declared before the reactor so it outlives the reactor's thread)
 std::unique_ptr<reactor<zmqDataReceiver> > receiverReactor;
 
 bool stripHeader = false; //First sizeof(Poco::Int64)*2 bytes removed from each message when retransmitting if true to get rid of caster header
+bool stripFrameHeader = false; //True if each message also has a stream frame header after the caster header
 Poco::Int64 casterID; //The caster ID to listen for, in host format
 Poco::Int64 streamID; //The stream ID to listen for, in host format
+streamDeliveryTracker deliveryTracker; //Updated with the stream frame headers of received messages
+Poco::Timestamp::TimeVal timeDeliveryStatisticsWereLastSent = 0;
+latencyTracer *tracer = nullptr; //Not owned
+std::shared_ptr<zmqCasterSubscriber> casterSubscriber; //Publishes to this object's addresses in place of receiverReactor if not nullptr
 
 protected:
 /**
-This function reads from the ZMQ PUB port and forwards the received data to the publisher socket.
+This function reads from the ZMQ PUB port and forwards the received data to the publisher socket.  When receiving from a caster, the casterID/streamID (and the stream frame header, if the caster adds them) are removed before forwarding.
 @param inputReactor: The reactor which called the function
 @param inputFileDescriptor: The file descriptor to read from
 @return: false if the reactor doesn't need to restart its poll cycle
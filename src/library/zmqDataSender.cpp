@@ -7,10 +7,11 @@ This function initializes the zmqDataSender to publish data using a ZMQ PUB sock
 @param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
 @param inputContext: A reference to the ZMQ context to use
 @param inputPortNumberToPublishOn: The TCP port number to bind/use for publishing
+@param inputDirectSource: If not nullptr, the sinks of the receiver publishing at the source connection string, which this object attaches to in place of subscribing (the receiver must outlive this object)
 
 @throws: This function can throw exceptions
 */
-zmqDataSender::zmqDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, int inputPortNumberToPublishOn) : context(inputContext)
+zmqDataSender::zmqDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, int inputPortNumberToPublishOn, directDataSinkList *inputDirectSource) : context(inputContext)
 {
 if(inputPortNumberToPublishOn < 0)
 {
@@ -19,13 +20,6 @@ throw SOMException("Received negative port number\n", INVALID_FUNCTION_INPUT, __
 
 informationSourceConnectionString = inputSourceConnectionString;
 
-//Construct reactor
-SOM_TRY
-senderReactor.reset(new reactor<zmqDataSender>(&context, this));
-SOM_CATCH("Error initializing reactor\n")
-
-
-
 //Create socket for publishing
 SOM_TRY
 publishingSocket.reset(new zmq::socket_t(context, ZMQ_PUB));
@@ -37,6 +31,29 @@ SOM_TRY //Bind
 publishingSocket->bind(connectionString.c_str());
 SOM_CATCH("Error connecting socket\n")
 
+//Create socket for notification publishing
+SOM_TRY
+notificationPublishingSocket.reset(new zmq::socket_t(context, ZMQ_PUB));
+SOM_CATCH("Error making socket\n")
+
+//Bind socket for publishing and store address
+int extensionStringNumber = 0;
+SOM_TRY //Bind to an dynamically generated address
+std::tie(notificationConnectionString, extensionStringNumber) = bindZMQSocketWithAutomaticAddressGeneration(*notificationPublishingSocket, "zmqDataSenderNotificationSocketAddress");
+SOM_CATCH("Error binding notificationPublishingSocket\n")
+
+if(inputDirectSource != nullptr)
+{ //Messages are forwarded from the receiver's thread, so no subscriber or reactor is needed
+directSource = inputDirectSource;
+directSource->add(this);
+return;
+}
+
+//Construct reactor
+SOM_TRY
+senderReactor.reset(new reactor<zmqDataSender>(&context, this));
+SOM_CATCH("Error initializing reactor\n")
+
 //Create socket for subscribing
 SOM_TRY
 subscriberSocket.reset(new zmq::socket_t(context, ZMQ_SUB));
@@ -52,17 +69,6 @@ SOM_TRY
 subscriberSocket->connect(informationSourceConnectionString.c_str());
 SOM_CATCH("Error connecting socket\n")
 
-//Create socket for notification publishing
-SOM_TRY
-notificationPublishingSocket.reset(new zmq::socket_t(context, ZMQ_PUB));
-SOM_CATCH("Error making socket\n")
-
-//Bind socket for publishing and store address
-int extensionStringNumber = 0;
-SOM_TRY //Bind to an dynamically generated address
-std::tie(notificationConnectionString, extensionStringNumber) = bindZMQSocketWithAutomaticAddressGeneration(*notificationPublishingSocket, "zmqDataSenderNotificationSocketAddress");
-SOM_CATCH("Error binding notificationPublishingSocket\n")
-
 //Give ownership of the subscriber socket to the reactor
 SOM_TRY
 senderReactor->addInterface(subscriberSocket, &zmqDataSender::readAndWriteData);
@@ -85,6 +91,51 @@ std::string zmqDataSender::notificationAddress()
 return notificationConnectionString;
 }
 
+/**
+This function forwards a message handed over directly by the source receiver (on the receiver's thread).  If forwarding fails, a notification is sent and later messages are dropped.
+@param inputData: The message
+@param inputDataSize: The size of the message in bytes
+*/
+void zmqDataSender::handleDirectData(const char *inputData, uint64_t inputDataSize)
+{
+if(directForwardingHasFailed)
+{
+return;
+}
+
+try
+{
+publishingSocket->send(inputData, inputDataSize);
+}
+catch(const std::exception &inputException)
+{ //Can't throw into the receiver's thread, so stop forwarding instead of killing a reactor
+directForwardingHasFailed = true;
+
+data_receiver_status_notification notification;
+notification.set_unrecoverable_error_has_occurred(true);
+
+try
+{
+sendProtobufMessage(*notificationPublishingSocket, notification);
+}
+catch(const std::exception &inputNotificationException)
+{
+fprintf(stderr, "%s", inputNotificationException.what());
+}
+}
+}
+
+/**
+This function detaches from the source receiver, if attached.
+*/
+zmqDataSender::~zmqDataSender()
+{
+if(directSource != nullptr)
+{
+directSource->remove(this);
+}
+}
+
 /**
 This function forwards any received messages to the publisher socket
 @param inputReactor: The reactor which called the function
@@ -13,6 +13,7 @@
 #include "zmq.hpp"
 #include "reactor.hpp"
 #include "utilityFunctions.hpp"
+#include "directDataSink.hpp"
 #include "data_receiver_status_notification.pb.h" 
 
 namespace pylongps
@@ -20,9 +21,9 @@ namespace pylongps
 
 
 /**
-This class takes data published on an inproc ZMQ PUB socket and forwards it to a tcp ZMQ PUB socket. 
+This class takes data published on an inproc ZMQ PUB socket and forwards it to a tcp ZMQ PUB socket.  If it is given the direct data sinks of a receiver in the same process, it instead forwards each message from the receiver's thread and doesn't start a thread of its own.
 */
-class zmqDataSender : public dataSender
+class zmqDataSender : public dataSender, public directDataSink
 {
 public:
 /**
@@ -30,10 +31,11 @@ This function initializes the zmqDataSender to publish data using a ZMQ PUB sock
 @param inputSourceConnectionString: The connection string to use to subscribe to the ZMQ PUB socket that is providing the data
 @param inputContext: A reference to the ZMQ context to use
 @param inputPortNumberToPublishOn: The TCP port number to bind/use for publishing
+@param inputDirectSource: If not nullptr, the sinks of the receiver publishing at the source connection string, which this object attaches to in place of subscribing (the receiver must outlive this object)
 
 @throws: This function can throw exceptions
 */
-zmqDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, int inputPortNumberToPublishOn);
+zmqDataSender(const std::string &inputSourceConnectionString, zmq::context_t &inputContext, int inputPortNumberToPublishOn, directDataSinkList *inputDirectSource = nullptr);
 
 
 
@@ -43,6 +45,18 @@ This function is required to return a ZMQ inproc address which can be used with
 */
 virtual std::string notificationAddress();
 
+/**
+This function forwards a message handed over directly by the source receiver (on the receiver's thread).  If forwarding fails, a notification is sent and later messages are dropped.
+@param inputData: The message
+@param inputDataSize: The size of the message in bytes
+*/
+virtual void handleDirectData(const char *inputData, uint64_t inputDataSize);
+
+/**
+This function detaches from the source receiver, if attached.
+*/
+~zmqDataSender();
+
 zmq::context_t &context;
 std::unique_ptr<zmq::socket_t> subscriberSocket;
 std::unique_ptr<zmq::socket_t> publishingSocket;
@@ -50,6 +64,8 @@ std::unique_ptr<zmq::socket_t> notificationPublishingSocket;
 std::string informationSourceConnectionString; //String used to connect to the data source
 std::string notificationConnectionString; //String used to publish status changes (such as unrecoverable disconnects)
 std::unique_ptr<reactor<zmqDataSender> > senderReactor;
+directDataSinkList *directSource = nullptr; //Not owned, the sinks this object is attached to in place of senderReactor if not nullptr
+bool directForwardingHasFailed = false; //Only used by the source receiver's thread
 
 protected:
 /**